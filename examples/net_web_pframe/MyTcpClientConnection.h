@@ -32,9 +32,10 @@ namespace stm32plus {
       // class but it has not yet initialised itself from those parameters
       // therefore we are able to tune them for our needs
 
-      // increase receive buffer size to 3xMSL for better throughput
+      // increase receive buffer size to nearly 3xMSS for better throughput. the buffer
+      // is a power of 2 in size.
 
-      _params.tcp_receiveBufferSize=4380;
+      _params.tcp_receiveBufferSize=4096;
     }
   }
 }
@@ -6,6 +6,10 @@
 
 #pragma once
 
+// font depends on smartptr
+
+#include "config/smartptr.h"
+
 // include the feature
 
 #include "display/graphic/FontChar.h"
@@ -62,7 +62,10 @@
 #include "display/graphic/PanelConfiguration.h"
 #include "display/graphic/PicoJpeg.h"
 #include "display/graphic/JpegDecoder.h"
+#include "display/graphic/GlyphCache.h"
 #include "display/graphic/GraphicsLibrary.h"
+#include "display/graphic/framebuffer/DirtyRectangleList.h"
+#include "display/graphic/framebuffer/FrameBufferDevice.h"
 
 // include the optimised GPIO drivers in specialisation order
 
@@ -48,13 +48,16 @@
 #include "filesystem/fat/DirectoryEntryIterator.h"
 
 #include "filesystem/fat/ClusterChainIterator.h"
+#include "filesystem/fat/ClusterExtentMap.h"
 #include "filesystem/fat/FatFileInformation.h"
 #include "filesystem/fat/FatIterator.h"
 #include "filesystem/fat/FileSectorIterator.h"
 #include "filesystem/fat/LongNameDirentGenerator.h"
 #include "filesystem/fat/NormalDirectoryEntryIterator.h"
 
+#include "filesystem/fat/FreeClusterBitmap.h"
 #include "filesystem/fat/FreeClusterFinder.h"
+#include "filesystem/fat/BitmapFreeClusterFinder.h"
 #include "filesystem/fat/IteratingFreeClusterFinder.h"
 #include "filesystem/fat/LinearFreeClusterFinder.h"
 #include "filesystem/fat/WearResistFreeClusterFinder.h"
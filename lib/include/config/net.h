@@ -44,9 +44,12 @@
 #include "net/EtherType.h"
 #include "net/NetUtil.h"
 #include "net/datalink/DatalinkChecksum.h"
+#include "net/NetBufferPool.h"
+#include "net/NetBufferSegment.h"
 #include "net/NetBuffer.h"
 #include "net/NetEventDescriptor.h"
 #include "net/NetworkErrorEvent.h"
+#include "net/NetEventSource.h"
 #include "net/NetworkEvents.h"
 #include "net/NetworkDebugEvent.h"
 #include "net/NetworkIntervalTicker.h"
@@ -166,15 +169,18 @@
 #include "net/transport/tcp/TcpConnectionStateChangedEvent.h"
 #include "net/transport/tcp/TcpConnectionState.h"
 #include "net/transport/tcp/TcpClosingConnectionState.h"
+#include "net/transport/tcp/TcpConnectionTable.h"
 #include "net/transport/tcp/TcpEvents.h"
 #include "net/transport/tcp/TcpFindConnectionNotificationEvent.h"
 #include "net/transport/tcp/TcpConnectionReleasedEvent.h"
 #include "net/transport/tcp/TcpConnectionClosedEvent.h"
 #include "net/transport/tcp/TcpConnectionDataReadyEvent.h"
 #include "net/transport/tcp/TcpReceiveBuffer.h"
+#include "net/transport/tcp/TcpReassemblyQueue.h"
+#include "net/transport/tcp/TcpResendDelayCalculator.h"
+#include "net/transport/tcp/TcpCongestionControl.h"
 #include "net/transport/tcp/TcpConnection.h"
 #include "net/transport/tcp/TcpClientConnection.h"
-#include "net/transport/tcp/TcpResendDelayCalculator.h"
 #include "net/transport/tcp/TcpAcceptEvent.h"
 #include "net/transport/tcp/TcpServerReleasedEvent.h"
 #include "net/transport/tcp/TcpServerBase.h"
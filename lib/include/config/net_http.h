@@ -23,6 +23,9 @@
 
 #include "net/application/http/HttpVersion.h"
 #include "net/application/http/HttpMethod.h"
+#include "net/application/http/HttpStaticAsset.h"
+#include "net/application/http/HttpServerMetrics.h"
+#include "net/application/http/HttpChunkedInputStream.h"
 #include "net/application/http/HttpServerConnection.h"
 #include "net/application/http/HttpClient.h"
 
@@ -25,4 +25,5 @@
 #include "string/StringUtil.h"
 #include "string/TokenisedString.h"
 #include "string/StdStringUtil.h"
+#include "string/StringView.h"
 #include "string/Ascii.h"
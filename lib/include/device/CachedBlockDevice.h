@@ -14,35 +14,102 @@ namespace stm32plus {
    * @brief Specialisation of BlockDevice to provide in-memory caching.
    *
    * This class subclasses BlockDevice and provides in-memory caching of recently
-   * used blocks. The cache is write-through. A user of this class must ensure
-   * that he has enough RAM in his device to support the desired cache size.
+   * used blocks. A user of this class must ensure that he has enough RAM in his
+   * device to support the desired cache size.
+   *
+   * Blocks are located through a hash index and recency is tracked with an intrusive
+   * doubly linked LRU list so that lookup, hit and eviction are all constant time.
+   *
+   * The cache can be write-through (the default) or write-back. In write-back mode
+   * written blocks are held dirty in RAM until they are evicted or flush() is called.
+   * When dirty blocks are written back, runs of consecutive block indices that occupy
+   * adjacent cache slots are coalesced into a single writeBlocks() call on the
+   * underlying device. The destructor flushes any remaining dirty blocks.
+   *
+   * The constructor allocates the cache, which can fail. Check isValid() before using it.
    */
 
   class CachedBlockDevice : public BlockDevice {
 
+    public:
+
+      /**
+       * Error codes
+       */
+
+      enum {
+        /// the number of cached blocks is zero or more than the maximum of 65534
+        E_INVALID_CACHE_SIZE=3,
+
+        /// the memory for the cache could not be allocated
+        E_OUT_OF_MEMORY=4,
+
+        /// the cache is not valid and cannot be used
+        E_NOT_VALID=5
+      };
+
+      /**
+       * Write policy for the cache
+       */
+
+      enum WritePolicy {
+        /// writes go straight to the device and update the cache
+        WRITE_THROUGH,
+
+        /// writes go to the cache and are written to the device on eviction or flush()
+        WRITE_BACK
+      };
+
     protected:
 
       struct CacheEntry {
           uint32_t BlockIndex;
-          uint32_t CacheIndex;
+          uint16_t Prev;          // LRU list towards the head (most recent)
+          uint16_t Next;          // LRU list towards the tail (least recent)
+          uint16_t HashNext;      // hash bucket chain
+          bool Dirty;
       };
 
       BlockDevice& _device;
       uint32_t _numCachedBlocks;
-      uint8_t **_cachedBlocks;
+      uint8_t *_cacheMemory;
       CacheEntry *_cacheIndex;
+      uint16_t *_hashBuckets;
+      uint32_t _hashMask;
+      uint16_t _lruHead;
+      uint16_t _lruTail;
       uint32_t _blockSize;
+      uint32_t _dirtyCount;
+      WritePolicy _writePolicy;
+      bool _valid;
 
       static constexpr uint32_t FREE_CACHE_ENTRY=0xFFFFFFFF;
+      static constexpr uint16_t NO_ENTRY=0xFFFF;
+      static constexpr uint32_t MAX_CACHED_BLOCKS=NO_ENTRY-1;
 
     protected:
-      void writeToCache(const void *data,uint32_t blockIndex);
-      void moveToFront(uint32_t index);
+      uint8_t *getBlockData(uint16_t entry) const;
+      uint32_t hash(uint32_t blockIndex) const;
+
+      uint16_t findEntry(uint32_t blockIndex) const;
+      bool allocateEntry(uint32_t blockIndex,uint16_t& entry);
+      bool writeToCache(const void *data,uint32_t blockIndex,bool dirty);
+      bool writeBackRun(uint16_t entry);
+
+      void hashInsert(uint16_t entry);
+      void hashRemove(uint16_t entry);
+      void moveToFront(uint16_t entry);
 
     public:
-      CachedBlockDevice(BlockDevice& bd,uint32_t numCachedBlocks);
+      CachedBlockDevice(BlockDevice& bd,uint32_t numCachedBlocks,WritePolicy writePolicy=WRITE_THROUGH);
       virtual ~CachedBlockDevice();
 
+      bool isValid() const;
+      bool flush();
+
+      uint32_t getDirtyBlockCount() const;
+      WritePolicy getWritePolicy() const;
+
       // overrides from BlockDevice
 
       virtual uint32_t getBlockSizeInBytes() override;
@@ -57,5 +124,35 @@ namespace stm32plus {
 
       virtual formatType getFormatType() override;
   };
-}
 
+
+  /**
+   * Check that the constructor's arguments were good and that it got the memory that it
+   * needed. The block operations of a cache that isn't valid fail.
+   * @return true if the cache is usable
+   */
+
+  inline bool CachedBlockDevice::isValid() const {
+    return _valid;
+  }
+
+
+  /**
+   * Get the number of blocks that are in the cache but not yet written to the device
+   * @return The dirty block count. Always zero for a write-through cache.
+   */
+
+  inline uint32_t CachedBlockDevice::getDirtyBlockCount() const {
+    return _dirtyCount;
+  }
+
+
+  /**
+   * Get the write policy that this cache was constructed with
+   * @return WRITE_THROUGH or WRITE_BACK
+   */
+
+  inline CachedBlockDevice::WritePolicy CachedBlockDevice::getWritePolicy() const {
+    return _writePolicy;
+  }
+}
@@ -24,11 +24,18 @@ namespace stm32plus {
 
         enum FontType {
           FONT_BITMAP,//!< FONT_BITMAP
-          FONT_LZG    //!< FONT_LZG
+          FONT_LZG,   //!< FONT_LZG
+          FONT_RLE,   //!< FONT_RLE
+          FONT_ANTIALIASED  //!< FONT_ANTIALIASED
         } _fontType;
 
+        enum {
+          NO_CHARACTER=0xff   ///< marks a gap in the character index
+        };
+
       private:
         const struct FontChar * _characters;
+        scoped_array<uint8_t> _index;
         uint8_t _characterCount;
         uint8_t _firstCharacter;
         uint8_t _height;
@@ -58,51 +65,51 @@ namespace stm32plus {
         _height(height),
         _characterSpacing(spacing) {
 
+      uint16_t i,range;
+
       _lastCharacter=_characters[characterCount-1].Code;
-    }
 
+      // most fonts are a contiguous run of codes and can be indexed directly. the others get a
+      // table that maps each code in the range to its position so that a lookup is never a search
 
-    /**
-     * Get the font character definition address
-     */
+      range=_lastCharacter-_firstCharacter+1;
 
-    inline void FontBase::getCharacter(uint8_t character,const FontChar*& fc) const {
+      if(range!=_characterCount) {
 
-      const FontChar *ptr;
-      int16_t i;
+        _index.reset(new uint8_t[range]);
+        memset(_index.get(),NO_CHARACTER,range);
+
+        for(i=0;i<_characterCount;i++)
+          _index[_characters[i].Code-_firstCharacter]=i;
+      }
+    }
 
-      // the bulk of the characters are in sequential order, see if we can
-      // index directly into the character array to find it
 
-      ptr=nullptr;
+    /**
+     * Get the font character definition address. This is a constant time lookup for both
+     * contiguous and sparse fonts.
+     * @param character The character code
+     * @param[out] fc The character definition, or the first character if the font doesn't have it
+     */
 
-      if(character>=_firstCharacter && character<_lastCharacter) {
+    inline void FontBase::getCharacter(uint8_t character,const FontChar*& fc) const {
 
-        // the character is in range and indexable, is it in sequential place?
+      uint8_t pos;
 
-        if(character-_firstCharacter<_characterCount && _characters[character-_firstCharacter].Code==character)
-          ptr=&_characters[character-_firstCharacter];
-        else {
+      if(character>=_firstCharacter && character<=_lastCharacter) {
 
-          // did't find it, search for it going backwards because the likelihood is that
-          // it's towards the end of the array
+        pos=character-_firstCharacter;
 
-          for(i=_characterCount-1;i>=0;i--) {
+        if(_index.get()!=nullptr)
+          pos=_index[pos];
 
-            if(_characters[i].Code==character) {
-              ptr=&_characters[i];
-              break;
-            }
-          }
+        if(pos!=NO_CHARACTER) {
+          fc=&_characters[pos];
+          return;
         }
       }
 
-      if(ptr==nullptr)
-        ptr=&_characters[0];        // didn't found it, default to first char so user knows something is wrong
-
-      // set up the return data
-
-      fc=ptr;
+      fc=&_characters[0];        // didn't find it, default to first char so user knows something is wrong
     }
 
 
@@ -124,12 +131,27 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the font type
+     */
+
+    inline FontBase::FontType FontBase::getType() const {
+      return _fontType;
+    }
+
+
     /**
      * stub types to allow method overloading in the GraphicsLibrary class. this first one is for
      * bitmap fonts - the original font format
      */
 
     class Font : public FontBase {
+
+      protected:
+        Font(FontType type,uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing,const struct FontChar *characters)
+          : FontBase(type,firstChar,characterCount,height,spacing,characters) {
+        }
+
       public:
         Font(uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing,const struct FontChar *characters)
           : FontBase(FONT_BITMAP,firstChar,characterCount,height,spacing,characters) {
@@ -137,6 +159,23 @@ namespace stm32plus {
     };
 
 
+    /**
+     * A bitmap font stored as run lengths. The pixels of each character are taken left to right,
+     * top to bottom as for a bitmap font and the data is the length of each run of identical
+     * pixels, one byte per run. Runs alternate between background and foreground starting with
+     * background, which may be a zero length run. A run longer than 255 is split by a zero
+     * length run of the other colour. Larger fonts are smaller this way and the renderer deals
+     * in runs rather than testing every bit. Being a Font, it can be used anywhere a Font can.
+     */
+
+    class RleFont : public Font {
+      public:
+        RleFont(uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing,const struct FontChar *characters)
+          : Font(FONT_RLE,firstChar,characterCount,height,spacing,characters) {
+        }
+    };
+
+
     /**
      * and this one is for the Lzg TrueType fonts
      */
@@ -147,5 +186,39 @@ namespace stm32plus {
           : FontBase(FONT_LZG,firstChar,characterCount,height,spacing,characters) {
         }
     };
+
+
+    /**
+     * An anti-aliased font with 2 or 4 bits per pixel. Each pixel is the coverage of the
+     * character from 0 (background) to 3 or 15 (foreground) and the pixels are packed in the
+     * same order as a bitmap font: left to right, top to bottom, starting at the least
+     * significant bits of each byte and carrying on across the end of each row. Unlike the LZG
+     * fonts the colours aren't part of the font, they're blended from the current foreground
+     * and background when the text is drawn.
+     */
+
+    class AntiAliasedFont : public FontBase {
+
+      protected:
+        uint8_t _bitsPerPixel;
+
+      public:
+        AntiAliasedFont(uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing,uint8_t bitsPerPixel,const struct FontChar *characters)
+          : FontBase(FONT_ANTIALIASED,firstChar,characterCount,height,spacing,characters),
+            _bitsPerPixel(bitsPerPixel) {
+        }
+
+        uint8_t getBitsPerPixel() const;
+    };
+
+
+    /**
+     * Get the number of bits in each pixel
+     * @return 2 or 4
+     */
+
+    inline uint8_t AntiAliasedFont::getBitsPerPixel() const {
+      return _bitsPerPixel;
+    }
   }
 }
@@ -0,0 +1,228 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * A cache of characters that have already been expanded into panel colours. Each slot holds
+     * one character as an array of pixels in the foreground and background colours that were
+     * selected when it was expanded, ready to be sent to the panel with rawTransfer(). A slot only
+     * matches when the colours do as well, so text drawn in a few colour pairs shares the cache
+     * without flushing it.
+     *
+     * The slots are arranged in pairs and a character can only live in the pair chosen by the
+     * address of its definition, so a lookup is two comparisons however big the cache is. The
+     * characters of a font are consecutive in memory and so spread evenly over the pairs. The
+     * least recently used of the pair is replaced, but never one that has been handed out since
+     * the last beginBatch() so that the pointers a caller is holding while it draws a group of
+     * characters stay valid.
+     *
+     * Give one to the graphics library with setGlyphCache(). Text with a filled background is
+     * then sent from here instead of being decoded from the font each time, which pays off on
+     * screens that keep redrawing the same characters. Characters larger than a slot are
+     * decoded as normal.
+     *
+     * @tparam TUnpackedColour The panel's UnpackedColour type. GraphicsLibrary has a tGLYPHCACHE
+     * typedef for the matching cache.
+     */
+
+    template<class TUnpackedColour>
+    class GlyphCache {
+
+      protected:
+
+        struct Slot {
+          const FontChar *Character;      // nullptr if free
+          TUnpackedColour Foreground;
+          TUnpackedColour Background;
+          uint32_t LastUsed;
+        };
+
+        Slot *_slots;
+        TUnpackedColour *_pixels;
+        TUnpackedColour _foreground;      // colours of the current batch
+        TUnpackedColour _background;
+        uint32_t _clock;
+        uint32_t _batchStart;
+        uint16_t _slotCount;
+        uint16_t _slotPixels;
+
+      protected:
+        uint16_t getFirstSlot(const FontChar *fc) const;
+        bool isMatch(const Slot& slot,const FontChar *fc) const;
+
+      public:
+        GlyphCache(uint16_t slotCount,uint16_t slotPixels);
+        ~GlyphCache();
+
+        void beginBatch(const TUnpackedColour& foreground,const TUnpackedColour& background);
+        void clear();
+
+        const TUnpackedColour *find(const FontChar *fc);
+        TUnpackedColour *allocate(const FontChar *fc);
+
+        uint16_t getSlotPixels() const;
+    };
+
+
+    /**
+     * Constructor
+     * @param slotCount The number of characters to hold. It's rounded up to an even number.
+     * @param slotPixels The largest character in pixels (width x height) that can be held
+     */
+
+    template<class TUnpackedColour>
+    inline GlyphCache<TUnpackedColour>::GlyphCache(uint16_t slotCount,uint16_t slotPixels)
+      : _clock(0),
+        _batchStart(0),
+        _slotCount((slotCount+1) & ~1),
+        _slotPixels(slotPixels) {
+
+      _slots=new Slot[_slotCount];
+      _pixels=new TUnpackedColour[static_cast<uint32_t>(_slotCount)*slotPixels];
+
+      clear();
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    template<class TUnpackedColour>
+    inline GlyphCache<TUnpackedColour>::~GlyphCache() {
+      delete [] _slots;
+      delete [] _pixels;
+    }
+
+
+    /**
+     * Start drawing a group of characters in the given colours. find() and allocate() work in
+     * these colours until the next call.
+     * @param foreground The foreground colour
+     * @param background The background colour
+     */
+
+    template<class TUnpackedColour>
+    inline void GlyphCache<TUnpackedColour>::beginBatch(const TUnpackedColour& foreground,const TUnpackedColour& background) {
+
+      _batchStart=_clock;
+
+      memcpy(&_foreground,&foreground,sizeof(TUnpackedColour));
+      memcpy(&_background,&background,sizeof(TUnpackedColour));
+    }
+
+
+    /**
+     * Empty the cache
+     */
+
+    template<class TUnpackedColour>
+    inline void GlyphCache<TUnpackedColour>::clear() {
+
+      uint16_t i;
+
+      for(i=0;i<_slotCount;i++)
+        _slots[i].Character=nullptr;
+    }
+
+
+    /**
+     * Look for a character in the colours of the current batch
+     * @param fc The character definition
+     * @return The expanded pixels or nullptr if it's not cached
+     */
+
+    template<class TUnpackedColour>
+    inline const TUnpackedColour *GlyphCache<TUnpackedColour>::find(const FontChar *fc) {
+
+      uint16_t i,first;
+
+      first=getFirstSlot(fc);
+
+      for(i=first;i<first+2;i++) {
+
+        if(isMatch(_slots[i],fc)) {
+          _slots[i].LastUsed=++_clock;
+          return _pixels+static_cast<uint32_t>(i)*_slotPixels;
+        }
+      }
+
+      return nullptr;
+    }
+
+
+    /**
+     * Get a slot for a character that's not in the cache in the current colours. The caller must
+     * expand the character into the returned space before the next call to find().
+     * @param fc The character definition
+     * @return Space for getSlotPixels() pixels, or nullptr if both slots that it could go in are
+     * in use in this batch
+     */
+
+    template<class TUnpackedColour>
+    inline TUnpackedColour *GlyphCache<TUnpackedColour>::allocate(const FontChar *fc) {
+
+      uint16_t victim;
+
+      // prefer a free slot, then the older one
+
+      victim=getFirstSlot(fc);
+
+      if(_slots[victim].Character!=nullptr &&
+         (_slots[victim+1].Character==nullptr || _slots[victim+1].LastUsed<_slots[victim].LastUsed))
+        victim++;
+
+      if(_slots[victim].Character!=nullptr && _slots[victim].LastUsed>_batchStart)
+        return nullptr;
+
+      _slots[victim].Character=fc;
+      _slots[victim].LastUsed=++_clock;
+
+      memcpy(&_slots[victim].Foreground,&_foreground,sizeof(TUnpackedColour));
+      memcpy(&_slots[victim].Background,&_background,sizeof(TUnpackedColour));
+
+      return _pixels+static_cast<uint32_t>(victim)*_slotPixels;
+    }
+
+
+    /**
+     * Get the size of a slot
+     * @return The largest number of pixels in a character that can be cached
+     */
+
+    template<class TUnpackedColour>
+    inline uint16_t GlyphCache<TUnpackedColour>::getSlotPixels() const {
+      return _slotPixels;
+    }
+
+
+    /*
+     * Get the first of the pair of slots that a character can occupy
+     */
+
+    template<class TUnpackedColour>
+    inline uint16_t GlyphCache<TUnpackedColour>::getFirstSlot(const FontChar *fc) const {
+      return ((reinterpret_cast<uintptr_t>(fc)/sizeof(FontChar)) % (_slotCount/2))*2;
+    }
+
+
+    /*
+     * Return true if a slot holds the character in the colours of the current batch
+     */
+
+    template<class TUnpackedColour>
+    inline bool GlyphCache<TUnpackedColour>::isMatch(const Slot& slot,const FontChar *fc) const {
+      return slot.Character==fc &&
+             memcmp(&slot.Foreground,&_foreground,sizeof(TUnpackedColour))==0 &&
+             memcmp(&slot.Background,&_background,sizeof(TUnpackedColour))==0;
+    }
+  }
+}
@@ -17,6 +17,12 @@ namespace stm32plus {
      *
      * The font must be fixed width or wierd stuff will happen.
      *
+     * Text is kept in a grid of characters the size of the screen. Each call that writes to the
+     * terminal updates the grid and then sends each changed part of a line to the panel as a
+     * single string, so a burst of output costs a few windows per line rather than one per
+     * character. Lines that scroll off during a burst are scrolled away together at the end of
+     * it, and a burst longer than the screen simply clears it and draws what's left.
+     *
      * This class implements output stream so it can be used as a sink for data sourced from other
      * places. For example, see ConnectedInputOutputStream for a plumbing class that can be used to join an
      * input stream to an output stream.
@@ -32,6 +38,17 @@ namespace stm32plus {
     class GraphicTerminal : public OutputStream {
 
       protected:
+
+        /*
+         * What's on the panel in a line compared to what's in the grid
+         */
+
+        enum RowState {
+          ROW_DRAWN,          // the panel shows the line except for the dirty columns
+          ROW_BLANK,          // the panel line is blank, or will be once the pending scroll is done
+          ROW_NEEDS_CLEAR     // the panel line must be cleared before it's drawn
+        };
+
         TGraphicsLibrary& _gl;
         const Font *_font;
         bool _autoLineFeed;
@@ -42,10 +59,21 @@ namespace stm32plus {
         uint8_t _smoothScrollStep;
         int16_t _scrollPosition;
 
+        scoped_array<char> _grid;           // _terminalSize.Width+1 characters per line
+        scoped_array<uint8_t> _dirtyStart;  // first changed column in each line
+        scoped_array<uint8_t> _dirtyEnd;    // one past the last changed column
+        scoped_array<uint8_t> _rowState;    // RowState for each line
+        uint16_t _pendingScroll;            // lines to scroll before the next update
+        bool _clearPending;                 // clear the panel before the next update
+
       protected:
         void calcTerminalSize();
         void incrementY();
         void scroll();
+        void resetRow(int16_t row,RowState state);
+        void addCharacter(char c);
+        void update();
+        void drawRow(int16_t row);
 
       public:
         enum {
@@ -83,7 +111,7 @@ namespace stm32plus {
         virtual bool write(const void *buffer,uint32_t size) override;
 
         virtual bool close() override { return true; }
-        virtual bool flush() override { return true; }
+        virtual bool flush() override { update(); return true; }
     };
 
 
@@ -94,6 +122,9 @@ namespace stm32plus {
      * @param gl The graphics library (LCD implementation class) to use
      * @param font The font to use, or nullptr to get it from the graphics library selection
      * @param autoLineFeed true to add a line feed when a carriage return is received.
+     * @param smoothScrollStep Milliseconds between each step of a hardware scroll, or NO_SMOOTH_SCROLLING
+     * to jump straight to the new position. However many lines are scrolled at once it takes one font
+     * height's worth of steps.
      */
 
     template<class TGraphicsLibrary,bool THardwareScrolling>
@@ -106,9 +137,23 @@ namespace stm32plus {
         _font(font==nullptr ? gl.getStreamSelectedFont() : font),
         _autoLineFeed(autoLineFeed),
         _smoothScrollStep(smoothScrollStep),
-        _scrollPosition(0) {
+        _scrollPosition(0),
+        _pendingScroll(0),
+        _clearPending(false) {
+
+      int16_t i;
 
       calcTerminalSize();
+
+      // the grid has room for a terminating nul on each line so that a line can be written directly
+
+      _grid.reset(new char[(_terminalSize.Width+1)*_terminalSize.Height]);
+      _dirtyStart.reset(new uint8_t[_terminalSize.Height]);
+      _dirtyEnd.reset(new uint8_t[_terminalSize.Height]);
+      _rowState.reset(new uint8_t[_terminalSize.Height]);
+
+      for(i=0;i<_terminalSize.Height;i++)
+        resetRow(i,ROW_DRAWN);
     }
 
 
@@ -128,9 +173,10 @@ namespace stm32plus {
       _fontSize.Height=_font->getHeight();
       _fontSize.Width=fc->PixelWidth;
 
-      // height is rounded down if the fixed lines don't sum to a multiple of the font height
+      // height is rounded down if the fixed lines don't sum to a multiple of the font height.
+      // the dirty columns are bytes so the width is limited to what they can hold
 
-      _terminalSize.Width=_gl.getWidth()/fc->PixelWidth;
+      _terminalSize.Width=std::min(_gl.getWidth()/fc->PixelWidth,255);
       _terminalSize.Height=_gl.getHeight()/_font->getHeight();
     }
 
@@ -142,6 +188,8 @@ namespace stm32plus {
     template<class TGraphicsLibrary,bool THardwareScrolling>
     inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::clearScreen() {
 
+      int16_t i;
+
       // clear the display
 
       _gl.clearScreen();
@@ -149,6 +197,14 @@ namespace stm32plus {
       _cursor.X=0;
       _cursor.Y=0;
 
+      // the panel is blank and nothing is waiting to go to it
+
+      for(i=0;i<_terminalSize.Height;i++)
+        resetRow(i,ROW_DRAWN);
+
+      _pendingScroll=0;
+      _clearPending=false;
+
       // reset the scroll position if hardware scrolling is supported
 
       if(THardwareScrolling) {
@@ -165,16 +221,16 @@ namespace stm32plus {
     template<class TGraphicsLibrary,bool THardwareScrolling>
     inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::clearLine() {
 
-      Rectangle rc;
+      int16_t row;
 
-      rc.X=0;
-      rc.Y=(_cursor.Y % _terminalSize.Height)*_fontSize.Height;
-      rc.Height=_fontSize.Height;
-      rc.Width=_terminalSize.Width*_fontSize.Width;
+      row=_cursor.Y % _terminalSize.Height;
 
-      _gl.clearRectangle(rc);
+      // a line that's blank already or about to be doesn't need clearing again
 
+      resetRow(row,_rowState[row]==ROW_DRAWN ? ROW_NEEDS_CLEAR : static_cast<RowState>(_rowState[row]));
       _cursor.X=0;
+
+      update();
     }
 
 
@@ -186,7 +242,9 @@ namespace stm32plus {
     inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::writeString(const char *str) {
 
       const char *ptr;
-      for(ptr=str;*ptr;writeCharacter(*ptr++));
+
+      for(ptr=str;*ptr;addCharacter(*ptr++));
+      update();
     }
 
 
@@ -196,9 +254,19 @@ namespace stm32plus {
 
     template<class TGraphicsLibrary,bool THardwareScrolling>
     inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::writeCharacter(char c) {
+      addCharacter(c);
+      update();
+    }
+
+
+    /*
+     * Put a character in the grid and move the cursor on
+     */
+
+    template<class TGraphicsLibrary,bool THardwareScrolling>
+    inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::addCharacter(char c) {
 
-      char buffer[2];
-      Point p;
+      int16_t row;
 
       if(c=='\n') {
 
@@ -213,19 +281,20 @@ namespace stm32plus {
         _cursor.X=0;
       } else {
 
-        // scale up the x,y character co-ords to pixel co-ords
+        row=_cursor.Y % _terminalSize.Height;
 
-        p.X=_cursor.X*_fontSize.Width;
-        p.Y=(_cursor.Y % _terminalSize.Height)*_fontSize.Height;
+        _grid[row*(_terminalSize.Width+1)+_cursor.X]=c;
 
-        // create a string
+        // widen the changed part of the line
 
-        buffer[0]=c;
-        buffer[1]='\0';
-
-        // move the cursor and write
-
-        _gl.writeString(p,*_font,buffer);
+        if(_dirtyStart[row]>=_dirtyEnd[row]) {
+          _dirtyStart[row]=_cursor.X;
+          _dirtyEnd[row]=_cursor.X+1;
+        }
+        else {
+          _dirtyStart[row]=std::min<uint8_t>(_dirtyStart[row],_cursor.X);
+          _dirtyEnd[row]=std::max<uint8_t>(_dirtyEnd[row],_cursor.X+1);
+        }
 
         if(++_cursor.X >= _terminalSize.Width) {
           _cursor.X=0;
@@ -238,62 +307,204 @@ namespace stm32plus {
     /**
      * Increment the row and scroll if we have hit the bottom. If the LCD implementation supports
      * hardware scrolling then we will use it, otherwise we just clear the display and start again
-     * at the top left.
+     * at the top left. Either way nothing happens on the panel until the next update.
      */
 
     template<class TGraphicsLibrary,bool THardwareScrolling>
     inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::incrementY() {
 
+      int16_t i;
+
       _cursor.Y++;
 
       if(THardwareScrolling) {
-        if(_cursor.Y>=_terminalSize.Height)
-          scroll();
+
+        if(_cursor.Y>=_terminalSize.Height) {
+
+          // the new line is the one that's about to scroll off the top. the scroll will clear it.
+
+          resetRow(_cursor.Y % _terminalSize.Height,ROW_BLANK);
+          _pendingScroll++;
+
+          // don't allow the cursor to run away and overflow
+
+          if(_cursor.Y==_terminalSize.Height*2)
+            _cursor.Y=_terminalSize.Height;
+        }
+      }
+      else if(_cursor.Y>=_terminalSize.Height) {
+
+        for(i=0;i<_terminalSize.Height;i++)
+          resetRow(i,ROW_BLANK);
+
+        _cursor.Y=0;
+        _clearPending=true;
+      }
+    }
+
+
+    /*
+     * Blank a line in the grid
+     */
+
+    template<class TGraphicsLibrary,bool THardwareScrolling>
+    inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::resetRow(int16_t row,RowState state) {
+
+      char *line;
+
+      line=&_grid[row*(_terminalSize.Width+1)];
+
+      memset(line,' ',_terminalSize.Width);
+      line[_terminalSize.Width]='\0';
+
+      _dirtyStart[row]=_dirtyEnd[row]=0;
+      _rowState[row]=state;
+    }
+
+
+    /*
+     * Bring the panel up to date with the grid. Any pending clear or scroll is done first and then
+     * each line that has changed is drawn.
+     */
+
+    template<class TGraphicsLibrary,bool THardwareScrolling>
+    inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::update() {
+
+      int16_t row;
+
+      if(_clearPending) {
+        _gl.clearScreen();
+        _clearPending=false;
+      }
+
+      if(THardwareScrolling && _pendingScroll)
+        scroll();
+
+      for(row=0;row<_terminalSize.Height;row++)
+        if(_rowState[row]!=ROW_DRAWN || _dirtyStart[row]<_dirtyEnd[row])
+          drawRow(row);
+    }
+
+
+    /*
+     * Draw the changed part of a line as a single string. A line that's blank on the panel only
+     * needs its non-space characters drawn.
+     */
+
+    template<class TGraphicsLibrary,bool THardwareScrolling>
+    inline void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::drawRow(int16_t row) {
+
+      char *line,saved;
+      uint8_t first,last;
+      Rectangle rc;
+
+      line=&_grid[row*(_terminalSize.Width+1)];
+
+      first=_dirtyStart[row];
+      last=_dirtyEnd[row];
+
+      if(_rowState[row]!=ROW_DRAWN) {
+
+        if(_rowState[row]==ROW_NEEDS_CLEAR) {
+
+          rc.X=0;
+          rc.Y=row*_fontSize.Height;
+          rc.Height=_fontSize.Height;
+          rc.Width=_terminalSize.Width*_fontSize.Width;
+
+          _gl.clearRectangle(rc);
+        }
+
+        while(first<last && line[first]==' ')
+          first++;
+
+        while(last>first && line[last-1]==' ')
+          last--;
+      }
+
+      // terminate the line at the end of the changed part for the duration of the write
+
+      if(first<last) {
+
+        saved=line[last];
+        line[last]='\0';
+
+        _gl.writeString(Point(first*_fontSize.Width,row*_fontSize.Height),*_font,line+first);
+
+        line[last]=saved;
       }
-      else if(_cursor.Y>=_terminalSize.Height)
-        clearScreen();
+
+      _dirtyStart[row]=_dirtyEnd[row]=0;
+      _rowState[row]=ROW_DRAWN;
     }
 
 
     /**
-     * Scroll the display by one line
+     * Scroll the display by the pending number of lines and clear the lines that scroll in at the
+     * bottom. A smooth scroll moves that many pixels at each step so it takes the same time however
+     * far it goes. Scrolling the whole screen or more is the same as clearing it.
      */
 
     template<class TGraphicsLibrary,bool THardwareScrolling>
     void GraphicTerminal<TGraphicsLibrary,THardwareScrolling>::scroll() {
 
-      int i;
+      int16_t i,steps,step,screenHeight,position;
       Rectangle rc;
-      int16_t screenHeight;
 
       screenHeight=_gl.getHeight();
 
+      if(_pendingScroll>=_terminalSize.Height) {
+
+        _gl.clearScreen();
+
+        _scrollPosition=(_scrollPosition+static_cast<int32_t>(_pendingScroll)*_fontSize.Height) % screenHeight;
+        _gl.setScrollPosition(_scrollPosition);
+
+        _pendingScroll=0;
+        return;
+      }
+
       rc.Width=_gl.getWidth();
       rc.X=0;
 
-      // smooth scroll
+      if(_smoothScrollStep==NO_SMOOTH_SCROLLING) {
+        steps=1;
+        step=_pendingScroll*_fontSize.Height;
+      }
+      else {
+        steps=_fontSize.Height;
+        step=_pendingScroll;
+      }
 
-      rc.Height=1;
+      for(i=0;i<steps;i++) {
 
-      for(i=0;i<_fontSize.Height;i++) {
+        position=_scrollPosition;
 
-        _scrollPosition++;
+        _scrollPosition+=step;
 
-        if(_scrollPosition==screenHeight)
-          _scrollPosition=0;
+        if(_scrollPosition>=screenHeight)
+          _scrollPosition-=screenHeight;
 
         _gl.setScrollPosition(_scrollPosition);
 
-        rc.Y=_scrollPosition>0 ? _scrollPosition-1 : screenHeight-1;
+        // clear the pixel rows that just went off the top, they're now at the bottom. they
+        // might wrap around the end of the display memory.
+
+        rc.Y=position;
+        rc.Height=std::min<int16_t>(step,screenHeight-position);
         _gl.clearRectangle(rc);
 
-        MillisecondTimer::delay(_smoothScrollStep);
-      }
+        if(rc.Height<step) {
+          rc.Y=0;
+          rc.Height=step-rc.Height;
+          _gl.clearRectangle(rc);
+        }
 
-      // don't allow the cursor to run away and overflow
+        if(_smoothScrollStep!=NO_SMOOTH_SCROLLING)
+          MillisecondTimer::delay(_smoothScrollStep);
+      }
 
-      if(_cursor.Y==_terminalSize.Height*2)
-        _cursor.Y=_terminalSize.Height;
+      _pendingScroll=0;
     }
 
     /**
@@ -405,7 +616,8 @@ namespace stm32plus {
 
     /**
      * Write many bytes. Each byte must be interpretable as a character to from the selected
-     * font for this to make any sense. Random binary input will result in odd things.
+     * font for this to make any sense. Random binary input will result in odd things. The
+     * panel is updated once, at the end.
      * @param[in] buffer The buffer of bytes
      * @param[in] size The number of bytes to write
      * @return always true
@@ -417,8 +629,9 @@ namespace stm32plus {
       const char *ptr=reinterpret_cast<const char *>(buffer);
 
       while(size--)
-        writeCharacter(*ptr++);
+        addCharacter(*ptr++);
 
+      update();
       return true;
     }
   }
@@ -24,18 +24,53 @@ namespace stm32plus {
     public:
       typedef typename TDevice::UnpackedColour UnpackedColour;    ///< Helper type for the unpacked colour structure
       typedef typename TDevice::tCOLOUR tCOLOUR;                  ///< Helper type for the packed colour type
+      typedef GlyphCache<UnpackedColour> tGLYPHCACHE;             ///< Helper type for a glyph cache that suits this panel
 
     protected:
 
       UnpackedColour _foreground;
       UnpackedColour _background;
+      tCOLOUR _foregroundRgb;             // #rrggbb copies of the colours for blending
+      tCOLOUR _backgroundRgb;
 
       Point _streamSelectedPoint;         // need to keep a copy so rvalue points can be used
       const Font *_streamSelectedFont;    // can keep a ptr, user should not delete font while selected
       bool _fontFilledBackground;         // true to use filled backgrounds for fonts
+      tGLYPHCACHE *_glyphCache;           // optional, user owns it
+
+      enum {
+        MAX_BLIT_CHARACTERS=16,           // characters written to the panel in one window
+        MAX_ALPHA_LEVELS=16               // coverage levels in a 4 bit anti-aliased font
+      };
+
+      /*
+       * Decoding state for one character of a bitmap or run length encoded font
+       */
+
+      struct GlyphCursor {
+        const UnpackedColour *Pixels;     // expanded pixels from the glyph cache, or nullptr to decode
+        const uint8_t *Data;              // the font data
+        uint16_t Remaining;               // RLE: pixels left in the current run
+        uint8_t Mask;                     // bitmap: the current bit
+        uint8_t Width;
+        bool Rle;
+        bool Foreground;                  // RLE: the colour of the current run
+      };
 
     protected:
-      void plot4EllipsePoints(int16_t cx,int16_t cy,int16_t x,int16_t y);
+      void fillQuadrants(int16_t left,int16_t top,int16_t right,int16_t bottom,int16_t a,int16_t b,bool outline);
+      void fillQuadrantRows(int16_t left,int16_t top,int16_t right,int16_t bottom,int16_t first,int16_t last,int16_t outer,int16_t inner);
+      static int16_t getPolygonEdgeX(const Point& p1,const Point& p2,int16_t y);
+
+      void beginGlyph(GlyphCursor& gc,const Font& font,const FontChar& fc) const;
+      static uint16_t nextGlyphRun(GlyphCursor& gc,uint16_t maxPixels,bool& foreground);
+      const UnpackedColour *getCachedGlyph(const Font& font,const FontChar& fc);
+      void writeGlyphs(const Point& p,const Font& font,const FontChar **glyphs,uint8_t count,uint8_t gap);
+      void writeGlyphSpans(const Point& p,const Font& font,const FontChar& fc);
+
+      void getAlphaPalette(uint8_t bitsPerPixel,UnpackedColour *palette) const;
+      void writeAlphaGlyphs(const Point& p,const AntiAliasedFont& font,const FontChar **glyphs,uint8_t count,uint8_t gap,const UnpackedColour *palette);
+      void writeAlphaGlyphSpans(const Point& p,const AntiAliasedFont& font,const FontChar& fc,const UnpackedColour *palette);
 
     public:
       GraphicsLibrary(TDeviceAccessMode& accessMode);
@@ -48,6 +83,8 @@ namespace stm32plus {
       void setBackground(tCOLOUR cr);
       void setBackground(uint8_t r,uint8_t g,uint8_t b);
 
+      void getBlendedColour(uint8_t alpha,UnpackedColour& cr) const;
+
       // panel querying
 
       int16_t getXmax() const;
@@ -57,11 +94,12 @@ namespace stm32plus {
       // text output methods
 
       void setFontFilledBackground(bool fontFilledBackground);
+      void setGlyphCache(tGLYPHCACHE *glyphCache);
 
       Size writeString(const Point& p,const Font& font,const char *str);
       void writeCharacterFill(const Point& p,const Font& font,const FontChar& fc);
       void writeCharacterNoFill(const Point& p,const Font& font,const FontChar& fc);
-      Size measureString(const Font& font,const char *str) const;
+      Size measureString(const FontBase& font,const char *str) const;
       const Font *getStreamSelectedFont() const;
 
       // text output methods - LZG fonts
@@ -69,6 +107,10 @@ namespace stm32plus {
       Size writeString(const Point& p,const LzgFont& font,const char *str);
       void writeCharacter(const Point& p,const LzgFont& font,const FontChar& fc);
 
+      // text output methods - anti-aliased fonts
+
+      Size writeString(const Point& p,const AntiAliasedFont& font,const char *str);
+
       // can't do these as a template with specialisation because you can't specialise
       // members in a template class that isn't also fully specialised
 
@@ -92,9 +134,13 @@ namespace stm32plus {
       void fillRectangle(const Rectangle& rc);
       void clearRectangle(const Rectangle& rc);
       void gradientFillRectangle(const Rectangle& rc,Direction dir,tCOLOUR first,tCOLOUR last);
+      void drawRoundedRectangle(const Rectangle& rc,int16_t radius);
+      void fillRoundedRectangle(const Rectangle& rc,int16_t radius);
       void drawEllipse(const Point& center,const Size& size);
       void fillEllipse(const Point& center,const Size& size);
       void drawLine(const Point& p1,const Point& p2);
+      void drawPolygon(const Point *points,uint16_t count);
+      void fillPolygon(const Point *points,uint16_t count);
 
       // bitmap handling
 
@@ -104,7 +150,10 @@ namespace stm32plus {
 
       // jpeg handling
 
-      void drawJpeg(const Rectangle& rc,InputStream& source);
+      bool drawJpeg(const Rectangle& rc,InputStream& source);
+
+      template<class TDmaCopierImpl>
+      bool drawJpeg(const Rectangle& rc,InputStream& source,DmaLcdWriter<TDmaCopierImpl>& dma,uint32_t priority=DMA_Priority_High);
     };
   }
 }
@@ -118,8 +167,10 @@ namespace stm32plus {
 #include "gl/Primitives.inl"
 #include "gl/Ellipse.inl"
 #include "gl/Rectangle.inl"
+#include "gl/Polygon.inl"
 #include "gl/Text.inl"
 #include "gl/LzgText.inl"
+#include "gl/AntiAliasedText.inl"
 #include "gl/Bitmap.inl"
 
 // the text operations use bitbanding on the f1 and f4. not available on the f0.
@@ -12,142 +12,383 @@ namespace stm32plus {
 
     /**
      * JPEG decoder. Implements the callback from the picoJpeg decoder to write
-     * 8x8 blocks to the screen.
+     * decoded pixels to the screen.
      *
      * Either call decode() to decode the whole JPEG or call beginDecode() then
      * endDecode() if you need access to the image dimensions
+     *
+     * The decoder works a row of MCUs at a time. Each MCU in the row is converted to
+     * the device's native pixel format in a band buffer that's the width of the image
+     * and the height of an MCU (8 or 16 lines). The band is then sent to the display
+     * with a single window command and one rawTransfer() or DMA transfer. A 320 pixel
+     * wide image needs a 5Kb band for 16 bit colour and 10Kb for colour subsampled
+     * (H2V2) images. The DMA variant needs two bands so that the next row can be
+     * decoded while the last one is transferred.
+     *
+     * If the band can't be allocated then the image is drawn one 8x8 block at a time
+     * which needs no extra memory but is much slower.
      */
 
     template<class TGraphicsLibrary>
     class JpegDecoder {
 
       protected:
+        typedef typename TGraphicsLibrary::UnpackedColour UnpackedColour;
+
         pjpeg_image_info_t _imageInfo;
 
+      protected:
+        bool decodeBand(UnpackedColour *band,int16_t bandHeight,TGraphicsLibrary& gl);
+        void storeBlock(UnpackedColour *dest,int16_t destStride,uint16_t srcOffset,int16_t width,int16_t height,TGraphicsLibrary& gl) const;
+        int16_t getBandHeight(int16_t mcuY) const;
+        uint32_t getBandPixels() const;
+
       public:
+        bool decode(const Point& pt,InputStream& is,TGraphicsLibrary& gl);
 
-        /**
-         * Convenience method to call begin, end
-         * @param pt
-         * @param is
-         * @param gl
-         */
+        template<class TDmaCopierImpl>
+        bool decode(const Point& pt,InputStream& is,TGraphicsLibrary& gl,DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority=DMA_Priority_High);
 
-        bool decode(const Point& pt,InputStream& is,TGraphicsLibrary& gl) {
+        bool beginDecode(InputStream& is,Size& size);
+        bool endDecode(const Point& pt,TGraphicsLibrary& gl);
 
-          Size size;
+        template<class TDmaCopierImpl>
+        bool endDecode(const Point& pt,TGraphicsLibrary& gl,DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority=DMA_Priority_High);
 
-          if(!beginDecode(is,size))
-            return false;
+        bool endDecodeBlocks(const Point& pt,TGraphicsLibrary& gl);
+    };
 
-          return endDecode(pt,gl);
-        }
 
+    /**
+     * Convenience method to call begin, end
+     * @param pt The top-left of the image on the display
+     * @param is The source of JPEG data
+     * @param gl The graphics library to draw on
+     * @return true if it works
+     */
 
-        /**
-         * Start decoding.
-         * @param is
-         * @param size
-         * @return true if it works
-         */
+    template<class TGraphicsLibrary>
+    inline bool JpegDecoder<TGraphicsLibrary>::decode(const Point& pt,InputStream& is,TGraphicsLibrary& gl) {
 
-        bool beginDecode(InputStream& is,Size& size) {
+      Size size;
 
-          // initialise the decoder
+      if(!beginDecode(is,size))
+        return false;
 
-          if(pjpeg_decode_init(&_imageInfo,is)!=0)
-            return false;
+      return endDecode(pt,gl);
+    }
 
-          size.Width=_imageInfo.m_width;
-          size.Height=_imageInfo.m_height;
 
-          return true;
-        }
+    /**
+     * Convenience method to call begin, end with DMA transfers to the display
+     * @param pt The top-left of the image on the display
+     * @param is The source of JPEG data
+     * @param gl The graphics library to draw on
+     * @param dma The DMA class used to transfer the data to the FSMC
+     * @param dataAddress The FSMC data address from the access mode's getDataAddress()
+     * @param priority The DMA priority constant
+     * @return true if it works
+     */
 
+    template<class TGraphicsLibrary>
+    template<class TDmaCopierImpl>
+    inline bool JpegDecoder<TGraphicsLibrary>::decode(const Point& pt,
+                                                      InputStream& is,
+                                                      TGraphicsLibrary& gl,
+                                                      DmaLcdWriter<TDmaCopierImpl>& dma,
+                                                      void *dataAddress,
+                                                      uint32_t priority) {
 
-        /**
-         * Decode the JPEG encoded data from the input stream, using the graphics library and display it
-         * at the point on screen.
-         * @param pt
-         * @param gl
-         */
+      Size size;
 
-        bool endDecode(const Point& pt,TGraphicsLibrary& gl) {
+      if(!beginDecode(is,size))
+        return false;
 
-          typename TGraphicsLibrary::UnpackedColour cr;
+      return endDecode(pt,gl,dma,dataAddress,priority);
+    }
 
-          int16_t mcu_x=0,mcu_y=0;
 
-          for(;;) {
+    /**
+     * Start decoding.
+     * @param is The source of JPEG data
+     * @param size The image dimensions are returned here
+     * @return true if it works
+     */
 
-            if(pjpeg_decode_mcu()!=0)
-              return false;
+    template<class TGraphicsLibrary>
+    inline bool JpegDecoder<TGraphicsLibrary>::beginDecode(InputStream& is,Size& size) {
 
-            if(mcu_y>=_imageInfo.m_MCUSPerCol)
-              return false;
+      // initialise the decoder
 
-            for(int y=0;y<_imageInfo.m_MCUHeight;y+=8) {
+      if(pjpeg_decode_init(&_imageInfo,is)!=0)
+        return false;
 
-              int by_limit=std::min<int>(8,_imageInfo.m_height-(mcu_y*_imageInfo.m_MCUHeight+y));
+      size.Width=_imageInfo.m_width;
+      size.Height=_imageInfo.m_height;
 
-              for(int x=0;x<_imageInfo.m_MCUWidth;x+=8) {
+      return true;
+    }
 
-                uint16_t src_ofs=(x*8U)+(y*16U);
 
-                uint8_t *pSrcR=_imageInfo.m_pMCUBufR+src_ofs;
-                uint8_t *pSrcG=_imageInfo.m_pMCUBufG+src_ofs;
-                uint8_t *pSrcB=_imageInfo.m_pMCUBufB+src_ofs;
+    /**
+     * Decode the JPEG encoded data from the input stream, using the graphics library and display it
+     * at the point on screen. Each row of MCUs is sent to the display with rawTransfer().
+     * @param pt The top-left of the image on the display
+     * @param gl The graphics library to draw on
+     * @return true if it works
+     */
 
-                int bx_limit=std::min(8,_imageInfo.m_width-(mcu_x*_imageInfo.m_MCUWidth+x));
+    template<class TGraphicsLibrary>
+    inline bool JpegDecoder<TGraphicsLibrary>::endDecode(const Point& pt,TGraphicsLibrary& gl) {
 
-                gl.moveTo(Rectangle(pt.X+mcu_x*_imageInfo.m_MCUWidth+x,pt.Y+mcu_y*_imageInfo.m_MCUHeight+y,bx_limit,by_limit));
-                gl.beginWriting();
+      UnpackedColour *band;
+      int16_t mcuY,bandHeight;
+      bool retval;
 
-                if(_imageInfo.m_scanType==PJPG_GRAYSCALE) {
+      if((band=new UnpackedColour[getBandPixels()])==nullptr)
+        return endDecodeBlocks(pt,gl);
 
-                  for(int by=0;by<by_limit;by++) {
+      retval=false;
 
-                    for(int bx=0;bx < bx_limit;bx++) {
-                      gl.unpackColour(*pSrcR,*pSrcR,*pSrcR,cr);
-                      gl.writePixel(cr);
-                      pSrcR++;
-                    }
+      for(mcuY=0;mcuY<_imageInfo.m_MCUSPerCol;mcuY++) {
 
-                    pSrcR+=(8-bx_limit);
-                  }
-                } else {
-                  for(int by=0;by<by_limit;by++) {
+        bandHeight=getBandHeight(mcuY);
 
-                    for(int bx=0;bx<bx_limit;bx++) {
+        if(!decodeBand(band,bandHeight,gl))
+          goto finished;
 
-                      gl.unpackColour(*pSrcR,*pSrcG,*pSrcB,cr);
+        // one window and one transfer for the whole band
 
-                      pSrcR++;
-                      pSrcG++;
-                      pSrcB++;
+        gl.moveTo(Rectangle(pt.X,pt.Y+mcuY*_imageInfo.m_MCUHeight,_imageInfo.m_width,bandHeight));
+        gl.beginWriting();
+        gl.rawTransfer(band,_imageInfo.m_width*bandHeight);
+      }
 
-                      gl.writePixel(cr);
-                    }
+      retval=true;
 
-                    pSrcR+=(8-bx_limit);
-                    pSrcG+=(8-bx_limit);
-                    pSrcB+=(8-bx_limit);
-                  }
-                }
-              }
-            }
+      finished:
+        delete [] band;
+        return retval;
+    }
+
+
+    /**
+     * Decode the JPEG encoded data and display it using DMA to transfer each row of MCUs to
+     * the display while the next one is decoded. The access mode must be the FSMC. A band
+     * must not exceed the 65535 transfer limit of the DMA peripheral, which is not a concern
+     * for the panels supported here.
+     * @param pt The top-left of the image on the display
+     * @param gl The graphics library to draw on
+     * @param dma The DMA class used to transfer the data to the FSMC
+     * @param dataAddress The FSMC data address from the access mode's getDataAddress()
+     * @param priority The DMA priority constant
+     * @return true if it works
+     */
+
+    template<class TGraphicsLibrary>
+    template<class TDmaCopierImpl>
+    inline bool JpegDecoder<TGraphicsLibrary>::endDecode(const Point& pt,
+                                                         TGraphicsLibrary& gl,
+                                                         DmaLcdWriter<TDmaCopierImpl>& dma,
+                                                         void *dataAddress,
+                                                         uint32_t priority) {
+
+      UnpackedColour *bands[2],*band;
+      int16_t mcuY,bandHeight;
+      bool retval;
+
+      bands[0]=new UnpackedColour[getBandPixels()];
+      bands[1]=new UnpackedColour[getBandPixels()];
+
+      if(bands[0]==nullptr || bands[1]==nullptr) {
+        delete [] bands[0];
+        delete [] bands[1];
+        return endDecode(pt,gl);
+      }
+
+      retval=false;
+
+      for(mcuY=0;mcuY<_imageInfo.m_MCUSPerCol;mcuY++) {
+
+        band=bands[mcuY & 1];
+        bandHeight=getBandHeight(mcuY);
+
+        // decode while the previous band is transferring
+
+        if(!decodeBand(band,bandHeight,gl))
+          goto finished;
+
+        // the display window can't be changed until the last transfer has finished
+
+        if(mcuY>0 && !dma.waitUntilComplete())
+          goto finished;
+
+        gl.moveTo(Rectangle(pt.X,pt.Y+mcuY*_imageInfo.m_MCUHeight,_imageInfo.m_width,bandHeight));
+        gl.beginWriting();
+
+        dma.beginCopyToLcd(dataAddress,band,_imageInfo.m_width*bandHeight*sizeof(UnpackedColour),priority);
+      }
+
+      retval=true;
+
+      finished:
+
+        // the last transfer must finish before the memory is freed
+
+        if(mcuY>0 && !dma.waitUntilComplete())
+          retval=false;
+
+        delete [] bands[0];
+        delete [] bands[1];
+
+        return retval;
+    }
+
+
+    /**
+     * Decode the JPEG and display it one 8x8 block at a time, writing a pixel at a time. This
+     * needs no memory beyond the decoder's own state but each block costs a window command.
+     * @param pt The top-left of the image on the display
+     * @param gl The graphics library to draw on
+     * @return true if it works
+     */
+
+    template<class TGraphicsLibrary>
+    inline bool JpegDecoder<TGraphicsLibrary>::endDecodeBlocks(const Point& pt,TGraphicsLibrary& gl) {
+
+      UnpackedColour cr[64];
+      int16_t mcuX,mcuY,x,y,left,top,blockWidth,blockHeight,i;
 
-            mcu_x++;
+      for(mcuY=0;mcuY<_imageInfo.m_MCUSPerCol;mcuY++) {
 
-            if(mcu_x==_imageInfo.m_MCUSPerRow) {
-              mcu_x=0;
-              mcu_y++;
+        top=mcuY*_imageInfo.m_MCUHeight;
+
+        for(mcuX=0;mcuX<_imageInfo.m_MCUSPerRow;mcuX++) {
+
+          if(pjpeg_decode_mcu()!=0)
+            return false;
+
+          left=mcuX*_imageInfo.m_MCUWidth;
+
+          for(y=0;y<_imageInfo.m_MCUHeight && top+y<_imageInfo.m_height;y+=8) {
+
+            blockHeight=std::min<int16_t>(8,_imageInfo.m_height-(top+y));
+
+            for(x=0;x<_imageInfo.m_MCUWidth && left+x<_imageInfo.m_width;x+=8) {
+
+              blockWidth=std::min<int16_t>(8,_imageInfo.m_width-(left+x));
+
+              storeBlock(cr,blockWidth,(x*8U)+(y*16U),blockWidth,blockHeight,gl);
+
+              gl.moveTo(Rectangle(pt.X+left+x,pt.Y+top+y,blockWidth,blockHeight));
+              gl.beginWriting();
+
+              for(i=0;i<blockWidth*blockHeight;i++)
+                gl.writePixel(cr[i]);
             }
           }
+        }
+      }
+
+      return true;
+    }
+
 
-          return true;
+    /*
+     * Decode a row of MCUs into the band. Each 8x8 block is converted into its place in the
+     * band, clipped to the image.
+     */
+
+    template<class TGraphicsLibrary>
+    inline bool JpegDecoder<TGraphicsLibrary>::decodeBand(UnpackedColour *band,int16_t bandHeight,TGraphicsLibrary& gl) {
+
+      int16_t mcuX,x,y,left;
+
+      for(mcuX=0;mcuX<_imageInfo.m_MCUSPerRow;mcuX++) {
+
+        if(pjpeg_decode_mcu()!=0)
+          return false;
+
+        left=mcuX*_imageInfo.m_MCUWidth;
+
+        for(y=0;y<bandHeight;y+=8) {
+          for(x=0;x<_imageInfo.m_MCUWidth && left+x<_imageInfo.m_width;x+=8) {
+
+            storeBlock(band+y*_imageInfo.m_width+left+x,
+                       _imageInfo.m_width,
+                       (x*8U)+(y*16U),
+                       std::min<int16_t>(8,_imageInfo.m_width-(left+x)),
+                       std::min<int16_t>(8,bandHeight-y),
+                       gl);
+          }
         }
-    };
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Convert part of an 8x8 block in the MCU buffers to the device format. The destination
+     * rows are destStride pixels apart. srcOffset is the position of the block in each of the
+     * R, G and B buffers. Greyscale images have only the R buffer.
+     */
+
+    template<class TGraphicsLibrary>
+    inline void JpegDecoder<TGraphicsLibrary>::storeBlock(UnpackedColour *dest,int16_t destStride,uint16_t srcOffset,int16_t width,int16_t height,TGraphicsLibrary& gl) const {
+
+      const uint8_t *r,*g,*b;
+      int16_t x,y;
+
+      r=_imageInfo.m_pMCUBufR+srcOffset;
+
+      if(_imageInfo.m_scanType==PJPG_GRAYSCALE) {
+
+        for(y=0;y<height;y++) {
+
+          for(x=0;x<width;x++)
+            gl.unpackColour(r[x],r[x],r[x],dest[x]);
+
+          r+=8;
+          dest+=destStride;
+        }
+      }
+      else {
+
+        g=_imageInfo.m_pMCUBufG+srcOffset;
+        b=_imageInfo.m_pMCUBufB+srcOffset;
+
+        for(y=0;y<height;y++) {
+
+          for(x=0;x<width;x++)
+            gl.unpackColour(r[x],g[x],b[x],dest[x]);
+
+          r+=8;
+          g+=8;
+          b+=8;
+          dest+=destStride;
+        }
+      }
+    }
+
+
+    /*
+     * Get the number of lines in a row of MCUs. The last row may be clipped.
+     */
+
+    template<class TGraphicsLibrary>
+    inline int16_t JpegDecoder<TGraphicsLibrary>::getBandHeight(int16_t mcuY) const {
+      return std::min<int16_t>(_imageInfo.m_MCUHeight,_imageInfo.m_height-mcuY*_imageInfo.m_MCUHeight);
+    }
+
+
+    /*
+     * Get the number of pixels in a band buffer
+     */
+
+    template<class TGraphicsLibrary>
+    inline uint32_t JpegDecoder<TGraphicsLibrary>::getBandPixels() const {
+      return static_cast<uint32_t>(_imageInfo.m_width)*_imageInfo.m_MCUHeight;
+    }
   }
 }
-
@@ -0,0 +1,205 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * A fixed size list of rectangles that need to be redrawn. Rectangles that overlap or share
+     * an edge are merged as they're added so that no pixel is sent twice. When the list is full a new
+     * rectangle is merged with whichever existing one grows the least, trading a few clean
+     * pixels for a bounded amount of bookkeeping.
+     *
+     * @tparam TMaxRectangles The maximum number of disjoint rectangles held
+     */
+
+    template<uint8_t TMaxRectangles>
+    class DirtyRectangleList {
+
+      protected:
+        Rectangle _rectangles[TMaxRectangles];
+        uint8_t _count;
+
+      protected:
+        static Rectangle getUnion(const Rectangle& r1,const Rectangle& r2);
+        static bool isAdjacent(const Rectangle& r1,const Rectangle& r2);
+        static uint32_t getArea(const Rectangle& rc);
+
+      public:
+        DirtyRectangleList();
+
+        void add(Rectangle rc);
+        void clear();
+
+        bool isEmpty() const;
+        uint8_t getCount() const;
+        const Rectangle& operator[](uint8_t index) const;
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline DirtyRectangleList<TMaxRectangles>::DirtyRectangleList()
+      : _count(0) {
+    }
+
+
+    /**
+     * Add a rectangle. It's merged with every rectangle that it overlaps or shares an edge with, and
+     * then again with any that the merged result now reaches.
+     * @param rc The rectangle to add. Empty rectangles are ignored.
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline void DirtyRectangleList<TMaxRectangles>::add(Rectangle rc) {
+
+      uint8_t i,best;
+      uint32_t growth,bestGrowth;
+
+      if(rc.Width<=0 || rc.Height<=0)
+        return;
+
+      // absorb everything that this one reaches. removing an entry may let the grown
+      // rectangle reach one that was checked earlier so start again after each merge
+
+      for(i=0;i<_count;) {
+
+        if(isAdjacent(rc,_rectangles[i])) {
+          rc=getUnion(rc,_rectangles[i]);
+          _rectangles[i]=_rectangles[--_count];
+          i=0;
+        }
+        else
+          i++;
+      }
+
+      if(_count<TMaxRectangles) {
+        _rectangles[_count++]=rc;
+        return;
+      }
+
+      // full: merge with the one that grows the least
+
+      best=0;
+      bestGrowth=UINT32_MAX;
+
+      for(i=0;i<_count;i++) {
+
+        growth=getArea(getUnion(rc,_rectangles[i]))-getArea(_rectangles[i]);
+
+        if(growth<bestGrowth) {
+          bestGrowth=growth;
+          best=i;
+        }
+      }
+
+      rc=getUnion(rc,_rectangles[best]);
+      _rectangles[best]=_rectangles[--_count];
+
+      // the grown rectangle may now reach others
+
+      add(rc);
+    }
+
+
+    /**
+     * Remove all rectangles
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline void DirtyRectangleList<TMaxRectangles>::clear() {
+      _count=0;
+    }
+
+
+    /**
+     * Return true if there are no rectangles
+     * @return true if empty
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline bool DirtyRectangleList<TMaxRectangles>::isEmpty() const {
+      return _count==0;
+    }
+
+
+    /**
+     * Get the number of rectangles
+     * @return The number of disjoint rectangles
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline uint8_t DirtyRectangleList<TMaxRectangles>::getCount() const {
+      return _count;
+    }
+
+
+    /**
+     * Get a rectangle
+     * @param index The index, less than getCount()
+     * @return A reference to the rectangle
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline const Rectangle& DirtyRectangleList<TMaxRectangles>::operator[](uint8_t index) const {
+      return _rectangles[index];
+    }
+
+
+    /*
+     * The bounding box of two rectangles
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline Rectangle DirtyRectangleList<TMaxRectangles>::getUnion(const Rectangle& r1,const Rectangle& r2) {
+
+      int16_t x,y;
+
+      x=std::min(r1.X,r2.X);
+      y=std::min(r1.Y,r2.Y);
+
+      return Rectangle(x,
+                       y,
+                       std::max(r1.X+r1.Width,r2.X+r2.Width)-x,
+                       std::max(r1.Y+r1.Height,r2.Y+r2.Height)-y);
+    }
+
+
+    /*
+     * Return true if two rectangles overlap or share part of an edge. Rectangles that only
+     * meet at a corner are not adjacent because their union would add clean pixels.
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline bool DirtyRectangleList<TMaxRectangles>::isAdjacent(const Rectangle& r1,const Rectangle& r2) {
+
+      bool xTouch,yTouch,xOverlap,yOverlap;
+
+      xTouch=r1.X<=r2.X+r2.Width && r2.X<=r1.X+r1.Width;
+      yTouch=r1.Y<=r2.Y+r2.Height && r2.Y<=r1.Y+r1.Height;
+      xOverlap=r1.X<r2.X+r2.Width && r2.X<r1.X+r1.Width;
+      yOverlap=r1.Y<r2.Y+r2.Height && r2.Y<r1.Y+r1.Height;
+
+      return (xTouch && yOverlap) || (xOverlap && yTouch);
+    }
+
+
+    /*
+     * The number of pixels in a rectangle
+     */
+
+    template<uint8_t TMaxRectangles>
+    inline uint32_t DirtyRectangleList<TMaxRectangles>::getArea(const Rectangle& rc) {
+      return static_cast<uint32_t>(rc.Width)*static_cast<uint32_t>(rc.Height);
+    }
+  }
+}
@@ -0,0 +1,656 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * A device that draws into RAM instead of a panel. It's used as the TDevice parameter
+     * to GraphicsLibrary so that everything the library can draw can be composed off-screen
+     * and then sent to the real panel with flush(). Only the rectangles that were written
+     * since the last flush are sent, so widgets that overdraw each other don't tear and
+     * unchanged areas cost nothing on the bus.
+     *
+     * The pixels are stored in the real panel's native format (its UnpackedColour), so a
+     * 64K colour panel gives an RGB565 frame buffer and a 262K panel gives RGB666. Flushing
+     * is a rawTransfer() of each dirty span, or a DMA transfer if you have a DmaLcdWriter.
+     *
+     * The frame buffer may be smaller than the panel. It's flushed to the area that starts
+     * at the origin, which can be changed with setOrigin(). A 240x320 RGB565 frame buffer
+     * needs 150Kb so on most MCUs you'll want to buffer just the area that changes.
+     *
+     * The window and write position behave like a panel's GRAM address counter: writes start
+     * at the top-left of the window when moveTo(), moveX(), moveY() or beginWriting() is
+     * called and wrap at the right and bottom edges of the window. Windows are clipped to
+     * the frame buffer.
+     *
+     * Nothing here touches the hardware, so as long as TPanel is any class with the colour
+     * and window methods of a GraphicsLibrary this device can be rendered into and examined
+     * pixel-for-pixel on a host computer.
+     *
+     * @tparam TPanel The graphics library type of the real panel, e.g. SSD1289_Portrait_64K<...>
+     * @tparam TWidth The frame buffer width in pixels
+     * @tparam THeight The frame buffer height in pixels
+     * @tparam TMaxDirtyRectangles The number of disjoint dirty rectangles tracked before they get merged
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles=8>
+    class FrameBufferDevice {
+
+      protected:
+        typedef typename TPanel::tCOLOUR tCOLOUR;
+        typedef typename TPanel::UnpackedColour UnpackedColour;
+
+        TPanel& _panel;
+        Point _origin;
+        UnpackedColour *_pixels;
+
+        // the window and the write position within it
+
+        mutable int16_t _windowLeft,_windowTop,_windowRight,_windowBottom;
+        mutable int16_t _x,_y;
+        mutable uint32_t _written;          // pixels written since the position was reset
+
+        mutable DirtyRectangleList<TMaxDirtyRectangles> _dirty;
+
+      protected:
+        FrameBufferDevice(TPanel& panel);
+        ~FrameBufferDevice();
+
+        void resetPosition() const;
+        void commitWritten() const;
+        bool isWindowEmpty() const;
+        void advance(uint32_t count) const;
+
+        template<class TDmaCopierImpl>
+        bool flushSpan(const UnpackedColour *pixels,uint32_t numPixels,DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority) const;
+
+      public:
+        void initialise() const;
+
+        constexpr int16_t getWidth() const;
+        constexpr int16_t getHeight() const;
+
+        // colour handling is the panel's
+
+        void unpackColour(tCOLOUR src,UnpackedColour& dest) const;
+        void unpackColour(uint8_t red,uint8_t green,uint8_t blue,UnpackedColour& dest) const;
+
+        // the device interface used by the graphics library
+
+        void moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend) const;
+        void moveTo(const Rectangle& rc) const;
+        void moveX(int16_t xstart,int16_t xend) const;
+        void moveY(int16_t ystart,int16_t yend) const;
+        void beginWriting() const;
+
+        void writePixel(const UnpackedColour& cr) const;
+        void writePixelAgain(const UnpackedColour& cr) const;
+        void fillPixels(uint32_t numPixels,const UnpackedColour& cr) const;
+
+        void allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const;
+        void rawTransfer(const void *data,uint32_t numPixels) const;
+
+        // frame buffer management
+
+        void setOrigin(const Point& origin);
+        const Point& getOrigin() const;
+
+        void invalidate() const;
+        void invalidate(const Rectangle& rc) const;
+        bool isDirty() const;
+
+        void flush() const;
+
+        template<class TDmaCopierImpl>
+        bool flush(DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority=DMA_Priority_High) const;
+
+        const UnpackedColour *getPixels() const;
+        const UnpackedColour& getPixel(int16_t x,int16_t y) const;
+    };
+
+
+    /**
+     * Constructor. The GraphicsLibrary passes its 'access mode' parameter here, which for
+     * this device is the real panel.
+     * @param panel The panel that flush() writes to
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::FrameBufferDevice(TPanel& panel)
+      : _panel(panel),
+        _origin(0,0) {
+
+      _pixels=new UnpackedColour[static_cast<uint32_t>(TWidth)*static_cast<uint32_t>(THeight)]();
+
+      _windowLeft=_windowTop=0;
+      _windowRight=TWidth-1;
+      _windowBottom=THeight-1;
+
+      resetPosition();
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::~FrameBufferDevice() {
+      delete [] _pixels;
+    }
+
+
+    /**
+     * Called by the graphics library constructor. The real panel is initialised by its own
+     * graphics library so there's nothing to do.
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::initialise() const {
+    }
+
+
+    /**
+     * Get the width in pixels
+     * @return The frame buffer width
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    constexpr inline int16_t FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::getWidth() const {
+      return TWidth;
+    }
+
+
+    /**
+     * Get the height in pixels
+     * @return The frame buffer height
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    constexpr inline int16_t FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::getHeight() const {
+      return THeight;
+    }
+
+
+    /**
+     * Unpack the colour from #rrggbb to the panel's native format
+     * @param src rrggbb
+     * @param dest The unpacked colour structure
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::unpackColour(tCOLOUR src,UnpackedColour& dest) const {
+      _panel.unpackColour(src,dest);
+    }
+
+
+    /**
+     * Unpack the colour from components to the panel's native format
+     * @param red
+     * @param green
+     * @param blue
+     * @param dest
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::unpackColour(uint8_t red,uint8_t green,uint8_t blue,UnpackedColour& dest) const {
+      _panel.unpackColour(red,green,blue,dest);
+    }
+
+
+    /**
+     * Move the display rectangle to the rectangle described by the co-ordinates
+     * @param xstart starting X position
+     * @param ystart starting Y position
+     * @param xend ending X position
+     * @param yend ending Y position
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend) const {
+
+      commitWritten();
+
+      _windowLeft=std::max<int16_t>(xstart,0);
+      _windowTop=std::max<int16_t>(ystart,0);
+      _windowRight=std::min<int16_t>(xend,TWidth-1);
+      _windowBottom=std::min<int16_t>(yend,THeight-1);
+
+      resetPosition();
+    }
+
+
+    /**
+     * Move the display output rectangle
+     * @param rc The display output rectangle
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::moveTo(const Rectangle& rc) const {
+      moveTo(rc.X,rc.Y,rc.X+rc.Width-1,rc.Y+rc.Height-1);
+    }
+
+
+    /**
+     * Move the X position
+     * @param xstart The new X start position
+     * @param xend The new X end position
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::moveX(int16_t xstart,int16_t xend) const {
+      moveTo(xstart,_windowTop,xend,_windowBottom);
+    }
+
+
+    /**
+     * Move the Y position
+     * @param ystart The new Y start position
+     * @param yend The new Y end position
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::moveY(int16_t ystart,int16_t yend) const {
+      moveTo(_windowLeft,ystart,_windowRight,yend);
+    }
+
+
+    /**
+     * Start writing at the top-left of the window
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::beginWriting() const {
+      commitWritten();
+      resetPosition();
+    }
+
+
+    /**
+     * Write a single pixel to the current output position.
+     * @param cr The pixel to write
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::writePixel(const UnpackedColour& cr) const {
+
+      if(isWindowEmpty())
+        return;
+
+      _pixels[static_cast<uint32_t>(_y)*TWidth+_x]=cr;
+      advance(1);
+    }
+
+
+    /**
+     * Write the same colour pixel that we last wrote
+     * @param cr The same pixel to write again
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::writePixelAgain(const UnpackedColour& cr) const {
+      writePixel(cr);
+    }
+
+
+    /**
+     * Fill a block of pixels with the same colour. Like a panel this starts at the top-left
+     * of the window. Each row is filled in one go.
+     * @param numPixels how many
+     * @param cr The unpacked colour to write
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::fillPixels(uint32_t numPixels,const UnpackedColour& cr) const {
+
+      UnpackedColour *ptr;
+      uint32_t count;
+
+      beginWriting();
+
+      if(isWindowEmpty())
+        return;
+
+      while(numPixels) {
+
+        count=std::min<uint32_t>(numPixels,_windowRight-_x+1);
+        ptr=_pixels+static_cast<uint32_t>(_y)*TWidth+_x;
+
+        std::fill(ptr,ptr+count,cr);
+
+        advance(count);
+        numPixels-=count;
+      }
+    }
+
+
+    /**
+     * Allocate a buffer for pixel data. You supply the number of pixels and this allocates the buffer as a uint8_t[].
+     * Allocated buffers should be freed with delete[]
+     *
+     * @param numPixels The number of pixels to allocate
+     * @param buffer The output buffer
+     * @param bytesPerPixel Output the number of bytes per pixel
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const {
+      bytesPerPixel=sizeof(UnpackedColour);
+      buffer=new uint8_t[numPixels*bytesPerPixel];
+    }
+
+
+    /**
+     * Bulk-copy some pixels from the memory buffer to the current position. The pixels must
+     * already be in the panel's native format. Each row is copied in one go.
+     * @param data The memory buffer
+     * @param numPixels The number of pixels to transfer from the buffer
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::rawTransfer(const void *data,uint32_t numPixels) const {
+
+      const UnpackedColour *src;
+      uint32_t count;
+
+      if(isWindowEmpty())
+        return;
+
+      src=static_cast<const UnpackedColour *>(data);
+
+      while(numPixels) {
+
+        count=std::min<uint32_t>(numPixels,_windowRight-_x+1);
+        std::copy(src,src+count,_pixels+static_cast<uint32_t>(_y)*TWidth+_x);
+
+        src+=count;
+        advance(count);
+        numPixels-=count;
+      }
+    }
+
+
+    /**
+     * Set where the top-left of the frame buffer goes on the panel
+     * @param origin The panel co-ordinates
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::setOrigin(const Point& origin) {
+      _origin=origin;
+    }
+
+
+    /**
+     * Get where the top-left of the frame buffer goes on the panel
+     * @return The panel co-ordinates
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline const Point& FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::getOrigin() const {
+      return _origin;
+    }
+
+
+    /**
+     * Mark the whole frame buffer as needing to be sent, e.g. after the origin has changed
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::invalidate() const {
+      invalidate(Rectangle(0,0,TWidth,THeight));
+    }
+
+
+    /**
+     * Mark a rectangle as needing to be sent
+     * @param rc The area, in frame buffer co-ordinates
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::invalidate(const Rectangle& rc) const {
+
+      int16_t left,top,right,bottom;
+
+      left=std::max<int16_t>(rc.X,0);
+      top=std::max<int16_t>(rc.Y,0);
+      right=std::min<int16_t>(rc.X+rc.Width,TWidth);
+      bottom=std::min<int16_t>(rc.Y+rc.Height,THeight);
+
+      _dirty.add(Rectangle(left,top,right-left,bottom-top));
+    }
+
+
+    /**
+     * Return true if anything has been drawn since the last flush
+     * @return true if a flush would send something
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline bool FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::isDirty() const {
+      commitWritten();
+      return !_dirty.isEmpty();
+    }
+
+
+    /**
+     * Send the dirty rectangles to the panel with rawTransfer(). A rectangle that's the full
+     * width of the frame buffer is contiguous and goes in a single transfer. Others go a row
+     * at a time into one panel window.
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::flush() const {
+
+      uint8_t i;
+      int16_t y;
+      const UnpackedColour *ptr;
+
+      commitWritten();
+
+      for(i=0;i<_dirty.getCount();i++) {
+
+        const Rectangle& rc(_dirty[i]);
+
+        _panel.moveTo(Rectangle(_origin.X+rc.X,_origin.Y+rc.Y,rc.Width,rc.Height));
+        _panel.beginWriting();
+
+        ptr=_pixels+static_cast<uint32_t>(rc.Y)*TWidth+rc.X;
+
+        if(rc.Width==TWidth)
+          _panel.rawTransfer(ptr,static_cast<uint32_t>(rc.Width)*rc.Height);
+        else {
+          for(y=0;y<rc.Height;y++) {
+            _panel.rawTransfer(ptr,rc.Width);
+            ptr+=TWidth;
+          }
+        }
+      }
+
+      _dirty.clear();
+    }
+
+
+    /**
+     * Send the dirty rectangles to the panel using DMA. The access mode must be the FSMC.
+     * Full width rectangles go in as few transfers as the DMA count limit allows, others a
+     * row at a time. The CPU waits for each transfer so the frame buffer can be drawn on
+     * as soon as this returns.
+     * @param dma The DMA class used to transfer the data
+     * @param dataAddress The FSMC data address from the access mode's getDataAddress()
+     * @param priority The DMA priority constant
+     * @return false if the DMA peripheral reported an error
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    template<class TDmaCopierImpl>
+    inline bool FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::flush(DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority) const {
+
+      uint8_t i;
+      int16_t y;
+      const UnpackedColour *ptr;
+
+      commitWritten();
+
+      for(i=0;i<_dirty.getCount();i++) {
+
+        const Rectangle& rc(_dirty[i]);
+
+        _panel.moveTo(Rectangle(_origin.X+rc.X,_origin.Y+rc.Y,rc.Width,rc.Height));
+        _panel.beginWriting();
+
+        ptr=_pixels+static_cast<uint32_t>(rc.Y)*TWidth+rc.X;
+
+        if(rc.Width==TWidth) {
+          if(!flushSpan(ptr,static_cast<uint32_t>(rc.Width)*rc.Height,dma,dataAddress,priority))
+            return false;
+        }
+        else {
+          for(y=0;y<rc.Height;y++) {
+
+            if(!flushSpan(ptr,rc.Width,dma,dataAddress,priority))
+              return false;
+
+            ptr+=TWidth;
+          }
+        }
+      }
+
+      _dirty.clear();
+      return true;
+    }
+
+
+    /**
+     * Get the frame buffer. Row y starts at getPixels()+y*getWidth().
+     * @return A pointer to the first pixel
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline const typename FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::UnpackedColour *FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::getPixels() const {
+      return _pixels;
+    }
+
+
+    /**
+     * Get a pixel
+     * @param x The column
+     * @param y The row
+     * @return A reference to the pixel in the panel's native format
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline const typename FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::UnpackedColour& FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::getPixel(int16_t x,int16_t y) const {
+      return _pixels[static_cast<uint32_t>(y)*TWidth+x];
+    }
+
+
+    /*
+     * Go back to the top-left of the window
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::resetPosition() const {
+      _x=_windowLeft;
+      _y=_windowTop;
+      _written=0;
+    }
+
+
+    /*
+     * Add the area written since the position was reset to the dirty list. Writes always
+     * start at the top-left of the window and go row by row so a count is enough to know
+     * what was touched. This is done when the window moves rather than on every pixel.
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::commitWritten() const {
+
+      uint32_t width,height;
+
+      if(_written==0 || isWindowEmpty())
+        return;
+
+      width=_windowRight-_windowLeft+1;
+      height=_windowBottom-_windowTop+1;
+
+      if(_written<=width)
+        _dirty.add(Rectangle(_windowLeft,_windowTop,_written,1));
+      else
+        _dirty.add(Rectangle(_windowLeft,_windowTop,width,std::min<uint32_t>(height,(_written+width-1)/width)));
+
+      _written=0;
+    }
+
+
+    /*
+     * Return true if the window has been clipped away to nothing
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline bool FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::isWindowEmpty() const {
+      return _windowLeft>_windowRight || _windowTop>_windowBottom;
+    }
+
+
+    /*
+     * Move the write position on. The count never takes it past the end of the current row.
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    inline void FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::advance(uint32_t count) const {
+
+      _written+=count;
+
+      if((_x+=count)>_windowRight) {
+
+        _x=_windowLeft;
+
+        if(++_y>_windowBottom)
+          _y=_windowTop;
+      }
+    }
+
+
+    /*
+     * DMA a contiguous span of pixels to the panel, split to fit the transfer count
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles>
+    template<class TDmaCopierImpl>
+    inline bool FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>::flushSpan(const UnpackedColour *pixels,uint32_t numPixels,DmaLcdWriter<TDmaCopierImpl>& dma,void *dataAddress,uint32_t priority) const {
+
+      uint32_t count;
+
+      while(numPixels) {
+
+        count=std::min<uint32_t>(numPixels,UINT16_MAX/sizeof(UnpackedColour));
+
+        dma.beginCopyToLcd(dataAddress,const_cast<UnpackedColour *>(pixels),count*sizeof(UnpackedColour),priority);
+
+        if(!dma.waitUntilComplete())
+          return false;
+
+        pixels+=count;
+        numPixels-=count;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Convenience type for a graphics library that draws into a frame buffer for a panel
+     */
+
+    template<class TPanel,int16_t TWidth,int16_t THeight,uint8_t TMaxDirtyRectangles=8>
+    using FrameBufferGraphicsLibrary=GraphicsLibrary<FrameBufferDevice<TPanel,TWidth,THeight,TMaxDirtyRectangles>,TPanel>;
+  }
+}
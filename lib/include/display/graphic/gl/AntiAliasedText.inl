@@ -0,0 +1,238 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * Write a null terminated string of characters from an anti-aliased font. The edges of the
+     * characters are blended from the foreground colour into the background colour, which must
+     * be set to the colour that the text is going over because nothing is read back from the
+     * panel.
+     *
+     * With a filled background the characters are sent in runs of up to MAX_BLIT_CHARACTERS,
+     * each in a single window, in the same way as bitmap fonts. Without one the background
+     * pixels are skipped and each run of the other pixels in a row gets its own window.
+     *
+     * Returns the size of the string
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline Size GraphicsLibrary<TDevice,TDeviceAccessMode>::writeString(const Point& p,const AntiAliasedFont& font,const char *str) {
+
+      const FontChar *glyphs[MAX_BLIT_CHARACTERS];
+      UnpackedColour palette[MAX_ALPHA_LEVELS];
+      Point pos(p);
+      int16_t width;
+      int8_t spacing;
+      uint8_t count,maxCount;
+      Size s;
+
+      s.Height=font.getHeight();
+      s.Width=0;
+
+      spacing=font.getCharacterSpacing();
+
+      // the colour of each coverage level is worked out once for the whole string
+
+      getAlphaPalette(font.getBitsPerPixel(),palette);
+
+      if(!_fontFilledBackground) {
+
+        for(;*str;str++) {
+
+          font.getCharacter((uint8_t)*str,glyphs[0]);
+          writeAlphaGlyphSpans(pos,font,*glyphs[0],palette);
+
+          width=glyphs[0]->PixelWidth+spacing;
+          pos.X+=width;
+          s.Width+=width;
+        }
+
+        return s;
+      }
+
+      // group the characters into single windows if we can
+
+      if(spacing>=0 &&
+         p.X>=0 &&
+         p.Y>=0 &&
+         p.Y+s.Height<=this->getHeight() &&
+         p.X+measureString(font,str).Width<=this->getWidth())
+        maxCount=MAX_BLIT_CHARACTERS;
+      else {
+        maxCount=1;
+        spacing=0;
+      }
+
+      while(*str) {
+
+        width=0;
+
+        for(count=0;*str && count<maxCount;count++) {
+          font.getCharacter((uint8_t)*str++,glyphs[count]);
+          width+=glyphs[count]->PixelWidth+spacing;
+        }
+
+        writeAlphaGlyphs(pos,font,glyphs,count,spacing,palette);
+
+        // the advance always includes the font spacing even if we're not filling it
+
+        width+=static_cast<int16_t>(font.getCharacterSpacing()-spacing)*count;
+        pos.X+=width;
+        s.Width+=width;
+      }
+
+      return s;
+    }
+
+
+    /*
+     * Fill in the panel colour for each coverage level of a font. Level 0 is the background and
+     * the highest level is the foreground.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::getAlphaPalette(uint8_t bitsPerPixel,UnpackedColour *palette) const {
+
+      uint8_t i,maxLevel;
+
+      maxLevel=(1 << bitsPerPixel)-1;
+
+      palette[0]=_background;
+      palette[maxLevel]=_foreground;
+
+      for(i=1;i<maxLevel;i++)
+        getBlendedColour((i*255+maxLevel/2)/maxLevel,palette[i]);
+    }
+
+
+    /*
+     * Write a group of anti-aliased characters into a single window. Each row of the window is
+     * made from the same row of each character followed by gap background pixels. A pixel never
+     * straddles a byte so a row starts at a known bit offset into the character data.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::writeAlphaGlyphs(const Point& p,const AntiAliasedFont& font,const FontChar **glyphs,uint8_t count,uint8_t gap,const UnpackedColour *palette) {
+
+      const uint8_t *data;
+      uint32_t bitOffset;
+      int16_t width;
+      uint8_t i,j,x,row,bpp,mask,shift;
+
+      bpp=font.getBitsPerPixel();
+      mask=(1 << bpp)-1;
+
+      width=0;
+
+      for(i=0;i<count;i++)
+        width+=glyphs[i]->PixelWidth+gap;
+
+      if(width==0)
+        return;
+
+      this->moveTo(Rectangle(p.X,p.Y,width,font.getHeight()));
+      this->beginWriting();
+
+      for(row=0;row<font.getHeight();row++) {
+
+        for(i=0;i<count;i++) {
+
+          bitOffset=static_cast<uint32_t>(row)*glyphs[i]->PixelWidth*bpp;
+
+          data=glyphs[i]->Data+(bitOffset >> 3);
+          shift=bitOffset & 7;
+
+          for(x=0;x<glyphs[i]->PixelWidth;x++) {
+
+            this->writePixel(palette[(*data >> shift) & mask]);
+
+            if((shift+=bpp)==8) {
+              shift=0;
+              data++;
+            }
+          }
+
+          for(j=0;j<gap;j++)
+            this->writePixel(palette[0]);
+        }
+      }
+    }
+
+
+    /*
+     * Write an anti-aliased character without filling the background. Background pixels are
+     * skipped and each run of the others in a row is sent in a one row window.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::writeAlphaGlyphSpans(const Point& p,const AntiAliasedFont& font,const FontChar& fc,const UnpackedColour *palette) {
+
+      const uint8_t *data,*runData;
+      uint8_t x,row,bpp,mask,shift,runShift,runStart,value;
+
+      bpp=font.getBitsPerPixel();
+      mask=(1 << bpp)-1;
+
+      data=fc.Data;
+      shift=0;
+
+      for(row=0;row<font.getHeight();row++) {
+
+        for(x=0;x<fc.PixelWidth;) {
+
+          // skip the background
+
+          if(((*data >> shift) & mask)==0) {
+
+            if((shift+=bpp)==8) {
+              shift=0;
+              data++;
+            }
+
+            x++;
+            continue;
+          }
+
+          // find the end of the run and go back to send it
+
+          runData=data;
+          runShift=shift;
+          runStart=x;
+
+          do {
+
+            if((shift+=bpp)==8) {
+              shift=0;
+              data++;
+            }
+
+            x++;
+
+          } while(x<fc.PixelWidth && ((*data >> shift) & mask)!=0);
+
+          this->moveTo(Rectangle(p.X+runStart,p.Y+row,x-runStart,1));
+          this->beginWriting();
+
+          while(runStart++<x) {
+
+            value=(*runData >> runShift) & mask;
+            this->writePixel(palette[value]);
+
+            if((runShift+=bpp)==8) {
+              runShift=0;
+              runData++;
+            }
+          }
+        }
+      }
+    }
+  }
+}
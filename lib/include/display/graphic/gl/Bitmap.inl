@@ -157,19 +157,46 @@ namespace stm32plus {
     /**
      * Draw a JPEG on the display. The rectangle size must match the JPEG size. The source
      * should supply the compressed data in the form of a JPEG file. Progressive JPEGs are
-     * not supported. This function will cost you about 2Kb of SRAM to call.
+     * not supported. This function will cost you about 2Kb of SRAM to call plus a band
+     * buffer of one row of MCUs (8 or 16 lines) in the native pixel format. If there's
+     * not enough memory for the band then the image is drawn a block at a time.
      *
      * @param rc The rectangle to draw the image at.
      * @param source The source of compressed data.
+     * @return false if there was a failure (e.g. stream failure or corrupt data)
      */
 
     template<class TDevice,typename TDeviceAccessMode>
-    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawJpeg(const Rectangle& rc,InputStream& source) {
+    inline bool GraphicsLibrary<TDevice,TDeviceAccessMode>::drawJpeg(const Rectangle& rc,InputStream& source) {
 
       // call a decoder typed for this graphics library
 
       JpegDecoder<GraphicsLibrary<TDevice,TDeviceAccessMode>> jpeg;
-      jpeg.decode(rc.getTopLeft(),source,*this);
+      return jpeg.decode(rc.getTopLeft(),source,*this);
+    }
+
+
+    /**
+     * Draw a JPEG on the display using DMA to transfer each row of MCUs to the display while
+     * the next row is being decoded. That implies that the access mode being used is the
+     * FSMC. Compilation will fail for other access modes. This costs two band buffers.
+     *
+     * @param rc The rectangle to draw the image at.
+     * @param source The source of compressed data.
+     * @param dma The DMA class used to transfer the data.
+     * @param priority The dma priority constant
+     * @return false if there was a failure (e.g. stream failure or corrupt data)
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    template<class TDmaCopierImpl>
+    inline bool GraphicsLibrary<TDevice,TDeviceAccessMode>::drawJpeg(const Rectangle& rc,
+                                                                     InputStream& source,
+                                                                     DmaLcdWriter<TDmaCopierImpl>& dma,
+                                                                     uint32_t priority) {
+
+      JpegDecoder<GraphicsLibrary<TDevice,TDeviceAccessMode>> jpeg;
+      return jpeg.decode(rc.getTopLeft(),source,*this,dma,(void *)this->_accessMode.getDataAddress(),priority);
     }
   }
 }
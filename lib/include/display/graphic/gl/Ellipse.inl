@@ -11,76 +11,24 @@ namespace stm32plus {
   namespace display {
 
     /**
-     * Fill an ellipse with the foreground colour. This is the algorithm documented in the paper
-     * "Drawing Ellipses Using Filled Rectangles" by L. Patrick.
+     * Fill an ellipse with the foreground colour. Each scanline of the top half is mirrored into
+     * the bottom half and scanlines of equal width are merged so that the panel sees one window
+     * and one run of pixels for each block of identical rows.
+     *
+     * @param[in] center The center point.
+     * @param[in] size The radius width and height.
      */
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillEllipse(const Point& center,const Size& size) {
-
-      int16_t x=0,y=size.Height;
-      int16_t rx=x,ry=y;
-      uint32_t width=1,height=1;
-      int32_t a2=(int32_t)size.Width*(int32_t)size.Width,b2=(int32_t)size.Height*(int32_t)size.Height;
-      int32_t crit1=-(a2 / 4 + size.Width % 2 + b2);
-      int32_t crit2=-(b2 / 4 + size.Height % 2 + a2);
-      int32_t crit3=-(b2 / 4 + size.Height % 2);
-      int32_t t=-a2 * y; // e(x+1/2,y-1/2) - (width_^2+height_^2)/4
-      int32_t dxt=2 * b2 * x,dyt=-2 * a2 * y;
-      int32_t d2xt=2 * b2,d2yt=2 * a2;
-
-      if(size.Height==0) {
-        fillRectangle(NormalizedRectangle(center.X-size.Width,center.Y,2*size.Width+ 1,1));
-        return;
-      }
-
-      while(y >= 0 && x <= size.Width) {
-        if(t + b2 * x <= crit1 || /* e(x+1,y-1/2) <= 0 */
-        t + a2 * y <= crit3) { /* e(x+1/2,y) <= 0 */
-          if(height == 1) {}      // draw nothing
-          else if(ry * 2 + 1 > ((int32_t)height - 1) * 2) {
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,height - 1));
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y + ry + 1,width,1 - height));
-            ry-=height - 1;
-            height=1;
-          } else {
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,ry * 2 + 1));
-            ry-=ry;
-            height=1;
-          }
-          x++,dxt+=d2xt,t+=dxt;
-          rx++;
-          width+=2;
-        } else if(t - a2 * y > crit2) { /* e(x+1/2,y-1) > 0 */
-          y--,dyt+=d2yt,t+=dyt;
-          height++;
-        } else {
-          if(ry * 2 + 1 > (int32_t)height * 2) {
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,height));
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y + ry + 1,width,-height));
-          } else {
-            fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,ry * 2 + 1));
-          }
-          x++,dxt+=d2xt,t+=dxt;
-          y--,dyt+=d2yt,t+=dyt;
-          rx++;
-          width+=2;
-          ry-=height;
-          height=1;
-        }
-      }
-
-      if(ry > (int32_t)height) {
-        fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,height));
-        fillRectangle(NormalizedRectangle(center.X - rx,center.Y + ry + 1,width,-height));
-      } else {
-        fillRectangle(NormalizedRectangle(center.X - rx,center.Y - ry,width,ry * 2 + 2));
-      }
+      fillQuadrants(center.X,center.Y,center.X,center.Y,size.Width,size.Height,false);
     }
 
+
     /**
-     * Draw an ellipse with the foreground colour using the fast bresenham algorithm. This method is an implementation of
-     * the pseudo-code in the paper "A Fast Bresenham Type Algorithm For Drawing Ellipses" by John Kennedy.
+     * Draw an ellipse with the foreground colour. The outline is the edge of the shape that
+     * fillEllipse() produces and is output as horizontal runs near the top and bottom and
+     * vertical runs down the sides rather than as individual points.
      *
      * @param[in] center The center point.
      * @param[in] size The radius width and height.
@@ -88,75 +36,116 @@ namespace stm32plus {
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawEllipse(const Point& center,const Size& size) {
-      int32_t x,y,xchange,ychange,ellipseError,twoASquare,twoBSquare,stoppingX,stoppingY,width,height;
+      fillQuadrants(center.X,center.Y,center.X,center.Y,size.Width,size.Height,true);
+    }
+
+
+    /*
+     * Fill or outline four elliptical quadrants. The top-left quadrant is centred on (left,top) and
+     * the bottom-right on (right,bottom). An ellipse has both centres at the same point. A rounded
+     * rectangle has them at the corners of its straight edges and the gaps between them are filled
+     * in, which is why the two shapes share this code.
+     *
+     * The half-width of a quadrant on row dy is the largest x for which b^2.x^2 + a^2.dy^2 is no more
+     * than a^2.b^2 + ab(a+b)/2. The allowance is about half a pixel and for a circle it reduces to
+     * x^2+y^2 <= r^2+r, which avoids the single pixel spikes at the poles that the exact equation
+     * produces. It's tracked incrementally so there are no multiplications in the inner loop.
+     *
+     * An outline row runs from the half-width on that row in to one pixel beyond the half-width of
+     * the next row out, so that the curve is continuous where it becomes steep.
+     */
 
-      width=size.Width;
-      height=size.Height;
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillQuadrants(int16_t left,int16_t top,int16_t right,int16_t bottom,int16_t a,int16_t b,bool outline) {
+
+      int16_t dy,x,outer,inner,runFirst,runOuter,runInner;
+      int32_t a2,b2,f;
+
+      a2=static_cast<int32_t>(a)*a;
+      b2=static_cast<int32_t>(b)*b;
 
-      twoASquare=2 * width * width;
-      twoBSquare=2 * height * height;
+      // f is the error at (x,dy) after the allowance, it starts at (a,0)
 
-      x=width;
-      y=0;
+      x=a;
+      f=-(static_cast<int32_t>(a)*b*(a+b))/2;
 
-      xchange=height * height * (1 - 2 * width);
-      ychange=width * width;
+      runFirst=runOuter=runInner=0;
 
-      ellipseError=0;
-      stoppingX=twoBSquare * width;
-      stoppingY=0;
+      for(dy=0;dy<=b;dy++) {
 
-      while(stoppingX >= stoppingY) {
+        outer=x;
 
-        plot4EllipsePoints(center.X,center.Y,x,y);
-        y++;
-        stoppingY+=twoASquare;
-        ellipseError+=ychange;
+        // move down a row and pull x in until it's back inside
 
-        ychange+=twoASquare;
+        if(dy<b) {
 
-        if(2 * ellipseError + xchange > 0) {
-          x--;
-          stoppingX-=twoBSquare;
-          ellipseError+=xchange;
-          xchange+=twoBSquare;
+          f+=a2*(2*dy+1);
+
+          while(f>0 && x>0) {
+            f-=b2*(2*x-1);
+            x--;
+          }
         }
-      }
 
-      x=0;
-      y=height;
+        // the outline runs from here to just short of the next row's edge. the last row and
+        // all filled rows are solid
+
+        if(outline && dy<b)
+          inner=std::min<int16_t>(x+1,outer);
+        else
+          inner=-1;
 
-      xchange=height * height;
-      ychange=width * width * (1 - 2 * height);
+        // merge with the previous rows if they're the same shape
 
-      ellipseError=0;
-      stoppingX=0;
-      stoppingY=twoASquare * height;
+        if(dy==0 || outer!=runOuter || inner!=runInner) {
 
-      while(stoppingX <= stoppingY) {
-        plot4EllipsePoints(center.X,center.Y,x,y);
-        x++;
-        stoppingX+=twoBSquare;
-        ellipseError+=xchange;
-        xchange+=twoBSquare;
+          if(dy!=0)
+            fillQuadrantRows(left,top,right,bottom,runFirst,dy-1,runOuter,runInner);
 
-        if((2 * ellipseError + ychange) > 0) {
-          y--;
-          stoppingY-=twoASquare;
-          ellipseError+=ychange;
-          ychange+=twoASquare;
+          runFirst=dy;
+          runOuter=outer;
+          runInner=inner;
         }
       }
+
+      fillQuadrantRows(left,top,right,bottom,runFirst,b,runOuter,runInner);
     }
 
 
+    /*
+     * Fill the quadrant rows from first to last inclusive that all have the same span. The rows are
+     * mirrored above top and below bottom. If the run includes row 0 then it's a single block that
+     * also covers the rows in between. A negative inner offset, or one where the left and right
+     * pieces meet, produces a single span from the left edge to the right edge.
+     */
+
     template<class TDevice,typename TDeviceAccessMode>
-    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::plot4EllipsePoints(int16_t cx,int16_t cy,int16_t x,int16_t y) {
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillQuadrantRows(int16_t left,int16_t top,int16_t right,int16_t bottom,int16_t first,int16_t last,int16_t outer,int16_t inner) {
 
-      plotPoint(Point(cx + x,cy + y)); // point in quadrant 1
-      plotPoint(Point(cx - x,cy + y)); // point in quadrant 2
-      plotPoint(Point(cx - x,cy - y)); // point in quadrant 3
-      plotPoint(Point(cx + x,cy - y)); // point in quadrant 4
+      int16_t height;
+
+      if(first==0)
+        height=bottom-top+2*last+1;
+      else
+        height=last-first+1;
+
+      if(inner<0 || left-inner+1>=right+inner) {
+
+        fillRectangle(Rectangle(left-outer,top-last,right-left+2*outer+1,height));
+
+        if(first!=0)
+          fillRectangle(Rectangle(left-outer,bottom+first,right-left+2*outer+1,height));
+      }
+      else {
+
+        fillRectangle(Rectangle(left-outer,top-last,outer-inner+1,height));
+        fillRectangle(Rectangle(right+inner,top-last,outer-inner+1,height));
+
+        if(first!=0) {
+          fillRectangle(Rectangle(left-outer,bottom+first,outer-inner+1,height));
+          fillRectangle(Rectangle(right+inner,bottom+first,outer-inner+1,height));
+        }
+      }
     }
   }
 }
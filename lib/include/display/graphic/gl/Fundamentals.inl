@@ -20,6 +20,7 @@ namespace stm32plus {
       : TDevice(accessMode) {
 
       _fontFilledBackground=true;
+      _glyphCache=nullptr;
 
       // initialise the panel
 
@@ -34,11 +35,13 @@ namespace stm32plus {
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setForeground(tCOLOUR cr) {
       this->unpackColour(cr,_foreground);
+      _foregroundRgb=cr;
     }
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setForeground(uint8_t r,uint8_t g,uint8_t b) {
       this->unpackColour(r,g,b,_foreground);
+      _foregroundRgb=static_cast<tCOLOUR>(r) << 16 | static_cast<tCOLOUR>(g) << 8 | b;
     }
 
     /**
@@ -48,11 +51,39 @@ namespace stm32plus {
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setBackground(tCOLOUR cr) {
       this->unpackColour(cr,_background);
+      _backgroundRgb=cr;
     }
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setBackground(uint8_t r,uint8_t g,uint8_t b) {
       this->unpackColour(r,g,b,_background);
+      _backgroundRgb=static_cast<tCOLOUR>(r) << 16 | static_cast<tCOLOUR>(g) << 8 | b;
+    }
+
+    /**
+     * Blend the foreground colour over the background colour. This is how anti-aliased text is
+     * drawn without reading back from the panel: the background colour is taken to be what's
+     * already there.
+     * @param alpha The foreground coverage from 0 (all background) to 255 (all foreground)
+     * @param[out] cr The blended colour
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::getBlendedColour(uint8_t alpha,UnpackedColour& cr) const {
+
+      uint8_t components[3];
+      uint16_t fg,bg;
+      int i;
+
+      for(i=0;i<3;i++) {
+
+        fg=(_foregroundRgb >> (16-8*i)) & 0xff;
+        bg=(_backgroundRgb >> (16-8*i)) & 0xff;
+
+        components[i]=(fg*alpha+bg*(255-alpha)+127)/255;
+      }
+
+      this->unpackColour(components[0],components[1],components[2],cr);
     }
 
     /**
@@ -0,0 +1,134 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace display {
+
+    /**
+     * Draw the outline of a closed polygon in the foreground colour. The last point is joined
+     * back to the first.
+     * @param points The vertices
+     * @param count The number of vertices
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawPolygon(const Point *points,uint16_t count) {
+
+      uint16_t i;
+
+      if(count==0)
+        return;
+
+      for(i=1;i<count;i++)
+        drawLine(points[i-1],points[i]);
+
+      drawLine(points[count-1],points[0]);
+    }
+
+
+    /**
+     * Fill a closed polygon with the foreground colour. The polygon may be concave or self
+     * intersecting, in which case the even-odd rule decides what's inside. Each scanline is
+     * filled with one fill per span.
+     *
+     * Pixels exactly on the bottom and right edges are not filled, in the same way as most
+     * rasterisers, so that polygons that share an edge don't overlap. Call drawPolygon()
+     * afterwards if you want the edges included.
+     *
+     * @param points The vertices
+     * @param count The number of vertices
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillPolygon(const Point *points,uint16_t count) {
+
+      int16_t stackCrossings[16],*crossings,ymin,ymax,x,y;
+      scoped_array<int16_t> heapCrossings;
+      uint16_t i,j,k,ncrossings;
+
+      if(count<3)
+        return;
+
+      // there can't be more crossings on a scanline than there are edges. small polygons
+      // don't need the heap
+
+      if(count<=sizeof(stackCrossings)/sizeof(stackCrossings[0]))
+        crossings=stackCrossings;
+      else {
+        heapCrossings.reset(new int16_t[count]);
+        crossings=heapCrossings.get();
+      }
+
+      // vertical extent
+
+      ymin=ymax=points[0].Y;
+
+      for(i=1;i<count;i++) {
+        ymin=std::min(ymin,points[i].Y);
+        ymax=std::max(ymax,points[i].Y);
+      }
+
+      for(y=ymin;y<ymax;y++) {
+
+        // find where each edge crosses this row. edges include their top row and exclude their
+        // bottom row so a vertex shared by two edges is counted once and horizontal edges never are
+
+        ncrossings=0;
+
+        for(i=0,j=count-1;i<count;j=i++) {
+
+          if(points[j].Y<=y && y<points[i].Y)
+            x=getPolygonEdgeX(points[j],points[i],y);
+          else if(points[i].Y<=y && y<points[j].Y)
+            x=getPolygonEdgeX(points[i],points[j],y);
+          else
+            continue;
+
+          // insertion sort, there are only a few
+
+          for(k=ncrossings;k>0 && crossings[k-1]>x;k--)
+            crossings[k]=crossings[k-1];
+
+          crossings[k]=x;
+          ncrossings++;
+        }
+
+        // fill between pairs of crossings
+
+        for(j=1;j<ncrossings;j+=2)
+          if(crossings[j]>crossings[j-1])
+            fillRectangle(Rectangle(crossings[j-1],y,crossings[j]-crossings[j-1],1));
+      }
+    }
+
+
+    /*
+     * Get the x co-ordinate, rounded to the nearest pixel, where the edge from p1 down to p2
+     * crosses row y. p1 must be above p2.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline int16_t GraphicsLibrary<TDevice,TDeviceAccessMode>::getPolygonEdgeX(const Point& p1,const Point& p2,int16_t y) {
+
+      int32_t num,den;
+
+      num=2*static_cast<int32_t>(y-p1.Y)*(p2.X-p1.X);
+      den=2*static_cast<int32_t>(p2.Y-p1.Y);
+
+      // round half up, allowing for division truncating towards zero
+
+      num+=den/2;
+
+      if(num<0)
+        num-=den-1;
+
+      return p1.X+num/den;
+    }
+  }
+}
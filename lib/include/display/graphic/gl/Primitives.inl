@@ -32,115 +32,96 @@ namespace stm32plus {
 
 
     /**
-     * Draw a line between two points. Modified slightly by me (Andy Brown) to include the final point
-     * in the line. Therefore drawing from (x,y) to (x,y) will result in a single point being plotted.
-     * Freely useable in non-commercial applications as long as credits
-     * to Po-Han Lin and link to http://www.edepot.com is provided in
-     * source code and can been seen in compiled executable.
-     * Commercial applications please inquire about licensing the algorithms.
+     * Draw a line between two points. Both end points are included so drawing from (x,y) to (x,y)
+     * plots a single point. Horizontal and vertical lines are drawn as a single filled rectangle.
+     *
+     * Other lines are drawn left to right using the classic Bresenham error term to choose the
+     * points, but the points are not sent one at a time. A line that is closer to horizontal is
+     * made of horizontal runs, one per row, and a line that is closer to vertical is made of
+     * vertical runs, one per column. A run ends when the error term steps in the minor direction
+     * and each run is sent as a single filled rectangle so the panel window is only set once per
+     * run.
      */
 
     template<class TDevice,typename TDeviceAccessMode>
     inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawLine(const Point& p1,const Point& p2) {
 
+      int16_t x0,x1,y0,y1,dx,dy,sy,err,e2,runX,runY;
+      bool xmajor;
+
       // optimisation for straight lines. filling rectangles is much more efficient than plotting points
 
-      if(p1.X==p2.X)
+      if(p1.X==p2.X) {
         fillRectangle(Rectangle(p1.X,std::min<int16_t>(p1.Y,p2.Y),1,std::abs(p2.Y-p1.Y)+1));
-      else if(p1.Y==p2.Y)
+        return;
+      }
+
+      if(p1.Y==p2.Y) {
         fillRectangle(Rectangle(std::min<int16_t>(p1.X,p2.X),p1.Y,std::abs(p2.X-p1.X)+1,1));
-      else {
-        int16_t x0,x1,y0,y1;
+        return;
+      }
+
+      // always draw left to right
 
+      if(p1.X<p2.X) {
         x0=p1.X;
         y0=p1.Y;
         x1=p2.X;
         y1=p2.Y;
+      }
+      else {
+        x0=p2.X;
+        y0=p2.Y;
+        x1=p1.X;
+        y1=p1.Y;
+      }
 
-        if(x0>x1) {
-
-          // the optimiser does this swap method faster than
-          // the xor-trick
-
-          int16_t t;
-
-          t=x0;
-          x0=x1;
-          x1=t;
-
-          t=y0;
-          y0=y1;
-          y1=t;
-        }
-
-        // calculate constants up-front
-
-        int16_t dx=x1-x0;
-        int16_t dy=std::abs(y1-y0);
-        int16_t sy=y0<y1 ? 1 : -1;
-        int16_t mdy=-dy;
-        int16_t err=dx-dy;
-        bool xinc;
-
-        // set the drawing rectangle that we need and plot the first point
-
-        this->moveTo(x0,y0,this->getXmax(),this->getYmax());
-        this->beginWriting();
-        this->writePixel(_foreground);
-
-        while(x0!=x1 || y0!=y1) {
-
-          int16_t e2=2*err;
-
-          if(e2>mdy) {
+      // calculate constants up-front
 
-            err-=dy;
-            x0++;
+      dx=x1-x0;
+      dy=std::abs(y1-y0);
+      sy=y0<y1 ? 1 : -1;
+      err=dx-dy;
+      xmajor=dx>=dy;
 
-            // make a note that X has incremented
+      runX=x0;
+      runY=y0;
 
-            xinc=true;
-          }
-          else
-            xinc=false;       // nothing happened to X
+      while(x0!=x1 || y0!=y1) {
 
-          if(x0==x1 && y0==y1) {
+        e2=2*err;
 
-            if(xinc) {
+        // a step in the minor direction ends the current run
 
-              // plot the pending X increment before returning
+        if(e2>-dy) {
 
-              this->writePixelAgain(_foreground);
-              break;
-            }
+          if(!xmajor) {
+            fillRectangle(Rectangle(x0,std::min(runY,y0),1,std::abs(y0-runY)+1));
+            runY=y0+(e2<dx ? sy : 0);
           }
 
-          if(e2<dx) {
-            err+=dx;
-            y0+=sy;
-
-            // Y has changed. We're going to have to do a complete
-            // pixel write after we've moved the bare minimum of
-            // window pointers
-
-            if(xinc)
-              this->moveX(x0,this->getXmax());
+          err-=dy;
+          x0++;
+        }
 
-            this->moveY(y0,this->getYmax());
+        if(e2<dx) {
 
-            this->beginWriting();
-            this->writePixel(_foreground);
+          if(xmajor) {
+            fillRectangle(Rectangle(runX,y0,x0-runX+(e2>-dy ? 0 : 1),1));
+            runX=x0;
           }
-          else {
-
-            // Y has not changed, if X has changed then all we need
-            // to do is push out another pixel
 
-            if(xinc)
-              this->writePixelAgain(_foreground);
-          }
+          err+=dx;
+          y0+=sy;
         }
       }
+
+      // the final run
+
+      if(xmajor)
+        fillRectangle(Rectangle(runX,y0,x1-runX+1,1));
+      else
+        fillRectangle(Rectangle(x0,std::min(runY,y0),1,std::abs(y0-runY)+1));
     }
   }
 }
@@ -67,6 +67,44 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Draw the outline of a rectangle with rounded corners in the foreground colour. The corners
+     * are quarter circles and the straight edges are single fills between them.
+     * @param rc The bounding rectangle
+     * @param radius The corner radius. It's reduced if it won't fit in the rectangle.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::drawRoundedRectangle(const Rectangle& rc,int16_t radius) {
+
+      radius=std::min<int16_t>(radius,(std::min(rc.Width,rc.Height)-1)/2);
+
+      if(radius<=0)
+        drawRectangle(rc);
+      else
+        fillQuadrants(rc.X+radius,rc.Y+radius,rc.X+rc.Width-1-radius,rc.Y+rc.Height-1-radius,radius,radius,true);
+    }
+
+
+    /**
+     * Fill a rectangle with rounded corners with the foreground colour. The middle band is a
+     * single fill and the rows above and below it are merged where they have the same width.
+     * @param rc The bounding rectangle
+     * @param radius The corner radius. It's reduced if it won't fit in the rectangle.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::fillRoundedRectangle(const Rectangle& rc,int16_t radius) {
+
+      radius=std::min<int16_t>(radius,(std::min(rc.Width,rc.Height)-1)/2);
+
+      if(radius<=0)
+        fillRectangle(rc);
+      else
+        fillQuadrants(rc.X+radius,rc.Y+radius,rc.X+rc.Width-1-radius,rc.Y+rc.Height-1-radius,radius,radius,false);
+    }
+
+
     /*
      * Gradient fill a rectangle from the foreground to the background colour
      */
@@ -21,35 +21,93 @@ namespace stm32plus {
       _fontFilledBackground=fontFilledBackground;
     }
 
+    /**
+     * Set a cache of expanded characters to speed up text with a filled background. The cache
+     * is not owned by this class and must stay in scope while it's set.
+     * @param glyphCache The cache, or nullptr to stop using one
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::setGlyphCache(tGLYPHCACHE *glyphCache) {
+      _glyphCache=glyphCache;
+    }
+
+
     /**
      * Write a null terminated string of characters to the display.
+     *
+     * With a filled background the characters are sent to the panel in runs of up to
+     * MAX_BLIT_CHARACTERS, each in a single window, with the character spacing filled with the
+     * background colour. If the spacing is negative or the string doesn't fit on the panel then
+     * it's done one character at a time. Without a filled background bitmap fonts are written
+     * pixel by pixel and run length encoded fonts as one fill per horizontal run.
+     *
      * Returns the size of the string
      */
 
     template<class TDevice,typename TDeviceAccessMode>
     inline Size GraphicsLibrary<TDevice,TDeviceAccessMode>::writeString(const Point& p,const Font& font,const char *str) {
 
-      const char *ptr;
+      const FontChar *glyphs[MAX_BLIT_CHARACTERS];
       Point pos(p);
-      const FontChar *fc;
       int16_t width;
+      int8_t spacing;
+      uint8_t count,maxCount;
       Size s;
 
       s.Height=font.getHeight();
       s.Width=0;
 
-      // print each character in turn
+      spacing=font.getCharacterSpacing();
 
-      for(ptr=str;*ptr;ptr++) {
+      if(!_fontFilledBackground) {
 
-        font.getCharacter((uint8_t)*ptr,fc);
+        // print each character in turn
 
-        if(_fontFilledBackground)
-          writeCharacterFill(pos,font,*fc);
-        else
-          writeCharacterNoFill(pos,font,*fc);
+        for(;*str;str++) {
+
+          font.getCharacter((uint8_t)*str,glyphs[0]);
+
+          if(font.getType()==FontBase::FONT_RLE)
+            writeGlyphSpans(pos,font,*glyphs[0]);
+          else
+            writeCharacterNoFill(pos,font,*glyphs[0]);
+
+          width=glyphs[0]->PixelWidth+spacing;
+          pos.X+=width;
+          s.Width+=width;
+        }
+
+        return s;
+      }
+
+      // group the characters into single windows if we can
+
+      if(spacing>=0 &&
+         p.X>=0 &&
+         p.Y>=0 &&
+         p.Y+s.Height<=this->getHeight() &&
+         p.X+measureString(font,str).Width<=this->getWidth())
+        maxCount=MAX_BLIT_CHARACTERS;
+      else {
+        maxCount=1;
+        spacing=0;
+      }
 
-        width=fc->PixelWidth+font.getCharacterSpacing();
+      while(*str) {
+
+        width=0;
+
+        for(count=0;*str && count<maxCount;count++) {
+          font.getCharacter((uint8_t)*str++,glyphs[count]);
+          width+=glyphs[count]->PixelWidth+spacing;
+        }
+
+        writeGlyphs(pos,font,glyphs,count,spacing);
+
+        // the advance always includes the font spacing even if we're not filling it
+
+        width+=static_cast<int16_t>(font.getCharacterSpacing()-spacing)*count;
         pos.X+=width;
         s.Width+=width;
       }
@@ -58,6 +116,249 @@ namespace stm32plus {
     }
 
 
+    /*
+     * Write a group of characters from a bitmap or RLE font into a single window. Each row of the
+     * window is made from the same row of each character followed by gap background pixels.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::writeGlyphs(const Point& p,const Font& font,const FontChar **glyphs,uint8_t count,uint8_t gap) {
+
+      GlyphCursor cursors[MAX_BLIT_CHARACTERS];
+      UnpackedColour fg,bg;
+      const uint8_t *data;
+      int16_t width;
+      uint16_t x,n;
+      uint8_t i,j,row,mask;
+      bool foreground;
+
+      // local copies of the colours don't have to be reloaded after every pixel write
+
+      fg=_foreground;
+      bg=_background;
+
+      // prepare each character and work out the window that encloses them all
+
+      if(_glyphCache!=nullptr)
+        _glyphCache->beginBatch(_foreground,_background);
+
+      width=0;
+
+      for(i=0;i<count;i++) {
+
+        beginGlyph(cursors[i],font,*glyphs[i]);
+        cursors[i].Pixels=getCachedGlyph(font,*glyphs[i]);
+
+        width+=glyphs[i]->PixelWidth+gap;
+      }
+
+      if(width==0)
+        return;
+
+      this->moveTo(Rectangle(p.X,p.Y,width,font.getHeight()));
+      this->beginWriting();
+
+      for(row=0;row<font.getHeight();row++) {
+
+        for(i=0;i<count;i++) {
+
+          GlyphCursor& gc(cursors[i]);
+
+          if(gc.Pixels!=nullptr) {
+
+            // send a row of the expanded character as it is
+
+            if(gc.Width) {
+              this->rawTransfer(gc.Pixels,gc.Width);
+              gc.Pixels+=gc.Width;
+            }
+          }
+          else if(gc.Rle) {
+
+            // decode a row of an RLE character a run at a time
+
+            for(x=0;x<gc.Width;x+=n) {
+
+              n=nextGlyphRun(gc,gc.Width-x,foreground);
+
+              const UnpackedColour& cr(foreground ? fg : bg);
+
+              for(j=0;j<n;j++)
+                this->writePixel(cr);
+            }
+          }
+          else {
+
+            // bitmap characters are quicker tested bit by bit than by runs
+
+            data=gc.Data;
+            mask=gc.Mask;
+
+            for(x=0;x<gc.Width;x++) {
+
+              this->writePixel((*data & mask)!=0 ? fg : bg);
+
+              if(mask==0x80) {
+                mask=1;
+                data++;
+              }
+              else
+                mask<<=1;
+            }
+
+            gc.Data=data;
+            gc.Mask=mask;
+          }
+
+          for(j=0;j<gap;j++)
+            this->writePixel(bg);
+        }
+      }
+    }
+
+
+    /*
+     * Write a character from an RLE font without filling the background. Each foreground run is
+     * split at the end of its row and sent as a one row fill.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::writeGlyphSpans(const Point& p,const Font& font,const FontChar& fc) {
+
+      GlyphCursor gc;
+      uint16_t x,n;
+      uint8_t row;
+      bool foreground;
+
+      beginGlyph(gc,font,fc);
+
+      for(row=0;row<font.getHeight();row++) {
+
+        for(x=0;x<gc.Width;x+=n) {
+
+          n=nextGlyphRun(gc,gc.Width-x,foreground);
+
+          if(foreground) {
+            this->moveTo(Rectangle(p.X+x,p.Y+row,n,1));
+            this->fillPixels(n,_foreground);
+          }
+        }
+      }
+    }
+
+
+    /*
+     * Get a character from the glyph cache, expanding it into the cache if it's not there. Returns
+     * nullptr if there's no cache, the character is too big for it or there's no free slot.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline const typename GraphicsLibrary<TDevice,TDeviceAccessMode>::UnpackedColour *GraphicsLibrary<TDevice,TDeviceAccessMode>::getCachedGlyph(const Font& font,const FontChar& fc) {
+
+      const UnpackedColour *cached;
+      UnpackedColour *dest;
+      GlyphCursor gc;
+      uint16_t numPixels,n;
+      bool foreground;
+
+      if(_glyphCache==nullptr)
+        return nullptr;
+
+      numPixels=static_cast<uint16_t>(fc.PixelWidth)*font.getHeight();
+
+      if(numPixels>_glyphCache->getSlotPixels())
+        return nullptr;
+
+      if((cached=_glyphCache->find(&fc))!=nullptr)
+        return cached;
+
+      // decode the whole character into a new slot
+
+      if((dest=_glyphCache->allocate(&fc))==nullptr)
+        return nullptr;
+
+      cached=dest;
+      beginGlyph(gc,font,fc);
+
+      while(numPixels) {
+
+        n=nextGlyphRun(gc,numPixels,foreground);
+
+        std::fill(dest,dest+n,foreground ? _foreground : _background);
+        dest+=n;
+        numPixels-=n;
+      }
+
+      return cached;
+    }
+
+
+    /*
+     * Get ready to decode a character from a bitmap or RLE font
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline void GraphicsLibrary<TDevice,TDeviceAccessMode>::beginGlyph(GlyphCursor& gc,const Font& font,const FontChar& fc) const {
+
+      gc.Pixels=nullptr;
+      gc.Data=fc.Data;
+      gc.Width=fc.PixelWidth;
+      gc.Mask=1;
+      gc.Rle=font.getType()==FontBase::FONT_RLE;
+
+      // RLE starts with the length of the first background run
+
+      if(gc.Rle) {
+        gc.Remaining=*gc.Data++;
+        gc.Foreground=false;
+      }
+    }
+
+
+    /*
+     * Get the next run of pixels of one colour from a character, up to maxPixels. Bitmap fonts
+     * are scanned bit by bit. RLE fonts give up their runs directly.
+     */
+
+    template<class TDevice,typename TDeviceAccessMode>
+    inline uint16_t GraphicsLibrary<TDevice,TDeviceAccessMode>::nextGlyphRun(GlyphCursor& gc,uint16_t maxPixels,bool& foreground) {
+
+      uint16_t n;
+
+      if(gc.Rle) {
+
+        while(gc.Remaining==0) {
+          gc.Remaining=*gc.Data++;
+          gc.Foreground=!gc.Foreground;
+        }
+
+        n=std::min(gc.Remaining,maxPixels);
+        gc.Remaining-=n;
+        foreground=gc.Foreground;
+
+        return n;
+      }
+
+      foreground=(*gc.Data & gc.Mask)!=0;
+      n=0;
+
+      do {
+
+        n++;
+
+        if(gc.Mask==0x80) {
+          gc.Mask=1;
+          gc.Data++;
+        }
+        else
+          gc.Mask<<=1;
+
+      } while(n<maxPixels && ((*gc.Data & gc.Mask)!=0)==foreground);
+
+      return n;
+    }
+
+
     /**
      * Get the font currently selected for use in stream operations
      * @return The font pointer, or NULL. You do not own this pointer
@@ -74,7 +375,7 @@ namespace stm32plus {
      */
 
     template<class TDevice,typename TDeviceAccessMode>
-    inline Size GraphicsLibrary<TDevice,TDeviceAccessMode>::measureString(const Font& font,const char *str) const {
+    inline Size GraphicsLibrary<TDevice,TDeviceAccessMode>::measureString(const FontBase& font,const char *str) const {
 
       Size size;
       uint8_t c;
@@ -115,16 +416,12 @@ namespace stm32plus {
     template<class TDevice,typename TDeviceAccessMode>
     inline GraphicsLibrary<TDevice,TDeviceAccessMode>& GraphicsLibrary<TDevice,TDeviceAccessMode>::operator<<(char c) {
 
-      const FontChar *fc;
-
-      _streamSelectedFont->getCharacter((uint8_t)c,fc);
+      char str[2];
 
-      if(_fontFilledBackground)
-        writeCharacterFill(_streamSelectedPoint,*_streamSelectedFont,*fc);
-      else
-        writeCharacterNoFill(_streamSelectedPoint,*_streamSelectedFont,*fc);
+      str[0]=c;
+      str[1]='\0';
 
-      _streamSelectedPoint.X+=fc->PixelWidth+_streamSelectedFont->getCharacterSpacing();
+      _streamSelectedPoint.X+=writeString(_streamSelectedPoint,*_streamSelectedFont,str).Width;
       return *this;
     }
 
@@ -88,7 +88,7 @@ namespace stm32plus {
       // follow the data
 
       numBits=static_cast<uint32_t>(font.getHeight()) * static_cast<uint32_t>(fc.PixelWidth);
-      needToMove=false;
+      needToMove=true;          // the first pixel written always needs a window
       fontData=fc.Data;
       mask=1;
 
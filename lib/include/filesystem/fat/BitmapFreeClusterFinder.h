@@ -0,0 +1,47 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * @brief Free cluster finder that searches the file system's free cluster bitmap.
+     *
+     * Groups of clusters that are known to be full are skipped without reading the FAT. With an
+     * exact bitmap the FAT is not read at all. Searching starts at a hint, typically the cluster
+     * after the last one allocated, so that consecutive allocations form contiguous runs.
+     */
+
+    class BitmapFreeClusterFinder : public FreeClusterFinder {
+
+      protected:
+        FreeClusterBitmap& _bitmap;
+        uint32_t _nextCluster;
+
+      protected:
+        bool isFree(uint32_t clusterNumber,bool& free);
+
+      public:
+        BitmapFreeClusterFinder(FatFileSystem& fs,FreeClusterBitmap& bitmap,uint32_t startCluster);
+
+        /**
+         * Virtual destructor. Does nothing.
+         */
+
+        virtual ~BitmapFreeClusterFinder() {
+        }
+
+        bool findMultipleSequential(uint32_t clustersRequired,uint32_t& firstCluster);
+
+        // overrides from FreeClusterFinder
+
+        virtual bool find(uint32_t& freeCluster) override;
+    };
+  }
+}
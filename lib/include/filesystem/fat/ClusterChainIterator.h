@@ -33,6 +33,7 @@ namespace stm32plus {
         ExtensionMode _extend;
         uint32_t _currentClusterNumber;
         uint32_t _firstClusterNumber;
+        uint32_t _clustersWanted;
         FatFileSystem& _fs;
 
       public:
@@ -46,6 +47,7 @@ namespace stm32plus {
 
         uint32_t currentSectorNumber();
         void reset(uint32_t firstClusterNumber_);
+        void setClustersWanted(uint32_t clustersWanted);
 
         // overrides from Iterator
 
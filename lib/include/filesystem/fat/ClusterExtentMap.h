@@ -0,0 +1,47 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * @brief Map of a file's cluster chain compressed into runs of contiguous clusters.
+     *
+     * The map is built as the chain is walked and holds a bounded number of extents. When the
+     * map is full it continues to describe the start of the file and any further clusters are
+     * not recorded. Lookups are a binary search over the extents so seeking to a position
+     * inside the mapped part of a file does not need to read the FAT.
+     */
+
+    class ClusterExtentMap {
+
+      protected:
+
+        struct Extent {
+          uint32_t FileClusterIndex;    // zero-based cluster index within the file
+          uint32_t FirstCluster;        // cluster number on the device
+          uint32_t Length;              // clusters in this run
+        };
+
+        Extent *_extents;
+        uint32_t _maxExtents;
+        uint32_t _extentCount;
+
+      public:
+        ClusterExtentMap(uint32_t maxExtents);
+        ~ClusterExtentMap();
+
+        void clear();
+        void add(uint32_t fileClusterIndex,uint32_t clusterNumber);
+        bool find(uint32_t fileClusterIndex,uint32_t& clusterNumber) const;
+        bool getLast(uint32_t& fileClusterIndex,uint32_t& clusterNumber) const;
+        uint32_t getExtentCount() const;
+    };
+  }
+}
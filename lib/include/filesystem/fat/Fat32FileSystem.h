@@ -13,11 +13,20 @@ namespace stm32plus {
   /**
    * @brief FAT32 implementation of the filesystem.
    *
-   * Provides an implementation of FatFileSystem for FAT32.
+   * Provides an implementation of FatFileSystem for FAT32. The free cluster count and next
+   * free cluster hint in the FSInfo sector are read when the file system is created and
+   * written back by sync().
    */
 
     class Fat32FileSystem : public FatFileSystem {
 
+      protected:
+        void readFreeSpaceInfo();
+
+        // overrides from FatFileSystem
+
+        virtual bool writeFreeSpaceInfo(bool valid) override;
+
       public:
         Fat32FileSystem(
           BlockDevice& blockDevice,
@@ -13,11 +13,15 @@ namespace stm32plus {
     /**
      * @brief FsInfo structure used to accelerate some file system operation.
      *
-     * This is not supported in the stm32plus implementation.
+     * The free count and next free hint are read and maintained by Fat32FileSystem.
      */
 
     struct Fat32FsInfo {
 
+        static constexpr uint32_t FSINFO_LEAD_SIG=0x41615252;
+        static constexpr uint32_t FSINFO_STRUC_SIG=0x61417272;
+        static constexpr uint32_t FSINFO_TRAIL_SIG=0xAA550000;
+
         /// Value 0x41615252. This lead signature is used to validate that this is in fact an FSInfo sector.
         uint32_t FSI_LeadSig;
 
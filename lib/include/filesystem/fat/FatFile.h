@@ -24,18 +24,17 @@ namespace stm32plus {
         DirectoryEntryWithLocation _dirent;
         ByteMemblock _sectorBuffer;
         FileSectorIterator _iterator;
+        ClusterExtentMap *_extentMap;
 
       protected:
         void calcIndexes();
+        uint32_t getFirstCluster() const;
 
       public:
         FatFile(FatFileSystem& fs_,DirectoryEntryWithLocation& dirent_);
+        virtual ~FatFile();
 
-        /**
-         * Virtual destructor, does nothing.
-         */
-
-        virtual ~FatFile() {}
+        bool enableExtentMap(uint32_t maxExtents);
 
       // get the dirent
 
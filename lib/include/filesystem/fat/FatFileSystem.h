@@ -23,16 +23,73 @@ namespace stm32plus {
      * @brief Base class for FAT filesystems.
      *
      * Exposes the common functionality of FAT16 and FAT32 filesystems.
+     *
+     * FAT sectors are accessed through a small cache so that consecutive reads and writes of
+     * FAT entries in the same sector do not go to the device. Modified FAT sectors are written
+     * to every copy of the FAT when they are evicted from the cache or when flushFatCache() is
+     * called. The file system flushes at the end of each operation that changes the FAT and
+     * when it is destroyed.
+     *
+     * The number of free clusters is tracked as the FAT changes once it is known, either from the
+     * FAT32 FSInfo sector, from a call to getFreeSpace() or from enableFreeClusterBitmap().
+     * The optional free cluster bitmap lets allocation skip full parts of the FAT and places new
+     * clusters after the end of the chain being extended so that files stay contiguous. With an
+     * exact bitmap a chain that can't continue into the next cluster moves to a run of free
+     * clusters that's long enough for the rest of the write in progress. The bitmap is built at mount if getInstance()
+     * is given the RAM for it, or later by enableFreeClusterBitmap().
      */
 
     class FatFileSystem : public FileSystem {
+
+      public:
+
+        /**
+         * Counters for the FAT sector cache. The ratio of entry accesses to sector I/Os
+         * shows how effective the cache is.
+         */
+
+        struct FatCacheStatistics {
+          uint32_t FatEntryReads;       ///< calls to readFatEntry()
+          uint32_t FatEntryWrites;      ///< calls to writeFatEntry()
+          uint32_t FatSectorReads;      ///< FAT sectors read from the device
+          uint32_t FatSectorWrites;     ///< FAT sectors written to the device, including mirrors
+        };
+
+        /// default number of FAT sectors held in the cache
+        static constexpr uint32_t DEFAULT_FAT_CACHE_SECTORS=2;
+
       protected:
+
+        struct FatCacheEntry {
+          uint32_t SectorIndex;
+          uint32_t LastUsed;
+          uint8_t *Data;
+          bool Dirty;
+        };
+
         BootSector _bootSector; // the BPB
 
         uint32_t _firstDataSector; // index of the first data sector
         uint32_t _fatFirstSector; // first sector of the FAT
         uint32_t _rootDirFirstSector; // first sector of the root directory
         uint32_t _countOfClusters; // total # of clusters
+        uint32_t _fatSize; // sectors in each copy of the FAT
+
+        FatCacheEntry *_fatCache; // cached FAT sectors
+        uint8_t *_fatCacheMemory; // sector data for the cache
+        uint32_t _fatCacheSize; // number of cached sectors
+        uint32_t _fatCacheClock; // LRU timestamp source
+        FatCacheStatistics _fatCacheStatistics;
+
+        FreeClusterBitmap *_freeClusterBitmap; // optional free cluster summary
+        uint32_t _freeClusterCount; // current free cluster count, if known
+        uint32_t _nextFreeCluster; // where to start looking for a free cluster
+        bool _freeSpaceInfoValid; // the free space info on the device is current
+        bool _invalidateFreeSpaceInfo; // the free space info on the device must be marked unknown
+
+        static constexpr uint32_t FREE_FAT_CACHE_ENTRY=0xFFFFFFFF;
+        static constexpr uint32_t UNKNOWN_FREE_CLUSTER_COUNT=0xFFFFFFFF;
+        static constexpr uint32_t FREE_CLUSTER_SCAN_SECTORS=8;
 
       protected:
         FatFileSystem(BlockDevice& blockDevice,const TimeProvider& timeProvider,const fat::BootSector& bootSector,uint32_t firstSectorIndex,uint32_t countOfClusters);
@@ -43,6 +100,24 @@ namespace stm32plus {
         bool fullyDelete(FatDirectoryIterator& it);
         bool deleteDirents(FatDirectoryIterator& fdi);
 
+        bool getFatCacheEntry(uint32_t fatEntryIndex,FatCacheEntry*& entry,uint32_t& offset);
+        bool writeBackFatCacheEntry(FatCacheEntry& entry);
+        void freeFatCache();
+        bool findFreeCluster(uint32_t& freeCluster,uint32_t hint);
+        bool findFreeRun(uint32_t clustersWanted,uint32_t hint,uint32_t& firstCluster);
+
+
+        /**
+         * Write the free cluster count and next free cluster hint to the device. The base class does not
+         * store this information and does nothing.
+         * @param[in] valid false to mark the information on the device as unknown.
+         * @return false if it fails.
+         */
+
+        virtual bool writeFreeSpaceInfo(bool /* valid */) {
+          return true;
+        }
+
       public:
 
         /**
@@ -64,7 +139,7 @@ namespace stm32plus {
         };
 
         // factory constructor/destructor
-        static bool getInstance(BlockDevice& blockDevice,const TimeProvider& timeProvider,FatFileSystem*& newFileSystem);
+        static bool getInstance(BlockDevice& blockDevice,const TimeProvider& timeProvider,FatFileSystem*& newFileSystem,uint32_t freeClusterBitmapBytes=0);
 
         virtual ~FatFileSystem();
 
@@ -87,13 +162,21 @@ namespace stm32plus {
         bool readSectorFromCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer);
         bool writeSectorToCluster(uint32_t clusterIndex,uint32_t sectorIndexInCluster,void *buffer);
         bool readFatEntry(uint32_t clusterNumber,uint32_t& fatEntryForCluster);
-        bool allocateNewCluster(uint32_t anyClusterInChain,uint32_t& newCluster);
+        bool allocateNewCluster(uint32_t anyClusterInChain,uint32_t& newCluster,uint32_t clustersWanted=1);
         bool findFreeCluster(uint32_t& freeCluster);
         bool writeFatEntry(uint32_t fatEntryIndex,uint32_t fatEntryContent);
         bool writeDirectoryEntry(DirectoryEntryWithLocation& dirent);
         bool deAllocateClusterChain(uint32_t firstCluster);
         bool directoryHasContent(const char *dirName,bool& hasContent);
 
+        bool flushFatCache();
+        bool sync();
+        bool enableFreeClusterBitmap(uint32_t clustersPerBit);
+        FreeClusterBitmap *getFreeClusterBitmap() const;
+        bool setFatCacheSize(uint32_t numSectors);
+        const FatCacheStatistics& getFatCacheStatistics() const;
+        void resetFatCacheStatistics();
+
         /**
          * Get a FAT entry from memory. 16-bit entries are up-cast to fill 32 bits.
          * @param[in] addr the address to extract the entry from.
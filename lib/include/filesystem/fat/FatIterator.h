@@ -12,6 +12,8 @@ namespace stm32plus {
 
     /**
      * @brief Iterate over the entries in the FAT sequentially.
+     *
+     * Entries are read through the file system's FAT sector cache.
      */
 
     class FatIterator : public Iterator<uint32_t> {
@@ -21,10 +23,9 @@ namespace stm32plus {
         uint32_t _firstIndex;
         uint32_t _currentIndex;
         uint32_t _entriesPerFat;
-        uint32_t _lastSectorIndex;
+        uint32_t _currentContent;
         bool _wrap;
         bool _first;
-        ByteMemblock _sectorBuffer;
 
       public:
         FatIterator(FatFileSystem& fs_,uint32_t firstIndex_,bool wrap_);
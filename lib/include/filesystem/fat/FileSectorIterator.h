@@ -21,6 +21,12 @@ namespace stm32plus {
         FatFileSystem& _fs;
         uint32_t _sectorIndexInCluster;
         uint32_t _sectorsPerCluster;
+        uint32_t _clusterIndexInFile;
+        ClusterExtentMap *_extentMap;
+
+      protected:
+        bool nextCluster();
+        void positionAtCluster(uint32_t clusterIndexInFile,uint32_t clusterNumber);
 
       public:
         FileSectorIterator(FatFileSystem& fs,uint32_t firstClusterIndex,ClusterChainIterator::ExtensionMode extend);
@@ -37,7 +43,12 @@ namespace stm32plus {
         bool readSector(void *buffer);
         bool writeSector(void *buffer);
 
+        bool nextRun(uint32_t maxSectors,uint32_t& firstSector,uint32_t& numSectors);
+
         void reset(uint32_t firstClusterNumber);
+        bool moveTo(uint32_t firstClusterNumber,uint32_t sectorCount);
+        void setExtentMap(ClusterExtentMap *extentMap);
+        void setClustersWanted(uint32_t clustersWanted);
 
         // overrides from Iterator
 
@@ -0,0 +1,91 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * @brief In-memory summary of the free clusters in the FAT.
+     *
+     * Each bit covers a group of clustersPerBit clusters. A set bit means that the group may
+     * contain a free cluster and a clear bit means that it definitely does not. When there is one
+     * cluster per bit the bitmap is exact and a set bit is a free cluster. Larger groups trade
+     * precision for RAM: a 32Gb card with 1M clusters needs 128Kb for an exact bitmap but only 1Kb
+     * with 128 clusters (one FAT32 sector) per bit. A finder that searches a group and finds it
+     * full clears the bit with markGroupFull().
+     */
+
+    class FreeClusterBitmap {
+
+      protected:
+        uint32_t *_bits;
+        uint32_t _numClusters;
+        uint32_t _numGroups;
+        uint32_t _groupShift;
+
+      public:
+        FreeClusterBitmap(uint32_t numClusters,uint32_t clustersPerBit);
+        ~FreeClusterBitmap();
+
+        void clear();
+        void markFree(uint32_t clusterNumber);
+        void markUsed(uint32_t clusterNumber);
+        void markGroupFull(uint32_t clusterNumber);
+        bool mayBeFree(uint32_t clusterNumber) const;
+        bool findGroup(uint32_t startCluster,uint32_t& groupFirstCluster) const;
+
+        bool isExact() const;
+        uint32_t getClustersPerBit() const;
+        uint32_t getNumClusters() const;
+    };
+
+
+    /**
+     * Check if the group containing a cluster may have free clusters in it
+     * @param[in] clusterNumber The cluster to check.
+     * @return true if the group may contain a free cluster. For an exact bitmap, true if the cluster is free.
+     */
+
+    inline bool FreeClusterBitmap::mayBeFree(uint32_t clusterNumber) const {
+      uint32_t group=clusterNumber >> _groupShift;
+      return (_bits[group/32] & (1U << (group % 32)))!=0;
+    }
+
+
+    /**
+     * Check if this bitmap has a bit for every cluster
+     * @return true if there is one cluster per bit.
+     */
+
+    inline bool FreeClusterBitmap::isExact() const {
+      return _groupShift==0;
+    }
+
+
+    /**
+     * Get the number of clusters covered by each bit
+     * @return The group size.
+     */
+
+    inline uint32_t FreeClusterBitmap::getClustersPerBit() const {
+      return 1 << _groupShift;
+    }
+
+
+    /**
+     * Get the number of clusters covered by the bitmap, including the two reserved entries
+     * at the start of the FAT.
+     * @return The cluster count.
+     */
+
+    inline uint32_t FreeClusterBitmap::getNumClusters() const {
+      return _numClusters;
+    }
+  }
+}
@@ -11,31 +11,40 @@ namespace stm32plus {
 
 
   /**
-   * Template class to manage a circular buffer of types. Separate read and write pointers are
-   * maintained. Methods are provided to read from and write to the buffer. More methods are provided
-   * to find out how much read space and write space is available without overrunning the other
-   * position.
+   * Template class to manage a circular buffer of types. This is a lock-free single producer,
+   * single consumer ring. One side of your code may write to it while another side reads from
+   * it without disabling interrupts. The writer may be an IRQ handler and the reader normal
+   * code or the other way around, or on a host they can be two threads.
    *
-   * The 'last operation type' flag is stored in the high bit of the read index. This allows the
-   * availableToWrite() and availableToRead() methods to get at the read index and the flag in an
-   * atomic operation. This makes this class safe to use for an IRQ-based writer and a normal code
-   * reader - but not the other way around.
+   * The capacity is rounded up to a power of two so that positions are found by masking.
+   * The read and write indexes run freely and wrap at 2^32 so the amount of data held is
+   * always writeIndex-readIndex, with no need for a flag to tell a full buffer from an empty
+   * one. Each index is only ever stored by its own side. The data is published by a store
+   * with release semantics after it has been written and picked up with a load that has
+   * acquire semantics before it's read.
+   *
+   * As well as copying reads and writes there are peek/commit methods that expose the
+   * contiguous span at the current position so that, for example, a DMA transfer can fill
+   * or drain the buffer in place.
+   *
+   * Producer methods: write(), writeAhead(), peekWrite(), commitWrite()
+   * Consumer methods: read(), peekRead(), commitRead()
+   * Either side: availableToWrite(), availableToRead(), getCapacity()
    */
 
   template<typename T>
   class circular_buffer {
 
     protected:
-
-      enum {
-        LAST_OP_READ_FLAG = 0x80000000,
-        READ_INDEX_MASK = ~LAST_OP_READ_FLAG
-      };
-
       T *_buffer;
       uint32_t _size;
-      uint32_t _readIndex;
-      uint32_t _writeIndex;
+      uint32_t _mask;
+      uint32_t _readIndex;          // stored only by the consumer
+      uint32_t _writeIndex;         // stored only by the producer
+
+    protected:
+      static uint32_t loadAcquire(const volatile uint32_t& index);
+      static void storeRelease(volatile uint32_t& index,uint32_t value);
 
     public:
       circular_buffer(uint32_t size);
@@ -43,26 +52,35 @@ namespace stm32plus {
 
       void read(T *output,uint32_t size) volatile;
       T read() volatile;
+      uint32_t peekRead(const T*& ptr) const volatile;
+      void commitRead(uint32_t size) volatile;
 
       void write(const T *input,uint32_t size) volatile;
       void write(const T& input) volatile;
+      void writeAhead(uint32_t offset,const T *input,uint32_t size) volatile;
+      uint32_t peekWrite(T*& ptr) const volatile;
+      void commitWrite(uint32_t size) volatile;
 
       uint32_t availableToWrite() const volatile;
       uint32_t availableToRead() const volatile;
+      uint32_t getCapacity() const volatile;
   };
 
 
   /**
    * Constructor
-   * @param size The number of types to store in the buffer
+   * @param size The number of types to store in the buffer. This is rounded up to a power of 2.
    */
 
   template<typename T>
   inline circular_buffer<T>::circular_buffer(uint32_t size)
-    : _buffer(new T[size]),
-      _size(size),
-      _readIndex(LAST_OP_READ_FLAG),
+    : _readIndex(0),
       _writeIndex(0) {
+
+    for(_size=1;_size<size;_size<<=1);
+
+    _buffer=new T[_size];
+    _mask=_size-1;
   }
 
 
@@ -72,64 +90,46 @@ namespace stm32plus {
 
   template<typename T>
   inline circular_buffer<T>::~circular_buffer() {
-    delete _buffer;
+    delete [] _buffer;
   }
 
 
   /**
-   * get the number of types that available to write without overrunning the read pointer. In
-   * an IRQ-writer, normal reader scenario this method is safe for the IRQ writer to call.
-   * @return The number of available types
+   * Get the number of types that the buffer can hold
+   * @return The capacity, which is a power of 2
    */
 
   template<typename T>
-  inline uint32_t circular_buffer<T>::availableToWrite() const volatile {
+  inline uint32_t circular_buffer<T>::getCapacity() const volatile {
+    return _size;
+  }
 
-    volatile uint32_t readIndex;
-    bool lastOpRead;
 
-    readIndex=_readIndex;
-    lastOpRead=(readIndex & LAST_OP_READ_FLAG)!=0;
-    readIndex&=READ_INDEX_MASK;
+  /**
+   * get the number of types that available to write without overrunning the read pointer.
+   * @return The number of available types
+   */
 
-    if(_writeIndex==readIndex)
-      return lastOpRead ? _size : 0;
-    else if(_writeIndex>readIndex)
-      return _size-_writeIndex+readIndex;
-    else
-      return readIndex-_writeIndex;
+  template<typename T>
+  inline uint32_t circular_buffer<T>::availableToWrite() const volatile {
+    return _size-availableToRead();
   }
 
 
   /**
-   * get the number of types that available to read without overrunning the write pointer
+   * get the number of types that available to read without overrunning the write pointer. The
+   * read index is loaded first. The write index can only move further ahead of it so the
+   * result never exceeds the capacity, whichever side calls this.
    * @return The number of available types
    */
 
   template<typename T>
   inline uint32_t circular_buffer<T>::availableToRead() const volatile {
 
-    volatile uint32_t readIndex;
-    uint32_t ret;
-    bool lastOpRead;
+    uint32_t readIndex;
 
-    // the loop catches a nasty case where an interrupt gets in between the lines labelled
-    // 1 and 2 below and the write index subsequently wraps below the read index
-
-    do {
-      readIndex=_readIndex;
-      lastOpRead=(readIndex & LAST_OP_READ_FLAG)!=0;
-      readIndex&=READ_INDEX_MASK;
-
-      if(_writeIndex==readIndex)
-        ret=lastOpRead ? 0 : _size;
-      else if(_writeIndex>readIndex)    // 1
-        ret=_writeIndex-readIndex;      // 2
-      else
-        ret=_size-readIndex+_writeIndex;
-    } while(ret>_size);
-
-    return ret;
+    readIndex=loadAcquire(_readIndex);
+    return loadAcquire(_writeIndex)-readIndex;
   }
 
 
@@ -143,17 +143,17 @@ namespace stm32plus {
   template<typename T>
   inline void circular_buffer<T>::read(T *output,uint32_t size) volatile {
 
-    uint32_t pos;
+    uint32_t pos,first;
 
-    for(pos=(_readIndex & READ_INDEX_MASK);size!=0;size--) {
+    pos=_readIndex & _mask;
+    first=std::min(size,_size-pos);
 
-      *output++=_buffer[pos];
+    // the data may be in two pieces if it wraps around the end
 
-      if(++pos==_size)
-        pos=0;
-    }
+    std::copy(_buffer+pos,_buffer+pos+first,output);
+    std::copy(_buffer,_buffer+size-first,output+first);
 
-    _readIndex=pos | LAST_OP_READ_FLAG;
+    storeRelease(_readIndex,_readIndex+size);
   }
 
 
@@ -165,44 +165,58 @@ namespace stm32plus {
   template<typename T>
   inline T circular_buffer<T>::read() volatile {
 
-    uint32_t pos;
     T retval;
 
-    pos=_readIndex & READ_INDEX_MASK;
-    retval=_buffer[pos];
+    retval=_buffer[_readIndex & _mask];
+    storeRelease(_readIndex,_readIndex+1);
 
-    if(++pos==_size)
-      pos=0;
-
-    _readIndex=pos | LAST_OP_READ_FLAG;
     return retval;
   }
 
 
   /**
-   * Write a number of types to the internal buffer. It's your responsibility to ensure that there
-   * is sufficient space in the circular buffer to write your data.
-   * @param input Your buffer to copy from
-   * @param size The number of types to write
+   * Get a pointer to the data waiting to be read without consuming it. Only the part up to
+   * the end of the internal buffer is returned. If the data wraps then a second call after
+   * commitRead() gets the rest.
+   * @param[out] ptr Where the data starts
+   * @return The number of types that can be read contiguously from ptr
    */
 
   template<typename T>
-  inline void circular_buffer<T>::write(const T *input,uint32_t size) volatile {
+  inline uint32_t circular_buffer<T>::peekRead(const T*& ptr) const volatile {
 
     uint32_t pos;
 
-    // operate on local version of write index until we're sure it's valid when written back.
+    pos=_readIndex & _mask;
+    ptr=_buffer+pos;
 
-    for(pos=_writeIndex;size!=0;size--) {
+    return std::min(availableToRead(),_size-pos);
+  }
 
-      _buffer[pos]=*input++;
 
-      if(++pos==_size)
-        pos=0;
-    }
+  /**
+   * Release types that have been read in place after peekRead(). The space becomes
+   * available to the writer.
+   * @param size The number of types consumed
+   */
 
-    _writeIndex=pos;
-    _readIndex&=~LAST_OP_READ_FLAG;
+  template<typename T>
+  inline void circular_buffer<T>::commitRead(uint32_t size) volatile {
+    storeRelease(_readIndex,_readIndex+size);
+  }
+
+
+  /**
+   * Write a number of types to the internal buffer. It's your responsibility to ensure that there
+   * is sufficient space in the circular buffer to write your data.
+   * @param input Your buffer to copy from
+   * @param size The number of types to write
+   */
+
+  template<typename T>
+  inline void circular_buffer<T>::write(const T *input,uint32_t size) volatile {
+    writeAhead(0,input,size);
+    commitWrite(size);
   }
 
 
@@ -213,18 +227,85 @@ namespace stm32plus {
 
   template<typename T>
   inline void circular_buffer<T>::write(const T& input) volatile {
+    _buffer[_writeIndex & _mask]=input;
+    storeRelease(_writeIndex,_writeIndex+1);
+  }
+
+
+  /**
+   * Write a number of types into the free space at an offset beyond the write index without
+   * making them available to the reader. This lets data that arrives out of order be stored
+   * where it belongs so that it can be made readable later with commitWrite(). It's your
+   * responsibility to ensure that offset+size does not exceed the available write space.
+   * @param offset The distance beyond the write index to start writing
+   * @param input Your buffer to copy from
+   * @param size The number of types to write
+   */
+
+  template<typename T>
+  inline void circular_buffer<T>::writeAhead(uint32_t offset,const T *input,uint32_t size) volatile {
+
+    uint32_t pos,first;
+
+    pos=(_writeIndex+offset) & _mask;
+    first=std::min(size,_size-pos);
+
+    std::copy(input,input+first,_buffer+pos);
+    std::copy(input+first,input+size,_buffer);
+  }
+
+
+  /**
+   * Get a pointer to the free space so that it can be filled in place. Only the part up to
+   * the end of the internal buffer is returned. If the space wraps then a second call after
+   * commitWrite() gets the rest.
+   * @param[out] ptr Where the free space starts
+   * @return The number of types that can be written contiguously from ptr
+   */
+
+  template<typename T>
+  inline uint32_t circular_buffer<T>::peekWrite(T*& ptr) const volatile {
 
     uint32_t pos;
 
-    // operate on local version of write index until we're sure it's valid when written back.
+    pos=_writeIndex & _mask;
+    ptr=_buffer+pos;
+
+    return std::min(availableToWrite(),_size-pos);
+  }
+
+
+  /**
+   * Make types that have been written in place after peekWrite() or writeAhead() available
+   * to the reader by moving the write index forward. The types immediately following the
+   * write index must all have been written.
+   * @param size The number of types to commit
+   */
+
+  template<typename T>
+  inline void circular_buffer<T>::commitWrite(uint32_t size) volatile {
+    storeRelease(_writeIndex,_writeIndex+size);
+  }
+
+
+  /*
+   * Load an index written by the other side. Data that the other side wrote before storing
+   * the index is visible after this returns.
+   */
+
+  template<typename T>
+  inline uint32_t circular_buffer<T>::loadAcquire(const volatile uint32_t& index) {
+    return __atomic_load_n(&index,__ATOMIC_ACQUIRE);
+  }
 
-    pos=_writeIndex;
-    _buffer[pos]=input;
 
-    if(++pos==_size)
-      pos=0;
+  /*
+   * Store our own index. Everything we wrote before this is visible to the other side
+   * when it loads the new value.
+   */
 
-    _writeIndex=pos;
-    _readIndex&=~LAST_OP_READ_FLAG;
+  template<typename T>
+  inline void circular_buffer<T>::storeRelease(volatile uint32_t& index,uint32_t value) {
+    __atomic_store_n(&index,value,__ATOMIC_RELEASE);
   }
 }
@@ -12,23 +12,28 @@ namespace stm32plus {
   namespace net {
 
     /**
-     * Network buffer class. This is designed to hold an un-owned pointer to an optional
-     * user-supplied data buffer intended for transmission together with an owned buffer
-     * large enough to contain data to transmit before the user buffer, i.e. network
-     * headers and such like.
+     * Network buffer class. This is designed to hold an owned buffer large enough to contain
+     * the network headers followed by a chain of reference counted data segments that are
+     * transmitted after the headers. The segments may own their memory, point at an un-owned
+     * user-supplied buffer or be slices of other segments. The MAC gathers the internal buffer
+     * and the segments straight into the frame with DMA so the payload is never copied.
      */
 
     class NetBuffer {
 
       protected:
-        const void *_userBuffer;
-        uint32_t _userBufferSize;
-
         void *_internalBuffer;
         uint32_t _internalBufferSize;
 
         void *_writePointer;
 
+        // the payload segment chain
+
+        NetBufferSegment *_firstSegment;
+        NetBufferSegment *_lastSegment;
+        uint16_t _segmentCount;
+        uint32_t _segmentsSize;
+
         // this is normall nullptr except when a fragmented packet is going out. In that case the last
         // in the sequence has the original packet pointer here
 
@@ -39,10 +44,19 @@ namespace stm32plus {
 
         DatalinkChecksum _checksumRequest;
 
+        // false if the constructor could not allocate the header space or the user buffer's segment
+
+        bool _valid;
+
       public:
         NetBuffer(uint32_t headerSpace,uint32_t dataSpace,const void *userBuffer=nullptr,uint32_t userBufferSize=0);
         ~NetBuffer();
 
+        bool isValid() const;
+
+        static void *operator new(size_t size) noexcept;
+        static void operator delete(void *ptr);
+
         const void *getUserBuffer() const;
         void *getInternalBuffer() const;
 
@@ -53,6 +67,10 @@ namespace stm32plus {
         void *getWritePointer() const;
         void *moveWritePointerBack(uint32_t size);
 
+        bool appendSegment(NetBufferSegment *segment);
+        NetBufferSegment *getFirstSegment() const;
+        uint16_t getSegmentCount() const;
+
         NetBuffer *getReference() const;
         void setReference(NetBuffer *reference);
 
@@ -62,51 +80,156 @@ namespace stm32plus {
 
 
     /**
-     * Constructor, save variables and allocate internal buffer
+     * Constructor, save variables and allocate internal buffer. If a user buffer is supplied then
+     * it becomes the first segment in the chain. The user buffer is not owned by this class and
+     * must stay in scope until the frame has been transmitted.
+     *
+     * The constructor allocates memory, which can fail. Check isValid() before using the buffer.
      * @param headerSpace
      * @param dataSpace
      * @param userBuffer
+     * @param userBufferSize
      */
 
     inline NetBuffer::NetBuffer(uint32_t headerSpace,uint32_t dataSpace,const void *userBuffer,uint32_t userBufferSize) {
 
-      _userBufferSize=userBufferSize;
-      _userBuffer=userBuffer;
+      _firstSegment=_lastSegment=nullptr;
+      _segmentCount=0;
+      _segmentsSize=0;
+
+      _valid=true;
+
+      if(userBuffer && userBufferSize)
+        _valid=appendSegment(NetBufferSegment::createExternal(userBuffer,userBufferSize));
 
       // allocate space for net buffer and position the write pointer past the end
 
       _internalBufferSize=headerSpace+dataSpace;
-      _internalBuffer=malloc(_internalBufferSize);
+
+      if((_internalBuffer=NetBufferPool::allocateBuffer(_internalBufferSize))==nullptr)
+        _valid=false;
+
       _writePointer=reinterpret_cast<void *>(reinterpret_cast<uint8_t *>(_internalBuffer)+_internalBufferSize);
     }
 
 
+    /**
+     * Check that the constructor got all the memory that it needed. A buffer that is not valid
+     * must be deleted and not transmitted because it would go out without its data.
+     * @return true if the buffer is usable
+     */
+
+    inline bool NetBuffer::isValid() const {
+      return _valid;
+    }
+
+
     /**
      * Destructor, clean up
      */
 
     inline NetBuffer::~NetBuffer() {
+
+      NetBufferSegment *seg,*next;
+
       if(_internalBuffer)
-        free(_internalBuffer);
+        NetBufferPool::releaseBuffer(_internalBuffer);
+
+      for(seg=_firstSegment;seg;seg=next) {
+        next=seg->getNext();
+        seg->release();
+      }
+    }
+
+
+    /**
+     * NetBuffer objects are allocated from the pool
+     * @param size The object size
+     * @return The memory for the object, or nullptr if there is none
+     */
+
+    inline void *NetBuffer::operator new(size_t size) noexcept {
+      return NetBufferPool::allocateNetBuffer(size);
+    }
+
+
+    /**
+     * Give the memory for a NetBuffer object back to the pool
+     * @param ptr The memory
+     */
+
+    inline void NetBuffer::operator delete(void *ptr) {
+      if(ptr)
+        NetBufferPool::releaseNetBuffer(ptr);
     }
 
 
     /**
-     * Get the size of the user buffer
-     * @return The user buffer size
+     * Get the size of the user data that follows the internal buffer. This is the
+     * total size of all the segments in the chain.
+     * @return The user data size
      */
 
     inline uint32_t NetBuffer::getUserBufferSize() const {
-      return _userBufferSize;
+      return _segmentsSize;
     }
 
 
     /**
-     * Return the user buffer pointer
+     * Return the data pointer of the first segment in the chain. This is the user buffer
+     * passed to the constructor, if there was one.
      */
 
     inline const void *NetBuffer::getUserBuffer() const {
-      return _userBuffer;
+      return _firstSegment ? _firstSegment->getData() : nullptr;
+    }
+
+
+    /**
+     * Append a segment to the end of the chain. Ownership of the caller's reference to the
+     * segment is transferred to this buffer and it will be released when this buffer is
+     * destroyed. A nullptr segment (i.e. a failed allocation) is rejected.
+     * @param segment The segment to append.
+     * @return false if segment was nullptr
+     */
+
+    inline bool NetBuffer::appendSegment(NetBufferSegment *segment) {
+
+      if(segment==nullptr)
+        return false;
+
+      segment->setNext(nullptr);
+
+      if(_lastSegment)
+        _lastSegment->setNext(segment);
+      else
+        _firstSegment=segment;
+
+      _lastSegment=segment;
+      _segmentCount++;
+      _segmentsSize+=segment->getSize();
+
+      return true;
+    }
+
+
+    /**
+     * Get the first segment in the chain. Follow the chain with NetBufferSegment::getNext().
+     * @return The first segment, or nullptr if there are none
+     */
+
+    inline NetBufferSegment *NetBuffer::getFirstSegment() const {
+      return _firstSegment;
+    }
+
+
+    /**
+     * Get the number of segments in the chain
+     * @return The segment count
+     */
+
+    inline uint16_t NetBuffer::getSegmentCount() const {
+      return _segmentCount;
     }
 
 
@@ -138,8 +261,8 @@ namespace stm32plus {
      */
 
     inline uint32_t NetBuffer::getSizeFromWritePointerToEnd() const {
-      return (reinterpret_cast<uint32_t>(_internalBuffer)+_internalBufferSize)-
-             reinterpret_cast<uint32_t>(_writePointer);
+      return (static_cast<uint8_t *>(_internalBuffer)+_internalBufferSize)-
+             static_cast<uint8_t *>(_writePointer);
     }
 
 
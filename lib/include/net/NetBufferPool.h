@@ -0,0 +1,154 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Fixed-size block allocator for the transmit path. NetBuffer objects, their internal
+     * header buffers and the storage for owned NetBufferSegments are allocated from slabs
+     * that are carved out of the heap once at initialisation. This avoids fragmenting the
+     * heap with the constant churn of short lived transmit buffers and gives allocation
+     * a constant, predictable cost.
+     *
+     * There are three slabs: one sized for NetBuffer objects, one for small control packets
+     * such as TCP ACKs and one for full MTU sized frames. A request is served from the
+     * smallest slab that fits. If that slab is exhausted then the next larger one is tried
+     * and if there is nothing left the request falls back to the heap. Exhaustion and
+     * high-water-mark statistics are kept so that the slab sizes can be tuned.
+     *
+     * The pool is a base of NetworkUtilityObjects and is initialised by the physical layer.
+     * NetBuffer reaches it through the static instance pointer because buffers are created
+     * and destroyed from many places, including the MAC transmit IRQ.
+     */
+
+    class NetBufferPool {
+
+      public:
+
+        /**
+         * Parameters class
+         */
+
+        struct Parameters {
+          uint16_t pool_netBufferCount;       ///< number of NetBuffer objects in the pool. Default is 12.
+          uint16_t pool_smallBufferSize;      ///< size of the small buffers. Default is 128.
+          uint16_t pool_smallBufferCount;     ///< number of small buffers. Default is 8.
+          uint16_t pool_largeBufferSize;      ///< size of the large buffers. Default is 1536.
+          uint16_t pool_largeBufferCount;     ///< number of large buffers. Default is 2.
+
+          Parameters() {
+            pool_netBufferCount=12;
+            pool_smallBufferSize=128;
+            pool_smallBufferCount=8;
+            pool_largeBufferSize=1536;
+            pool_largeBufferCount=2;
+          }
+        };
+
+
+        /**
+         * Statistics for one of the slabs
+         */
+
+        struct Statistics {
+          uint16_t blockSize;                 ///< size of each block
+          uint16_t blockCount;                ///< number of blocks in the slab
+          uint16_t inUse;                     ///< number of blocks currently allocated
+          uint16_t highWaterMark;             ///< the most blocks that have ever been allocated at once
+          uint32_t allocations;               ///< total successful allocations
+          uint32_t exhausted;                 ///< number of times a request found this slab empty
+        };
+
+      protected:
+
+        /*
+         * A slab of equal sized blocks with a free list threaded through the blocks
+         */
+
+        struct Slab {
+          uint8_t *memory;
+          void *freeList;
+          Statistics stats;
+
+          bool initialise(uint16_t blockSize,uint16_t blockCount);
+          void *allocate();
+          bool release(void *ptr);
+        };
+
+        Slab _netBuffers;
+        Slab _small;
+        Slab _large;
+        uint32_t _heapFallbacks;
+
+        static NetBufferPool *_instance;
+
+      protected:
+        void *allocateFromSlabs(uint32_t size);
+        void releaseToSlabs(void *ptr);
+
+      public:
+        NetBufferPool();
+        ~NetBufferPool();
+
+        bool initialise(const Parameters& params);
+
+        const Statistics& getNetBufferStatistics() const;
+        const Statistics& getSmallBufferStatistics() const;
+        const Statistics& getLargeBufferStatistics() const;
+        uint32_t getHeapFallbacks() const;
+
+        static void *allocateNetBuffer(size_t size);
+        static void releaseNetBuffer(void *ptr);
+        static void *allocateBuffer(uint32_t size);
+        static void releaseBuffer(void *ptr);
+    };
+
+
+    /**
+     * Get the statistics for the NetBuffer object slab
+     * @return The statistics
+     */
+
+    inline const NetBufferPool::Statistics& NetBufferPool::getNetBufferStatistics() const {
+      return _netBuffers.stats;
+    }
+
+
+    /**
+     * Get the statistics for the small buffer slab
+     * @return The statistics
+     */
+
+    inline const NetBufferPool::Statistics& NetBufferPool::getSmallBufferStatistics() const {
+      return _small.stats;
+    }
+
+
+    /**
+     * Get the statistics for the large buffer slab
+     * @return The statistics
+     */
+
+    inline const NetBufferPool::Statistics& NetBufferPool::getLargeBufferStatistics() const {
+      return _large.stats;
+    }
+
+
+    /**
+     * Get the number of requests that could not be served by any slab and went to the heap
+     * @return The heap fallback count
+     */
+
+    inline uint32_t NetBufferPool::getHeapFallbacks() const {
+      return _heapFallbacks;
+    }
+  }
+}
@@ -0,0 +1,171 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * A reference counted segment of transmit data. Segments are chained together on to
+     * a NetBuffer after its header area so that a frame can be gathered from several
+     * places in memory by the MAC DMA without first being copied into one buffer.
+     *
+     * There are three kinds of segment:
+     *
+     *  - owned: the segment allocated its own storage which is free'd when the last
+     *    reference to it is released.
+     *  - external: the segment points at memory owned by someone else who must keep
+     *    it in scope until the frame has gone.
+     *  - slice: the segment points into part of another segment and holds a reference
+     *    to it. This is how IP fragmentation divides up a payload without copying it.
+     *
+     * Segment descriptors are small and are recycled through a free list so that the
+     * steady state does not hit the heap. A segment can be linked into only one chain at
+     * a time. To share its data with another chain, take a slice of it.
+     */
+
+    class NetBufferSegment {
+
+      protected:
+        const uint8_t *_data;
+        uint16_t _size;
+        uint16_t _referenceCount;
+        uint8_t *_storage;                  // owned memory, or nullptr
+        NetBufferSegment *_parent;          // the segment this is a slice of, or nullptr
+        NetBufferSegment *_next;            // next in the chain, or in the free list
+
+        static NetBufferSegment *_freeList;
+        static uint32_t _poolSize;
+        static uint32_t _poolFree;
+
+        enum {
+          POOL_GROWTH = 8                   // descriptors allocated together when the free list is empty
+        };
+
+      protected:
+        static NetBufferSegment *allocate();
+        void recycle();
+
+      public:
+        NetBufferSegment();
+
+        static NetBufferSegment *create(uint16_t size);
+        static NetBufferSegment *createExternal(const void *data,uint16_t size);
+        static NetBufferSegment *createSlice(NetBufferSegment& parent,uint16_t offset,uint16_t size);
+
+        void addReference();
+        void release();
+
+        const uint8_t *getData() const;
+        uint8_t *getWritableData() const;
+        uint16_t getSize() const;
+        uint16_t getReferenceCount() const;
+
+        NetBufferSegment *getNext() const;
+        void setNext(NetBufferSegment *next);
+
+        static uint32_t getPoolSize();
+        static uint32_t getPoolFree();
+    };
+
+
+    /**
+     * Constructor. Descriptors are only constructed in blocks by the pool.
+     */
+
+    inline NetBufferSegment::NetBufferSegment()
+      : _data(nullptr),
+        _size(0),
+        _referenceCount(0),
+        _storage(nullptr),
+        _parent(nullptr),
+        _next(nullptr) {
+    }
+
+
+    /**
+     * Get the data pointer
+     * @return The first byte of this segment
+     */
+
+    inline const uint8_t *NetBufferSegment::getData() const {
+      return _data;
+    }
+
+
+    /**
+     * Get the data pointer for writing. Only valid for an owned segment.
+     * @return The first byte of this segment, or nullptr if this segment does not own its data
+     */
+
+    inline uint8_t *NetBufferSegment::getWritableData() const {
+      return _storage;
+    }
+
+
+    /**
+     * Get the number of bytes in this segment
+     * @return The segment size
+     */
+
+    inline uint16_t NetBufferSegment::getSize() const {
+      return _size;
+    }
+
+
+    /**
+     * Get the current reference count
+     * @return The reference count
+     */
+
+    inline uint16_t NetBufferSegment::getReferenceCount() const {
+      return _referenceCount;
+    }
+
+
+    /**
+     * Get the next segment in the chain
+     * @return The next segment, or nullptr if this is the last
+     */
+
+    inline NetBufferSegment *NetBufferSegment::getNext() const {
+      return _next;
+    }
+
+
+    /**
+     * Set the next segment in the chain
+     * @param next The next segment
+     */
+
+    inline void NetBufferSegment::setNext(NetBufferSegment *next) {
+      _next=next;
+    }
+
+
+    /**
+     * Get the number of descriptors that the pool has allocated from the heap
+     * @return The pool size
+     */
+
+    inline uint32_t NetBufferSegment::getPoolSize() {
+      return _poolSize;
+    }
+
+
+    /**
+     * Get the number of descriptors currently sitting in the free list
+     * @return The free descriptor count
+     */
+
+    inline uint32_t NetBufferSegment::getPoolFree() {
+      return _poolFree;
+    }
+  }
+}
@@ -52,7 +52,7 @@ namespace stm32plus {
           TCP_CONNECTION_CLOSED,        ///< TCP remote end has closed
           TCP_CONNECTION_DATA_READY,    ///< we have buffered some data from the remote end
           TCP_CONNECTION_STATE_CHANGED, ///< the state of a TCP connection has changed
-          DEBUG_MESSAGE                 ///< message for debugging
+          DEBUG_MESSAGE                 ///< message for debugging. Must be last, NetEventSource sizes its tables from it.
         };
 
         NetEventType eventType;
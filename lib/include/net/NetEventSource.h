@@ -0,0 +1,203 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Event source for the network event bus. Subscribers can register for one NetEventType
+     * and raising an event goes straight to the subscribers for its type through a table
+     * indexed by the type, so the stack's many layers are no longer all called for every
+     * frame and notification just to check the type and return.
+     *
+     * Subscribers added without a type are kept in the wink::signal base class as before and
+     * are called for every event after the typed subscribers, so application code that
+     * switches on the event type itself still works.
+     *
+     * The number of events raised of each type is counted for diagnostics.
+     *
+     * @tparam TSlot The wink slot type
+     */
+
+    template<class TSlot>
+    class NetEventSource : public wink::signal<TSlot> {
+
+      public:
+        enum {
+          EVENT_TYPE_COUNT = static_cast<int>(NetEventDescriptor::NetEventType::DEBUG_MESSAGE)+1
+        };
+
+      protected:
+
+        struct Subscriber {
+          TSlot slot;
+          Subscriber *next;
+        };
+
+        Subscriber *_subscribers[EVENT_TYPE_COUNT];
+        mutable uint32_t _dispatchCounts[EVENT_TYPE_COUNT];
+
+      public:
+        NetEventSource();
+        ~NetEventSource();
+
+        using wink::signal<TSlot>::insertSubscriber;
+        using wink::signal<TSlot>::removeSubscriber;
+
+        void insertSubscriber(NetEventDescriptor::NetEventType eventType,const TSlot& slot);
+        bool removeSubscriber(NetEventDescriptor::NetEventType eventType,const TSlot& slot);
+
+        template<class TEvent>
+        void raiseEvent(TEvent&& ned) const;
+
+        uint32_t getDispatchCount(NetEventDescriptor::NetEventType eventType) const;
+        void resetDispatchCounts();
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    template<class TSlot>
+    inline NetEventSource<TSlot>::NetEventSource() {
+
+      uint16_t i;
+
+      for(i=0;i<EVENT_TYPE_COUNT;i++)
+        _subscribers[i]=nullptr;
+
+      resetDispatchCounts();
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    template<class TSlot>
+    inline NetEventSource<TSlot>::~NetEventSource() {
+
+      Subscriber *s,*next;
+      uint16_t i;
+
+      for(i=0;i<EVENT_TYPE_COUNT;i++) {
+        for(s=_subscribers[i];s;s=next) {
+          next=s->next;
+          delete s;
+        }
+      }
+    }
+
+
+    /**
+     * Subscribe to events of one type. Subscribe more than once to receive more than one type.
+     * Like the untyped subscribers, the most recent subscriber is called first.
+     * @param eventType The type of event to receive
+     * @param slot The subscriber
+     */
+
+    template<class TSlot>
+    inline void NetEventSource<TSlot>::insertSubscriber(NetEventDescriptor::NetEventType eventType,const TSlot& slot) {
+
+      Subscriber *s;
+
+      s=new Subscriber;
+      s->slot=slot;
+
+      {
+        IrqSuspend suspender;
+
+        s->next=_subscribers[static_cast<int>(eventType)];
+        _subscribers[static_cast<int>(eventType)]=s;
+      }
+    }
+
+
+    /**
+     * Unsubscribe from events of one type
+     * @param eventType The type that was subscribed to
+     * @param slot The subscriber
+     * @return true if it was found
+     */
+
+    template<class TSlot>
+    inline bool NetEventSource<TSlot>::removeSubscriber(NetEventDescriptor::NetEventType eventType,const TSlot& slot) {
+
+      Subscriber **link,*s;
+
+      {
+        IrqSuspend suspender;
+
+        for(link=&_subscribers[static_cast<int>(eventType)];*link;link=&(*link)->next)
+          if((*link)->slot==slot)
+            break;
+
+        if((s=*link)==nullptr)
+          return false;
+
+        *link=s->next;
+      }
+
+      delete s;
+      return true;
+    }
+
+
+    /**
+     * Raise an event to the subscribers for its type and then to the untyped subscribers.
+     * A subscriber may unsubscribe itself while it's being called.
+     * @param ned The event
+     */
+
+    template<class TSlot>
+    template<class TEvent>
+    inline void NetEventSource<TSlot>::raiseEvent(TEvent&& ned) const {
+
+      const Subscriber *s,*next;
+      NetEventDescriptor& descriptor(ned);
+
+      _dispatchCounts[static_cast<int>(descriptor.eventType)]++;
+
+      for(s=_subscribers[static_cast<int>(descriptor.eventType)];s;s=next) {
+        next=s->next;
+        s->slot(descriptor);
+      }
+
+      if(!this->_slots.empty())
+        wink::signal<TSlot>::raiseEvent(descriptor);
+    }
+
+
+    /**
+     * Get the number of events of a type that have been raised
+     * @param eventType The event type
+     * @return The count since construction or the last reset
+     */
+
+    template<class TSlot>
+    inline uint32_t NetEventSource<TSlot>::getDispatchCount(NetEventDescriptor::NetEventType eventType) const {
+      return _dispatchCounts[static_cast<int>(eventType)];
+    }
+
+
+    /**
+     * Reset the dispatch counters to zero
+     */
+
+    template<class TSlot>
+    inline void NetEventSource<TSlot>::resetDispatchCounts() {
+
+      uint16_t i;
+
+      for(i=0;i<EVENT_TYPE_COUNT;i++)
+        _dispatchCounts[i]=0;
+    }
+  }
+}
@@ -13,13 +13,20 @@ namespace stm32plus {
     /**
      * Declare the signatures for the transmit, receive, error and notification events. Splitting the
      * events out into separate slots makes it more efficient at dispatch time as there will be fewer
-     * false calls.
+     * false calls. The receive, send and notification sources carry many event types and are
+     * NetEventSource instances so that subscribers can ask for just the types they handle.
      */
 
-    DECLARE_EVENT_SIGNATURE(NetworkReceive,void (NetEventDescriptor&));
-    DECLARE_EVENT_SIGNATURE(NetworkSend,void (NetEventDescriptor&));
+    typedef wink::slot<void (NetEventDescriptor&)> NetworkReceiveEventSourceSlot;
+    typedef NetEventSource<NetworkReceiveEventSourceSlot> NetworkReceiveEventSourceType;
+
+    typedef wink::slot<void (NetEventDescriptor&)> NetworkSendEventSourceSlot;
+    typedef NetEventSource<NetworkSendEventSourceSlot> NetworkSendEventSourceType;
+
+    typedef wink::slot<void (NetEventDescriptor&)> NetworkNotificationEventSourceSlot;
+    typedef NetEventSource<NetworkNotificationEventSourceSlot> NetworkNotificationEventSourceType;
+
     DECLARE_EVENT_SIGNATURE(NetworkError,void (NetEventDescriptor&));
-    DECLARE_EVENT_SIGNATURE(NetworkNotification,void (NetEventDescriptor&));
 
     /**
      * Network events base classes. Just declares the event slot that
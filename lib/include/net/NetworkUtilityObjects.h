@@ -22,6 +22,7 @@ namespace stm32plus {
                                    virtual NetworkErrorEvents,
                                    virtual NetworkNotificationEvents,
                                    virtual NetworkIntervalTicker,
+                                   virtual NetBufferPool,
                                    virtual DefaultRng {
     };
   }
@@ -169,7 +169,7 @@ namespace stm32plus {
 
       // subscribe to notifications and receive events
 
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&DhcpClient<TTransportLayer>::onNotification));
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::MAC_ADDRESS_ANNOUNCEMENT,NetworkNotificationEventSourceSlot::bind(this,&DhcpClient<TTransportLayer>::onNotification));
       this->UdpReceiveEventSender.insertSubscriber(UdpReceiveEventSourceSlot::bind(this,&DhcpClient<TTransportLayer>::onReceive));
 
       // start the ticker off as disabled
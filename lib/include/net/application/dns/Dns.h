@@ -24,12 +24,16 @@ namespace stm32plus {
         struct Parameters {
 
           uint32_t dns_timeout;               ///< 10000ms is the default. don't go less than 5000 according to RFC 1123
-          uint32_t dns_cacheSize;             ///< DNS cache size (default is 20)
+          uint32_t dns_cacheSize;             ///< DNS cache size (default is 20, maximum is 254)
+          uint16_t dns_cacheMaxHostnameLength; ///< longest hostname that can be cached (default is 47)
+          uint32_t dns_negativeCacheSeconds;  ///< seconds to remember that a name does not exist (default is 60)
           uint8_t dns_retries;                ///< number of times to retry all servers (default is 5)
 
           Parameters() {
             dns_timeout=10000;
             dns_cacheSize=20;
+            dns_cacheMaxHostnameLength=47;
+            dns_negativeCacheSeconds=60;
             dns_retries=5;
           }
         };
@@ -48,7 +52,8 @@ namespace stm32plus {
           E_SERVER_ERROR,                     ///< the server returned an error (cause is set)
           E_NO_ANSWERS,                       ///< the server did not return an answer
           E_NO_A_RECORD_IN_ANSWERS,           ///< server did not return an A record in the answers
-          E_OUT_OF_MEMORY                     ///< memory allocation failure
+          E_OUT_OF_MEMORY,                    ///< memory allocation failure
+          E_MALFORMED_REPLY                   ///< the reply has records that run past its end
         };
 
       protected:
@@ -60,12 +65,14 @@ namespace stm32plus {
 
         volatile bool _awaitingReply;
         DnsReplyPacket volatile *_replyPacket;
+        uint16_t _replyPacketSize;
 
       protected:
         void onNotification(NetEventDescriptor& ned);
         void onReceive(UdpDatagramEvent& ned);
-        bool queryServer(const IpAddress& dnsServer,const DnsQueryPacket& packet,uint16_t querySize,IpAddress& ipAddress,uint32_t& ttl);
-        bool processQueryResponse(IpAddress& ipAddress,uint32_t& ttl);
+        bool queryServer(const IpAddress& dnsServer,const char *hostname,const DnsQueryPacket& packet,uint16_t querySize,IpAddress& ipAddress);
+        bool processQueryResponse(const char *hostname,IpAddress& ipAddress);
+        void cacheAliases(DnsReplyPacket *packet,uint8_t *answers,const IpAddress& ipAddress);
         void freeReplyPacket();
 
       public:
@@ -76,6 +83,7 @@ namespace stm32plus {
         bool startup();
 
         bool dnsHostnameQuery(const char *hostname,IpAddress& ipAddress);
+        const DnsCacheStatistics& dnsGetCacheStatistics() const;
     };
 
 
@@ -88,8 +96,9 @@ namespace stm32plus {
 
       uint32_t randomNumber;
 
-      _dnsServers[0]=nullptr;
+      _dnsServers[0].invalidate();
       _replyPacket=nullptr;
+      _replyPacketSize=0;
       _awaitingReply=false;
 
       this->nextRandom(randomNumber);
@@ -122,12 +131,12 @@ namespace stm32plus {
 
       // create the cache
 
-      if(!_cache.initialise(_params.dns_cacheSize,this->_rtc))
+      if(!_cache.initialise(_params.dns_cacheSize,_params.dns_cacheMaxHostnameLength,this->_rtc))
         return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_OUT_OF_MEMORY);
 
       // subscribe to notifications and receive events
 
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Dns<TTransportLayer>::onNotification));
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::DNS_SERVERS_ANNOUNCEMENT,NetworkNotificationEventSourceSlot::bind(this,&Dns<TTransportLayer>::onNotification));
       this->UdpReceiveEventSender.insertSubscriber(UdpReceiveEventSourceSlot::bind(this,&Dns<TTransportLayer>::onReceive));
       return true;
     }
@@ -161,11 +170,10 @@ namespace stm32plus {
 
       IpDnsServersAnnouncementEvent& dnsevent(static_cast<IpDnsServersAnnouncementEvent&>(ned));
 
-      // copy out the valid servers from the event
+      // copy out the valid servers from the event, they're at the front of the array
 
-      for(i=0;i<3;i++)
-        if(dnsevent.ipDnsServers[i]!=nullptr && dnsevent.ipDnsServers[i].isValid())
-          _dnsServers[i]=*dnsevent.ipDnsServers;
+      for(i=0;i<3 && dnsevent.ipDnsServers[i].isValid();i++)
+        _dnsServers[i]=dnsevent.ipDnsServers[i];
 
       // invalidate the others
 
@@ -185,7 +193,6 @@ namespace stm32plus {
     inline bool Dns<TTransportLayer>::dnsHostnameQuery(const char *hostname,IpAddress& ipAddress) {
 
       uint16_t querySize;
-      uint32_t ttl;
       uint8_t i,retry;
 
       // special case for localhost
@@ -195,14 +202,24 @@ namespace stm32plus {
         return true;
       }
 
-      // is the association cached?
+      // is the association cached? a name that's known not to exist fails in the same way
+      // that it did when the server told us
 
-      if(_cache.lookup(hostname,ipAddress))
-        return true;
+      switch(_cache.find(hostname,ipAddress)) {
+
+        case DnsCache::FOUND:
+          return true;
+
+        case DnsCache::NEGATIVE:
+          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_SERVER_ERROR,DnsPacketHeader::RCODE_NAME_ERROR);
+
+        default:
+          break;
+      }
 
       // must have at least one server
 
-      if(_dnsServers[0]==nullptr)
+      if(!_dnsServers[0].isValid())
         return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_UNCONFIGURED);
 
       // the size of the query is the hostname+2+header+4
@@ -232,10 +249,8 @@ namespace stm32plus {
         // run through the list of servers
 
         for(i=0;i<3 && _dnsServers[i].isValid();i++) {
-          if(queryServer(_dnsServers[i],packet,querySize,ipAddress,ttl)) {
-            _cache.add(hostname,ipAddress,ttl);
+          if(queryServer(_dnsServers[i],hostname,packet,querySize,ipAddress))
             return true;
-          }
         }
       }
 
@@ -247,19 +262,19 @@ namespace stm32plus {
 
     /**
      * Query the server and wait for a response
+     * @param hostname The host being looked up
      * @param packet The packet to send
      * @param querySize The size of the packet
      * @param[out] ipAddress The returned IP address mapping
-     * @param[out] ttl The time-to-live of the entry in seconds
      * @return true if it worked
      */
 
     template<class TTransportLayer>
     inline bool Dns<TTransportLayer>::queryServer(const IpAddress& dnsServer,
+                                                   const char *hostname,
                                                    const DnsQueryPacket& packet,
                                                    uint16_t querySize,
-                                                   IpAddress& ipAddress,
-                                                   uint32_t& ttl) {
+                                                   IpAddress& ipAddress) {
 
       uint32_t now;
       bool retval;
@@ -294,7 +309,7 @@ namespace stm32plus {
         }
       }
 
-      retval=processQueryResponse(ipAddress,ttl);
+      retval=processQueryResponse(hostname,ipAddress);
 
       freeReplyPacket();
       this->ip_releaseEphemeralPort(_replyPort);
@@ -303,22 +318,29 @@ namespace stm32plus {
 
 
     /**
-     * Process the response from the server
+     * Process the response from the server. The answer is added to the cache, including
+     * any CNAME records that lead to it. An NXDOMAIN reply is cached as a negative entry.
+     * @param hostname The host being looked up
      * @param[out] ipAddress The response IP address
-     * @param[out] ttl The time-to-live of the entry in seconds
      * @return true if it worked
      */
 
     template<class TTransportLayer>
-    inline bool Dns<TTransportLayer>::processQueryResponse(IpAddress& ipAddress,uint32_t& ttl) {
+    inline bool Dns<TTransportLayer>::processQueryResponse(const char *hostname,IpAddress& ipAddress) {
 
       uint16_t flags=NetUtil::ntohs(_replyPacket->dns_flags);
       uint8_t *answers,*record;
+      uint32_t ttl;
 
       // the flags must not have an error (unknown host is picked up here as cause=3)
 
-      if((flags & 0xf)!=0)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_SERVER_ERROR,flags & 0xf);
+      if((flags & DnsPacketHeader::RCODE_MASK)!=0) {
+
+        if((flags & DnsPacketHeader::RCODE_MASK)==DnsPacketHeader::RCODE_NAME_ERROR)
+          _cache.addNegative(hostname,_params.dns_negativeCacheSeconds);
+
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_SERVER_ERROR,flags & DnsPacketHeader::RCODE_MASK);
+      }
 
       // the flags must not indicate truncation
 
@@ -333,26 +355,103 @@ namespace stm32plus {
       // find the answers
 
       DnsReplyPacket *packet(const_cast<DnsReplyPacket *>(_replyPacket));
-      answers=packet->findAnswers();
+      if((answers=packet->findAnswers(_replyPacketSize))==nullptr)
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_MALFORMED_REPLY);
 
-      // find the first A record
+      // find the first A record. it's known to be complete if it's found
 
-      if((record=packet->findRecord(answers,DnsPacketHeader::RecordType::A))==nullptr)
+      if((record=packet->findRecord(answers,DnsPacketHeader::RecordType::A,_replyPacketSize))==nullptr)
         return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_NO_A_RECORD_IN_ANSWERS);
 
       // step over the name (should possibly verify that it's the answer to our question here)
 
-      record=packet->stepOverName(record);
+      record=packet->stepOverName(record,_replyPacketSize);
+
+      if(DnsReplyPacket::getRecordDataLength(record)!=4)
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_DNS,E_MALFORMED_REPLY);
 
       // pull out the IP address and ttl from the record
 
       ipAddress.ipAddress=*reinterpret_cast<uint32_t *>(record+10);
       ttl=NetUtil::ntohl(*reinterpret_cast<uint32_t *>(record+4));
 
+      // cache the answer against the name that we asked for unless it came through aliases
+
+      if(packet->findRecord(answers,DnsPacketHeader::RecordType::CNAME,_replyPacketSize)==nullptr)
+        _cache.add(hostname,ipAddress,ttl);
+      else
+        cacheAliases(packet,answers,ipAddress);
+
       return true;
     }
 
 
+    /**
+     * Cache the CNAME chain from a reply and the A record that it ends at. Each record keeps
+     * its own TTL. The records are added in the order that they appear, the cache links them
+     * up as it goes. Processing stops at the first record that runs past the end of the packet.
+     * @param packet The reply packet
+     * @param answers The start of the answer records
+     * @param ipAddress The address from the first A record
+     */
+
+    template<class TTransportLayer>
+    inline void Dns<TTransportLayer>::cacheAliases(DnsReplyPacket *packet,uint8_t *answers,const IpAddress& ipAddress) {
+
+      uint8_t *record,*dataptr,*next;
+      uint16_t i;
+      uint32_t ttl;
+      DnsPacketHeader::RecordType type;
+
+      scoped_array<char> names(new char[(_params.dns_cacheMaxHostnameLength+1)*2]);
+      if(names.get()==nullptr)
+        return;
+
+      char *owner=names.get();
+      char *target=owner+_params.dns_cacheMaxHostnameLength+1;
+
+      record=answers;
+
+      for(i=NetUtil::ntohs(packet->dns_numberOfAnswerRrs);i!=0;i--,record=next) {
+
+        // the whole record including its data must be inside the packet
+
+        if((next=packet->stepOverRecord(record,_replyPacketSize))==nullptr)
+          return;
+
+        // names that are too long for the cache are ignored
+
+        if(!packet->decodeName(record,owner,_params.dns_cacheMaxHostnameLength+1,_replyPacketSize))
+          continue;
+
+        dataptr=packet->stepOverName(record,_replyPacketSize);
+
+        type=static_cast<DnsPacketHeader::RecordType>(NetUtil::ntohs(*reinterpret_cast<uint16_t *>(dataptr)));
+        ttl=NetUtil::ntohl(*reinterpret_cast<uint32_t *>(dataptr+4));
+
+        if(type==DnsPacketHeader::RecordType::CNAME) {
+          if(packet->decodeName(dataptr+10,target,_params.dns_cacheMaxHostnameLength+1,_replyPacketSize))
+            _cache.addAlias(owner,target,ttl);
+        }
+        else if(type==DnsPacketHeader::RecordType::A &&
+                DnsReplyPacket::getRecordDataLength(dataptr)==4 &&
+                *reinterpret_cast<uint32_t *>(dataptr+10)==ipAddress.ipAddress)
+          _cache.add(owner,ipAddress,ttl);
+      }
+    }
+
+
+    /**
+     * Get the statistics for the DNS cache
+     * @return The cache statistics
+     */
+
+    template<class TTransportLayer>
+    inline const DnsCacheStatistics& Dns<TTransportLayer>::dnsGetCacheStatistics() const {
+      return _cache.getStatistics();
+    }
+
+
     /**
      * Receive event notification from the stack
      * @param upe The UDP packet event descriptor
@@ -361,6 +460,8 @@ namespace stm32plus {
     template<class TTransportLayer>
     __attribute__((noinline)) inline void Dns<TTransportLayer>::onReceive(UdpDatagramEvent& upe) {
 
+      uint16_t payloadSize;
+
       // must be for our reply port
 
       if(NetUtil::ntohs(upe.udpDatagram.udp_destinationPort)!=_replyPort)
@@ -375,12 +476,18 @@ namespace stm32plus {
       if(!_awaitingReply || _replyPacket!=nullptr)
         return;
 
-      // must be a valid packet on the DNS port
+      // must be a valid packet on the DNS port. the UDP length includes the UDP header and
+      // must not claim more than the IP packet actually carries
+
+      payloadSize=NetUtil::ntohs(upe.udpDatagram.udp_length);
 
       if(NetUtil::ntohs(upe.udpDatagram.udp_sourcePort)!=IpPorts::PORT_DNS_REQUEST ||
-         NetUtil::ntohs(upe.udpDatagram.udp_length)<DnsPacketHeader::getPacketHeaderSize())
+         payloadSize>upe.ipPacket.payloadLength ||
+         payloadSize<UdpDatagram::getHeaderSize()+DnsPacketHeader::getPacketHeaderSize())
         return;
 
+      payloadSize-=UdpDatagram::getHeaderSize();
+
       DnsQueryPacket *reply(reinterpret_cast<DnsQueryPacket *>(upe.udpDatagram.udp_data));
 
       // must be our DNS packet. there is no fixed magic number to indicate that this packet is
@@ -391,8 +498,11 @@ namespace stm32plus {
 
       // it's for us
 
-      _replyPacket=(DnsReplyPacket *)malloc(upe.udpDatagram.udp_length);
-      memcpy(const_cast<DnsReplyPacket *>(_replyPacket),upe.udpDatagram.udp_data,upe.udpDatagram.udp_length);
+      if((_replyPacket=(DnsReplyPacket *)malloc(payloadSize))==nullptr)
+        return;
+
+      memcpy(const_cast<DnsReplyPacket *>(_replyPacket),upe.udpDatagram.udp_data,payloadSize);
+      _replyPacketSize=payloadSize;
 
       // wake up the caller
 
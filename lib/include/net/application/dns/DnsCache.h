@@ -11,43 +11,165 @@
 namespace stm32plus {
   namespace net {
 
+    /**
+     * Statistics maintained by the DNS cache. The hit rate is hits/(hits+misses).
+     */
+
+    struct DnsCacheStatistics {
+      uint32_t hits;                      ///< lookups that found an address
+      uint32_t misses;                    ///< lookups that found nothing usable
+      uint32_t negativeHits;              ///< lookups that found a cached NXDOMAIN
+      uint32_t aliasesFollowed;           ///< CNAME links followed during lookups
+      uint32_t insertions;                ///< new entries created
+      uint32_t evictions;                 ///< LRU entries evicted to make room
+      uint32_t expiries;                  ///< entries found to have expired
+      uint32_t uncacheable;               ///< names too long for a hostname slot
+    };
+
 
     /**
-     * Simple DNS cache of hostname to IP address with TTL. A full pass through the cache is
-     * required for add and lookup so this is not intended for high volumes, not that you'd
-     * have the SRAM for that anyway. A pessimistic average domain name length of 25 characters
-     * with 20 entries would use around (26*20)+(12*20) = 760 bytes of SRAM in the cache.
-     * Whatever, parsing 20 entries per lookup is massively cheaper than a network DNS lookup.
+     * DNS cache of hostname to IP address with TTL. The entries are kept in a compact doubly
+     * linked LRU list with an open addressing hash index keyed by a case-insensitive hash of
+     * the hostname, so lookup, insert and eviction are constant time.
+     *
+     * Hostnames are stored once each in a fixed arena of equal sized slots that's allocated at
+     * initialisation. There is no dynamic memory allocation after that. A name that does not
+     * fit in a slot is simply not cached. With the default of 20 entries and 47 character names
+     * the cache uses about 20*(48+16)+64 = 1344 bytes of SRAM.
+     *
+     * As well as addresses the cache can hold negative entries that record an NXDOMAIN reply
+     * and alias entries that record a CNAME. An alias links to the entry for its canonical name
+     * so a lookup follows the chain to the address. A link carries the generation number of
+     * the entry that it points to so that a link to an entry that has since been evicted and
+     * reused is recognised as broken. Expiry is lazy, as in the ARP cache.
      */
 
     class DnsCache {
 
-      protected:
+      public:
 
         /**
-         * Constant to indicate the cache entry is free
+         * Results from a lookup
          */
 
-        enum {
-          NO_ENTRY = 0xffffffff       //!< The cache entry is free
+        enum LookupResult {
+          FOUND,                          ///< address found, possibly through aliases
+          NOT_FOUND,                      ///< nothing is known
+          NEGATIVE                        ///< the name is known not to exist
         };
 
-        struct Entry {
-          scoped_array<char> _hostname;
-          uint32_t expiryTicks;
-          IpAddress address;
+      protected:
+
+        enum {
+          NO_ENTRY = 0xff,                ///< used as a next/prev/target marker to say 'none'
+          MAX_ALIAS_DEPTH = 8,            ///< maximum CNAME links followed by a lookup
+
+          FLAG_NEGATIVE = 0x1,            ///< the entry records an NXDOMAIN
+          FLAG_ALIAS = 0x2,               ///< the entry records a CNAME
+          FLAG_PENDING = 0x4              ///< canonical name of an alias with no data yet
         };
 
-        scoped_array<Entry> _entries;
-        uint32_t _maxEntries;
-        RtcBase *_rtc;
+        struct CacheEntry {
+          uint8_t next;                   ///< next index in the list (or NO_ENTRY)
+          uint8_t previous;               ///< previous index in the list (or NO_ENTRY)
+          uint8_t flags;                  ///< FLAG_xxx values
+          uint8_t generation;             ///< incremented each time the entry is recycled
+          uint8_t target;                 ///< canonical name entry for an alias
+          uint8_t targetGeneration;       ///< generation of the target when linked
+          uint16_t hash;                  ///< hash of the hostname
+          uint32_t expiryTime;            ///< RTC time after which this entry is invalid
+          IpAddress address;              ///< the address held here
+        } __attribute__((packed));
+
+        uint8_t _first;                   ///< first index in the list (or NO_ENTRY if empty)
+        uint8_t _last;                    ///< last index in the list (or NO_ENTRY if empty)
+        uint8_t _free;                    ///< first index in the free list (or NO_ENTRY if full)
+        uint8_t _maxEntries;              ///< total entries allowed
+        uint16_t _hashMask;               ///< hash table size - 1
+        uint16_t _slotSize;               ///< size of each hostname slot including the \0
+        RtcBase *_rtc;                    ///< Pointer to the RTC
+
+        scoped_array<CacheEntry> _array;  ///< the array of CacheEntry structures
+        scoped_array<uint8_t> _hashTable; ///< open addressing index into _array (or NO_ENTRY)
+        scoped_array<char> _names;        ///< the hostname arena, one slot per entry
+
+        DnsCacheStatistics _statistics;
+
+      protected:
+        uint8_t internalInsert(const char *hostname,uint8_t flags,uint32_t ttl);
+        uint8_t allocateEntry();
+        void removeEntry(uint8_t index);
+        void unlink(uint8_t index);
+        void insertFront(uint8_t index);
+        bool hasExpired(uint8_t index) const;
+        char *getName(uint8_t index) const;
+
+        static uint16_t hash(const char *hostname);
+        uint8_t hashFind(const char *hostname,uint16_t h) const;
+        void hashInsert(uint8_t index);
+        void hashRemove(uint8_t index);
 
       public:
-        bool initialise(uint32_t cacheSize,RtcBase *rtc);
+        bool initialise(uint32_t cacheSize,uint16_t maxHostnameLength,RtcBase *rtc);
+
+        void add(const char *hostname,const IpAddress& address,uint32_t ttl);
+        void addNegative(const char *hostname,uint32_t ttl);
+        void addAlias(const char *alias,const char *canonicalName,uint32_t ttl);
 
-        void add(const char *hostname,const IpAddress& address,uint32_t expiry);
+        LookupResult find(const char *hostname,IpAddress& address);
         bool lookup(const char *hostname,IpAddress& address);
+
+        const DnsCacheStatistics& getStatistics() const;
+        void resetStatistics();
     };
+
+
+    /**
+     * Lookup an address in the cache
+     * @param hostname The host to find
+     * @param[out] address The address, if found
+     * @return true if found
+     */
+
+    inline bool DnsCache::lookup(const char *hostname,IpAddress& address) {
+      return find(hostname,address)==FOUND;
+    }
+
+
+    /**
+     * Get the cache statistics
+     * @return A reference to the statistics
+     */
+
+    inline const DnsCacheStatistics& DnsCache::getStatistics() const {
+      return _statistics;
+    }
+
+
+    /**
+     * Reset the cache statistics to zero
+     */
+
+    inline void DnsCache::resetStatistics() {
+      memset(&_statistics,0,sizeof(_statistics));
+    }
+
+
+    /*
+     * Check if an entry has expired
+     */
+
+    inline bool DnsCache::hasExpired(uint8_t index) const {
+      return _rtc->getTick()>_array[index].expiryTime;
+    }
+
+
+    /*
+     * Get the hostname slot for an entry
+     */
+
+    inline char *DnsCache::getName(uint8_t index) const {
+      return _names.get()+index*_slotSize;
+    }
   }
 }
-
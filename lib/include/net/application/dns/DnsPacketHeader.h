@@ -32,6 +32,21 @@ namespace stm32plus {
       };
 
 
+      /**
+       * Response codes in the bottom 4 bits of the flags
+       */
+
+      enum ResponseCode {
+        RCODE_MASK            = 0xf,
+        RCODE_NO_ERROR        = 0,
+        RCODE_FORMAT_ERROR    = 1,
+        RCODE_SERVER_FAILURE  = 2,
+        RCODE_NAME_ERROR      = 3,      //!< NXDOMAIN, the name does not exist
+        RCODE_NOT_IMPLEMENTED = 4,
+        RCODE_REFUSED         = 5
+      };
+
+
       /**
        * Common types
        */
@@ -19,11 +19,12 @@ namespace stm32plus {
     struct DnsReplyPacket : DnsPacketHeader {
 
       /**
-       * Find the start of the answers in this packet. Assumes a well-formed response.
-       * @return the answers pointer
+       * Find the start of the answers in this packet.
+       * @param packetSize The size of this packet as received
+       * @return the answers pointer, or null if the questions run past the end of the packet
        */
 
-      uint8_t *findAnswers() {
+      uint8_t *findAnswers(uint16_t packetSize) {
 
         uint16_t i;
         uint8_t *ptr;
@@ -34,8 +35,13 @@ namespace stm32plus {
 
         // step over each question
 
-        for(i=NetUtil::ntohs(dns_numberOfQuestions);i!=0;i--)
-          ptr=stepOverName(ptr)+4;          // step over the name + (type, class)
+        for(i=NetUtil::ntohs(dns_numberOfQuestions);i!=0;i--) {
+
+          if((ptr=stepOverName(ptr,packetSize))==nullptr || !contains(ptr,4,packetSize))
+            return nullptr;
+
+          ptr+=4;                         // step over (type, class)
+        }
 
         return ptr;
       }
@@ -46,37 +52,45 @@ namespace stm32plus {
        * name may optionally end in a pointer, or just be a pointer. In any case the occurence of
        * a pointer is the end of the name.
        * @param ptr The start of a name
-       * @return The start of the next name
+       * @param packetSize The size of this packet as received
+       * @return The start of the next name, or null if the name runs past the end of the packet
        */
 
-      uint8_t *stepOverName(uint8_t *ptr) {
+      uint8_t *stepOverName(uint8_t *ptr,uint16_t packetSize) {
+
+        uint32_t pos;
 
-        while(*ptr) {
+        pos=ptr-reinterpret_cast<uint8_t *>(this);
+
+        while(pos<packetSize && ptr[0]) {
 
           // check for a pointer
 
-          if((*ptr & 0xc0)==0xc0)
-            return ptr+2;           // don't care what the pointer is, just that this is the end of the name
+          if((ptr[0] & 0xc0)==0xc0)
+            return pos+2<=packetSize ? ptr+2 : nullptr;     // don't care what the pointer is, just that this is the end of the name
 
-          ptr+=(*ptr)+1;            // normal label with length prefix
+          pos+=ptr[0]+1;                  // normal label with length prefix
+          ptr=reinterpret_cast<uint8_t *>(this)+pos;
         }
 
         // and over the \0 terminator
 
-        return ptr+1;
+        return pos<packetSize ? ptr+1 : nullptr;
       }
 
 
       /**
-       * Find the first occurrence of a record with the given type
+       * Find the first occurrence of a record with the given type. Only records that lie
+       * entirely within the packet are returned.
        * @param answers The start of the answers records
        * @param requestedType The type to search for
+       * @param packetSize The size of this packet as received
        * @return A pointer to the record, or null
        */
 
-      uint8_t *findRecord(uint8_t *answers,RecordType requestedType) {
+      uint8_t *findRecord(uint8_t *answers,RecordType requestedType,uint16_t packetSize) {
 
-        uint8_t *dataptr,*ptr;
+        uint8_t *dataptr,*ptr,*next;
         RecordType thisType;
         uint16_t i;
 
@@ -84,9 +98,10 @@ namespace stm32plus {
 
         for(i=NetUtil::ntohs(dns_numberOfAnswerRrs);i!=0;i--) {
 
-          // get past the encoded name
+          // get past the encoded name and check that the rest of the record is present
 
-          dataptr=stepOverName(ptr);
+          if((dataptr=stepOverName(ptr,packetSize))==nullptr || (next=stepOverRecord(ptr,packetSize))==nullptr)
+            return nullptr;
 
           // is it a record of the correct type?
 
@@ -96,8 +111,7 @@ namespace stm32plus {
 
           // next one
 
-          ptr=dataptr+8;                                                // to the resource data length
-          ptr+=2+NetUtil::ntohs(*reinterpret_cast<uint16_t *>(ptr));    // over the length and data
+          ptr=next;
         }
 
         // not found
@@ -105,6 +119,119 @@ namespace stm32plus {
         return nullptr;
       }
 
+
+      /**
+       * Step over a complete resource record
+       * @param ptr The start of the record
+       * @param packetSize The size of this packet as received
+       * @return The start of the next record, or null if the record runs past the end of the packet
+       */
+
+      uint8_t *stepOverRecord(uint8_t *ptr,uint16_t packetSize) {
+
+        uint16_t dataLength;
+
+        // to the resource data length
+
+        if((ptr=stepOverName(ptr,packetSize))==nullptr || !contains(ptr,10,packetSize))
+          return nullptr;
+
+        ptr+=8;
+        dataLength=NetUtil::ntohs(*reinterpret_cast<uint16_t *>(ptr));
+
+        // over the length and data
+
+        return contains(ptr+2,dataLength,packetSize) ? ptr+2+dataLength : nullptr;
+      }
+
+
+      /**
+       * Get the length of the resource data in a record
+       * @param dataptr The record, just after its name
+       * @return The data length
+       */
+
+      static uint16_t getRecordDataLength(const uint8_t *dataptr) {
+        return NetUtil::ntohs(*reinterpret_cast<const uint16_t *>(dataptr+8));
+      }
+
+
+      /**
+       * Decode the possibly compressed name at ptr into a dotted string. Compression pointers
+       * are offsets from the start of this packet. The number of pointers that will be followed
+       * is limited so that a malicious loop cannot hang the caller, and any label or pointer
+       * target that lies outside the packet fails the decode.
+       * @param ptr The start of the name
+       * @param[out] name Where to write the name
+       * @param nameSize The size of the name buffer including the \0
+       * @param packetSize The size of this packet as received
+       * @return false if the name does not fit, runs past the end of the packet or contains too many pointers
+       */
+
+      bool decodeName(const uint8_t *ptr,char *name,uint16_t nameSize,uint16_t packetSize) {
+
+        const uint8_t *base;
+        uint32_t offset;
+        uint16_t length,pos;
+        uint8_t jumps;
+
+        base=reinterpret_cast<const uint8_t *>(this);
+        offset=ptr-base;
+        pos=0;
+        jumps=0;
+
+        for(;;) {
+
+          if(offset>=packetSize)
+            return false;
+
+          if(base[offset]==0)
+            break;
+
+          if((base[offset] & 0xc0)==0xc0) {
+
+            if(++jumps>16 || offset+1>=packetSize)
+              return false;
+
+            offset=((base[offset] & 0x3f) << 8) | base[offset+1];
+            continue;
+          }
+
+          // the 0x40 and 0x80 label types are reserved
+
+          if((base[offset] & 0xc0)!=0)
+            return false;
+
+          length=base[offset++];
+
+          if(offset+length>packetSize || pos+length+1>=nameSize)
+            return false;
+
+          if(pos)
+            name[pos++]='.';
+
+          memcpy(name+pos,base+offset,length);
+          pos+=length;
+          offset+=length;
+        }
+
+        name[pos]='\0';
+        return true;
+      }
+
+
+      /**
+       * Check that a range of bytes lies within the packet
+       * @param ptr The start of the range
+       * @param size The number of bytes
+       * @param packetSize The size of this packet as received
+       * @return true if the range is inside the packet
+       */
+
+      bool contains(const uint8_t *ptr,uint32_t size,uint16_t packetSize) const {
+        return static_cast<uint32_t>(ptr-reinterpret_cast<const uint8_t *>(this))+size<=packetSize;
+      }
+
     } __attribute__((packed));
   }
 }
@@ -0,0 +1,253 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Wrap an input stream in HTTP/1.1 chunked transfer encoding so that a response of
+     * unknown length can be sent on a persistent connection. Each read from the wrapped
+     * stream becomes one chunk and the terminating zero length chunk is added when the
+     * wrapped stream ends.
+     *
+     * Chunks are framed in the caller's buffer around the data read from the wrapped stream
+     * so there's no extra copy. The size prefix is zero padded to a fixed width for each read,
+     * which HTTP allows. If the caller asks for too little to hold a chunk and its framing
+     * then a small chunk is built here and handed out over as many reads as it takes.
+     */
+
+    class HttpChunkedInputStream : public InputStream {
+
+      protected:
+
+        enum {
+          MIN_DIRECT_SIZE = 16,         ///< smaller reads than this use the pending buffer
+          PENDING_SIZE = 16             ///< one hex digit, CRLF, up to 11 bytes of data, CRLF
+        };
+
+        InputStream *_is;
+        bool _owned;
+        bool _finished;
+        uint8_t _pending[PENDING_SIZE];
+        uint8_t _pendingPos;
+        uint8_t _pendingSize;
+
+      protected:
+        static uint8_t hexDigitCount(uint32_t value);
+        static void writeChunkSize(uint8_t *ptr,uint32_t size,uint8_t digits);
+
+      public:
+        HttpChunkedInputStream(InputStream *is,bool takeOwnership);
+        virtual ~HttpChunkedInputStream();
+
+        // overrides from InputStream
+
+        virtual int16_t read() override;
+        virtual bool read(void *buffer,uint32_t size,uint32_t& actuallyRead) override;
+        virtual bool skip(uint32_t howMuch) override;
+        virtual bool available() override;
+        virtual bool reset() override;
+
+        // overrides from StreamBase
+
+        virtual bool close() override;
+    };
+
+
+    /**
+     * Constructor
+     * @param is The stream to encode
+     * @param takeOwnership true if the stream should be deleted when this one is
+     */
+
+    inline HttpChunkedInputStream::HttpChunkedInputStream(InputStream *is,bool takeOwnership)
+      : _is(is),
+        _owned(takeOwnership),
+        _finished(false),
+        _pendingPos(0),
+        _pendingSize(0) {
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    inline HttpChunkedInputStream::~HttpChunkedInputStream() {
+      if(_owned)
+        delete _is;
+    }
+
+
+    /**
+     * Read a single byte
+     * @return the byte, E_END_OF_STREAM or E_STREAM_ERROR
+     */
+
+    inline int16_t HttpChunkedInputStream::read() {
+
+      uint8_t c;
+      uint32_t actuallyRead;
+
+      if(!read(&c,1,actuallyRead))
+        return E_STREAM_ERROR;
+
+      return actuallyRead ? c : E_END_OF_STREAM;
+    }
+
+
+    /**
+     * Read encoded data
+     * @param buffer Where to read out to
+     * @param size Number requested
+     * @param actuallyRead Number actually read out. Zero means the end of the stream.
+     * @return false if the wrapped stream failed
+     */
+
+    inline bool HttpChunkedInputStream::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
+
+      uint8_t *ptr,digits;
+      uint32_t count;
+
+      actuallyRead=0;
+      ptr=reinterpret_cast<uint8_t *>(buffer);
+
+      while(size) {
+
+        // anything held back from the last read goes first
+
+        if(_pendingPos!=_pendingSize) {
+
+          count=std::min(size,static_cast<uint32_t>(_pendingSize-_pendingPos));
+          memcpy(ptr,_pending+_pendingPos,count);
+          _pendingPos+=count;
+        }
+        else if(_finished)
+          return true;
+        else if(size>=MIN_DIRECT_SIZE) {
+
+          // read the data in place after room for the size prefix
+
+          digits=hexDigitCount(size);
+
+          if(!_is->read(ptr+digits+2,size-digits-4,count))
+            return false;
+
+          if(count==0) {
+            memcpy(_pending,"0\r\n\r\n",_pendingSize=5);
+            _pendingPos=0;
+            _finished=true;
+            continue;
+          }
+
+          writeChunkSize(ptr,count,digits);
+          ptr[digits]=ptr[digits+2+count]='\r';
+          ptr[digits+1]=ptr[digits+3+count]='\n';
+
+          count+=digits+4;
+        }
+        else {
+
+          // build a small chunk that we hand out over this and the following reads
+
+          if(!_is->read(_pending+3,PENDING_SIZE-5,count))
+            return false;
+
+          if(count==0) {
+            memcpy(_pending,"0\r\n\r\n",_pendingSize=5);
+            _finished=true;
+          }
+          else {
+            writeChunkSize(_pending,count,1);
+            _pending[1]=_pending[3+count]='\r';
+            _pending[2]=_pending[4+count]='\n';
+            _pendingSize=count+5;
+          }
+
+          _pendingPos=0;
+          continue;
+        }
+
+        ptr+=count;
+        size-=count;
+        actuallyRead+=count;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Get the number of hex digits in a value
+     */
+
+    inline uint8_t HttpChunkedInputStream::hexDigitCount(uint32_t value) {
+
+      uint8_t digits;
+
+      for(digits=1;value>15;digits++)
+        value>>=4;
+
+      return digits;
+    }
+
+
+    /*
+     * Write a chunk size in hex, zero padded to a width
+     */
+
+    inline void HttpChunkedInputStream::writeChunkSize(uint8_t *ptr,uint32_t size,uint8_t digits) {
+
+      while(digits--) {
+        ptr[digits]="0123456789abcdef"[size & 0xf];
+        size>>=4;
+      }
+    }
+
+
+    /**
+     * Skipping is not supported
+     * @return false
+     */
+
+    inline bool HttpChunkedInputStream::skip(uint32_t /* howMuch */) {
+      return false;
+    }
+
+
+    /**
+     * Check if there's more to read
+     * @return true if the terminating chunk has not been read
+     */
+
+    inline bool HttpChunkedInputStream::available() {
+      return !_finished || _pendingPos!=_pendingSize;
+    }
+
+
+    /**
+     * Reset is not supported
+     * @return false
+     */
+
+    inline bool HttpChunkedInputStream::reset() {
+      return false;
+    }
+
+
+    /**
+     * Close the wrapped stream
+     * @return the result of closing the wrapped stream
+     */
+
+    inline bool HttpChunkedInputStream::close() {
+      return _is->close();
+    }
+  }
+}
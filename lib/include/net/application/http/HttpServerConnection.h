@@ -17,7 +17,19 @@ namespace stm32plus {
      * parsed. This template follows the CRTP pattern of you parameterising it with your
      * implementation.
      *
-     * We support HTTP/1.1 and HTTP/1.0 connections. In HTTP/1.1 mode
+     * We support HTTP/1.1 and HTTP/1.0 connections. In HTTP/1.1 mode the connection persists
+     * after the response so that the client can send more requests without another TCP
+     * handshake. Requests that the client pipelines behind the one being served wait in the
+     * TCP receive buffer until the response is finished. A connection that stays idle between
+     * requests for longer than http_keepAliveTimeout is closed by the TcpConnectionArray.
+     * A response of unknown length can use chunked transfer encoding, see addUnknownLengthHeaders()
+     * and addUnknownLengthStream().
+     *
+     * Files that never change, such as the HTML, JavaScript and CSS of a device's user interface,
+     * can be served by calling sendStaticAsset() from your handleStateChange() when the state
+     * moves to WRITING_RESPONSE. The response is built from headers prepared in advance and the
+     * body is sent straight out of flash without being copied. Precompressed gzip variants,
+     * conditional requests (If-None-Match) and single byte ranges are handled for you.
      */
 
     template<class TImpl>
@@ -25,6 +37,11 @@ namespace stm32plus {
 
       public:
 
+        enum {
+          E_STATIC_HEADER_TOO_LONG = 1,   ///< the asset's headers don't fit in http_staticBufferSize
+          E_OUT_OF_MEMORY                 ///< the static buffer could not be allocated
+        };
+
         /**
          * Parameters for this class
          */
@@ -34,17 +51,49 @@ namespace stm32plus {
           bool http_version11;                      ///< are we operating in HTTP/1.1 mode? default is true.
           uint16_t http_maxRequestLineLength;       ///< size includes the verb, URL and HTTP version. Default is 200
           uint16_t http_outputStreamBufferMaxSize;  ///< buffer size of the stream-of-streams class. Default is 256
-          uint16_t http_maxRequestsPerConnection;   ///< in http1.1, close connection after this many requests. 0 = never, default is 5.
+          uint16_t http_maxRequestsPerConnection;   ///< in http1.1, close connection after this many requests. 0 = never, default is 100.
+          uint16_t http_staticBufferSize;           ///< sendStaticAsset() response header buffer, allocated on first use. Small bodies are sent from it with the header. Default is 384.
+          uint32_t http_keepAliveTimeout;           ///< in http1.1, millis that a connection may be idle between requests. 0 = use the server's tcp_idleConnectionTimeout. Default is 5000.
+          HttpServerMetrics *http_metrics;          ///< if not null then the connections update these counters. Default is nullptr.
 
           Parameters() {
-            http_version11=false;
+            http_version11=true;
             http_maxRequestLineLength=200;
             http_outputStreamBufferMaxSize=256;
-            http_maxRequestsPerConnection=5;
+            http_maxRequestsPerConnection=100;
+            http_staticBufferSize=384;
+            http_keepAliveTimeout=5000;
+            http_metrics=nullptr;
           }
         };
 
       protected:
+
+        enum {
+          MAX_IF_NONE_MATCH_LENGTH = 48,    ///< longest If-None-Match header value that we'll remember
+          STATIC_HEADER_OVERHEAD = 220      ///< worst case size of the status text and the headers that sendStaticAsset() adds
+        };
+
+        /**
+         * The single byte range that the client asked for
+         */
+
+        enum class RangeType : uint8_t {
+          NONE,                         ///< no range, or one that we can't handle
+          FROM,                         ///< bytes=first-
+          SPAN,                         ///< bytes=first-last
+          SUFFIX                        ///< bytes=-count, the last count bytes
+        };
+
+        /**
+         * A block of memory to be sent without going through the stream of streams
+         */
+
+        struct StaticSegment {
+          const uint8_t *data;
+          uint32_t size;
+        };
+
         const Parameters& _params;          ///< reference to the parameters class
         uint32_t _contentLength;            ///< value of the Content-Length header
         OutputStream *_requestBody;         ///< derivation sets this non-null when it wants the request body
@@ -56,6 +105,18 @@ namespace stm32plus {
         std::string _action;
         std::string _uri;
 
+        char _ifNoneMatch[MAX_IF_NONE_MATCH_LENGTH+1];  ///< value of the If-None-Match header
+        bool _acceptsGzip;                  ///< true if Accept-Encoding includes gzip
+        bool _closeAfterResponse;           ///< the client sent Connection: close, or the response length is unknown
+        RangeType _rangeType;               ///< the Range header
+        uint32_t _rangeFirst;
+        uint32_t _rangeLast;
+
+        scoped_array<char> _staticBuffer;   ///< sendStaticAsset() builds the response header here
+        StaticSegment _staticSegments[2];   ///< the header (maybe with the body) and then the body
+        uint8_t _staticSegmentCount;
+        uint8_t _staticSegmentIndex;
+
         /**
          * States that we transition through while processing a request
          */
@@ -71,11 +132,21 @@ namespace stm32plus {
 
       protected:
         HttpServerConnection(const Parameters& params);
+        ~HttpServerConnection();
 
         void changeState(State newState);
-        void processRequestHeader(const std::string& header);
-
+        void processRequestHeader(const StringView& header);
+        void processIfNoneMatchHeader(const StringView& value);
+        void processAcceptEncodingHeader(const StringView& value);
+        void processRangeHeader(const StringView& value);
+        void processConnectionHeader(const StringView& value);
+        void resetRequest();
+
+        bool isVersion11() const;
+        bool isKeepAlive() const;
         void addConnectionHeader(std::string& response);
+        void addUnknownLengthHeaders(std::string& response);
+        void addUnknownLengthStream(InputStream *stream,bool takeOwnership);
         void addContentTypeHeader(std::string& response);
         void addContentTypeHeader(std::string& response,const char *contentType);
         void addContentLengthHeader(std::string& response,uint32_t contentLength);
@@ -84,11 +155,24 @@ namespace stm32plus {
         void readRequestHeaders();
         void readRequestBody();
         void parseRequestLine();
-        std::string decodeUri(const std::string& uri);
+        void decodeUri(const StringView& uri,std::string& decoded);
+        static uint8_t hexDigit(char c);
+
+        const HttpStaticAsset *findStaticAsset(const HttpStaticAsset *assets,uint16_t count) const;
+        bool wantsGzipVariant(const HttpStaticAsset& asset) const;
+        bool isNotModified(const HttpStaticAsset& asset) const;
+        bool sendStaticAsset(const HttpStaticAsset& asset,InputStream *body=nullptr,bool takeOwnership=false);
+
+        bool getRange(uint32_t size,uint32_t& first,uint32_t& length) const;
+        bool writeStaticSegment();
+        static char *appendString(char *ptr,const char *str);
+        static char *appendUnsigned(char *ptr,uint32_t value);
 
       public:
         bool handleRead();              ///< implementation requirement from the TcpConnectionArray
         bool handleWrite();             ///< implementation requirement from the TcpConnectionArray
+
+        uint16_t getRequestsServed() const;
     };
 
 
@@ -107,6 +191,31 @@ namespace stm32plus {
         _output(*this,params.http_outputStreamBufferMaxSize),
         _requestsServed(0),
         _state(State::READING_REQUEST_LINE) {
+
+      resetRequest();
+    }
+
+
+    /**
+     * Destructor. Record the connection in the metrics.
+     */
+
+    template<class TImpl>
+    inline HttpServerConnection<TImpl>::~HttpServerConnection() {
+
+      bool idle;
+
+      if(_params.http_metrics) {
+
+        // idle if we're closing while waiting for a new request that hasn't started to arrive
+
+        idle=_requestsServed>0 &&
+             _state==State::READING_REQUEST_LINE &&
+             _currentLine.length()==0 &&
+             !isRemoteEndClosed();
+
+        _params.http_metrics->connectionClosed(_requestsServed,idle);
+      }
     }
 
 
@@ -153,6 +262,11 @@ namespace stm32plus {
       _currentLine.add(*this);
 
       if(_currentLine.ready()) {
+
+        // the request is under way so the keep-alive timeout no longer applies
+
+        setIdleTimeout(0);
+
         parseRequestLine();
         changeState(State::READING_REQUEST_HEADERS);
         _currentLine.reset();
@@ -164,38 +278,45 @@ namespace stm32plus {
      * Parse the request line: ACTION SP URI SP PROTOCOL
      * e.g. GET http://www.foo.com/this/file.html HTTP/1.1
      * e.g. GET /this/file.html HTTP/1.1
+     *
+     * The line is taken apart in place and the pieces are assigned into the member strings,
+     * which keep their capacity from one request to the next.
      */
 
     template<class TImpl>
     inline void HttpServerConnection<TImpl>::parseRequestLine() {
 
-      std::string::size_type pos,pos2;
-      const std::string& request(_currentLine.str());
+      uint16_t pos,pos2;
+      StringView request(_currentLine.view()),uri;
 
-      if((pos=request.find(' '))!=std::string::npos) {
+      if((pos=request.find(' '))!=StringView::npos) {
 
         // first the action
 
-        _action=request.substr(0,pos);
+        _action.assign(request.data(),pos);
 
-        if((pos2=request.find(' ',pos+1))!=std::string::npos) {
+        if((pos2=request.find(' ',pos+1))!=StringView::npos) {
 
           // now URI and protocol
 
-          _uri=decodeUri(request.substr(pos+1,pos2-pos-1));
-          _version=request.substr(pos2+1);
+          uri=request.substr(pos+1,pos2-pos-1);
+          _version.assign(request.data()+pos2+1,request.length()-pos2-1);
 
-          // URI may be absolute. deal with that.
+          // URI may be absolute. deal with that before decoding it.
 
-          if((pos=_uri.find("://"))!=std::string::npos) {
+          if((pos=uri.find("://"))!=StringView::npos) {
 
             // found the abs prefix, find the URI at the end
 
-            if((pos=_uri.find('/',pos+3))!=std::string::npos)
-              _uri=_uri.substr(pos);      // URI found, keep it
-            else
+            if((pos=uri.find('/',pos+3))!=StringView::npos)
+              uri=uri.substr(pos);        // URI found, keep it
+            else {
               _uri="/index.html";         // only host and protocol found, default to /index.html
+              return;
+            }
           }
+
+          decodeUri(uri,_uri);
         }
       }
     }
@@ -219,7 +340,7 @@ namespace stm32plus {
             changeState(State::WRITING_BEGIN);                              // zero length = request complete
         }
         else {
-          processRequestHeader(_currentLine);                               // got a header, see if we care about it
+          processRequestHeader(_currentLine.view());                        // got a header, see if we care about it
           static_cast<TImpl *>(this)->handleRequestHeader(_currentLine);    // notify the subclass
         }
 
@@ -242,9 +363,9 @@ namespace stm32plus {
 
       while(_contentLength && getDataAvailable()) {
 
-        // read a chunk
+        // read a chunk of what's here. receive() blocks until it has all that's asked for.
 
-        size=std::min((uint32_t)sizeof(buf),_contentLength);
+        size=std::min(std::min((uint32_t)sizeof(buf),_contentLength),(uint32_t)getDataAvailable());
 
         if(!receive(buf,size,actuallyReceived,0))
           return;
@@ -256,8 +377,13 @@ namespace stm32plus {
 
         // reduce data to read
 
-        _contentLength-=size;
+        _contentLength-=actuallyReceived;
       }
+
+      // on to the response when the whole body has arrived. anything after it is the next request.
+
+      if(_contentLength==0)
+        changeState(State::WRITING_BEGIN);
     }
 
 
@@ -281,37 +407,48 @@ namespace stm32plus {
       else if(_state==State::WRITING_RESPONSE) {
 
         uint32_t actuallySent;
+        bool ok,keepAlive;
+
+        // static segments from sendStaticAsset() go first, then the streams
 
-        if(!_output.writeDataToConnection(actuallySent)) {        // try to write data and kill the connection if it fails
+        if(_staticSegmentIndex!=_staticSegmentCount)
+          ok=writeStaticSegment();
+        else
+          ok=_output.writeDataToConnection(actuallySent);
 
-          delete this;
+        if(!ok) {             // kill the connection if the write failed
+          delete static_cast<TImpl *>(this);
           return true;
         }
 
         // any more data to write?
 
-        if(_output.completed()) {
+        if(_staticSegmentIndex==_staticSegmentCount && _output.completed()) {
+
+          // isKeepAlive() must be asked before the count goes up to get the same answer that
+          // went out in the Connection header
 
+          keepAlive=isKeepAlive();
           _requestsServed++;
 
-          // if this is not HTTP/1.1 or we have served the max number of connections then close the connection
+          if(_params.http_metrics) {
 
-          if(strcasecmp(_version.c_str(),"HTTP/1.1")!=0 ||
-             !_params.http_version11 ||
-             (_params.http_maxRequestsPerConnection && _requestsServed>=_params.http_maxRequestsPerConnection)) {
+            _params.http_metrics->requests++;
 
-            delete this;
-            return true;
+            if(keepAlive && getDataAvailable())
+              _params.http_metrics->pipelinedRequests++;
           }
 
-          // reset and move on to next request from client
-
-          _contentLength=0;
+          if(!keepAlive) {
+            delete static_cast<TImpl *>(this);
+            return true;
+          }
 
-          _action.clear();
-          _uri.clear();
-          _version.clear();
+          // reset and move on to next request from client. it may already be waiting in the
+          // receive buffer if the client is pipelining.
 
+          resetRequest();
+          setIdleTimeout(_params.http_keepAliveTimeout);
           changeState(State::READING_REQUEST_LINE);
         }
       }
@@ -332,22 +469,194 @@ namespace stm32plus {
 
 
     /**
-     * Process an incoming request header
+     * Process an incoming request header. The header is split into its name and value in place.
      * @param header The header, as supplied by the client
      */
 
     template<class TImpl>
-    inline void HttpServerConnection<TImpl>::processRequestHeader(const std::string& header) {
+    inline void HttpServerConnection<TImpl>::processRequestHeader(const StringView& header) {
 
-      std::string::size_type pos;
+      uint16_t pos;
+
+      if((pos=header.find(':'))==StringView::npos)
+        return;
+
+      StringView name(header.substr(0,pos).trim()),value(header.substr(pos+1).trim());
+
+      // Content-Length because the client may be doing a POST, the rest for sendStaticAsset()
+
+      if(name.equalsIgnoreCase("Content-Length"))
+        _contentLength=value.toUnsigned();
+      else if(name.equalsIgnoreCase("If-None-Match"))
+        processIfNoneMatchHeader(value);
+      else if(name.equalsIgnoreCase("Accept-Encoding"))
+        processAcceptEncodingHeader(value);
+      else if(name.equalsIgnoreCase("Range"))
+        processRangeHeader(value);
+      else if(name.equalsIgnoreCase("Connection"))
+        processConnectionHeader(value);
+    }
+
+
+    /*
+     * The Connection header is a list of options. The client sends "close" if it wants the
+     * connection to be closed after this response.
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::processConnectionHeader(const StringView& value) {
+
+      uint16_t start,end;
+
+      for(start=0;start<value.length();start=end+1) {
+
+        if((end=value.find(',',start))==StringView::npos)
+          end=value.length();
+
+        if(value.substr(start,end-start).trim().equalsIgnoreCase("close"))
+          _closeAfterResponse=true;
+      }
+    }
+
+
+    /*
+     * Remember the If-None-Match value. It's a list of ETags that the client has cached. If it's too
+     * long to keep then we forget it, which is always safe because the client gets the full response.
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::processIfNoneMatchHeader(const StringView& value) {
+
+      if(value.length()>MAX_IF_NONE_MATCH_LENGTH)
+        _ifNoneMatch[0]='\0';
+      else {
+        memcpy(_ifNoneMatch,value.data(),value.length());
+        _ifNoneMatch[value.length()]='\0';
+      }
+    }
+
+
+    /*
+     * Check if the client will take gzip. The coding may have a quality value and q=0 means
+     * that it's not acceptable, e.g. "gzip;q=0, deflate".
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::processAcceptEncodingHeader(const StringView& value) {
+
+      uint16_t pos,end;
+      StringView params;
+
+      _acceptsGzip=false;
 
-      // we only care about Content-Length since the client may be doing a POST
+      if((pos=value.find("gzip"))==StringView::npos)
+        return;
 
-      if(!strcasecmp(header.c_str(),"Content-Length:")) {
-        for(pos=15;pos!=header.length() && isspace(header[pos]);pos++);
-        if(pos!=header.length())
-          _contentLength=atoi(header.c_str()+pos);
+      end=value.find(',',pos);
+      params=value.substr(pos+4,end==StringView::npos ? StringView::npos : end-pos-4).trim();
+
+      if(params.empty())
+        _acceptsGzip=true;
+      else if(params[0]==';' && (pos=params.find("q="))!=StringView::npos) {
+
+        // acceptable if there's any non-zero digit in the quality value
+
+        for(pos+=2;pos<params.length() && (params[pos]=='0' || params[pos]=='.');pos++);
+        _acceptsGzip=pos<params.length() && params[pos]>='1' && params[pos]<='9';
       }
+      else
+        _acceptsGzip=params[0]==';';
+    }
+
+
+    /*
+     * Parse the Range header. We handle one range of bytes: first-last, first- and -suffix.
+     * Multiple ranges would need a multipart response so we ignore the header and send the whole
+     * thing, which the client has to accept. Malformed ranges are ignored for the same reason.
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::processRangeHeader(const StringView& value) {
+
+      uint16_t pos;
+      StringView spec;
+
+      _rangeType=RangeType::NONE;
+
+      if(!value.substr(0,6).equalsIgnoreCase("bytes="))
+        return;
+
+      spec=value.substr(6).trim();
+
+      if(spec.find(',')!=StringView::npos || (pos=spec.find('-'))==StringView::npos)
+        return;
+
+      if(pos==0) {
+
+        // -suffix
+
+        if(spec.length()>1) {
+          _rangeLast=spec.substr(1).toUnsigned();
+          _rangeType=RangeType::SUFFIX;
+        }
+      }
+      else {
+
+        _rangeFirst=spec.substr(0,pos).toUnsigned();
+
+        if(pos==spec.length()-1)
+          _rangeType=RangeType::FROM;
+        else if((_rangeLast=spec.substr(pos+1).toUnsigned())>=_rangeFirst)
+          _rangeType=RangeType::SPAN;
+      }
+    }
+
+
+    /*
+     * Reset the per-request state ready for the next request on this connection
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::resetRequest() {
+
+      _contentLength=0;
+
+      _action.clear();
+      _uri.clear();
+      _version.clear();
+
+      _ifNoneMatch[0]='\0';
+      _acceptsGzip=false;
+      _closeAfterResponse=false;
+      _rangeType=RangeType::NONE;
+
+      _staticSegmentCount=0;
+      _staticSegmentIndex=0;
+    }
+
+
+    /**
+     * Check if the request is HTTP/1.1 and we're allowed to use HTTP/1.1 features
+     * @return true if it is
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::isVersion11() const {
+      return _params.http_version11 && !strcasecmp(_version.c_str(),"HTTP/1.1");
+    }
+
+
+    /**
+     * Check if the connection will stay open after this response
+     * @return true if it will
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::isKeepAlive() const {
+
+      return isVersion11() &&
+             !_closeAfterResponse &&
+             (_params.http_maxRequestsPerConnection==0 || _requestsServed<_params.http_maxRequestsPerConnection-1);
     }
 
 
@@ -359,15 +668,49 @@ namespace stm32plus {
     template<class TImpl>
     inline void HttpServerConnection<TImpl>::addConnectionHeader(std::string& response) {
 
-      if(!strcasecmp(_version.c_str(),"HTTP/1.1") &&
-          _params.http_version11 &&
-          (_params.http_maxRequestsPerConnection==0 || _requestsServed!=_params.http_maxRequestsPerConnection-1))
+      if(isKeepAlive())
         response+="Connection: keep-alive\r\n";
       else
         response+="Connection: close\r\n";
     }
 
 
+    /**
+     * Add the headers for a response body whose length is not known in advance, instead of the
+     * Connection and Content-Length headers. An HTTP/1.1 client gets chunked transfer encoding and
+     * the connection can persist. Other clients get a body that ends when the connection is closed.
+     * Add the body with addUnknownLengthStream().
+     * @param response The response string
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::addUnknownLengthHeaders(std::string& response) {
+
+      if(isVersion11())
+        response+="Transfer-Encoding: chunked\r\n";
+      else
+        _closeAfterResponse=true;
+
+      addConnectionHeader(response);
+    }
+
+
+    /**
+     * Add the body of a response that was started with addUnknownLengthHeaders()
+     * @param stream The body
+     * @param takeOwnership true if the stream should be deleted when it's been sent
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::addUnknownLengthStream(InputStream *stream,bool takeOwnership) {
+
+      if(isVersion11())
+        _output.addStream(new HttpChunkedInputStream(stream,takeOwnership),true);
+      else
+        _output.addStream(stream,takeOwnership);
+    }
+
+
     /**
      * Try to add a content-type header from a limited set of known types
      * @param response The response string
@@ -437,31 +780,377 @@ namespace stm32plus {
 
     /**
      * Decode the URI by replacing %xx chars
-     * @param uri
-     * @return
+     * @param uri The URI from the request line
+     * @param[out] decoded Where to put the decoded URI
+     */
+
+    template<class TImpl>
+    inline void HttpServerConnection<TImpl>::decodeUri(const StringView& uri,std::string& decoded) {
+
+      uint16_t i,start;
+
+      decoded.clear();
+
+      for(start=0;(i=uri.find('%',start))!=StringView::npos;start=i+3) {
+
+        if(i+2>=uri.length())
+          break;
+
+        decoded.append(uri.data()+start,i-start);
+        decoded+=static_cast<char>((hexDigit(uri[i+1]) << 4) | hexDigit(uri[i+2]));
+      }
+
+      decoded.append(uri.data()+start,uri.length()-start);
+    }
+
+
+    /**
+     * Get the value of a hex digit
+     * @param c The digit
+     * @return Its value, 0 if it's not a hex digit
      */
 
     template<class TImpl>
-    inline std::string HttpServerConnection<TImpl>::decodeUri(const std::string& uri) {
+    inline uint8_t HttpServerConnection<TImpl>::hexDigit(char c) {
 
-      std::string ret;
-      std::string::size_type i;
-      uint8_t ch;
+      if(c>='0' && c<='9')
+        return c-'0';
+
+      if(c>='a' && c<='f')
+        return c-'a'+10;
+
+      if(c>='A' && c<='F')
+        return c-'A'+10;
+
+      return 0;
+    }
+
+
+    /**
+     * Find the static asset for the request URI
+     * @param assets The array of assets
+     * @param count The number of assets
+     * @return The asset or nullptr if the URI isn't one of them
+     */
+
+    template<class TImpl>
+    inline const HttpStaticAsset *HttpServerConnection<TImpl>::findStaticAsset(const HttpStaticAsset *assets,uint16_t count) const {
 
-      ret.reserve(uri.length());
+      while(count--) {
 
-      for(i=0;i<uri.length();i++) {
+        if(!strcmp(_uri.c_str(),assets->uri))
+          return assets;
 
-        if(uri[i]=='%' && i<=uri.length()-3) {
+        assets++;
+      }
+
+      return nullptr;
+    }
+
+
+    /**
+     * Check if sendStaticAsset() will send the gzip variant of an asset. It will if there is one and
+     * the client accepts gzip, unless there's a range because ranges always refer to the original
+     * bytes. If the body is streamed then this tells you which file to open.
+     * @param asset The asset
+     * @return true if the gzip variant will be sent
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::wantsGzipVariant(const HttpStaticAsset& asset) const {
+      return _acceptsGzip && asset.gzipBodySize!=0 && _rangeType==RangeType::NONE;
+    }
+
+
+    /**
+     * Check if the client already has this asset cached, in which case sendStaticAsset() will send
+     * 304 Not Modified and you don't need to open a file to stream it.
+     * @param asset The asset
+     * @return true if the client's copy is current
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::isNotModified(const HttpStaticAsset& asset) const {
+
+      if(_ifNoneMatch[0]=='\0' || asset.etag==nullptr)
+        return false;
+
+      return !strcmp(_ifNoneMatch,"*") || strstr(_ifNoneMatch,asset.etag)!=nullptr;
+    }
 
-          ch=((uri[i+1]-'0')*16)+(uri[i+2]-'0');
-          ret+=static_cast<char>(ch);
-          i+=2;
+
+    /**
+     * Send a static asset as the response to a GET or HEAD request. Call this from handleStateChange()
+     * when the new state is WRITING_RESPONSE. The status is one of:
+     *
+     *   200 OK                         the whole body
+     *   206 Partial Content            the requested range of the body
+     *   304 Not Modified               the client's If-None-Match has the asset's ETag. No body.
+     *   416 Range Not Satisfiable      the requested range is outside the body. No body.
+     *
+     * The response header is built in a buffer that's allocated once per connection. A body in
+     * memory is sent directly from where it is without copying, unless it's small enough to go
+     * out in the same segment as the header. A streamed body goes through the stream of streams.
+     * Streams can only be skipped forwards so a range that doesn't extend to the end of a streamed
+     * body gets the whole body.
+     *
+     * @param asset The asset
+     * @param body A stream on to the body variant given by wantsGzipVariant(), or nullptr if it's in memory
+     * @param takeOwnership true if the stream should be deleted when it's no longer needed
+     * @return false if the headers are too big for the buffer or it can't be allocated
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::sendStaticAsset(const HttpStaticAsset& asset,InputStream *body,bool takeOwnership) {
+
+      const uint8_t *data;
+      const char *status;
+      uint32_t size,first,length;
+      uint16_t headersLength,code;
+      bool gzip;
+      char *ptr;
+
+      // the buffer must have room for the worst case
+
+      headersLength=strlen(asset.headers);
+
+      if(_version.length()+headersLength+STATIC_HEADER_OVERHEAD>_params.http_staticBufferSize) {
+
+        if(takeOwnership)
+          delete body;
+
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_HTTP_SERVER_CONNECTION,E_STATIC_HEADER_TOO_LONG);
+      }
+
+      if(_staticBuffer.get()==nullptr) {
+
+        _staticBuffer.reset(new char[_params.http_staticBufferSize]);
+
+        if(_staticBuffer.get()==nullptr) {
+
+          if(takeOwnership)
+            delete body;
+
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_HTTP_SERVER_CONNECTION,E_OUT_OF_MEMORY);
+        }
+      }
+
+      // decide which variant and how much of it
+
+      gzip=wantsGzipVariant(asset);
+      data=static_cast<const uint8_t *>(gzip ? asset.gzipBody : asset.body);
+      size=gzip ? asset.gzipBodySize : asset.bodySize;
+
+      first=0;
+      length=size;
+      code=200;
+
+      if(isNotModified(asset)) {
+        code=304;
+        length=0;
+      }
+      else if(_rangeType!=RangeType::NONE) {
+
+        if(!getRange(size,first,length)) {
+          code=416;
+          length=0;
+        }
+        else if(data!=nullptr || first+length==size)
+          code=206;
+        else {
+          first=0;
+          length=size;
+        }
+      }
+
+      switch(code) {
+        case 206: status=" 206 Partial Content\r\n"; break;
+        case 304: status=" 304 Not Modified\r\n"; break;
+        case 416: status=" 416 Range Not Satisfiable\r\n"; break;
+        default:  status=" 200 OK\r\n"; break;
+      }
+
+      // status line and the fixed headers
+
+      ptr=_staticBuffer.get();
+
+      memcpy(ptr,_version.c_str(),_version.length());
+      ptr=appendString(ptr+_version.length(),status);
+
+      memcpy(ptr,asset.headers,headersLength);
+      ptr+=headersLength;
+
+      // the headers that depend on this request
+
+      if(code!=304) {
+        ptr=appendString(ptr,"Content-Length: ");
+        ptr=appendString(appendUnsigned(ptr,length),"\r\n");
+      }
+
+      if(code==206) {
+        ptr=appendString(ptr,"Content-Range: bytes ");
+        ptr=appendUnsigned(ptr,first);
+        ptr=appendString(ptr,"-");
+        ptr=appendUnsigned(ptr,first+length-1);
+        ptr=appendString(ptr,"/");
+        ptr=appendString(appendUnsigned(ptr,size),"\r\n");
+      }
+      else if(code==416) {
+        ptr=appendString(ptr,"Content-Range: bytes */");
+        ptr=appendString(appendUnsigned(ptr,size),"\r\n");
+      }
+
+      if(gzip && code!=304)
+        ptr=appendString(ptr,"Content-Encoding: gzip\r\n");
+
+      if(asset.gzipBodySize)
+        ptr=appendString(ptr,"Vary: Accept-Encoding\r\n");
+
+      ptr=appendString(ptr,"Accept-Ranges: bytes\r\n");
+      ptr=appendString(ptr,isKeepAlive() ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+      ptr=appendString(ptr,"\r\n");
+
+      // HEAD gets the headers without the body
+
+      if(!strcasecmp(_action.c_str(),"HEAD"))
+        length=0;
+
+      // set up the segments. a small body in memory is copied in after the header.
+
+      _staticSegments[0].data=reinterpret_cast<const uint8_t *>(_staticBuffer.get());
+      _staticSegmentCount=1;
+      _staticSegmentIndex=0;
+
+      if(length && data) {
+
+        if(length<=_params.http_staticBufferSize-static_cast<uint32_t>(ptr-_staticBuffer.get())) {
+          memcpy(ptr,data+first,length);
+          ptr+=length;
+        }
+        else {
+          _staticSegments[1].data=data+first;
+          _staticSegments[1].size=length;
+          _staticSegmentCount=2;
         }
-        else
-          ret+=uri[i];
       }
-      return ret;
+
+      _staticSegments[0].size=ptr-_staticBuffer.get();
+
+      // a streamed body follows the segments
+
+      if(body) {
+
+        if(length && (first==0 || body->skip(first))) {
+          _output.addStream(body,takeOwnership);
+          return true;
+        }
+
+        if(takeOwnership)
+          delete body;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Resolve the requested range against the body size
+     * @param size The body size
+     * @param[out] first The first byte to send
+     * @param[out] length The number of bytes to send
+     * @return false if the range is not satisfiable
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::getRange(uint32_t size,uint32_t& first,uint32_t& length) const {
+
+      if(_rangeType==RangeType::SUFFIX) {
+
+        if(_rangeLast==0 || size==0)
+          return false;
+
+        length=std::min(_rangeLast,size);
+        first=size-length;
+        return true;
+      }
+
+      if(_rangeFirst>=size)
+        return false;
+
+      first=_rangeFirst;
+
+      if(_rangeType==RangeType::FROM)
+        length=size-first;
+      else
+        length=std::min(_rangeLast,size-1)-first+1;
+
+      return true;
+    }
+
+
+    /*
+     * Send what's left of the current static segment. TCP keeps no copy of what it sends so the
+     * data is sent straight from the segment, which is why it must stay put until it's been sent.
+     * @return false if the connection failed
+     */
+
+    template<class TImpl>
+    inline bool HttpServerConnection<TImpl>::writeStaticSegment() {
+
+      uint32_t actuallySent;
+      StaticSegment& segment(_staticSegments[_staticSegmentIndex]);
+
+      if(!send(segment.data,segment.size,actuallySent,0))
+        return false;
+
+      segment.data+=actuallySent;
+      segment.size-=actuallySent;
+
+      if(segment.size==0)
+        _staticSegmentIndex++;
+
+      return true;
+    }
+
+
+    /*
+     * Append a null terminated string to a buffer
+     * @param ptr Where to append
+     * @param str What to append
+     * @return The new end of the buffer
+     */
+
+    template<class TImpl>
+    inline char *HttpServerConnection<TImpl>::appendString(char *ptr,const char *str) {
+
+      while(*str)
+        *ptr++=*str++;
+
+      return ptr;
+    }
+
+
+    /*
+     * Append a number in decimal to a buffer
+     * @param ptr Where to append
+     * @param value The number
+     * @return The new end of the buffer
+     */
+
+    template<class TImpl>
+    inline char *HttpServerConnection<TImpl>::appendUnsigned(char *ptr,uint32_t value) {
+      return ptr+StringUtil::modp_uitoa10(value,ptr);
+    }
+
+
+    /**
+     * Get the number of requests served on this connection
+     * @return The number of responses completed
+     */
+
+    template<class TImpl>
+    inline uint16_t HttpServerConnection<TImpl>::getRequestsServed() const {
+      return _requestsServed;
     }
   }
 }
@@ -0,0 +1,86 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Counters for how well persistent connections are working. Declare one of these, point
+     * the http_metrics parameter at it and all the connections that share the parameters will
+     * update it. A high requests per connection figure means that clients are saving the TCP
+     * handshake on most requests.
+     */
+
+    struct HttpServerMetrics {
+
+      enum {
+        HISTOGRAM_SIZE = 5              ///< buckets are 0, 1, 2-3, 4-7 and 8+ requests
+      };
+
+      uint32_t connections;             ///< connections that have closed
+      uint32_t requests;                ///< requests served on those and the open connections
+      uint32_t reusedConnections;       ///< connections that served more than one request
+      uint32_t pipelinedRequests;       ///< requests that had already arrived when the previous response finished
+      uint32_t idleCloses;              ///< connections closed by us while waiting for the next request
+      uint32_t maxRequestsPerConnection;
+      uint32_t requestsPerConnection[HISTOGRAM_SIZE];   ///< connections by the number of requests served
+
+      HttpServerMetrics();
+
+      void reset();
+      void connectionClosed(uint32_t requestsServed,bool idle);
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    inline HttpServerMetrics::HttpServerMetrics() {
+      reset();
+    }
+
+
+    /**
+     * Reset all counters to zero
+     */
+
+    inline void HttpServerMetrics::reset() {
+      memset(this,0,sizeof(*this));
+    }
+
+
+    /**
+     * Record a connection that has closed
+     * @param requestsServed The number of requests that it served
+     * @param idle true if we closed it while waiting for the next request
+     */
+
+    inline void HttpServerMetrics::connectionClosed(uint32_t requestsServed,bool idle) {
+
+      uint8_t bucket;
+
+      connections++;
+
+      if(requestsServed>1)
+        reusedConnections++;
+
+      if(idle)
+        idleCloses++;
+
+      if(requestsServed>maxRequestsPerConnection)
+        maxRequestsPerConnection=requestsServed;
+
+      // 0, 1, 2-3, 4-7, 8+
+
+      for(bucket=0;bucket<HISTOGRAM_SIZE-1 && requestsServed>=(1U << bucket);bucket++);
+      requestsPerConnection[bucket]++;
+    }
+  }
+}
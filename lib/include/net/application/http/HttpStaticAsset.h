@@ -0,0 +1,48 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Description of a static file that HttpServerConnection::sendStaticAsset() can serve
+     * without building anything at request time. Everything here is normally const data in
+     * flash, for example:
+     *
+     *   static const uint8_t IndexHtml[]={ ... };        // the file
+     *   static const uint8_t IndexHtmlGz[]={ ... };      // gzip -9 of the file
+     *
+     *   static const HttpStaticAsset Assets[]={
+     *     { "/index.html",
+     *       "Content-Type: text/html\r\nETag: \"1a2b3c4d\"\r\nCache-Control: no-cache\r\n",
+     *       "\"1a2b3c4d\"",
+     *       IndexHtml,sizeof(IndexHtml),
+     *       IndexHtmlGz,sizeof(IndexHtmlGz) },
+     *     ...
+     *   };
+     *
+     * The ETag can be anything that changes when the file does, a CRC of the content is the
+     * usual choice. Leave out the gzip variant if it's not smaller than the original.
+     *
+     * The bodies don't have to be in memory. If they're in files on a FAT file system then set
+     * the body pointers to nullptr but still give the sizes, and pass sendStaticAsset() a stream
+     * on to the variant that it says it wants.
+     */
+
+    struct HttpStaticAsset {
+      const char *uri;                ///< the path that requests this asset, e.g. "/index.html"
+      const char *headers;            ///< headers common to every response, each ending with CRLF. Should include Content-Type and ETag.
+      const char *etag;               ///< the quoted ETag as it appears in the headers, nullptr for none
+      const void *body;               ///< the body, or nullptr if it's streamed
+      uint32_t bodySize;              ///< the body size
+      const void *gzipBody;           ///< the gzip compressed body, or nullptr if it's streamed or there isn't one
+      uint32_t gzipBodySize;          ///< the gzip body size, zero if there isn't one
+    };
+  }
+}
@@ -121,7 +121,7 @@ namespace stm32plus {
 
       // subscribe to notifications (to get the stack's MAC)
 
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&LinkLocalIp<TTransportLayer>::onNotification));
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::MAC_ADDRESS_ANNOUNCEMENT,NetworkNotificationEventSourceSlot::bind(this,&LinkLocalIp<TTransportLayer>::onNotification));
 
       // set up our RTC ticker, initially disabled
 
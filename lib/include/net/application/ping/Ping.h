@@ -100,7 +100,7 @@ namespace stm32plus {
 
       // subscribe to receive events from the network
 
-      this->NetworkReceiveEventSender.insertSubscriber(NetworkReceiveEventSourceSlot::bind(this,&Ping<TTransportLayer>::onReceive));
+      this->NetworkReceiveEventSender.insertSubscriber(NetEventDescriptor::NetEventType::ICMP_PACKET,NetworkReceiveEventSourceSlot::bind(this,&Ping<TTransportLayer>::onReceive));
       return true;
     }
 
@@ -115,9 +115,12 @@ namespace stm32plus {
     template<class TPhysicalLayer>
     inline bool Mac<TPhysicalLayer>::initialise(Parameters& params) {
 
-      // subscribe to notification events
+      // subscribe to the PHY register notification events
 
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Mac<TPhysicalLayer>::onNotification));
+      NetworkNotificationEventSourceSlot notificationSlot(NetworkNotificationEventSourceSlot::bind(this,&Mac<TPhysicalLayer>::onNotification));
+
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::PHY_READ_REQUEST,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::PHY_WRITE_REQUEST,notificationSlot);
 
       // enable the interrupts
 
@@ -128,6 +128,7 @@ namespace stm32plus {
         bool setupEthernetFrame(const FrameTypeDef& fd,EthernetFrame& ef) const;
 
         bool sendBuffer(NetBuffer *nb);
+        uint16_t nextTransmitIndex(uint16_t index) const;
 
         bool initialise(const Parameters& params);
         bool startup();
@@ -156,6 +157,17 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the index of the transmit descriptor after this one in the ring
+     * @param index The current index
+     * @return The next index, wrapping back to zero at the end of the ring
+     */
+
+    inline uint16_t MacBase::nextTransmitIndex(uint16_t index) const {
+      return index==_params.mac_transmitBufferCount-1 ? 0 : index+1;
+    }
+
+
     /**
      * Get the size of the headers needed to transmit an ethernet frame
      * @return The size of 2 MAC addresses and the EtherType field. A total of 14 bytes.
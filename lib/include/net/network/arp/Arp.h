@@ -48,6 +48,7 @@ namespace stm32plus {
           uint32_t arp_cacheExpirySeconds;  ///< The max seconds to keep an ARP cache entry, default is 600
           uint32_t arp_replyTimeout;        ///< how long in ms to wait for an ARP reply, default is 5000
           uint8_t arp_retries;              ///< number of times to retry, default is 5
+          uint32_t arp_unresolvedCacheSeconds; ///< seconds to remember a failed resolution before trying again, default is 10. zero to disable.
 
           Parameters() {
             arp_startupBroadcast=true;
@@ -55,6 +56,7 @@ namespace stm32plus {
             arp_replyTimeout=5000;          ///< 5 seconds for an ARP timeout
             arp_cacheExpirySeconds=600;     ///< 10 minute default cache lifetime
             arp_retries=5;                  ///< 5 times to retry
+            arp_unresolvedCacheSeconds=10;  ///< 10 seconds before retrying an unresolved address
           }
         };
 
@@ -87,6 +89,8 @@ namespace stm32plus {
         void arpBroadcastMyAddress();
         void arpSendRequest(IpAddress& ipaddress);
         void arpSendProbe(IpAddress& ipaddress);
+
+        const ArpCacheStatistics& arpGetCacheStatistics() const;
     };
 
 
@@ -107,10 +111,18 @@ namespace stm32plus {
 
       _arpCache.initialise(params.arp_cacheSize,params.arp_cacheExpirySeconds,this->_rtc);
 
-      // subscribe to receive notification and receive events
+      // subscribe to the receive and notification events that we handle
+
+      this->NetworkReceiveEventSender.insertSubscriber(NetEventDescriptor::NetEventType::DATALINK_FRAME,NetworkReceiveEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onReceive));
+
+      NetworkNotificationEventSourceSlot notificationSlot(NetworkNotificationEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onNotification));
 
-      this->NetworkReceiveEventSender.insertSubscriber(NetworkReceiveEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onReceive));
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Arp<TDatalinkLayer>::onNotification));
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::ARP_MAPPING_REQUEST,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::IP_ADDRESS_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::SUBNET_MASK_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::DEFAULT_GATEWAY_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::MAC_ADDRESS_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::IP_ADDRESS_MAPPING,notificationSlot);
 
       return true;
     }
@@ -359,10 +371,21 @@ namespace stm32plus {
       else
         ip=_defaultGatewayAddress;      // a remote IP address
 
-      // first check the cache and return if found or we cannot do a lookup
+      // first check the cache and return if found. if the address recently failed to resolve
+      // then fail now rather than sending more requests for it
 
-      if((event.found=_arpCache.findMacAddress(ip,event.macAddress)))
-        return true;
+      switch(_arpCache.lookup(ip,event.macAddress)) {
+
+        case ArpCache::FOUND:
+          event.found=true;
+          return true;
+
+        case ArpCache::UNRESOLVED:
+          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_ARP,E_TIMED_OUT);
+
+        default:
+          break;
+      }
 
       // if we're in an IRQ then we can't continue because we'd need to do a tx/rx
 
@@ -383,10 +406,26 @@ namespace stm32plus {
           return true;
       }
 
+      // remember the failure to throttle further requests
+
+      if(_params.arp_unresolvedCacheSeconds)
+        _arpCache.insertUnresolved(ip,_params.arp_unresolvedCacheSeconds);
+
       return this->setError(ErrorProvider::ERROR_PROVIDER_NET_ARP,E_TIMED_OUT);
     }
 
 
+    /**
+     * Get the ARP cache hit/miss statistics
+     * @return A reference to the statistics
+     */
+
+    template<class TDatalinkLayer>
+    inline const ArpCacheStatistics& Arp<TDatalinkLayer>::arpGetCacheStatistics() const {
+      return _arpCache.getStatistics();
+    }
+
+
     /**
      * Send an ARP request.
      * @param ipaddress the IP address to include in the query
@@ -11,16 +11,47 @@ namespace stm32plus {
   namespace net {
 
     /**
-     * Simple LRU cache for an ARP mapping of IP address to MAC address. Implemented as
-     * a compact doubly linked list with a fixed maximum number of entries. The list
-     * entry overhead is just 2 bytes and no dynamic memory allocation is required after
-     * initialisation. Searching is a linear operation from the MRU to the LRU so the
-     * number of entries should be kept low. The maximum number of entries is 255.
-     * Index #255 is reserved.
+     * Statistics maintained by the ARP cache
+     */
+
+    struct ArpCacheStatistics {
+      uint32_t hits;                      ///< lookups that found a resolved address
+      uint32_t misses;                    ///< lookups that found nothing
+      uint32_t unresolvedHits;            ///< lookups that found a recently failed resolution
+      uint32_t insertions;                ///< new entries created
+      uint32_t evictions;                 ///< LRU entries evicted to make room
+      uint32_t expiries;                  ///< entries found to have expired
+    };
+
+
+    /**
+     * LRU cache for an ARP mapping of IP address to MAC address. Implemented as a compact
+     * doubly linked list with a fixed maximum number of entries and an open addressing hash
+     * index keyed by IP address so that lookup, insert and eviction are constant time. No
+     * dynamic memory allocation is required after initialisation. The maximum number of
+     * entries is 254. Index #255 is reserved.
+     *
+     * Expiry is lazy. An expired entry is only noticed and recycled when a lookup or insert
+     * lands on it, or when it reaches the LRU end of the list and is evicted.
+     *
+     * An IP address that could not be resolved can be cached as 'unresolved' for a short time
+     * so that a burst of traffic to an absent host does not turn into a burst of ARP requests.
      */
 
     class ArpCache {
 
+      public:
+
+        /**
+         * Results from a lookup
+         */
+
+        enum LookupResult {
+          FOUND,                          ///< resolved MAC address found
+          NOT_FOUND,                      ///< nothing is known
+          UNRESOLVED                      ///< resolution recently failed
+        };
+
       protected:
 
         /**
@@ -28,12 +59,14 @@ namespace stm32plus {
          */
 
         enum {
-          NO_ENTRY = 0xff                 ///< used as a next/prev marker to say 'none'
+          NO_ENTRY = 0xff,                ///< used as a next/prev marker to say 'none'
+          FLAG_UNRESOLVED = 0x1           ///< the entry records a failed resolution
         };
 
         struct CacheEntry {
           uint8_t next;                   ///< next index in the list (or NO_ENTRY)
           uint8_t previous;               ///< previous index in the list (or NO_ENTRY)
+          uint8_t flags;                  ///< FLAG_xxx values
           MacAddress macAddress;          ///< mac address held here
           IpAddress ipAddress;            ///< ip address held here
           uint32_t expiryTime;            ///< RTC time after which this entry is invalid
@@ -41,31 +74,48 @@ namespace stm32plus {
 
         uint8_t _first;                   ///< first index in the list (or NO_ENTRY if empty)
         uint8_t _last;                    ///< last index in the list (or NO_ENTRY if empty)
-        uint8_t _insertionPoint;          ///< next free array slot for new entries (or _maxEntries-1 if full)
+        uint8_t _free;                    ///< first index in the free list (or NO_ENTRY if full)
         uint8_t _maxEntries;              ///< total entries allowed
+        uint16_t _hashMask;               ///< hash table size - 1
         uint32_t _expirySeconds;          ///< seconds to keep in a cache
         RtcBase *_rtc;                    ///< Pointer to the RTC
 
         scoped_array<CacheEntry> _array;  ///< the array of CacheEntry structures
+        scoped_array<uint8_t> _hashTable; ///< open addressing index into _array (or NO_ENTRY)
+
+        ArpCacheStatistics _statistics;
 
         volatile bool _watchFlag;         ///< set to true when _watchIp is inserted
         IpAddress _watchIp;             ///< an IP to watch for
         MacAddress *_foundMac;            ///< MAC address found for the watcher
 
       protected:
-        void internalInsert(const MacAddress& mac,const IpAddress& ip);
+        void internalInsert(const MacAddress& mac,const IpAddress& ip,uint8_t flags,uint32_t expirySeconds);
+        uint8_t allocateEntry();
+        void removeEntry(uint8_t index);
         void unlink(uint8_t index);
         void insertFront(uint8_t index);
         bool hasExpired(uint8_t index) const;
 
+        uint16_t hash(const IpAddress& ip) const;
+        uint8_t hashFind(const IpAddress& ip) const;
+        void hashInsert(uint8_t index);
+        void hashRemove(uint8_t index);
+
       public:
         bool initialise(uint8_t numEntries,uint32_t expirySeconds,RtcBase *rtc);
 
         void insert(const MacAddress& mac,const IpAddress& ip);
+        void insertUnresolved(const IpAddress& ip,uint32_t expirySeconds);
+
+        LookupResult lookup(const IpAddress& ip,MacAddress& found);
         bool findMacAddress(const IpAddress& ip,MacAddress& found);
 
         void setWatchIp(const IpAddress& ip,MacAddress *foundMac);
         bool waitForWatch(uint32_t timeout);
+
+        const ArpCacheStatistics& getStatistics() const;
+        void resetStatistics();
     };
 
 
@@ -82,18 +132,43 @@ namespace stm32plus {
 
     inline bool ArpCache::initialise(uint8_t numEntries,uint32_t expirySeconds,RtcBase *rtc) {
 
+      uint16_t i,hashSize;
+
+      if(numEntries==NO_ENTRY)
+        numEntries--;
+
+      // the hash table is at least twice the number of entries so that probe sequences stay short
+
+      for(hashSize=4;hashSize<numEntries*2;hashSize<<=1);
+
       _array.reset(new CacheEntry[numEntries]);
+      _hashTable.reset(new uint8_t[hashSize]);
+
+      if(_array.get()==nullptr || _hashTable.get()==nullptr)
+        return false;
+
+      for(i=0;i<hashSize;i++)
+        _hashTable[i]=NO_ENTRY;
+
+      // all entries start on the free list
+
+      for(i=0;i<numEntries;i++) {
+        _array[i].next=i+1<numEntries ? i+1 : NO_ENTRY;
+        _array[i].previous=NO_ENTRY;
+      }
 
       // initialise internal variables
 
       _first=_last=NO_ENTRY;
-      _insertionPoint=0;
+      _free=numEntries ? 0 : NO_ENTRY;
       _maxEntries=numEntries;
+      _hashMask=hashSize-1;
       _expirySeconds=expirySeconds;
       _rtc=rtc;
       _watchFlag=false;
 
-      return _array.get()!=nullptr;
+      resetStatistics();
+      return true;
     }
 
 
@@ -108,14 +183,6 @@ namespace stm32plus {
       // protect ourselves from re-entrancy while we do the insert
 
       IrqSuspend suspender;
-      internalInsert(mac,ip);
-    }
-
-    inline void ArpCache::internalInsert(const MacAddress& mac,const IpAddress& ip) {
-
-      uint8_t i,found,unused;
-      uint32_t timeNow;
-      CacheEntry *ptr;
 
       // can we release a watcher when this IRQ finishes?
 
@@ -124,90 +191,66 @@ namespace stm32plus {
         _watchFlag=false;
       }
 
-      // don't care for the link order here, just walk the array. If a matching
-      // cache entry is found then get out right away. We also need to take care
-      // of a change of association so we also try to find matches by IP and MAC
-      // but not both
-
-      ptr=_array.get();
-      found=unused=NO_ENTRY;
-      timeNow=_rtc->getTick();
+      internalInsert(mac,ip,0,_expirySeconds);
+    }
 
-      for(i=0;i<_insertionPoint;i++) {
 
-        if(ptr->next==NO_ENTRY && ptr->previous==NO_ENTRY && i!=_first)
-          unused=i;
-        else {
+    /**
+     * Record that an IP address could not be resolved. Lookups will return UNRESOLVED until the
+     * entry expires or a real mapping for the address is inserted. A resolved entry that has
+     * not expired is never replaced. This is IRQ-safe
+     * @param ip The IP address that could not be resolved
+     * @param expirySeconds How long to remember the failure
+     */
 
-          // if expired then remove it
+    inline void ArpCache::insertUnresolved(const IpAddress& ip,uint32_t expirySeconds) {
 
-          if(timeNow>ptr->expiryTime) {
-            unlink(i);
-            unused=i;
-          }
-          else if(ptr->ipAddress==ip) {
+      uint8_t i;
 
-            if(ptr->macAddress==mac)
-              found=i;        // found an exact match that hasn't expired
-            else {
+      IrqSuspend suspender;
 
-              // IP address is cached but has been assigned to another MAC
-              // this cache entry must be expunged
+      if((i=hashFind(ip))!=NO_ENTRY && (_array[i].flags & FLAG_UNRESOLVED)==0 && !hasExpired(i))
+        return;
 
-              unlink(i);
-              unused=i;
-            }
-          }
-          else if(ptr->macAddress==mac) {
+      internalInsert(MacAddress(),ip,FLAG_UNRESOLVED,expirySeconds);
+    }
 
-            // MAC address is in the cache but has a different IP address
-            // the cache entry is not valid any more
 
-            unlink(i);
-            unused=i;
-          }
-        }
-        ptr++;
-      }
+    /*
+     * insert or update an entry and bring it to the front of the LRU list
+     */
 
-      // so what happened? if an unexpired match was found then it needs to come to the front
+    inline void ArpCache::internalInsert(const MacAddress& mac,const IpAddress& ip,uint8_t flags,uint32_t expirySeconds) {
 
-      if(found!=NO_ENTRY) {
+      uint8_t i;
+      CacheEntry *ptr;
 
-        // take the entry out of the list and put it back at the front
+      if((i=hashFind(ip))!=NO_ENTRY) {
 
-        unlink(found);
-        insertFront(found);
+        // the IP address is already known. the MAC address may have changed so it's
+        // simply overwritten
 
-        return;
+        unlink(i);
       }
+      else {
 
-      // a new entry needs to be created. can we place it in a previously
-      // used position?
-
-      if(unused!=NO_ENTRY)
-        i=unused;
-      else if(_insertionPoint!=_maxEntries) {
-
-        // there is space to put it on the end
+        // a new entry needs to be created
 
-        i=_insertionPoint;
-        _insertionPoint++;
-      }
-      else {
+        if((i=allocateEntry())==NO_ENTRY)
+          return;
 
-        // there is no space, evict the LRU entry at the end of the cache
+        _array[i].ipAddress=ip;
+        hashInsert(i);
 
-        i=_last;
-        unlink(_last);
+        _statistics.insertions++;
       }
 
       // enter our details
 
       ptr=&_array[i];
       ptr->macAddress=mac;
-      ptr->ipAddress=ip;
-      ptr->expiryTime=_rtc->getTick()+_expirySeconds;
+      ptr->flags=flags;
+      ptr->expiryTime=_rtc->getTick()+expirySeconds;
 
       // we are the most recent, insert at front
 
@@ -216,35 +259,58 @@ namespace stm32plus {
 
 
     /**
-     * Find the MAC address given an IP address. The cached address must not have
-     * expired. Expired entries are intentionally not cleaned here to keep the
-     * performance to a maximum. Expired entries are detected and recycled in the
-     * insert() method.
+     * Look up the MAC address for an IP address. An expired entry is recycled when it's found.
+     * A resolved entry that is found becomes the most recently used.
      * @param ip The IP address to find
      * @param found The found mac address
-     * @return true if found
+     * @return FOUND, NOT_FOUND or UNRESOLVED
      */
 
-    inline bool ArpCache::findMacAddress(const IpAddress& ip,MacAddress& found) {
+    inline ArpCache::LookupResult ArpCache::lookup(const IpAddress& ip,MacAddress& found) {
 
       uint8_t i;
-      bool ret;
-
-      ret=false;
 
       // protect ourselves from re-entrancy
 
       IrqSuspend suspender;
 
-      for(i=_first;i!=NO_ENTRY;i=_array[i].next) {
-        if(_array[i].ipAddress==ip && !hasExpired(i)) {
-          found=_array[i].macAddress;
-          ret=true;
-          break;
-        }
+      if((i=hashFind(ip))==NO_ENTRY) {
+        _statistics.misses++;
+        return NOT_FOUND;
+      }
+
+      if(hasExpired(i)) {
+        removeEntry(i);
+        _statistics.expiries++;
+        _statistics.misses++;
+        return NOT_FOUND;
+      }
+
+      if((_array[i].flags & FLAG_UNRESOLVED)!=0) {
+        _statistics.unresolvedHits++;
+        return UNRESOLVED;
       }
 
-      return ret;
+      found=_array[i].macAddress;
+      _statistics.hits++;
+
+      unlink(i);
+      insertFront(i);
+
+      return FOUND;
+    }
+
+
+    /**
+     * Find the MAC address given an IP address. The cached address must not have
+     * expired and must not be an unresolved entry.
+     * @param ip The IP address to find
+     * @param found The found mac address
+     * @return true if found
+     */
+
+    inline bool ArpCache::findMacAddress(const IpAddress& ip,MacAddress& found) {
+      return lookup(ip,found)==FOUND;
     }
 
 
@@ -294,6 +360,63 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the cache statistics
+     * @return A reference to the statistics
+     */
+
+    inline const ArpCacheStatistics& ArpCache::getStatistics() const {
+      return _statistics;
+    }
+
+
+    /**
+     * Reset the cache statistics to zero
+     */
+
+    inline void ArpCache::resetStatistics() {
+      memset(&_statistics,0,sizeof(_statistics));
+    }
+
+
+    /*
+     * Get a free entry, evicting the LRU entry if there are none
+     */
+
+    inline uint8_t ArpCache::allocateEntry() {
+
+      uint8_t i;
+
+      if(_free==NO_ENTRY) {
+
+        if(_last==NO_ENTRY)
+          return NO_ENTRY;
+
+        removeEntry(_last);
+        _statistics.evictions++;
+      }
+
+      i=_free;
+      _free=_array[i].next;
+
+      return i;
+    }
+
+
+    /*
+     * Take an entry out of the list and the index and put it on the free list
+     */
+
+    inline void ArpCache::removeEntry(uint8_t index) {
+
+      unlink(index);
+      hashRemove(index);
+
+      _array[index].next=_free;
+      _free=index;
+    }
+
+
     /**
      * Unlink an entry from the list
      * @param index The entry to unlink
@@ -348,5 +471,75 @@ namespace stm32plus {
 
       _first=index;
     }
+
+
+    /*
+     * Multiplicative hash of the IP address. The address is in network order so on a little
+     * endian MCU the host part is in the top byte, which can't reach the bits of the product
+     * that are used. The top half is folded into the bottom half first so that the hosts on a
+     * subnet don't all land in the same slot.
+     */
+
+    inline uint16_t ArpCache::hash(const IpAddress& ip) const {
+      return (((ip.ipAddress ^ (ip.ipAddress >> 16))*2654435761U) >> 16) & _hashMask;
+    }
+
+
+    /*
+     * Find the entry index for an IP address by linear probing
+     */
+
+    inline uint8_t ArpCache::hashFind(const IpAddress& ip) const {
+
+      uint16_t slot;
+      uint8_t i;
+
+      for(slot=hash(ip);(i=_hashTable[slot])!=NO_ENTRY;slot=(slot+1) & _hashMask)
+        if(_array[i].ipAddress==ip)
+          return i;
+
+      return NO_ENTRY;
+    }
+
+
+    /*
+     * Add an entry to the index at the first free slot in its probe sequence
+     */
+
+    inline void ArpCache::hashInsert(uint8_t index) {
+
+      uint16_t slot;
+
+      for(slot=hash(_array[index].ipAddress);_hashTable[slot]!=NO_ENTRY;slot=(slot+1) & _hashMask);
+      _hashTable[slot]=index;
+    }
+
+
+    /*
+     * Remove an entry from the index. Entries later in the same probe run are shifted back
+     * into the hole if their home slot allows it so that no tombstones are needed.
+     */
+
+    inline void ArpCache::hashRemove(uint8_t index) {
+
+      uint16_t hole,slot,home;
+
+      for(hole=hash(_array[index].ipAddress);_hashTable[hole]!=index;hole=(hole+1) & _hashMask);
+
+      for(slot=(hole+1) & _hashMask;_hashTable[slot]!=NO_ENTRY;slot=(slot+1) & _hashMask) {
+
+        home=hash(_array[_hashTable[slot]].ipAddress);
+
+        // the entry stays where it is if its home is cyclically in (hole,slot]
+
+        if(hole<=slot ? (hole<home && home<=slot) : (hole<home || home<=slot))
+          continue;
+
+        _hashTable[hole]=_hashTable[slot];
+        hole=slot;
+      }
+
+      _hashTable[hole]=NO_ENTRY;
+    }
   }
 }
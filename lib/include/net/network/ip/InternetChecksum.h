@@ -15,7 +15,14 @@ namespace stm32plus {
 
 
     /**
-     * Utility class to do the IP checksum algorithm
+     * Utility class to do the IP checksum algorithm. An instance of this class is an
+     * accumulator that can be fed any number of scatter-gather segments of any length
+     * and alignment. The bulk of the work is done 32 bits at a time into a 64 bit
+     * accumulator with the carries folded only once at the end.
+     *
+     * The static methods provide one-shot checksums, RFC 1624 incremental update for
+     * header fields that are rewritten, and the transport checksum over a NetBuffer for
+     * the UDP, TCP and ICMP protocols.
      */
 
     class InternetChecksum {
@@ -30,11 +37,122 @@ namespace stm32plus {
           uint16_t length;
         };
 
+        uint32_t _sum;
+        bool _odd;
+
       protected:
-        static void sumit(const void *vptr,uint16_t length,uint32_t& sum);
+        static uint16_t sumBlock(const void *data,uint32_t length);
+        static uint16_t fold(uint64_t sum);
+        static uint16_t swap(uint16_t value);
 
       public:
+        InternetChecksum();
+
+        void reset();
+        void add(const void *data,uint32_t length);
+        void add(const NetBuffer& nb);
+
+        uint16_t getSum() const;
+        uint16_t getChecksum() const;
+
+        static uint16_t checksum(const void *data,uint32_t length);
+        static uint16_t update(uint16_t checksum,uint16_t oldValue,uint16_t newValue);
+        static uint16_t update32(uint16_t checksum,uint32_t oldValue,uint32_t newValue);
+
+        static bool calculate(const IpAddress& sourceAddress,const IpAddress& destinationAddress,IpProtocol protocol,NetBuffer& nb);
         static void calculate(const IpAddress& sourceAddress,const IpAddress& destinationAddress,NetBuffer& nb);
     };
+
+
+    /**
+     * Constructor
+     */
+
+    inline InternetChecksum::InternetChecksum() {
+      reset();
+    }
+
+
+    /**
+     * Reset the accumulator to start a new checksum
+     */
+
+    inline void InternetChecksum::reset() {
+      _sum=0;
+      _odd=false;
+    }
+
+
+    /**
+     * Get the ones-complement sum of all the data added so far, not complemented
+     * @return The sum, in the same byte order as the data
+     */
+
+    inline uint16_t InternetChecksum::getSum() const {
+      return fold(_sum);
+    }
+
+
+    /**
+     * Get the checksum of all the data added so far. This is the value that goes in
+     * the checksum field of a header.
+     * @return The checksum, in the same byte order as the data
+     */
+
+    inline uint16_t InternetChecksum::getChecksum() const {
+      return ~getSum();
+    }
+
+
+    /**
+     * Calculate the checksum of a single block of memory, for example an IP header
+     * @param data The data
+     * @param length The number of bytes
+     * @return The checksum, ready to be stored in the header
+     */
+
+    inline uint16_t InternetChecksum::checksum(const void *data,uint32_t length) {
+      return ~sumBlock(data,length);
+    }
+
+
+    /**
+     * Calculate the UDP checksum. This is the original UDP-only overload.
+     * @param sourceAddress Our IP address
+     * @param destinationAddress The destination IP address
+     * @param nb The netbuffer containing the UDP packet including the header
+     */
+
+    inline void InternetChecksum::calculate(const IpAddress& sourceAddress,const IpAddress& destinationAddress,NetBuffer& nb) {
+      calculate(sourceAddress,destinationAddress,IpProtocol::UDP,nb);
+    }
+
+
+    /*
+     * fold a wide sum down to 16 bits with end-around carry
+     */
+
+    inline uint16_t InternetChecksum::fold(uint64_t sum) {
+
+      uint32_t sum32;
+
+      sum32=static_cast<uint32_t>(sum)+static_cast<uint32_t>(sum >> 32);
+      if(sum32<static_cast<uint32_t>(sum))
+        sum32++;
+
+      sum32=(sum32 & 0xFFFF)+(sum32 >> 16);
+      sum32=(sum32 & 0xFFFF)+(sum32 >> 16);
+
+      return sum32;
+    }
+
+
+    /*
+     * swap the bytes in a 16 bit value
+     */
+
+    inline uint16_t InternetChecksum::swap(uint16_t value) {
+      return (value << 8) | (value >> 8);
+    }
   }
 }
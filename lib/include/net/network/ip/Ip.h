@@ -128,11 +128,16 @@ namespace stm32plus {
 
       _initialTtl=params.ip_initialTtl;
 
-      // subscribe to send/receive/notify events from the network
+      // subscribe to the send/receive/notify events from the network that we handle
 
-      this->NetworkReceiveEventSender.insertSubscriber(NetworkReceiveEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onReceive));
-      this->NetworkSendEventSender.insertSubscriber(NetworkSendEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onSend));
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onNotification));
+      this->NetworkReceiveEventSender.insertSubscriber(NetEventDescriptor::NetEventType::DATALINK_FRAME,NetworkReceiveEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onReceive));
+      this->NetworkSendEventSender.insertSubscriber(NetEventDescriptor::NetEventType::IP_TRANSMIT_REQUEST,NetworkSendEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onSend));
+
+      NetworkNotificationEventSourceSlot notificationSlot(NetworkNotificationEventSourceSlot::bind(this,&Ip<TDatalinkLayer,Features...>::onNotification));
+
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::IP_ADDRESS_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::MAC_ADDRESS_ANNOUNCEMENT,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::SUBNET_MASK_ANNOUNCEMENT,notificationSlot);
 
       return true;
     }
@@ -234,7 +239,7 @@ namespace stm32plus {
 
       packet.headerLength=(header->ip_hdr_version & 0x0f)*4;
       packet.header=header;
-      packet.payload=reinterpret_cast<uint8_t *>(((uint32_t)header)+packet.headerLength);
+      packet.payload=reinterpret_cast<uint8_t *>(header)+packet.headerLength;
       packet.payloadLength=NetUtil::ntohs(header->ip_hdr_length)-packet.headerLength;
 
       // if the packet came from ethernet then we notify that there is a potentially
@@ -490,9 +495,14 @@ namespace stm32plus {
       // if the TX payload is in just one of the netbuffer buffers then we can use it
       // without copying it out
 
-      if(txevent.networkBuffer->getInternalBufferSize()!=0 && txevent.networkBuffer->getUserBufferSize()!=0) {
+      NetBuffer& nb(*txevent.networkBuffer);
+
+      if((nb.getSizeFromWritePointerToEnd()!=0 && nb.getSegmentCount()!=0) || nb.getSegmentCount()>1) {
 
-        bufferSize=txevent.networkBuffer->getInternalBufferSize()+txevent.networkBuffer->getUserBufferSize();
+        const NetBufferSegment *seg;
+        uint8_t *ptr;
+
+        bufferSize=nb.getSizeFromWritePointerToEnd()+nb.getUserBufferSize();
         buffer.reset(new uint8_t[bufferSize]);
 
         if(buffer.get()==nullptr) {
@@ -500,27 +510,33 @@ namespace stm32plus {
           return;
         }
 
-        // copy the buffers out to a linear memory space
+        // gather the internal buffer and the segments out to a linear memory space
+
+        ptr=buffer.get();
+        memcpy(ptr,nb.getWritePointer(),nb.getSizeFromWritePointerToEnd());
+        ptr+=nb.getSizeFromWritePointerToEnd();
 
-        memcpy(buffer.get(),txevent.networkBuffer->getInternalBuffer(),txevent.networkBuffer->getInternalBufferSize());
-        memcpy(buffer.get()+txevent.networkBuffer->getInternalBufferSize(),txevent.networkBuffer->getUserBuffer(),txevent.networkBuffer->getUserBufferSize());
+        for(seg=nb.getFirstSegment();seg;seg=seg->getNext()) {
+          memcpy(ptr,seg->getData(),seg->getSize());
+          ptr+=seg->getSize();
+        }
 
         packet.payload=buffer.get();
         packet.payloadLength=bufferSize;
       }
-      else if(txevent.networkBuffer->getUserBufferSize()==0) {
+      else if(nb.getSegmentCount()==0) {
 
         // only internal buffer is present, reference it directly
 
-        packet.payload=reinterpret_cast<uint8_t *>(txevent.networkBuffer->getInternalBuffer());
-        packet.payloadLength=txevent.networkBuffer->getInternalBufferSize();
+        packet.payload=reinterpret_cast<uint8_t *>(nb.getWritePointer());
+        packet.payloadLength=nb.getSizeFromWritePointerToEnd();
       }
       else {
 
-        // only user buffer is present (not likely), reference it directly
+        // only one segment is present (not likely), reference it directly
 
-        packet.payload=(uint8_t *)txevent.networkBuffer->getUserBuffer();
-        packet.payloadLength=txevent.networkBuffer->getUserBufferSize();
+        packet.payload=const_cast<uint8_t *>(nb.getFirstSegment()->getData());
+        packet.payloadLength=nb.getUserBufferSize();
       }
 
       // raise the event
@@ -16,8 +16,8 @@ namespace stm32plus {
      * that contain the input data fragmented into parts small enough to
      * fit into the link layer's max MTU size.
      *
-     * The original netbuffer's data is referenced by pointers in the fragment
-     * buffers so very little additional memory is required. The original netbuffer
+     * The original netbuffer's data is referenced by segment slices in the fragment
+     * buffers so very little additional memory is required and nothing is copied. The original netbuffer
      * is added as a reference to the last fragmentso that any higher layer that
      * is tracking outgoing packets by waiting for a netbuffer they created
      * to be sent will function correctly.
@@ -40,7 +40,7 @@ namespace stm32plus {
          */
 
         struct Parameters {
-          bool ip_checksumOnLargeUdpPackets;      ///< true if we manually calculate checksums on large UDP packets. default is true.
+          bool ip_checksumOnLargeUdpPackets;      ///< true if we manually calculate checksums on large UDP, TCP and ICMP packets. default is true.
 
           /**
            * Constructor
@@ -57,18 +57,11 @@ namespace stm32plus {
         uint16_t _identification;
 
       private:
-        uint32_t fragmentsRequired(uint16_t size);
+        uint32_t fragmentsRequired(uint32_t size);
 
         bool internalCreateFragments(NetBuffer *inputBuffer,
-                                     NetBuffer **&outputBuffers);
-
-        bool createFragmentsFrom(NetBuffer *inputBuffer,
-                                 const void *sourceData,
-                                 uint16_t sourceDataSize,
-                                 NetBuffer **outputBuffers,
-                                 uint16_t firstOutputBuffer,
-                                 bool lastFragmentIsHere,
-                                 uint16_t& offset);
+                                     NetBuffer **outputBuffers,
+                                     uint16_t outputBufferCount);
 
       public:
         bool initialise(const Parameters& params,NetworkUtilityObjects&);
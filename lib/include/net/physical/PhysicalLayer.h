@@ -31,7 +31,8 @@ namespace stm32plus {
 
         struct Parameters : TPhy::Parameters,
                             Features<TPhy>::Parameters...,
-                            NetworkIntervalTicker::Parameters {
+                            NetworkIntervalTicker::Parameters,
+                            NetBufferPool::Parameters {
         };
 
       public:
@@ -54,6 +55,11 @@ namespace stm32plus {
       if(!NetworkIntervalTicker::initialise(params))
         return false;
 
+      // initialise the transmit buffer pool
+
+      if(!NetBufferPool::initialise(params))
+        return false;
+
       // initialise the PHY
 
       if(!TPhy::initialise(params,*this))
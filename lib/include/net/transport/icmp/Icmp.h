@@ -74,7 +74,7 @@ namespace stm32plus {
 
       // subscribe to send events from the stack
 
-      this->NetworkSendEventSender.insertSubscriber(NetworkSendEventSourceSlot::bind(this,&Icmp<TNetworkLayer>::onSend));
+      this->NetworkSendEventSender.insertSubscriber(NetEventDescriptor::NetEventType::ICMP_TRANSMIT_REQUEST,NetworkSendEventSourceSlot::bind(this,&Icmp<TNetworkLayer>::onSend));
 
       return true;
     }
@@ -115,6 +115,14 @@ namespace stm32plus {
                        &icmptre.packet,
                        icmptre.packetSize);
 
+      // the request fails if the packet could not be attached to the buffer
+
+      if(nb==nullptr || !nb->isValid()) {
+        delete nb;
+        icmptre.succeeded=false;
+        return;
+      }
+
       // raise a transmit event for the IP layer to pick up
 
 
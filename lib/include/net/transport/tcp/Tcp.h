@@ -44,6 +44,7 @@ namespace stm32plus {
           uint16_t tcp_msl;                       ///< maximum segment lifetime, in seconds. default is 30
           uint16_t tcp_connectRetryInterval;      ///< the time, in millis to wait for a SYN-ACK before sending another. Default is 4000.
           uint16_t tcp_connectMaxRetries;         ///< number of times to retry a connect if SYN-ACK not received. Default is 5.
+          uint16_t tcp_connectionTableSize;       ///< number of hash buckets used to find connections and servers, rounded up to a power of 2. Default is 16.
 
           /**
            * Constructor
@@ -54,6 +55,7 @@ namespace stm32plus {
             tcp_msl=30;
             tcp_connectRetryInterval=4000;
             tcp_connectMaxRetries=5;
+            tcp_connectionTableSize=16;
           }
         };
 
@@ -67,6 +69,7 @@ namespace stm32plus {
         void onReceive(IpPacketEvent& event);
         void onTick(NetworkIntervalTickData& nitd);
         void handleConnectionReleased(const TcpConnectionReleasedEvent& tcre);
+        void handleFindConnection(TcpFindConnectionNotificationEvent& tfcne);
         bool rejectWithRst(const TcpSegmentEvent& event);
         void handleFinWait1(const TcpHeader& header,TcpConnectionState& rstate);
         void handleFinWait2(const TcpHeader& header,TcpConnectionState& rstate);
@@ -121,9 +124,17 @@ namespace stm32plus {
       _params=params;
       _serverCount=0;
 
-      // subscribe to notify events from the network
+      // create the table that finds the owner of each incoming segment
 
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Tcp<TNetworkLayer>::onNotification));
+      tcpConnectionTable.initialise(params.tcp_connectionTableSize);
+
+      // subscribe to the notify events from the network that we handle
+
+      NetworkNotificationEventSourceSlot notificationSlot(NetworkNotificationEventSourceSlot::bind(this,&Tcp<TNetworkLayer>::onNotification));
+
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_SERVER_RELEASED,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED,notificationSlot);
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_FIND_CONNECTION,notificationSlot);
 
       // subscribe to packet events from the IP module
 
@@ -172,8 +183,6 @@ namespace stm32plus {
       uint8_t *data=ipe.ipPacket.payload+header->getDataOffset();
       uint16_t datalen=ipe.ipPacket.payloadLength-header->getHeaderSize();
 
-      // send the event
-
       TcpSegmentEvent event(ipe.ipPacket,
                              *header,
                              data,
@@ -181,7 +190,22 @@ namespace stm32plus {
                              NetUtil::ntohs(header->tcp_sourcePort),
                              NetUtil::ntohs(header->tcp_destinationPort));
 
-      TcpReceiveEventSender.raiseEvent(event);
+      // look up the connection that owns it. failing that a SYN may be for a listening server
+
+      const TcpConnectionTable::Entry *entry;
+
+      entry=tcpConnectionTable.findConnection(ipe.ipPacket.header->ip_sourceAddress,event.sourcePort,event.destinationPort);
+
+      if(entry==nullptr && header->hasSyn() && !header->hasAck())
+        entry=tcpConnectionTable.findListener(event.destinationPort);
+
+      if(entry!=nullptr)
+        entry->handler(event);
+
+      // anything not claimed is offered to other subscribers
+
+      if(!event.handled)
+        TcpReceiveEventSender.raiseEvent(event);
 
       // if a connection or server handled it then we don't need to go further
 
@@ -327,6 +351,23 @@ namespace stm32plus {
       }
       else if(ned.eventType==NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED)
         handleConnectionReleased(static_cast<TcpConnectionReleasedEvent&>(ned));
+      else if(ned.eventType==NetEventDescriptor::NetEventType::TCP_FIND_CONNECTION)
+        handleFindConnection(static_cast<TcpFindConnectionNotificationEvent&>(ned));
+    }
+
+
+    /**
+     * Answer a request to find a connection from the connection table
+     * @param tfcne The find connection event
+     */
+
+    template<class TNetworkLayer>
+    inline void Tcp<TNetworkLayer>::handleFindConnection(TcpFindConnectionNotificationEvent& tfcne) {
+
+      const TcpConnectionTable::Entry *entry;
+
+      if((entry=tcpConnectionTable.findConnection(tfcne.remoteAddress,tfcne.remotePort,tfcne.localPort))!=nullptr)
+        tfcne.tcpConnection=entry->connection;
     }
 
 
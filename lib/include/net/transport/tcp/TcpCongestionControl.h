@@ -0,0 +1,219 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+
+    /**
+     * Congestion control for the sender side of a connection. This implements slow start and
+     * congestion avoidance from RFC5681 with the NewReno modification to fast recovery from
+     * RFC6582. The congestion window is in bytes. The ACK handling methods are called from
+     * the receive IRQ and return true when the segment at sendUnacknowledged should be
+     * retransmitted immediately.
+     */
+
+    class TcpCongestionControl {
+
+      protected:
+        uint32_t _congestionWindow;
+        uint32_t _slowStartThreshold;
+        uint32_t _recover;
+        uint16_t _mss;
+        uint8_t _duplicateAcks;
+        bool _inRecovery;
+
+      public:
+        void initialise(uint16_t mss,uint32_t sendNext);
+
+        bool newAck(uint32_t ackNumber,uint32_t bytesAcked,uint32_t flightSize);
+        bool duplicateAck(uint32_t flightSize,uint32_t sendMaximum);
+        void timeout(uint32_t flightSize,uint32_t sendMaximum);
+        void restart();
+
+        uint32_t getCongestionWindow() const;
+        uint32_t getSlowStartThreshold() const;
+        bool isInRecovery() const;
+
+      protected:
+        uint32_t getInitialWindow() const;
+        void reduceThreshold(uint32_t flightSize);
+    };
+
+
+    /**
+     * Initialise the state when the connection is established and the remote MSS is known
+     * @param mss The sender maximum segment size
+     * @param sendNext The current send sequence number
+     */
+
+    inline void TcpCongestionControl::initialise(uint16_t mss,uint32_t sendNext) {
+
+      _mss=mss;
+      _congestionWindow=getInitialWindow();
+      _slowStartThreshold=UINT16_MAX;         // the largest window that can be advertised
+      _recover=sendNext;
+      _duplicateAcks=0;
+      _inRecovery=false;
+    }
+
+
+    /**
+     * An ACK arrived that moved sendUnacknowledged forward. This is IRQ code.
+     * @param ackNumber The new sendUnacknowledged
+     * @param bytesAcked The number of bytes newly acknowledged
+     * @param flightSize The number of bytes still outstanding after this ACK
+     * @return true if this was a partial ACK during recovery and the next segment must be resent
+     */
+
+    inline bool TcpCongestionControl::newAck(uint32_t ackNumber,uint32_t bytesAcked,uint32_t flightSize) {
+
+      _duplicateAcks=0;
+
+      if(_inRecovery) {
+
+        // a full ACK ends recovery with the window deflated
+
+        if(static_cast<int32_t>(ackNumber-_recover)>=0) {
+          _congestionWindow=std::min(_slowStartThreshold,flightSize+_mss);
+          _inRecovery=false;
+          return false;
+        }
+
+        // a partial ACK means the next hole must be filled now. deflate by the amount acked
+        // and add back a segment for the retransmission
+
+        _congestionWindow-=std::min(_congestionWindow,bytesAcked);
+        if(bytesAcked>=_mss)
+          _congestionWindow+=_mss;
+
+        return true;
+      }
+
+      // slow start grows by up to a segment per ACK, congestion avoidance by about a segment per RTT
+
+      if(_congestionWindow<_slowStartThreshold)
+        _congestionWindow+=std::min(bytesAcked,static_cast<uint32_t>(_mss));
+      else
+        _congestionWindow+=std::max<uint32_t>(1,(_mss*_mss)/_congestionWindow);
+
+      return false;
+    }
+
+
+    /**
+     * A duplicate ACK arrived while data is outstanding. The third one triggers fast retransmit.
+     * Further duplicates inflate the window during fast recovery. This is IRQ code.
+     * @param flightSize The number of bytes outstanding
+     * @param sendMaximum The highest sequence number sent so far
+     * @return true if the segment at sendUnacknowledged must be retransmitted now
+     */
+
+    inline bool TcpCongestionControl::duplicateAck(uint32_t flightSize,uint32_t sendMaximum) {
+
+      if(_inRecovery) {
+        _congestionWindow+=_mss;
+        return false;
+      }
+
+      if(++_duplicateAcks!=3)
+        return false;
+
+      reduceThreshold(flightSize);
+
+      _congestionWindow=_slowStartThreshold+3*_mss;
+      _recover=sendMaximum;
+      _inRecovery=true;
+
+      return true;
+    }
+
+
+    /**
+     * The retransmission timer expired. Go back to slow start from one segment.
+     * @param flightSize The number of bytes outstanding
+     * @param sendMaximum The highest sequence number sent so far
+     */
+
+    inline void TcpCongestionControl::timeout(uint32_t flightSize,uint32_t sendMaximum) {
+
+      reduceThreshold(flightSize);
+
+      _congestionWindow=_mss;
+      _recover=sendMaximum;
+      _duplicateAcks=0;
+      _inRecovery=false;
+    }
+
+
+    /**
+     * The connection has been idle for longer than the resend delay so the network state
+     * that the window was based on is stale. Restart from the initial window (RFC5681 4.1).
+     */
+
+    inline void TcpCongestionControl::restart() {
+      _congestionWindow=std::min(_congestionWindow,getInitialWindow());
+    }
+
+
+    /**
+     * Get the congestion window
+     * @return The window in bytes
+     */
+
+    inline uint32_t TcpCongestionControl::getCongestionWindow() const {
+      return _congestionWindow;
+    }
+
+
+    /**
+     * Get the slow start threshold
+     * @return The threshold in bytes
+     */
+
+    inline uint32_t TcpCongestionControl::getSlowStartThreshold() const {
+      return _slowStartThreshold;
+    }
+
+
+    /**
+     * Return true if fast recovery is in progress
+     * @return true if in recovery
+     */
+
+    inline bool TcpCongestionControl::isInRecovery() const {
+      return _inRecovery;
+    }
+
+
+    /*
+     * The initial window from RFC5681 3.1
+     */
+
+    inline uint32_t TcpCongestionControl::getInitialWindow() const {
+
+      if(_mss>2190)
+        return 2*_mss;
+
+      if(_mss>1095)
+        return 3*_mss;
+
+      return 4*_mss;
+    }
+
+
+    /*
+     * Halve the amount in flight for the new threshold (RFC5681 equation 4)
+     */
+
+    inline void TcpCongestionControl::reduceThreshold(uint32_t flightSize) {
+      _slowStartThreshold=std::max(flightSize/2,2*static_cast<uint32_t>(_mss));
+    }
+  }
+}
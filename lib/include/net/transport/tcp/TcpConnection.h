@@ -31,7 +31,8 @@ namespace stm32plus {
       enum {
         E_TIMED_OUT = 1,
         E_INVALID_STATE,        ///< you tried to do something when the connection is not in a state that would allow it
-        E_CONNECTION_RESET      ///< connection was closed while we were sending data
+        E_CONNECTION_RESET,     ///< connection was closed while we were sending data
+        E_OUT_OF_MEMORY         ///< a buffer could not be allocated for a segment
       };
 
 
@@ -41,9 +42,12 @@ namespace stm32plus {
 
       struct Parameters {
 
-        uint16_t tcp_receiveBufferSize;     ///< per-connection receive buffer size. Default is 256 bytes.
-        uint32_t tcp_initialResendDelay;    ///< first delay to resend an un-acked segment. Default is 4 seconds.
+        uint16_t tcp_receiveBufferSize;     ///< per-connection receive buffer size, rounded up to a power of 2 with a maximum of 32768. Default is 256 bytes.
+        uint32_t tcp_initialResendDelay;    ///< delay to resend an un-acked segment before the round trip time is known. Default is 4 seconds.
+        uint32_t tcp_minResendDelay;        ///< lower bound on the resend delay calculated from the round trip time. Default is 200ms.
         uint32_t tcp_maxResendDelay;        ///< the resend delay exponential backoff is capped at this value. default is 60 (1 minute)
+        uint8_t tcp_reassemblyIntervals;    ///< number of disjoint ranges of out of order data that can be held for reassembly. Zero drops out of order segments. Default is 4.
+        bool tcp_selectiveAck;              ///< if true, negotiate SACK and report out of order data held for reassembly in our ACKs. Default is true.
         bool tcp_push;                      ///< if true, set the PSH flag in sent segments. Default is false.
         bool tcp_nagleAvoidance;            ///< if true, single packet sends are broken into 2 to force the receiver's Nagle algorithm to generate an ACK without delay. Default is true.
 
@@ -55,6 +59,9 @@ namespace stm32plus {
           tcp_receiveBufferSize=256;
           tcp_maxResendDelay=60000;
           tcp_initialResendDelay=4000;
+          tcp_minResendDelay=200;
+          tcp_reassemblyIntervals=4;
+          tcp_selectiveAck=true;
           tcp_nagleAvoidance=true;
           tcp_push=false;
         }
@@ -63,36 +70,50 @@ namespace stm32plus {
       protected:
         NetworkUtilityObjects *_networkUtilityObjects;
         TcpEvents *_tcpEvents;
+        TcpConnectionTable::Entry _tableEntry;      // our entry in the connection table
 
         TcpReceiveBuffer *_receiveBuffer;
+        TcpReassemblyQueue _reassemblyQueue;
         uint16_t _remoteMss;
         uint16_t _segmentSizeLimit;
         uint16_t _additionalHeaderSize;
-        uint32_t _lastZeroWindowPollTime;
-        uint32_t _zeroWindowPollDelay;
         uint32_t _lastActiveTime;                   // from the millisecond timer
+        uint32_t _lastTransmitTime;                 // from the millisecond timer
+        uint32_t _idleTimeout;                      // overrides the TcpConnectionArray idle timeout if not zero
+        volatile uint32_t _resendTimerStart;        // restarted when an ACK moves the window
+        volatile bool _resendNow;                   // set by the IRQ for fast retransmit
+        TcpResendDelayCalculator _resendDelay;
+        TcpCongestionControl _congestionControl;
         TcpConnectionState _state;
         const Parameters& _params;
         bool _receiveWindowIsClosed;
+        bool _sackPermitted;                        // both ends sent SACK-permitted
 
       protected:
-        void onNotification(NetEventDescriptor& ned);
         void onReceive(TcpSegmentEvent& event);
 
         void handleIncomingSynAck(const TcpHeader& header);
         void handleIncomingAck(const TcpHeader& header,bool hasData);
+        void handleDuplicateAck(const TcpHeader& header,bool hasData);
         void handleIncomingFin(TcpSegmentEvent& event);
         void handleIncomingRst();
         void handleIncomingData(const TcpSegmentEvent& event);
+        void handleRemoteOptions(const TcpHeader& header);
 
         void initialise(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort);
-        void handleFindConnectionEvent(TcpFindConnectionNotificationEvent& tfcne);
 
         bool sendSynAck();
+        bool sendAck();
+        static uint16_t getSynOptionsSize(bool sackPermitted);
+        uint16_t writeSynOptions(NetBuffer *nb,bool sackPermitted) const;
+        bool sendSegment(const uint8_t *data,uint32_t sequenceNumber,uint16_t size,TcpHeaderFlags flags);
+        void resendTimeout();
+        void abandonUnacknowledged(uint32_t startseq,uint32_t& actuallySent);
 
         uint16_t getReceiveBufferSpaceAvailable() const;
         uint16_t sillyWindowAvoidance();
         bool receiveWindowCanBeOpened() const;
+        void receiveBufferConsumed();
 
       public:
         TcpConnection(const Parameters& params);
@@ -119,6 +140,8 @@ namespace stm32plus {
         const TcpConnectionState& getConnectionState() const;
 
         bool receive(void *data,uint32_t dataSize,uint32_t& actuallyReceived,uint32_t timeoutMillis=0);
+        uint32_t peekReceive(const uint8_t *& data) const;
+        void commitReceive(uint32_t size);
         bool send(const void *data,uint32_t dataSize,uint32_t& actuallySent,uint32_t timeoutMillis=0);
         bool abort();
 
@@ -127,9 +150,14 @@ namespace stm32plus {
         bool waitForStateChange(TcpState oldState,uint32_t timeoutMillis) const;
 
         uint16_t getTransmitWindowSize() const;
+        const TcpCongestionControl& getCongestionControl() const;
+        const TcpResendDelayCalculator& getResendDelayCalculator() const;
+        const TcpReassemblyStatistics& getReassemblyStatistics() const;
         uint16_t getDataAvailable() const;
 
         uint32_t getLastActiveTime() const;
+        uint32_t getIdleTimeout() const;
+        void setIdleTimeout(uint32_t idleTimeout);
 
         DECLARE_EVENT_SOURCE(TcpConnectionClosed);
         DECLARE_EVENT_SOURCE(TcpConnectionDataReady);
@@ -151,21 +179,8 @@ namespace stm32plus {
      */
 
     inline TcpConnection::TcpConnection(const Parameters& params)
-      : _params(params) {
-    }
-
-
-    /**
-     * Handle an event that's searching for a connection
-     * @param tfcne The event descriptor
-     */
-
-    inline void TcpConnection::handleFindConnectionEvent(TcpFindConnectionNotificationEvent& tfcne) {
-
-      if(tfcne.localPort==_state.localPort &&
-         tfcne.remotePort==_state.remotePort &&
-         tfcne.remoteAddress==_state.remoteAddress)
-        tfcne.tcpConnection=this;
+      : _idleTimeout(0),
+        _params(params) {
     }
 
 
@@ -252,10 +267,42 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the congestion control state. The congestion window limits how much data we will
+     * have in flight in addition to the transmit window advertised by the remote end.
+     * @return The congestion control state
+     */
+
+    inline const TcpCongestionControl& TcpConnection::getCongestionControl() const {
+      return _congestionControl;
+    }
+
+
+    /**
+     * Get the resend delay calculator, which knows the smoothed round trip time
+     * @return The resend delay calculator
+     */
+
+    inline const TcpResendDelayCalculator& TcpConnection::getResendDelayCalculator() const {
+      return _resendDelay;
+    }
+
+
+    /**
+     * Get the statistics for out of order data held for reassembly. The maximum depth shows
+     * how far the network is reordering segments.
+     * @return The reassembly statistics
+     */
+
+    inline const TcpReassemblyStatistics& TcpConnection::getReassemblyStatistics() const {
+      return _reassemblyQueue.getStatistics();
+    }
+
+
     /**
      * Get the amount of data available for reading without blocking. The maximum
      * amount that can ever be returned by this function is the value that you specified in the
-     * tcp_receiveBufferSize configuration parameter.
+     * tcp_receiveBufferSize configuration parameter rounded up to a power of 2.
      */
 
     inline uint16_t TcpConnection::getDataAvailable() const {
@@ -263,6 +310,19 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Look at received data in place without copying it out. The data stays in the receive
+     * buffer until commitReceive() is called. Only the part up to where the circular buffer
+     * wraps is returned, call again after committing to get the rest. This does not block.
+     * @param[out] data Where the data starts
+     * @return The number of bytes that can be read from data, zero if there are none
+     */
+
+    inline uint32_t TcpConnection::peekReceive(const uint8_t *& data) const {
+      return _receiveBuffer->peekRead(data);
+    }
+
+
     /**
      * Try to abort this connection by sending an RST to the other end.
      * @return true if it was in an abortable state and an RST has been sent
@@ -315,13 +375,35 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get the idle timeout for this connection
+     * @return The timeout in millis, or zero if the TcpConnectionArray's timeout applies
+     */
+
+    inline uint32_t TcpConnection::getIdleTimeout() const {
+      return _idleTimeout;
+    }
+
+
+    /**
+     * Set the idle timeout for this connection. A TcpConnectionArray will close the connection if it's
+     * not active for this long. It can be changed at any time to suit what the connection is doing,
+     * for example an HTTP server waiting for the next request on a persistent connection.
+     * @param idleTimeout The timeout in millis, or zero to use the TcpConnectionArray's timeout
+     */
+
+    inline void TcpConnection::setIdleTimeout(uint32_t idleTimeout) {
+      _idleTimeout=idleTimeout;
+    }
+
+
     /**
      * Return true if the receive window advertised in an ACK can be opened
      * @return true if the current receive window can be advertised
      */
 
     inline bool TcpConnection::receiveWindowCanBeOpened() const {
-      return _state.rxWindow.receiveWindow>=std::min(_params.tcp_receiveBufferSize/2,(int)_segmentSizeLimit);
+      return _state.rxWindow.receiveWindow>=std::min(_receiveBuffer->getCapacity()/2,static_cast<uint32_t>(_segmentSizeLimit));
     }
 
 
@@ -120,8 +120,10 @@ namespace stm32plus {
 
       // subscribe to network notification events so we know when a TCP server or connection is released
 
-      _networkUtilityObjects.NetworkNotificationEventSender.insertSubscriber(
-          NetworkNotificationEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onNotification));
+      NetworkNotificationEventSourceSlot slot(NetworkNotificationEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onNotification));
+
+      _networkUtilityObjects.NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_SERVER_RELEASED,slot);
+      _networkUtilityObjects.NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED,slot);
     }
 
 
@@ -139,8 +141,10 @@ namespace stm32plus {
 
       // unsubscribe from notification events
 
-      _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(
-          NetworkNotificationEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onNotification));
+      NetworkNotificationEventSourceSlot slot(NetworkNotificationEventSourceSlot::bind(this,&TcpConnectionArray<TConnection>::onNotification));
+
+      _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(NetEventDescriptor::NetEventType::TCP_SERVER_RELEASED,slot);
+      _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED,slot);
 
       // release the connections
 
@@ -346,7 +350,7 @@ namespace stm32plus {
                                                       TcpWaitState *outputState) {
 
 
-      uint32_t now;
+      uint32_t now,idleTimeout;
       TConnection *conn;
 
       // get the current time
@@ -400,9 +404,11 @@ namespace stm32plus {
             return handleFail(conn,TcpWaitState::WRITE,outputConnection,outputState);
         }
 
-        // has the connection timed out?
+        // has the connection timed out? the connection's own timeout takes precedence over ours
 
-        if(_idleTimeout && (conn=_connections[_index])!=nullptr && MillisecondTimer::hasTimedOut(conn->getLastActiveTime(),_idleTimeout)) {
+        if((conn=_connections[_index])!=nullptr &&
+           (idleTimeout=conn->getIdleTimeout() ? conn->getIdleTimeout() : _idleTimeout)!=0 &&
+           MillisecondTimer::hasTimedOut(conn->getLastActiveTime(),idleTimeout)) {
 
           // we'll get a callback via our connection-released notification subscription
           // and we'll remove it from the array automatically
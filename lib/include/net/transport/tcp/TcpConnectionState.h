@@ -69,11 +69,16 @@ namespace stm32plus {
        * (re)send the current ACK
        * @param netutils The network utils
        * @param windowSize the current receive window size
+       * @param sackBlocks SACK blocks to send as an option, or nullptr
+       * @param sackBlockCount The number of SACK blocks
        * @return true if it was sent
        */
 
-      bool sendAck(NetworkUtilityObjects& netutils,uint16_t windowSize) {
-        return sendHeaderOnly(netutils,TcpHeaderFlags::ACK,windowSize);
+      bool sendAck(NetworkUtilityObjects& netutils,
+                   uint16_t windowSize,
+                   const TcpSackBlock *sackBlocks=nullptr,
+                   uint8_t sackBlockCount=0) {
+        return sendHeaderOnly(netutils,TcpHeaderFlags::ACK,windowSize,sackBlocks,sackBlockCount);
       }
 
 
@@ -108,16 +113,38 @@ namespace stm32plus {
        * @param netutils The network utils
        * @param windowSize the current receive window size
        * @param flags The flags to set in the header
+       * @param sackBlocks SACK blocks to send as an option, or nullptr
+       * @param sackBlockCount The number of SACK blocks
        * @return true if it was sent
        */
 
       bool sendHeaderOnly(NetworkUtilityObjects& netutils,
                           TcpHeaderFlags flags,
-                          uint16_t windowSize) {
+                          uint16_t windowSize,
+                          const TcpSackBlock *sackBlocks=nullptr,
+                          uint8_t sackBlockCount=0) {
 
-        // create a NetBuffer to hold the RST segment
+        uint16_t optionsSize;
 
-        NetBuffer *nb=new NetBuffer(additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),0);
+        // the SACK option is preceded by two NOPs to keep the blocks word aligned
+
+        optionsSize=sackBlockCount ? 2+TcpOptionSack::getSize(sackBlockCount) : 0;
+
+        // create a NetBuffer to hold the segment
+
+        NetBuffer *nb=new NetBuffer(additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),optionsSize);
+
+        if(optionsSize) {
+
+          uint8_t *options=reinterpret_cast<uint8_t *>(nb->moveWritePointerBack(optionsSize));
+
+          reinterpret_cast<TcpOptionNop *>(options)->initialise();
+          reinterpret_cast<TcpOptionNop *>(options+1)->initialise();
+
+          TcpOptionSack *sack=reinterpret_cast<TcpOptionSack *>(options+2);
+          sack->initialise(sackBlockCount);
+          memcpy(sack->tcp_blocks,sackBlocks,sackBlockCount*sizeof(TcpSackBlock));
+        }
 
         // construct the header
 
@@ -130,6 +157,9 @@ namespace stm32plus {
                            windowSize,                  // data space available
                            flags);
 
+        if(optionsSize)
+          header->setSize(TcpHeader::getNoOptionsHeaderSize()+optionsSize);
+
         // ask the IP layer to send the packet
 
         IpTransmitRequestEvent iptre(
@@ -0,0 +1,244 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    DECLARE_EVENT_SIGNATURE(TcpReceive,void (TcpSegmentEvent&));
+
+    class TcpConnection;
+
+
+    /**
+     * Table used by the TCP module to send each incoming segment straight to the connection or
+     * server that owns it instead of offering it to every one of them in turn. Connections are
+     * keyed on the remote address, remote port and local port and servers on their listening
+     * port. Both are hashed into a power of 2 number of buckets so a lookup costs a hash and a
+     * short chain walk however many connections are open.
+     *
+     * The entries are owned by the connections and servers so there is no allocation here.
+     * Entries are added and removed under IRQ suspension because the lookups are done in the
+     * IRQ context of the receive path.
+     */
+
+    class TcpConnectionTable {
+
+      public:
+
+        /**
+         * An entry in the table. The owner fills in the key and handler before adding it and must
+         * remove it before it goes away.
+         */
+
+        struct Entry {
+          IpAddress remoteAddress;                ///< not used for listeners
+          uint16_t remotePort;                    ///< not used for listeners
+          uint16_t localPort;                     ///< the local or listening port
+          TcpConnection *connection;              ///< the connection, nullptr for listeners
+          TcpReceiveEventSourceSlot handler;      ///< receives the segments
+          Entry *next;                            ///< next in the bucket chain
+        };
+
+      protected:
+        scoped_array<Entry *> _connections;
+        scoped_array<Entry *> _listeners;
+        uint16_t _mask;
+
+      protected:
+        uint16_t getConnectionBucket(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort) const;
+        uint16_t getListenerBucket(uint16_t localPort) const;
+        static void insert(Entry *& head,Entry& entry);
+        static void remove(Entry *& head,Entry& entry);
+
+      public:
+        TcpConnectionTable();
+
+        void initialise(uint16_t bucketCount);
+
+        void addConnection(Entry& entry);
+        void removeConnection(Entry& entry);
+        void addListener(Entry& entry);
+        void removeListener(Entry& entry);
+
+        const Entry *findConnection(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort) const;
+        const Entry *findListener(uint16_t localPort) const;
+    };
+
+
+    /**
+     * Constructor
+     */
+
+    inline TcpConnectionTable::TcpConnectionTable()
+      : _mask(0) {
+    }
+
+
+    /**
+     * Allocate the buckets. This must be done before any connection or server is created.
+     * @param bucketCount The number of buckets in each of the connection and listener tables.
+     *   Rounded up to a power of 2.
+     */
+
+    inline void TcpConnectionTable::initialise(uint16_t bucketCount) {
+
+      uint16_t i,size;
+
+      for(size=1;size<bucketCount;size<<=1);
+
+      _connections.reset(new Entry *[size]);
+      _listeners.reset(new Entry *[size]);
+
+      for(i=0;i<size;i++)
+        _connections[i]=_listeners[i]=nullptr;
+
+      _mask=size-1;
+    }
+
+
+    /**
+     * Add a connection to the table
+     * @param entry The connection's entry with the key and handler filled in
+     */
+
+    inline void TcpConnectionTable::addConnection(Entry& entry) {
+      insert(_connections[getConnectionBucket(entry.remoteAddress,entry.remotePort,entry.localPort)],entry);
+    }
+
+
+    /**
+     * Remove a connection from the table. It's not an error if it's not there.
+     * @param entry The entry that was added
+     */
+
+    inline void TcpConnectionTable::removeConnection(Entry& entry) {
+      remove(_connections[getConnectionBucket(entry.remoteAddress,entry.remotePort,entry.localPort)],entry);
+    }
+
+
+    /**
+     * Add a listening server to the table
+     * @param entry The server's entry with the local port and handler filled in
+     */
+
+    inline void TcpConnectionTable::addListener(Entry& entry) {
+      insert(_listeners[getListenerBucket(entry.localPort)],entry);
+    }
+
+
+    /**
+     * Remove a listening server from the table. It's not an error if it's not there.
+     * @param entry The entry that was added
+     */
+
+    inline void TcpConnectionTable::removeListener(Entry& entry) {
+      remove(_listeners[getListenerBucket(entry.localPort)],entry);
+    }
+
+
+    /**
+     * Find the connection that owns a segment. This is IRQ code.
+     * @param remoteAddress The address that the segment came from
+     * @param remotePort The port that the segment came from
+     * @param localPort The port that the segment was sent to
+     * @return The connection's entry or nullptr if there isn't one
+     */
+
+    inline const TcpConnectionTable::Entry *TcpConnectionTable::findConnection(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort) const {
+
+      const Entry *entry;
+
+      for(entry=_connections[getConnectionBucket(remoteAddress,remotePort,localPort)];entry;entry=entry->next)
+        if(entry->localPort==localPort && entry->remotePort==remotePort && entry->remoteAddress==remoteAddress)
+          return entry;
+
+      return nullptr;
+    }
+
+
+    /**
+     * Find the server listening on a port. This is IRQ code.
+     * @param localPort The port that the segment was sent to
+     * @return The server's entry or nullptr if there isn't one
+     */
+
+    inline const TcpConnectionTable::Entry *TcpConnectionTable::findListener(uint16_t localPort) const {
+
+      const Entry *entry;
+
+      for(entry=_listeners[getListenerBucket(localPort)];entry;entry=entry->next)
+        if(entry->localPort==localPort)
+          return entry;
+
+      return nullptr;
+    }
+
+
+    /*
+     * Hash the connection key. The address is in network order so its last octet, which varies
+     * the most on a local network, is in the top byte alongside the remote port. The fold brings
+     * it down and the multiply mixes every bit into the top half, which is where the bucket
+     * comes from. An xor fold alone isn't enough because clients that step their address and
+     * their port together would cancel out into a handful of buckets.
+     */
+
+    inline uint16_t TcpConnectionTable::getConnectionBucket(const IpAddress& remoteAddress,uint16_t remotePort,uint16_t localPort) const {
+
+      uint32_t hash;
+
+      hash=remoteAddress.ipAddress ^ ((static_cast<uint32_t>(remotePort) << 16) | localPort);
+      hash^=hash >> 16;
+      hash*=0x9e3779b1;
+
+      return (hash >> 16) & _mask;
+    }
+
+
+    /*
+     * Hash a listening port
+     */
+
+    inline uint16_t TcpConnectionTable::getListenerBucket(uint16_t localPort) const {
+      return (localPort ^ (localPort >> 8)) & _mask;
+    }
+
+
+    /*
+     * Link an entry into the head of a chain
+     */
+
+    inline void TcpConnectionTable::insert(Entry *& head,Entry& entry) {
+
+      IrqSuspend suspender;
+
+      entry.next=head;
+      head=&entry;
+    }
+
+
+    /*
+     * Unlink an entry from a chain
+     */
+
+    inline void TcpConnectionTable::remove(Entry *& head,Entry& entry) {
+
+      Entry **link;
+
+      IrqSuspend suspender;
+
+      for(link=&head;*link;link=&(*link)->next) {
+
+        if(*link==&entry) {
+          *link=entry.next;
+          return;
+        }
+      }
+    }
+  }
+}
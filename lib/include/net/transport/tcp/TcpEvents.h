@@ -12,13 +12,16 @@ namespace stm32plus {
 
 
     /**
-     * Base class for Tcp that declares the events. Lifting this up gets us out of the trap
-     * of circular dependencies.
+     * Base class for Tcp that declares the events and the table used to find the connection or
+     * server that owns an incoming segment. Lifting this up gets us out of the trap of circular
+     * dependencies.
+     *
+     * Segments that are not claimed through the table are raised as TcpReceive events for any
+     * other subscribers.
      */
 
-    DECLARE_EVENT_SIGNATURE(TcpReceive,void (TcpSegmentEvent&));
-
     struct TcpEvents {
+      TcpConnectionTable tcpConnectionTable;
       DECLARE_EVENT_SOURCE(TcpReceive);
     };
   }
@@ -18,7 +18,9 @@ namespace stm32plus {
     enum class TcpOptionKind : uint8_t {
       END_OF_OPTIONS       = 0x00,                      ///< no more options in the header
       NOP                  = 0x01,                      ///< padding option
-      MAXIMUM_SEGMENT_SIZE = 0x02                       ///< MSS
+      MAXIMUM_SEGMENT_SIZE = 0x02,                      ///< MSS
+      SACK_PERMITTED       = 0x04,                      ///< selective acknowledgement permitted (SYN only)
+      SACK                 = 0x05                       ///< selective acknowledgement blocks
     };
 
 
@@ -106,5 +108,65 @@ namespace stm32plus {
         return TcpOptionKind::MAXIMUM_SEGMENT_SIZE;
       }
     } __attribute__((packed));
+  
+
+    /**
+     * SACK permitted. Sent in a SYN to say that we can handle the SACK option. Both ends must
+     * send it for SACK to be used on the connection (RFC2018).
+     */
+
+    struct TcpOptionSackPermitted : TcpVariableLengthOption {
+
+      void initialise() {
+        TcpVariableLengthOption::initialise(TcpOptionKind::SACK_PERMITTED,2);
+      }
+
+      constexpr static uint16_t getSize() {
+        return 2;
+      }
+
+      constexpr static TcpOptionKind getOptionKind() {
+        return TcpOptionKind::SACK_PERMITTED;
+      }
+    } __attribute__((packed));
+
+
+    /**
+     * A block of received data that's not contiguous with the acknowledgement number. The
+     * edges are in network byte order and the right edge is the sequence number just after
+     * the block.
+     */
+
+    struct TcpSackBlock {
+      uint32_t tcp_leftEdge;
+      uint32_t tcp_rightEdge;
+    } __attribute__((packed));
+
+
+    /**
+     * SACK. A variable number of blocks follow the length. Only as many blocks as were given
+     * to initialise() are present in the header.
+     */
+
+    struct TcpOptionSack : TcpVariableLengthOption {
+
+      enum {
+        MAX_BLOCKS = 4                  ///< the most that will fit in the options space
+      };
+
+      TcpSackBlock tcp_blocks[MAX_BLOCKS];
+
+      void initialise(uint8_t blockCount) {
+        TcpVariableLengthOption::initialise(TcpOptionKind::SACK,getSize(blockCount));
+      }
+
+      constexpr static uint16_t getSize(uint8_t blockCount) {
+        return 2+blockCount*sizeof(TcpSackBlock);
+      }
+
+      constexpr static TcpOptionKind getOptionKind() {
+        return TcpOptionKind::SACK;
+      }
+    } __attribute__((packed));
   }
 }
@@ -0,0 +1,325 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /**
+     * Statistics maintained by the reassembly queue. The depth is the distance from the
+     * next expected sequence number to the end of the furthest data held out of order, which
+     * is how far the network has reordered the stream.
+     */
+
+    struct TcpReassemblyStatistics {
+      uint32_t outOfOrderSegments;        ///< segments that arrived ahead of a hole
+      uint32_t duplicateSegments;         ///< out of order segments that we already had
+      uint32_t droppedSegments;           ///< out of order segments dropped for lack of intervals
+      uint32_t holesFilled;               ///< times that queued data became contiguous
+      uint32_t maxDepth;                  ///< the greatest reordering depth seen, in bytes
+      uint8_t maxIntervals;               ///< the greatest number of intervals in use at once
+    };
+
+
+    /**
+     * Bookkeeping for data received out of order. The data itself is stored in the receive
+     * buffer's free space at its offset from receiveNext. This class only remembers which
+     * ranges of sequence numbers are held there as a sorted list of disjoint intervals taken
+     * from a pool allocated at initialisation.
+     *
+     * When a segment fills the hole at receiveNext the intervals that have become contiguous
+     * are removed and receiveNext jumps to the end of them. The intervals are also the
+     * source of the SACK blocks sent in our ACKs with the most recently changed one first as
+     * RFC2018 requires. All methods except initialise() are IRQ code.
+     */
+
+    class TcpReassemblyQueue {
+
+      protected:
+
+        enum {
+          NO_ENTRY = 0xff                 ///< used as a next marker to say 'none'
+        };
+
+        struct Interval {
+          uint32_t start;                 ///< first sequence number held
+          uint32_t end;                   ///< sequence number just after the last one held
+          uint8_t next;                   ///< next interval in sequence order (or NO_ENTRY)
+        };
+
+        scoped_array<Interval> _intervals;
+        uint8_t _first;                   ///< lowest interval (or NO_ENTRY if empty)
+        uint8_t _free;                    ///< first free interval (or NO_ENTRY if all used)
+        uint8_t _mostRecent;              ///< last interval changed by insert (or NO_ENTRY)
+        uint8_t _count;                   ///< number of intervals in use
+
+        TcpReassemblyStatistics _statistics;
+
+      protected:
+        void remove(uint8_t index,uint8_t previous);
+
+        static bool before(uint32_t a,uint32_t b);
+
+      public:
+        bool initialise(uint8_t maxIntervals);
+
+        bool insert(uint32_t receiveNext,uint32_t start,uint32_t end);
+        uint32_t advance(uint32_t receiveNext);
+        bool isEmpty() const;
+
+        uint8_t getSackBlocks(TcpSackBlock *blocks,uint8_t maxBlocks) const;
+
+        const TcpReassemblyStatistics& getStatistics() const;
+        void resetStatistics();
+    };
+
+
+    /**
+     * Initialise the queue. Zero intervals disables reassembly and every out of order
+     * segment will be dropped.
+     * @param maxIntervals The most disjoint ranges that can be held. The limit is 254.
+     * @return true if it worked
+     */
+
+    inline bool TcpReassemblyQueue::initialise(uint8_t maxIntervals) {
+
+      uint8_t i;
+
+      if(maxIntervals>=NO_ENTRY)
+        maxIntervals=NO_ENTRY-1;
+
+      if(maxIntervals) {
+
+        _intervals.reset(new Interval[maxIntervals]);
+
+        if(_intervals.get()==nullptr)
+          return false;
+
+        // all intervals start on the free list
+
+        for(i=0;i<maxIntervals;i++)
+          _intervals[i].next=i+1<maxIntervals ? i+1 : NO_ENTRY;
+      }
+
+      _first=_mostRecent=NO_ENTRY;
+      _free=maxIntervals ? 0 : NO_ENTRY;
+      _count=0;
+
+      resetStatistics();
+      return true;
+    }
+
+
+    /**
+     * Record that a segment has arrived ahead of receiveNext. It's merged with any intervals
+     * that it overlaps or touches. If it needs a new interval and there are none left then it
+     * can't be held and the caller must not store the data.
+     * @param receiveNext The next sequence number expected
+     * @param start The first sequence number in the segment
+     * @param end The sequence number just after the segment
+     * @return true if the data should be stored
+     */
+
+    inline bool TcpReassemblyQueue::insert(uint32_t receiveNext,uint32_t start,uint32_t end) {
+
+      uint8_t previous,current,next,index;
+      Interval *ptr;
+
+      _statistics.outOfOrderSegments++;
+
+      // find the first interval that does not end before this segment starts
+
+      previous=NO_ENTRY;
+      for(current=_first;current!=NO_ENTRY && before(_intervals[current].end,start);current=_intervals[current].next)
+        previous=current;
+
+      if(current!=NO_ENTRY && !before(end,_intervals[current].start)) {
+
+        // the segment overlaps or touches this interval so grow it
+
+        ptr=&_intervals[current];
+
+        if(!before(start,ptr->start) && !before(ptr->end,end))
+          _statistics.duplicateSegments++;
+
+        if(before(start,ptr->start))
+          ptr->start=start;
+
+        if(before(ptr->end,end)) {
+
+          ptr->end=end;
+
+          // the grown interval may now reach the ones after it
+
+          while((next=ptr->next)!=NO_ENTRY && !before(ptr->end,_intervals[next].start)) {
+
+            if(before(ptr->end,_intervals[next].end))
+              ptr->end=_intervals[next].end;
+
+            remove(next,current);
+          }
+        }
+
+        index=current;
+      }
+      else {
+
+        // a new interval is needed between previous and current
+
+        if((index=_free)==NO_ENTRY) {
+          _statistics.droppedSegments++;
+          return false;
+        }
+
+        _free=_intervals[index].next;
+
+        ptr=&_intervals[index];
+        ptr->start=start;
+        ptr->end=end;
+        ptr->next=current;
+
+        if(previous==NO_ENTRY)
+          _first=index;
+        else
+          _intervals[previous].next=index;
+
+        if(++_count>_statistics.maxIntervals)
+          _statistics.maxIntervals=_count;
+      }
+
+      _mostRecent=index;
+
+      // the furthest data held is at the end of the last interval
+
+      for(index=_first;_intervals[index].next!=NO_ENTRY;index=_intervals[index].next);
+
+      if(_intervals[index].end-receiveNext>_statistics.maxDepth)
+        _statistics.maxDepth=_intervals[index].end-receiveNext;
+
+      return true;
+    }
+
+
+    /**
+     * receiveNext has moved forward. Any intervals that it has reached are removed and
+     * receiveNext is extended to the end of the data that they held.
+     * @param receiveNext The next sequence number expected
+     * @return The new value for receiveNext, which is unchanged if the hole is still there
+     */
+
+    inline uint32_t TcpReassemblyQueue::advance(uint32_t receiveNext) {
+
+      uint32_t end;
+
+      while(_first!=NO_ENTRY && !before(receiveNext,_intervals[_first].start)) {
+
+        end=_intervals[_first].end;
+
+        if(before(receiveNext,end)) {
+          receiveNext=end;
+          _statistics.holesFilled++;
+        }
+
+        remove(_first,NO_ENTRY);
+      }
+
+      return receiveNext;
+    }
+
+
+    /**
+     * Return true if nothing is held out of order
+     * @return true if empty
+     */
+
+    inline bool TcpReassemblyQueue::isEmpty() const {
+      return _first==NO_ENTRY;
+    }
+
+
+    /**
+     * Get the SACK blocks that describe the data held. The most recently changed interval
+     * is first and the others follow in sequence order.
+     * @param[out] blocks Where to write the blocks, in network byte order
+     * @param maxBlocks The most blocks to write
+     * @return The number of blocks written
+     */
+
+    inline uint8_t TcpReassemblyQueue::getSackBlocks(TcpSackBlock *blocks,uint8_t maxBlocks) const {
+
+      uint8_t count,index;
+
+      count=0;
+
+      if(_mostRecent!=NO_ENTRY && maxBlocks) {
+        blocks[0].tcp_leftEdge=NetUtil::htonl(_intervals[_mostRecent].start);
+        blocks[0].tcp_rightEdge=NetUtil::htonl(_intervals[_mostRecent].end);
+        count++;
+      }
+
+      for(index=_first;index!=NO_ENTRY && count<maxBlocks;index=_intervals[index].next) {
+
+        if(index!=_mostRecent) {
+          blocks[count].tcp_leftEdge=NetUtil::htonl(_intervals[index].start);
+          blocks[count].tcp_rightEdge=NetUtil::htonl(_intervals[index].end);
+          count++;
+        }
+      }
+
+      return count;
+    }
+
+
+    /**
+     * Get the statistics
+     * @return A reference to the statistics
+     */
+
+    inline const TcpReassemblyStatistics& TcpReassemblyQueue::getStatistics() const {
+      return _statistics;
+    }
+
+
+    /**
+     * Reset the statistics to zero
+     */
+
+    inline void TcpReassemblyQueue::resetStatistics() {
+      memset(&_statistics,0,sizeof(_statistics));
+    }
+
+
+    /*
+     * Unlink an interval and put it on the free list
+     */
+
+    inline void TcpReassemblyQueue::remove(uint8_t index,uint8_t previous) {
+
+      if(previous==NO_ENTRY)
+        _first=_intervals[index].next;
+      else
+        _intervals[previous].next=_intervals[index].next;
+
+      if(_mostRecent==index)
+        _mostRecent=NO_ENTRY;
+
+      _intervals[index].next=_free;
+      _free=index;
+      _count--;
+    }
+
+
+    /*
+     * Sequence number comparison that survives 32-bit wrap
+     */
+
+    inline bool TcpReassemblyQueue::before(uint32_t a,uint32_t b) {
+      return static_cast<int32_t>(a-b)<0;
+    }
+  }
+}
@@ -12,55 +12,82 @@ namespace stm32plus {
 
 
     /**
-     * Simple wrapper for the circular buffer used for received data that ensures
-     * IRQ-safe access to the methods.
+     * Simple wrapper for the circular buffer used for received data. The receive IRQ is the
+     * only writer and the application is the only reader so the lock-free ring needs no
+     * interrupt masking.
      */
 
     class TcpReceiveBuffer {
 
       protected:
+        enum {
+          MAX_SIZE = 32768            ///< largest power of 2 that fits the window field
+        };
+
         volatile circular_buffer<uint8_t> _receiveBuffer;
 
       public:
         TcpReceiveBuffer(uint32_t size);
 
         void read(uint8_t *output,uint32_t size) volatile;
+        uint32_t peekRead(const uint8_t*& ptr) const volatile;
+        void commitRead(uint32_t size) volatile;
         void write(const uint8_t *input,uint32_t size) volatile;
+        void writeAhead(uint32_t offset,const uint8_t *input,uint32_t size) volatile;
+        void commitWrite(uint32_t size) volatile;
 
         uint32_t availableToWrite() const volatile;
         uint32_t availableToRead() const volatile;
+        uint32_t getCapacity() const volatile;
     };
 
 
     /**
-     * Constructor
+     * Constructor. The size is rounded up to a power of 2 and limited so that the free space
+     * can always be advertised in the 16-bit window field.
      * @param size the buffer size
      */
 
     inline TcpReceiveBuffer::TcpReceiveBuffer(uint32_t size)
-      : _receiveBuffer(size) {
+      : _receiveBuffer(std::min(size,static_cast<uint32_t>(MAX_SIZE))) {
     }
 
     inline void TcpReceiveBuffer::read(uint8_t *output,uint32_t size) volatile {
-      IrqSuspend suspender;
       _receiveBuffer.read(output,size);
     }
 
+    inline uint32_t TcpReceiveBuffer::peekRead(const uint8_t*& ptr) const volatile {
+      return _receiveBuffer.peekRead(ptr);
+    }
+
+    inline void TcpReceiveBuffer::commitRead(uint32_t size) volatile {
+      _receiveBuffer.commitRead(size);
+    }
+
 
     inline void TcpReceiveBuffer::write(const uint8_t *input,uint32_t size) volatile {
-      IrqSuspend suspender;
       _receiveBuffer.write(input,size);
     }
 
+    inline void TcpReceiveBuffer::writeAhead(uint32_t offset,const uint8_t *input,uint32_t size) volatile {
+      _receiveBuffer.writeAhead(offset,input,size);
+    }
+
+    inline void TcpReceiveBuffer::commitWrite(uint32_t size) volatile {
+      _receiveBuffer.commitWrite(size);
+    }
+
     inline uint32_t TcpReceiveBuffer::availableToWrite() const volatile {
-      IrqSuspend suspend;
       return _receiveBuffer.availableToWrite();
     }
 
     inline uint32_t TcpReceiveBuffer::availableToRead() const volatile {
-      IrqSuspend suspend;
       return _receiveBuffer.availableToRead();
     }
+
+    inline uint32_t TcpReceiveBuffer::getCapacity() const volatile {
+      return _receiveBuffer.getCapacity();
+    }
   }
 }
 
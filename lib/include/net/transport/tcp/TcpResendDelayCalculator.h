@@ -12,64 +12,119 @@ namespace stm32plus {
 
 
     /**
-     * State management for the resend algorithm. This implements the algorithm in RFC2988 as
+     * State management for the resend algorithm. This implements the algorithm in RFC6298 as
      * best we can here. Round-trip times are used to calculate an adaptive value that defines
-     * how long to wait before a packet is considered lost and should be retransmitted for the
-     * first time.
+     * how long to wait before a packet is considered lost and should be retransmitted.
+     *
+     * One segment at a time is timed. Following Karn's algorithm the timing is abandoned if
+     * anything is retransmitted because the ACK would be ambiguous. Each retransmission timeout
+     * doubles the delay until a new sample is taken. All times are in milliseconds.
      */
 
     class TcpResendDelayCalculator {
 
       protected:
-        uint16_t _initialDelay;
-        uint16_t _maxDelay;
+        uint32_t _initialDelay;
+        uint32_t _minDelay;
+        uint32_t _maxDelay;
 
         uint32_t _srtt;
         uint32_t _rttvar;
         uint32_t _timerStart;
+        uint32_t _timedSequenceNumber;
+        uint8_t _backoff;
         bool _first;
+        bool _timing;
 
       public:
-        bool initialise(uint16_t initialDelay,uint16_t maxDelay);
+        bool initialise(uint32_t initialDelay,uint32_t minDelay,uint32_t maxDelay);
 
-        void startTimer();
-        void stopTimer();
+        void startTimer(uint32_t sequenceNumber);
+        void cancelTimer();
+        void acknowledged(uint32_t ackNumber);
+        bool isTiming() const;
 
-        uint16_t getResendDelay() const;
+        void backoff();
+        uint32_t getResendDelay() const;
+        uint32_t getSmoothedRoundTripTime() const;
     };
 
 
     /**
      * Initialise the class
-     * @param initialDelay The first delay seconds
-     * @param maxDelay The maximum delay seconds
+     * @param initialDelay The delay used until the first round trip time is measured
+     * @param minDelay The lower bound on the calculated delay
+     * @param maxDelay The upper bound on the calculated delay including backoff
      * @return true
      */
 
-    inline bool TcpResendDelayCalculator::initialise(uint16_t initialDelay,uint16_t maxDelay) {
+    inline bool TcpResendDelayCalculator::initialise(uint32_t initialDelay,uint32_t minDelay,uint32_t maxDelay) {
+
       _initialDelay=initialDelay;
+      _minDelay=minDelay;
       _maxDelay=maxDelay;
+
+      _srtt=_rttvar=0;
+      _backoff=0;
+      _first=true;
+      _timing=false;
+
       return true;
     }
 
 
     /**
-     * Start the RTT timer
+     * Start timing a segment if one is not already being timed. This is called when new
+     * data is first transmitted.
+     * @param sequenceNumber The sequence number just after the segment. The timer stops
+     *   when this is acknowledged.
+     */
+
+    inline void TcpResendDelayCalculator::startTimer(uint32_t sequenceNumber) {
+
+      if(!_timing) {
+        _timerStart=MillisecondTimer::millis();
+        _timedSequenceNumber=sequenceNumber;
+        _timing=true;
+      }
+    }
+
+
+    /**
+     * Abandon the current timing. Called on a retransmission (Karn's algorithm).
+     */
+
+    inline void TcpResendDelayCalculator::cancelTimer() {
+      _timing=false;
+    }
+
+
+    /**
+     * Return true if a segment is being timed
+     * @return true if timing
      */
 
-    inline void TcpResendDelayCalculator::startTimer() {
-      _timerStart=MillisecondTimer::millis();
+    inline bool TcpResendDelayCalculator::isTiming() const {
+      return _timing;
     }
 
 
     /**
-     * Stop the RTT timer and calculate the state variables
+     * An ACK has arrived that moved the window. If it covers the timed segment then the
+     * round trip time is sampled and the state variables are updated. This is IRQ code.
+     * @param ackNumber The acknowledgement number in the ACK
      */
 
-    inline void TcpResendDelayCalculator::stopTimer() {
+    inline void TcpResendDelayCalculator::acknowledged(uint32_t ackNumber) {
 
       uint32_t r;
 
+      if(!_timing || static_cast<int32_t>(ackNumber-_timedSequenceNumber)<0)
+        return;
+
+      _timing=false;
+      _backoff=0;
+
       r=MillisecondTimer::difference(_timerStart);
 
       if(_first) {
@@ -84,17 +139,42 @@ namespace stm32plus {
     }
 
 
+    /**
+     * A retransmission timeout happened. Double the delay until the next sample is taken.
+     */
+
+    inline void TcpResendDelayCalculator::backoff() {
+
+      if(getResendDelay()<_maxDelay)
+        _backoff++;
+    }
+
+
     /**
      * Get the current resend delay, calculated from the state variables
-     * @return the current resend delay
+     * @return the current resend delay in milliseconds
      */
 
-    inline uint16_t TcpResendDelayCalculator::getResendDelay() const {
+    inline uint32_t TcpResendDelayCalculator::getResendDelay() const {
+
+      uint32_t delay;
 
       if(_first)
-        return _initialDelay;
+        delay=_initialDelay;
+      else
+        delay=std::max(_minDelay,_srtt+std::max<uint32_t>(1,4*_rttvar));
+
+      return std::min(_maxDelay,delay << _backoff);
+    }
+
+
+    /**
+     * Get the smoothed round trip time
+     * @return The SRTT in milliseconds, zero if no sample has been taken yet
+     */
 
-      return std::min((uint32_t)_maxDelay,(_srtt+std::max(1ul,4*_rttvar))/1000);
+    inline uint32_t TcpResendDelayCalculator::getSmoothedRoundTripTime() const {
+      return _srtt;
     }
   }
 }
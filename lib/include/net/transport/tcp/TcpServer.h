@@ -30,6 +30,7 @@ namespace stm32plus {
       protected:
         TUser *_userptr;                                            // connection constructor may take optional typed user parameter
         const typename TConnection::Parameters _connectionParams;   // connection parameters are shared between instances
+        TcpConnectionTable::Entry _listenerEntry;                   // our entry in the listener table
 
       protected:
         void onReceive(TcpSegmentEvent&);
@@ -101,9 +102,13 @@ namespace stm32plus {
                       additionalHeaderSize),
         _userptr(userptr) {
 
-      // subscribe to receive events
+      // register for SYNs sent to our port
 
-      _tcpEvents.TcpReceiveEventSender.insertSubscriber(TcpReceiveEventSourceSlot::bind(this,&TcpServer::onReceive));
+      _listenerEntry.localPort=listeningPort;
+      _listenerEntry.connection=nullptr;
+      _listenerEntry.handler=TcpReceiveEventSourceSlot::bind(this,&TcpServer::onReceive);
+
+      _tcpEvents.tcpConnectionTable.addListener(_listenerEntry);
     }
 
 
@@ -114,9 +119,9 @@ namespace stm32plus {
     template<class TConnection,class TUser>
     inline TcpServer<TConnection,TUser>::~TcpServer() {
 
-      // unsubscribe from receive events
+      // stop receiving SYNs
 
-      _tcpEvents.TcpReceiveEventSender.removeSubscriber(TcpReceiveEventSourceSlot::bind(this,&TcpServer::onReceive));
+      _tcpEvents.tcpConnectionTable.removeListener(_listenerEntry);
 
       // raise the event that we're going away
 
@@ -125,8 +130,8 @@ namespace stm32plus {
 
 
     /**
-     * Network receive event
-     * @param ned The event descriptor
+     * Segment receive event for a SYN sent to our port. This is IRQ code.
+     * @param event The segment event
      */
 
     template<class TConnection,class TUser>
@@ -154,12 +159,7 @@ namespace stm32plus {
       // if an existing connection already has this source/dest port combo then this
       // segment is a retransmit and we're going to drop it
 
-      TcpFindConnectionNotificationEvent findconn(event.ipPacket.header->ip_sourceAddress,event.sourcePort,event.destinationPort);
-      _networkUtilityObjects.NetworkNotificationEventSender.raiseEvent(findconn);
-
-      // if there's a connection, return now as we have a dupe SYN
-
-      if(findconn.tcpConnection!=nullptr)
+      if(_tcpEvents.tcpConnectionTable.findConnection(event.ipPacket.header->ip_sourceAddress,event.sourcePort,event.destinationPort)!=nullptr)
         return;
 
       // if we've hit the maximum number of connections then we have to ignore it
@@ -94,7 +94,7 @@ namespace stm32plus {
 
       // subscribe to network notifications
 
-      _networkUtilityObjects.NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpServerBase::onNotification));
+      _networkUtilityObjects.NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED,NetworkNotificationEventSourceSlot::bind(this,&TcpServerBase::onNotification));
     }
 
 
@@ -106,7 +106,7 @@ namespace stm32plus {
 
       // unsubscribe from notify events
 
-      _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpServerBase::onNotification));
+      _networkUtilityObjects.NetworkNotificationEventSender.removeSubscriber(NetEventDescriptor::NetEventType::TCP_CONNECTION_RELEASED,NetworkNotificationEventSourceSlot::bind(this,&TcpServerBase::onNotification));
     }
 
 
@@ -16,9 +16,13 @@ namespace stm32plus {
      * being able to process data a line at a time. This class simplifies receiving
      * data from a TcpConnection a line at a time.
      *
-     * Data is read into a pre-sized std::string class a character at a time until
-     * an LF is hit. Any CR characters are discarded. The trailing LF is not included
-     * in the string.
+     * The receive buffer is scanned in place for the LF with memchr(), which works a word
+     * at a time, and everything up to it is appended to the line in one go. Nothing past
+     * the LF is consumed. The string is reserved at the maximum length up front so
+     * receiving lines does not allocate. The trailing CR LF is not included in the string.
+     *
+     * view() returns the line as a StringView so that it can be taken apart without
+     * copying.
      */
 
     class TcpTextLineReceiver {
@@ -48,6 +52,7 @@ namespace stm32plus {
 
         operator const std::string&() const;
         const std::string& str() const;
+        StringView view() const;
     };
 
 
@@ -58,6 +63,7 @@ namespace stm32plus {
 
     inline TcpTextLineReceiver::TcpTextLineReceiver(uint16_t maxLength)
       : _maxLength(maxLength) {
+      _line.reserve(maxLength+1);
       reset();
     }
 
@@ -74,33 +80,42 @@ namespace stm32plus {
 
     inline bool TcpTextLineReceiver::add(TcpConnection& conn) {
 
-      char c;
-      uint32_t actuallyRead;
+      const uint8_t *data,*lf;
+      uint32_t available,consumed,stored;
 
       // cannot procede if you haven't called reset on the previous line
 
       if(_ready)
         return errorProvider.set(ErrorProvider::ERROR_PROVIDER_NET_TCP_TEXT_LINE_RECEIVER,E_RESET_REQUIRED);
 
-      // loop while data is ready to read
-
-      while(conn.getDataAvailable()) {
+      // work through the receive buffer a contiguous block at a time
 
-        // try to read a character
+      while(!_ready && (available=conn.peekReceive(data))!=0) {
 
-        if(!conn.receive(&c,1,actuallyRead,1) || actuallyRead!=1)
-          return false;
+        // consume up to and including the LF if there is one, otherwise the whole block
 
-        // if LF then done, otherwise store non-CR char
-
-        if(c=='\n') {
+        if((lf=reinterpret_cast<const uint8_t *>(memchr(data,'\n',available)))!=nullptr) {
+          consumed=lf-data+1;
           _ready=true;
-          break;
         }
-        else if(c!='\r' && _line.length()<_maxLength)
-          _line+=c;
+        else
+          consumed=available;
+
+        // store as much of it as fits. anything past the maximum length is dropped.
+
+        stored=std::min<uint32_t>(consumed-(_ready ? 1 : 0),_maxLength-_line.length());
+
+        if(stored)
+          _line.append(reinterpret_cast<const char *>(data),stored);
+
+        conn.commitReceive(consumed);
       }
 
+      // the CR of the CR LF may have been stored in an earlier block
+
+      if(_ready && !_line.empty() && _line[_line.length()-1]=='\r')
+        _line.erase(_line.length()-1);
+
       return true;
     }
 
@@ -148,6 +163,16 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Get a view of the line that's valid until the next reset()
+     * @return The view
+     */
+
+    inline StringView TcpTextLineReceiver::view() const {
+      return StringView(_line);
+    }
+
+
     /**
      * Get the string length
      * @return The length of the string
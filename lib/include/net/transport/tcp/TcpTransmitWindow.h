@@ -20,11 +20,15 @@ namespace stm32plus {
      * +-----------------------------------------
      *          ^                 ^
      *     sendUnacknowleged     sendNext
+     *
+     * sendNext is wound back to sendUnacknowledged after a retransmission timeout so
+     * sendMaximum is kept to remember how far we'd got.
      */
 
     struct TcpTransmitWindow {
       uint32_t sendUnacknowledged;      ///< seq num of first byte of data sent but not acked
       uint32_t sendNext;                ///< seq num of next byte of data to be sent
+      uint32_t sendMaximum;             ///< seq num after the highest byte of data ever sent
       uint16_t sendWindow;              ///< send window (starts at _sendUnacknowledged)
     };
   }
@@ -45,6 +45,7 @@ namespace stm32plus {
         enum {
           E_TIMED_OUT = 1,    ///< timed out while waiting for data
           E_MSG_SIZE,         ///< data was received, but more is available and has been lost
+          E_OUT_OF_MEMORY     ///< a buffer could not be allocated for the datagram
         };
 
         DECLARE_EVENT_SOURCE(UdpReceive);
@@ -76,6 +77,11 @@ namespace stm32plus {
                      bool async,
                      uint32_t transmitTimeout);
 
+        bool udpSend(const IpAddress& ipaddress,
+                     uint16_t sourcePortNumber,
+                     uint16_t destinationPortNumber,
+                     NetBufferSegment *payload);
+
         // synchronous receive functions
 
         bool udpReceive(uint16_t portNumber,void *buffer,uint16_t& size,uint32_t receiveTimeout=0);
@@ -105,7 +111,7 @@ namespace stm32plus {
       // subscribe for receive and notification events from the IP implementation
 
       this->IpReceiveEventSender.insertSubscriber(IpReceiveEventSourceSlot::bind(this,&Udp<TNetworkLayer>::onReceive));
-      this->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&Udp<TNetworkLayer>::onNotification));
+      this->NetworkNotificationEventSender.insertSubscriber(NetEventDescriptor::NetEventType::DATALINK_FRAME_SENT,NetworkNotificationEventSourceSlot::bind(this,&Udp<TNetworkLayer>::onNotification));
 
       return true;
     }
@@ -278,6 +284,13 @@ namespace stm32plus {
                          data,
                          dataSize);
 
+        // don't send a datagram that has lost its data
+
+        if(nb==nullptr || !nb->isValid()) {
+          delete nb;
+          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_UDP,E_OUT_OF_MEMORY);
+        }
+
         // we'll need to wait for this buffer to go out
 
         _waitForThisBuffer=nb;
@@ -330,6 +343,61 @@ namespace stm32plus {
     }
 
 
+    /**
+     * Send a datagram asynchronously whose payload is a chain of segments linked with
+     * NetBufferSegment::setNext(). The segments are gathered straight into the frame by
+     * the MAC so the data is not copied. Ownership of the caller's reference to each segment
+     * is transferred to this method and the segments are released when the datagram has been
+     * transmitted (or has failed to be). An owned segment can be filled in by the caller and
+     * then sent without the caller having to keep anything in scope.
+     *
+     * @param ipaddress The IP address to send to.
+     * @param sourcePortNumber The port number that you are sending from, or zero if you don't care
+     * @param destinationPortNumber The destination port to send to.
+     * @param payload The first segment in the payload chain. May be nullptr.
+     * @return true if the datagram was accepted for sending
+     */
+
+    template<class TNetworkLayer>
+    bool Udp<TNetworkLayer>::udpSend(const IpAddress& ipaddress,
+                                      uint16_t sourcePortNumber,
+                                      uint16_t destinationPortNumber,
+                                      NetBufferSegment *payload) {
+
+      NetBuffer *nb;
+      NetBufferSegment *next;
+
+      nb=new NetBuffer(this->getDatalinkTransmitHeaderSize()+this->getIpTransmitHeaderSize()+UdpDatagram::getHeaderSize(),0);
+
+      // transfer the segments to the net buffer
+
+      for(;payload;payload=next) {
+        next=payload->getNext();
+        nb->appendSegment(payload);
+      }
+
+      // set up the header
+
+      UdpDatagram *header=reinterpret_cast<UdpDatagram *>(nb->moveWritePointerBack(UdpDatagram::getHeaderSize()));
+
+      header->udp_sourcePort=NetUtil::htons(sourcePortNumber);
+      header->udp_destinationPort=NetUtil::htons(destinationPortNumber);
+      header->udp_checksum=0;         // will be calculated by the MAC
+      header->udp_length=NetUtil::htons(nb->getUserBufferSize()+UdpDatagram::getHeaderSize());
+
+      // send the datagram
+
+      IpTransmitRequestEvent iptre(
+                  nb,
+                  ipaddress,
+                  IpProtocol::UDP
+                );
+
+      this->NetworkSendEventSender.raiseEvent(iptre);
+      return iptre.succeeded;
+    }
+
+
     /**
      * Receive a datagram synchronously. This method blocks until data is available or the
      * timeout is hit. Data from the received datagram is stored in 'buffer' up to a maximum
@@ -16,37 +16,67 @@ namespace stm32plus {
    * LzgDecompressionInputStream acts as a filter, taking LZG-compressed bytes from an
    * input stream that you supply and making them available as an uncompressed stream
    * through this class's own implementation of InputStream.
+   *
+   * Decompression works in blocks. A read() of many bytes copies whole runs of literals
+   * and whole back-references straight into your buffer. Non-overlapping history copies
+   * are done with memcpy and overlapping (run-length) copies double up the repeating
+   * pattern so they too are done in a few block copies. The compressed input is read from
+   * your stream in small blocks rather than a byte at a time.
+   *
+   * If all the compressed data is in memory and you have room for all the output then
+   * the static decompress() method is faster still and has no history window limit.
    */
 
   class LzgDecompressionStream : public InputStream {
 
     public:
       enum {
-        E_UNSUPPORTED_COMPRESSED_DATA = 1
+        E_UNSUPPORTED_COMPRESSED_DATA = 1,
+        E_CORRUPT_COMPRESSED_DATA
       };
 
     protected:
+      enum {
+        HISTORY_SIZE = 2056,                // the largest back-reference that isn't a distant copy
+        INPUT_BUFFER_SIZE = 32,             // compressed bytes read from the input at a time
+        HEADER_SIZE = 16,                   // magic, sizes, checksum and method
+        METHOD_COPY = 0,                    // data is stored uncompressed
+        METHOD_LZG1 = 1                     // data is compressed
+      };
+
       InputStream& _input;
       uint32_t _compressedSize;
 
-      uint32_t _compressedDataAvailable;
-      uint8_t _circbuf[2056];               // note the size of this - ensure you can afford it
+      uint32_t _compressedDataAvailable;    // yet to be read from the input
+      uint32_t _uncompressedDataAvailable;  // yet to be returned to the caller
+      uint8_t _circbuf[HISTORY_SIZE];       // note the size of this - ensure you can afford it
       uint8_t *_dst,*_dstEnd;
+      uint8_t _inputBuffer[INPUT_BUFFER_SIZE];
+      uint8_t *_inputPos,*_inputEnd;
       char _isMarkerSymbolLUT[256];
       uint8_t _marker1,_marker2,_marker3,_marker4;
+      bool _isStored;
 
       uint8_t *_historyCopyPosition;
       uint32_t _historyCopyDataAvailable;
 
     protected:
-      bool readNextUncompressedByte(uint8_t& nextByte);
+      bool decode(uint8_t *output,uint32_t size,uint32_t& actuallyDecoded);
       bool nextByteFromStream(uint8_t& nextByte);
-      uint8_t getByteFromHistoryCopy();
+      bool fillInputBuffer();
+      void emitLiterals(uint8_t*& output,const uint8_t *literals,uint32_t size);
+      void emitHistoryCopy(uint8_t*& output,uint32_t size);
+
+      static uint32_t getUint32(const uint8_t *ptr);
+      static void copyHistory(uint8_t *dest,const uint8_t *src,uint32_t size);
 
     public:
       LzgDecompressionStream(InputStream& input,uint32_t compressedSize);
       virtual ~LzgDecompressionStream() {}
 
+      static uint32_t getDecodedSize(const void *compressed,uint32_t compressedSize);
+      static bool decompress(const void *compressed,uint32_t compressedSize,void *output,uint32_t outputSize);
+
       // overrides from InputStream
 
       virtual int16_t read() override;
@@ -0,0 +1,237 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /**
+   * @brief A non-owning view of part of a string.
+   *
+   * The view is a pointer and a length into characters owned by someone else, so taking
+   * pieces out of a line for parsing costs nothing and allocates nothing. The characters
+   * are not null terminated. The view is only valid while the owner's characters are.
+   */
+
+  class StringView {
+
+    public:
+      enum {
+        npos = 0xffff             ///< returned by the find methods when there's no match
+      };
+
+    protected:
+      const char *_ptr;
+      uint16_t _length;
+
+    public:
+      StringView();
+      StringView(const char *str);
+      StringView(const char *ptr,uint16_t length);
+      StringView(const std::string& str);
+
+      const char *data() const;
+      uint16_t length() const;
+      bool empty() const;
+      char operator[](uint16_t pos) const;
+
+      uint16_t find(char c,uint16_t pos=0) const;
+      uint16_t find(const char *str,uint16_t pos=0) const;
+      StringView substr(uint16_t pos,uint16_t length=npos) const;
+      StringView trim() const;
+
+      bool equalsIgnoreCase(const char *str) const;
+      uint32_t toUnsigned() const;
+  };
+
+
+  /**
+   * Default constructor: an empty view
+   */
+
+  inline StringView::StringView()
+    : _ptr(""),
+      _length(0) {
+  }
+
+
+  /**
+   * Constructor for a view of a null terminated string
+   * @param str The string
+   */
+
+  inline StringView::StringView(const char *str)
+    : _ptr(str),
+      _length(strlen(str)) {
+  }
+
+
+  /**
+   * Constructor
+   * @param ptr The first character
+   * @param length The number of characters
+   */
+
+  inline StringView::StringView(const char *ptr,uint16_t length)
+    : _ptr(ptr),
+      _length(length) {
+  }
+
+
+  /**
+   * Constructor for a view of a whole std::string
+   * @param str The string, which must outlive the view and not change
+   */
+
+  inline StringView::StringView(const std::string& str)
+    : _ptr(str.c_str()),
+      _length(str.length()) {
+  }
+
+
+  /**
+   * Get the first character
+   * @return A pointer to the first character. It's not null terminated.
+   */
+
+  inline const char *StringView::data() const {
+    return _ptr;
+  }
+
+
+  /**
+   * Get the length
+   * @return The number of characters
+   */
+
+  inline uint16_t StringView::length() const {
+    return _length;
+  }
+
+
+  /**
+   * Check for an empty view
+   * @return true if there are no characters
+   */
+
+  inline bool StringView::empty() const {
+    return _length==0;
+  }
+
+
+  /**
+   * Get a character
+   * @param pos The position, which must be less than length()
+   * @return The character
+   */
+
+  inline char StringView::operator[](uint16_t pos) const {
+    return _ptr[pos];
+  }
+
+
+  /**
+   * Find a character. The search is done by memchr() which works a word at a time.
+   * @param c The character to find
+   * @param pos Where to start
+   * @return The position or npos if it's not there
+   */
+
+  inline uint16_t StringView::find(char c,uint16_t pos) const {
+
+    const char *found;
+
+    if(pos>=_length)
+      return npos;
+
+    if((found=reinterpret_cast<const char *>(memchr(_ptr+pos,c,_length-pos)))==nullptr)
+      return npos;
+
+    return found-_ptr;
+  }
+
+
+  /**
+   * Find a null terminated string
+   * @param str The string to find
+   * @param pos Where to start
+   * @return The position or npos if it's not there
+   */
+
+  inline uint16_t StringView::find(const char *str,uint16_t pos) const {
+
+    uint16_t len;
+
+    len=strlen(str);
+
+    for(;(pos=find(str[0],pos))!=npos;pos++)
+      if(_length-pos>=len && memcmp(_ptr+pos,str,len)==0)
+        return pos;
+
+    return npos;
+  }
+
+
+  /**
+   * Get part of the view
+   * @param pos The first character. Clipped to the length.
+   * @param length The number of characters. Clipped to what's left.
+   * @return The new view
+   */
+
+  inline StringView StringView::substr(uint16_t pos,uint16_t length) const {
+
+    pos=std::min(pos,_length);
+    return StringView(_ptr+pos,std::min<uint16_t>(length,_length-pos));
+  }
+
+
+  /**
+   * Remove leading and trailing spaces and tabs
+   * @return The new view
+   */
+
+  inline StringView StringView::trim() const {
+
+    uint16_t first,last;
+
+    for(first=0;first<_length && (_ptr[first]==' ' || _ptr[first]=='\t');first++);
+    for(last=_length;last>first && (_ptr[last-1]==' ' || _ptr[last-1]=='\t');last--);
+
+    return StringView(_ptr+first,last-first);
+  }
+
+
+  /**
+   * Compare with a null terminated string, ignoring case
+   * @param str The string to compare with
+   * @return true if they're the same
+   */
+
+  inline bool StringView::equalsIgnoreCase(const char *str) const {
+    return strncasecmp(_ptr,str,_length)==0 && str[_length]=='\0';
+  }
+
+
+  /**
+   * Convert leading decimal digits to a number
+   * @return The number, zero if there are no digits
+   */
+
+  inline uint32_t StringView::toUnsigned() const {
+
+    uint32_t value;
+    uint16_t i;
+
+    value=0;
+
+    for(i=0;i<_length && _ptr[i]>='0' && _ptr[i]<='9';i++)
+      value=value*10+(_ptr[i]-'0');
+
+    return value;
+  }
+}
@@ -10,62 +10,135 @@
 
 namespace stm32plus {
 
+  /*
+   * get the data for a cache entry
+   */
+
+  inline uint8_t *CachedBlockDevice::getBlockData(uint16_t entry) const {
+    return _cacheMemory+entry*_blockSize;
+  }
+
+
+  /*
+   * hash a block index. Sequential blocks go to sequential buckets.
+   */
+
+  inline uint32_t CachedBlockDevice::hash(uint32_t blockIndex) const {
+    return (blockIndex ^ (blockIndex >> 16)) & _hashMask;
+  }
+
+
   /**
    * Constructor
    *
    * @param[in] bd The block device being cached. Must not go out of scope.
    * @param[in] numCachedBlocks The number of blocks to cache. This parameter controls the memory used by this class.
+   *   It must be from 1 to 65534. Check isValid() after construction.
+   * @param[in] writePolicy WRITE_THROUGH (the default) or WRITE_BACK.
    */
 
-  CachedBlockDevice::CachedBlockDevice(BlockDevice& bd,uint32_t numCachedBlocks) :
-    _device(bd), _numCachedBlocks(numCachedBlocks), _blockSize(bd.getBlockSizeInBytes()) {
-    uint32_t i;
+  CachedBlockDevice::CachedBlockDevice(BlockDevice& bd,uint32_t numCachedBlocks,WritePolicy writePolicy) :
+    _device(bd), _numCachedBlocks(0), _cacheMemory(nullptr), _cacheIndex(nullptr), _hashBuckets(nullptr),
+    _blockSize(bd.getBlockSizeInBytes()), _dirtyCount(0), _writePolicy(writePolicy), _valid(false) {
+
+    uint32_t i,numBuckets;
+
+    // the entries are linked by 16 bit indices and NO_ENTRY is reserved as the end marker
+
+    if(numCachedBlocks==0 || numCachedBlocks>MAX_CACHED_BLOCKS) {
+      errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_INVALID_CACHE_SIZE);
+      return;
+    }
+
+    // the number of hash buckets is the next power of 2 up from the number of blocks
+
+    for(numBuckets=1;numBuckets<numCachedBlocks;numBuckets<<=1);
+
+    // the data for all the blocks is allocated in one piece so that blocks in adjacent
+    // slots are adjacent in memory and can be written back with a single multi-block write
 
-    _cachedBlocks=new uint8_t *[numCachedBlocks];
-    _cacheIndex=new CacheEntry[numCachedBlocks];
+    if((_cacheMemory=new uint8_t[numCachedBlocks*_blockSize])==nullptr ||
+       (_cacheIndex=new CacheEntry[numCachedBlocks])==nullptr ||
+       (_hashBuckets=new uint16_t[numBuckets])==nullptr) {
+
+      errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_OUT_OF_MEMORY);
+      return;
+    }
+
+    _numCachedBlocks=numCachedBlocks;
+    _hashMask=numBuckets-1;
+
+    for(i=0;i<numBuckets;i++)
+      _hashBuckets[i]=NO_ENTRY;
+
+    // all entries start free and are linked so that slot zero is the least recently used
+    // and will be the first to be allocated
 
     for(i=0;i<numCachedBlocks;i++) {
-      _cachedBlocks[i]=new uint8_t[_blockSize];
       _cacheIndex[i].BlockIndex=FREE_CACHE_ENTRY;
-      _cacheIndex[i].CacheIndex=i;
+      _cacheIndex[i].Prev=i+1<numCachedBlocks ? i+1 : NO_ENTRY;
+      _cacheIndex[i].Next=i>0 ? i-1 : NO_ENTRY;
+      _cacheIndex[i].HashNext=NO_ENTRY;
+      _cacheIndex[i].Dirty=false;
     }
+
+    _lruHead=numCachedBlocks-1;
+    _lruTail=0;
+    _valid=true;
   }
 
+
   /**
-   * Destructor. Free memory allocated by the cache.
+   * Destructor. Write back any dirty blocks and free memory allocated by the cache.
    */
 
   CachedBlockDevice::~CachedBlockDevice() {
 
-    uint32_t i;
+    flush();
+
+    delete[] _cacheMemory;
+    delete[] _cacheIndex;
+    delete[] _hashBuckets;
+  }
 
-    for(i=0;i<_numCachedBlocks;i++)
-      delete[] _cachedBlocks[i];
 
-    delete _cachedBlocks;
-    delete _cacheIndex;
+  /**
+   * Write all dirty blocks back to the device. Does nothing for a write-through cache.
+   * @return false if a device write fails.
+   */
+
+  bool CachedBlockDevice::flush() {
+
+    uint16_t i;
+
+    for(i=0;_dirtyCount && i<_numCachedBlocks;i++)
+      if(_cacheIndex[i].Dirty && !writeBackRun(i))
+        return false;
+
+    return true;
   }
 
+
   /*
    * read a block
    */
 
   bool CachedBlockDevice::readBlock(void *dest,uint32_t blockIndex) {
 
-    uint32_t i;
+    uint16_t entry;
+
+    if(!_valid)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_NOT_VALID);
 
     // try to find in the cache index
 
-    for(i=0;i<_numCachedBlocks&&_cacheIndex[i].BlockIndex!=FREE_CACHE_ENTRY;i++) {
+    if((entry=findEntry(blockIndex))!=NO_ENTRY) {
 
-      if(_cacheIndex[i].BlockIndex==blockIndex) {
+      // cache hit
 
-        // cache hit
-
-        memcpy(dest,_cachedBlocks[_cacheIndex[i].CacheIndex],_blockSize);
-        moveToFront(i);
-        return true;
-      }
+      memcpy(dest,getBlockData(entry),_blockSize);
+      moveToFront(entry);
+      return true;
     }
 
     // cache miss, read from device
@@ -75,16 +148,22 @@ namespace stm32plus {
 
     // write to the cache
 
-    writeToCache(dest,blockIndex);
-    return true;
+    return writeToCache(dest,blockIndex,false);
   }
 
+
   /*
    * write a block
    */
 
   bool CachedBlockDevice::writeBlock(const void *src,uint32_t blockIndex) {
 
+    if(!_valid)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_NOT_VALID);
+
+    if(_writePolicy==WRITE_BACK)
+      return writeToCache(src,blockIndex,true);
+
     // write through
 
     if(!_device.writeBlock(src,blockIndex))
@@ -92,59 +171,59 @@ namespace stm32plus {
 
     // and into the cache
 
-    writeToCache(src,blockIndex);
-    return true;
+    return writeToCache(src,blockIndex,false);
   }
 
+
   /*
-   * find cache entry and write
+   * multi-block read. runs of blocks that miss the cache are read from the device
+   * in a single multi-block operation
    */
 
-  void CachedBlockDevice::writeToCache(const void *data,uint32_t blockIndex) {
-
-    uint32_t i;
-    CacheEntry evictedEntry;
-
-    // if already in the cache index then move its entry to the front
+  bool CachedBlockDevice::readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) {
 
-    for(i=0;i<_numCachedBlocks&&_cacheIndex[i].BlockIndex!=FREE_CACHE_ENTRY;i++) {
+    uint32_t i,runLength;
+    uint16_t entry;
+    uint8_t *ptr;
 
-      if(_cacheIndex[i].BlockIndex==blockIndex) {
-        moveToFront(i);
-        memcpy(_cachedBlocks[_cacheIndex[i].CacheIndex],data,_blockSize);
-        return;
-      }
-    }
+    if(!_valid)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_NOT_VALID);
 
-    // move up the whole index losing the last one
+    ptr=static_cast<uint8_t *> (dest);
 
-    evictedEntry=_cacheIndex[_numCachedBlocks-1];
-    memmove(&_cacheIndex[1],&_cacheIndex[0],sizeof(CacheEntry)*(_numCachedBlocks-1));
+    while(numBlocks) {
 
-    // this is a new entry into the index so store its data
+      if((entry=findEntry(blockIndex))!=NO_ENTRY) {
 
-    memcpy(_cachedBlocks[evictedEntry.CacheIndex],data,_blockSize);
+        // cache hit
 
-    evictedEntry.BlockIndex=blockIndex;
-    _cacheIndex[0]=evictedEntry;
-  }
+        memcpy(ptr,getBlockData(entry),_blockSize);
+        moveToFront(entry);
+        runLength=1;
+      }
+      else {
 
-  /*
-   * move an entry to the front of the index
-   */
+        // find the length of the run of misses
 
-  void CachedBlockDevice::moveToFront(uint32_t index) {
+        for(runLength=1;runLength<numBlocks && findEntry(blockIndex+runLength)==NO_ENTRY;runLength++);
 
-    if(index!=0) {
+        if(!_device.readBlocks(ptr,blockIndex,runLength))
+          return false;
 
-      CacheEntry entry;
+        for(i=0;i<runLength;i++)
+          if(!writeToCache(ptr+i*_blockSize,blockIndex+i,false))
+            return false;
+      }
 
-      entry=_cacheIndex[index];
-      memmove(&_cacheIndex[1],&_cacheIndex[0],sizeof(CacheEntry)*index);
-      _cacheIndex[0]=entry;
+      ptr+=runLength*_blockSize;
+      blockIndex+=runLength;
+      numBlocks-=runLength;
     }
+
+    return true;
   }
 
+
   /*
    * multi-block write
    */
@@ -154,11 +233,19 @@ namespace stm32plus {
     uint32_t i;
     const uint8_t *ptr;
 
+    if(!_valid)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE,E_NOT_VALID);
+
     ptr=static_cast<const uint8_t *> (src);
 
+    // write through goes to the device in one operation
+
+    if(_writePolicy==WRITE_THROUGH && !_device.writeBlocks(src,blockIndex,numBlocks))
+      return false;
+
     for(i=0;i<numBlocks;i++) {
 
-      if(!writeBlock(ptr,blockIndex+i))
+      if(!writeToCache(ptr,blockIndex+i,_writePolicy==WRITE_BACK))
         return false;
 
       ptr+=_blockSize;
@@ -167,27 +254,172 @@ namespace stm32plus {
     return true;
   }
 
+
   /*
-   * multi-block read
+   * find cache entry and write. The entry becomes the most recently used.
    */
 
-  bool CachedBlockDevice::readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) {
-    uint32_t i;
-    uint8_t *ptr;
+  bool CachedBlockDevice::writeToCache(const void *data,uint32_t blockIndex,bool dirty) {
 
-    ptr=static_cast<uint8_t *> (dest);
+    uint16_t entry;
 
-    for(i=0;i<numBlocks;i++) {
+    // if already in the cache index then move its entry to the front
 
-      if(!readBlock(ptr,blockIndex+i))
-        return false;
+    if((entry=findEntry(blockIndex))!=NO_ENTRY)
+      moveToFront(entry);
+    else if(!allocateEntry(blockIndex,entry))
+      return false;
 
-      ptr+=_blockSize;
+    memcpy(getBlockData(entry),data,_blockSize);
+
+    if(dirty && !_cacheIndex[entry].Dirty) {
+      _cacheIndex[entry].Dirty=true;
+      _dirtyCount++;
     }
 
     return true;
   }
 
+
+  /*
+   * allocate the least recently used entry for a new block, writing it back first if
+   * it's dirty. The entry is moved to the front of the LRU list.
+   */
+
+  bool CachedBlockDevice::allocateEntry(uint32_t blockIndex,uint16_t& entry) {
+
+    entry=_lruTail;
+
+    if(_cacheIndex[entry].Dirty && !writeBackRun(entry))
+      return false;
+
+    if(_cacheIndex[entry].BlockIndex!=FREE_CACHE_ENTRY)
+      hashRemove(entry);
+
+    _cacheIndex[entry].BlockIndex=blockIndex;
+    hashInsert(entry);
+    moveToFront(entry);
+
+    return true;
+  }
+
+
+  /*
+   * write back the dirty entry and any dirty neighbours that hold consecutive block
+   * indices in adjacent cache slots. The whole run goes out in one writeBlocks() call.
+   */
+
+  bool CachedBlockDevice::writeBackRun(uint16_t entry) {
+
+    uint16_t first,last,i;
+    uint32_t blockIndex;
+
+    blockIndex=_cacheIndex[entry].BlockIndex;
+
+    // extend the run downwards
+
+    for(first=entry;
+        first>0 && blockIndex-(entry-first)>0 &&
+          _cacheIndex[first-1].Dirty &&
+          _cacheIndex[first-1].BlockIndex==blockIndex-(entry-first)-1;
+        first--);
+
+    // extend the run upwards
+
+    for(last=entry;
+        last<_numCachedBlocks-1 &&
+          _cacheIndex[last+1].Dirty &&
+          _cacheIndex[last+1].BlockIndex==blockIndex+(last-entry)+1;
+        last++);
+
+    if(!_device.writeBlocks(getBlockData(first),_cacheIndex[first].BlockIndex,last-first+1))
+      return false;
+
+    for(i=first;i<=last;i++)
+      _cacheIndex[i].Dirty=false;
+
+    _dirtyCount-=last-first+1;
+    return true;
+  }
+
+
+  /*
+   * find the cache entry for a block index
+   */
+
+  uint16_t CachedBlockDevice::findEntry(uint32_t blockIndex) const {
+
+    uint16_t entry;
+
+    for(entry=_hashBuckets[hash(blockIndex)];
+        entry!=NO_ENTRY && _cacheIndex[entry].BlockIndex!=blockIndex;
+        entry=_cacheIndex[entry].HashNext);
+
+    return entry;
+  }
+
+
+  /*
+   * insert an entry at the head of its hash bucket chain
+   */
+
+  void CachedBlockDevice::hashInsert(uint16_t entry) {
+
+    uint32_t bucket;
+
+    bucket=hash(_cacheIndex[entry].BlockIndex);
+
+    _cacheIndex[entry].HashNext=_hashBuckets[bucket];
+    _hashBuckets[bucket]=entry;
+  }
+
+
+  /*
+   * remove an entry from its hash bucket chain
+   */
+
+  void CachedBlockDevice::hashRemove(uint16_t entry) {
+
+    uint16_t *link;
+
+    for(link=&_hashBuckets[hash(_cacheIndex[entry].BlockIndex)];
+        *link!=entry;
+        link=&_cacheIndex[*link].HashNext);
+
+    *link=_cacheIndex[entry].HashNext;
+    _cacheIndex[entry].HashNext=NO_ENTRY;
+  }
+
+
+  /*
+   * move an entry to the front of the LRU list
+   */
+
+  void CachedBlockDevice::moveToFront(uint16_t entry) {
+
+    CacheEntry& ce(_cacheIndex[entry]);
+
+    if(entry==_lruHead)
+      return;
+
+    // unlink. it's not the head so it has a predecessor
+
+    _cacheIndex[ce.Prev].Next=ce.Next;
+
+    if(ce.Next==NO_ENTRY)
+      _lruTail=ce.Prev;
+    else
+      _cacheIndex[ce.Next].Prev=ce.Prev;
+
+    // link in at the head
+
+    ce.Prev=NO_ENTRY;
+    ce.Next=_lruHead;
+    _cacheIndex[_lruHead].Prev=entry;
+    _lruHead=entry;
+  }
+
+
   /*
    * pass through to device
    */
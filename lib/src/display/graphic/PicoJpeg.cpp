@@ -17,6 +17,7 @@
 //     can come off the stack. Without this you'd pay the 3Kb penalty for the entire life
 //     of your app. With this, you pay only while you do the JPEG decode.
 //  -- move the whole lot into the stm32plus::display namespace
+//  -- look up the chroma terms of the YCbCr->RGB conversion in tables
 
 #include "config/stm32plus.h"
 #include "config/display/tft.h"
@@ -1234,6 +1235,83 @@ namespace stm32plus {
   //G = Y - 0.34414 (Cb-128) - 0.71414 (Cr-128)
   // 198/256
   //B = Y + 1.772 (Cb-128)
+  //
+  // The chroma terms are looked up in these tables instead of being calculated
+  // for every pixel. They hold exactly what the fixed point expressions above
+  // produce so the output is unchanged. 1.5Kb of flash.
+    /*----------------------------------------------------------------------------*/
+    static const int8_t CB_G[256]= {
+      -44,-44,-44,-43,-43,-43,-42,-42,-42,-41,-41,-41,-40,-40,-40,-39,
+      -39,-39,-38,-38,-38,-37,-37,-37,-36,-36,-36,-35,-35,-35,-34,-34,
+      -33,-33,-33,-32,-32,-32,-31,-31,-31,-30,-30,-30,-29,-29,-29,-28,
+      -28,-28,-27,-27,-27,-26,-26,-26,-25,-25,-25,-24,-24,-24,-23,-23,
+      -22,-22,-22,-21,-21,-21,-20,-20,-20,-19,-19,-19,-18,-18,-18,-17,
+      -17,-17,-16,-16,-16,-15,-15,-15,-14,-14,-14,-13,-13,-13,-12,-12,
+      -11,-11,-11,-10,-10,-10,-9,-9,-9,-8,-8,-8,-7,-7,-7,-6,
+      -6,-6,-5,-5,-5,-4,-4,-4,-3,-3,-3,-2,-2,-2,-1,-1,
+      0,0,0,1,1,1,2,2,2,3,3,3,4,4,4,5,
+      5,5,6,6,6,7,7,7,8,8,8,9,9,9,10,10,
+      11,11,11,12,12,12,13,13,13,14,14,14,15,15,15,16,
+      16,16,17,17,17,18,18,18,19,19,19,20,20,20,21,21,
+      22,22,22,23,23,23,24,24,24,25,25,25,26,26,26,27,
+      27,27,28,28,28,29,29,29,30,30,30,31,31,31,32,32,
+      33,33,33,34,34,34,35,35,35,36,36,36,37,37,37,38,
+      38,38,39,39,39,40,40,40,41,41,41,42,42,42,43,43
+    };
+    static const int16_t CB_B[256]= {
+      -227,-226,-224,-222,-220,-219,-217,-215,-213,-212,-210,-208,-206,-204,-203,-201,
+      -199,-197,-196,-194,-192,-190,-188,-187,-185,-183,-181,-180,-178,-176,-174,-173,
+      -171,-169,-167,-165,-164,-162,-160,-158,-157,-155,-153,-151,-149,-148,-146,-144,
+      -142,-141,-139,-137,-135,-134,-132,-130,-128,-126,-125,-123,-121,-119,-118,-116,
+      -114,-112,-110,-109,-107,-105,-103,-102,-100,-98,-96,-94,-93,-91,-89,-87,
+      -86,-84,-82,-80,-79,-77,-75,-73,-71,-70,-68,-66,-64,-63,-61,-59,
+      -57,-55,-54,-52,-50,-48,-47,-45,-43,-41,-40,-38,-36,-34,-32,-31,
+      -29,-27,-25,-24,-22,-20,-18,-16,-15,-13,-11,-9,-8,-6,-4,-2,
+      0,1,3,5,7,8,10,12,14,15,17,19,21,23,24,26,
+      28,30,31,33,35,37,39,40,42,44,46,47,49,51,53,54,
+      56,58,60,62,63,65,67,69,70,72,74,76,78,79,81,83,
+      85,86,88,90,92,93,95,97,99,101,102,104,106,108,109,111,
+      113,115,117,118,120,122,124,125,127,129,131,133,134,136,138,140,
+      141,143,145,147,148,150,152,154,156,157,159,161,163,164,166,168,
+      170,172,173,175,177,179,180,182,184,186,187,189,191,193,195,196,
+      198,200,202,203,205,207,209,211,212,214,216,218,219,221,223,225
+    };
+    static const int16_t CR_R[256]= {
+      -179,-178,-177,-175,-174,-172,-171,-170,-168,-167,-165,-164,-163,-161,-160,-158,
+      -157,-156,-154,-153,-151,-150,-149,-147,-146,-144,-143,-142,-140,-139,-137,-136,
+      -135,-133,-132,-130,-129,-128,-126,-125,-123,-122,-121,-119,-118,-116,-115,-114,
+      -112,-111,-109,-108,-107,-105,-104,-102,-101,-100,-98,-97,-95,-94,-93,-91,
+      -90,-88,-87,-86,-84,-83,-81,-80,-79,-77,-76,-74,-73,-72,-70,-69,
+      -67,-66,-65,-63,-62,-60,-59,-57,-56,-55,-53,-52,-50,-49,-48,-46,
+      -45,-43,-42,-41,-39,-38,-36,-35,-34,-32,-31,-29,-28,-27,-25,-24,
+      -22,-21,-20,-18,-17,-15,-14,-13,-11,-10,-8,-7,-6,-4,-3,-1,
+      0,1,3,4,6,7,8,10,11,13,14,15,17,18,20,21,
+      22,24,25,27,28,29,31,32,34,35,36,38,39,41,42,43,
+      45,46,48,49,50,52,53,55,56,57,59,60,62,63,65,66,
+      67,69,70,72,73,74,76,77,79,80,81,83,84,86,87,88,
+      90,91,93,94,95,97,98,100,101,102,104,105,107,108,109,111,
+      112,114,115,116,118,119,121,122,123,125,126,128,129,130,132,133,
+      135,136,137,139,140,142,143,144,146,147,149,150,151,153,154,156,
+      157,158,160,161,163,164,165,167,168,170,171,172,174,175,177,178
+    };
+    static const int8_t CR_G[256]= {
+      -91,-91,-90,-89,-89,-88,-87,-86,-86,-85,-84,-84,-83,-82,-81,-81,
+      -80,-79,-79,-78,-77,-76,-76,-75,-74,-74,-73,-72,-71,-71,-70,-69,
+      -69,-68,-67,-66,-66,-65,-64,-64,-63,-62,-61,-61,-60,-59,-59,-58,
+      -57,-56,-56,-55,-54,-54,-53,-52,-51,-51,-50,-49,-49,-48,-47,-46,
+      -46,-45,-44,-44,-43,-42,-41,-41,-40,-39,-39,-38,-37,-36,-36,-35,
+      -34,-34,-33,-32,-31,-31,-30,-29,-29,-28,-27,-26,-26,-25,-24,-24,
+      -23,-22,-21,-21,-20,-19,-19,-18,-17,-16,-16,-15,-14,-14,-13,-12,
+      -11,-11,-10,-9,-9,-8,-7,-6,-6,-5,-4,-4,-3,-2,-1,-1,
+      0,1,1,2,3,4,4,5,6,6,7,8,9,9,10,11,
+      11,12,13,14,14,15,16,16,17,18,19,19,20,21,21,22,
+      23,24,24,25,26,26,27,28,29,29,30,31,31,32,33,34,
+      34,35,36,36,37,38,39,39,40,41,41,42,43,44,44,45,
+      46,46,47,48,49,49,50,51,51,52,53,54,54,55,56,56,
+      57,58,59,59,60,61,61,62,63,64,64,65,66,66,67,68,
+      69,69,70,71,71,72,73,74,74,75,76,76,77,78,79,79,
+      80,81,81,82,83,84,84,85,86,86,87,88,89,89,90,91
+    };
     /*----------------------------------------------------------------------------*/
     static void upsampleCb(uint8_t srcOfs,uint8_t dstOfs) {
       // Cb - affects G and B
@@ -1246,13 +1324,13 @@ namespace stm32plus {
           uint8_t cb=(uint8_t)*pSrc++;
           int16_t cbG,cbB;
 
-          cbG=((cb * 88U) >> 8U) - 44U;
+          cbG=CB_G[cb];
           pDstG[0]=subAndClamp(pDstG[0],cbG);
           pDstG[1]=subAndClamp(pDstG[1],cbG);
           pDstG[8]=subAndClamp(pDstG[8],cbG);
           pDstG[9]=subAndClamp(pDstG[9],cbG);
 
-          cbB=(cb + ((cb * 198U) >> 8U)) - 227U;
+          cbB=CB_B[cb];
           pDstB[0]=addAndClamp(pDstB[0],cbB);
           pDstB[1]=addAndClamp(pDstB[1],cbB);
           pDstB[8]=addAndClamp(pDstB[8],cbB);
@@ -1286,13 +1364,13 @@ namespace stm32plus {
           uint8_t cr=(uint8_t)*pSrc++;
           int16_t crR,crG;
 
-          crR=(cr + ((cr * 103U) >> 8U)) - 179;
+          crR=CR_R[cr];
           pDstR[0]=addAndClamp(pDstR[0],crR);
           pDstR[1]=addAndClamp(pDstR[1],crR);
           pDstR[8]=addAndClamp(pDstR[8],crR);
           pDstR[9]=addAndClamp(pDstR[9],crR);
 
-          crG=((cr * 183U) >> 8U) - 91;
+          crG=CR_G[cr];
           pDstG[0]=subAndClamp(pDstG[0],crG);
           pDstG[1]=subAndClamp(pDstG[1],crG);
           pDstG[8]=subAndClamp(pDstG[8],crG);
@@ -1334,12 +1412,12 @@ namespace stm32plus {
         uint8_t cb=(uint8_t)*pSrc++;
         int16_t cbG,cbB;
 
-        cbG=((cb * 88U) >> 8U) - 44U;
+        cbG=CB_G[cb];
 
         *pDstG=subAndClamp(pDstG[0],cbG);
         pDstG++;
 
-        cbB=(cb + ((cb * 198U) >> 8U)) - 227U;
+        cbB=CB_B[cb];
         *pDstB=addAndClamp(pDstB[0],cbB);
         pDstB++;
       }
@@ -1355,11 +1433,11 @@ namespace stm32plus {
         uint8_t cr=(uint8_t)*pSrc++;
         int16_t crR,crG;
 
-        crR=(cr + ((cr * 103U) >> 8U)) - 179;
+        crR=CR_R[cr];
         *pDstR=addAndClamp(pDstR[0],crR);
         pDstR++;
 
-        crG=((cr * 183U) >> 8U) - 91;
+        crG=CR_G[cr];
         *pDstG=subAndClamp(pDstG[0],crG);
         pDstG++;
       }
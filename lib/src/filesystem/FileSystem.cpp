@@ -118,6 +118,53 @@ namespace stm32plus {
     return _blockDevice.writeBlock(buffer,blockIndex);
   }
 
+  /**
+   * Read consecutive sectors from the file system. Where the block size equals the sector size this is
+   * a single multi-block read directly into the caller's buffer.
+   *
+   * @param[in] sectorIndex The index of the first sector to read. Zero is the first sector on the file system, not the block device.
+   * @param[in,out] buffer Caller supplied buffer large enough to hold all the sectors.
+   * @param[in] numSectors The number of sectors to read.
+   * @return false if it fails.
+   */
+
+  bool FileSystem::readSectors(uint32_t sectorIndex,void *buffer,uint32_t numSectors) {
+
+    uint8_t *ptr;
+
+    if(_blockDevice.getBlockSizeInBytes() == getSectorSizeInBytes())
+      return _blockDevice.readBlocks(buffer,sectorIndexToBlockIndex(_firstSectorIndex + sectorIndex),numSectors);
+
+    // fall back to one at a time
+
+    for(ptr=static_cast<uint8_t *> (buffer);numSectors--;ptr+=getSectorSizeInBytes())
+      if(!readSector(sectorIndex++,ptr))
+        return false;
+
+    return true;
+  }
+
+  /**
+   * Write consecutive sectors to the file system as a single multi-block write.
+   *
+   * @param[in] sectorIndex The index of the first sector to write. Zero is the first sector on the file system, not the block device.
+   * @param[in] buffer Buffer that holds the sector data to write.
+   * @param[in] numSectors The number of sectors to write.
+   * @return false if it fails.
+   */
+
+  bool FileSystem::writeSectors(uint32_t sectorIndex,const void *buffer,uint32_t numSectors) {
+
+    errorProvider.clear();
+
+    // not supporting non-aligned block/sector sizes for now
+
+    if(_blockDevice.getBlockSizeInBytes() != getSectorSizeInBytes())
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_FILESYSTEM,E_UNEQUAL_BLOCK_SECTOR_SIZES);
+
+    return _blockDevice.writeBlocks(buffer,sectorIndexToBlockIndex(_firstSectorIndex + sectorIndex),numSectors);
+  }
+
   /*
    * Convert a sector index to a block index
    */
@@ -0,0 +1,187 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * Constructor
+     * @param[in] fs A reference to the FAT file system. Must not go out of scope.
+     * @param[in] bitmap The free cluster bitmap for the file system. Must not go out of scope.
+     * @param[in] startCluster The cluster to start searching at. Out of range values start at the first cluster.
+     */
+
+    BitmapFreeClusterFinder::BitmapFreeClusterFinder(FatFileSystem& fs,FreeClusterBitmap& bitmap,uint32_t startCluster) :
+      FreeClusterFinder(fs), _bitmap(bitmap) {
+
+      _nextCluster=startCluster<2 || startCluster>=bitmap.getNumClusters() ? 2 : startCluster;
+    }
+
+
+    /**
+     * Find the next free cluster at or after the current search position, wrapping around
+     * to the start of the FAT.
+     * @param[out] freeCluster The free cluster.
+     * @return false if there are no free clusters or there is an error.
+     *
+     * @see FreeClusterFinder::find
+     */
+
+    bool BitmapFreeClusterFinder::find(uint32_t& freeCluster) {
+
+      uint32_t cluster,groupEnd,maxVisits,i;
+      bool free,wholeGroup;
+
+      cluster=_nextCluster;
+      maxVisits=_bitmap.getNumClusters()/_bitmap.getClustersPerBit()+2;
+
+      for(i=0;i<maxVisits && _bitmap.findGroup(cluster,cluster);i++) {
+
+        // clusters 0 and 1 are reserved
+
+        if(cluster<2)
+          cluster=2;
+
+        // an exact bitmap is authoritative
+
+        if(_bitmap.isExact()) {
+          freeCluster=cluster;
+          _nextCluster=cluster+1;
+          return true;
+        }
+
+        // search the rest of the group in the FAT
+
+        wholeGroup=cluster<=2 || (cluster & (_bitmap.getClustersPerBit()-1))==0;
+
+        groupEnd=(cluster | (_bitmap.getClustersPerBit()-1))+1;
+        if(groupEnd>_bitmap.getNumClusters())
+          groupEnd=_bitmap.getNumClusters();
+
+        for(;cluster<groupEnd;cluster++) {
+
+          if(!isFree(cluster,free))
+            return false;
+
+          if(free) {
+            freeCluster=cluster;
+            _nextCluster=cluster+1;
+            return true;
+          }
+        }
+
+        // nothing free in here. if we looked at all of it then we can say so in the bitmap
+
+        if(wholeGroup)
+          _bitmap.markGroupFull(groupEnd-1);
+      }
+
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_FREE_CLUSTER_FINDER,E_NO_FREE_CLUSTERS);
+    }
+
+
+    /**
+     * Find a sequence of at least the given number of clusters that are all free. The search
+     * starts at the hint given to the constructor and wraps around to the first data cluster.
+     * A run does not continue across the wrap. Groups that are known to be full are skipped
+     * without reading the FAT.
+     * @param[in] clustersRequired The number of consecutive free clusters required.
+     * @param[out] firstCluster The first cluster in the run.
+     * @return false if there is no such run or there is an error.
+     */
+
+    bool BitmapFreeClusterFinder::findMultipleSequential(uint32_t clustersRequired,uint32_t& firstCluster) {
+
+      uint32_t cluster,next,run,remaining,skipped,numClusters;
+      bool free;
+
+      numClusters=_bitmap.getNumClusters();
+
+      if(clustersRequired==0 || clustersRequired>numClusters-2)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_FREE_CLUSTER_FINDER,E_NO_FREE_CLUSTERS);
+
+      // go round far enough to find a run that straddles the start
+
+      run=0;
+      cluster=_nextCluster;
+      remaining=numClusters-2+clustersRequired-1;
+
+      while(remaining>0) {
+
+        if(cluster>=numClusters) {
+          cluster=2;
+          run=0;
+        }
+
+        // skip over groups that are known to be full. The group search wraps around too.
+
+        if(!_bitmap.mayBeFree(cluster)) {
+
+          if(!_bitmap.findGroup(cluster,next))
+            break;
+
+          if(next<2)
+            next=2;
+
+          skipped=next>cluster ? next-cluster : numClusters-cluster+next-2;
+
+          if(skipped>=remaining)
+            break;
+
+          remaining-=skipped;
+          cluster=next;
+          run=0;
+          continue;
+        }
+
+        if(!isFree(cluster,free))
+          return false;
+
+        if(!free)
+          run=0;
+        else {
+
+          if(run==0)
+            firstCluster=cluster;
+
+          if(++run==clustersRequired)
+            return true;
+        }
+
+        cluster++;
+        remaining--;
+      }
+
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_FREE_CLUSTER_FINDER,E_NO_FREE_CLUSTERS);
+    }
+
+
+    /*
+     * Check if a cluster is free. Only called for clusters in groups that may be free so an
+     * exact bitmap does not need to consult the FAT.
+     */
+
+    bool BitmapFreeClusterFinder::isFree(uint32_t clusterNumber,bool& free) {
+
+      uint32_t entry;
+
+      if(_bitmap.isExact()) {
+        free=true;
+        return true;
+      }
+
+      if(!_fs.readFatEntry(clusterNumber,entry))
+        return false;
+
+      free=entry==0;
+      return true;
+    }
+  }
+}
@@ -25,6 +25,7 @@ namespace stm32plus {
       _first=true;
       _firstClusterNumber=firstClusterNumber_;
       _extend=extend_;
+      _clustersWanted=1;
     }
 
     /**
@@ -37,6 +38,17 @@ namespace stm32plus {
       _first=true;
     }
 
+    /**
+     * Set the number of clusters that the caller expects to add to the chain. When the chain is
+     * extended and can't continue into the next cluster this is passed to the file system so that
+     * the new clusters go in a free run that will hold them all.
+     * @param[in] clustersWanted The number of clusters, 1 if not known.
+     */
+
+    void ClusterChainIterator::setClustersWanted(uint32_t clustersWanted) {
+      _clustersWanted=clustersWanted;
+    }
+
     /*
      * Get the current cluster number
      */
@@ -86,7 +98,7 @@ namespace stm32plus {
 
           // try to extend the cluster chain with a new entry
 
-          if(!_fs.allocateNewCluster(_currentClusterNumber,nextNumber))
+          if(!_fs.allocateNewCluster(_currentClusterNumber,nextNumber,_clustersWanted))
             return false;
         } else
           return errorProvider.set(ErrorProvider::ERROR_PROVIDER_ITERATOR,E_END_OF_ENTRIES);
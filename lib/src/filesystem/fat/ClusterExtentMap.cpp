@@ -0,0 +1,156 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * Constructor
+     * @param[in] maxExtents The maximum number of extents to hold. Each one costs 12 bytes of RAM.
+     */
+
+    ClusterExtentMap::ClusterExtentMap(uint32_t maxExtents) {
+      _extents=new Extent[maxExtents];
+      _maxExtents=maxExtents;
+      _extentCount=0;
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    ClusterExtentMap::~ClusterExtentMap() {
+      delete [] _extents;
+    }
+
+
+    /**
+     * Forget all the extents
+     */
+
+    void ClusterExtentMap::clear() {
+      _extentCount=0;
+    }
+
+
+    /**
+     * Record that the given cluster index in the file lives at the given cluster number. Only
+     * the cluster immediately following the last one recorded is accepted, anything else is
+     * either already known or would leave a gap.
+     * @param[in] fileClusterIndex The zero-based cluster index within the file.
+     * @param[in] clusterNumber The cluster number on the device.
+     */
+
+    void ClusterExtentMap::add(uint32_t fileClusterIndex,uint32_t clusterNumber) {
+
+      Extent *last;
+
+      if(_extentCount == 0) {
+
+        if(fileClusterIndex != 0 || _maxExtents == 0)
+          return;
+      }
+      else {
+
+        last=&_extents[_extentCount - 1];
+
+        if(fileClusterIndex != last->FileClusterIndex + last->Length)
+          return;
+
+        // extend the last run if this cluster is adjacent to it
+
+        if(clusterNumber == last->FirstCluster + last->Length) {
+          last->Length++;
+          return;
+        }
+
+        if(_extentCount == _maxExtents)
+          return;
+      }
+
+      // start a new run
+
+      _extents[_extentCount].FileClusterIndex=fileClusterIndex;
+      _extents[_extentCount].FirstCluster=clusterNumber;
+      _extents[_extentCount].Length=1;
+      _extentCount++;
+    }
+
+
+    /**
+     * Look up the cluster number for a cluster index in the file.
+     * @param[in] fileClusterIndex The zero-based cluster index within the file.
+     * @param[out] clusterNumber The cluster number on the device.
+     * @return false if the index is not in the map.
+     */
+
+    bool ClusterExtentMap::find(uint32_t fileClusterIndex,uint32_t& clusterNumber) const {
+
+      uint32_t low,high,mid;
+
+      // binary search for the last extent starting at or before the index
+
+      low=0;
+      high=_extentCount;
+
+      while(low < high) {
+
+        mid=(low + high) / 2;
+
+        if(_extents[mid].FileClusterIndex <= fileClusterIndex)
+          low=mid + 1;
+        else
+          high=mid;
+      }
+
+      if(low == 0)
+        return false;
+
+      const Extent& extent(_extents[low - 1]);
+
+      if(fileClusterIndex - extent.FileClusterIndex >= extent.Length)
+        return false;
+
+      clusterNumber=extent.FirstCluster + (fileClusterIndex - extent.FileClusterIndex);
+      return true;
+    }
+
+
+    /**
+     * Get the last cluster known to the map.
+     * @param[out] fileClusterIndex The zero-based cluster index within the file.
+     * @param[out] clusterNumber The cluster number on the device.
+     * @return false if the map is empty.
+     */
+
+    bool ClusterExtentMap::getLast(uint32_t& fileClusterIndex,uint32_t& clusterNumber) const {
+
+      if(_extentCount == 0)
+        return false;
+
+      const Extent& extent(_extents[_extentCount - 1]);
+
+      fileClusterIndex=extent.FileClusterIndex + extent.Length - 1;
+      clusterNumber=extent.FirstCluster + extent.Length - 1;
+      return true;
+    }
+
+
+    /**
+     * Get the number of extents in the map
+     * @return The extent count.
+     */
+
+    uint32_t ClusterExtentMap::getExtentCount() const {
+      return _extentCount;
+    }
+  }
+}
@@ -28,13 +28,70 @@ namespace stm32plus {
 
       _rootDirFirstSector=clusterToSector(_bootSector.fat32.BPB_RootClus);
       _firstDataSector=_bootSector.BPB_RsvdSecCnt+(_bootSector.BPB_NumFATs*_bootSector.fat32.BPB_FATSz32);
+
+      readFreeSpaceInfo();
     }
 
     /**
-     * Destructor
+     * Destructor. Writes back the FAT and the free space information.
      */
 
     Fat32FileSystem::~Fat32FileSystem() {
+      sync();
+    }
+
+
+    /*
+     * Read the free cluster count and next free hint from the FSInfo sector. Values that fail
+     * the range checks are ignored.
+     */
+
+    void Fat32FileSystem::readFreeSpaceInfo() {
+
+      ByteMemblock sector(getSectorSizeInBytes());
+      const Fat32FsInfo *fsinfo;
+
+      if(!readSector(_bootSector.fat32.BPB_FSInfo,sector))
+        return;
+
+      fsinfo=reinterpret_cast<const Fat32FsInfo *>(sector.getData());
+
+      if(fsinfo->FSI_LeadSig!=Fat32FsInfo::FSINFO_LEAD_SIG || fsinfo->FSI_StrucSig!=Fat32FsInfo::FSINFO_STRUC_SIG || fsinfo->FSI_TrailSig!=Fat32FsInfo::FSINFO_TRAIL_SIG)
+        return;
+
+      if(fsinfo->FSI_Free_Count<=_countOfClusters) {
+        _freeClusterCount=fsinfo->FSI_Free_Count;
+        _freeSpaceInfoValid=true;
+      }
+
+      if(fsinfo->FSI_Nxt_Free>=2 && fsinfo->FSI_Nxt_Free<_countOfClusters+2)
+        _nextFreeCluster=fsinfo->FSI_Nxt_Free;
+    }
+
+
+    /*
+     * Write the free cluster count and next free hint to the FSInfo sector
+     */
+
+    bool Fat32FileSystem::writeFreeSpaceInfo(bool valid) {
+
+      ByteMemblock sector(getSectorSizeInBytes());
+      Fat32FsInfo *fsinfo;
+
+      if(!readSector(_bootSector.fat32.BPB_FSInfo,sector))
+        return false;
+
+      fsinfo=reinterpret_cast<Fat32FsInfo *>(sector.getData());
+
+      // don't write to something that isn't an FSInfo sector
+
+      if(fsinfo->FSI_LeadSig!=Fat32FsInfo::FSINFO_LEAD_SIG || fsinfo->FSI_StrucSig!=Fat32FsInfo::FSINFO_STRUC_SIG || fsinfo->FSI_TrailSig!=Fat32FsInfo::FSINFO_TRAIL_SIG)
+        return true;
+
+      fsinfo->FSI_Free_Count=valid ? _freeClusterCount : 0xFFFFFFFF;
+      fsinfo->FSI_Nxt_Free=valid ? _nextFreeCluster : 0xFFFFFFFF;
+
+      return writeSector(_bootSector.fat32.BPB_FSInfo,sector);
     }
 
     /**
@@ -25,6 +25,39 @@ namespace stm32plus {
                 ClusterChainIterator::extensionExtend) {
 
       _dirent=dirent_; // struct copy
+      _extentMap=nullptr;
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    FatFile::~FatFile() {
+      delete _extentMap;
+    }
+
+
+    /**
+     * Keep a map of the runs of contiguous clusters in this file so that seek() can go straight to
+     * the right cluster instead of walking the cluster chain from the start. The map is filled in
+     * as the file is read, written and seeked. A file that fits in maxExtents runs is fully mapped,
+     * otherwise seeks beyond the mapped part continue to walk the chain from the end of the map.
+     * @param[in] maxExtents The maximum number of runs to hold. Each one costs 12 bytes.
+     * @return false if the current position could not be restored.
+     */
+
+    bool FatFile::enableExtentMap(uint32_t maxExtents) {
+
+      delete _extentMap;
+
+      _extentMap=new ClusterExtentMap(maxExtents);
+      _iterator.setExtentMap(_extentMap);
+
+      // the map must start at the beginning of the file
+
+      _iterator.reset(getFirstCluster());
+      return seek(_offset,SeekStart);
     }
 
 
@@ -35,7 +68,7 @@ namespace stm32plus {
     bool FatFile::read(void *ptr_,uint32_t size_,uint32_t& actuallyRead_) {
 
       uint32_t sectorSize=_fs.getSectorSizeInBytes();
-      uint32_t fileLength,sectorOffset,copySize,available,remainingInFile;
+      uint32_t fileLength,sectorOffset,copySize,available,remainingInFile,firstSector,numSectors;
       uint8_t *current;
 
       fileLength=getLength();
@@ -61,6 +94,28 @@ namespace stm32plus {
         if(_offset == fileLength)
           return true;
 
+        // if we're on a sector boundary and the caller wants at least a whole sector then read
+        // runs of contiguous sectors straight into the caller's buffer
+
+        remainingInFile=fileLength - _offset;
+
+        if(sectorOffset == 0 && size_ >= sectorSize && remainingInFile >= sectorSize) {
+
+          available=(size_ < remainingInFile ? size_ : remainingInFile) / sectorSize;
+
+          if(!_iterator.nextRun(available,firstSector,numSectors) || !_fs.readSectors(firstSector,current,numSectors))
+            return false;
+
+          copySize=numSectors * sectorSize;
+
+          size_-=copySize;
+          current+=copySize;
+          _offset+=copySize;
+          actuallyRead_+=copySize;
+
+          continue;
+        }
+
         // are we on a new sector?
 
         if(_offset % sectorSize == 0 && !_iterator.next())
@@ -73,7 +128,6 @@ namespace stm32plus {
 
         // calculate the copy size
 
-        remainingInFile=fileLength - _offset;
         available=remainingInFile < sectorSize - sectorOffset ? remainingInFile : sectorSize - sectorOffset;
         copySize=size_ < available ? size_ : available;
 
@@ -106,7 +160,12 @@ namespace stm32plus {
       uint16_t d,t;
       const uint8_t *current=static_cast<const uint8_t *> (ptr_);
       DirectoryEntry& dirent=_dirent.Dirent;
-      uint32_t sectorOffset,amountToCopy,sectorSize=_fs.getSectorSizeInBytes();
+      uint32_t sectorOffset,amountToCopy,firstSector,numSectors,clusterSize,sectorSize=_fs.getSectorSizeInBytes();
+
+      // if the file has to grow then try to keep all of this write in one run of clusters
+
+      clusterSize=sectorSize * _fs.getBootSector().BPB_SecPerClus;
+      _iterator.setClustersWanted((size_ + clusterSize - 1) / clusterSize);
 
       // need to get the file pointer on to a sector boundary
 
@@ -149,6 +208,26 @@ namespace stm32plus {
 
       while(size_ > 0) {
 
+        // whole sectors are written in contiguous runs directly from the caller's buffer. The first
+        // sector of an empty file goes the slow way so that the dirent gets its first cluster.
+
+        if(size_ >= sectorSize && getLength() != 0) {
+
+          if(!_iterator.nextRun(size_ / sectorSize,firstSector,numSectors) || !_fs.writeSectors(firstSector,current,numSectors))
+            return false;
+
+          amountToCopy=numSectors * sectorSize;
+
+          current+=amountToCopy;
+          size_-=amountToCopy;
+          _offset+=amountToCopy;
+
+          if(_offset > dirent.sdir.DIR_FileSize)
+            dirent.sdir.DIR_FileSize=_offset;
+
+          continue;
+        }
+
         // move to the next sector if we're on the end
 
         if(_offset % sectorSize == 0 && !_iterator.next())
@@ -246,16 +325,22 @@ namespace stm32plus {
       if(newOffset % _fs.getSectorSizeInBytes() > 0)
         sectorCount++;
 
-      _iterator.reset((static_cast<uint32_t> (dirent.sdir.DIR_FstClusHI) << 16) | dirent.sdir.DIR_FstClusLO);
-
-      while(sectorCount--)
-        if(!_iterator.next())
-          return false;
+      if(!_iterator.moveTo(getFirstCluster(),sectorCount))
+        return false;
 
       _offset=newOffset;
       return true;
     }
 
+    /*
+     * Get the first cluster in the chain from the dirent
+     */
+
+    uint32_t FatFile::getFirstCluster() const {
+      return (static_cast<uint32_t> (_dirent.Dirent.sdir.DIR_FstClusHI) << 16) | _dirent.Dirent.sdir.DIR_FstClusLO;
+    }
+
+
     /**
      * @copydoc File::getLength
      */
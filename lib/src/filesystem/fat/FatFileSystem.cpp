@@ -22,13 +22,39 @@ namespace stm32plus {
       _bootSector=bootSector; // struct copy
       _fatFirstSector=_bootSector.BPB_RsvdSecCnt; // sector index of the FAT
       _sectorsPerBlock=blockDevice.getBlockSizeInBytes() / _bootSector.BPB_BytsPerSec;
+
+      // the FAT size is needed by the destructor when the virtual getSectorsPerFat() is no longer available
+
+      _fatSize=_bootSector.BPB_FATSz16!=0 ? _bootSector.BPB_FATSz16 : _bootSector.fat32.BPB_FATSz32;
+
+      // set up the FAT sector cache
+
+      _fatCache=nullptr;
+      _fatCacheMemory=nullptr;
+      _fatCacheSize=0;
+      _fatCacheClock=0;
+
+      resetFatCacheStatistics();
+      setFatCacheSize(DEFAULT_FAT_CACHE_SECTORS);
+
+      // free space is unknown until a subclass or a scan finds out
+
+      _freeClusterBitmap=nullptr;
+      _freeClusterCount=UNKNOWN_FREE_CLUSTER_COUNT;
+      _nextFreeCluster=2;
+      _freeSpaceInfoValid=false;
+      _invalidateFreeSpaceInfo=false;
     }
 
     /**
-     * Virtual destructor, does nothing.
+     * Virtual destructor, writes back any modified FAT sectors. Subclasses that store free space
+     * information must call sync() in their own destructor.
      */
 
     FatFileSystem::~FatFileSystem() {
+      sync();
+      freeFatCache();
+      delete _freeClusterBitmap;
     }
 
     /**
@@ -39,14 +65,17 @@ namespace stm32plus {
      * update the directory entry with write times.
      * @param[out] newFileSystem Reference to a caller supplied pointer that will be filled in with the appropriate FatFileSystem instance.
      * The caller owns this pointer and must delete it when finished.
+     * @param[in] freeClusterBitmapBytes RAM to spend on a free cluster bitmap that is built now by reading the whole FAT.
+     * The bitmap is exact if it fits, otherwise each bit covers the smallest power of 2 clusters that makes it fit. The
+     * default of zero does not build one and allocation uses the wear resistant search. See enableFreeClusterBitmap().
      * @return false if it fails, error provider will be filled in.
      */
 
-    bool FatFileSystem::getInstance(BlockDevice& blockDevice,const TimeProvider& timeProvider,FatFileSystem*& newFileSystem) {
+    bool FatFileSystem::getInstance(BlockDevice& blockDevice,const TimeProvider& timeProvider,FatFileSystem*& newFileSystem,uint32_t freeClusterBitmapBytes) {
 
       ByteMemblock bootSectorBytes(blockDevice.getBlockSizeInBytes());
       fat::BootSector bs;
-      uint32_t rootDirSectors,fatSize,totalSectors,dataSectors,countOfClusters,firstSectorIndex;
+      uint32_t rootDirSectors,fatSize,totalSectors,dataSectors,countOfClusters,firstSectorIndex,maxGroups,clustersPerBit;
 
       // read block zero
 
@@ -117,6 +146,22 @@ namespace stm32plus {
       else
         newFileSystem=new Fat32FileSystem(blockDevice,timeProvider,bs,firstSectorIndex,countOfClusters);
 
+      // build the free cluster bitmap in the RAM that the caller can spare. It's allocated in whole words.
+
+      if(freeClusterBitmapBytes) {
+
+        maxGroups=((freeClusterBitmapBytes+3)/4)*32;
+
+        for(clustersPerBit=1;(countOfClusters+2+clustersPerBit-1)/clustersPerBit>maxGroups;clustersPerBit<<=1)
+          ;
+
+        if(!newFileSystem->enableFreeClusterBitmap(clustersPerBit)) {
+          delete newFileSystem;
+          newFileSystem=nullptr;
+          return false;
+        }
+      }
+
       return true;
     }
 
@@ -171,26 +216,19 @@ namespace stm32plus {
 
     bool FatFileSystem::readFatEntry(uint32_t clusterNumber,uint32_t& fatEntryForCluster) {
 
-      uint32_t sectorIndex,fatEntOffset,fatOffset;
-      ByteMemblock sector(_bootSector.BPB_BytsPerSec);
+      FatCacheEntry *entry;
+      uint32_t offset;
 
-      // get the byte offset into the fat of the cluster entry
+      _fatCacheStatistics.FatEntryReads++;
 
-      fatOffset=clusterNumber * getFatEntrySizeInBytes();
+      // get the cached sector that holds the entry
 
-      // now get the sector index that holds the fat entry and the offset into that sector of the fat entry
-
-      sectorIndex=_bootSector.BPB_RsvdSecCnt + (fatOffset / _bootSector.BPB_BytsPerSec);
-      fatEntOffset=fatOffset % _bootSector.BPB_BytsPerSec;
-
-      // read the sector
-
-      if(!readSector(sectorIndex,sector))
+      if(!getFatCacheEntry(clusterNumber,entry,offset))
         return false;
 
       // get the value from the fat
 
-      fatEntryForCluster=getFatEntryFromMemory(static_cast<uint8_t *> (sector) + fatEntOffset);
+      fatEntryForCluster=getFatEntryFromMemory(entry->Data + offset);
       return true;
     }
 
@@ -358,7 +396,10 @@ namespace stm32plus {
 
       retval=it->getDirectoryEntryIterator().writeDirents(lndg.getDirents(),lndg.getDirentCount());
       delete it;
-      return retval;
+
+      // writing the dirents may have extended the directory's cluster chain
+
+      return flushFatCache() && retval;
     }
 
     /**
@@ -597,7 +638,7 @@ namespace stm32plus {
       if(clusterNumber != 0 && !writeFatEntry(clusterNumber,0))
         return false;
 
-      return true;
+      return flushFatCache();
     }
 
     /*
@@ -736,20 +777,22 @@ namespace stm32plus {
      * Allocate a new cluster into the chain. This function will seek to the end of the cluster
      * chain and then allocate a new cluster and link it to the end of the chain.
      *
-     * @param[in] anyClusterInChain Any cluster number in the chain.
+     * @param[in] anyClusterInChain Any cluster number in the chain, or zero to start a new chain.
      * @param[out] newCluster The newly allocated cluster number.
+     * @param[in] clustersWanted The number of clusters that the caller expects to add to the chain. If there is an exact
+     *   free cluster bitmap and the chain can't continue into the next cluster then the new cluster is the first of a free
+     *   run this long, if there is one.
      * @return false if it fails.
      */
 
-    bool FatFileSystem::allocateNewCluster(uint32_t anyClusterInChain,uint32_t& newCluster) {
-
-      // find a free cluster
+    bool FatFileSystem::allocateNewCluster(uint32_t anyClusterInChain,uint32_t& newCluster,uint32_t clustersWanted) {
 
-      if(!findFreeCluster(newCluster))
-        return false;
+      uint32_t lastCluster,hint;
 
       // step to the end of the cluster chain if this is not the first cluster in an empty file
 
+      lastCluster=0;
+
       if(anyClusterInChain != 0) {
 
         ClusterChainIterator cit(*this,anyClusterInChain,ClusterChainIterator::extensionDontExtend);
@@ -761,19 +804,36 @@ namespace stm32plus {
         if(!errorProvider.isLastError(ErrorProvider::ERROR_PROVIDER_ITERATOR,ClusterChainIterator::E_END_OF_ENTRIES))
           return false;
 
-        // link the free cluster to the previous EOC
-
-        if(!writeFatEntry(cit.current(),newCluster))
-          return false;
+        lastCluster=cit.current();
       }
 
+      // find a free cluster, preferably straight after the end of the chain. A new chain starts at the next free hint.
+
+      hint=lastCluster != 0 ? lastCluster + 1 : _nextFreeCluster;
+
+      if(!findFreeCluster(newCluster,hint))
+        return false;
+
+      // if the chain can't continue contiguously then move it to a free run that will hold the rest of the
+      // write. Only an exact bitmap can do that without reading the FAT for every cluster in the search.
+
+      if(newCluster != lastCluster + 1 && clustersWanted > 1 && _freeClusterBitmap && _freeClusterBitmap->isExact()
+          && !findFreeRun(clustersWanted,hint,newCluster))
+        return false;
+
+      // link the free cluster to the previous EOC
+
+      if(lastCluster != 0 && !writeFatEntry(lastCluster,newCluster))
+        return false;
+
       // write EOC to free cluster
 
       return writeFatEntry(newCluster,getEndOfClusterChainMarker());
     }
 
     /**
-     * Write an entry to both copies of the FAT. The assumption here is that both FAT entries are
+     * Write an entry to the FAT. The entry is modified in the FAT sector cache and all copies of the
+     * FAT are updated when the sector is written back. The assumption here is that all FAT copies are
      * identical, as they should be except in the case of recoverable corruption.
      * @param[in] fatEntryIndex The FAT index to write to.
      * @param[in] fatEntryContent The content of the entry to write.
@@ -782,38 +842,345 @@ namespace stm32plus {
 
     bool FatFileSystem::writeFatEntry(uint32_t fatEntryIndex,uint32_t fatEntryContent) {
 
-      uint32_t sectorIndex,fatEntOffset,fatOffset;
-      Memblock<uint8_t> sector(_bootSector.BPB_BytsPerSec);
+      FatCacheEntry *entry;
+      uint32_t offset;
+
+      _fatCacheStatistics.FatEntryWrites++;
+
+      // get the cached sector that holds the entry
+
+      if(!getFatCacheEntry(fatEntryIndex,entry,offset))
+        return false;
+
+      // keep the free space accounting up to date if this allocates or frees the cluster
+
+      if((getFatEntryFromMemory(entry->Data + offset) == 0) != (fatEntryContent == 0)) {
+
+        if(fatEntryContent == 0) {
+
+          if(_freeClusterCount != UNKNOWN_FREE_CLUSTER_COUNT)
+            _freeClusterCount++;
+
+          if(_freeClusterBitmap)
+            _freeClusterBitmap->markFree(fatEntryIndex);
+        }
+        else {
+
+          if(_freeClusterCount != UNKNOWN_FREE_CLUSTER_COUNT)
+            _freeClusterCount--;
+
+          if(_freeClusterBitmap)
+            _freeClusterBitmap->markUsed(fatEntryIndex);
+
+          // the search wraps around to the first data cluster after the last one
+
+          if((_nextFreeCluster=fatEntryIndex + 1) >= _countOfClusters + 2)
+            _nextFreeCluster=2;
+        }
+
+        // the free space info on the device is now stale and will be marked as unknown on the next flush
+
+        if(_freeSpaceInfoValid) {
+          _freeSpaceInfoValid=false;
+          _invalidateFreeSpaceInfo=true;
+        }
+      }
+
+      // modify the value in the sector
+
+      setFatEntryToMemory(entry->Data + offset,fatEntryContent);
+      entry->Dirty=true;
+
+      return true;
+    }
+
+
+    /**
+     * Write all modified FAT sectors in the cache back to every copy of the FAT on the device.
+     * @return false if it fails.
+     */
+
+    bool FatFileSystem::flushFatCache() {
+
+      uint32_t i;
+
+      for(i=0;i < _fatCacheSize;i++)
+        if(_fatCache[i].Dirty && !writeBackFatCacheEntry(_fatCache[i]))
+          return false;
+
+      // if the free space changed then the info on the device can no longer be trusted
+
+      if(_invalidateFreeSpaceInfo) {
+
+        if(!writeFreeSpaceInfo(false))
+          return false;
 
-      // get the byte offset into the fat of the cluster entry
+        _invalidateFreeSpaceInfo=false;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Flush the FAT cache and, if it is known, write the current free space information to the device.
+     * Call this before removing the media to avoid a full FAT scan the next time the free space is
+     * needed.
+     * @return false if it fails.
+     */
+
+    bool FatFileSystem::sync() {
+
+      if(!flushFatCache())
+        return false;
+
+      if(!_freeSpaceInfoValid && _freeClusterCount != UNKNOWN_FREE_CLUSTER_COUNT) {
+
+        if(!writeFreeSpaceInfo(true))
+          return false;
+
+        _freeSpaceInfoValid=true;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Build a summary of the free clusters in the FAT so that allocation can skip the parts that
+     * are full and the free space is known without scanning. The FAT is read once, several sectors
+     * at a time, and the bitmap is kept up to date as the FAT changes. getInstance() calls this at
+     * mount when it's given a RAM budget for the bitmap. Reading the FAT of a large card takes a
+     * while so the bitmap is not built unless it's asked for.
+     * @param[in] clustersPerBit The number of clusters covered by each bit. 1 gives an exact bitmap that
+     *   needs (clusters/8) bytes of RAM. Larger powers of 2 reduce the RAM required.
+     * @return false if it fails.
+     */
+
+    bool FatFileSystem::enableFreeClusterBitmap(uint32_t clustersPerBit) {
+
+      uint32_t i,entry,sectorIndex,sectorsPerRead,entriesPerSector,numEntries,freeCount,sectorSize;
+      uint8_t *ptr;
+
+      // the FAT is read directly from the device so the cache must be written back first
+
+      if(!flushFatCache())
+        return false;
+
+      delete _freeClusterBitmap;
+
+      numEntries=_countOfClusters + 2;
+      _freeClusterBitmap=new FreeClusterBitmap(numEntries,clustersPerBit);
+
+      sectorSize=getSectorSizeInBytes();
+      entriesPerSector=sectorSize / getFatEntrySizeInBytes();
+      sectorsPerRead=FREE_CLUSTER_SCAN_SECTORS;
+
+      ByteMemblock sectors(sectorsPerRead * sectorSize);
+
+      sectorIndex=_bootSector.BPB_RsvdSecCnt;
+      freeCount=0;
+      entry=0;
+
+      while(entry < numEntries) {
+
+        // read a batch of FAT sectors
+
+        if(sectorsPerRead > (numEntries - entry + entriesPerSector - 1) / entriesPerSector)
+          sectorsPerRead=(numEntries - entry + entriesPerSector - 1) / entriesPerSector;
+
+        if(!readSectors(sectorIndex,sectors,sectorsPerRead)) {
+          delete _freeClusterBitmap;
+          _freeClusterBitmap=nullptr;
+          return false;
+        }
+
+        sectorIndex+=sectorsPerRead;
+
+        // mark the free entries
+
+        ptr=sectors;
+        for(i=sectorsPerRead * entriesPerSector;i && entry < numEntries;i--,entry++) {
+
+          if(getFatEntryFromMemory(ptr) == 0) {
+            _freeClusterBitmap->markFree(entry);
+            freeCount++;
+          }
+
+          ptr+=getFatEntrySizeInBytes();
+        }
+      }
+
+      // now we know the real free count. If it's not what the device says then sync() will correct it
+
+      if(freeCount != _freeClusterCount) {
+        _freeClusterCount=freeCount;
+        _freeSpaceInfoValid=false;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Get the free cluster bitmap
+     * @return The bitmap, or nullptr if enableFreeClusterBitmap() has not been called.
+     */
+
+    FreeClusterBitmap *FatFileSystem::getFreeClusterBitmap() const {
+      return _freeClusterBitmap;
+    }
+
+
+    /**
+     * Change the number of FAT sectors held in the cache. Any modified sectors are written back
+     * first. The default is DEFAULT_FAT_CACHE_SECTORS.
+     * @param[in] numSectors The new cache size in sectors. Must be at least 1.
+     * @return false if the modified sectors could not be written back.
+     */
+
+    bool FatFileSystem::setFatCacheSize(uint32_t numSectors) {
+
+      uint32_t i,sectorSize;
+
+      if(numSectors == 0)
+        numSectors=1;
+
+      if(!flushFatCache())
+        return false;
+
+      freeFatCache();
+
+      sectorSize=getSectorSizeInBytes();
+
+      _fatCacheSize=numSectors;
+      _fatCache=new FatCacheEntry[numSectors];
+      _fatCacheMemory=new uint8_t[numSectors * sectorSize];
+
+      for(i=0;i < numSectors;i++) {
+        _fatCache[i].SectorIndex=FREE_FAT_CACHE_ENTRY;
+        _fatCache[i].LastUsed=0;
+        _fatCache[i].Data=_fatCacheMemory + i * sectorSize;
+        _fatCache[i].Dirty=false;
+      }
+
+      return true;
+    }
+
+
+    /**
+     * Get the FAT cache statistics
+     * @return A reference to the internal statistics counters.
+     */
+
+    const FatFileSystem::FatCacheStatistics& FatFileSystem::getFatCacheStatistics() const {
+      return _fatCacheStatistics;
+    }
+
+
+    /**
+     * Reset the FAT cache statistics to zero
+     */
+
+    void FatFileSystem::resetFatCacheStatistics() {
+      memset(&_fatCacheStatistics,0,sizeof(_fatCacheStatistics));
+    }
+
+
+    /*
+     * Get the cache entry for the FAT sector that holds the given FAT entry index. The least
+     * recently used sector is replaced (and written back if modified) on a miss.
+     */
+
+    bool FatFileSystem::getFatCacheEntry(uint32_t fatEntryIndex,FatCacheEntry*& entry,uint32_t& offset) {
+
+      uint32_t i,sectorIndex,fatOffset;
+      FatCacheEntry *victim;
+
+      // get the byte offset into the fat of the entry
 
       fatOffset=fatEntryIndex * getFatEntrySizeInBytes();
 
       // now get the sector index that holds the fat entry and the offset into that sector of the fat entry
 
       sectorIndex=_bootSector.BPB_RsvdSecCnt + (fatOffset / _bootSector.BPB_BytsPerSec);
-      fatEntOffset=fatOffset % _bootSector.BPB_BytsPerSec;
+      offset=fatOffset % _bootSector.BPB_BytsPerSec;
 
-      // read the sector from FAT #1
+      // look for it in the cache and remember the LRU victim in case it's not there
 
-      if(!readSector(sectorIndex,sector))
-        return false;
+      victim=_fatCache;
 
-      // modify the value in the sector
+      for(i=0;i < _fatCacheSize;i++) {
+
+        entry=&_fatCache[i];
 
-      setFatEntryToMemory(sector + fatEntOffset,fatEntryContent);
+        if(entry->SectorIndex == sectorIndex) {
+          entry->LastUsed=++_fatCacheClock;
+          return true;
+        }
 
-      // write the sector back to FAT #1
+        if(entry->LastUsed < victim->LastUsed)
+          victim=entry;
+      }
 
-      if(!writeSector(sectorIndex,sector))
+      // cache miss, write back the victim if it's been modified
+
+      entry=victim;
+
+      if(entry->Dirty && !writeBackFatCacheEntry(*entry))
         return false;
 
-      // write the sector back to FAT #2 - big assumption here that FAT #1 and FAT#2 are identical
+      // read the new sector from FAT #1
 
-      sectorIndex+=getSectorsPerFat();
-      return writeSector(sectorIndex,sector);
+      entry->SectorIndex=FREE_FAT_CACHE_ENTRY;
+
+      if(!readSector(sectorIndex,entry->Data))
+        return false;
+
+      _fatCacheStatistics.FatSectorReads++;
+
+      entry->SectorIndex=sectorIndex;
+      entry->LastUsed=++_fatCacheClock;
+      return true;
     }
 
+
+    /*
+     * Write a cached FAT sector to all copies of the FAT
+     */
+
+    bool FatFileSystem::writeBackFatCacheEntry(FatCacheEntry& entry) {
+
+      uint32_t i;
+
+      for(i=0;i < _bootSector.BPB_NumFATs;i++) {
+
+        if(!writeSector(entry.SectorIndex + i * _fatSize,entry.Data))
+          return false;
+
+        _fatCacheStatistics.FatSectorWrites++;
+      }
+
+      entry.Dirty=false;
+      return true;
+    }
+
+
+    /*
+     * Free the memory used by the FAT cache
+     */
+
+    void FatFileSystem::freeFatCache() {
+
+      delete [] _fatCache;
+      delete [] _fatCacheMemory;
+
+      _fatCache=nullptr;
+      _fatCacheMemory=nullptr;
+      _fatCacheSize=0;
+    }
+
+
     /**
      * Write a directory entry back to the device.
      * @param[in] dirent_ The directory entry to write back.
@@ -824,6 +1191,11 @@ namespace stm32plus {
 
       ByteMemblock sector(getSectorSizeInBytes());
 
+      // the FAT must be up to date on the device before the dirent that refers to it
+
+      if(!flushFatCache())
+        return false;
+
       // read the sector containing the directory entry
 
       if(!readSector(dirent_.SectorNumber,sector))
@@ -840,20 +1212,57 @@ namespace stm32plus {
     }
 
     /**
-     * Find a free cluster. This implementation - being for an MCU - assumes that the FS is likely to
-     * be on flash therefore the wear resistant implementation is used. Swap to the linear implementation
-     * if this is not the case.
+     * Find a free cluster. If the free cluster bitmap is enabled then it is searched starting at the
+     * next free cluster hint. Otherwise this implementation - being for an MCU - assumes that the FS
+     * is likely to be on flash therefore the wear resistant implementation is used. Swap to the linear
+     * implementation if this is not the case.
      *
      * @param[out] freeCluster The free cluster number.
      * @return false if it fails.
      */
 
     bool FatFileSystem::findFreeCluster(uint32_t& freeCluster) {
+      return findFreeCluster(freeCluster,_nextFreeCluster);
+    }
+
+
+    /*
+     * Find a free cluster, starting at the hint if the bitmap is enabled
+     */
+
+    bool FatFileSystem::findFreeCluster(uint32_t& freeCluster,uint32_t hint) {
+
+      if(_freeClusterBitmap) {
+        BitmapFreeClusterFinder freeFinder(*this,*_freeClusterBitmap,hint);
+        return freeFinder.find(freeCluster);
+      }
 
       WearResistFreeClusterFinder freeFinder(*this);
       return freeFinder.find(freeCluster);
     }
 
+    /*
+     * Find the first cluster of a run of free clusters in the bitmap, starting at the hint. If there's
+     * no run that long then firstCluster is not changed and it is not an error.
+     */
+
+    bool FatFileSystem::findFreeRun(uint32_t clustersWanted,uint32_t hint,uint32_t& firstCluster) {
+
+      BitmapFreeClusterFinder freeFinder(*this,*_freeClusterBitmap,hint);
+      uint32_t cluster;
+
+      if(freeFinder.findMultipleSequential(clustersWanted,cluster)) {
+        firstCluster=cluster;
+        return true;
+      }
+
+      if(!errorProvider.isLastError(ErrorProvider::ERROR_PROVIDER_FREE_CLUSTER_FINDER,FreeClusterFinder::E_NO_FREE_CLUSTERS))
+        return false;
+
+      errorProvider.clear();
+      return true;
+    }
+
     /**
      * Get free space on the device in bytes.
      * Units will be clusters, the multiplier being sectorsPerCluster * bytesPerSector. So to get the free
@@ -867,11 +1276,28 @@ namespace stm32plus {
     bool FatFileSystem::getFreeSpace(uint32_t& freeUnits,uint32_t& unitsMultiplier) {
 
       uint32_t sectorIndex,entriesPerSector,i,count;
-      ByteMemblock sector(getSectorSizeInBytes());
       uint8_t *ptr;
 
+      // set the multiplier
+
+      unitsMultiplier=static_cast<uint32_t> (_bootSector.BPB_SecPerClus) * getSectorSizeInBytes();
+
+      // no need to scan if we're keeping count
+
+      if(_freeClusterCount != UNKNOWN_FREE_CLUSTER_COUNT) {
+        freeUnits=_freeClusterCount;
+        return true;
+      }
+
+      // the FAT is read directly from the device so the cache must be written back first
+
+      if(!flushFatCache())
+        return false;
+
       // read each FAT sector
 
+      ByteMemblock sector(getSectorSizeInBytes());
+
       freeUnits=0;
       count=0;
 
@@ -897,9 +1323,9 @@ namespace stm32plus {
         }
       }
 
-      // set the multiplier
+      // remember the count, it's kept up to date from now on
 
-      unitsMultiplier=static_cast<uint32_t> (_bootSector.BPB_SecPerClus) * getSectorSizeInBytes();
+      _freeClusterCount=freeUnits;
       return true;
     }
   }
@@ -117,11 +117,11 @@ namespace stm32plus {
         if(!_blockDevice.writeBlock(sector,sectorIndex++))
           return false;
 
-        // write the remaining sectors
+        // write the rest of the sectors in this copy
 
         memset(sector,0,512);
 
-        for(j=0;j<sectorsPerFat_;j++)
+        for(j=1;j<sectorsPerFat_;j++)
           if(!_blockDevice.writeBlock(sector,sectorIndex++))
             return false;
       }
@@ -21,11 +21,11 @@ namespace stm32plus {
      */
 
     FatIterator::FatIterator(FatFileSystem& fs_,uint32_t firstIndex_,bool wrap_) :
-      _fs(fs_), _sectorBuffer(_fs.getSectorSizeInBytes()) {
+      _fs(fs_) {
 
       _firstIndex=firstIndex_;
       _currentIndex=firstIndex_;
-      _lastSectorIndex=UINT32_MAX;
+      _currentContent=0;
       _wrap=wrap_;
       _first=true;
       _entriesPerFat=_fs.getCountOfClusters();
@@ -38,8 +38,6 @@ namespace stm32plus {
 
     bool FatIterator::next() {
 
-      uint32_t sectorIndex;
-
       if(!_first) {
 
         // advance the current index until hits the end
@@ -61,15 +59,10 @@ namespace stm32plus {
       } else
         _first=false;
 
-      // get the sector index
-
-      sectorIndex=_fs.getBootSector().BPB_RsvdSecCnt+((_currentIndex*_fs.getFatEntrySizeInBytes())/_fs.getSectorSizeInBytes());
-
-      // read the sector if it's new
+      // read the entry through the FAT cache
 
-      if(sectorIndex!=_lastSectorIndex)
-        if(!_fs.readSector(sectorIndex,_sectorBuffer))
-          return false;
+      if(!_fs.readFatEntry(_currentIndex,_currentContent))
+        return false;
 
       // done
 
@@ -92,11 +85,7 @@ namespace stm32plus {
      */
 
     uint32_t FatIterator::currentContent() {
-      uint32_t offset;
-
-      offset=(_currentIndex*_fs.getFatEntrySizeInBytes())%_fs.getSectorSizeInBytes();
-      return _fs.getFatEntryFromMemory(_sectorBuffer+offset);
+      return _currentContent;
     }
   }
 }
-
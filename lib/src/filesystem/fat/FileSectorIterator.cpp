@@ -24,6 +24,30 @@ namespace stm32plus {
 
       _sectorIndexInCluster=0x10000;        // force initial move
       _sectorsPerCluster=fs_.getBootSector().BPB_SecPerClus;
+      _clusterIndexInFile=UINT32_MAX;       // the first move goes to cluster index zero
+      _extentMap=nullptr;
+    }
+
+
+  /**
+   * Set an extent map that will be filled in as the cluster chain is walked and used by
+   * moveTo() to jump straight to a cluster without reading the FAT.
+   * @param extentMap The map, or nullptr for none. The caller retains ownership.
+   */
+
+    void FileSectorIterator::setExtentMap(ClusterExtentMap *extentMap) {
+      _extentMap=extentMap;
+    }
+
+
+  /**
+   * Set the number of clusters that the caller expects to add to the end of the file.
+   * @param clustersWanted The number of clusters.
+   * @see ClusterChainIterator::setClustersWanted
+   */
+
+    void FileSectorIterator::setClustersWanted(uint32_t clustersWanted) {
+      _iterator.setClustersWanted(clustersWanted);
     }
 
 
@@ -34,10 +58,101 @@ namespace stm32plus {
 
     void FileSectorIterator::reset(uint32_t firstClusterNumber_) {
       _sectorIndexInCluster=0x10000;
+      _clusterIndexInFile=UINT32_MAX;
       _iterator.reset(firstClusterNumber_);
     }
 
 
+  /**
+   * Position the iterator as if it had been reset and then next() called sectorCount times. The
+   * extent map is used if the target cluster is in it, otherwise the chain is walked from the
+   * closest known position: the current position, the end of the extent map or the first cluster.
+   * @param firstClusterNumber The first cluster in the file.
+   * @param sectorCount The number of sectors to move over.
+   * @return false if the move fails due to error or end of sectors.
+   */
+
+    bool FileSectorIterator::moveTo(uint32_t firstClusterNumber,uint32_t sectorCount) {
+
+      uint32_t target,clusterIndex,clusterNumber,lastIndex;
+
+      if(sectorCount == 0) {
+        reset(firstClusterNumber);
+        return true;
+      }
+
+      target=sectorCount - 1;
+      clusterIndex=target / _sectorsPerCluster;
+
+      if(_extentMap) {
+
+        // jump directly if the map knows where the cluster is
+
+        if(_extentMap->find(clusterIndex,clusterNumber)) {
+          positionAtCluster(clusterIndex,clusterNumber);
+          _sectorIndexInCluster=target % _sectorsPerCluster;
+          return true;
+        }
+
+        // the map doesn't reach that far, start from its end if that's closer than where we are now
+
+        if(_extentMap->getLast(lastIndex,clusterNumber)
+           && (_clusterIndexInFile == UINT32_MAX || _clusterIndexInFile < lastIndex || _clusterIndexInFile > clusterIndex))
+          positionAtCluster(lastIndex,clusterNumber);
+      }
+
+      // can't walk backwards, go back to the beginning if we're past the target
+
+      if(_clusterIndexInFile != UINT32_MAX && _clusterIndexInFile > clusterIndex)
+        reset(firstClusterNumber);
+
+      // walk forwards
+
+      if(_clusterIndexInFile == UINT32_MAX && !nextCluster())
+        return false;
+
+      while(_clusterIndexInFile < clusterIndex)
+        if(!nextCluster())
+          return false;
+
+      _sectorIndexInCluster=target % _sectorsPerCluster;
+      return true;
+    }
+
+
+  /*
+   * Position the underlying chain iterator on a known cluster
+   */
+
+    void FileSectorIterator::positionAtCluster(uint32_t clusterIndexInFile,uint32_t clusterNumber) {
+
+      // the first call to next() after a reset returns the reset cluster without reading the FAT
+
+      _iterator.reset(clusterNumber);
+      _iterator.next();
+
+      _clusterIndexInFile=clusterIndexInFile;
+    }
+
+
+  /*
+   * Advance the cluster chain iterator and record the new cluster in the extent map
+   */
+
+    bool FileSectorIterator::nextCluster() {
+
+      if(!_iterator.next())
+        return false;
+
+      _clusterIndexInFile++;
+
+      if(_extentMap)
+        _extentMap->add(_clusterIndexInFile,_iterator.current());
+
+      return true;
+    }
+
+
   /**
    * Move to next sector in the file.
    * @see Iterator::next
@@ -49,7 +164,7 @@ namespace stm32plus {
     // check if move required
 
       if(++_sectorIndexInCluster>=_sectorsPerCluster) {
-        if(!_iterator.next())
+        if(!nextCluster())
           return false;
 
         _sectorIndexInCluster=0;
@@ -59,6 +174,70 @@ namespace stm32plus {
     }
 
 
+  /**
+   * Move forward over a run of sectors that are physically contiguous on the device. The run
+   * continues across cluster boundaries when the next cluster in the chain immediately follows
+   * the current one. On return the iterator is positioned as if next() had been called
+   * numSectors times.
+   *
+   * @param[in] maxSectors The maximum number of sectors to move over. Must be at least 1.
+   * @param[out] firstSector The file system sector index of the first sector in the run.
+   * @param[out] numSectors The number of sectors in the run, between 1 and maxSectors.
+   * @return false if the first move fails due to error or end of sectors.
+   */
+
+    bool FileSectorIterator::nextRun(uint32_t maxSectors,uint32_t& firstSector,uint32_t& numSectors) {
+
+      uint32_t available,lastCluster;
+
+      if(!next())
+        return false;
+
+      firstSector=current();
+      numSectors=1;
+
+      while(numSectors<maxSectors) {
+
+        // take the rest of this cluster
+
+        available=_sectorsPerCluster-1-_sectorIndexInCluster;
+        if(available>maxSectors-numSectors)
+          available=maxSectors-numSectors;
+
+        _sectorIndexInCluster+=available;
+        numSectors+=available;
+
+        if(numSectors==maxSectors)
+          break;
+
+        // the run can only continue into the next cluster if it's adjacent
+
+        lastCluster=_iterator.current();
+
+        if(!nextCluster()) {
+
+          // the chain has ended, the caller will find out on the next move
+
+          positionAtCluster(_clusterIndexInFile,lastCluster);
+          break;
+        }
+
+        if(_iterator.current()!=lastCluster+1) {
+
+          // not adjacent. leave the iterator so that next() moves to sector zero of the new cluster
+
+          _sectorIndexInCluster=UINT32_MAX;
+          break;
+        }
+
+        _sectorIndexInCluster=0;
+        numSectors++;
+      }
+
+      return true;
+    }
+
+
   /**
    * Get the current cluster number
    * @return The current cluster number.
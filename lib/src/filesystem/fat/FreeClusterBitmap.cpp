@@ -0,0 +1,140 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+
+
+namespace stm32plus {
+  namespace fat {
+
+    /**
+     * Constructor. All groups start as full.
+     * @param[in] numClusters The number of FAT entries to cover, including the two reserved entries.
+     * @param[in] clustersPerBit The number of clusters covered by each bit. Rounded down to a power of 2.
+     */
+
+    FreeClusterBitmap::FreeClusterBitmap(uint32_t numClusters,uint32_t clustersPerBit) {
+
+      for(_groupShift=0;clustersPerBit>1;clustersPerBit>>=1)
+        _groupShift++;
+
+      _numClusters=numClusters;
+      _numGroups=(numClusters+(1 << _groupShift)-1) >> _groupShift;
+      _bits=new uint32_t[(_numGroups+31)/32];
+
+      clear();
+    }
+
+
+    /**
+     * Destructor
+     */
+
+    FreeClusterBitmap::~FreeClusterBitmap() {
+      delete [] _bits;
+    }
+
+
+    /**
+     * Mark all groups as full
+     */
+
+    void FreeClusterBitmap::clear() {
+      memset(_bits,0,((_numGroups+31)/32)*sizeof(uint32_t));
+    }
+
+
+    /**
+     * A cluster has become free. Its group is marked as possibly containing free clusters.
+     * @param[in] clusterNumber The cluster that is now free.
+     */
+
+    void FreeClusterBitmap::markFree(uint32_t clusterNumber) {
+
+      uint32_t group;
+
+      group=clusterNumber >> _groupShift;
+      _bits[group/32]|=1U << (group % 32);
+    }
+
+
+    /**
+     * A cluster has been allocated. The bit is cleared if the bitmap is exact. Groups of more
+     * than one cluster can only be cleared by a search that finds them full.
+     * @param[in] clusterNumber The cluster that is now in use.
+     */
+
+    void FreeClusterBitmap::markUsed(uint32_t clusterNumber) {
+      if(_groupShift==0)
+        _bits[clusterNumber/32]&=~(1U << (clusterNumber % 32));
+    }
+
+
+    /**
+     * Mark the group containing this cluster as having no free clusters.
+     * @param[in] clusterNumber Any cluster in the group.
+     */
+
+    void FreeClusterBitmap::markGroupFull(uint32_t clusterNumber) {
+
+      uint32_t group;
+
+      group=clusterNumber >> _groupShift;
+      _bits[group/32]&=~(1U << (group % 32));
+    }
+
+
+    /**
+     * Find the next group at or after the given cluster that may contain free clusters. The search
+     * wraps around to the start of the bitmap. Whole words of full groups are skipped at a time.
+     * @param[in] startCluster The cluster to start searching at.
+     * @param[out] groupFirstCluster startCluster if its group may contain free clusters, otherwise
+     *   the first cluster of the next such group.
+     * @return false if there are no groups that may contain free clusters.
+     */
+
+    bool FreeClusterBitmap::findGroup(uint32_t startCluster,uint32_t& groupFirstCluster) const {
+
+      uint32_t group,word,bits,numWords,i;
+
+      if(startCluster>=_numClusters)
+        startCluster=0;
+
+      group=startCluster >> _groupShift;
+
+      if(mayBeFree(startCluster)) {
+        groupFirstCluster=startCluster;
+        return true;
+      }
+
+      // search the remainder of the first word, then whole words, wrapping back to the first word
+
+      numWords=(_numGroups+31)/32;
+      word=group/32;
+      bits=_bits[word] & ~((2U << (group % 32))-1);
+
+      for(i=0;i<=numWords;i++) {
+
+        if(bits) {
+          group=word*32+__builtin_ctz(bits);
+
+          if(group<_numGroups) {
+            groupFirstCluster=group << _groupShift;
+            return true;
+          }
+        }
+
+        if(++word==numWords)
+          word=0;
+
+        bits=_bits[word];
+      }
+
+      return false;
+    }
+  }
+}
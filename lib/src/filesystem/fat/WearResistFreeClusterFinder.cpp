@@ -18,7 +18,7 @@ namespace stm32plus {
      */
 
     WearResistFreeClusterFinder::WearResistFreeClusterFinder(FatFileSystem& fs_) :
-      IteratingFreeClusterFinder(fs_,rand()%(fs_.getSectorsPerFat()*fs_.getSectorSizeInBytes())/fs_.getFatEntrySizeInBytes()) {
+      IteratingFreeClusterFinder(fs_,rand()%fs_.getCountOfClusters()) {
     }
   }
 }
@@ -0,0 +1,249 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+
+#if defined(STM32PLUS_F4_HAS_MAC) || defined(STM32PLUS_F1_CL_E)
+
+#include "config/net.h"
+
+
+namespace stm32plus {
+  namespace net {
+
+    /*
+     * the static instance used by NetBuffer
+     */
+
+    NetBufferPool *NetBufferPool::_instance=nullptr;
+
+
+    /**
+     * Constructor. The slabs are empty until initialise() is called.
+     */
+
+    NetBufferPool::NetBufferPool() {
+
+      memset(&_netBuffers,0,sizeof(_netBuffers));
+      memset(&_small,0,sizeof(_small));
+      memset(&_large,0,sizeof(_large));
+
+      _heapFallbacks=0;
+    }
+
+
+    /**
+     * Destructor. The stack is expected to live forever but if it does go away then
+     * anything that's still allocated must not be returned to slabs that no longer exist.
+     */
+
+    NetBufferPool::~NetBufferPool() {
+
+      if(_instance==this)
+        _instance=nullptr;
+
+      delete[] _netBuffers.memory;
+      delete[] _small.memory;
+      delete[] _large.memory;
+    }
+
+
+    /**
+     * Initialise the slabs
+     * @param params The parameters
+     * @return true if it worked, false if there's not enough memory for the slabs
+     */
+
+    bool NetBufferPool::initialise(const Parameters& params) {
+
+      if(!_netBuffers.initialise(sizeof(NetBuffer),params.pool_netBufferCount)
+          || !_small.initialise(params.pool_smallBufferSize,params.pool_smallBufferCount)
+          || !_large.initialise(params.pool_largeBufferSize,params.pool_largeBufferCount))
+        return false;
+
+      _instance=this;
+      return true;
+    }
+
+
+    /**
+     * Allocate memory for a NetBuffer object. This is called by NetBuffer's operator new.
+     * @param size The object size
+     * @return The memory, or nullptr if the heap is exhausted too
+     */
+
+    void *NetBufferPool::allocateNetBuffer(size_t size) {
+
+      void *ptr;
+
+      if(_instance && size<=_instance->_netBuffers.stats.blockSize) {
+
+        if((ptr=_instance->_netBuffers.allocate())!=nullptr)
+          return ptr;
+
+        _instance->_heapFallbacks++;
+      }
+
+      return malloc(size);
+    }
+
+
+    /**
+     * Release memory allocated by allocateNetBuffer()
+     * @param ptr The memory to release
+     */
+
+    void NetBufferPool::releaseNetBuffer(void *ptr) {
+
+      if(_instance && _instance->_netBuffers.release(ptr))
+        return;
+
+      free(ptr);
+    }
+
+
+    /**
+     * Allocate a data buffer. This is used for NetBuffer internal buffers and owned segments.
+     * @param size The number of bytes required
+     * @return The memory, or nullptr if the heap is exhausted too
+     */
+
+    void *NetBufferPool::allocateBuffer(uint32_t size) {
+      return _instance ? _instance->allocateFromSlabs(size) : malloc(size);
+    }
+
+
+    /**
+     * Release memory allocated by allocateBuffer(). Memory that came from the heap
+     * is recognised and given back to the heap.
+     * @param ptr The memory to release
+     */
+
+    void NetBufferPool::releaseBuffer(void *ptr) {
+
+      if(_instance)
+        _instance->releaseToSlabs(ptr);
+      else
+        free(ptr);
+    }
+
+
+    /*
+     * serve a request from the smallest slab that fits, moving up a size if that slab is
+     * exhausted and finally falling back to the heap
+     */
+
+    void *NetBufferPool::allocateFromSlabs(uint32_t size) {
+
+      void *ptr;
+
+      if(size<=_small.stats.blockSize && (ptr=_small.allocate())!=nullptr)
+        return ptr;
+
+      if(size<=_large.stats.blockSize && (ptr=_large.allocate())!=nullptr)
+        return ptr;
+
+      _heapFallbacks++;
+      return malloc(size);
+    }
+
+
+    /*
+     * give memory back to whichever slab it came from, or to the heap
+     */
+
+    void NetBufferPool::releaseToSlabs(void *ptr) {
+
+      if(!_small.release(ptr) && !_large.release(ptr))
+        free(ptr);
+    }
+
+
+    /*
+     * allocate the slab memory and thread the free list through it. Block sizes are rounded
+     * up to keep every block 8 byte aligned.
+     */
+
+    bool NetBufferPool::Slab::initialise(uint16_t blockSize,uint16_t blockCount) {
+
+      uint16_t i;
+
+      blockSize=(blockSize+7) & ~7;
+
+      memset(&stats,0,sizeof(stats));
+      freeList=nullptr;
+      memory=nullptr;
+
+      if(blockCount==0)
+        return true;
+
+      if((memory=new uint8_t[blockSize*blockCount])==nullptr)
+        return false;
+
+      stats.blockSize=blockSize;
+      stats.blockCount=blockCount;
+
+      for(i=0;i<blockCount;i++) {
+        *reinterpret_cast<void **>(memory+i*blockSize)=freeList;
+        freeList=memory+i*blockSize;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * take a block from the free list
+     */
+
+    void *NetBufferPool::Slab::allocate() {
+
+      void *ptr;
+
+      IrqSuspend suspender;
+
+      if(freeList==nullptr) {
+        if(stats.blockCount)
+          stats.exhausted++;
+        return nullptr;
+      }
+
+      ptr=freeList;
+      freeList=*reinterpret_cast<void **>(ptr);
+
+      stats.allocations++;
+      if(++stats.inUse>stats.highWaterMark)
+        stats.highWaterMark=stats.inUse;
+
+      return ptr;
+    }
+
+
+    /*
+     * return a block to the free list if it came from this slab
+     */
+
+    bool NetBufferPool::Slab::release(void *ptr) {
+
+      uint8_t *p;
+
+      p=reinterpret_cast<uint8_t *>(ptr);
+
+      if(p<memory || p>=memory+stats.blockSize*stats.blockCount)
+        return false;
+
+      IrqSuspend suspender;
+
+      *reinterpret_cast<void **>(ptr)=freeList;
+      freeList=ptr;
+      stats.inUse--;
+
+      return true;
+    }
+  }
+}
+
+#endif
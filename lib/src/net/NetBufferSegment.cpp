@@ -0,0 +1,202 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#include "config/stm32plus.h"
+
+#if defined(STM32PLUS_F4_HAS_MAC) || defined(STM32PLUS_F1_CL_E)
+
+#include "config/net.h"
+
+
+namespace stm32plus {
+  namespace net {
+
+    /*
+     * the descriptor pool is shared by the whole stack
+     */
+
+    NetBufferSegment *NetBufferSegment::_freeList=nullptr;
+    uint32_t NetBufferSegment::_poolSize=0;
+    uint32_t NetBufferSegment::_poolFree=0;
+
+
+    /**
+     * Create a segment that owns its own storage. The caller gets the only reference.
+     * @param size The number of bytes to allocate
+     * @return The new segment, or nullptr if out of memory
+     */
+
+    NetBufferSegment *NetBufferSegment::create(uint16_t size) {
+
+      NetBufferSegment *seg;
+      uint8_t *storage;
+
+      if((storage=reinterpret_cast<uint8_t *>(NetBufferPool::allocateBuffer(size)))==nullptr)
+        return nullptr;
+
+      if((seg=allocate())==nullptr) {
+        NetBufferPool::releaseBuffer(storage);
+        return nullptr;
+      }
+
+      seg->_storage=storage;
+      seg->_data=storage;
+      seg->_size=size;
+
+      return seg;
+    }
+
+
+    /**
+     * Create a segment that points to memory owned by the caller. The memory must stay
+     * in scope until the frame has been transmitted.
+     * @param data The data
+     * @param size The number of bytes
+     * @return The new segment, or nullptr if out of memory
+     */
+
+    NetBufferSegment *NetBufferSegment::createExternal(const void *data,uint16_t size) {
+
+      NetBufferSegment *seg;
+
+      if((seg=allocate())==nullptr)
+        return nullptr;
+
+      seg->_data=reinterpret_cast<const uint8_t *>(data);
+      seg->_size=size;
+
+      return seg;
+    }
+
+
+    /**
+     * Create a segment that refers to part of another segment. The parent is kept in scope
+     * by the slice until the slice is released. A slice of a slice refers directly to the
+     * segment that holds the data.
+     * @param parent The segment to slice
+     * @param offset The offset into the parent of the first byte
+     * @param size The number of bytes
+     * @return The new segment, or nullptr if out of memory
+     */
+
+    NetBufferSegment *NetBufferSegment::createSlice(NetBufferSegment& parent,uint16_t offset,uint16_t size) {
+
+      NetBufferSegment *seg,*owner;
+
+      if((seg=allocate())==nullptr)
+        return nullptr;
+
+      owner=parent._parent ? parent._parent : &parent;
+
+      // slices of external data do not need to hold anything in scope
+
+      if(owner->_storage) {
+        owner->addReference();
+        seg->_parent=owner;
+      }
+
+      seg->_data=parent._data+offset;
+      seg->_size=size;
+
+      return seg;
+    }
+
+
+    /**
+     * Add a reference to this segment
+     */
+
+    void NetBufferSegment::addReference() {
+      IrqSuspend suspender;
+      _referenceCount++;
+    }
+
+
+    /**
+     * Release a reference to this segment. When the last reference goes the storage and
+     * the descriptor are recycled. This can be called from the MAC transmit IRQ.
+     */
+
+    void NetBufferSegment::release() {
+
+      NetBufferSegment *parent;
+
+      {
+        IrqSuspend suspender;
+
+        if(--_referenceCount)
+          return;
+      }
+
+      parent=_parent;
+
+      if(_storage)
+        NetBufferPool::releaseBuffer(_storage);
+
+      recycle();
+
+      if(parent)
+        parent->release();
+    }
+
+
+    /*
+     * get a descriptor from the free list with one reference, growing the pool if necessary
+     */
+
+    NetBufferSegment *NetBufferSegment::allocate() {
+
+      NetBufferSegment *seg,*block;
+      uint16_t i;
+
+      IrqSuspend suspender;
+
+      if(_freeList==nullptr) {
+
+        if((block=new NetBufferSegment[POOL_GROWTH])==nullptr)
+          return nullptr;
+
+        for(i=0;i<POOL_GROWTH;i++) {
+          block[i]._next=_freeList;
+          _freeList=&block[i];
+        }
+
+        _poolSize+=POOL_GROWTH;
+        _poolFree+=POOL_GROWTH;
+      }
+
+      seg=_freeList;
+      _freeList=seg->_next;
+      _poolFree--;
+
+      seg->_next=nullptr;
+      seg->_referenceCount=1;
+
+      return seg;
+    }
+
+
+    /*
+     * return this descriptor to the free list
+     */
+
+    void NetBufferSegment::recycle() {
+
+      IrqSuspend suspender;
+
+      _data=nullptr;
+      _size=0;
+      _storage=nullptr;
+      _parent=nullptr;
+
+      _next=_freeList;
+      _freeList=this;
+      _poolFree++;
+    }
+  }
+}
+
+#endif
@@ -17,38 +17,59 @@ namespace stm32plus {
 
 
     /**
-     * Initialise the cache
-     * @param cacheSize The maximum entries in the cache
+     * Initialise the cache. Memory for the entries, the index and the hostname arena is
+     * allocated here and nowhere else.
+     * @param cacheSize The maximum entries in the cache. The limit is 254.
+     * @param maxHostnameLength The longest hostname that can be cached
      * @param rtc pointer to the RTC
      * @return true if it worked
      */
 
-    bool DnsCache::initialise(uint32_t cacheSize,RtcBase *rtc) {
+    bool DnsCache::initialise(uint32_t cacheSize,uint16_t maxHostnameLength,RtcBase *rtc) {
 
-      uint32_t i;
+      uint16_t i,hashSize;
+
+      if(cacheSize>=NO_ENTRY)
+        cacheSize=NO_ENTRY-1;
 
       _maxEntries=cacheSize;
+      _slotSize=maxHostnameLength+1;
       _rtc=rtc;
 
-      // allocate the entries
+      // the hash table is at least twice the number of entries so that probe sequences stay short
+
+      for(hashSize=4;hashSize<_maxEntries*2;hashSize<<=1);
+
+      _array.reset(new CacheEntry[_maxEntries]);
+      _hashTable.reset(new uint8_t[hashSize]);
+      _names.reset(new char[_maxEntries*_slotSize]);
 
-      _entries.reset(new Entry[cacheSize]);
-      if(_entries.get()==nullptr)
+      if(_array.get()==nullptr || _hashTable.get()==nullptr || _names.get()==nullptr)
         return false;
 
-      // mark all as unused
+      for(i=0;i<hashSize;i++)
+        _hashTable[i]=NO_ENTRY;
 
-      for(i=0;i<_maxEntries;i++)
-        _entries[i].expiryTicks=NO_ENTRY;
+      // all entries start on the free list
+
+      for(i=0;i<_maxEntries;i++) {
+        _array[i].next=i+1<_maxEntries ? i+1 : NO_ENTRY;
+        _array[i].previous=NO_ENTRY;
+        _array[i].generation=0;
+      }
 
+      _first=_last=NO_ENTRY;
+      _free=_maxEntries ? 0 : NO_ENTRY;
+      _hashMask=hashSize-1;
+
+      resetStatistics();
       return true;
     }
 
 
     /**
-     * Add a new entry to the cache. An exact match updates the expiry time. Otherwise
-     * unused entries are preferred. If no unused entry is found then the entry that's
-     * closest to its expiry time is evicted.
+     * Add an address to the cache. An existing entry for the name is updated, whatever it
+     * held before.
      * @param hostname The host to add
      * @param address The corresponding address
      * @param ttl Number of seconds that this address is valid for
@@ -56,84 +77,328 @@ namespace stm32plus {
 
     void DnsCache::add(const char *hostname,const IpAddress& address,uint32_t ttl) {
 
-      uint32_t i,unused,closest,closestTicks,now;
-      uint16_t hostlen;
-      Entry *ptr;
+      uint8_t i;
 
-      unused=closest=NO_ENTRY;
-      closestTicks=UINT32_MAX;
-      now=_rtc->getTick();
-      ptr=_entries.get();
+      if((i=internalInsert(hostname,0,ttl))!=NO_ENTRY)
+        _array[i].address=address;
+    }
 
-      for(i=0;i<_maxEntries;i++,ptr++) {
 
-        if(unused==NO_ENTRY && _entries[i].expiryTicks==NO_ENTRY)
-          unused=i;
-        else if(!strcasecmp(hostname,ptr->_hostname.get())) {
+    /**
+     * Record that a name does not exist (an NXDOMAIN reply). Lookups will return NEGATIVE
+     * until the entry expires or an address for the name is added.
+     * @param hostname The host that does not exist
+     * @param ttl Number of seconds to remember that
+     */
 
-          // found an exact match, update host and expiry and return
+    void DnsCache::addNegative(const char *hostname,uint32_t ttl) {
+      internalInsert(hostname,FLAG_NEGATIVE,ttl);
+    }
+
+
+    /**
+     * Record that a name is an alias (CNAME) for another. If the canonical name is not in
+     * the cache then a placeholder is created for it that will be filled in when its own
+     * record is added. Records from a reply may therefore be added in the order that they
+     * appear.
+     * @param alias The alias
+     * @param canonicalName The name that the alias refers to
+     * @param ttl Number of seconds that the alias is valid for
+     */
+
+    void DnsCache::addAlias(const char *alias,const char *canonicalName,uint32_t ttl) {
 
-          ptr->address=address;
-          ptr->expiryTicks=ttl+now;
+      uint8_t a,t,generation;
 
+      if(!strcasecmp(alias,canonicalName))
+        return;
+
+      if((t=hashFind(canonicalName,hash(canonicalName)))==NO_ENTRY)
+        if((t=internalInsert(canonicalName,FLAG_PENDING,ttl))==NO_ENTRY)
           return;
+
+      // the generation is taken now because inserting the alias could evict the target
+
+      generation=_array[t].generation;
+
+      if((a=internalInsert(alias,FLAG_ALIAS,ttl))==NO_ENTRY)
+        return;
+
+      _array[a].target=t;
+      _array[a].targetGeneration=generation;
+    }
+
+
+    /**
+     * Lookup an entry in the cache. Aliases are followed to the address. An expired entry
+     * is recycled when it's found. Every entry that's used becomes the most recently used.
+     * @param hostname The host to find
+     * @param[out] address The address, if found
+     * @return FOUND, NOT_FOUND or NEGATIVE
+     */
+
+    DnsCache::LookupResult DnsCache::find(const char *hostname,IpAddress& address) {
+
+      uint8_t i,depth;
+      CacheEntry *ptr;
+
+      i=hashFind(hostname,hash(hostname));
+
+      for(depth=0;depth<MAX_ALIAS_DEPTH && i!=NO_ENTRY;depth++) {
+
+        if(hasExpired(i)) {
+          removeEntry(i);
+          _statistics.expiries++;
+          break;
         }
-        else {
 
-          if(ptr->expiryTicks<now) {
+        ptr=&_array[i];
+
+        if((ptr->flags & FLAG_PENDING)!=0)
+          break;
 
-            // this entry has expired, remove it
+        unlink(i);
+        insertFront(i);
 
-            ptr->expiryTicks=NO_ENTRY;
-            ptr->_hostname.reset();
-          }
-          else if(ptr->expiryTicks-now<closestTicks) {
-            closest=i;
-            closestTicks=ptr->expiryTicks-now;
-          }
+        if((ptr->flags & FLAG_NEGATIVE)!=0) {
+          _statistics.negativeHits++;
+          return NEGATIVE;
         }
+
+        if((ptr->flags & FLAG_ALIAS)==0) {
+          address=ptr->address;
+          _statistics.hits++;
+          return FOUND;
+        }
+
+        // follow the alias if the target has not been recycled since the link was made
+
+        _statistics.aliasesFollowed++;
+
+        if(ptr->target==NO_ENTRY || _array[ptr->target].generation!=ptr->targetGeneration)
+          break;
+
+        i=ptr->target;
+      }
+
+      _statistics.misses++;
+      return NOT_FOUND;
+    }
+
+
+    /*
+     * insert or update an entry and bring it to the front of the LRU list. returns the index
+     * or NO_ENTRY if the name cannot be cached.
+     */
+
+    uint8_t DnsCache::internalInsert(const char *hostname,uint8_t flags,uint32_t ttl) {
+
+      uint16_t h,length;
+      uint8_t i;
+      CacheEntry *ptr;
+
+      if((length=strlen(hostname))>=_slotSize) {
+        _statistics.uncacheable++;
+        return NO_ENTRY;
+      }
+
+      h=hash(hostname);
+
+      if((i=hashFind(hostname,h))!=NO_ENTRY) {
+
+        // the name is already known. whatever it held is simply overwritten
+
+        unlink(i);
       }
+      else {
+
+        // a new entry needs to be created
 
-      // if we have an unused entry then use it, otherwise evict.
+        if((i=allocateEntry())==NO_ENTRY)
+          return NO_ENTRY;
 
-      if(unused!=NO_ENTRY)
-        i=unused;
-      else
-        i=closest;
+        memcpy(getName(i),hostname,length+1);
+        _array[i].hash=h;
+        hashInsert(i);
 
-      // set up the entry
+        _statistics.insertions++;
+      }
+
+      ptr=&_array[i];
+      ptr->flags=flags;
+      ptr->target=NO_ENTRY;
+      ptr->expiryTime=_rtc->getTick()+ttl;
 
-      hostlen=strlen(hostname);
-      _entries[i]._hostname.reset(new char[hostlen+1]);
-      strcpy(_entries[i]._hostname.get(),hostname);
-      _entries[i].expiryTicks=ttl+now;
-      _entries[i].address=address;
+      insertFront(i);
+      return i;
     }
 
 
-    /**
-     * Lookup an entry in the cache
-     * @param hostname
-     * @param address
-     * @return
+    /*
+     * Get a free entry, evicting the LRU entry if there are none
      */
 
-    bool DnsCache::lookup(const char *hostname,IpAddress& address) {
+    uint8_t DnsCache::allocateEntry() {
 
-      uint32_t i;
-      Entry *ptr;
-      uint32_t now;
+      uint8_t i;
 
-      now=_rtc->getTick();
+      if(_free==NO_ENTRY) {
 
-      for(ptr=_entries.get(),i=0;i<_maxEntries;i++,ptr++) {
-        if(ptr->expiryTicks!=NO_ENTRY && ptr->expiryTicks>now && !strcasecmp(hostname,ptr->_hostname.get())) {
-          address=ptr->address;
-          return true;
-        }
+        if(_last==NO_ENTRY)
+          return NO_ENTRY;
+
+        removeEntry(_last);
+        _statistics.evictions++;
+      }
+
+      i=_free;
+      _free=_array[i].next;
+
+      return i;
+    }
+
+
+    /*
+     * Take an entry out of the list and the index and put it on the free list. The generation
+     * changes so that any alias that links here is broken.
+     */
+
+    void DnsCache::removeEntry(uint8_t index) {
+
+      unlink(index);
+      hashRemove(index);
+
+      _array[index].generation++;
+      _array[index].next=_free;
+      _free=index;
+    }
+
+
+    /*
+     * Unlink an entry from the list
+     */
+
+    void DnsCache::unlink(uint8_t index) {
+
+      CacheEntry *ptr;
+
+      ptr=&_array[index];
+
+      if(_first==index)
+        _first=ptr->next;
+
+      if(_last==index)
+        _last=ptr->previous;
+
+      if(ptr->previous!=NO_ENTRY)
+        _array[ptr->previous].next=ptr->next;
+
+      if(ptr->next!=NO_ENTRY)
+        _array[ptr->next].previous=ptr->previous;
+
+      ptr->next=NO_ENTRY;
+      ptr->previous=NO_ENTRY;
+    }
+
+
+    /*
+     * Link an entry into the front of the list
+     */
+
+    void DnsCache::insertFront(uint8_t index) {
+
+      if(_first!=NO_ENTRY)
+        _array[_first].previous=index;
+
+      _array[index].previous=NO_ENTRY;
+      _array[index].next=_first;
+
+      if(_last==NO_ENTRY)
+        _last=index;
+
+      _first=index;
+    }
+
+
+    /*
+     * Case-insensitive FNV-1a hash of a hostname folded to 16 bits
+     */
+
+    uint16_t DnsCache::hash(const char *hostname) {
+
+      uint32_t h;
+      uint8_t c;
+
+      h=2166136261U;
+
+      while((c=*hostname++)!='\0') {
+
+        if(c>='A' && c<='Z')
+          c+='a'-'A';
+
+        h=(h ^ c)*16777619U;
+      }
+
+      return h ^ (h >> 16);
+    }
+
+
+    /*
+     * Find the entry index for a hostname by linear probing. The stored hash is compared
+     * before the name so that most mismatches cost nothing.
+     */
+
+    uint8_t DnsCache::hashFind(const char *hostname,uint16_t h) const {
+
+      uint16_t slot;
+      uint8_t i;
+
+      for(slot=h & _hashMask;(i=_hashTable[slot])!=NO_ENTRY;slot=(slot+1) & _hashMask)
+        if(_array[i].hash==h && !strcasecmp(hostname,getName(i)))
+          return i;
+
+      return NO_ENTRY;
+    }
+
+
+    /*
+     * Add an entry to the index at the first free slot in its probe sequence
+     */
+
+    void DnsCache::hashInsert(uint8_t index) {
+
+      uint16_t slot;
+
+      for(slot=_array[index].hash & _hashMask;_hashTable[slot]!=NO_ENTRY;slot=(slot+1) & _hashMask);
+      _hashTable[slot]=index;
+    }
+
+
+    /*
+     * Remove an entry from the index. Entries later in the same probe run are shifted back
+     * into the hole if their home slot allows it so that no tombstones are needed.
+     */
+
+    void DnsCache::hashRemove(uint8_t index) {
+
+      uint16_t hole,slot,home;
+
+      for(hole=_array[index].hash & _hashMask;_hashTable[hole]!=index;hole=(hole+1) & _hashMask);
+
+      for(slot=(hole+1) & _hashMask;_hashTable[slot]!=NO_ENTRY;slot=(slot+1) & _hashMask) {
+
+        home=_array[_hashTable[slot]].hash & _hashMask;
+
+        // the entry stays where it is if its home is cyclically in (hole,slot]
+
+        if(hole<=slot ? (hole<home && home<=slot) : (hole<home || home<=slot))
+          continue;
+
+        _hashTable[hole]=_hashTable[slot];
+        hole=slot;
       }
 
-      return false;
+      _hashTable[hole]=NO_ENTRY;
     }
   }
 }
@@ -52,7 +52,7 @@ namespace stm32plus {
 
       // subscribe to send and notify events
 
-      this->NetworkSendEventSender.insertSubscriber(NetworkSendEventSourceSlot::bind(this,&MacBase::onSend));
+      this->NetworkSendEventSender.insertSubscriber(NetEventDescriptor::NetEventType::ETHERNET_TRANSMIT_REQUEST,NetworkSendEventSourceSlot::bind(this,&MacBase::onSend));
 
       // set our MAC address
 
@@ -391,12 +391,13 @@ namespace stm32plus {
       // we cannot transmit data out of flash memory because the flash banks are
       // not connected to the Ethernet DMA bus on the STM32. More's the pity.
 
-      uint32_t ub=reinterpret_cast<uint32_t>(event.networkBuffer->getUserBuffer());
+      for(const NetBufferSegment *seg=event.networkBuffer->getFirstSegment();seg;seg=seg->getNext()) {
 
-      if(ub && IS_FLASH_ADDRESS(ub)) {
-        delete event.networkBuffer;
-        this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_NO_FLASH_DATA);
-        return;
+        if(IS_FLASH_ADDRESS(reinterpret_cast<uint32_t>(seg->getData()))) {
+          delete event.networkBuffer;
+          this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_NO_FLASH_DATA);
+          return;
+        }
       }
 
       // the NetBuffer needs to get an ethernet header
@@ -439,9 +440,10 @@ namespace stm32plus {
 
 
     /**
-     * Send the content of a NetBuffer via DMA. One NetBuffer contains exactly one frame which may be
-     * in one or two buffers. When two buffers are used typically the first buffer contain all the
-     * metadata in the form of headers and the second buffer is the user data to send.
+     * Send the content of a NetBuffer via DMA. One NetBuffer contains exactly one frame which is
+     * gathered from the internal buffer holding the headers followed by each of the segments in
+     * the chain. Each DMA descriptor carries two buffers so a frame with more than one segment
+     * will occupy a run of consecutive descriptors.
      *
      * @param nb The buffer to send.
      * @return true if it worked
@@ -449,70 +451,111 @@ namespace stm32plus {
 
     bool MacBase::sendBuffer(NetBuffer *nb) {
 
+      const NetBufferSegment *seg;
+      uint16_t i,index,descriptorCount,lastIndex;
+      uint32_t address,size;
+
       // ensure we cannot be interrupted either by an IRQ if we are normal flow
       // or by a higher priority interrupt if we are an IRQ
 
       IrqSuspend suspender;
 
-      // find the next buffer owned by the CPU with NetBuffer == nullptr (TDES0 OWN bit = 0)
-      // it's important to consider NetBuffer == nullptr to avoid a race condition with the
-      // IRQ handler that cleans up the NetBuffer
+      // check that we will not exceed the MTU
+
+      if(nb->getInternalBufferSize()+nb->getUserBufferSize()>_params.mac_mtu)
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_TOO_BIG);
+
+      // the internal buffer plus each segment, two to a descriptor
+
+      descriptorCount=(nb->getSegmentCount()+2)/2;
+
+      if(descriptorCount>_params.mac_transmitBufferCount)
+        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_TOO_BIG);
+
+      // the run of descriptors starting at the next one must all be owned by the CPU with
+      // NetBuffer == nullptr (TDES0 OWN bit = 0). it's important to consider NetBuffer == nullptr
+      // to avoid a race condition with the IRQ handler that cleans up the NetBuffer
 
-      ETH_DMADESCTypeDef& txdesc(_transmitDmaDescriptors[_transmitBufferIndex]);
+      for(i=0,index=_transmitBufferIndex;i<descriptorCount;i++,index=nextTransmitIndex(index))
+        if((_transmitDmaDescriptors[index].Status & ETH_DMATxDesc_OWN)!=0 || _transmitNetBuffers[index]!=nullptr)
+          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_BUSY);
 
-      if((txdesc.Status & ETH_DMATxDesc_OWN)!=0 || _transmitNetBuffers[_transmitBufferIndex]!=nullptr)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_BUSY);
+      // fill in the buffer addresses and sizes. buffer1 of the first descriptor is always the
+      // internal buffer
 
-      // clear out the buffer1 and buffer2 size bits in TDES1
+      seg=nb->getFirstSegment();
+      address=reinterpret_cast<uint32_t>(nb->getInternalBuffer());
+      size=nb->getInternalBufferSize();
 
-      txdesc.ControlBufferSize&=~(ETH_DMATxDesc_TBS2 | ETH_DMATxDesc_TBS1);
+      for(i=0,index=_transmitBufferIndex;i<descriptorCount;i++,index=nextTransmitIndex(index)) {
 
-      // set up buffer1
+        ETH_DMADESCTypeDef& txdesc(_transmitDmaDescriptors[index]);
 
-      txdesc.Buffer1Addr=reinterpret_cast<uint32_t>(nb->getInternalBuffer());
-      txdesc.ControlBufferSize|=nb->getInternalBufferSize();
+        // clear out the buffer1 and buffer2 size bits in TDES1 and the status bits that
+        // we are going to set up in TDES0
 
-      if(nb->getUserBufferSize()>0) {
+        txdesc.ControlBufferSize&=~(ETH_DMATxDesc_TBS2 | ETH_DMATxDesc_TBS1);
+        txdesc.Status&=~(ETH_DMATxDesc_ChecksumIPV4Header | ETH_DMATxDesc_ChecksumTCPUDPICMPFull | ETH_DMATxDesc_ChecksumByPass | ETH_DMATxDesc_LS | ETH_DMATxDesc_FS);
 
-        // there are two buffers, headers go out first followed by the user buffer
-        // check that we will not exceed the MTU
+        txdesc.Buffer1Addr=address;
+        txdesc.ControlBufferSize|=size;
 
-        if(nb->getUserBufferSize()+nb->getInternalBufferSize()>_params.mac_mtu)
-          return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_TOO_BIG);
+        // set up buffer2 if there's another segment
 
-        // set up buffer2
+        if(seg) {
+          txdesc.Buffer2NextDescAddr=reinterpret_cast<uint32_t>(seg->getData());
+          txdesc.ControlBufferSize|=static_cast<uint32_t>(seg->getSize()) << 16;
+          seg=seg->getNext();
+        }
+        else
+          txdesc.Buffer2NextDescAddr=0;
 
-        txdesc.Buffer2NextDescAddr=reinterpret_cast<uint32_t>(nb->getUserBuffer());
-        txdesc.ControlBufferSize|=nb->getUserBufferSize() <<  16;
+        // the next descriptor's buffer1
+
+        if(seg) {
+          address=reinterpret_cast<uint32_t>(seg->getData());
+          size=seg->getSize();
+          seg=seg->getNext();
+        }
       }
-      else if(nb->getInternalBufferSize()>_params.mac_mtu)
-        return this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_TOO_BIG);
 
-      // this is the first and the last frame and DMA owns it now. OWN must be set before
-      // the netbuffer pointer is inserted to avoid a race condition with the cleanup
-      // code in the transmit interrupt handler.
+      // set up the checksum request in the first descriptor
 
-      txdesc.Status&=~(ETH_DMATxDesc_ChecksumIPV4Header | ETH_DMATxDesc_ChecksumTCPUDPICMPFull | ETH_DMATxDesc_ChecksumByPass);
+      ETH_DMADESCTypeDef& firstdesc(_transmitDmaDescriptors[_transmitBufferIndex]);
 
       if(nb->getChecksumRequest()==DatalinkChecksum::IP_HEADER)
-        txdesc.Status|=ETH_DMATxDesc_ChecksumIPV4Header;
+        firstdesc.Status|=ETH_DMATxDesc_ChecksumIPV4Header;
       else if(nb->getChecksumRequest()==DatalinkChecksum::IP_HEADER_AND_PROTOCOL)
-        txdesc.Status|=ETH_DMATxDesc_ChecksumTCPUDPICMPFull;
+        firstdesc.Status|=ETH_DMATxDesc_ChecksumTCPUDPICMPFull;
       else
-        txdesc.Status|=ETH_DMATxDesc_ChecksumByPass;
+        firstdesc.Status|=ETH_DMATxDesc_ChecksumByPass;
+
+      firstdesc.Status|=ETH_DMATxDesc_FS;
+
+      // hand the descriptors to the DMA from the last back to the first so that the DMA cannot
+      // start on a partially set up frame. OWN must be set before the netbuffer pointer is
+      // inserted to avoid a race condition with the cleanup code in the transmit interrupt handler.
+      // The netbuffer goes with the last descriptor because that's the last to be released.
+
+      lastIndex=_transmitBufferIndex;
+      for(i=1;i<descriptorCount;i++)
+        lastIndex=nextTransmitIndex(lastIndex);
 
-      txdesc.Status|=ETH_DMATxDesc_LS | ETH_DMATxDesc_FS | ETH_DMATxDesc_OWN;
+      _transmitDmaDescriptors[lastIndex].Status|=ETH_DMATxDesc_LS;
+
+      for(i=0,index=lastIndex;i<descriptorCount;i++) {
+
+        _transmitDmaDescriptors[index].Status|=ETH_DMATxDesc_OWN;
+        index=index==0 ? _params.mac_transmitBufferCount-1 : index-1;
+      }
 
       // set up the NetBuffer pointer in the transmit buffers array
 
-      _transmitNetBuffers[_transmitBufferIndex]=nb;
+      _transmitNetBuffers[lastIndex]=nb;
 
-      // move to the next, or back to the first
+      // move to the one after the last
 
-      if(_transmitBufferIndex==_params.mac_transmitBufferCount-1)
-        _transmitBufferIndex=0;
-      else
-        _transmitBufferIndex++;
+      _transmitBufferIndex=nextTransmitIndex(lastIndex);
 
       // trigger DMA to poll for transmit buffers
 
@@ -568,6 +611,8 @@ namespace stm32plus {
           delete _transmitNetBuffers[i];
           _transmitNetBuffers[i]=nullptr;
         }
+
+        txbuf++;
       }
     }
 
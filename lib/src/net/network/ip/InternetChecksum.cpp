@@ -16,107 +16,237 @@ namespace stm32plus {
 
 
     /**
-     * Calculate the checksum for a UDP packet
+     * Calculate and insert the transport checksum for a UDP, TCP or ICMP packet held in a
+     * netbuffer. The packet starts at the write pointer and continues through the segment
+     * chain. UDP and TCP include the pseudo-header in the sum, ICMP does not.
      * @param sourceAddress Our IP address
      * @param destinationAddress The destination IP address
-     * @param protocol The internet protocol - which must be UDP for this overload
-     * @param nb The netbuffer containing the UDP packet including the header
+     * @param protocol The internet protocol
+     * @param nb The netbuffer containing the packet including the header
+     * @return false if the protocol is not one that we know how to checksum
      */
 
-    void InternetChecksum::calculate(const IpAddress& sourceAddress,const IpAddress& destinationAddress,NetBuffer& nb) {
+    bool InternetChecksum::calculate(const IpAddress& sourceAddress,const IpAddress& destinationAddress,IpProtocol protocol,NetBuffer& nb) {
 
       PseudoHeader ph;
-      uint32_t sum,bufferSize;
-      uint16_t temp;
-      UdpDatagram *datagram;
-      const uint8_t *ptr;
+      InternetChecksum sum;
+      uint16_t *field,checksum;
+
+      // locate the checksum field, which must be zero while summing
+
+      switch(protocol) {
+
+        case IpProtocol::UDP:
+          field=&reinterpret_cast<UdpDatagram *>(nb.getWritePointer())->udp_checksum;
+          break;
 
-      // the internal buffer is always there and always has the UDP header
+        case IpProtocol::TCP:
+          field=&reinterpret_cast<TcpHeader *>(nb.getWritePointer())->tcp_checksum;
+          break;
 
-      datagram=reinterpret_cast<UdpDatagram *>(nb.getWritePointer());
+        case IpProtocol::ICMP:
+          field=&reinterpret_cast<IcmpPacket *>(nb.getWritePointer())->icmp_checksum;
+          break;
 
-      // set up the pseudo-header
+        default:
+          return false;
+      }
 
-      ph.sourceAddress=sourceAddress;
-      ph.destinationAddress=destinationAddress;
-      ph.zero=0;
-      ph.protocol=IpProtocol::UDP;
-      ph.length=datagram->udp_length;
+      *field=0;
 
       // sum the pseudo-header
 
-      sum=0;
-      sumit(&ph,sizeof(PseudoHeader),sum);
+      if(protocol!=IpProtocol::ICMP) {
 
-      // sum the internal buffer - the UDP API guarantees that there will be an internal buffer
+        ph.sourceAddress=sourceAddress;
+        ph.destinationAddress=destinationAddress;
+        ph.zero=0;
+        ph.protocol=protocol;
+        ph.length=NetUtil::htons(nb.getSizeFromWritePointerToEnd()+nb.getUserBufferSize());
 
-      ptr=static_cast<uint8_t *>(nb.getWritePointer());
-      bufferSize=nb.getSizeFromWritePointerToEnd();
+        sum.add(&ph,sizeof(PseudoHeader));
+      }
 
-      sumit(ptr,bufferSize & ~1,sum);
+      // sum the packet
 
-      // if there's one left, get it
+      sum.add(nb);
 
-      if((bufferSize & 1)!=0) {
+      // a computed UDP checksum of zero is transmitted as all ones because zero means 'none'
 
-        if(nb.getUserBufferSize()) {
+      checksum=sum.getChecksum();
+      if(checksum==0 && protocol==IpProtocol::UDP)
+        checksum=0xFFFF;
 
-          temp=ptr[bufferSize-1];
+      *field=checksum;
+      return true;
+    }
 
-          ptr=static_cast<const uint8_t *>(nb.getUserBuffer());
-          temp=(temp << 8) | *ptr++;
 
-          bufferSize=nb.getUserBufferSize()-1;
-          sumit(&temp,2,sum);
-        }
-      }
-      else {
-        if(nb.getUserBufferSize()) {
-          ptr=static_cast<const uint8_t *>(nb.getUserBuffer());
-          bufferSize=nb.getUserBufferSize();
-        }
-      }
+    /**
+     * Add a block of data to the sum. The block can be any length and alignment. If the
+     * previous blocks added up to an odd length then this one is byte-swapped into place.
+     * @param data The data
+     * @param length The number of bytes
+     */
 
-      // if there's a user buffer, sum it
+    void InternetChecksum::add(const void *data,uint32_t length) {
 
-      if(nb.getUserBufferSize())
-        sumit(ptr,bufferSize & ~1,sum);
+      uint16_t sum;
 
-      // take care of any left over byte
+      sum=sumBlock(data,length);
 
-      if((bufferSize & 1)!=0)
-        sum+=ptr[bufferSize-1];
+      if(_odd)
+        sum=swap(sum);
 
-      while(sum >> 16)
-        sum=(sum & 0xFFFF)+(sum >> 16);
+      _sum=fold(static_cast<uint64_t>(_sum)+sum);
+      _odd^=(length & 1)!=0;
+    }
 
-      // insert the complement into the datagram checksum
 
-      datagram->udp_checksum=~sum;
+    /**
+     * Add the content of a netbuffer from the write pointer to the end of the internal
+     * buffer and then each of the segments in its chain
+     * @param nb The netbuffer
+     */
+
+    void InternetChecksum::add(const NetBuffer& nb) {
+
+      const NetBufferSegment *seg;
+
+      add(nb.getWritePointer(),nb.getSizeFromWritePointerToEnd());
+
+      for(seg=nb.getFirstSegment();seg;seg=seg->getNext())
+        add(seg->getData(),seg->getSize());
+    }
+
+
+    /**
+     * Incrementally update a checksum after a 16 bit field covered by it has changed. This
+     * is equation 3 from RFC 1624. All values are in the byte order that they have in the packet.
+     * @param checksum The current checksum
+     * @param oldValue The old value of the field
+     * @param newValue The new value of the field
+     * @return The new checksum
+     */
+
+    uint16_t InternetChecksum::update(uint16_t checksum,uint16_t oldValue,uint16_t newValue) {
+
+      uint32_t sum;
+
+      sum=static_cast<uint16_t>(~checksum)+static_cast<uint16_t>(~oldValue)+newValue;
+      return ~fold(sum);
     }
 
 
     /**
-     * Sum up a buffer up to the last even byte
-     * @param vptr buffer address
-     * @param length length in bytes
-     * @param[in,out] sum The running total
+     * Incrementally update a checksum after a 32 bit field covered by it has changed, for
+     * example an IP address. The field must be 16 bit aligned within the packet.
+     * @param checksum The current checksum
+     * @param oldValue The old value of the field
+     * @param newValue The new value of the field
+     * @return The new checksum
+     */
+
+    uint16_t InternetChecksum::update32(uint16_t checksum,uint32_t oldValue,uint32_t newValue) {
+
+      uint32_t sum;
+
+      sum=static_cast<uint16_t>(~checksum)
+         +static_cast<uint16_t>(~(oldValue >> 16))
+         +static_cast<uint16_t>(~oldValue)
+         +(newValue >> 16)
+         +(newValue & 0xFFFF);
+
+      return ~fold(sum);
+    }
+
+
+    /*
+     * Sum a block of memory as 16 bit words in memory order without complementing the
+     * result. The loads are done 32 bits at a time into a 64 bit accumulator, 16 bytes per
+     * iteration. The carries pile up in the top half and are folded once at the end. An odd
+     * start address is handled by summing from the next even address with the first byte in
+     * the other lane and then swapping the result (RFC 1071 byte order independence).
      */
 
-    void InternetChecksum::sumit(const void *vptr,uint16_t length,uint32_t& sum) {
+    uint16_t InternetChecksum::sumBlock(const void *data,uint32_t length) {
 
-      const uint16_t *ptr;
+      const uint8_t *ptr;
+      const uint32_t *wptr;
+      uint64_t sum;
+      uint16_t result;
+      bool swapped;
 
-      ptr=reinterpret_cast<const uint16_t *>(vptr);
-      length>>=1;
+      union {
+        uint8_t b[2];
+        uint16_t w;
+      } edge;
 
-      while(length--) {
+      ptr=static_cast<const uint8_t *>(data);
+      sum=0;
+      swapped=false;
 
-        sum+=*ptr++;
+      if(length==0)
+        return 0;
 
-        if(sum & 0x80000000)    // if high order bit set, fold
-          sum=(sum & 0xFFFF) + (sum >> 16);
+      // get to an even address
+
+      if((reinterpret_cast<uintptr_t>(ptr) & 1)!=0) {
+
+        edge.b[0]=0;
+        edge.b[1]=*ptr++;
+        sum=edge.w;
+
+        length--;
+        swapped=true;
       }
+
+      // get to a word address
+
+      if((reinterpret_cast<uintptr_t>(ptr) & 2)!=0 && length>=2) {
+        sum+=*reinterpret_cast<const uint16_t *>(ptr);
+        ptr+=2;
+        length-=2;
+      }
+
+      // the main unrolled loop
+
+      wptr=reinterpret_cast<const uint32_t *>(ptr);
+
+      while(length>=16) {
+
+        sum+=wptr[0];
+        sum+=wptr[1];
+        sum+=wptr[2];
+        sum+=wptr[3];
+
+        wptr+=4;
+        length-=16;
+      }
+
+      while(length>=4) {
+        sum+=*wptr++;
+        length-=4;
+      }
+
+      // the tail
+
+      ptr=reinterpret_cast<const uint8_t *>(wptr);
+
+      if(length>=2) {
+        sum+=*reinterpret_cast<const uint16_t *>(ptr);
+        ptr+=2;
+        length-=2;
+      }
+
+      if(length) {
+        edge.b[0]=*ptr;
+        edge.b[1]=0;
+        sum+=edge.w;
+      }
+
+      result=fold(sum);
+      return swapped ? swap(result) : result;
     }
   }
 }
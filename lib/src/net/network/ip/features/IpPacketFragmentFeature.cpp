@@ -57,21 +57,19 @@ namespace stm32plus {
       _identification++;
 
       // The STM32 MAC cannot do checksum offload for fragmented packets so we offer the option
-      // to do it in software for UDP packets.
+      // to do it in software.
 
-      if(_params.ip_checksumOnLargeUdpPackets && protocol==IpProtocol::UDP)
-        InternetChecksum::calculate(myIpAddress,destinationIpAddress,*inputBuffer);
+      if(_params.ip_checksumOnLargeUdpPackets)
+        InternetChecksum::calculate(myIpAddress,destinationIpAddress,protocol,*inputBuffer);
 
-      // work out how many fragments we need. we fragment the internal buffer and the
-      // user buffer separately resulting in one more fragment than is strictly
-      // necessary in some cases
+      // work out how many fragments we need. the internal buffer and the segment chain are
+      // treated as one continuous payload so a fragment can span the boundaries between them
 
-      outputBufferCount=fragmentsRequired(inputBuffer->getSizeFromWritePointerToEnd())
-                       +fragmentsRequired(inputBuffer->getUserBufferSize());
+      outputBufferCount=fragmentsRequired(inputBuffer->getSizeFromWritePointerToEnd()+inputBuffer->getUserBufferSize());
 
       // allocate for the output buffers
 
-      outputBuffers=reinterpret_cast<NetBuffer **>(malloc(sizeof(NetBuffer)*outputBufferCount));
+      outputBuffers=reinterpret_cast<NetBuffer **>(malloc(sizeof(NetBuffer *)*outputBufferCount));
       if(outputBuffers==nullptr)
         return false;
 
@@ -79,7 +77,7 @@ namespace stm32plus {
 
       // attempt to do the fragmentation
 
-      if(internalCreateFragments(inputBuffer,outputBuffers))
+      if(internalCreateFragments(inputBuffer,outputBuffers,outputBufferCount))
         return true;
 
       // failed, clean up any memory allocated and return failure
@@ -96,91 +94,76 @@ namespace stm32plus {
 
 
     /*
-     * Create fragments, internal function. buffers and count are set up.
+     * Create fragments, internal function. buffers and count are set up. Each fragment gets a
+     * new netbuffer for its headers and a chain of segments that refer to the data in the input
+     * buffer. Nothing is copied. Slices of owned segments keep their data in scope and the
+     * input buffer is referenced by the last fragment to keep everything else in scope.
      */
 
-    bool IpPacketFragmentFeature::internalCreateFragments(NetBuffer *inputBuffer,NetBuffer **&outputBuffers) {
+    bool IpPacketFragmentFeature::internalCreateFragments(NetBuffer *inputBuffer,NetBuffer **outputBuffers,uint16_t outputBufferCount) {
 
-      uint16_t offset;
-
-      // first fragment the internal buffer - there will at least
-      // be a header in here from the upper layers
+      NetBuffer *nb;
+      NetBufferSegment *seg,*slice;
+      const uint8_t *internalData;
+      uint32_t internalSize;
+      uint16_t i,offset,flags,segmentOffset,fragmentSize,sliceSize,maxFragmentSize;
 
-      offset=0;
+      maxFragmentSize=_mtu-IpPacketHeader::getNoOptionsHeaderSize();
 
-      if(!createFragmentsFrom(inputBuffer,
-                              inputBuffer->getWritePointer(),
-                              inputBuffer->getSizeFromWritePointerToEnd(),
-                              outputBuffers,
-                              0,
-                              inputBuffer->getUserBufferSize()==0,
-                              offset))
-        return false;
+      // the payload starts with the upper layer headers in the internal buffer
 
-      // if there's no user data then that's it
+      internalData=reinterpret_cast<const uint8_t *>(inputBuffer->getWritePointer());
+      internalSize=inputBuffer->getSizeFromWritePointerToEnd();
 
-      if(inputBuffer->getUserBufferSize()==0)
-        return true;
+      seg=inputBuffer->getFirstSegment();
+      segmentOffset=0;
+      offset=0;
 
-      // finally fragment the user data
+      for(i=0;i<outputBufferCount;i++) {
 
-      return createFragmentsFrom(inputBuffer,
-                                 inputBuffer->getUserBuffer(),
-                                 inputBuffer->getUserBufferSize(),
-                                 outputBuffers,
-                                 fragmentsRequired(inputBuffer->getSizeFromWritePointerToEnd()),
-                                 true,
-                                 offset);
-    }
+        // create a new netbuffer for the fragment. it needs IP and link layer headers
 
+        if((nb=new NetBuffer(_linkHeaderSize+IpPacketHeader::getNoOptionsHeaderSize(),0))==nullptr)
+          return false;
 
-    /**
-     * Create a run of fragmented packets from this data
-     * @param inputBuffer The netbuffer containing the data to fragment
-     * @param sourceData The source data to fragment
-     * @param sourceDataSize The size of sourceData in bytes
-     * @param isInternalBufferData true if this data is coming from the internal buffer
-     * @param outputBuffers Where to store the netbuffers containing the fragments
-     * @param firstOutputBuffer The index of the first netbuffer to store the fragments in
-     * @param lastFragmentIsHere true if the last fragment in this packet is in this data
-     * @return true if it worked. false means out of memory.
-     */
+        outputBuffers[i]=nb;
 
-    bool IpPacketFragmentFeature::createFragmentsFrom(NetBuffer *inputBuffer,
-                                                       const void *sourceData,
-                                                       uint16_t sourceDataSize,
-                                                       NetBuffer **outputBuffers,
-                                                       uint16_t firstOutputBuffer,
-                                                       bool lastFragmentIsHere,
-                                                       uint16_t& offset) {
+        // gather up to a fragment's worth of the payload
 
-      NetBuffer *nb;
-      uint16_t fragmentSize,flags;
-      const uint8_t *ptr;
+        for(fragmentSize=0;fragmentSize<maxFragmentSize && (internalSize || seg);fragmentSize+=sliceSize) {
 
-      ptr=reinterpret_cast<const uint8_t *>(sourceData);
+          if(internalSize) {
 
-      while(sourceDataSize) {
+            sliceSize=internalSize<static_cast<uint32_t>(maxFragmentSize-fragmentSize) ? internalSize : maxFragmentSize-fragmentSize;
+            slice=NetBufferSegment::createExternal(internalData,sliceSize);
 
-        // calculate sizes
+            internalData+=sliceSize;
+            internalSize-=sliceSize;
+          }
+          else {
 
-        fragmentSize=sourceDataSize<_mtu-IpPacketHeader::getNoOptionsHeaderSize() ?
-                      sourceDataSize :
-                      _mtu-IpPacketHeader::getNoOptionsHeaderSize();
+            sliceSize=seg->getSize()-segmentOffset;
+            if(sliceSize>maxFragmentSize-fragmentSize)
+              sliceSize=maxFragmentSize-fragmentSize;
 
-        // create a new netbuffer for the fragment
+            slice=sliceSize ? NetBufferSegment::createSlice(*seg,segmentOffset,sliceSize) : nullptr;
 
-        nb=new NetBuffer(_linkHeaderSize+IpPacketHeader::getNoOptionsHeaderSize(),  // needs IP and link layer headers
-                         0,
-                         ptr,                                 // fragment data starts here
-                         fragmentSize);                       // size of this fragment
+            if((segmentOffset+=sliceSize)==seg->getSize()) {
+              seg=seg->getNext();
+              segmentOffset=0;
+            }
 
-        // more fragments flag if this is not the last in the run
+            if(sliceSize==0)
+              continue;
+          }
 
-        if(lastFragmentIsHere && fragmentSize==sourceDataSize) {
+          if(!nb->appendSegment(slice))
+            return false;
+        }
 
-          // this is the last
+        // more fragments flag if this is not the last
 
+        if(i==outputBufferCount-1) {
           flags=0;
           nb->setReference(inputBuffer);
         }
@@ -197,14 +180,6 @@ namespace stm32plus {
         header->ip_hdr_identification=_identification;
         header->ip_hdr_flagsAndOffset=NetUtil::htons((offset/8) | flags);
 
-        // store the netbuffer in the array
-
-        outputBuffers[firstOutputBuffer++]=nb;
-
-        // update pointers
-
-        ptr+=fragmentSize;
-        sourceDataSize-=fragmentSize;
         offset+=fragmentSize;
       }
 
@@ -219,7 +194,7 @@ namespace stm32plus {
      * @return The number of fragments required
      */
 
-    uint32_t IpPacketFragmentFeature::fragmentsRequired(uint16_t size) {
+    uint32_t IpPacketFragmentFeature::fragmentsRequired(uint32_t size) {
       return size/(_mtu-IpPacketHeader::getNoOptionsHeaderSize())+(size % (_mtu-IpPacketHeader::getNoOptionsHeaderSize()) ? 1 : 0);
     }
   }
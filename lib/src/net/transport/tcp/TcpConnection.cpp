@@ -30,15 +30,12 @@ namespace stm32plus {
                                    uint16_t segmentSizeLimit,
                                    uint16_t additionalHeaderSize) {
 
-      const TcpOptionMaximumSegmentSize *mss;
-
       // remember parameters
 
       _networkUtilityObjects=&networkUtilityObjects;
       _tcpEvents=&tcpEvents;
       _segmentSizeLimit=segmentSizeLimit;
       _additionalHeaderSize=additionalHeaderSize;
-      _lastZeroWindowPollTime=0;
 
       // create the receive buffer
 
@@ -55,12 +52,9 @@ namespace stm32plus {
       _state.rxWindow.receiveNext=NetUtil::ntohl(segmentEvent.tcpHeader.tcp_sequenceNumber);
       _state.txWindow.sendWindow=NetUtil::ntohs(segmentEvent.tcpHeader.tcp_windowSize);
 
-      // find the MSS option
+      // find the MSS and SACK options
 
-      if((mss=segmentEvent.tcpHeader.findOption<TcpOptionMaximumSegmentSize>())==nullptr)
-        _remoteMss=536;                 // default from the RFC
-      else
-        _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
+      handleRemoteOptions(segmentEvent.tcpHeader);
 
       // this is an incoming client connection to our server. we need to send a SYN-ACK
 
@@ -93,7 +87,6 @@ namespace stm32plus {
       _tcpEvents=&tcpEvents;
       _segmentSizeLimit=segmentSizeLimit;
       _additionalHeaderSize=additionalHeaderSize;
-      _lastZeroWindowPollTime=0;
 
       // create the receive buffer
 
@@ -123,13 +116,9 @@ namespace stm32plus {
 
     TcpConnection::~TcpConnection() {
 
-      // unsubscribe from notification events
-
-      _networkUtilityObjects->NetworkNotificationEventSender.removeSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpConnection::onNotification));
+      // stop receiving segments
 
-      // unsubscribe from receive events
-
-      _tcpEvents->TcpReceiveEventSender.removeSubscriber(TcpReceiveEventSourceSlot::bind(this,&TcpConnection::onReceive));
+      _tcpEvents->tcpConnectionTable.removeConnection(_tableEntry);
 
       // notify that we've been released. depending on our state, the connection may be moved into the
       // closing handler
@@ -173,44 +162,39 @@ namespace stm32plus {
       _state.txWindow.sendNext&=0x7FFFFFFF;
 
       _state.txWindow.sendUnacknowledged=_state.txWindow.sendNext;
+      _state.txWindow.sendMaximum=_state.txWindow.sendNext;
       _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
 
-      // subscribe to notification events
-
-      _networkUtilityObjects->NetworkNotificationEventSender.insertSubscriber(NetworkNotificationEventSourceSlot::bind(this,&TcpConnection::onNotification));
+      // out of order data is held in the receive buffer. SACK is off until both ends agree to it.
 
-      // subscribe to segment receive events
+      _reassemblyQueue.initialise(_params.tcp_reassemblyIntervals);
+      _sackPermitted=false;
 
-      _tcpEvents->TcpReceiveEventSender.insertSubscriber(TcpReceiveEventSourceSlot::bind(this,&TcpConnection::onReceive));
-    }
+      // the resend delay adapts to the round trip time once data is flowing
 
+      _resendDelay.initialise(_params.tcp_initialResendDelay,_params.tcp_minResendDelay,_params.tcp_maxResendDelay);
+      _resendNow=false;
+      _lastTransmitTime=_lastActiveTime;
 
-    /**
-     * Callback from our subscription to notification events
-     * @param ned The event descriptor
-     */
+      // register in the connection table so that our segments come straight to us
 
-    void TcpConnection::onNotification(NetEventDescriptor& ned) {
+      _tableEntry.remoteAddress=remoteAddress;
+      _tableEntry.remotePort=remotePort;
+      _tableEntry.localPort=localPort;
+      _tableEntry.connection=this;
+      _tableEntry.handler=TcpReceiveEventSourceSlot::bind(this,&TcpConnection::onReceive);
 
-      if(ned.eventType==NetEventDescriptor::NetEventType::TCP_FIND_CONNECTION)
-        handleFindConnectionEvent(static_cast<TcpFindConnectionNotificationEvent&>(ned));
+      _tcpEvents->tcpConnectionTable.addConnection(_tableEntry);
     }
 
 
     /**
-     * Segment received event. This is IRQ code.
+     * Segment received event. The connection table only sends us our own segments. This is IRQ code.
      * @param event The event
      */
 
     void TcpConnection::onReceive(TcpSegmentEvent& event) {
 
-      // must be for this connection
-
-      if(event.ipPacket.header->ip_sourceAddress!=_state.remoteAddress ||
-         _state.localPort!=event.destinationPort ||
-         _state.remotePort!=event.sourcePort)
-        return;
-
       // it's for us, so it's considered handled even if we drop it
 
       event.handled=true;
@@ -255,11 +239,11 @@ namespace stm32plus {
 
       uint32_t rxnext;
 
-      // the sequence number must be in order. if the segments have got out of order on
-      // the network then there could be data to come before this FIN
+      // the FIN follows any data in the segment and must be in order. if the segments have
+      // got out of order on the network then there could be data to come before this FIN
 
-      rxnext=NetUtil::ntohl(event.tcpHeader.tcp_sequenceNumber);
-      if(rxnext!=_state.rxWindow.receiveNext)
+      rxnext=NetUtil::ntohl(event.tcpHeader.tcp_sequenceNumber)+event.payloadLength;
+      if(rxnext!=_state.rxWindow.receiveNext || !_reassemblyQueue.isEmpty())
         return;
 
       // change our state
@@ -269,7 +253,7 @@ namespace stm32plus {
       // ACK the FIN so the connection is now half-closed
 
       _state.rxWindow.receiveNext++;
-      _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+      sendAck();
 
       // notify
 
@@ -278,45 +262,73 @@ namespace stm32plus {
 
 
     /**
-     * Handle some incoming data from the remote end. This is IRQ code.
+     * Handle some incoming data from the remote end. Data that starts at receiveNext goes
+     * straight into the receive buffer. Data that arrives ahead of a hole caused by a lost or
+     * overtaken segment is stored in the receive buffer's free space at its offset from
+     * receiveNext and recorded in the reassembly queue. When the hole is filled all the
+     * contiguous data becomes readable at once. This is IRQ code.
      * @param event The segment event
      */
 
     void TcpConnection::handleIncomingData(const TcpSegmentEvent& event) {
 
-      uint32_t rxnext;
+      uint32_t seq,offset,size,available;
+      const uint8_t *payload;
 
       // we've become active
 
       _lastActiveTime=MillisecondTimer::millis();
 
-      // we can only handle sequential data. if the sequence number on the incoming packet is
-      // not what we expect then we drop the segment because an earlier segment has either got
-      // lost or been overtaken on the network. the sender will have to resend.
+      seq=NetUtil::ntohl(event.tcpHeader.tcp_sequenceNumber);
+      payload=event.payload;
+      size=event.payloadLength;
+
+      // trim off anything that we've already received. a retransmission can overlap
+      // data that was reassembled from segments sent after it.
+
+      offset=_state.rxWindow.receiveNext-seq;
+
+      if(static_cast<int32_t>(offset)>0) {
+
+        if(offset>=size)
+          size=0;
+        else {
+          payload+=offset;
+          size-=offset;
+          seq=_state.rxWindow.receiveNext;
+        }
+      }
+
+      // the data cannot extend beyond the write space available in the buffer. If it does
+      // then the sender is most likely probing a zero window that we have advertised.
 
-      rxnext=NetUtil::ntohl(event.tcpHeader.tcp_sequenceNumber);
+      offset=seq-_state.rxWindow.receiveNext;
+      available=_receiveBuffer->availableToWrite();
 
-      if(rxnext==_state.rxWindow.receiveNext) {
+      if(size>0 && offset<available && size<=available-offset) {
 
-        // the data size cannot be greater than the write space available in the buffer. If it
-        // is then the sender is most likely probing a zero window that we have advertised.
+        if(offset==0) {
 
-        if(event.payloadLength<=_receiveBuffer->availableToWrite()) {
+          // in order. write the data into the buffer and see if that filled a hole
 
-          // write the data into the buffer
+          _receiveBuffer->write(payload,size);
 
-          _receiveBuffer->write(event.payload,event.payloadLength);
+          seq=_reassemblyQueue.advance(seq+size);
+          _receiveBuffer->commitWrite(seq-_state.rxWindow.receiveNext-size);
 
           // update our variables
 
-          _state.rxWindow.receiveNext+=event.payloadLength;
+          _state.rxWindow.receiveNext=seq;
           _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
         }
+        else if(_reassemblyQueue.insert(_state.rxWindow.receiveNext,seq,seq+size))
+          _receiveBuffer->writeAhead(offset,payload,size);
       }
 
-      // ack the current state
+      // ack the current state. if there's a hole then this is a duplicate ACK that tells
+      // the sender what's missing
 
-      _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+      sendAck();
 
       // notify if there is some data to read
 
@@ -326,8 +338,10 @@ namespace stm32plus {
 
 
     /**
-     * Handle an incoming ACK. We can handle any ACK that moves sendUnacknowledged forward. We are trusting
-     * the remote not to ACK data that it hasn't received.
+     * Handle an incoming ACK. We can handle any ACK that moves sendUnacknowledged forward and does not
+     * acknowledge data that we haven't sent. Each such ACK restarts the resend timer, feeds the round
+     * trip time calculation and opens the congestion window. An ACK that does not move the window is
+     * checked to see if it's a duplicate.
      * This is IRQ code.
      * @param header The TCP header
      * @param true if this segment contains data
@@ -335,7 +349,7 @@ namespace stm32plus {
 
     void TcpConnection::handleIncomingAck(const TcpHeader& header,bool hasData) {
 
-      uint32_t newSuna;
+      uint32_t newSuna,acked;
 
       // if the current state is SYN_RCVD then we can move to established
 
@@ -344,19 +358,55 @@ namespace stm32plus {
 
       // the gotcha here is to cater for 32-bit overflow while checking that the new s.una
       // is greater than the old which is necessary to avoid winding back the window by
-      // accident when segments arrive out of order. We arbitrarily decide that a distance
-      // of 2^31 between the pointers is sufficient to indicate a wrap.
+      // accident when segments arrive out of order. Sequence numbers are compared using
+      // the signed distance between them.
 
       newSuna=NetUtil::ntohl(header.tcp_ackNumber);
-      if((newSuna>_state.txWindow.sendUnacknowledged || _state.txWindow.sendUnacknowledged-newSuna>0x80000000))
+
+      if(static_cast<int32_t>(newSuna-_state.txWindow.sendUnacknowledged)>0 &&
+         static_cast<int32_t>(newSuna-_state.txWindow.sendMaximum)<=0) {
+
+        acked=newSuna-_state.txWindow.sendUnacknowledged;
         _state.txWindow.sendUnacknowledged=newSuna;
-      else {
 
-        // if the ACK has no data and did not move the window then re-ack our current state
-        // possibly opening our window
+        // after a resend timeout sendNext is behind and may have been overtaken
+
+        if(static_cast<int32_t>(newSuna-_state.txWindow.sendNext)>0)
+          _state.txWindow.sendNext=newSuna;
 
-        if(!hasData)
-          _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
+        _resendDelay.acknowledged(newSuna);
+        _resendTimerStart=MillisecondTimer::millis();
+
+        if(_congestionControl.newAck(newSuna,acked,_state.txWindow.sendMaximum-newSuna))
+          _resendNow=true;
+      }
+      else if(newSuna==_state.txWindow.sendUnacknowledged)
+        handleDuplicateAck(header,hasData);
+    }
+
+
+    /**
+     * Handle an ACK that did not move the window. If we have data outstanding and the segment
+     * carries no data and does not change the window then it's a duplicate ACK (RFC5681) that
+     * tells us the remote end has received something out of order. If nothing is outstanding
+     * then we re-ack our current state, possibly opening our window.
+     * This is IRQ code.
+     * @param header The TCP header
+     * @param true if this segment contains data
+     */
+
+    void TcpConnection::handleDuplicateAck(const TcpHeader& header,bool hasData) {
+
+      if(hasData)
+        return;
+
+      if(_state.txWindow.sendUnacknowledged==_state.txWindow.sendMaximum)
+        sendAck();
+      else if(_state.txWindow.sendWindow!=0 && NetUtil::ntohs(header.tcp_windowSize)==_state.txWindow.sendWindow) {
+
+        if(_congestionControl.duplicateAck(_state.txWindow.sendMaximum-_state.txWindow.sendUnacknowledged,
+                                           _state.txWindow.sendMaximum))
+          _resendNow=true;
       }
     }
 
@@ -369,28 +419,25 @@ namespace stm32plus {
 
     void TcpConnection::handleIncomingSynAck(const TcpHeader& header) {
 
-      const TcpOptionMaximumSegmentSize *mss;
-
       // the only legal state is SYN_SENT
 
       if(_state.state!=TcpState::SYN_SENT)
         return;
 
-      // that SYN cost us a sequence number
+      // that SYN cost us a sequence number and it's now been acknowledged
 
       _state.txWindow.sendNext++;
+      _state.txWindow.sendMaximum=_state.txWindow.sendNext;
+      _state.txWindow.sendUnacknowledged=_state.txWindow.sendNext;
 
       // pull out the state variables from the remote side
 
       _state.rxWindow.receiveNext=NetUtil::ntohl(header.tcp_sequenceNumber)+1;
       _state.txWindow.sendWindow=NetUtil::ntohs(header.tcp_windowSize);
 
-      // find the MSS option
+      // find the MSS and SACK options
 
-      if((mss=header.findOption<TcpOptionMaximumSegmentSize>())==nullptr)
-        _remoteMss=536;                 // default from the RFC
-      else
-        _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
+      handleRemoteOptions(header);
 
       // we're established, as far as we know
 
@@ -404,20 +451,21 @@ namespace stm32plus {
 
     /**
      * Send a SYN segment to the server. This segment has no data. It contains the SYN flag plus our receive buffer
-     * size and the MSS option.
+     * size, the MSS option and the SACK-permitted option if selective ACKs are enabled.
      * @return true if it was sent
      */
 
     bool TcpConnection::sendSyn() {
 
+      uint16_t optionsSize;
+
       // create a NetBuffer to hold the SYN segment
 
-      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),4);
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),getSynOptionsSize(_params.tcp_selectiveAck));
 
-      // set up MSS (maximum segment size) option
+      // set up MSS (maximum segment size) option and offer SACK if we're configured for it
 
-      TcpOptionMaximumSegmentSize *mssOption=reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(4));
-      mssOption->initialise(_segmentSizeLimit);
+      optionsSize=writeSynOptions(nb,_params.tcp_selectiveAck);
 
       // construct the header
 
@@ -434,7 +482,7 @@ namespace stm32plus {
 
       // this header is larger than the minimum
 
-      header->setSize(TcpHeader::getNoOptionsHeaderSize()+TcpOptionMaximumSegmentSize::getSize());
+      header->setSize(TcpHeader::getNoOptionsHeaderSize()+optionsSize);
 
       // ask the IP layer to send the packet
 
@@ -450,21 +498,23 @@ namespace stm32plus {
 
     /**
      * Send a SYN-ACK segment back to our client. This segment has no data. It contains the SYN
-     * and ACK flags plus our receive buffer size and the MSS option.
+     * and ACK flags plus our receive buffer size, the MSS option and the SACK-permitted option if
+     * the client sent it.
      * @return true if it worked
      */
 
     bool TcpConnection::sendSynAck() {
 
+      uint16_t optionsSize;
+
       // create a NetBuffer to hold the SYN-ACK segment. we're dealing with an incoming
       // SYN segment from an IRQ
 
-      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),4);
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),getSynOptionsSize(_sackPermitted));
 
-      // set up MSS (maximum segment size) option
+      // set up MSS (maximum segment size) option and agree to SACK if the client offered it
 
-      TcpOptionMaximumSegmentSize *mssOption=reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(4));
-      mssOption->initialise(_segmentSizeLimit);
+      optionsSize=writeSynOptions(nb,_sackPermitted);
 
       // construct the header
 
@@ -483,11 +533,12 @@ namespace stm32plus {
 
       // this header is larger than the minimum
 
-      header->setSize(TcpHeader::getNoOptionsHeaderSize()+TcpOptionMaximumSegmentSize::getSize());
+      header->setSize(TcpHeader::getNoOptionsHeaderSize()+optionsSize);
 
       // increment our sequence number
 
       _state.txWindow.sendNext++;
+      _state.txWindow.sendMaximum=_state.txWindow.sendNext;
 
       // ask the IP layer to send the packet
 
@@ -502,23 +553,98 @@ namespace stm32plus {
 
 
     /**
-     * Send a batch of data to the remote client with an optional timeout. If the timeout is zero
-     * then this is effectively a blocking call that will not return until success or a network
-     * error occurs.
+     * Get the size of the options for a SYN or SYN-ACK segment. The buffer must be exactly
+     * this size because the MAC transmits the whole of it.
+     * @param sackPermitted true if the SACK-permitted option will be included
+     * @return The size of the options
+     */
+
+    uint16_t TcpConnection::getSynOptionsSize(bool sackPermitted) {
+      return TcpOptionMaximumSegmentSize::getSize()+(sackPermitted ? 2+TcpOptionSackPermitted::getSize() : 0);
+    }
+
+
+    /**
+     * Write the options for a SYN or SYN-ACK segment into the front of the buffer. The MSS
+     * comes first and SACK-permitted follows it, padded to a word boundary with NOPs.
+     * @param nb The buffer with getSynOptionsSize() bytes of space
+     * @param sackPermitted true to include the SACK-permitted option
+     * @return The size of the options
+     */
+
+    uint16_t TcpConnection::writeSynOptions(NetBuffer *nb,bool sackPermitted) const {
+
+      if(sackPermitted) {
+
+        reinterpret_cast<TcpOptionSackPermitted *>(nb->moveWritePointerBack(TcpOptionSackPermitted::getSize()))->initialise();
+        reinterpret_cast<TcpOptionNop *>(nb->moveWritePointerBack(1))->initialise();
+        reinterpret_cast<TcpOptionNop *>(nb->moveWritePointerBack(1))->initialise();
+      }
+
+      reinterpret_cast<TcpOptionMaximumSegmentSize *>(nb->moveWritePointerBack(TcpOptionMaximumSegmentSize::getSize()))->initialise(_segmentSizeLimit);
+      return getSynOptionsSize(sackPermitted);
+    }
+
+
+    /**
+     * Pick up the options from the remote SYN or SYN-ACK and initialise the congestion
+     * control now that the segment size is known. SACK is used if the remote end sent
+     * SACK-permitted. For a client that means it's agreed to our offer.
+     * @param header The TCP header of the SYN or SYN-ACK
+     */
+
+    void TcpConnection::handleRemoteOptions(const TcpHeader& header) {
+
+      const TcpOptionMaximumSegmentSize *mss;
+
+      if((mss=header.findOption<TcpOptionMaximumSegmentSize>())==nullptr)
+        _remoteMss=536;                 // default from the RFC
+      else
+        _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
+
+      _sackPermitted=_params.tcp_selectiveAck && header.findOption<TcpOptionSackPermitted>()!=nullptr;
+
+      _congestionControl.initialise(_remoteMss,_state.txWindow.sendNext);
+    }
+
+
+    /**
+     * Send an ACK for the current state. If SACK was negotiated and there's data held out of
+     * order then SACK blocks describing it are included. This is IRQ code.
+     * @return true if it was sent
+     */
+
+    bool TcpConnection::sendAck() {
+
+      TcpSackBlock blocks[TcpOptionSack::MAX_BLOCKS];
+      uint8_t count;
+
+      count=_sackPermitted ? _reassemblyQueue.getSackBlocks(blocks,TcpOptionSack::MAX_BLOCKS) : 0;
+      return _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance(),blocks,count);
+    }
+
+
+    /**
+     * Send data to the remote client with an optional timeout. If the timeout is zero then this is
+     * effectively a blocking call that will not return until success or a network error occurs.
+     *
+     * Data is sent in segments to the other side. The size of each segment is bounded by the remote
+     * MSS. The amount of data in flight is bounded by the lower of the last known receive window of
+     * the recipient and our congestion window. As ACKs arrive the window slides forward and more
+     * segments are sent so the pipe is kept full. The data is transmitted in-place from your buffer
+     * so the unacknowledged part of your buffer is the retransmission queue.
      *
-     * Data is sent in segments to the other side. The size of each segment is bounded by the lower
-     * of our MTU and the last known receive window of the recipient. actuallySent is updated to
-     * hold the amount of data acknowledged by the other end when this function returns.
+     * Lost segments are detected by duplicate ACKs (fast retransmit) or by the resend timer, whose
+     * delay is calculated from the measured round trip time. actuallySent is updated to hold the
+     * amount of data acknowledged by the other end when this function returns.
      *
      * If tcp_nagleAvoidance is true (the default) then this method tries to send at least two
      * packets per call to force the remote to ACK immediately. If only one packet were to go out
      * per call then we may have to wait up to 200ms for the remote end's Nagle algorithm timer
      * to expire and send us our ACK.
      *
-     * The timeout, if non zero, is applied in full to each segment that we send. It means
-     * that we will wait for that many milliseconds after we send a segment to receiving an ACK
-     * before we give up. There will be an interplay between this timeout and the tcp_sendRetry*
-     * configuration parameters.
+     * The timeout, if non zero, is the longest that we will wait for the other end to acknowledge
+     * some more data. It is restarted every time that the window moves forward.
      *
      * @param data The buffer of data to transmit
      * @param datasize How many bytes of data to transmit
@@ -529,9 +655,11 @@ namespace stm32plus {
 
     bool TcpConnection::send(const void *data,uint32_t datasize,uint32_t& actuallySent,uint32_t timeoutMillis) {
 
-      uint32_t bufpos,expectsuna,batchpos,batchbufpos,now,resendtimeout,startwait;
-      uint16_t batchwin,batchsendcap;
+      uint32_t now,startseq,endseq,suna,snxt,lastsuna,window,flight,tosend,lastprogress;
+      uint16_t segmentcap;
+      bool resendnow;
       TcpHeaderFlags headerFlags;
+      const uint8_t *ptr;
 
       actuallySent=0;
       now=MillisecondTimer::millis();
@@ -551,41 +679,27 @@ namespace stm32plus {
       if(_state.state!=TcpState::ESTABLISHED)
         return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_INVALID_STATE);
 
-      // we need to handle the zero window case. don't try to send if the window is at zero
-      // for a defined interval.
+      if(datasize==0)
+        return true;
 
-      if(_state.txWindow.sendWindow==0) {
+      // if we've been idle for longer than the resend delay then what we know about the network is stale
 
-        if(_lastZeroWindowPollTime==0) {
-          _lastZeroWindowPollTime=now;      // we can try now, this is the first time we know it to be zero
-          _zeroWindowPollDelay=_params.tcp_initialResendDelay;
-        }
-        else {
-          if(MillisecondTimer::hasTimedOut(_lastZeroWindowPollTime,_zeroWindowPollDelay))
-            return true;                    // this is not an error, zero bytes were sent because the window is closed
-          else {
-            _lastZeroWindowPollTime=now;    // we can try again now
-            _zeroWindowPollDelay=std::min(_params.tcp_maxResendDelay,_zeroWindowPollDelay*2);
-          }
-        }
-      }
-      else
-        _lastZeroWindowPollTime=0;          // non-zero window, cancel the poll time
+      if(MillisecondTimer::difference(_lastTransmitTime)>_resendDelay.getResendDelay())
+        _congestionControl.restart();
 
-      // bufpos is the index into the user's data of the current batch being sent
-      // batchwin is current sender receive window
+      // the user's data occupies [startseq,endseq) in sequence number space
 
-      bufpos=0;
-      batchwin=_state.txWindow.sendWindow;
-      resendtimeout=_params.tcp_initialResendDelay;
+      ptr=reinterpret_cast<const uint8_t *>(data);
+      startseq=lastsuna=_state.txWindow.sendNext;
+      endseq=startseq+datasize;
 
       // if the data would be sent in one go and nagle avoidance is enabled then force the send
       // to be 2 packets so that the recipient will generate an ACK immediately.
 
-      if(datasize<=batchwin && _params.tcp_nagleAvoidance && datasize>1)
-        batchsendcap=(datasize/2)+1;
+      if(datasize<=_state.txWindow.sendWindow && _params.tcp_nagleAvoidance && datasize>1)
+        segmentcap=std::min(static_cast<uint32_t>(_remoteMss),(datasize/2)+1);
       else
-        batchsendcap=UINT16_MAX;
+        segmentcap=_remoteMss;
 
       // set up the header flags
 
@@ -593,114 +707,135 @@ namespace stm32plus {
       if(_params.tcp_push)
         headerFlags=headerFlags | TcpHeaderFlags::PSH;
 
-      // keep going while there is data and the connection is open
+      lastprogress=now;
+      _resendTimerStart=now;
+      _resendNow=false;
 
-      while(datasize>0 && !isLocalEndClosed()) {
+      // keep going until everything is acknowledged or the connection is closed
 
-        uint16_t batchsize,batchremaining;
-        bool resend;
+      while(!isLocalEndClosed()) {
 
-        // a batch is how much we push out without waiting for ACKs. We always try to send 1 byte even when the sender
-        // window is closed, this effectively polls the sender for window updates if they've been advertising
-        // a zero window to us.
+        // take a consistent snapshot of the state that the IRQ updates
 
-        batchsize=std::max(1UL,std::min(datasize,static_cast<uint32_t>(batchwin)));
-        batchremaining=batchsize;
-        batchpos=_state.txWindow.sendNext;
-        batchbufpos=bufpos;
+        {
+          IrqSuspend suspender;
 
-        // expectsuna is the ACK number that we'll be expecting when this batch is done
+          suna=_state.txWindow.sendUnacknowledged;
+          snxt=_state.txWindow.sendNext;
+          window=std::min(_congestionControl.getCongestionWindow(),static_cast<uint32_t>(_state.txWindow.sendWindow));
+          resendnow=_resendNow;
+          _resendNow=false;
+        }
 
-        expectsuna=_state.txWindow.sendNext+batchsize;
+        if(suna==endseq)
+          break;
 
-        // keep transmitting segments for this batch or until the local end is closed
+        // check for user timeout, measured from the last time the window moved
 
-        while(batchremaining>0 && !isLocalEndClosed()) {
+        if(suna!=lastsuna) {
+          lastsuna=suna;
+          lastprogress=MillisecondTimer::millis();
+        }
+        else if(timeoutMillis && MillisecondTimer::hasTimedOut(lastprogress,timeoutMillis)) {
+          abandonUnacknowledged(startseq,actuallySent);
+          return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_TIMED_OUT);
+        }
 
-          uint16_t tosend;
+        if(resendnow) {
 
-          // send up to the remote MSS in one segment
+          // fast retransmit of the first unacknowledged segment
 
-          tosend=std::min(std::min(batchsendcap,batchremaining),_remoteMss);
+          _resendDelay.cancelTimer();
 
-          // send this segment if it's not been ACK'd already (can happen if this is a resend)
+          tosend=std::min(static_cast<uint32_t>(segmentcap),endseq-suna);
+          if(!sendSegment(ptr+(suna-startseq),suna,tosend,headerFlags)) {
+            abandonUnacknowledged(startseq,actuallySent);
+            return false;
+          }
+
+          _resendTimerStart=MillisecondTimer::millis();
+        }
+        else if(suna!=_state.txWindow.sendMaximum && MillisecondTimer::hasTimedOut(_resendTimerStart,_resendDelay.getResendDelay())) {
 
-          if(batchpos+tosend>=_state.txWindow.sendUnacknowledged) {
+          // resend timeout. everything outstanding is considered lost and will be sent again
 
-            // create a netbuffer for the user data - only the header space is alloc'd. the user data
-            // is transmitted in-place.
+          resendTimeout();
+          continue;
+        }
 
-            NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),
-                                        0,
-                                        reinterpret_cast<const uint8_t *>(data)+batchbufpos,
-                                        tosend);
+        // send new segments while the windows allow
 
-            // create the header
+        while(snxt!=endseq) {
 
-            TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
+          flight=snxt-suna;
 
-            header->initialise(_state.localPort,
-                               _state.remotePort,
-                                batchpos,                       // where we are sending from
-                                _state.rxWindow.receiveNext,    //  ack up to receiveNext
-                                _state.rxWindow.receiveWindow,  // current window size
-                                headerFlags);                   // always ACK
+          if(window==0) {
 
-            // ask the IP layer to send the packet
+            // the remote end has closed its window. probe it with a single byte when nothing
+            // is outstanding. the resend timer takes care of repeating the probe.
 
-            IpTransmitRequestEvent iptre(
-                  nb,
-                  _state.remoteAddress,
-                  IpProtocol::TCP);
+            if(flight)
+              break;
 
-            _networkUtilityObjects->NetworkSendEventSender.raiseEvent(iptre);
-            if(!iptre.succeeded)
-              return false;
+            tosend=1;
           }
+          else {
 
-          // update the sequence number (batchpos) and the user buffer position (batchbufpos)
+            if(flight>=window)
+              break;
 
-          batchpos+=tosend;
-          batchbufpos+=tosend;
-          batchremaining-=tosend;
-        }
+            tosend=std::min(std::min(static_cast<uint32_t>(segmentcap),endseq-snxt),window-flight);
 
-        // reset the resend flag
+            // sender silly window avoidance: don't send a runt while ACKs are still due to arrive
 
-        resend=false;
-        startwait=MillisecondTimer::millis();
+            if(flight && tosend<std::min(static_cast<uint32_t>(segmentcap),endseq-snxt))
+              break;
+          }
 
-        // wait for the ACKs on that last batch to come back
+          // time new data only, a retransmission would give an ambiguous sample (Karn)
 
-        while(expectsuna!=_state.txWindow.sendUnacknowledged && !isLocalEndClosed()) {
+          if(static_cast<int32_t>(snxt-_state.txWindow.sendMaximum)>=0)
+            _resendDelay.startTimer(snxt+tosend);
+          else
+            _resendDelay.cancelTimer();
 
-          // check for user timeout, measured from the beginning of the call
+          if(flight==0)
+            _resendTimerStart=MillisecondTimer::millis();
 
-          if(timeoutMillis && MillisecondTimer::hasTimedOut(now,timeoutMillis))
-            return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_TIMED_OUT);
+          // the state must be updated before the segment goes out because the ACK could come
+          // back before sendSegment() returns
 
-          // check for resend timeout for this batch
+          {
+            IrqSuspend suspender;
 
-          if(MillisecondTimer::hasTimedOut(startwait,resendtimeout)) {
-            resend=true;
-            resendtimeout=std::min(_params.tcp_maxResendDelay,resendtimeout*2);
-            break;
+            if(static_cast<int32_t>(snxt+tosend-_state.txWindow.sendNext)>0)
+              _state.txWindow.sendNext=snxt+tosend;
+
+            if(static_cast<int32_t>(snxt+tosend-_state.txWindow.sendMaximum)>0)
+              _state.txWindow.sendMaximum=snxt+tosend;
+          }
+
+          if(!sendSegment(ptr+(snxt-startseq),snxt,tosend,headerFlags)) {
+            abandonUnacknowledged(startseq,actuallySent);
+            return false;
+          }
+
+          {
+            IrqSuspend suspender;
+
+            snxt=_state.txWindow.sendNext;
+            suna=_state.txWindow.sendUnacknowledged;
           }
-        }
 
-        // if we're not about to go into a resend of this batch then update the batch position
-        // for the next run
+          _lastTransmitTime=MillisecondTimer::millis();
 
-        if(!resend) {
-          resendtimeout=_params.tcp_initialResendDelay;
-          bufpos=batchbufpos;
-          _state.txWindow.sendNext=batchpos;      // it's very important that sendNext and actuallySent move in sync
-          actuallySent+=batchsize;
-          datasize-=batchsize;
-          batchwin=_state.txWindow.sendWindow;
+          if(window==0)
+            break;
         }
       }
 
+      actuallySent=_state.txWindow.sendUnacknowledged-startseq;
+
       // if we bailed because the state was changed then indicate that to the caller
 
       if(isLocalEndClosed())
@@ -710,6 +845,80 @@ namespace stm32plus {
     }
 
 
+    /*
+     * The resend timer has expired. Everything outstanding is considered lost: sendNext goes back to
+     * sendUnacknowledged, the resend delay backs off and the congestion window restarts from one
+     * segment. A zero window probe going unanswered is not a sign of congestion.
+     */
+
+    void TcpConnection::resendTimeout() {
+
+      IrqSuspend suspender;
+
+      if(_state.txWindow.sendWindow!=0)
+        _congestionControl.timeout(_state.txWindow.sendMaximum-_state.txWindow.sendUnacknowledged,_state.txWindow.sendMaximum);
+
+      _resendDelay.backoff();
+      _resendDelay.cancelTimer();
+
+      _state.txWindow.sendNext=_state.txWindow.sendUnacknowledged;
+      _resendTimerStart=MillisecondTimer::millis();
+      _resendNow=false;
+    }
+
+
+    /*
+     * send() is returning early and the unacknowledged part of the user's buffer is about to go out of
+     * scope so it's forgotten. It's very important that sendNext and actuallySent move in sync.
+     */
+
+    void TcpConnection::abandonUnacknowledged(uint32_t startseq,uint32_t& actuallySent) {
+
+      IrqSuspend suspender;
+
+      _state.txWindow.sendNext=_state.txWindow.sendMaximum=_state.txWindow.sendUnacknowledged;
+      actuallySent=_state.txWindow.sendUnacknowledged-startseq;
+    }
+
+
+    /*
+     * Send a segment of user data. Only the header space is allocated, the user data is transmitted in-place.
+     */
+
+    bool TcpConnection::sendSegment(const uint8_t *data,uint32_t sequenceNumber,uint16_t size,TcpHeaderFlags flags) {
+
+      NetBuffer *nb=new NetBuffer(_additionalHeaderSize+TcpHeader::getNoOptionsHeaderSize(),0,data,size);
+
+      // don't send a segment that has lost its data
+
+      if(nb==nullptr || !nb->isValid()) {
+        delete nb;
+        return _networkUtilityObjects->setError(ErrorProvider::ERROR_PROVIDER_NET_TCP_CONNECTION,E_OUT_OF_MEMORY);
+      }
+
+      // create the header
+
+      TcpHeader *header=reinterpret_cast<TcpHeader *>(nb->moveWritePointerBack(TcpHeader::getNoOptionsHeaderSize()));
+
+      header->initialise(_state.localPort,
+                         _state.remotePort,
+                         sequenceNumber,                  // where we are sending from
+                         _state.rxWindow.receiveNext,     // ack up to receiveNext
+                         _state.rxWindow.receiveWindow,   // current window size
+                         flags);
+
+      // ask the IP layer to send the packet
+
+      IpTransmitRequestEvent iptre(
+            nb,
+            _state.remoteAddress,
+            IpProtocol::TCP);
+
+      _networkUtilityObjects->NetworkSendEventSender.raiseEvent(iptre);
+      return iptre.succeeded;
+    }
+
+
     /**
      * Receive some data from the remote client. If the timeout is zero then this is a blocking call that will
      * not return until success, the other end closes, or a network error occurs. actuallyReceived will be filled
@@ -760,8 +969,6 @@ namespace stm32plus {
           actuallyReceived+=received;
           ptr+=received;
 
-          _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
-
           // reset timeout base
 
           if(timeoutMillis)
@@ -795,23 +1002,46 @@ namespace stm32plus {
 
       // if we've got some data then we can check if a currently-closed receive window can be opened
 
-      if(actuallyReceived) {
+      if(actuallyReceived)
+        receiveBufferConsumed();
 
-        // this must be done with IRQs suspended
+      // finished
 
-        IrqSuspend suspender;
+      return true;
+    }
 
-        // if the receive window is closed and we can now open it then do so
 
-        if(_receiveWindowIsClosed && receiveWindowCanBeOpened()) {
-          _receiveWindowIsClosed=false;
-          _state.sendAck(*_networkUtilityObjects,sillyWindowAvoidance());
-        }
+    /**
+     * Release data that was looked at with peekReceive()
+     * @param size The number of bytes consumed. Must not be more than peekReceive() returned.
+     */
+
+    void TcpConnection::commitReceive(uint32_t size) {
+
+      if(size) {
+        _receiveBuffer->commitRead(size);
+        receiveBufferConsumed();
       }
+    }
 
-      // finished
 
-      return true;
+    /**
+     * Data has been taken out of the receive buffer. Update the window from the new free space
+     * and if the window is closed and there's now enough space to open it then tell the other end.
+     */
+
+    void TcpConnection::receiveBufferConsumed() {
+
+      // this must be done with IRQs suspended because the receive IRQ also writes the window
+
+      IrqSuspend suspender;
+
+      _state.rxWindow.receiveWindow=_receiveBuffer->availableToWrite();
+
+      if(_receiveWindowIsClosed && receiveWindowCanBeOpened()) {
+        _receiveWindowIsClosed=false;
+        sendAck();
+      }
     }
   }
 }
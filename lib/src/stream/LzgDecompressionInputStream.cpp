@@ -27,6 +27,7 @@ namespace stm32plus {
     : _input(input),
       _compressedSize(compressedSize) {
 
+    uint8_t header[HEADER_SIZE];
     int i;
 
     // no error yet
@@ -35,35 +36,55 @@ namespace stm32plus {
 
     // initialize the output byte buffer
 
-    _compressedDataAvailable=_compressedSize;
+    _compressedDataAvailable=compressedSize;
+    _uncompressedDataAvailable=0;
     _historyCopyDataAvailable=0;
 
     _dst=_circbuf;
     _dstEnd=_circbuf+sizeof(_circbuf);
+    _inputPos=_inputEnd=_inputBuffer;
 
-    // skip header information
+    // read the header. It tells us the decompressed size and the method. It comes through the
+    // input buffer because the input may give out fewer bytes than we ask for.
 
-    if(!input.skip(16))
+    if(compressedSize<HEADER_SIZE)
       return;
 
+    for(i=0;i<HEADER_SIZE;i++)
+      if(!nextByteFromStream(header[i]))
+        return;
+
+    if(header[0]!='L' || header[1]!='Z' || header[2]!='G' || header[15]>METHOD_LZG1) {
+      errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_UNSUPPORTED_COMPRESSED_DATA);
+      return;
+    }
+
+    _isStored=header[15]==METHOD_COPY;
+
     // Get marker symbols from the input stream
 
-    _input >> _marker1;
-    _input >> _marker2;
-    _input >> _marker3;
-    _input >> _marker4;
+    if(!_isStored) {
 
-    _compressedDataAvailable-=20;           // the header and 4 markers
+      if(!nextByteFromStream(_marker1) ||
+         !nextByteFromStream(_marker2) ||
+         !nextByteFromStream(_marker3) ||
+         !nextByteFromStream(_marker4))
+        return;
 
-    // Initialize marker symbol LUT
+      // Initialize marker symbol LUT
 
-    for(i=0;i<256;++i)
-      _isMarkerSymbolLUT[i]=0;
+      for(i=0;i<256;++i)
+        _isMarkerSymbolLUT[i]=0;
 
-    _isMarkerSymbolLUT[_marker1]=1;
-    _isMarkerSymbolLUT[_marker2]=1;
-    _isMarkerSymbolLUT[_marker3]=1;
-    _isMarkerSymbolLUT[_marker4]=1;
+      _isMarkerSymbolLUT[_marker1]=1;
+      _isMarkerSymbolLUT[_marker2]=1;
+      _isMarkerSymbolLUT[_marker3]=1;
+      _isMarkerSymbolLUT[_marker4]=1;
+    }
+
+    // everything is OK so data can now be read
+
+    _uncompressedDataAvailable=getUint32(header+3);
   }
 
 
@@ -74,37 +95,29 @@ namespace stm32plus {
   int16_t LzgDecompressionStream::read() {
 
     uint8_t nextByte;
+    uint32_t actuallyRead;
 
     // check for end of stream
 
-    if(_historyCopyDataAvailable==0 && _compressedDataAvailable==0)
+    if(_uncompressedDataAvailable==0)
       return E_END_OF_STREAM;
 
     // return the next byte
 
-    if(readNextUncompressedByte(nextByte))
+    if(decode(&nextByte,1,actuallyRead))
       return nextByte;
 
-    return false;
+    return E_STREAM_ERROR;
   }
 
 
-  bool LzgDecompressionStream::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
-
-    uint8_t *ptr;
-
-    ptr=static_cast<uint8_t *>(buffer);
-    actuallyRead=0;
-
-    while(size-- && available()) {
-
-      if(!readNextUncompressedByte(*ptr++))
-        return false;
-
-      actuallyRead++;
-    }
+  /*
+   * Read a block of bytes. Less than requested will be returned if the end of the
+   * data is reached.
+   */
 
-    return true;
+  bool LzgDecompressionStream::read(void *buffer,uint32_t size,uint32_t& actuallyRead) {
+    return decode(static_cast<uint8_t *>(buffer),size,actuallyRead);
   }
 
 
@@ -118,11 +131,21 @@ namespace stm32plus {
 
 
   /*
-   * Can't skip
+   * Skip forward. The skipped data must still be decompressed to maintain the history
+   * but it's not copied anywhere else.
    */
 
-  bool LzgDecompressionStream::skip(uint32_t howMuch __attribute__((unused))) {
-    return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_OPERATION_NOT_SUPPORTED);
+  bool LzgDecompressionStream::skip(uint32_t howMuch) {
+
+    uint32_t actuallySkipped;
+
+    if(!decode(nullptr,howMuch,actuallySkipped))
+      return false;
+
+    if(actuallySkipped!=howMuch)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_END_OF_STREAM);
+
+    return true;
   }
 
 
@@ -131,7 +154,7 @@ namespace stm32plus {
    */
 
   bool LzgDecompressionStream::available() {
-    return _compressedDataAvailable>0 || _historyCopyDataAvailable>0;
+    return _uncompressedDataAvailable>0;
   }
 
 
@@ -146,38 +169,64 @@ namespace stm32plus {
 
 
   /*
-   * Read the next uncompressed byte from the stream
+   * Decompress up to size bytes into the output. The output may be null, in which case the
+   * data is decompressed into the history window only.
    */
 
-  bool LzgDecompressionStream::readNextUncompressedByte(uint8_t& nextByte) {
+  bool LzgDecompressionStream::decode(uint8_t *output,uint32_t size,uint32_t& actuallyDecoded) {
 
     uint8_t symbol,b,b2;
     uint16_t offset,length;
+    const uint8_t *ptr;
+    uint32_t count;
 
-    // if we're in mid-copy from the history window, take the next byte from there
+    actuallyDecoded=0;
 
-    if(_historyCopyDataAvailable>0) {
-      nextByte=getByteFromHistoryCopy();
-      return true;
-    }
+    size=std::min(size,_uncompressedDataAvailable);
 
-    // get the next symbol
+    while(size) {
 
-    if(!nextByteFromStream(symbol))
-      return false;
+      // if we're in mid-copy from the history window, take as much as we can from there
 
-    // Marker symbol?
+      if(_historyCopyDataAvailable>0) {
 
-    if(!_isMarkerSymbolLUT[symbol]) {
+        count=std::min(size,_historyCopyDataAvailable);
+        emitHistoryCopy(output,count);
 
-      // Literal copy
+        size-=count;
+        actuallyDecoded+=count;
+        continue;
+      }
 
-      nextByte=symbol;
+      if(_inputPos==_inputEnd && !fillInputBuffer())
+        return false;
 
-      *_dst++=symbol;
-      if(_dst==_dstEnd)
-        _dst=_circbuf;
-    } else {
+      // find the run of literals at the front of the input buffer
+
+      ptr=_inputPos;
+
+      if(_isStored)
+        ptr+=std::min(size,static_cast<uint32_t>(_inputEnd-_inputPos));
+      else
+        for(count=std::min(size,static_cast<uint32_t>(_inputEnd-_inputPos));count && !_isMarkerSymbolLUT[*ptr];count--)
+          ptr++;
+
+      if(ptr!=_inputPos) {
+
+        // Literal copy
+
+        count=ptr-_inputPos;
+        emitLiterals(output,_inputPos,count);
+
+        _inputPos+=count;
+        size-=count;
+        actuallyDecoded+=count;
+        continue;
+      }
+
+      // Marker symbol
+
+      symbol=*_inputPos++;
 
       if(!nextByteFromStream(b))
         return false;
@@ -217,7 +266,7 @@ namespace stm32plus {
           offset=(b >> 5) + 1;
         }
 
-        // Copy corresponding data from history window
+        // the copy comes from the history window on the next pass around the loop
 
         if(offset<=static_cast<uint16_t>(_dst-_circbuf))
           _historyCopyPosition=_dst-offset;
@@ -226,17 +275,14 @@ namespace stm32plus {
 
         _historyCopyDataAvailable=length;
 
-        nextByte=getByteFromHistoryCopy();
-
       } else {
 
         // single occurance of a marker symbol
 
-        nextByte=symbol;
+        emitLiterals(output,&symbol,1);
 
-        *_dst++=symbol;
-        if(_dst==_dstEnd)
-          _dst=_circbuf;
+        size--;
+        actuallyDecoded++;
       }
     }
 
@@ -244,59 +290,319 @@ namespace stm32plus {
   }
 
 
+  /*
+   * Copy literals to the output and the history window
+   */
+
+  void LzgDecompressionStream::emitLiterals(uint8_t*& output,const uint8_t *literals,uint32_t size) {
+
+    uint32_t count;
+
+    if(output) {
+      memcpy(output,literals,size);
+      output+=size;
+    }
+
+    _uncompressedDataAvailable-=size;
+
+    // the history window may wrap
+
+    while(size) {
+
+      count=std::min(size,static_cast<uint32_t>(_dstEnd-_dst));
+      memcpy(_dst,literals,count);
+
+      literals+=count;
+      size-=count;
+
+      if((_dst+=count)==_dstEnd)
+        _dst=_circbuf;
+    }
+  }
+
+
+  /*
+   * Copy from the history back into the history and out to the output. The source and
+   * destination both wrap independently so the copy is done in pieces that don't wrap.
+   */
+
+  void LzgDecompressionStream::emitHistoryCopy(uint8_t*& output,uint32_t size) {
+
+    uint32_t count;
+
+    _historyCopyDataAvailable-=size;
+    _uncompressedDataAvailable-=size;
+
+    while(size) {
+
+      count=std::min(size,static_cast<uint32_t>(std::min(_dstEnd-_dst,_dstEnd-_historyCopyPosition)));
+
+      // a source that's behind the destination may overlap it for a repeating pattern. a
+      // source that's ahead has wrapped around and is far enough away to be read first.
+
+      if(_historyCopyPosition<_dst)
+        copyHistory(_dst,_historyCopyPosition,count);
+      else
+        memmove(_dst,_historyCopyPosition,count);
+
+      if(output) {
+        memcpy(output,_dst,count);
+        output+=count;
+      }
+
+      size-=count;
+
+      if((_dst+=count)==_dstEnd)
+        _dst=_circbuf;
+
+      if((_historyCopyPosition+=count)==_dstEnd)
+        _historyCopyPosition=_circbuf;
+    }
+  }
+
+
   /*
    * Get next byte from input stream
    */
 
   bool LzgDecompressionStream::nextByteFromStream(uint8_t& nextByte) {
 
-    int16_t value;
+    if(_inputPos==_inputEnd && !fillInputBuffer())
+      return false;
+
+    nextByte=*_inputPos++;
+    return true;
+  }
+
+
+  /*
+   * Read the next block of compressed data from the input stream
+   */
+
+  bool LzgDecompressionStream::fillInputBuffer() {
+
+    uint32_t actuallyRead;
 
     // must have a byte to read
 
-    if(_compressedSize==0)
+    if(_compressedDataAvailable==0)
       return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_END_OF_STREAM);
 
-    // read next byte
-
-    if((value=_input.read())<0)
+    if(!_input.read(_inputBuffer,std::min(_compressedDataAvailable,static_cast<uint32_t>(INPUT_BUFFER_SIZE)),actuallyRead))
       return false;
 
-    // return it
+    if(actuallyRead==0)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_END_OF_STREAM);
 
-    nextByte=value;
-    _compressedSize--;
+    _compressedDataAvailable-=actuallyRead;
+    _inputPos=_inputBuffer;
+    _inputEnd=_inputBuffer+actuallyRead;
 
     return true;
   }
 
 
-  /*
-   * Get one byte from the available data in this history window.
-   * Data must be available!
+  /**
+   * Get the size of the data when it's decompressed
+   * @param compressed The compressed data including the header
+   * @param compressedSize The size of the compressed data
+   * @return The decompressed size, or zero if this is not LZG data
+   */
+
+  uint32_t LzgDecompressionStream::getDecodedSize(const void *compressed,uint32_t compressedSize) {
+
+    const uint8_t *in;
+
+    in=static_cast<const uint8_t *>(compressed);
+
+    if(compressedSize<HEADER_SIZE || in[0]!='L' || in[1]!='Z' || in[2]!='G')
+      return 0;
+
+    return getUint32(in+3);
+  }
+
+
+  /**
+   * Decompress a whole block of data that's in memory into a buffer that's large enough for
+   * all of it. There's no history window because the history is the output buffer so this
+   * is faster than the stream and distant copies are supported. The data is checked for
+   * corruption that would cause an access outside either buffer.
+   * @param compressed The compressed data including the header
+   * @param compressedSize The size of the compressed data
+   * @param output Where to write the decompressed data
+   * @param outputSize The size of the output buffer. Must be at least getDecodedSize().
+   * @return true if it worked
    */
 
-  uint8_t LzgDecompressionStream::getByteFromHistoryCopy() {
+  bool LzgDecompressionStream::decompress(const void *compressed,uint32_t compressedSize,void *output,uint32_t outputSize) {
+
+    const uint8_t *src,*srcEnd,*ptr;
+    uint8_t *dst,*dstEnd,symbol,b,b2;
+    uint8_t marker1,marker2,marker3,marker4;
+    char isMarkerSymbolLUT[256];
+    uint32_t decodedSize,length,offset;
+    int i;
+
+    src=static_cast<const uint8_t *>(compressed);
+    srcEnd=src+compressedSize;
 
-    uint8_t retval;
+    if((decodedSize=getDecodedSize(compressed,compressedSize))==0 || src[15]>METHOD_LZG1)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_UNSUPPORTED_COMPRESSED_DATA);
 
-    // get the next value from the copy position, copy back to the circular buffer
+    if(decodedSize>outputSize)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
 
-    retval=*_historyCopyPosition++;
-    *_dst++=retval;
+    dst=static_cast<uint8_t *>(output);
+    dstEnd=dst+decodedSize;
 
-    // copy position and source pointer are both in the circular buffer and must be updated
+    // plain copy?
 
-    if(_dst==_dstEnd)
-      _dst=_circbuf;
+    if(src[15]==METHOD_COPY) {
 
-    if(_historyCopyPosition==_dstEnd)
-      _historyCopyPosition=_circbuf;
+      if(compressedSize-HEADER_SIZE!=decodedSize)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+      memcpy(dst,src+HEADER_SIZE,decodedSize);
+      return true;
+    }
+
+    src+=HEADER_SIZE;
+
+    if(srcEnd-src<4)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+    marker1=*src++;
+    marker2=*src++;
+    marker3=*src++;
+    marker4=*src++;
+
+    for(i=0;i<256;++i)
+      isMarkerSymbolLUT[i]=0;
+
+    isMarkerSymbolLUT[marker1]=1;
+    isMarkerSymbolLUT[marker2]=1;
+    isMarkerSymbolLUT[marker3]=1;
+    isMarkerSymbolLUT[marker4]=1;
+
+    while(src<srcEnd) {
+
+      // copy the run of literals up to the next marker
+
+      for(ptr=src;ptr<srcEnd && !isMarkerSymbolLUT[*ptr];ptr++);
+
+      if(ptr!=src) {
+
+        if(ptr-src>dstEnd-dst)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+        memcpy(dst,src,ptr-src);
+        dst+=ptr-src;
+        src=ptr;
+        continue;
+      }
+
+      symbol=*src++;
+
+      if(src==srcEnd)
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+      if((b=*src++)==0) {
+
+        // single occurance of a marker symbol
 
-    // that's one less byte available for next time
+        if(dst==dstEnd)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
 
-    _historyCopyDataAvailable--;
+        *dst++=symbol;
+        continue;
+      }
+
+      if(symbol==marker1) {
+
+        // Distant copy
+
+        if(srcEnd-src<2)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+        length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        b2=*src++;
+        offset=(((uint32_t)(b & 0xe0)) << 11) | (((uint32_t)b2) << 8) | (*src++);
+        offset+=2056;
+      }
+      else if(symbol==marker2) {
+
+        // Medium copy
+
+        if(src==srcEnd)
+          return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+        length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        b2=*src++;
+        offset=(((uint32_t)(b & 0xe0)) << 3) | b2;
+        offset+=8;
+      }
+      else if(symbol==marker3) {
+
+        // Short copy
+
+        length=(b >> 6) + 3;
+        offset=(b & 0x3f) + 8;
+      }
+      else {
+
+        // Near copy (including RLE)
+
+        length=LZG_LENGTH_DECODE_LUT[b & 0x1f];
+        offset=(b >> 5) + 1;
+      }
+
+      if(offset>static_cast<uint32_t>(dst-static_cast<uint8_t *>(output)) || length>static_cast<uint32_t>(dstEnd-dst))
+        return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+      copyHistory(dst,dst-offset,length);
+      dst+=length;
+    }
+
+    // Did we get the right number of output bytes?
+
+    if(dst!=dstEnd)
+      return errorProvider.set(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,E_CORRUPT_COMPRESSED_DATA);
+
+    return true;
+  }
+
+
+  /*
+   * Copy a back-reference where the source is before the destination. If they don't overlap
+   * then it's one block copy. If they do then the data is a pattern that repeats every
+   * (dest-src) bytes. Each copied block extends the pattern so the copies double in size.
+   */
+
+  void LzgDecompressionStream::copyHistory(uint8_t *dest,const uint8_t *src,uint32_t size) {
+
+    uint32_t distance,count,done;
+
+    distance=dest-src;
+
+    if(distance>=size) {
+      memcpy(dest,src,size);
+      return;
+    }
+
+    memcpy(dest,src,distance);
+
+    for(done=distance;done<size;done+=count) {
+      count=std::min(done-done%distance,size-done);
+      memcpy(dest+done,dest+done-(done-done%distance),count);
+    }
+  }
+
+
+  /*
+   * Get a big-endian 32 bit value from the header
+   */
 
-    return retval;
+  uint32_t LzgDecompressionStream::getUint32(const uint8_t *ptr) {
+    return (static_cast<uint32_t>(ptr[0]) << 24) | (static_cast<uint32_t>(ptr[1]) << 16) | (static_cast<uint32_t>(ptr[2]) << 8) | ptr[3];
   }
 }
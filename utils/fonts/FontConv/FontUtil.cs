@@ -103,5 +103,55 @@ namespace FontConv
 
       return values;
     }
+
+
+  /*
+   * get the anti-aliased character coverage, 0 (paper) to 255 (ink). the character is drawn
+   * in the same box as GetCharacterBitmap() so the two line up
+   */
+
+    static public byte[,] GetCharacterCoverage(Control refControl_,Font f_,char c_,int xoffset_,int yoffset_,int extraLines_)
+    {
+      byte[,] values;
+      int x,y,width;
+      Bitmap bm;
+      Color cr;
+
+      using(Graphics g=refControl_.CreateGraphics())
+      {
+        g.TextRenderingHint=TextRenderingHint.SingleBitPerPixel;
+
+        if(c_==' ')
+          width=(int)g.MeasureString("-",f_,PointF.Empty,StringFormat.GenericTypographic).Width;
+        else
+          width=(int)g.MeasureString(c_.ToString(),f_,PointF.Empty,StringFormat.GenericTypographic).Width;
+        
+        bm=new Bitmap(width,(int)f_.Size+extraLines_,g);
+
+        using(Graphics g2=Graphics.FromImage(bm))
+        {
+          g2.FillRectangle(Brushes.White,0,0,bm.Width,bm.Height);
+
+          // greyscale anti-aliasing, not ClearType, so the coverage is the same in each channel
+
+          g2.TextRenderingHint=TextRenderingHint.AntiAliasGridFit;
+          g2.DrawString(c_.ToString(),f_,Brushes.Black,xoffset_,yoffset_,StringFormat.GenericTypographic);
+
+          values=new byte[bm.Width,bm.Height];
+
+          for(y=0;y<bm.Height;y++)
+          {
+            for(x=0;x<bm.Width;x++)
+            {
+              cr=bm.GetPixel(x,y);
+              
+              values[x,y]=(byte)(255-(cr.R+cr.G+cr.B)/3);
+            }
+          }
+        }
+      }
+
+      return values;
+    }
   }
 }
@@ -90,6 +90,18 @@ namespace FontConv {
               fw=new Stm32plusFontWriter(sf,headerWriter,sourceWriter,root,refControl);
               break;
 
+            case TargetDevice.STM32PLUS_RLE:
+              fw=new Stm32plusRleFontWriter(sf,headerWriter,sourceWriter,root,refControl);
+              break;
+
+            case TargetDevice.STM32PLUS_AA2:
+              fw=new Stm32plusAntiAliasedFontWriter(sf,headerWriter,sourceWriter,root,refControl,2);
+              break;
+
+            case TargetDevice.STM32PLUS_AA4:
+              fw=new Stm32plusAntiAliasedFontWriter(sf,headerWriter,sourceWriter,root,refControl,4);
+              break;
+
             default:
               throw new Exception("Unknown device");
           }
@@ -180,6 +192,24 @@ namespace FontConv {
     }
 
 
+    /*
+     * The library class that the generated font derives from
+     */
+
+    virtual protected string GetFontClassName() {
+      return "Font";
+    }
+
+
+    /*
+     * The constructor arguments for the library class
+     */
+
+    virtual protected string GetFontArguments(int firstChar,int charCount,int height,int spacing) {
+      return firstChar+","+charCount+","+height+","+spacing+","+GetCharName();
+    }
+
+
     /*
      * Write the font declaration
      */
@@ -197,10 +227,10 @@ namespace FontConv {
 
       _headerWriter.Write("  extern const struct FontChar "+GetCharName()+"[];\n\n");
 
-      _headerWriter.Write("  class Font_"+_font.Name+_font.Size+" : public Font {\n");
+      _headerWriter.Write("  class Font_"+_font.Name+_font.Size+" : public "+GetFontClassName()+" {\n");
       _headerWriter.Write("    public:\n");
       _headerWriter.Write("      Font_"+_font.Name+_font.Size+"()\n");
-      _headerWriter.Write("        : Font("+firstChar+","+charCount+","+height+","+spacing+","+GetCharName()+") {\n");
+      _headerWriter.Write("        : "+GetFontClassName()+"("+GetFontArguments(firstChar,charCount,height,spacing)+") {\n");
       _headerWriter.Write("      }\n");
       _headerWriter.Write("  };\n");
     }
@@ -62,6 +62,9 @@
       this._saveFileDialog = new System.Windows.Forms.SaveFileDialog();
       this._btnStm32plus = new System.Windows.Forms.RadioButton();
       this._btnArduino = new System.Windows.Forms.RadioButton();
+      this._btnStm32plusRle = new System.Windows.Forms.RadioButton();
+      this._btnStm32plusAa2 = new System.Windows.Forms.RadioButton();
+      this._btnStm32plusAa4 = new System.Windows.Forms.RadioButton();
       this.groupBox4 = new System.Windows.Forms.GroupBox();
       this._openFontFileDialog = new System.Windows.Forms.OpenFileDialog();
       this._logo = new System.Windows.Forms.PictureBox();
@@ -430,14 +433,50 @@
       this._btnArduino.Text = "Arduino";
       this._btnArduino.UseVisualStyleBackColor = true;
       // 
+      // _btnStm32plusRle
+      // 
+      this._btnStm32plusRle.AutoSize = true;
+      this._btnStm32plusRle.Location = new System.Drawing.Point(10, 61);
+      this._btnStm32plusRle.Name = "_btnStm32plusRle";
+      this._btnStm32plusRle.Size = new System.Drawing.Size(82, 17);
+      this._btnStm32plusRle.TabIndex = 2;
+      this._btnStm32plusRle.TabStop = true;
+      this._btnStm32plusRle.Text = "stm32plus RLE";
+      this._btnStm32plusRle.UseVisualStyleBackColor = true;
+      // 
+      // _btnStm32plusAa2
+      // 
+      this._btnStm32plusAa2.AutoSize = true;
+      this._btnStm32plusAa2.Location = new System.Drawing.Point(10, 82);
+      this._btnStm32plusAa2.Name = "_btnStm32plusAa2";
+      this._btnStm32plusAa2.Size = new System.Drawing.Size(84, 17);
+      this._btnStm32plusAa2.TabIndex = 3;
+      this._btnStm32plusAa2.TabStop = true;
+      this._btnStm32plusAa2.Text = "stm32plus AA2";
+      this._btnStm32plusAa2.UseVisualStyleBackColor = true;
+      // 
+      // _btnStm32plusAa4
+      // 
+      this._btnStm32plusAa4.AutoSize = true;
+      this._btnStm32plusAa4.Location = new System.Drawing.Point(10, 103);
+      this._btnStm32plusAa4.Name = "_btnStm32plusAa4";
+      this._btnStm32plusAa4.Size = new System.Drawing.Size(84, 17);
+      this._btnStm32plusAa4.TabIndex = 4;
+      this._btnStm32plusAa4.TabStop = true;
+      this._btnStm32plusAa4.Text = "stm32plus AA4";
+      this._btnStm32plusAa4.UseVisualStyleBackColor = true;
+      // 
       // groupBox4
       // 
       this.groupBox4.Anchor = ((System.Windows.Forms.AnchorStyles)((System.Windows.Forms.AnchorStyles.Top | System.Windows.Forms.AnchorStyles.Right)));
       this.groupBox4.Controls.Add(this._btnStm32plus);
       this.groupBox4.Controls.Add(this._btnArduino);
+      this.groupBox4.Controls.Add(this._btnStm32plusRle);
+      this.groupBox4.Controls.Add(this._btnStm32plusAa2);
+      this.groupBox4.Controls.Add(this._btnStm32plusAa4);
       this.groupBox4.Location = new System.Drawing.Point(954, 74);
       this.groupBox4.Name = "groupBox4";
-      this.groupBox4.Size = new System.Drawing.Size(97, 68);
+      this.groupBox4.Size = new System.Drawing.Size(97, 131);
       this.groupBox4.TabIndex = 5;
       this.groupBox4.TabStop = false;
       this.groupBox4.Text = "Target";
@@ -524,6 +563,9 @@
     private System.Windows.Forms.SaveFileDialog _saveFileDialog;
     private System.Windows.Forms.RadioButton _btnStm32plus;
     private System.Windows.Forms.RadioButton _btnArduino;
+    private System.Windows.Forms.RadioButton _btnStm32plusRle;
+    private System.Windows.Forms.RadioButton _btnStm32plusAa2;
+    private System.Windows.Forms.RadioButton _btnStm32plusAa4;
     private System.Windows.Forms.GroupBox groupBox4;
     private System.Windows.Forms.OpenFileDialog _openFontFileDialog;
     private System.Windows.Forms.Button _btnSelectAlpha;
@@ -365,6 +365,12 @@ namespace FontConv
           td=TargetDevice.ARDUINO;
         else if(_btnStm32plus.Checked)
           td=TargetDevice.STM32PLUS;
+        else if(_btnStm32plusRle.Checked)
+          td=TargetDevice.STM32PLUS_RLE;
+        else if(_btnStm32plusAa2.Checked)
+          td=TargetDevice.STM32PLUS_AA2;
+        else if(_btnStm32plusAa4.Checked)
+          td=TargetDevice.STM32PLUS_AA4;
         else
           throw new Exception("Please select a target device");
 
@@ -0,0 +1,101 @@
+﻿using System;
+using System.IO;
+using System.Windows.Forms;
+using System.Xml;
+
+
+namespace FontConv {
+  
+  /*
+   * Class for writing out anti-aliased fonts suitable for the stm32. Each pixel is the coverage
+   * of the character scaled down to 2 or 4 bits and the pixels are packed left to right, top to
+   * bottom from the least significant bits of each byte, in the same order as a bitmap font.
+   */
+
+  public class Stm32plusAntiAliasedFontWriter : Stm32plusFontWriter {
+
+    /*
+     * Members
+     */
+
+    protected int _bitsPerPixel;
+
+
+    /*
+     * Constructor
+     */
+
+    public Stm32plusAntiAliasedFontWriter(SizedFont sf,StreamWriter headerWriter,StreamWriter sourceWriter,XmlElement parent,Control refControl,int bitsPerPixel)
+      : base(sf,headerWriter,sourceWriter,parent,refControl) {
+
+      _bitsPerPixel=bitsPerPixel;
+    }
+
+  /*
+   * the generated class is an AntiAliasedFont
+   */
+
+    override protected string GetFontClassName() {
+      return "AntiAliasedFont";
+    }
+
+  /*
+   * the bits per pixel go before the characters
+   */
+
+    override protected string GetFontArguments(int firstChar,int charCount,int height,int spacing) {
+      return firstChar+","+charCount+","+height+","+spacing+","+_bitsPerPixel+","+GetCharName();
+    }
+
+  /*
+   * write font byte declarations
+   */
+
+    override protected void WriteFontBytes() {
+      
+      string str;
+      byte[,] values;
+      int x,y,b,bitpos,maxLevel;
+
+      _sourceWriter.Write("  // "+_bitsPerPixel+" bit coverage definitions for "+_font.Identifier+"\n\n");
+
+      maxLevel=(1 << _bitsPerPixel)-1;
+
+      foreach(char c in _font.Characters()) {
+
+        str=GetBytesName(c);
+
+        _sourceWriter.Write("  FONTCONST uint8_t "+str+"[]={ ");
+
+        values=FontUtil.GetCharacterCoverage(_refControl,_font.GdiFont,c,_font.XOffset,_font.YOffset,_font.ExtraLines);
+          
+        b=0;
+        bitpos=0;
+
+        for(y=0;y<values.GetLength(1);y++)
+        {
+          for(x=0;x<values.GetLength(0);x++)
+          {
+            // scale 0..255 to the nearest level
+
+            b|=((values[x,y]*maxLevel+127)/255) << bitpos;
+            bitpos+=_bitsPerPixel;
+
+            if(bitpos==8)
+            {
+              _sourceWriter.Write(b.ToString()+",");
+              bitpos=0;
+              b=0;
+            }
+          }
+        }
+
+        if(bitpos>0)
+          _sourceWriter.Write(b.ToString()+",");
+
+        _sourceWriter.Write("};\n");
+      }
+      _sourceWriter.Write("\n");
+    }
+  }
+}
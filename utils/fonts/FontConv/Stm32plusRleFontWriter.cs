@@ -0,0 +1,94 @@
+﻿using System;
+using System.IO;
+using System.Windows.Forms;
+using System.Xml;
+
+
+namespace FontConv {
+  
+  /*
+   * Class for writing out run length encoded fonts suitable for the stm32. The pixels of each
+   * character are scanned left to right, top to bottom and written as the lengths of the runs
+   * of background and foreground pixels, alternately and starting with background. A run that
+   * won't fit in a byte is split with a zero length run of the other colour.
+   */
+
+  public class Stm32plusRleFontWriter : Stm32plusFontWriter {
+
+    /*
+     * Constructor
+     */
+
+    public Stm32plusRleFontWriter(SizedFont sf,StreamWriter headerWriter,StreamWriter sourceWriter,XmlElement parent,Control refControl)
+      : base(sf,headerWriter,sourceWriter,parent,refControl) {
+    }
+
+  /*
+   * the generated class is an RleFont
+   */
+
+    override protected string GetFontClassName() {
+      return "RleFont";
+    }
+
+  /*
+   * write font byte declarations
+   */
+
+    override protected void WriteFontBytes() {
+      
+      string str;
+      bool[,] values;
+      bool foreground;
+      int x,y,run;
+
+      _sourceWriter.Write("  // run length definitions for "+_font.Identifier+"\n\n");
+
+      foreach(char c in _font.Characters()) {
+
+        str=GetBytesName(c);
+
+        _sourceWriter.Write("  FONTCONST uint8_t "+str+"[]={ ");
+
+        values=FontUtil.GetCharacterBitmap(_refControl,_font.GdiFont,c,_font.XOffset,_font.YOffset,_font.ExtraLines);
+
+        foreground=false;
+        run=0;
+
+        for(y=0;y<values.GetLength(1);y++)
+        {
+          for(x=0;x<values.GetLength(0);x++)
+          {
+            if(values[x,y]!=foreground)
+            {
+              WriteRun(run);
+              foreground=!foreground;
+              run=0;
+            }
+
+            run++;
+          }
+        }
+
+        WriteRun(run);
+        _sourceWriter.Write("};\n");
+      }
+      _sourceWriter.Write("\n");
+    }
+
+
+  /*
+   * write a run length, splitting it if it's too long for a byte
+   */
+
+    private void WriteRun(int run) {
+      
+      while(run>255) {
+        _sourceWriter.Write("255,0,");
+        run-=255;
+      }
+
+      _sourceWriter.Write(run.ToString()+",");
+    }
+  }
+}
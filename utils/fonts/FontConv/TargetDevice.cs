@@ -7,6 +7,9 @@ namespace FontConv {
 
   public enum TargetDevice {
     STM32PLUS,
+    STM32PLUS_RLE,
+    STM32PLUS_AA2,
+    STM32PLUS_AA4,
     ARDUINO
   };
 }
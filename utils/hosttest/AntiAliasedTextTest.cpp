@@ -0,0 +1,437 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for anti-aliased text. 2 and 4 bpp fonts are made from the proportional Volter font
+ * by giving each pixel the coverage of the 2x2 box below and to the right of it, so the
+ * widths vary and the rows of a character start part way through a byte.
+ *
+ * Each combination of depth and filled/unfilled background is drawn on an in-memory panel
+ * and compared with a straightforward model renderer and with the reference bitmap in the
+ * reference directory. The filled strings are longer than MAX_BLIT_CHARACTERS so that they
+ * are split into groups by writeAlphaGlyphs(), and the counters check that each group and
+ * each unfilled span written by writeAlphaGlyphSpans() gets a single window. Blending is
+ * checked for every alpha level.
+ *
+ * Run with --write-reference to rewrite the reference bitmaps from the model.
+ */
+
+#include "config/stm32plus.h"
+#include "config/display/tft.h"
+#include "MemoryPanel.h"
+#include "HostTest.h"
+
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::display;
+
+
+namespace stm32plus {
+  namespace display {
+    extern const struct FontChar FDEF_VOLTER__28GOLDFISH_29_CHAR[];
+  }
+}
+
+
+namespace {
+
+  enum {
+    FIRST_CHAR = 32,
+    CHARACTER_COUNT = 95,
+    HEIGHT = 10,
+    SPACING = 1,
+    LINE_HEIGHT = 12,
+    CLEAR_COLOUR = 0x204010,
+    IMAGE_WIDTH = 200,
+    IMAGE_HEIGHT = LINE_HEIGHT*3,
+    BLIT_CHARACTERS = 16              // GraphicsLibrary::MAX_BLIT_CHARACTERS
+  };
+
+  struct Line {
+    const char *Text;
+    uint32_t Foreground;
+    uint32_t Background;
+  };
+
+  const Line Lines[]={
+    { "The quick brown fox jumps over",0xffffff,0x000080 },
+    { "Temp 23.5C  RPM 1234 ~{}|",0xffff00,0x000080 },
+    { "Hello, world! 0123456789 @#$%",0x20ff40,0x102040 }
+  };
+
+
+  /*
+   * The coverage of a pixel from 0 to 4
+   */
+
+  uint8_t getCoverage(const FontChar& fc,int x,int y) {
+
+    uint8_t count;
+    int dx,dy,xx,yy,bit;
+
+    count=0;
+
+    for(dy=0;dy<2;dy++) {
+      for(dx=0;dx<2;dx++) {
+
+        xx=x+dx;
+        yy=y+dy;
+
+        if(xx<fc.PixelWidth && yy<HEIGHT) {
+          bit=yy*fc.PixelWidth+xx;
+          if(fc.Data[bit/8] & (1 << (bit % 8)))
+            count++;
+        }
+      }
+    }
+
+    return count;
+  }
+
+
+  uint8_t getLevel(const FontChar& fc,int x,int y,uint8_t bpp) {
+    return (getCoverage(fc,x,y)*((1 << bpp)-1)+2)/4;
+  }
+
+
+  /*
+   * An anti-aliased font made from the Volter bitmap font
+   */
+
+  class TestFont {
+
+    protected:
+      std::vector<std::vector<uint8_t>> _data;
+      std::vector<FontChar> _characters;
+      std::unique_ptr<AntiAliasedFont> _font;
+
+    public:
+      TestFont(uint8_t bpp) {
+
+        uint32_t i,bitOffset;
+        int x,y;
+
+        _data.resize(CHARACTER_COUNT);
+        _characters.assign(FDEF_VOLTER__28GOLDFISH_29_CHAR,FDEF_VOLTER__28GOLDFISH_29_CHAR+CHARACTER_COUNT);
+
+        for(i=0;i<CHARACTER_COUNT;i++) {
+
+          const FontChar& source(FDEF_VOLTER__28GOLDFISH_29_CHAR[i]);
+
+          _data[i].assign((source.PixelWidth*HEIGHT*bpp+7)/8+1,0);
+          bitOffset=0;
+
+          for(y=0;y<HEIGHT;y++) {
+            for(x=0;x<source.PixelWidth;x++) {
+              _data[i][bitOffset/8]|=getLevel(source,x,y,bpp) << (bitOffset % 8);
+              bitOffset+=bpp;
+            }
+          }
+
+          _characters[i].Data=&_data[i][0];
+        }
+
+        _font.reset(new AntiAliasedFont(FIRST_CHAR,CHARACTER_COUNT,HEIGHT,SPACING,bpp,&_characters[0]));
+      }
+
+      const AntiAliasedFont& getFont() const {
+        return *_font;
+      }
+  };
+
+
+  /*
+   * 64K colour packing and blending done the long way
+   */
+
+  uint16_t pack(uint32_t rgb) {
+    return ((rgb >> 19) & 0x1f) << 11 | ((rgb >> 10) & 0x3f) << 5 | ((rgb >> 3) & 0x1f);
+  }
+
+
+  uint32_t blend(uint32_t foreground,uint32_t background,uint8_t alpha) {
+
+    uint32_t rgb,fg,bg;
+    int shift;
+
+    rgb=0;
+
+    for(shift=16;shift>=0;shift-=8) {
+      fg=(foreground >> shift) & 0xff;
+      bg=(background >> shift) & 0xff;
+      rgb|=((fg*alpha+bg*(255-alpha)+127)/255) << shift;
+    }
+
+    return rgb;
+  }
+
+
+  /*
+   * The expected image for a combination along with the expected number of write commands
+   */
+
+  struct Expected {
+    std::vector<uint16_t> Image;
+    uint32_t Writes[3];
+  };
+
+
+  Expected model(uint8_t bpp,bool filled) {
+
+    Expected expected;
+    uint32_t i,alpha;
+    uint16_t palette[16];
+    uint8_t maxLevel,level;
+    int x,y,cx,length;
+    const char *ptr;
+    bool inRun;
+
+    maxLevel=(1 << bpp)-1;
+    expected.Image.assign(IMAGE_WIDTH*IMAGE_HEIGHT,pack(CLEAR_COLOUR));
+
+    for(i=0;i<3;i++) {
+
+      for(level=0;level<=maxLevel;level++) {
+        alpha=(level*255+maxLevel/2)/maxLevel;
+        palette[level]=pack(blend(Lines[i].Foreground,Lines[i].Background,alpha));
+      }
+
+      x=2;
+      length=strlen(Lines[i].Text);
+      expected.Writes[i]=filled ? (length+BLIT_CHARACTERS-1)/BLIT_CHARACTERS : 0;
+
+      for(ptr=Lines[i].Text;*ptr;ptr++) {
+
+        const FontChar& fc(FDEF_VOLTER__28GOLDFISH_29_CHAR[*ptr-FIRST_CHAR]);
+
+        for(y=0;y<HEIGHT;y++) {
+
+          inRun=false;
+
+          for(cx=0;cx<fc.PixelWidth+SPACING;cx++) {
+
+            level=cx<fc.PixelWidth ? getLevel(fc,cx,y,bpp) : 0;
+
+            if(filled || level)
+              expected.Image[(i*LINE_HEIGHT+y)*IMAGE_WIDTH+x+cx]=palette[level];
+
+            if(!filled && level && !inRun)
+              expected.Writes[i]++;
+
+            inRun=level!=0;
+          }
+        }
+
+        x+=fc.PixelWidth+SPACING;
+      }
+    }
+
+    return expected;
+  }
+
+
+  /*
+   * Reference bitmaps are binary PPM files
+   */
+
+  std::string getReferenceName(uint8_t bpp,bool filled) {
+
+    char name[100];
+
+    sprintf(name,"reference/AntiAliasedText_%dbpp_%s.ppm",bpp,filled ? "filled" : "unfilled");
+    return name;
+  }
+
+
+  bool writeReference(const std::string& name,const std::vector<uint16_t>& image) {
+
+    FILE *f;
+    uint16_t pixel;
+    uint8_t rgb[3];
+
+    if((f=fopen(name.c_str(),"wb"))==nullptr)
+      return false;
+
+    fprintf(f,"P6\n%d %d\n255\n",IMAGE_WIDTH,IMAGE_HEIGHT);
+
+    for(uint32_t i=0;i<image.size();i++) {
+
+      pixel=image[i];
+
+      rgb[0]=(pixel >> 11) << 3;
+      rgb[1]=((pixel >> 5) & 0x3f) << 2;
+      rgb[2]=(pixel & 0x1f) << 3;
+
+      fwrite(rgb,3,1,f);
+    }
+
+    fclose(f);
+    return true;
+  }
+
+
+  bool readReference(const std::string& name,std::vector<uint16_t>& image) {
+
+    FILE *f;
+    int width,height,maxval;
+    uint8_t rgb[3];
+
+    if((f=fopen(name.c_str(),"rb"))==nullptr)
+      return false;
+
+    image.clear();
+
+    if(fscanf(f,"P6 %d %d %d",&width,&height,&maxval)==3 && width==IMAGE_WIDTH && height==IMAGE_HEIGHT && fgetc(f)=='\n') {
+      while(fread(rgb,3,1,f)==1)
+        image.push_back((rgb[0] >> 3) << 11 | (rgb[1] >> 2) << 5 | (rgb[2] >> 3));
+    }
+
+    fclose(f);
+    return image.size()==IMAGE_WIDTH*IMAGE_HEIGHT;
+  }
+
+
+  /*
+   * Draw the lines with the library and return the top left of the panel
+   */
+
+  std::vector<uint16_t> render(const AntiAliasedFont& font,bool filled,uint32_t *writes) {
+
+    MemoryPanelAccessMode accessMode;
+    MemoryGraphicsLibrary gl(accessMode);
+    std::vector<uint16_t> image;
+    Size size;
+    int y;
+
+    gl.setBackground(CLEAR_COLOUR);
+    gl.clearScreen();
+    gl.setFontFilledBackground(filled);
+
+    for(uint32_t i=0;i<3;i++) {
+
+      gl.setForeground(Lines[i].Foreground);
+      gl.setBackground(Lines[i].Background);
+      gl.resetCounters();
+
+      size=gl.writeString(Point(2,i*LINE_HEIGHT),font,Lines[i].Text);
+      writes[i]=gl.getCounters().Writes;
+
+      HOSTTEST_CHECK(size.Height==HEIGHT);
+      HOSTTEST_CHECK(size.Width==gl.measureString(font,Lines[i].Text).Width);
+    }
+
+    for(y=0;y<IMAGE_HEIGHT;y++)
+      image.insert(image.end(),gl.getGram().begin()+y*MemoryPanel::WIDTH,gl.getGram().begin()+y*MemoryPanel::WIDTH+IMAGE_WIDTH);
+
+    return image;
+  }
+
+
+  /*
+   * Compare an image and report the first difference
+   */
+
+  void compare(const char *what,const std::string& name,const std::vector<uint16_t>& actual,const std::vector<uint16_t>& expected) {
+
+    for(uint32_t i=0;i<actual.size();i++) {
+
+      if(actual[i]!=expected[i]) {
+        fprintf(stderr,"%s: %s differs at (%u,%u): %04x, expected %04x\n",
+                name.c_str(),what,i % IMAGE_WIDTH,i/IMAGE_WIDTH,actual[i],expected[i]);
+        hosttest::check(false,what,__FILE__,__LINE__);
+        return;
+      }
+    }
+  }
+
+
+  void testRendering(uint8_t bpp,bool filled,bool write) {
+
+    TestFont font(bpp);
+    std::vector<uint16_t> actual,reference;
+    std::string name;
+    uint32_t writes[3];
+    Expected expected;
+
+    name=getReferenceName(bpp,filled);
+    expected=model(bpp,filled);
+
+    if(write) {
+      HOSTTEST_CHECK(writeReference(name,expected.Image));
+      return;
+    }
+
+    actual=render(font.getFont(),filled,writes);
+
+    compare("model",name,actual,expected.Image);
+
+    if(!readReference(name,reference))
+      hosttest::check(false,"reference bitmap missing or unreadable",__FILE__,__LINE__);
+    else
+      compare("reference",name,actual,reference);
+
+    // one window per group of characters when filled, one per span when not
+
+    for(uint32_t i=0;i<3;i++)
+      HOSTTEST_CHECK(writes[i]==expected.Writes[i]);
+  }
+
+
+  /*
+   * Every alpha level blends each component with rounding
+   */
+
+  void testBlending() {
+
+    MemoryPanelAccessMode accessMode;
+    MemoryGraphicsLibrary gl(accessMode);
+    const uint32_t pairs[][2]={
+      { 0xffffff,0x000000 },
+      { 0x000000,0xffffff },
+      { 0xff8000,0x0080ff },
+      { 0x123456,0xfedcba },
+      { 0x808080,0x808080 }
+    };
+    MemoryGraphicsLibrary::UnpackedColour cr;
+    uint32_t i,alpha;
+
+    for(i=0;i<sizeof(pairs)/sizeof(pairs[0]);i++) {
+
+      gl.setForeground(pairs[i][0]);
+      gl.setBackground(pairs[i][1]);
+
+      for(alpha=0;alpha<=255;alpha++) {
+        gl.getBlendedColour(alpha,cr);
+        HOSTTEST_CHECK(cr.packed565==pack(blend(pairs[i][0],pairs[i][1],alpha)));
+      }
+
+      gl.getBlendedColour(0,cr);
+      HOSTTEST_CHECK(cr.packed565==pack(pairs[i][1]));
+
+      gl.getBlendedColour(255,cr);
+      HOSTTEST_CHECK(cr.packed565==pack(pairs[i][0]));
+    }
+  }
+}
+
+
+int main(int argc,char *argv[]) {
+
+  bool write;
+
+  write=argc>1 && strcmp(argv[1],"--write-reference")==0;
+
+  testBlending();
+
+  testRendering(2,true,write);
+  testRendering(2,false,write);
+  testRendering(4,true,write);
+  testRendering(4,false,write);
+
+  return hosttest::result("AntiAliasedTextTest");
+}
@@ -0,0 +1,429 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the ARP cache on a fake clock. The RTC stand-in reads the millisecond timer,
+ * which only moves when the test moves it, so expiry is exact:
+ *
+ *   - an entry is good up to and including its expiry second and gone after it
+ *   - a full cache evicts the least recently used entry, and a lookup makes an entry the
+ *     most recently used
+ *   - an unresolved entry is reported until it expires or the address is resolved, and it
+ *     doesn't replace a resolved entry that's still good
+ *   - a watcher is released by the insert of its address and times out without it
+ *
+ * The hosts on a subnet must spread over the hash index. Then random inserts, lookups and
+ * clock moves over more addresses than the cache holds are
+ * checked against a model of the LRU list. That drives the hash index through collisions,
+ * evictions and removals from the middle of probe runs.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "HostTest.h"
+
+#include <list>
+#include <set>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    EXPIRY = 10,
+    UNRESOLVED_EXPIRY = 3,
+    ENTRIES = 16,
+    ADDRESSES = 48,
+    OPERATIONS = 200000
+  };
+
+
+  IpAddress ip(uint32_t n) {
+
+    IpAddress address;
+
+    address.ipAddress=NetUtil::htonl(0xc0a80000+n);
+    return address;
+  }
+
+
+  MacAddress mac(uint32_t n) {
+    return MacAddress(0x02,0,0,n >> 16,n >> 8,n);
+  }
+
+
+  void advanceSeconds(uint32_t seconds) {
+    MillisecondTimer::advance(seconds*1000);
+  }
+
+
+  void testExpiry(RtcBase& rtc) {
+
+    ArpCache cache;
+    MacAddress found;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,EXPIRY,&rtc));
+
+    cache.insert(mac(1),ip(1));
+
+    advanceSeconds(EXPIRY);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::FOUND && found==mac(1));
+
+    advanceSeconds(1);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.getStatistics().expiries==1);
+
+    // the expired entry was recycled, so it comes back as a new one
+
+    cache.insert(mac(2),ip(1));
+    HOSTTEST_CHECK(cache.findMacAddress(ip(1),found) && found==mac(2));
+    HOSTTEST_CHECK(cache.getStatistics().insertions==2);
+
+    // a new insert of a known address restarts its time
+
+    advanceSeconds(EXPIRY);
+    cache.insert(mac(3),ip(1));
+    advanceSeconds(EXPIRY);
+    HOSTTEST_CHECK(cache.findMacAddress(ip(1),found) && found==mac(3));
+    HOSTTEST_CHECK(cache.getStatistics().insertions==2);
+
+    HOSTTEST_CHECK(cache.getStatistics().hits==3);
+    HOSTTEST_CHECK(cache.getStatistics().misses==1);
+  }
+
+
+  void testEviction(RtcBase& rtc) {
+
+    ArpCache cache;
+    MacAddress found;
+    uint32_t i;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,EXPIRY,&rtc));
+
+    for(i=0;i<ENTRIES;i++)
+      cache.insert(mac(i),ip(i));
+
+    // 0 is now the most recently used, so 1 goes first
+
+    HOSTTEST_CHECK(cache.findMacAddress(ip(0),found));
+
+    cache.insert(mac(100),ip(100));
+    HOSTTEST_CHECK(cache.getStatistics().evictions==1);
+    HOSTTEST_CHECK(!cache.findMacAddress(ip(1),found));
+    HOSTTEST_CHECK(cache.findMacAddress(ip(0),found) && found==mac(0));
+    HOSTTEST_CHECK(cache.findMacAddress(ip(100),found) && found==mac(100));
+
+    cache.insert(mac(101),ip(101));
+    HOSTTEST_CHECK(!cache.findMacAddress(ip(2),found));
+
+    for(i=3;i<ENTRIES;i++)
+      HOSTTEST_CHECK(cache.findMacAddress(ip(i),found) && found==mac(i));
+
+    HOSTTEST_CHECK(cache.getStatistics().evictions==2);
+  }
+
+
+  void testUnresolved(RtcBase& rtc) {
+
+    ArpCache cache;
+    MacAddress found;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,EXPIRY,&rtc));
+
+    // a failure is remembered for its own time
+
+    cache.insertUnresolved(ip(1),UNRESOLVED_EXPIRY);
+
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::UNRESOLVED);
+    HOSTTEST_CHECK(!cache.findMacAddress(ip(1),found));
+    HOSTTEST_CHECK(cache.getStatistics().unresolvedHits==2);
+
+    advanceSeconds(UNRESOLVED_EXPIRY+1);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::NOT_FOUND);
+
+    // a reply replaces it
+
+    cache.insertUnresolved(ip(1),UNRESOLVED_EXPIRY);
+    cache.insert(mac(1),ip(1));
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::FOUND && found==mac(1));
+
+    // it doesn't replace a good entry, but does replace an expired one
+
+    cache.insertUnresolved(ip(1),UNRESOLVED_EXPIRY);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::FOUND);
+
+    advanceSeconds(EXPIRY+1);
+    cache.insertUnresolved(ip(1),UNRESOLVED_EXPIRY);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::UNRESOLVED);
+
+    // and a failure can be renewed
+
+    advanceSeconds(UNRESOLVED_EXPIRY);
+    cache.insertUnresolved(ip(1),UNRESOLVED_EXPIRY);
+    advanceSeconds(UNRESOLVED_EXPIRY);
+    HOSTTEST_CHECK(cache.lookup(ip(1),found)==ArpCache::UNRESOLVED);
+  }
+
+
+  /*
+   * The watch is released from 'interrupt' code that runs when the timer is read
+   */
+
+  ArpCache *WatchedCache;
+  uint32_t WatchReleaseTime;
+
+  void arpInterrupt() {
+
+    MillisecondTimer::advance(1);
+
+    // another address doesn't release the watch
+
+    if(MillisecondTimer::counter()==WatchReleaseTime-20)
+      WatchedCache->insert(mac(8),ip(8));
+
+    if(MillisecondTimer::counter()==WatchReleaseTime)
+      WatchedCache->insert(mac(7),ip(7));
+  }
+
+
+  void testWatch(RtcBase& rtc) {
+
+    ArpCache cache;
+    MacAddress found;
+    uint32_t start;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,EXPIRY,&rtc));
+
+    WatchedCache=&cache;
+    MillisecondTimer::interrupt()=arpInterrupt;
+
+    // nothing arrives
+
+    start=MillisecondTimer::counter();
+    WatchReleaseTime=start+200;
+
+    cache.setWatchIp(ip(7),&found);
+    HOSTTEST_CHECK(!cache.waitForWatch(100));
+    HOSTTEST_CHECK(MillisecondTimer::counter()-start>100);
+
+    // the reply arrives in time
+
+    start=MillisecondTimer::counter();
+    WatchReleaseTime=start+50;
+
+    cache.setWatchIp(ip(7),&found);
+    HOSTTEST_CHECK(cache.waitForWatch(100));
+    HOSTTEST_CHECK(found==mac(7));
+    HOSTTEST_CHECK(MillisecondTimer::counter()==WatchReleaseTime);
+
+    MillisecondTimer::interrupt()=nullptr;
+  }
+
+
+  /*
+   * The hosts on a subnet spread over the hash table. The address is in network order, so
+   * the host part is in the top byte on a little endian host as it is on the MCU.
+   */
+
+  struct HashedArpCache : ArpCache {
+    using ArpCache::hash;
+  };
+
+
+  void testHashSpread(RtcBase& rtc) {
+
+    HashedArpCache cache;
+    std::set<uint16_t> slots;
+    uint32_t i;
+
+    HOSTTEST_CHECK(cache.initialise(254,EXPIRY,&rtc));
+
+    // a /24 and every 5th host on a /22
+
+    for(i=1;i<255;i++)
+      slots.insert(cache.hash(ip(i)));
+
+    HOSTTEST_CHECK(slots.size()>200);
+
+    slots.clear();
+
+    for(i=0;i<1024;i+=5)
+      slots.insert(cache.hash(ip(i)));
+
+    HOSTTEST_CHECK(slots.size()>150);
+  }
+
+
+  /*
+   * A model of the cache: the LRU list with the most recent at the front
+   */
+
+  struct ModelEntry {
+    uint32_t Address;
+    uint32_t Mac;
+    bool Unresolved;
+    uint32_t ExpiryTime;
+  };
+
+  struct Model {
+
+    std::list<ModelEntry> Entries;
+    ArpCacheStatistics Statistics;
+
+    Model() {
+      memset(&Statistics,0,sizeof(Statistics));
+    }
+
+    std::list<ModelEntry>::iterator find(uint32_t address) {
+
+      std::list<ModelEntry>::iterator it;
+
+      for(it=Entries.begin();it!=Entries.end() && it->Address!=address;it++);
+      return it;
+    }
+
+    void insert(uint32_t address,uint32_t m,bool unresolved,uint32_t expiryTime) {
+
+      std::list<ModelEntry>::iterator it;
+
+      if((it=find(address))!=Entries.end())
+        Entries.erase(it);
+      else {
+
+        if(Entries.size()==ENTRIES) {
+          Entries.pop_back();
+          Statistics.evictions++;
+        }
+
+        Statistics.insertions++;
+      }
+
+      Entries.push_front(ModelEntry { address,m,unresolved,expiryTime });
+    }
+
+    void insertUnresolved(uint32_t address,uint32_t now,uint32_t expirySeconds) {
+
+      std::list<ModelEntry>::iterator it;
+
+      if((it=find(address))!=Entries.end() && !it->Unresolved && now<=it->ExpiryTime)
+        return;
+
+      insert(address,0,true,now+expirySeconds);
+    }
+
+    ArpCache::LookupResult lookup(uint32_t address,uint32_t now,uint32_t& m) {
+
+      std::list<ModelEntry>::iterator it;
+      ModelEntry entry;
+
+      if((it=find(address))==Entries.end()) {
+        Statistics.misses++;
+        return ArpCache::NOT_FOUND;
+      }
+
+      if(now>it->ExpiryTime) {
+        Entries.erase(it);
+        Statistics.expiries++;
+        Statistics.misses++;
+        return ArpCache::NOT_FOUND;
+      }
+
+      if(it->Unresolved) {
+        Statistics.unresolvedHits++;
+        return ArpCache::UNRESOLVED;
+      }
+
+      entry=*it;
+      Entries.erase(it);
+      Entries.push_front(entry);
+
+      m=entry.Mac;
+      Statistics.hits++;
+      return ArpCache::FOUND;
+    }
+  };
+
+
+  bool operator==(const ArpCacheStatistics& a,const ArpCacheStatistics& b) {
+    return memcmp(&a,&b,sizeof(a))==0;
+  }
+
+
+  void testAgainstModel(RtcBase& rtc) {
+
+    ArpCache cache;
+    Model model;
+    MacAddress found;
+    ArpCache::LookupResult result;
+    uint32_t op,address,m,serial;
+    bool ok;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,EXPIRY,&rtc));
+
+    srand(1);
+    serial=0;
+    ok=true;
+
+    for(op=0;ok && op<OPERATIONS;op++) {
+
+      address=rand() % ADDRESSES;
+
+      switch(rand() % 8) {
+
+        case 0:
+        case 1:
+          serial++;
+          cache.insert(mac(serial),ip(address));
+          model.insert(address,serial,false,rtc.getTick()+EXPIRY);
+          break;
+
+        case 2:
+          cache.insertUnresolved(ip(address),UNRESOLVED_EXPIRY);
+          model.insertUnresolved(address,rtc.getTick(),UNRESOLVED_EXPIRY);
+          break;
+
+        case 3:
+          advanceSeconds(rand() % 3);
+          break;
+
+        default:
+          m=0;
+          result=model.lookup(address,rtc.getTick(),m);
+          ok=cache.lookup(ip(address),found)==result && (result!=ArpCache::FOUND || found==mac(m));
+          break;
+      }
+
+      ok=ok && cache.getStatistics()==model.Statistics;
+    }
+
+    HOSTTEST_CHECK(ok);
+
+    // the run must have exercised everything
+
+    HOSTTEST_CHECK(model.Statistics.evictions>0);
+    HOSTTEST_CHECK(model.Statistics.expiries>0);
+    HOSTTEST_CHECK(model.Statistics.unresolvedHits>0);
+    HOSTTEST_CHECK(model.Statistics.hits>0);
+  }
+}
+
+
+int main() {
+
+  RtcBase rtc;
+
+  testExpiry(rtc);
+  testEviction(rtc);
+  testUnresolved(rtc);
+  testWatch(rtc);
+  testHashSpread(rtc);
+  testAgainstModel(rtc);
+
+  return hosttest::result("ArpCacheTest");
+}
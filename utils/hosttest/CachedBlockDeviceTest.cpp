@@ -0,0 +1,373 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the block cache on a device in memory. The constructor must refuse sizes that
+ * the 16 bit links can't hold. Hits, misses and LRU eviction are checked by counting what
+ * reaches the device. In write-back mode nothing may reach the device until a block is
+ * evicted, flush() is called or the cache is destroyed, and consecutive dirty blocks in
+ * adjacent slots must go in one write. A random run of mixed operations is compared with a
+ * plain copy of the device for several cache sizes.
+ */
+
+#include "config/stm32plus.h"
+#include "config/device.h"
+#include "MemoryBlockDevice.h"
+#include "HostTest.h"
+
+#include <vector>
+
+
+using namespace stm32plus;
+
+
+namespace {
+
+  enum {
+    DEVICE_BLOCKS = 256,
+    BLOCK_SIZE = MemoryBlockDevice::BLOCK_SIZE,
+    RANDOM_OPERATIONS = 20000
+  };
+
+
+  /*
+   * Fill a block with a pattern made from a number
+   */
+
+  void fill(uint8_t *block,uint32_t seed) {
+
+    uint32_t i;
+
+    for(i=0;i<BLOCK_SIZE;i++) {
+      seed=seed*1103515245+12345;
+      block[i]=seed >> 16;
+    }
+  }
+
+
+  bool isBlock(const uint8_t *block,uint32_t seed) {
+
+    uint8_t expected[BLOCK_SIZE];
+
+    fill(expected,seed);
+    return memcmp(block,expected,BLOCK_SIZE)==0;
+  }
+
+
+  /*
+   * Zero blocks can't be cached and the links can't index more than 65534
+   */
+
+  void testInvalidSizes() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t block[BLOCK_SIZE];
+
+    errorProvider.clear();
+
+    CachedBlockDevice none(device,0);
+
+    HOSTTEST_CHECK(!none.isValid());
+    HOSTTEST_CHECK(errorProvider.getLast()==((ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE << 16) | CachedBlockDevice::E_INVALID_CACHE_SIZE));
+    HOSTTEST_CHECK(!none.readBlock(block,0));
+    HOSTTEST_CHECK(!none.writeBlock(block,0));
+    HOSTTEST_CHECK(!none.readBlocks(block,0,1));
+    HOSTTEST_CHECK(!none.writeBlocks(block,0,1));
+    HOSTTEST_CHECK(none.flush());
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==0 && device.getCounters().WriteCalls==0);
+
+    errorProvider.clear();
+
+    CachedBlockDevice tooMany(device,65535);
+
+    HOSTTEST_CHECK(!tooMany.isValid());
+    HOSTTEST_CHECK(errorProvider.getLast()==((ErrorProvider::ERROR_PROVIDER_BLOCK_DEVICE << 16) | CachedBlockDevice::E_INVALID_CACHE_SIZE));
+
+    CachedBlockDevice one(device,1);
+    CachedBlockDevice most(device,65534);
+
+    HOSTTEST_CHECK(one.isValid());
+    HOSTTEST_CHECK(most.isValid());
+  }
+
+
+  /*
+   * Reads are served from the cache until the least recently used block is evicted
+   */
+
+  void testLru() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t block[BLOCK_SIZE];
+    uint32_t i;
+
+    for(i=0;i<DEVICE_BLOCKS;i++)
+      fill(device.getBlock(i),i);
+
+    CachedBlockDevice cache(device,4);
+
+    for(i=0;i<4;i++)
+      HOSTTEST_CHECK(cache.readBlock(block,i) && isBlock(block,i));
+
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==4);
+
+    // block 0 becomes the most recent so block 1 is the one to go
+
+    HOSTTEST_CHECK(cache.readBlock(block,0) && isBlock(block,0));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==4);
+
+    HOSTTEST_CHECK(cache.readBlock(block,4) && isBlock(block,4));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==5);
+
+    HOSTTEST_CHECK(cache.readBlock(block,0) && cache.readBlock(block,2) && cache.readBlock(block,3));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==5);
+
+    HOSTTEST_CHECK(cache.readBlock(block,1) && isBlock(block,1));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==6);
+  }
+
+
+  /*
+   * A multi-block read takes what it can from the cache and reads each run of misses in one go
+   */
+
+  void testReadRuns() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t blocks[BLOCK_SIZE*10];
+    uint32_t i;
+
+    for(i=0;i<DEVICE_BLOCKS;i++)
+      fill(device.getBlock(i),i);
+
+    CachedBlockDevice cache(device,16);
+
+    HOSTTEST_CHECK(cache.readBlock(blocks,14));
+
+    device.resetCounters();
+    HOSTTEST_CHECK(cache.readBlocks(blocks,10,10));
+
+    for(i=0;i<10;i++)
+      HOSTTEST_CHECK(isBlock(blocks+i*BLOCK_SIZE,10+i));
+
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==2);
+    HOSTTEST_CHECK(device.getCounters().BlocksRead==9);
+
+    device.resetCounters();
+    HOSTTEST_CHECK(cache.readBlocks(blocks,10,10));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==0);
+  }
+
+
+  /*
+   * Write-through writes reach the device at once and are then read from the cache
+   */
+
+  void testWriteThrough() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t block[BLOCK_SIZE];
+
+    CachedBlockDevice cache(device,4);
+
+    HOSTTEST_CHECK(cache.getWritePolicy()==CachedBlockDevice::WRITE_THROUGH);
+
+    fill(block,100);
+    HOSTTEST_CHECK(cache.writeBlock(block,7));
+    HOSTTEST_CHECK(isBlock(device.getBlock(7),100));
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==0);
+
+    memset(block,0,sizeof(block));
+    HOSTTEST_CHECK(cache.readBlock(block,7) && isBlock(block,100));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==0);
+
+    // a failed device write is reported
+
+    device.setFailingBlock(8);
+    HOSTTEST_CHECK(!cache.writeBlock(block,8));
+  }
+
+
+  /*
+   * Write-back writes wait in the cache. A run of consecutive dirty blocks goes out in one
+   * call when it's flushed or when one of them is evicted.
+   */
+
+  void testWriteBack() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t blocks[BLOCK_SIZE*4];
+    uint32_t i;
+
+    CachedBlockDevice cache(device,8,CachedBlockDevice::WRITE_BACK);
+
+    for(i=0;i<4;i++) {
+      fill(blocks,200+i);
+      HOSTTEST_CHECK(cache.writeBlock(blocks,20+i));
+    }
+
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==4);
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+
+    // writing the same block again doesn't make it dirty twice
+
+    fill(blocks,203);
+    HOSTTEST_CHECK(cache.writeBlock(blocks,23));
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==4);
+
+    HOSTTEST_CHECK(cache.readBlock(blocks,21) && isBlock(blocks,201));
+    HOSTTEST_CHECK(device.getCounters().ReadCalls==0);
+
+    HOSTTEST_CHECK(cache.flush());
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==0);
+    HOSTTEST_CHECK(device.getWrites().size()==1 && device.getWrites()[0].BlockIndex==20 && device.getWrites()[0].NumBlocks==4);
+
+    for(i=0;i<4;i++)
+      HOSTTEST_CHECK(isBlock(device.getBlock(20+i),200+i));
+
+    // nothing left to write
+
+    device.resetCounters();
+    HOSTTEST_CHECK(cache.flush());
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+
+    // a multi-block write fills adjacent slots and evicting the oldest writes the run
+
+    for(i=0;i<4;i++)
+      fill(blocks+i*BLOCK_SIZE,300+i);
+
+    HOSTTEST_CHECK(cache.writeBlocks(blocks,40,4));
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==4);
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+
+    for(i=0;i<8;i++)
+      HOSTTEST_CHECK(cache.readBlock(blocks,100+i));
+
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==0);
+    HOSTTEST_CHECK(device.getWrites().size()==1 && device.getWrites()[0].BlockIndex==40 && device.getWrites()[0].NumBlocks==4);
+
+    for(i=0;i<4;i++)
+      HOSTTEST_CHECK(isBlock(device.getBlock(40+i),300+i));
+  }
+
+
+  /*
+   * A failed write-back leaves the block dirty so that it can be tried again
+   */
+
+  void testWriteBackFailure() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t block[BLOCK_SIZE];
+
+    CachedBlockDevice cache(device,2,CachedBlockDevice::WRITE_BACK);
+
+    fill(block,400);
+    HOSTTEST_CHECK(cache.writeBlock(block,50));
+
+    device.setFailingBlock(50);
+    HOSTTEST_CHECK(!cache.flush());
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==1);
+
+    device.setFailingBlock(MemoryBlockDevice::NO_FAILURE);
+    HOSTTEST_CHECK(cache.flush());
+    HOSTTEST_CHECK(cache.getDirtyBlockCount()==0);
+    HOSTTEST_CHECK(isBlock(device.getBlock(50),400));
+  }
+
+
+  /*
+   * The destructor writes back what's dirty
+   */
+
+  void testDestructorFlushes() {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    uint8_t block[BLOCK_SIZE];
+
+    {
+      CachedBlockDevice cache(device,4,CachedBlockDevice::WRITE_BACK);
+
+      fill(block,500);
+      HOSTTEST_CHECK(cache.writeBlock(block,60));
+      HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+    }
+
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==1);
+    HOSTTEST_CHECK(isBlock(device.getBlock(60),500));
+  }
+
+
+  /*
+   * Random single and multi-block reads and writes against a copy of what the device should
+   * hold. Everything read must match the copy and after a flush the device must match it.
+   */
+
+  void testRandom(uint32_t numCachedBlocks,CachedBlockDevice::WritePolicy writePolicy) {
+
+    MemoryBlockDevice device(DEVICE_BLOCKS);
+    std::vector<uint8_t> model(DEVICE_BLOCKS*BLOCK_SIZE),buffer(8*BLOCK_SIZE);
+    uint32_t i,j,seed,blockIndex,numBlocks;
+    bool ok;
+
+    CachedBlockDevice cache(device,numCachedBlocks,writePolicy);
+
+    ok=true;
+    seed=numCachedBlocks;
+
+    for(i=0;i<RANDOM_OPERATIONS && ok;i++) {
+
+      seed=seed*1103515245+12345;
+
+      // mostly in a small working set so that there are hits and runs
+
+      blockIndex=(seed >> 8) % ((seed & 0x10000) ? DEVICE_BLOCKS-8 : 24);
+      numBlocks=(seed & 0x20000) ? 1+((seed >> 24) % 8) : 1;
+
+      if(seed & 0x40000) {
+
+        for(j=0;j<numBlocks;j++)
+          fill(&buffer[j*BLOCK_SIZE],i*8+j);
+
+        ok=numBlocks==1 ? cache.writeBlock(&buffer[0],blockIndex) : cache.writeBlocks(&buffer[0],blockIndex,numBlocks);
+        memcpy(&model[blockIndex*BLOCK_SIZE],&buffer[0],numBlocks*BLOCK_SIZE);
+      }
+      else {
+        ok=(numBlocks==1 ? cache.readBlock(&buffer[0],blockIndex) : cache.readBlocks(&buffer[0],blockIndex,numBlocks)) &&
+           memcmp(&buffer[0],&model[blockIndex*BLOCK_SIZE],numBlocks*BLOCK_SIZE)==0;
+      }
+
+      if(writePolicy==CachedBlockDevice::WRITE_BACK && cache.getDirtyBlockCount()>numCachedBlocks)
+        ok=false;
+    }
+
+    if(!ok)
+      fprintf(stderr,"%u cached blocks, operation %u\n",static_cast<unsigned>(numCachedBlocks),static_cast<unsigned>(i-1));
+
+    HOSTTEST_CHECK(ok);
+    HOSTTEST_CHECK(cache.flush());
+    HOSTTEST_CHECK(device.getData()==model);
+  }
+}
+
+
+int main() {
+
+  testInvalidSizes();
+  testLru();
+  testReadRuns();
+  testWriteThrough();
+  testWriteBack();
+  testWriteBackFailure();
+  testDestructorFlushes();
+
+  for(uint32_t numCachedBlocks : { 1,2,3,8,17,64 }) {
+    testRandom(numCachedBlocks,CachedBlockDevice::WRITE_THROUGH);
+    testRandom(numCachedBlocks,CachedBlockDevice::WRITE_BACK);
+  }
+
+  return hosttest::result("CachedBlockDeviceTest");
+}
@@ -0,0 +1,249 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * circular_buffer with a producer and a consumer on two threads and nothing masked. The
+ * producer writes a counting sequence and the consumer checks that it reads back exactly
+ * that sequence, so a value that was read before it was written, read twice or skipped
+ * shows up as a break in the count. It runs at capacities of 1, 8, 64 and 1024 with each of
+ * the ways that the two sides can move data:
+ *
+ *   - single values with write(T) and read()
+ *   - blocks of random size with write() and read(), which wrap around the end
+ *   - in place with peekWrite()/commitWrite() and peekRead()/commitRead()
+ *   - blocks whose second half is stored with writeAhead() before the first half, then
+ *     committed together, which is what TCP does when a hole is filled. Nothing may be
+ *     readable until the commit.
+ *
+ * Neither side may ever see more than the capacity available. Separately, peekWrite() and
+ * peekRead() must stop at the end of the storage when the free space or the data wraps.
+ */
+
+#include "config/stm32plus.h"
+#include "memory/circular_buffer.h"
+#include "HostTest.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+using namespace stm32plus;
+
+
+namespace {
+
+  enum {
+    VALUES = 250000,
+    MAX_BLOCK = 300
+  };
+
+  enum class Mode {
+    SINGLE,
+    BLOCK,
+    IN_PLACE,
+    WRITE_AHEAD
+  };
+
+  const uint32_t Capacities[]={ 1,8,64,1024 };
+
+
+  /*
+   * A small generator for each thread because rand() isn't thread safe
+   */
+
+  struct Random {
+
+    uint32_t _state;
+
+    Random(uint32_t seed)
+      : _state(seed) {
+    }
+
+    uint32_t next(uint32_t range) {
+      _state=_state*1103515245+12345;
+      return (_state >> 8) % range;
+    }
+  };
+
+
+  /*
+   * The producer. It waits for space by yielding, and never writes more than is free.
+   */
+
+  void produce(circular_buffer<uint32_t>& cb,Mode mode,uint32_t seed,std::atomic<bool>& ok) {
+
+    std::vector<uint32_t> block(MAX_BLOCK);
+    uint32_t next,free,size,half,i;
+    Random random(seed);
+    uint32_t *ptr;
+
+    for(next=0;next<VALUES;) {
+
+      while((free=cb.availableToWrite())==0)
+        std::this_thread::yield();
+
+      if(free>cb.getCapacity())
+        ok=false;
+
+      size=std::min(std::min(free,VALUES-next),1+random.next(MAX_BLOCK));
+
+      switch(mode) {
+
+        case Mode::SINGLE:
+          cb.write(next++);
+          break;
+
+        case Mode::BLOCK:
+          for(i=0;i<size;i++)
+            block[i]=next++;
+
+          cb.write(&block[0],size);
+          break;
+
+        case Mode::IN_PLACE:
+          size=std::min(size,cb.peekWrite(ptr));
+
+          for(i=0;i<size;i++)
+            ptr[i]=next++;
+
+          cb.commitWrite(size);
+          break;
+
+        case Mode::WRITE_AHEAD:
+          for(i=0;i<size;i++)
+            block[i]=next+i;
+
+          half=size/2;
+
+          cb.writeAhead(half,&block[half],size-half);
+          std::this_thread::yield();
+          cb.writeAhead(0,&block[0],half);
+          cb.commitWrite(size);
+
+          next+=size;
+          break;
+      }
+    }
+  }
+
+
+  /*
+   * The consumer. Each value must be the next in the count.
+   */
+
+  void consume(circular_buffer<uint32_t>& cb,Mode mode,uint32_t seed,std::atomic<bool>& ok) {
+
+    std::vector<uint32_t> block(MAX_BLOCK);
+    uint32_t expected,available,size,i;
+    Random random(seed);
+    const uint32_t *ptr;
+    bool good;
+
+    good=true;
+
+    for(expected=0;expected<VALUES;) {
+
+      while((available=cb.availableToRead())==0)
+        std::this_thread::yield();
+
+      if(available>cb.getCapacity())
+        good=false;
+
+      size=std::min(available,1+random.next(MAX_BLOCK));
+
+      switch(mode) {
+
+        case Mode::SINGLE:
+          good&=cb.read()==expected++;
+          break;
+
+        case Mode::BLOCK:
+        case Mode::WRITE_AHEAD:
+          cb.read(&block[0],size);
+
+          for(i=0;i<size;i++)
+            good&=block[i]==expected++;
+          break;
+
+        case Mode::IN_PLACE:
+          size=std::min(size,cb.peekRead(ptr));
+
+          for(i=0;i<size;i++)
+            good&=ptr[i]==expected++;
+
+          cb.commitRead(size);
+          break;
+      }
+    }
+
+    if(!good)
+      ok=false;
+  }
+
+
+  /*
+   * Run the two sides to the end and check that the buffer is empty after
+   */
+
+  bool run(uint32_t capacity,Mode mode) {
+
+    circular_buffer<uint32_t> cb(capacity);
+    std::atomic<bool> ok(true);
+
+    std::thread producer(produce,std::ref(cb),mode,capacity,std::ref(ok));
+    std::thread consumer(consume,std::ref(cb),mode,capacity*3,std::ref(ok));
+
+    producer.join();
+    consumer.join();
+
+    return ok && cb.getCapacity()==capacity && cb.availableToRead()==0 && cb.availableToWrite()==capacity;
+  }
+
+
+  /*
+   * Leave the indexes 6 into 8 so that both the free space and the data wrap. The in-place
+   * pointers may only cover the 2 slots before the end.
+   */
+
+  bool contiguous() {
+
+    circular_buffer<uint32_t> cb(8);
+    const uint32_t values[6]={ 0,1,2,3,4,5 };
+    const uint32_t *rptr;
+    uint32_t *wptr;
+    bool ok;
+
+    cb.write(values,6);
+    cb.commitRead(6);
+
+    ok=cb.availableToWrite()==8 && cb.peekWrite(wptr)==2;
+
+    cb.write(values,4);
+
+    ok&=cb.availableToRead()==4 && cb.peekRead(rptr)==2 && rptr[0]==0 && rptr[1]==1;
+
+    cb.commitRead(2);
+    ok&=cb.peekRead(rptr)==2 && rptr[0]==2 && rptr[1]==3;
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  HOSTTEST_CHECK(contiguous());
+
+  for(uint32_t capacity : Capacities) {
+    HOSTTEST_CHECK(run(capacity,Mode::SINGLE));
+    HOSTTEST_CHECK(run(capacity,Mode::BLOCK));
+    HOSTTEST_CHECK(run(capacity,Mode::IN_PLACE));
+    HOSTTEST_CHECK(run(capacity,Mode::WRITE_AHEAD));
+  }
+
+  return hosttest::result("CircularBufferTest");
+}
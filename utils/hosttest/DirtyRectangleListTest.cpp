@@ -0,0 +1,256 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the frame buffer's dirty rectangle list. The fixed cases cover merging on
+ * overlap and shared edges, the corner-only case that must not merge and the merge that
+ * happens when the list is full. A random run then checks that every dirty pixel stays
+ * covered and that the list never holds two rectangles that overlap.
+ */
+
+#include "config/stm32plus.h"
+#include "display/Point.h"
+#include "display/Size.h"
+#include "display/Rectangle.h"
+#include "display/graphic/framebuffer/DirtyRectangleList.h"
+#include "HostTest.h"
+
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::display;
+
+
+namespace {
+
+  bool equals(const Rectangle& r1,const Rectangle& r2) {
+    return r1.X==r2.X && r1.Y==r2.Y && r1.Width==r2.Width && r1.Height==r2.Height;
+  }
+
+  bool overlaps(const Rectangle& r1,const Rectangle& r2) {
+    return r1.X<r2.X+r2.Width && r2.X<r1.X+r1.Width && r1.Y<r2.Y+r2.Height && r2.Y<r1.Y+r1.Height;
+  }
+
+  bool contains(const Rectangle& rc,int x,int y) {
+    return x>=rc.X && x<rc.X+rc.Width && y>=rc.Y && y<rc.Y+rc.Height;
+  }
+
+
+  /*
+   * Rectangles that overlap or share an edge become one
+   */
+
+  void testMerge() {
+
+    DirtyRectangleList<4> list;
+
+    HOSTTEST_CHECK(list.isEmpty());
+
+    // empty rectangles are ignored
+
+    list.add(Rectangle(10,10,0,5));
+    list.add(Rectangle(10,10,5,-1));
+    HOSTTEST_CHECK(list.isEmpty());
+
+    // overlapping
+
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(5,5,10,10));
+    HOSTTEST_CHECK(list.getCount()==1);
+    HOSTTEST_CHECK(equals(list[0],Rectangle(0,0,15,15)));
+
+    // sharing the right edge
+
+    list.clear();
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(10,2,5,5));
+    HOSTTEST_CHECK(list.getCount()==1);
+    HOSTTEST_CHECK(equals(list[0],Rectangle(0,0,15,10)));
+
+    // sharing the bottom edge
+
+    list.clear();
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(3,10,4,4));
+    HOSTTEST_CHECK(list.getCount()==1);
+    HOSTTEST_CHECK(equals(list[0],Rectangle(0,0,10,14)));
+
+    // a rectangle inside another adds nothing
+
+    list.add(Rectangle(2,2,3,3));
+    HOSTTEST_CHECK(list.getCount()==1);
+    HOSTTEST_CHECK(equals(list[0],Rectangle(0,0,10,14)));
+  }
+
+
+  /*
+   * Rectangles that only meet at a corner or don't meet at all stay separate
+   */
+
+  void testNoMerge() {
+
+    DirtyRectangleList<4> list;
+
+    // each of the four corners
+
+    list.add(Rectangle(10,10,10,10));
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(20,0,10,10));
+    list.add(Rectangle(0,20,10,10));
+    HOSTTEST_CHECK(list.getCount()==4);
+
+    list.clear();
+    list.add(Rectangle(10,10,10,10));
+    list.add(Rectangle(20,20,10,10));
+    HOSTTEST_CHECK(list.getCount()==2);
+
+    // a one pixel gap
+
+    list.clear();
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(11,0,10,10));
+    list.add(Rectangle(0,11,10,10));
+    HOSTTEST_CHECK(list.getCount()==3);
+  }
+
+
+  /*
+   * A rectangle that bridges two others absorbs both, and the result absorbs any that it
+   * now reaches
+   */
+
+  void testChain() {
+
+    DirtyRectangleList<4> list;
+
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(20,0,10,10));
+    list.add(Rectangle(40,0,10,30));
+    HOSTTEST_CHECK(list.getCount()==3);
+
+    list.add(Rectangle(5,5,20,2));
+    HOSTTEST_CHECK(list.getCount()==2);
+
+    list.add(Rectangle(25,5,20,2));
+    HOSTTEST_CHECK(list.getCount()==1);
+    HOSTTEST_CHECK(equals(list[0],Rectangle(0,0,50,30)));
+  }
+
+
+  /*
+   * When the list is full the new rectangle merges with the one that grows the least and
+   * the grown one picks up anything that it then reaches
+   */
+
+  void testOverflow() {
+
+    DirtyRectangleList<3> list;
+
+    list.add(Rectangle(0,0,10,10));
+    list.add(Rectangle(100,0,10,10));
+    list.add(Rectangle(0,100,10,10));
+    HOSTTEST_CHECK(list.getCount()==3);
+
+    // nearest to the second one
+
+    list.add(Rectangle(120,0,10,10));
+    HOSTTEST_CHECK(list.getCount()==3);
+
+    bool found=false;
+    for(uint8_t i=0;i<list.getCount();i++)
+      if(equals(list[i],Rectangle(100,0,30,10)))
+        found=true;
+
+    HOSTTEST_CHECK(found);
+
+    // the first grows to take this one, then the next bridges it and the third
+
+    list.add(Rectangle(0,20,10,10));
+    HOSTTEST_CHECK(list.getCount()==3);
+
+    list.add(Rectangle(0,30,10,80));
+    HOSTTEST_CHECK(list.getCount()==2);
+
+    found=false;
+    for(uint8_t i=0;i<list.getCount();i++)
+      if(equals(list[i],Rectangle(0,0,10,110)))
+        found=true;
+
+    HOSTTEST_CHECK(found);
+  }
+
+
+  /*
+   * Random additions checked against a pixel map
+   */
+
+  void testRandom() {
+
+    enum { SIZE = 64 };
+
+    DirtyRectangleList<6> list;
+    std::vector<bool> dirty;
+    uint32_t i,j,pass;
+    int x,y;
+
+    srand(1);
+
+    for(pass=0;pass<500;pass++) {
+
+      list.clear();
+      dirty.assign(SIZE*SIZE,false);
+
+      for(i=0;i<20;i++) {
+
+        Rectangle rc(rand() % SIZE,rand() % SIZE,rand() % 12+1,rand() % 12+1);
+
+        rc.Width=std::min<int>(rc.Width,SIZE-rc.X);
+        rc.Height=std::min<int>(rc.Height,SIZE-rc.Y);
+
+        list.add(rc);
+
+        for(y=rc.Y;y<rc.Y+rc.Height;y++)
+          for(x=rc.X;x<rc.X+rc.Width;x++)
+            dirty[y*SIZE+x]=true;
+
+        // no overlaps
+
+        for(j=0;j<list.getCount();j++)
+          for(uint32_t k=j+1;k<list.getCount();k++)
+            if(overlaps(list[j],list[k]))
+              hosttest::check(false,"rectangles overlap",__FILE__,__LINE__);
+
+        // everything covered
+
+        for(y=0;y<SIZE;y++) {
+          for(x=0;x<SIZE;x++) {
+
+            if(!dirty[y*SIZE+x])
+              continue;
+
+            for(j=0;j<list.getCount() && !contains(list[j],x,y);j++);
+
+            if(j==list.getCount())
+              hosttest::check(false,"dirty pixel not covered",__FILE__,__LINE__);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+int main() {
+
+  testMerge();
+  testNoMerge();
+  testChain();
+  testOverflow();
+  testRandom();
+
+  return hosttest::result("DirtyRectangleListTest");
+}
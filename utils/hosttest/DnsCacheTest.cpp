@@ -0,0 +1,467 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the DNS cache on a fake clock. The RTC stand-in reads the millisecond timer,
+ * which only moves when the test moves it, so expiry is exact:
+ *
+ *   - an entry is good up to and including its expiry second and gone after it, and a
+ *     negative entry expires in the same way
+ *   - a full cache evicts the least recently used entry, and a lookup makes an entry the
+ *     most recently used
+ *   - an address replaces a negative entry and a negative entry replaces an address
+ *   - an alias is followed to its canonical name, which may be added after it, through up
+ *     to 8 links. A link to an entry that has expired, or that was evicted and reused for
+ *     another name, is broken.
+ *   - names are compared without regard to case, and a name too long for a slot isn't cached
+ *
+ * Then random adds, negative adds, lookups and clock moves over more names than the cache
+ * holds are checked against a model of the LRU list. That drives the hash index through
+ * collisions, evictions and removals from the middle of probe runs.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "HostTest.h"
+
+#include <list>
+#include <string>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    TTL = 10,
+    ENTRIES = 16,
+    MAX_HOSTNAME_LENGTH = 31,
+    NAMES = 48,
+    OPERATIONS = 200000
+  };
+
+
+  std::string name(uint32_t n) {
+    return "host"+std::to_string(n)+".example.com";
+  }
+
+
+  IpAddress ip(uint32_t n) {
+
+    IpAddress address;
+
+    address.ipAddress=NetUtil::htonl(0xc0a80000+n);
+    return address;
+  }
+
+
+  void advanceSeconds(uint32_t seconds) {
+    MillisecondTimer::advance(seconds*1000);
+  }
+
+
+  DnsCache::LookupResult find(DnsCache& cache,const std::string& hostname,IpAddress& address) {
+    return cache.find(hostname.c_str(),address);
+  }
+
+
+  void testExpiry(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    cache.add(name(1).c_str(),ip(1),TTL);
+    cache.addNegative(name(2).c_str(),TTL/2);
+
+    advanceSeconds(TTL/2);
+    HOSTTEST_CHECK(find(cache,name(2),found)==DnsCache::NEGATIVE);
+
+    advanceSeconds(1);
+    HOSTTEST_CHECK(find(cache,name(2),found)==DnsCache::NOT_FOUND);
+
+    advanceSeconds(TTL-TTL/2-1);
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::FOUND && found==ip(1));
+
+    advanceSeconds(1);
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::NOT_FOUND);
+
+    HOSTTEST_CHECK(cache.getStatistics().expiries==2);
+    HOSTTEST_CHECK(cache.getStatistics().hits==1);
+    HOSTTEST_CHECK(cache.getStatistics().negativeHits==1);
+    HOSTTEST_CHECK(cache.getStatistics().misses==2);
+
+    // an expired entry is recycled when it's found, so it's only counted once
+
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.getStatistics().expiries==2);
+
+    // adding a name again restarts its TTL
+
+    cache.add(name(3).c_str(),ip(3),TTL);
+    advanceSeconds(TTL);
+    cache.add(name(3).c_str(),ip(4),TTL);
+    advanceSeconds(TTL);
+
+    HOSTTEST_CHECK(find(cache,name(3),found)==DnsCache::FOUND && found==ip(4));
+    HOSTTEST_CHECK(cache.getStatistics().insertions==3);
+  }
+
+
+  void testEviction(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+    uint32_t i;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    for(i=0;i<ENTRIES;i++)
+      cache.add(name(i).c_str(),ip(i),TTL);
+
+    // the oldest entry is the next to go unless it's used
+
+    HOSTTEST_CHECK(find(cache,name(0),found)==DnsCache::FOUND);
+
+    cache.add(name(ENTRIES).c_str(),ip(ENTRIES),TTL);
+
+    HOSTTEST_CHECK(cache.getStatistics().evictions==1);
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(find(cache,name(0),found)==DnsCache::FOUND && found==ip(0));
+    HOSTTEST_CHECK(find(cache,name(ENTRIES),found)==DnsCache::FOUND && found==ip(ENTRIES));
+
+    // updating an entry makes it the most recently used without evicting anything
+
+    cache.add(name(2).c_str(),ip(100),TTL);
+    cache.add(name(ENTRIES+1).c_str(),ip(ENTRIES+1),TTL);
+
+    HOSTTEST_CHECK(cache.getStatistics().evictions==2);
+    HOSTTEST_CHECK(find(cache,name(2),found)==DnsCache::FOUND && found==ip(100));
+    HOSTTEST_CHECK(find(cache,name(3),found)==DnsCache::NOT_FOUND);
+
+    for(i=4;i<ENTRIES;i++)
+      HOSTTEST_CHECK(find(cache,name(i),found)==DnsCache::FOUND && found==ip(i));
+  }
+
+
+  void testNegative(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    cache.addNegative(name(1).c_str(),TTL);
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::NEGATIVE);
+    HOSTTEST_CHECK(!cache.lookup(name(1).c_str(),found));
+
+    cache.add(name(1).c_str(),ip(1),TTL);
+    HOSTTEST_CHECK(cache.lookup(name(1).c_str(),found) && found==ip(1));
+
+    cache.addNegative(name(1).c_str(),TTL);
+    HOSTTEST_CHECK(find(cache,name(1),found)==DnsCache::NEGATIVE);
+
+    HOSTTEST_CHECK(cache.getStatistics().insertions==1);
+    HOSTTEST_CHECK(cache.getStatistics().negativeHits==3);
+  }
+
+
+  void testAliases(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+    uint32_t i,insertions;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    // the records of a reply arrive alias first. The canonical name is a placeholder until
+    // its address arrives and a lookup of it finds nothing.
+
+    cache.addAlias("www.example.com","cdn.example.net",TTL);
+
+    HOSTTEST_CHECK(cache.find("www.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.find("cdn.example.net",found)==DnsCache::NOT_FOUND);
+
+    cache.add("cdn.example.net",ip(1),TTL*2);
+
+    HOSTTEST_CHECK(cache.find("www.example.com",found)==DnsCache::FOUND && found==ip(1));
+    HOSTTEST_CHECK(cache.getStatistics().aliasesFollowed==2);
+    HOSTTEST_CHECK(cache.getStatistics().insertions==2);
+
+    // the alias expires before its target
+
+    advanceSeconds(TTL+1);
+
+    HOSTTEST_CHECK(cache.find("www.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.find("cdn.example.net",found)==DnsCache::FOUND);
+
+    // an alias whose target has expired finds nothing
+
+    cache.add("brief.example.net",ip(5),1);
+    cache.addAlias("short.example.com","brief.example.net",TTL);
+    advanceSeconds(2);
+
+    HOSTTEST_CHECK(cache.find("short.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.getStatistics().expiries==2);
+
+    // an alias to a negative entry is negative, and an alias to itself is ignored
+
+    cache.addNegative("gone.example.net",TTL);
+    cache.addAlias("old.example.com","gone.example.net",TTL);
+    insertions=cache.getStatistics().insertions;
+    cache.addAlias("self.example.com","SELF.example.com",TTL);
+
+    HOSTTEST_CHECK(cache.find("old.example.com",found)==DnsCache::NEGATIVE);
+    HOSTTEST_CHECK(cache.find("self.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.getStatistics().insertions==insertions);
+
+    // a chain of 7 aliases and the address takes 8 steps, which is the limit
+
+    cache.add(name(0).c_str(),ip(2),TTL);
+
+    for(i=1;i<=8;i++)
+      cache.addAlias(name(i).c_str(),name(i-1).c_str(),TTL);
+
+    HOSTTEST_CHECK(find(cache,name(7),found)==DnsCache::FOUND && found==ip(2));
+    HOSTTEST_CHECK(find(cache,name(8),found)==DnsCache::NOT_FOUND);
+  }
+
+
+  /*
+   * An alias links to an entry by index and generation. When its target is evicted and the
+   * slot is reused for another name the link must not lead to the new name's address.
+   */
+
+  void testBrokenLink(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+    uint32_t i;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    // linking to a known name doesn't use it, so the target stays the oldest entry
+
+    cache.add("target.example.com",ip(1),TTL);
+
+    for(i=0;i<ENTRIES-2;i++)
+      cache.add(name(i).c_str(),ip(10+i),TTL);
+
+    cache.addAlias("alias.example.com","target.example.com",TTL);
+
+    // the next name evicts the target and takes its slot
+
+    cache.add("new.example.com",ip(99),TTL);
+
+    HOSTTEST_CHECK(cache.getStatistics().evictions==1);
+    HOSTTEST_CHECK(cache.find("target.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.find("alias.example.com",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.find("new.example.com",found)==DnsCache::FOUND && found==ip(99));
+  }
+
+
+  void testNames(RtcBase& rtc) {
+
+    DnsCache cache;
+    IpAddress found;
+    std::string longest(MAX_HOSTNAME_LENGTH,'a');
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    cache.add("WWW.Example.COM",ip(1),TTL);
+
+    HOSTTEST_CHECK(cache.find("www.example.com",found)==DnsCache::FOUND && found==ip(1));
+    HOSTTEST_CHECK(cache.find("www.example.co",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.find("www.example.comm",found)==DnsCache::NOT_FOUND);
+
+    cache.add("www.EXAMPLE.com",ip(2),TTL);
+
+    HOSTTEST_CHECK(cache.find("Www.Example.Com",found)==DnsCache::FOUND && found==ip(2));
+    HOSTTEST_CHECK(cache.getStatistics().insertions==1);
+
+    // the longest name fits its slot with the terminator, one more character does not
+
+    cache.add(longest.c_str(),ip(3),TTL);
+    HOSTTEST_CHECK(find(cache,longest,found)==DnsCache::FOUND && found==ip(3));
+
+    cache.add((longest+"a").c_str(),ip(4),TTL);
+    cache.addNegative((longest+"b").c_str(),TTL);
+    cache.addAlias((longest+"c").c_str(),"www.example.com",TTL);
+
+    HOSTTEST_CHECK(find(cache,longest+"a",found)==DnsCache::NOT_FOUND);
+    HOSTTEST_CHECK(cache.getStatistics().uncacheable==3);
+    HOSTTEST_CHECK(cache.getStatistics().insertions==2);
+  }
+
+
+  /*
+   * What the cache should hold, most recently used first
+   */
+
+  struct ModelEntry {
+    std::string Name;
+    uint32_t Address;
+    uint32_t ExpiryTime;
+    bool Negative;
+  };
+
+  struct Model {
+    std::list<ModelEntry> Entries;
+    DnsCacheStatistics Statistics;
+
+    Model() {
+      memset(&Statistics,0,sizeof(Statistics));
+    }
+
+    std::list<ModelEntry>::iterator find(const std::string& hostname) {
+
+      std::list<ModelEntry>::iterator it;
+
+      for(it=Entries.begin();it!=Entries.end();it++)
+        if(!strcasecmp(it->Name.c_str(),hostname.c_str()))
+          break;
+
+      return it;
+    }
+
+    void insert(const std::string& hostname,uint32_t address,bool negative,uint32_t now,uint32_t ttl) {
+
+      std::list<ModelEntry>::iterator it;
+
+      if((it=find(hostname))!=Entries.end())
+        Entries.erase(it);
+      else {
+
+        if(Entries.size()==ENTRIES) {
+          Entries.pop_back();
+          Statistics.evictions++;
+        }
+
+        Statistics.insertions++;
+      }
+
+      Entries.push_front(ModelEntry { hostname,address,now+ttl,negative });
+    }
+
+    DnsCache::LookupResult lookup(const std::string& hostname,uint32_t now,uint32_t& address) {
+
+      std::list<ModelEntry>::iterator it;
+      ModelEntry entry;
+
+      if((it=find(hostname))==Entries.end()) {
+        Statistics.misses++;
+        return DnsCache::NOT_FOUND;
+      }
+
+      entry=*it;
+      Entries.erase(it);
+
+      if(now>entry.ExpiryTime) {
+        Statistics.expiries++;
+        Statistics.misses++;
+        return DnsCache::NOT_FOUND;
+      }
+
+      Entries.push_front(entry);
+
+      if(entry.Negative) {
+        Statistics.negativeHits++;
+        return DnsCache::NEGATIVE;
+      }
+
+      address=entry.Address;
+      Statistics.hits++;
+      return DnsCache::FOUND;
+    }
+  };
+
+
+  /*
+   * Random operations on the cache and the model. Lookups use random case.
+   */
+
+  void testAgainstModel(RtcBase& rtc) {
+
+    DnsCache cache;
+    Model model;
+    IpAddress found;
+    DnsCache::LookupResult result;
+    std::string hostname;
+    uint32_t op,i,ttl,address,serial;
+    bool ok;
+
+    HOSTTEST_CHECK(cache.initialise(ENTRIES,MAX_HOSTNAME_LENGTH,&rtc));
+
+    srand(1);
+    serial=0;
+    ok=true;
+
+    for(op=0;ok && op<OPERATIONS;op++) {
+
+      hostname=name(rand() % NAMES);
+      ttl=1+rand() % TTL;
+
+      switch(rand() % 8) {
+
+        case 0:
+        case 1:
+          serial++;
+          cache.add(hostname.c_str(),ip(serial),ttl);
+          model.insert(hostname,ip(serial).ipAddress,false,rtc.getTick(),ttl);
+          break;
+
+        case 2:
+          cache.addNegative(hostname.c_str(),ttl);
+          model.insert(hostname,0,true,rtc.getTick(),ttl);
+          break;
+
+        case 3:
+          advanceSeconds(1);
+          break;
+
+        default:
+          for(i=0;i<hostname.size();i++)
+            if(rand() % 2)
+              hostname[i]=toupper(hostname[i]);
+
+          result=cache.find(hostname.c_str(),found);
+          ok=result==model.lookup(hostname,rtc.getTick(),address);
+
+          if(ok && result==DnsCache::FOUND)
+            ok=found.ipAddress==address;
+          break;
+      }
+
+      ok=ok && !memcmp(&cache.getStatistics(),&model.Statistics,sizeof(DnsCacheStatistics));
+    }
+
+    HOSTTEST_CHECK(ok);
+
+    // everything must have happened
+
+    HOSTTEST_CHECK(model.Statistics.hits>0 && model.Statistics.negativeHits>0);
+    HOSTTEST_CHECK(model.Statistics.evictions>0 && model.Statistics.expiries>0);
+  }
+}
+
+
+int main() {
+
+  RtcBase rtc;
+
+  testExpiry(rtc);
+  testEviction(rtc);
+  testNegative(rtc);
+  testAliases(rtc);
+  testBrokenLink(rtc);
+  testNames(rtc);
+  testAgainstModel(rtc);
+
+  return hosttest::result("DnsCacheTest");
+}
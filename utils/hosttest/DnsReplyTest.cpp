@@ -0,0 +1,594 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the bounds checks on DNS replies. A reply with a question, two CNAME records and
+ * the A record that they lead to is parsed again at every length short of its full size. The
+ * bytes received end where a page that can't be read begins, so a read past the end faults.
+ * Every name, record and answer section must be found when it lies inside the bytes received
+ * and be refused when any byte of it doesn't.
+ *
+ * Names that are broken on purpose must be refused: compression pointer loops, chains of more
+ * than 16 pointers, pointers past the end, the reserved label types, labels past the end and
+ * names longer than the caller's buffer. So must records whose data length runs past the end
+ * and question counts that do.
+ *
+ * Then a server on the memory network answers the stack's queries. A reply whose UDP length
+ * claims more than the IP packet carries is ignored, as is one shorter than a DNS header. A
+ * reply cut short at any point after its header fails the query without caching anything, as
+ * does a reply with no answers. A whole reply caches the chain of names and an NXDOMAIN is
+ * remembered.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+#include "HostTest.h"
+
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  typedef Dns<MemoryTransportLayer> MemoryDns;
+
+  enum {
+    HEADER_SIZE = 12,
+    DNS_PORT = 53,
+    NAME_SIZE = 256
+  };
+
+
+  /*
+   * A DNS packet built up a field at a time
+   */
+
+  struct Packet {
+
+    std::vector<uint8_t> Bytes;
+
+    Packet(uint16_t flags,uint16_t questions,uint16_t answers) {
+      u16(0x1234);
+      u16(flags);
+      u16(questions);
+      u16(answers);
+      u16(0);
+      u16(0);
+    }
+
+    uint16_t offset() const {
+      return Bytes.size();
+    }
+
+    void u8(uint8_t value) {
+      Bytes.push_back(value);
+    }
+
+    void u16(uint16_t value) {
+      u8(value >> 8);
+      u8(value);
+    }
+
+    void u32(uint32_t value) {
+      u16(value >> 16);
+      u16(value);
+    }
+
+    void label(const char *text) {
+      u8(strlen(text));
+      Bytes.insert(Bytes.end(),text,text+strlen(text));
+    }
+
+    void pointer(uint16_t target) {
+      u16(0xc000 | target);
+    }
+
+    void recordHeader(DnsPacketHeader::RecordType type,uint32_t ttl,uint16_t dataLength) {
+      u16(static_cast<uint16_t>(type));
+      u16(1);
+      u32(ttl);
+      u16(dataLength);
+    }
+  };
+
+
+  /*
+   * Copy the first bytes of a packet to the end of a page that's followed by one that can't
+   * be read, so that any read past the end of what was received faults
+   */
+
+  DnsReplyPacket *receive(const Packet& p,uint16_t size) {
+
+    static uint8_t *pages=nullptr;
+    static long pageSize;
+
+    if(pages==nullptr) {
+      pageSize=sysconf(_SC_PAGESIZE);
+      pages=static_cast<uint8_t *>(mmap(nullptr,pageSize*2,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0));
+      mprotect(pages+pageSize,pageSize,PROT_NONE);
+    }
+
+    memcpy(pages+pageSize-size,&p.Bytes[0],size);
+    return reinterpret_cast<DnsReplyPacket *>(pages+pageSize-size);
+  }
+
+
+  /*
+   * Where the names and records are in the test reply
+   */
+
+  struct Layout {
+    uint16_t Question;              // www.example.com
+    uint16_t Answers;
+    uint16_t Cname1;                // www.example.com CNAME cdn.example.com
+    uint16_t Cname1Target;
+    uint16_t Cname2;                // cdn.example.com CNAME edge.example.net
+    uint16_t Cname2Target;
+    uint16_t A;                     // edge.example.net A 93.184.216.34
+    uint16_t Size;
+  };
+
+
+  const uint32_t ReplyAddress=0x5db8d822;
+
+
+  Packet createReply(Layout& layout) {
+
+    Packet p(0x8180,1,3);
+
+    layout.Question=p.offset();
+    p.label("www");
+    p.label("example");
+    p.label("com");
+    p.u8(0);
+    p.u16(1);
+    p.u16(1);
+
+    layout.Answers=layout.Cname1=p.offset();
+    p.pointer(layout.Question);
+    p.recordHeader(DnsPacketHeader::RecordType::CNAME,300,6);
+    layout.Cname1Target=p.offset();
+    p.label("cdn");
+    p.pointer(layout.Question+4);
+
+    layout.Cname2=p.offset();
+    p.pointer(layout.Cname1Target);
+    p.recordHeader(DnsPacketHeader::RecordType::CNAME,200,18);
+    layout.Cname2Target=p.offset();
+    p.label("edge");
+    p.label("example");
+    p.label("net");
+    p.u8(0);
+
+    layout.A=p.offset();
+    p.pointer(layout.Cname2Target);
+    p.recordHeader(DnsPacketHeader::RecordType::A,60,4);
+    p.u32(ReplyAddress);
+
+    layout.Size=p.offset();
+    return p;
+  }
+
+
+  /*
+   * Check that a name decodes when the packet holds every byte that it uses and not otherwise
+   */
+
+  bool checkName(DnsReplyPacket *reply,uint16_t size,uint16_t offset,uint16_t needed,const char *expected) {
+
+    uint8_t *base;
+    char name[NAME_SIZE];
+    bool decoded;
+
+    base=reinterpret_cast<uint8_t *>(reply);
+    decoded=reply->decodeName(base+offset,name,sizeof(name),size);
+
+    if(size<needed)
+      return !decoded;
+
+    return decoded && !strcmp(name,expected);
+  }
+
+
+  /*
+   * Check where a record ends, or that it's refused if it doesn't end inside the packet
+   */
+
+  bool checkRecord(DnsReplyPacket *reply,uint16_t size,uint16_t offset,uint16_t end) {
+
+    uint8_t *base;
+
+    base=reinterpret_cast<uint8_t *>(reply);
+    return reply->stepOverRecord(base+offset,size)==(size<end ? nullptr : base+end);
+  }
+
+
+  /*
+   * Parse the reply at every length from the header to the whole packet
+   */
+
+  void testTruncation() {
+
+    Layout layout;
+    Packet p(createReply(layout));
+    uint8_t *base,*answers,*expected;
+    DnsReplyPacket *reply;
+    uint16_t size;
+    bool ok;
+
+    ok=true;
+
+    for(size=HEADER_SIZE;size<=layout.Size;size++) {
+
+      reply=receive(p,size);
+      base=reinterpret_cast<uint8_t *>(reply);
+
+      // the question ends after its type and class
+
+      answers=reply->findAnswers(size);
+      ok&=answers==(size<layout.Answers ? nullptr : base+layout.Answers);
+
+      ok&=reply->stepOverName(base+layout.Question,size)==(size<layout.Answers-4 ? nullptr : base+layout.Answers-4);
+      ok&=reply->stepOverName(base+layout.Cname2,size)==(size<layout.Cname2+2 ? nullptr : base+layout.Cname2+2);
+
+      // each record is there when its data is
+
+      ok&=checkRecord(reply,size,layout.Cname1,layout.Cname2);
+      ok&=checkRecord(reply,size,layout.Cname2,layout.A);
+      ok&=checkRecord(reply,size,layout.A,layout.Size);
+
+      if(answers) {
+        expected=size<layout.Cname2 ? nullptr : base+layout.Cname1;
+        ok&=reply->findRecord(answers,DnsPacketHeader::RecordType::CNAME,size)==expected;
+
+        expected=size<layout.Size ? nullptr : base+layout.A;
+        ok&=reply->findRecord(answers,DnsPacketHeader::RecordType::A,size)==expected;
+      }
+
+      // names decode when every label and pointer that they use is inside
+
+      ok&=checkName(reply,size,layout.Question,layout.Answers-4,"www.example.com");
+      ok&=checkName(reply,size,layout.Cname1,layout.Cname1+2,"www.example.com");
+      ok&=checkName(reply,size,layout.Cname1Target,layout.Cname2,"cdn.example.com");
+      ok&=checkName(reply,size,layout.Cname2,layout.Cname2+2,"cdn.example.com");
+      ok&=checkName(reply,size,layout.Cname2Target,layout.A,"edge.example.net");
+      ok&=checkName(reply,size,layout.A,layout.A+2,"edge.example.net");
+    }
+
+    HOSTTEST_CHECK(ok);
+  }
+
+
+  /*
+   * Decode the name at the start of the body of a packet
+   */
+
+  bool decode(const Packet& p,char *name,uint16_t nameSize) {
+
+    DnsReplyPacket *reply;
+
+    reply=receive(p,p.offset());
+    return reply->decodeName(reinterpret_cast<uint8_t *>(reply)+HEADER_SIZE,name,nameSize,p.offset());
+  }
+
+
+  uint8_t *stepOverName(const Packet& p) {
+
+    DnsReplyPacket *reply;
+
+    reply=receive(p,p.offset());
+    return reply->stepOverName(reinterpret_cast<uint8_t *>(reply)+HEADER_SIZE,p.offset());
+  }
+
+
+  void testBadNames() {
+
+    char name[NAME_SIZE];
+    uint16_t i;
+
+    // a pointer to itself, and two pointers to each other
+
+    Packet loop1(0x8180,0,0);
+    loop1.pointer(HEADER_SIZE);
+    HOSTTEST_CHECK(!decode(loop1,name,sizeof(name)));
+
+    Packet loop2(0x8180,0,0);
+    loop2.pointer(HEADER_SIZE+2);
+    loop2.pointer(HEADER_SIZE);
+    HOSTTEST_CHECK(!decode(loop2,name,sizeof(name)));
+
+    // 16 pointers in a row are followed and 17 are not
+
+    for(i=16;i<=17;i++) {
+
+      Packet chain(0x8180,0,0);
+
+      while(chain.offset()<HEADER_SIZE+i*2)
+        chain.pointer(chain.offset()+2);
+
+      chain.label("host");
+      chain.u8(0);
+
+      HOSTTEST_CHECK(decode(chain,name,sizeof(name))==(i==16));
+      HOSTTEST_CHECK(i==17 || !strcmp(name,"host"));
+    }
+
+    // a pointer past the end, and one cut in half
+
+    Packet past(0x8180,0,0);
+    past.label("a");
+    past.pointer(0x3ff);
+    HOSTTEST_CHECK(!decode(past,name,sizeof(name)));
+
+    Packet half(0x8180,0,0);
+    half.label("a");
+    half.u8(0xc0);
+    HOSTTEST_CHECK(!decode(half,name,sizeof(name)));
+    HOSTTEST_CHECK(stepOverName(half)==nullptr);
+
+    // the reserved label types, followed by as many bytes as they'd be labels of
+
+    Packet reserved40(0x8180,0,0);
+    reserved40.u8(0x41);
+    while(reserved40.offset()<HEADER_SIZE+1+0x41)
+      reserved40.u8('a');
+    reserved40.u8(0);
+    HOSTTEST_CHECK(!decode(reserved40,name,sizeof(name)));
+
+    Packet reserved80(0x8180,0,0);
+    reserved80.u8(0x81);
+    while(reserved80.offset()<HEADER_SIZE+1+0x81)
+      reserved80.u8('a');
+    reserved80.u8(0);
+    HOSTTEST_CHECK(!decode(reserved80,name,sizeof(name)));
+
+    // a label longer than the rest of the packet
+
+    Packet longLabel(0x8180,0,0);
+    longLabel.u8(0x3f);
+    longLabel.label("abc");
+    HOSTTEST_CHECK(!decode(longLabel,name,sizeof(name)));
+    HOSTTEST_CHECK(stepOverName(longLabel)==nullptr);
+
+    // a name must fit the buffer with its terminator
+
+    Packet fits(0x8180,0,0);
+    fits.label("www");
+    fits.label("example");
+    fits.label("com");
+    fits.u8(0);
+
+    HOSTTEST_CHECK(decode(fits,name,16) && !strcmp(name,"www.example.com"));
+    HOSTTEST_CHECK(!decode(fits,name,15));
+  }
+
+
+  void testBadRecords() {
+
+    DnsReplyPacket *reply;
+    uint8_t *answers;
+
+    // data that runs past the end
+
+    Packet p(0x8180,1,1);
+    p.label("a");
+    p.u8(0);
+    p.u16(1);
+    p.u16(1);
+    p.pointer(HEADER_SIZE);
+    p.recordHeader(DnsPacketHeader::RecordType::A,60,0xffff);
+    p.u32(ReplyAddress);
+
+    reply=receive(p,p.offset());
+
+    HOSTTEST_CHECK((answers=reply->findAnswers(p.offset()))==reinterpret_cast<uint8_t *>(reply)+HEADER_SIZE+7);
+    HOSTTEST_CHECK(reply->stepOverRecord(answers,p.offset())==nullptr);
+    HOSTTEST_CHECK(reply->findRecord(answers,DnsPacketHeader::RecordType::A,p.offset())==nullptr);
+
+    // more questions than the packet holds
+
+    p.Bytes[4]=0xff;
+    reply=receive(p,p.offset());
+
+    HOSTTEST_CHECK(reply->findAnswers(p.offset())==nullptr);
+  }
+
+
+  /*
+   * The server runs in the timer interrupt after the network has moved the frames
+   */
+
+  struct ServerNetwork : MemoryNetwork {
+    using MemoryNetwork::onTimerInterrupt;
+  };
+
+
+  /*
+   * The DNS server. It answers each query with the first SendSize bytes of Reply in a
+   * datagram whose UDP length says that it carries ClaimedSize bytes.
+   */
+
+  MemoryNetwork *Network;
+  MemoryHost *Server;
+  std::vector<uint8_t> Reply;
+  uint16_t SendSize;
+  uint16_t ClaimedSize;
+  uint32_t Queries;
+
+
+  void answer(std::vector<uint8_t>& query) {
+
+    const IpPacketHeader *iph;
+    const UdpDatagram *request;
+    UdpDatagram *udp;
+
+    iph=reinterpret_cast<const IpPacketHeader *>(&query[14]);
+
+    if(iph->ip_hdr_protocol!=IpProtocol::UDP)
+      return;
+
+    request=reinterpret_cast<const UdpDatagram *>(&query[14+(iph->ip_hdr_version & 0xf)*4]);
+
+    if(NetUtil::ntohs(request->udp_destinationPort)!=DNS_PORT)
+      return;
+
+    Queries++;
+
+    std::vector<uint8_t> frame(MemoryNetwork::createIpFrame(Server->getMacAddress(),Server->getAddress(),IpProtocol::UDP,UdpDatagram::getHeaderSize()+SendSize,Queries));
+
+    udp=reinterpret_cast<UdpDatagram *>(MemoryNetwork::getIpPayload(frame));
+    udp->udp_sourcePort=NetUtil::htons(DNS_PORT);
+    udp->udp_destinationPort=request->udp_sourcePort;
+    udp->udp_length=NetUtil::htons(UdpDatagram::getHeaderSize()+ClaimedSize);
+    udp->udp_checksum=0;
+
+    // the reply has the query's identification
+
+    memcpy(udp->udp_data,&Reply[0],SendSize);
+    memcpy(udp->udp_data,request->udp_data,2);
+
+    Network->transmit(frame);
+  }
+
+
+  void serverInterrupt() {
+
+    std::vector<uint8_t> frame;
+
+    ServerNetwork::onTimerInterrupt();
+
+    while(Server->getFrame(frame))
+      answer(frame);
+  }
+
+
+  bool isLastDnsError(uint16_t error) {
+    return errorProvider.isLastError(ErrorProvider::ERROR_PROVIDER_NET_DNS,error);
+  }
+
+
+  void testServer(MemoryNetwork& network) {
+
+    Layout layout;
+    Packet p(createReply(layout));
+    IpAddress address;
+    uint32_t insertions,queries;
+    bool ok;
+
+    Reply=p.Bytes;
+    insertions=network.getStack().dnsGetCacheStatistics().insertions;
+
+    // a reply that claims more than the IP packet carries is not a reply
+
+    SendSize=layout.Size-10;
+    ClaimedSize=layout.Size;
+
+    HOSTTEST_CHECK(!network.getStack().dnsHostnameQuery("www.example.com",address));
+    HOSTTEST_CHECK(isLastDnsError(MemoryDns::E_TIMED_OUT));
+    HOSTTEST_CHECK(Queries==1);
+
+    // and nor is one that's shorter than a DNS header
+
+    ok=true;
+
+    for(SendSize=2;SendSize<HEADER_SIZE;SendSize++) {
+      ClaimedSize=SendSize;
+      ok&=!network.getStack().dnsHostnameQuery("www.example.com",address) && isLastDnsError(MemoryDns::E_TIMED_OUT);
+    }
+
+    HOSTTEST_CHECK(ok);
+
+    // a reply cut short anywhere after its header fails without caching anything
+
+    ok=true;
+
+    for(SendSize=HEADER_SIZE;SendSize<layout.Size;SendSize++) {
+
+      ClaimedSize=SendSize;
+
+      ok&=!network.getStack().dnsHostnameQuery("www.example.com",address);
+      ok&=isLastDnsError(SendSize<layout.Answers ? MemoryDns::E_MALFORMED_REPLY : MemoryDns::E_NO_A_RECORD_IN_ANSWERS);
+    }
+
+    HOSTTEST_CHECK(ok);
+    HOSTTEST_CHECK(network.getStack().dnsGetCacheStatistics().insertions==insertions);
+
+    // the whole reply caches the aliases and the address, and the next lookup doesn't query
+
+    SendSize=ClaimedSize=layout.Size;
+
+    HOSTTEST_CHECK(network.getStack().dnsHostnameQuery("www.example.com",address));
+    HOSTTEST_CHECK(address.ipAddress==NetUtil::htonl(ReplyAddress));
+    HOSTTEST_CHECK(network.getStack().dnsGetCacheStatistics().insertions==insertions+3);
+
+    queries=Queries;
+    address.ipAddress=0;
+
+    HOSTTEST_CHECK(network.getStack().dnsHostnameQuery("WWW.example.com",address));
+    HOSTTEST_CHECK(network.getStack().dnsHostnameQuery("edge.example.net",address));
+    HOSTTEST_CHECK(address.ipAddress==NetUtil::htonl(ReplyAddress));
+    HOSTTEST_CHECK(Queries==queries);
+
+    // a reply with no answers
+
+    Packet empty(0x8180,1,0);
+    empty.label("a");
+    empty.u8(0);
+    empty.u16(1);
+    empty.u16(1);
+
+    Reply=empty.Bytes;
+    SendSize=ClaimedSize=empty.offset();
+
+    HOSTTEST_CHECK(!network.getStack().dnsHostnameQuery("a",address));
+    HOSTTEST_CHECK(isLastDnsError(MemoryDns::E_NO_ANSWERS));
+
+    // a name that doesn't exist is remembered
+
+    Packet nxdomain(0x8183,0,0);
+
+    Reply=nxdomain.Bytes;
+    SendSize=ClaimedSize=nxdomain.offset();
+
+    HOSTTEST_CHECK(!network.getStack().dnsHostnameQuery("nothing.example.com",address));
+    HOSTTEST_CHECK(isLastDnsError(MemoryDns::E_SERVER_ERROR));
+    HOSTTEST_CHECK(!network.getStack().dnsHostnameQuery("nothing.example.com",address));
+    HOSTTEST_CHECK(isLastDnsError(MemoryDns::E_SERVER_ERROR));
+    HOSTTEST_CHECK(Queries==queries+2);
+    HOSTTEST_CHECK(network.getStack().dnsGetCacheStatistics().negativeHits==1);
+  }
+}
+
+
+int main() {
+
+  ServerNetwork network;
+
+  testTruncation();
+  testBadNames();
+  testBadRecords();
+
+  network.getParameters().dns_timeout=100;
+  network.getParameters().dns_retries=1;
+
+  HOSTTEST_CHECK(network.initialise());
+
+  MemoryHost server(network,"192.168.0.1");
+
+  Network=&network;
+  Server=&server;
+  MillisecondTimer::interrupt()=serverInterrupt;
+
+  testServer(network);
+
+  return hosttest::result("DnsReplyTest");
+}
@@ -0,0 +1,287 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Mount and allocate on FAT32 images of 2, 8 and 32GB cards. The images are sparse, so only
+ * the FATs and the files take up memory. Each image is prepared so that allocation has to work
+ * for its clusters:
+ *
+ *   - the first 60% and the last 30% of the clusters are in use, with a free cluster every 64
+ *   - the 10% between them is free
+ *   - the free count and the next free hint in FSInfo are valid and the hint points at the
+ *     start of the FAT
+ *
+ * Then the image is mounted, the free space is asked for and a 4MB file is written in 64KB
+ * pieces. That's done with the default wear resistant allocator and with free cluster bitmaps
+ * of different sizes built at mount. The last row writes the file a cluster at a time, so
+ * allocation doesn't know that more clusters are coming and fills the holes in order.
+ *
+ * The device calls for each step are counted and turned into a time on the same model of an
+ * SDIO card as the throughput benchmark. A fragment is a run of contiguous clusters in the
+ * file. The file is read back and the free space must have gone down by the size of the file
+ * or the benchmark fails.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+#include "SparseBlockDevice.h"
+#include "FatImage.h"
+
+#include <chrono>
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::fat;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    FILE_SIZE = 4*1024*1024,
+    PIECE_SIZE = 65536,
+    HOLE_SPACING = 64,
+    EXACT = 0xffffffff
+  };
+
+  const double COMMAND_MS=0.25;
+  const double BYTES_PER_MS=12000;
+
+  struct Image {
+    const char *Name;
+    uint32_t Sectors;
+  };
+
+  struct Case {
+    const char *Name;
+    uint32_t BitmapBytes;
+    bool ClusterWrites;
+  };
+
+  const Image Images[]={
+    { "2GB",  4194304  },
+    { "8GB",  16777216 },
+    { "32GB", 67108864 }
+  };
+
+  const Case Cases[]={
+    { "wear resistant",        0,     false },
+    { "bitmap 512B",           512,   false },
+    { "bitmap 4KB",            4096,  false },
+    { "bitmap exact",          EXACT, false },
+    { "exact, cluster writes", EXACT, true  }
+  };
+
+
+  /*
+   * The cost of the device calls since the counters were reset
+   */
+
+  struct Cost {
+    uint32_t Calls;
+    double Ms;
+
+    Cost(SparseBlockDevice& device) {
+
+      const SparseBlockDevice::Counters& counters(device.getCounters());
+
+      Calls=counters.ReadCalls+counters.WriteCalls;
+      Ms=Calls*COMMAND_MS+(counters.BlocksRead+counters.BlocksWritten)*512.0/BYTES_PER_MS;
+
+      device.resetCounters();
+    }
+  };
+
+
+  /*
+   * Format the image and fill it. Each used cluster is a chain of one, which is all that the
+   * allocator cares about. They're marked in descending order so that the hint ends up at the
+   * start. The root directory is in cluster 2 and is left alone.
+   */
+
+  bool prepare(SparseBlockDevice& device,uint32_t& countOfClusters) {
+
+    std::unique_ptr<FatFileSystem> fs(FatImage::format(device,true));
+    uint32_t cluster,numEntries,usedEnd,gapEnd,units,multiplier;
+
+    if(!fs)
+      return false;
+
+    countOfClusters=fs->getCountOfClusters();
+    numEntries=countOfClusters+2;
+    usedEnd=2+countOfClusters*6/10;
+    gapEnd=2+countOfClusters*7/10;
+
+    for(cluster=numEntries-1;cluster>2;cluster--) {
+
+      if((cluster>=usedEnd && cluster<gapEnd) || cluster % HOLE_SPACING==0)
+        continue;
+
+      if(!fs->writeFatEntry(cluster,fs->getEndOfClusterChainMarker()))
+        return false;
+    }
+
+    // count the free clusters so that the destructor writes a valid FSInfo
+
+    return fs->getFreeSpace(units,multiplier);
+  }
+
+
+  /*
+   * Count the runs of contiguous clusters in a file
+   */
+
+  bool countFragments(FatFileSystem& fs,File& file,uint32_t& fragments) {
+
+    const DirectoryEntry& dirent(static_cast<FatFile&>(file).getDirectoryEntryWithLocation().Dirent);
+    uint32_t cluster,next;
+
+    cluster=dirent.sdir.DIR_FstClusLO | (static_cast<uint32_t>(dirent.sdir.DIR_FstClusHI) << 16);
+    fragments=1;
+
+    for(;;) {
+
+      if(!fs.readFatEntry(cluster,next))
+        return false;
+
+      if(fs.isEndOfClusterChainMarker(next))
+        return true;
+
+      if(next!=cluster+1)
+        fragments++;
+
+      cluster=next;
+    }
+  }
+
+
+  bool writeFile(FatFileSystem& fs,uint32_t pieceSize) {
+
+    std::vector<uint8_t> piece(pieceSize);
+    uint32_t offset;
+    File *file;
+    bool ok;
+
+    if(!fs.createFile("/new.bin") || !fs.openFile("/new.bin",file))
+      return false;
+
+    for(ok=true,offset=0;ok && offset<FILE_SIZE;offset+=pieceSize) {
+      FatImage::fill(&piece[0],0,offset,pieceSize);
+      ok=file->write(&piece[0],pieceSize);
+    }
+
+    delete file;
+    return ok;
+  }
+
+
+  bool checkFile(FatFileSystem& fs,uint32_t& fragments) {
+
+    std::vector<uint8_t> data(FILE_SIZE);
+    uint32_t actuallyRead;
+    File *file;
+    bool ok;
+
+    if(!fs.openFile("/new.bin",file))
+      return false;
+
+    ok=file->read(&data[0],FILE_SIZE,actuallyRead)
+       && actuallyRead==FILE_SIZE
+       && FatImage::check(&data[0],0,0,FILE_SIZE)
+       && countFragments(fs,*file,fragments);
+
+    delete file;
+    return ok;
+  }
+
+
+  bool run(const SparseBlockDevice& image,uint32_t countOfClusters,const Case& c) {
+
+    SparseBlockDevice device(image);
+    std::unique_ptr<FatFileSystem> fs;
+    uint32_t bitmapBytes,freeBefore,freeAfter,multiplier,clusterSize,fragments,fatReads;
+    bool ok;
+
+    // an exact bitmap needs a bit for every FAT entry
+
+    bitmapBytes=c.BitmapBytes==EXACT ? (countOfClusters+2+7)/8 : c.BitmapBytes;
+
+    auto start=std::chrono::steady_clock::now();
+
+    device.resetCounters();
+    fs.reset(FatImage::mount(device,bitmapBytes));
+
+    if(!fs)
+      return false;
+
+    Cost mount(device);
+
+    ok=fs->getFreeSpace(freeBefore,multiplier);
+    Cost freeSpace(device);
+
+    clusterSize=fs->getBootSector().BPB_SecPerClus*SparseBlockDevice::BLOCK_SIZE;
+
+    fs->resetFatCacheStatistics();
+
+    ok=ok && writeFile(*fs,c.ClusterWrites ? clusterSize : PIECE_SIZE);
+
+    fatReads=fs->getFatCacheStatistics().FatEntryReads;
+    Cost allocate(device);
+
+    std::chrono::duration<double,std::milli> elapsed=std::chrono::steady_clock::now()-start;
+
+    fragments=0;
+
+    ok=ok
+       && checkFile(*fs,fragments)
+       && fs->getFreeSpace(freeAfter,multiplier)
+       && freeBefore-freeAfter==FILE_SIZE/clusterSize;
+
+    printf("  %-22s %7u %9.0f %7u %7u %9u %9.0f %9u %8.0f\n",
+           c.Name,
+           mount.Calls,
+           mount.Ms,
+           freeSpace.Calls,
+           allocate.Calls,
+           fatReads,
+           allocate.Ms,
+           fragments,
+           elapsed.count());
+
+    if(!ok)
+      printf("%s: the file or the free space is wrong or an operation failed\n",c.Name);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  uint32_t countOfClusters;
+  bool ok;
+
+  printf("  %-22s %7s %9s %7s %7s %9s %9s %9s %8s\n","","mount","mount","free","write","write","write","","host");
+  printf("  %-22s %7s %9s %7s %7s %9s %9s %9s %8s\n","","calls","SDIO ms","calls","calls","FAT rds","SDIO ms","fragments","ms");
+
+  ok=true;
+
+  for(const Image& image : Images) {
+
+    SparseBlockDevice device(image.Sectors);
+
+    if(!prepare(device,countOfClusters))
+      return 1;
+
+    printf("%s, %u clusters\n",image.Name,countOfClusters);
+
+    for(const Case& c : Cases)
+      ok&=run(device,countOfClusters,c);
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Random seeks in an 8MB file on a FAT32 image in memory with one sector per cluster, which
+ * gives the longest cluster chains. Each operation seeks to a random offset and reads 64
+ * bytes from it. Without an extent map a seek walks the cluster chain from the start of the
+ * file or from the current cluster. With a map that covers the file it's a binary search,
+ * and a small map covers the start of the file and the walk continues from its end.
+ *
+ * The files are the same as the throughput benchmark's: a contiguous one, one interleaved
+ * cluster by cluster with another and one laid out by the default wear resistant
+ * allocator. The file is seeked to its end before timing starts so that the maps are full.
+ * The device reads, FAT entry reads and host time per operation are reported. Every read is
+ * checked and the benchmark fails if any of them are wrong.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+#include "MemoryBlockDevice.h"
+#include "FatImage.h"
+
+#include <chrono>
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::fat;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    IMAGE_SECTORS = 80000,
+    FILE_SIZE = 8*1024*1024,
+    SECTOR_SIZE = 512,
+    READ_SIZE = 64,
+    OPERATIONS = 2000,
+    SMALL_MAP = 16,
+    NO_MAP = 0,
+    FULL_MAP = 0xffffffff
+  };
+
+  struct Case {
+    const char *Name;
+    const char *Filename;
+    uint32_t MaxExtents;
+  };
+
+  const Case Cases[]={
+    { "contig no map",     "/contig.bin",  NO_MAP    },
+    { "contig small map",  "/contig.bin",  SMALL_MAP },
+    { "contig full map",   "/contig.bin",  FULL_MAP  },
+    { "frag no map",       "/frag0.bin",   NO_MAP    },
+    { "frag small map",    "/frag0.bin",   SMALL_MAP },
+    { "frag full map",     "/frag0.bin",   FULL_MAP  },
+    { "scatter no map",    "/scatter.bin", NO_MAP    },
+    { "scatter small map", "/scatter.bin", SMALL_MAP },
+    { "scatter full map",  "/scatter.bin", FULL_MAP  }
+  };
+
+
+  bool run(MemoryBlockDevice& device,FatFileSystem& fs,const Case& c) {
+
+    uint8_t buffer[READ_SIZE];
+    uint32_t i,offset,actuallyRead;
+    double reads,fatReads;
+    File *file;
+    bool ok;
+
+    if(!fs.openFile(c.Filename,file))
+      return false;
+
+    // a full map has an extent for every cluster in the worst case
+
+    ok=c.MaxExtents==NO_MAP
+       || static_cast<FatFile *>(file)->enableExtentMap(c.MaxExtents==FULL_MAP ? FILE_SIZE/SECTOR_SIZE : c.MaxExtents);
+
+    ok=ok && file->seek(0,File::SeekEnd);
+
+    srand(1);
+    device.resetCounters();
+    fs.resetFatCacheStatistics();
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;ok && i<OPERATIONS;i++) {
+
+      offset=((rand() << 15) ^ rand()) % (FILE_SIZE-READ_SIZE);
+
+      ok=file->seek(offset,File::SeekStart)
+         && file->read(buffer,READ_SIZE,actuallyRead)
+         && actuallyRead==READ_SIZE
+         && FatImage::check(buffer,0,offset,READ_SIZE);
+    }
+
+    std::chrono::duration<double,std::micro> elapsed=std::chrono::steady_clock::now()-start;
+
+    delete file;
+
+    reads=device.getCounters().ReadCalls/static_cast<double>(OPERATIONS);
+    fatReads=fs.getFatCacheStatistics().FatEntryReads/static_cast<double>(OPERATIONS);
+
+    printf("%-20s %9.1f %9.1f %9.1f\n",
+           c.Name,
+           reads,
+           fatReads,
+           elapsed.count()/OPERATIONS);
+
+    if(!ok)
+      printf("%s: a read is wrong or an operation failed\n",c.Name);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  MemoryBlockDevice device(IMAGE_SECTORS);
+  std::unique_ptr<FatFileSystem> fs;
+  bool ok;
+
+  fs.reset(FatImage::formatWithFiles(device,true,FILE_SIZE));
+
+  if(!fs)
+    return 1;
+
+  printf("FAT32, %u byte clusters, %u byte file, %u byte reads\n\n",fs->getBootSector().BPB_SecPerClus*SECTOR_SIZE,FILE_SIZE,READ_SIZE);
+  printf("%-20s %9s %9s %9s\n","per seek+read","dev reads","FAT reads","host us");
+
+  ok=true;
+
+  for(const Case& c : Cases)
+    ok&=run(device,*fs,c);
+
+  return ok ? 0 : 1;
+}
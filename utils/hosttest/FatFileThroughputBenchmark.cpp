@@ -0,0 +1,232 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * FatFile throughput on a FAT16 image in memory. A 4MB file is read and written in buffers
+ * of different sizes. The whole sectors in a buffer go straight between the caller and the
+ * device in runs of contiguous sectors. Buffers smaller than a sector, and the ends of
+ * buffers that start part way into a sector (+1), go through the file's sector buffer one
+ * sector at a time, which is how every transfer used to work.
+ *
+ * The scattered file is written with the default wear resistant allocator, which starts
+ * each search for a free cluster at a random place, so its clusters are all over the device.
+ * The others, and the new files, are written with the free cluster bitmap enabled, which
+ * allocates from the next free cluster. The contiguous file is one run and the fragmented
+ * one alternates clusters with another file so that no run is longer than a cluster.
+ *
+ * The device calls per MB are counted and turned into a rate on a model of an SDIO card:
+ *
+ *   - a command costs 250us of bus and card latency
+ *   - data moves at 12MB/s (4 bit bus at 24MHz)
+ *
+ * Every byte read is checked, and every file written is read back and checked. The
+ * benchmark fails if any of them are wrong.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+#include "MemoryBlockDevice.h"
+#include "FatImage.h"
+
+#include <chrono>
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::fat;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    IMAGE_SECTORS = 131072,
+    FILE_SIZE = 4*1024*1024,
+    SECTOR_SIZE = 512,
+    VERIFY_SIZE = 65536
+  };
+
+  const double COMMAND_MS=0.25;
+  const double BYTES_PER_MS=12000;
+
+  enum Operation {
+    READ,
+    WRITE_NEW,
+    OVERWRITE
+  };
+
+  struct Case {
+    const char *Name;
+    Operation Op;
+    const char *Filename;
+    uint32_t BufferSize;
+    uint32_t Misalignment;        // bytes to skip or write before the first full buffer
+  };
+
+  const Case Cases[]={
+    { "read contig 100",       READ,      "/contig.bin", 100,   0 },
+    { "read contig 512",       READ,      "/contig.bin", 512,   0 },
+    { "read contig 4096",      READ,      "/contig.bin", 4096,  0 },
+    { "read contig 4096 +1",   READ,      "/contig.bin", 4096,  1 },
+    { "read contig 65536",     READ,      "/contig.bin", 65536, 0 },
+    { "read contig 65536 +1",  READ,      "/contig.bin", 65536, 1 },
+    { "read scatter 65536",    READ,      "/scatter.bin",65536, 0 },
+    { "read frag 4096",        READ,      "/frag0.bin",  4096,  0 },
+    { "read frag 65536",       READ,      "/frag0.bin",  65536, 0 },
+    { "read frag 65536 +1",    READ,      "/frag0.bin",  65536, 1 },
+    { "write new 100",         WRITE_NEW, "/new.bin",    100,   0 },
+    { "write new 512",         WRITE_NEW, "/new.bin",    512,   0 },
+    { "write new 4096",        WRITE_NEW, "/new.bin",    4096,  0 },
+    { "write new 4096 +1",     WRITE_NEW, "/new.bin",    4096,  1 },
+    { "write new 65536",       WRITE_NEW, "/new.bin",    65536, 0 },
+    { "write new 65536 +1",    WRITE_NEW, "/new.bin",    65536, 1 },
+    { "overwrite frag 65536",  OVERWRITE, "/frag0.bin",  65536, 0 },
+    { "overwrite frag 65536 +1",OVERWRITE,"/frag0.bin",  65536, 1 }
+  };
+
+
+  /*
+   * Read the whole file in buffers, checking every one
+   */
+
+  bool readFile(File& file,const Case& c) {
+
+    std::vector<uint8_t> buffer(c.BufferSize);
+    uint32_t offset,actuallyRead;
+
+    if(!file.seek(c.Misalignment,File::SeekStart))
+      return false;
+
+    for(offset=c.Misalignment;offset<FILE_SIZE;offset+=actuallyRead) {
+
+      if(!file.read(&buffer[0],std::min<uint32_t>(c.BufferSize,FILE_SIZE-offset),actuallyRead))
+        return false;
+
+      if(actuallyRead==0 || !FatImage::check(&buffer[0],0,offset,actuallyRead))
+        return false;
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Write the whole file in buffers after the misaligning write, if there is one
+   */
+
+  bool writeFile(File& file,const Case& c) {
+
+    std::vector<uint8_t> buffer(c.BufferSize);
+    uint32_t offset,size;
+
+    for(offset=0;offset<FILE_SIZE;offset+=size) {
+
+      size=std::min<uint32_t>(offset==0 && c.Misalignment ? c.Misalignment : c.BufferSize,FILE_SIZE-offset);
+
+      FatImage::fill(&buffer[0],0,offset,size);
+
+      if(!file.write(&buffer[0],size))
+        return false;
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Read back a file that's just been written
+   */
+
+  bool verify(FatFileSystem& fs,const char *filename) {
+
+    Case c={ "",READ,filename,VERIFY_SIZE,0 };
+    File *file;
+    bool ok;
+
+    if(!fs.openFile(filename,file))
+      return false;
+
+    ok=file->getLength()==FILE_SIZE && readFile(*file,c);
+
+    delete file;
+    return ok;
+  }
+
+
+  bool run(MemoryBlockDevice& device,FatFileSystem& fs,const Case& c) {
+
+    File *file;
+    bool ok;
+    double calls,blocks,modelMs;
+
+    if(c.Op==WRITE_NEW && !fs.createFile(c.Filename))
+      return false;
+
+    if(!fs.openFile(c.Filename,file))
+      return false;
+
+    device.resetCounters();
+    auto start=std::chrono::steady_clock::now();
+
+    ok=c.Op==READ ? readFile(*file,c) : writeFile(*file,c);
+    delete file;
+
+    std::chrono::duration<double,std::milli> elapsed=std::chrono::steady_clock::now()-start;
+
+    const MemoryBlockDevice::Counters& counters(device.getCounters());
+
+    calls=(counters.ReadCalls+counters.WriteCalls)/(FILE_SIZE/1048576.0);
+    blocks=(counters.BlocksRead+counters.BlocksWritten)/(FILE_SIZE/1048576.0);
+    modelMs=calls*COMMAND_MS+(blocks*SECTOR_SIZE)/BYTES_PER_MS;
+
+    printf("%-24s %9.0f %9.0f %8.1f %9.0f %9.2f\n",
+           c.Name,
+           calls,
+           blocks,
+           blocks/calls,
+           FILE_SIZE/1048576.0/(elapsed.count()/1000),
+           1000/modelMs);
+
+    if(ok && c.Op!=READ)
+      ok=verify(fs,c.Filename);
+
+    if(c.Op==WRITE_NEW)
+      ok&=fs.deleteFile(c.Filename);
+
+    if(!ok)
+      printf("%s: the file is wrong or an operation failed\n",c.Name);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  MemoryBlockDevice device(IMAGE_SECTORS);
+  std::unique_ptr<FatFileSystem> fs;
+  uint32_t clusterSize;
+  bool ok;
+
+  // new files are written with the bitmap, like the contiguous one
+
+  fs.reset(FatImage::formatWithFiles(device,false,FILE_SIZE));
+
+  if(!fs || !fs->enableFreeClusterBitmap(1))
+    return 1;
+
+  clusterSize=fs->getBootSector().BPB_SecPerClus*SECTOR_SIZE;
+
+  printf("FAT16, %u byte clusters, %u byte file\n\n",clusterSize,FILE_SIZE);
+  printf("%-24s %9s %9s %8s %9s %9s\n","","calls/MB","blocks/MB","blk/call","host MB/s","SDIO MB/s");
+
+  ok=true;
+
+  for(const Case& c : Cases)
+    ok&=run(device,*fs,c);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,386 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the FAT sector cache on FAT16 and FAT32 images formatted in memory. A changed FAT
+ * entry must stay in the cache until its sector is evicted, flushFatCache() or sync() is
+ * called or the file system is destroyed. Then it must go to every copy of the FAT. A FAT
+ * that changes during a file operation must be on the device when that operation returns,
+ * and the device must mount again with the same files on it. That includes creating a file
+ * that extends its directory's chain. A failed write-back must
+ * leave the sector dirty so that a later flush can finish the job.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+#include "MemoryBlockDevice.h"
+#include "HostTest.h"
+
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::fat;
+
+
+namespace {
+
+  enum {
+    FAT16_SECTORS = 20000,
+    FAT32_SECTORS = 80000,
+    SECTOR_SIZE = 512,
+    FILE_SIZE = 30000,
+    DIRECTORY_FILES = 40
+  };
+
+  NullTimeProvider TimeSource;
+
+
+  /*
+   * The places on the device that the tests look at
+   */
+
+  struct Geometry {
+    uint32_t FatFirstSector;
+    uint32_t FatSize;
+    uint32_t NumFats;
+    uint32_t EntriesPerSector;
+  };
+
+
+  /*
+   * Format a device as FAT16 or FAT32 and mount it
+   */
+
+  FatFileSystem *format(MemoryBlockDevice& device,bool fat32,Geometry& geometry) {
+
+    FatFileSystem *fs;
+
+    if(fat32)
+      Fat32FileSystemFormatter(device,0,FAT32_SECTORS,"HOSTTEST");
+    else
+      Fat16FileSystemFormatter(device,0,FAT16_SECTORS,"HOSTTEST");
+
+    fs=nullptr;
+    if(!FatFileSystem::getInstance(device,TimeSource,fs))
+      return nullptr;
+
+    geometry.FatFirstSector=fs->getBootSector().BPB_RsvdSecCnt;
+    geometry.FatSize=fs->getSectorsPerFat();
+    geometry.NumFats=fs->getBootSector().BPB_NumFATs;
+    geometry.EntriesPerSector=SECTOR_SIZE/fs->getFatEntrySizeInBytes();
+
+    return fs;
+  }
+
+
+  /*
+   * Check that a FAT sector is the same in every copy
+   */
+
+  bool copiesMatch(MemoryBlockDevice& device,const Geometry& geometry,uint32_t sectorInFat) {
+
+    uint32_t i;
+
+    for(i=1;i<geometry.NumFats;i++)
+      if(memcmp(device.getBlock(geometry.FatFirstSector+sectorInFat),
+                device.getBlock(geometry.FatFirstSector+i*geometry.FatSize+sectorInFat),
+                SECTOR_SIZE)!=0)
+        return false;
+
+    return true;
+  }
+
+
+  bool allCopiesMatch(MemoryBlockDevice& device,const Geometry& geometry) {
+
+    uint32_t i;
+
+    for(i=0;i<geometry.FatSize;i++)
+      if(!copiesMatch(device,geometry,i))
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * Read a FAT entry straight from a copy of the FAT on the device
+   */
+
+  uint32_t deviceEntry(MemoryBlockDevice& device,const FatFileSystem& fs,const Geometry& geometry,uint32_t copy,uint32_t cluster) {
+    return fs.getFatEntryFromMemory(device.getBlock(geometry.FatFirstSector+copy*geometry.FatSize+cluster/geometry.EntriesPerSector)+
+                                    (cluster % geometry.EntriesPerSector)*fs.getFatEntrySizeInBytes());
+  }
+
+
+  bool onDevice(MemoryBlockDevice& device,const FatFileSystem& fs,const Geometry& geometry,uint32_t cluster,uint32_t value) {
+
+    uint32_t i;
+
+    for(i=0;i<geometry.NumFats;i++)
+      if(deviceEntry(device,fs,geometry,i,cluster)!=value)
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * Entries in the same sector are read once and written back once to every copy
+   */
+
+  void testFlush(bool fat32) {
+
+    MemoryBlockDevice device(fat32 ? FAT32_SECTORS : FAT16_SECTORS);
+    Geometry geometry;
+    FatFileSystem *fs;
+    uint32_t i,value,cluster;
+
+    if((fs=format(device,fat32,geometry))==nullptr) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    HOSTTEST_CHECK(geometry.NumFats==2);
+
+    cluster=geometry.EntriesPerSector*3;
+    fs->resetFatCacheStatistics();
+    device.resetCounters();
+
+    for(i=0;i<geometry.EntriesPerSector;i++)
+      HOSTTEST_CHECK(fs->writeFatEntry(cluster+i,0x100+i));
+
+    for(i=0;i<geometry.EntriesPerSector;i++)
+      HOSTTEST_CHECK(fs->readFatEntry(cluster+i,value) && value==0x100+i);
+
+    HOSTTEST_CHECK(fs->getFatCacheStatistics().FatSectorReads==1);
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+    HOSTTEST_CHECK(!onDevice(device,*fs,geometry,cluster,0x100));
+
+    HOSTTEST_CHECK(fs->flushFatCache());
+
+    HOSTTEST_CHECK(fs->getFatCacheStatistics().FatSectorWrites==geometry.NumFats);
+    HOSTTEST_CHECK(device.getWrites().size()==2);
+
+    for(i=0;i<geometry.EntriesPerSector;i++)
+      HOSTTEST_CHECK(onDevice(device,*fs,geometry,cluster+i,0x100+i));
+
+    // nothing to write the second time
+
+    device.resetCounters();
+    HOSTTEST_CHECK(fs->flushFatCache());
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==0);
+
+    delete fs;
+  }
+
+
+  /*
+   * The least recently used sector is written back to all copies when it's evicted
+   */
+
+  void testEviction(bool fat32) {
+
+    MemoryBlockDevice device(fat32 ? FAT32_SECTORS : FAT16_SECTORS);
+    Geometry geometry;
+    FatFileSystem *fs;
+    uint32_t value,a,b,c;
+
+    if((fs=format(device,fat32,geometry))==nullptr) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    a=geometry.EntriesPerSector*4;
+    b=geometry.EntriesPerSector*5;
+    c=geometry.EntriesPerSector*6;
+
+    HOSTTEST_CHECK(fs->setFatCacheSize(2));
+    HOSTTEST_CHECK(fs->writeFatEntry(a,0x200));
+    HOSTTEST_CHECK(fs->writeFatEntry(b,0x201));
+    HOSTTEST_CHECK(fs->readFatEntry(a,value) && value==0x200);
+
+    // b is now the least recently used
+
+    HOSTTEST_CHECK(fs->readFatEntry(c,value) && value==0);
+
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,b,0x201));
+    HOSTTEST_CHECK(!onDevice(device,*fs,geometry,a,0x200));
+
+    // and with a single sector every miss evicts
+
+    HOSTTEST_CHECK(fs->setFatCacheSize(1));
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,a,0x200));
+
+    HOSTTEST_CHECK(fs->writeFatEntry(c,0x202));
+    HOSTTEST_CHECK(fs->readFatEntry(b,value) && value==0x201);
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,c,0x202));
+
+    HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+
+    delete fs;
+  }
+
+
+  /*
+   * sync() and the destructor write back what's in the cache
+   */
+
+  void testSyncAndDestructor(bool fat32) {
+
+    MemoryBlockDevice device(fat32 ? FAT32_SECTORS : FAT16_SECTORS);
+    Geometry geometry;
+    FatFileSystem *fs;
+    uint32_t value,cluster;
+
+    if((fs=format(device,fat32,geometry))==nullptr) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    cluster=geometry.EntriesPerSector*7+3;
+
+    HOSTTEST_CHECK(fs->writeFatEntry(cluster,0x300));
+    HOSTTEST_CHECK(!onDevice(device,*fs,geometry,cluster,0x300));
+    HOSTTEST_CHECK(fs->sync());
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,cluster,0x300));
+
+    HOSTTEST_CHECK(fs->writeFatEntry(cluster+1,0x301));
+    HOSTTEST_CHECK(!onDevice(device,*fs,geometry,cluster+1,0x301));
+
+    delete fs;
+
+    fs=nullptr;
+    HOSTTEST_CHECK(FatFileSystem::getInstance(device,TimeSource,fs));
+
+    if(fs) {
+      HOSTTEST_CHECK(onDevice(device,*fs,geometry,cluster+1,0x301));
+      HOSTTEST_CHECK(fs->readFatEntry(cluster+1,value) && value==0x301);
+      HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+      delete fs;
+    }
+  }
+
+
+  /*
+   * File operations leave every copy of the FAT the same and the files are there after a
+   * remount. Deleting a file frees its chain in every copy.
+   */
+
+  void testFileOperations(bool fat32) {
+
+    MemoryBlockDevice device(fat32 ? FAT32_SECTORS : FAT16_SECTORS);
+    std::vector<uint8_t> data(FILE_SIZE),readBack(FILE_SIZE);
+    Geometry geometry;
+    FatFileSystem *fs;
+    uint32_t i,actuallyRead,firstCluster;
+    char filename[64];
+    File *file;
+
+    if((fs=format(device,fat32,geometry))==nullptr) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    for(i=0;i<FILE_SIZE;i++)
+      data[i]=i*7+(i >> 8);
+
+    HOSTTEST_CHECK(fs->createDirectory("/dir"));
+    HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+
+    HOSTTEST_CHECK(fs->createFile("/dir/file.bin"));
+    HOSTTEST_CHECK(fs->openFile("/dir/file.bin",file));
+    HOSTTEST_CHECK(file->write(&data[0],FILE_SIZE));
+    delete file;
+
+    HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+
+    delete fs;
+
+    // mount again and read it back
+
+    fs=nullptr;
+    HOSTTEST_CHECK(FatFileSystem::getInstance(device,TimeSource,fs));
+
+    if(fs==nullptr)
+      return;
+
+    HOSTTEST_CHECK(fs->openFile("/dir/file.bin",file));
+    HOSTTEST_CHECK(file->getLength()==FILE_SIZE);
+    HOSTTEST_CHECK(file->read(&readBack[0],FILE_SIZE,actuallyRead) && actuallyRead==FILE_SIZE);
+    HOSTTEST_CHECK(data==readBack);
+
+    const DirectoryEntry& dirent=static_cast<FatFile *>(file)->getDirectoryEntryWithLocation().Dirent;
+    firstCluster=dirent.sdir.DIR_FstClusLO | static_cast<uint32_t>(dirent.sdir.DIR_FstClusHI) << 16;
+
+    delete file;
+
+    HOSTTEST_CHECK(firstCluster!=0 && !onDevice(device,*fs,geometry,firstCluster,0));
+
+    HOSTTEST_CHECK(fs->deleteFile("/dir/file.bin"));
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,firstCluster,0));
+    HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+
+    // enough long names to extend the directory's chain more than once
+
+    for(i=0;i<DIRECTORY_FILES;i++) {
+      snprintf(filename,sizeof(filename),"/dir/a file with a long name %u.txt",static_cast<unsigned>(i));
+      HOSTTEST_CHECK(fs->createFile(filename));
+      HOSTTEST_CHECK(allCopiesMatch(device,geometry));
+    }
+
+    delete fs;
+  }
+
+
+  /*
+   * A sector that couldn't be written to one of the copies stays dirty
+   */
+
+  void testFailedWriteBack(bool fat32) {
+
+    MemoryBlockDevice device(fat32 ? FAT32_SECTORS : FAT16_SECTORS);
+    Geometry geometry;
+    FatFileSystem *fs;
+    uint32_t cluster;
+
+    if((fs=format(device,fat32,geometry))==nullptr) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    cluster=geometry.EntriesPerSector*9;
+
+    HOSTTEST_CHECK(fs->writeFatEntry(cluster,0x400));
+
+    device.setFailingBlock(geometry.FatFirstSector+geometry.FatSize+9);
+    HOSTTEST_CHECK(!fs->flushFatCache());
+
+    device.setFailingBlock(MemoryBlockDevice::NO_FAILURE);
+    device.resetCounters();
+
+    HOSTTEST_CHECK(fs->flushFatCache());
+    HOSTTEST_CHECK(device.getCounters().WriteCalls==geometry.NumFats);
+    HOSTTEST_CHECK(onDevice(device,*fs,geometry,cluster,0x400));
+
+    delete fs;
+  }
+}
+
+
+int main() {
+
+  for(bool fat32 : { false,true }) {
+    testFlush(fat32);
+    testEviction(fat32);
+    testSyncAndDestructor(fat32);
+    testFileOperations(fat32);
+    testFailedWriteBack(fat32);
+  }
+
+  return hosttest::result("FatSectorCacheTest");
+}
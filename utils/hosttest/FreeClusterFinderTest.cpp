@@ -0,0 +1,303 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the free cluster bitmap on a FAT32 image in memory. A bitmap asked for at mount
+ * must be the smallest that fits in the RAM given. The run search must start at its hint,
+ * wrap around without joining the last cluster to the first and find a run that straddles
+ * the hint. A new file must start at the next free hint. A write that can't continue its
+ * chain in the next cluster must go in a free run that holds all of it when the bitmap is
+ * exact, and fill the holes in order otherwise.
+ */
+
+#include "config/stm32plus.h"
+#include "config/filesystem.h"
+#include "MemoryBlockDevice.h"
+#include "FatImage.h"
+#include "HostTest.h"
+
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::fat;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    SECTORS = 80000,
+    CLUSTER_SIZE = 512,
+    FILE_CLUSTERS = 64,
+    HOLE_SPACING = 16
+  };
+
+
+  /*
+   * Mark every cluster except the root directory's as used, in descending order so that
+   * the next free hint ends up at the start
+   */
+
+  void fill(FatFileSystem& fs) {
+
+    uint32_t cluster;
+
+    for(cluster=fs.getCountOfClusters()+1;cluster>2;cluster--)
+      HOSTTEST_CHECK(fs.writeFatEntry(cluster,fs.getEndOfClusterChainMarker()));
+  }
+
+
+  void freeRun(FatFileSystem& fs,uint32_t first,uint32_t count) {
+    while(count--)
+      HOSTTEST_CHECK(fs.writeFatEntry(first++,0));
+  }
+
+
+  bool findRun(FatFileSystem& fs,uint32_t hint,uint32_t count,uint32_t& first) {
+
+    BitmapFreeClusterFinder finder(fs,*fs.getFreeClusterBitmap(),hint);
+
+    first=0;
+    return finder.findMultipleSequential(count,first);
+  }
+
+
+  /*
+   * The first cluster of a file and the number of runs of contiguous clusters in it
+   */
+
+  void getLayout(FatFileSystem& fs,const char *filename,uint32_t& firstCluster,uint32_t& fragments) {
+
+    uint32_t cluster,next;
+    File *file;
+
+    firstCluster=fragments=0;
+
+    if(!fs.openFile(filename,file)) {
+      HOSTTEST_CHECK(!"open");
+      return;
+    }
+
+    const DirectoryEntry& dirent(static_cast<FatFile *>(file)->getDirectoryEntryWithLocation().Dirent);
+
+    firstCluster=cluster=dirent.sdir.DIR_FstClusLO | (static_cast<uint32_t>(dirent.sdir.DIR_FstClusHI) << 16);
+    fragments=1;
+
+    while(fs.readFatEntry(cluster,next) && !fs.isEndOfClusterChainMarker(next)) {
+
+      if(next!=cluster+1)
+        fragments++;
+
+      cluster=next;
+    }
+
+    delete file;
+  }
+
+
+  bool writeFile(FatFileSystem& fs,const char *filename,uint32_t pieceSize) {
+
+    std::vector<uint8_t> data(FILE_CLUSTERS*CLUSTER_SIZE);
+    uint32_t offset;
+    File *file;
+    bool ok;
+
+    FatImage::fill(&data[0],0,0,data.size());
+
+    if(!fs.createFile(filename) || !fs.openFile(filename,file))
+      return false;
+
+    for(ok=true,offset=0;ok && offset<data.size();offset+=pieceSize)
+      ok=file->write(&data[offset],pieceSize);
+
+    delete file;
+    return ok;
+  }
+
+
+  /*
+   * The bitmap built at mount is the smallest that fits and has the right free count
+   */
+
+  void testMountBudget() {
+
+    MemoryBlockDevice device(SECTORS);
+    std::unique_ptr<FatFileSystem> fs;
+    uint32_t numEntries,clustersPerBit,units,multiplier,scanned;
+    FreeClusterBitmap *bitmap;
+
+    delete FatImage::format(device,true);
+
+    fs.reset(FatImage::mount(device));
+    HOSTTEST_CHECK(fs && fs->getFreeClusterBitmap()==nullptr);
+    HOSTTEST_CHECK(fs->getFreeSpace(scanned,multiplier));
+
+    numEntries=fs->getCountOfClusters()+2;
+
+    for(uint32_t budget : { 4U,64U,512U,(numEntries+7)/8 }) {
+
+      fs.reset(FatImage::mount(device,budget));
+
+      if(!fs || (bitmap=fs->getFreeClusterBitmap())==nullptr) {
+        HOSTTEST_CHECK(!"bitmap");
+        continue;
+      }
+
+      clustersPerBit=bitmap->getClustersPerBit();
+
+      // fits in whole words, and half the group size would not
+
+      HOSTTEST_CHECK(((numEntries+clustersPerBit-1)/clustersPerBit+31)/32*4<=(budget+3)/4*4);
+      HOSTTEST_CHECK(clustersPerBit==1 || (numEntries+clustersPerBit/2-1)/(clustersPerBit/2)>(budget+3)/4*32);
+
+      HOSTTEST_CHECK(bitmap->isExact()==(budget==(numEntries+7)/8));
+      HOSTTEST_CHECK(fs->getFreeSpace(units,multiplier) && units==scanned);
+    }
+  }
+
+
+  /*
+   * Runs are found from the hint, don't join across the wrap and can straddle the hint. On
+   * FAT16 the first data cluster is free, on FAT32 it's the root directory.
+   */
+
+  void testRuns(bool fat32,uint32_t clustersPerBit) {
+
+    MemoryBlockDevice device(SECTORS);
+    std::unique_ptr<FatFileSystem> fs(FatImage::format(device,fat32));
+    uint32_t first,firstFree,middle,last;
+
+    if(!fs || !fs->enableFreeClusterBitmap(clustersPerBit)) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    last=fs->getCountOfClusters()+1;
+    middle=last/2;
+    firstFree=fat32 ? 3 : 2;
+
+    fill(*fs);
+
+    if(!fat32)
+      HOSTTEST_CHECK(fs->writeFatEntry(2,fs->getEndOfClusterChainMarker()));
+
+    freeRun(*fs,firstFree,2);
+    freeRun(*fs,1000,5);
+    freeRun(*fs,middle,20);
+    freeRun(*fs,last-2,3);
+
+    HOSTTEST_CHECK(findRun(*fs,2,5,first) && first==1000);
+    HOSTTEST_CHECK(findRun(*fs,2,6,first) && first==middle);
+    HOSTTEST_CHECK(findRun(*fs,1003,5,first) && first==middle);
+    HOSTTEST_CHECK(findRun(*fs,middle+100,5,first) && first==1000);
+    HOSTTEST_CHECK(findRun(*fs,middle+10,20,first) && first==middle);
+    HOSTTEST_CHECK(findRun(*fs,last-2,3,first) && first==last-2);
+    HOSTTEST_CHECK(findRun(*fs,last-2,2,first) && first==last-2);
+    HOSTTEST_CHECK(findRun(*fs,last,2,first) && first==firstFree);
+
+    // the 3 at the end and the 2 at the start are not a run of 4
+
+    HOSTTEST_CHECK(findRun(*fs,last-2,4,first) && first==1000);
+
+    HOSTTEST_CHECK(!findRun(*fs,2,21,first));
+    HOSTTEST_CHECK(errorProvider.isLastError(ErrorProvider::ERROR_PROVIDER_FREE_CLUSTER_FINDER,FreeClusterFinder::E_NO_FREE_CLUSTERS));
+    HOSTTEST_CHECK(!findRun(*fs,2,last,first));
+  }
+
+
+  /*
+   * A new file starts at the next free hint and not at the first free cluster, and the hint
+   * survives a remount in FSInfo
+   */
+
+  void testNextFreeHint() {
+
+    MemoryBlockDevice device(SECTORS);
+    std::unique_ptr<FatFileSystem> fs(FatImage::format(device,true));
+    uint32_t cluster,firstCluster,fragments,bitmapBytes;
+
+    if(!fs || !fs->enableFreeClusterBitmap(1)) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    for(cluster=3;cluster<1000;cluster++)
+      HOSTTEST_CHECK(fs->writeFatEntry(cluster,fs->getEndOfClusterChainMarker()));
+
+    freeRun(*fs,10,10);
+
+    HOSTTEST_CHECK(writeFile(*fs,"/first.bin",CLUSTER_SIZE));
+    getLayout(*fs,"/first.bin",firstCluster,fragments);
+    HOSTTEST_CHECK(firstCluster==1000);
+
+    bitmapBytes=(fs->getCountOfClusters()+2+7)/8;
+
+    fs.reset();
+    fs.reset(FatImage::mount(device,bitmapBytes));
+
+    HOSTTEST_CHECK(fs && writeFile(*fs,"/second.bin",CLUSTER_SIZE));
+    getLayout(*fs,"/second.bin",firstCluster,fragments);
+    HOSTTEST_CHECK(firstCluster==1000+FILE_CLUSTERS);
+  }
+
+
+  /*
+   * The first part of the volume has a free cluster every HOLE_SPACING and the rest is free.
+   * With an exact bitmap a write of the whole file goes after the holes in one run. Writes of
+   * a cluster at a time, and writes with a coarse bitmap, fill the holes from the hint.
+   */
+
+  void testAllocation(uint32_t clustersPerBit,uint32_t pieceSize) {
+
+    MemoryBlockDevice device(SECTORS);
+    std::unique_ptr<FatFileSystem> fs(FatImage::format(device,true));
+    uint32_t cluster,holesEnd,firstCluster,fragments;
+    bool wholeRun;
+
+    if(!fs || !fs->enableFreeClusterBitmap(clustersPerBit)) {
+      HOSTTEST_CHECK(!"mount");
+      return;
+    }
+
+    holesEnd=fs->getCountOfClusters()/2;
+
+    for(cluster=holesEnd-1;cluster>2;cluster--)
+      if(cluster % HOLE_SPACING)
+        HOSTTEST_CHECK(fs->writeFatEntry(cluster,fs->getEndOfClusterChainMarker()));
+
+    HOSTTEST_CHECK(writeFile(*fs,"/file.bin",pieceSize));
+    getLayout(*fs,"/file.bin",firstCluster,fragments);
+
+    wholeRun=clustersPerBit==1 && pieceSize>CLUSTER_SIZE;
+
+    if(wholeRun) {
+      HOSTTEST_CHECK(firstCluster>=holesEnd);
+      HOSTTEST_CHECK(fragments==1);
+    }
+    else {
+      HOSTTEST_CHECK(firstCluster<holesEnd && firstCluster % HOLE_SPACING==0);
+      HOSTTEST_CHECK(fragments>1);
+    }
+  }
+}
+
+
+int main() {
+
+  testMountBudget();
+
+  testNextFreeHint();
+
+  for(uint32_t clustersPerBit : { 1,16 }) {
+    testRuns(false,clustersPerBit);
+    testRuns(true,clustersPerBit);
+    testAllocation(clustersPerBit,FILE_CLUSTERS*CLUSTER_SIZE);
+    testAllocation(clustersPerBit,CLUSTER_SIZE);
+  }
+
+  return hosttest::result("FreeClusterFinderTest");
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Terminal throughput. Bursts of 1KB of log output are written to a terminal on an
+ * in-memory panel, with hardware and software scrolling, in a tall and a short font, in one
+ * write() per burst and one character at a time. The panel operations per 1KB are counted
+ * and turned into a character rate on a model of a 16 bit FSMC panel:
+ *
+ *   - setting one axis of a window is a register write and three data writes (4 bus cycles)
+ *   - starting a GRAM write is one register write (1 bus cycle)
+ *   - each pixel is one data write (1 bus cycle)
+ *   - a bus cycle takes 100ns
+ *
+ * The time spent in smooth scrolling delays is added to the bus time. Whatever the size of
+ * the writes, the terminal must end up showing the same thing, and the benchmark fails if
+ * writing a character at a time looks different to writing whole bursts.
+ */
+
+#include "config/stm32plus.h"
+#include "config/display/tft.h"
+#include "MemoryPanel.h"
+
+#include <chrono>
+
+
+using namespace stm32plus;
+using namespace stm32plus::display;
+
+
+namespace {
+
+  enum {
+    BURST_SIZE = 1024,
+    BURSTS = 20
+  };
+
+  const double BUS_CYCLE_MS=100e-6;
+
+
+  /*
+   * 1KB of kernel-log style lines
+   */
+
+  std::string getBurst() {
+
+    std::string burst;
+    char line[80];
+    int i;
+
+    for(i=0;burst.size()<BURST_SIZE;i++) {
+      sprintf(line,"[%6d] eth: rx %d tx %d err 0\n",i*37,i*1234,i*4321);
+      burst+=line;
+    }
+
+    return burst.substr(0,BURST_SIZE);
+  }
+
+
+  struct Result {
+    std::vector<uint16_t> Visible;
+    double CharactersPerSecond;
+  };
+
+
+  template<bool THardwareScrolling>
+  Result run(const char *name,const Font& font,bool characterAtATime) {
+
+    typedef GraphicTerminal<MemoryGraphicsLibrary,THardwareScrolling> Terminal;
+
+    MemoryPanelAccessMode accessMode;
+    MemoryGraphicsLibrary gl(accessMode);
+    std::string burst;
+    uint32_t i,startTime;
+    double axes,writes,pixels,scrolls,delay,busTime;
+    Result result;
+
+    gl.setForeground(ColourNames::WHITE);
+    gl.setBackground(ColourNames::BLACK);
+
+    Terminal terminal(gl,&font,false);
+    terminal.clearScreen();
+
+    burst=getBurst();
+
+    gl.resetCounters();
+    startTime=MillisecondTimer::millis();
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<BURSTS;i++) {
+
+      if(characterAtATime) {
+        for(char c : burst)
+          terminal << c;
+      }
+      else
+        terminal.write(burst.data(),burst.size());
+    }
+
+    std::chrono::duration<double,std::milli> elapsed=std::chrono::steady_clock::now()-start;
+
+    axes=gl.getCounters().AxisChanges/static_cast<double>(BURSTS);
+    writes=gl.getCounters().Writes/static_cast<double>(BURSTS);
+    pixels=gl.getCounters().Pixels/static_cast<double>(BURSTS);
+    scrolls=gl.getCounters().Scrolls/static_cast<double>(BURSTS);
+    delay=MillisecondTimer::difference(startTime)/static_cast<double>(BURSTS);
+
+    busTime=(axes*4+writes+pixels)*BUS_CYCLE_MS;
+
+    result.Visible=gl.getVisible();
+    result.CharactersPerSecond=BURST_SIZE/((busTime+delay)/1000);
+
+    printf("%-24s %8.0f %8.0f %8.0f %7.0f %7.0f %8.2f %10.0f %9.3f\n",
+           name,
+           axes,
+           writes,
+           pixels,
+           scrolls,
+           delay,
+           busTime,
+           result.CharactersPerSecond,
+           elapsed.count()/BURSTS);
+
+    return result;
+  }
+
+
+  template<bool THardwareScrolling>
+  bool compare(const char *name,const Font& font) {
+
+    std::string bulkName,characterName;
+    Result bulk,character;
+
+    bulkName=std::string(name)+" write";
+    characterName=std::string(name)+" per char";
+
+    bulk=run<THardwareScrolling>(bulkName.c_str(),font,false);
+    character=run<THardwareScrolling>(characterName.c_str(),font,true);
+
+    if(bulk.Visible!=character.Visible) {
+      printf("%s: the screen differs when written a character at a time\n",name);
+      return false;
+    }
+
+    return true;
+  }
+}
+
+
+int main() {
+
+  Font_ATARIST8X16SYSTEMFONT16 atari;
+  Font_APPLE8 apple;
+  bool ok;
+
+  printf("%-24s %8s %8s %8s %7s %7s %8s %10s %9s\n","per 1KB","axes","writes","pixels","scrolls","delayms","bus ms","chars/s","host ms");
+
+  ok=compare<true>("hw scroll atari",atari);
+  ok&=compare<true>("hw scroll apple",apple);
+  ok&=compare<false>("sw scroll atari",atari);
+  ok&=compare<false>("sw scroll apple",apple);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the chunked transfer encoding stream. Bodies of several sizes are encoded by
+ * reading them through the stream with every read size from 1 to 4096 bytes, and from a
+ * wrapped stream that hands out a few bytes at a time. What comes out must be well formed
+ * chunked encoding that decodes back to the body, with nothing after the last chunk.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "HostTest.h"
+
+#include <string>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    MAX_READ_SIZE = 4096
+  };
+
+  const uint32_t BODY_SIZES[]={ 0,1,11,12,15,16,255,256,1000,5000,70000 };
+
+
+  /*
+   * A stream that gives out no more than a few bytes for each read, like a file read a
+   * sector at a time or a sensor that has a little data each time it's asked
+   */
+
+  class TrickleInputStream : public ByteArrayInputStream {
+
+    protected:
+      uint32_t _maxRead;
+
+    public:
+      TrickleInputStream(const void *data,uint32_t size,uint32_t maxRead)
+        : ByteArrayInputStream(data,size),
+          _maxRead(maxRead) {
+      }
+
+      virtual bool read(void *buffer,uint32_t size,uint32_t& actuallyRead) override {
+        return ByteArrayInputStream::read(buffer,std::min(size,_maxRead),actuallyRead);
+      }
+  };
+
+
+  /*
+   * Decode chunked encoding strictly. Every chunk is a hex size, CRLF, the data and CRLF,
+   * and the last one has a size of zero and no data.
+   * @return true if all of the encoded data is exactly one well formed body
+   */
+
+  bool decode(const std::string& encoded,std::string& decoded) {
+
+    size_t pos,digits;
+    uint32_t size;
+    char c;
+
+    decoded.clear();
+
+    for(pos=0;;) {
+
+      for(size=digits=0;pos<encoded.length() && isxdigit(c=encoded[pos]);pos++,digits++)
+        size=(size << 4) | (c<='9' ? c-'0' : (c|0x20)-'a'+10);
+
+      if(digits==0 || encoded.compare(pos,2,"\r\n")!=0)
+        return false;
+
+      pos+=2;
+
+      if(size==0)
+        return encoded.compare(pos,std::string::npos,"\r\n")==0;
+
+      if(pos+size+2>encoded.length() || encoded.compare(pos+size,2,"\r\n")!=0)
+        return false;
+
+      decoded.append(encoded,pos,size);
+      pos+=size+2;
+    }
+  }
+
+
+  /*
+   * Read the whole of the stream in reads of the same size
+   */
+
+  bool readAll(InputStream& is,uint32_t readSize,std::string& encoded) {
+
+    char buffer[MAX_READ_SIZE];
+    uint32_t actuallyRead;
+
+    encoded.clear();
+
+    do {
+
+      if(!is.read(buffer,readSize,actuallyRead) || actuallyRead>readSize)
+        return false;
+
+      encoded.append(buffer,actuallyRead);
+
+    } while(actuallyRead);
+
+    // the end must stay the end
+
+    return !is.available() && is.read(buffer,readSize,actuallyRead) && actuallyRead==0;
+  }
+
+
+  /*
+   * Every body at every read size from a stream that gives everything asked for
+   */
+
+  void testReadSizes(const std::string& body) {
+
+    std::string encoded,decoded;
+    uint32_t readSize;
+    bool ok;
+
+    for(readSize=1;readSize<=MAX_READ_SIZE;readSize++) {
+
+      HttpChunkedInputStream is(new ByteArrayInputStream(body.c_str(),body.length()),true);
+
+      ok=readAll(is,readSize,encoded) && decode(encoded,decoded) && decoded==body;
+
+      if(!ok)
+        fprintf(stderr,"body size %u, read size %u\n",static_cast<unsigned>(body.length()),readSize);
+
+      HOSTTEST_CHECK(ok);
+    }
+  }
+
+
+  /*
+   * Short reads from the wrapped stream make small chunks of varying size
+   */
+
+  void testShortReads(const std::string& body) {
+
+    static const uint32_t maxReads[]={ 1,3,11,12,100 };
+    static const uint32_t readSizes[]={ 1,5,16,17,64,1460 };
+
+    std::string encoded,decoded;
+
+    for(uint32_t maxRead : maxReads) {
+      for(uint32_t readSize : readSizes) {
+
+        HttpChunkedInputStream is(new TrickleInputStream(body.c_str(),body.length(),maxRead),true);
+
+        HOSTTEST_CHECK(readAll(is,readSize,encoded));
+        HOSTTEST_CHECK(decode(encoded,decoded) && decoded==body);
+      }
+    }
+  }
+
+
+  /*
+   * The single byte read
+   */
+
+  void testSingleBytes(const std::string& body) {
+
+    std::string encoded,decoded;
+    int16_t c;
+
+    HttpChunkedInputStream is(new ByteArrayInputStream(body.c_str(),body.length()),true);
+
+    while((c=is.read())>=0)
+      encoded+=static_cast<char>(c);
+
+    HOSTTEST_CHECK(c==InputStream::E_END_OF_STREAM);
+    HOSTTEST_CHECK(decode(encoded,decoded) && decoded==body);
+  }
+}
+
+
+int main() {
+
+  std::string body;
+  uint32_t i,seed;
+
+  for(uint32_t size : BODY_SIZES) {
+
+    body.resize(size);
+
+    for(i=0,seed=size;i<size;i++) {
+      seed=seed*1103515245+12345;
+      body[i]=seed >> 16;
+    }
+
+    testReadSizes(body);
+    testShortReads(body);
+
+    if(size<=5000)
+      testSingleBytes(body);
+  }
+
+  return hosttest::result("HttpChunkedInputStreamTest");
+}
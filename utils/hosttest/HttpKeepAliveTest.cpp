@@ -0,0 +1,590 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for HTTP/1.1 persistent connections. An HTTP server on the memory network answers a
+ * scripted client. The client pipelines five requests in one segment: a GET, a POST with a
+ * body, a GET with a chunked response, a GET with "Connection: keep-alive, Close" and one
+ * after that. The first four must be answered in order and the connection closed before
+ * the fifth. Then the HTTP/1.0 fallback, the limit on requests per connection, the switch
+ * between the server's idle timeout and the keep-alive timeout, and the metrics.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "MemoryNetwork.h"
+#include "HttpResponseReader.h"
+#include "HostTest.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    SERVER_PORT = 80,
+    IDLE_TIMEOUT = 1000,
+    KEEP_ALIVE_TIMEOUT = 200,
+    TIMEOUT = 5000
+  };
+
+  const char HELLO[]="Hello from the memory network\n";
+  const char POSTED[]="interval=30&units=metric";
+
+  std::string Report;
+
+
+  /*
+   * A request body is appended to a string
+   */
+
+  class StringOutputStream : public OutputStream {
+
+    public:
+      std::string Data;
+
+    public:
+      virtual bool write(uint8_t c) override {
+        Data+=static_cast<char>(c);
+        return true;
+      }
+
+      virtual bool write(const void *buffer,uint32_t size) override {
+        Data.append(static_cast<const char *>(buffer),size);
+        return true;
+      }
+
+      virtual bool flush() override {
+        return true;
+      }
+
+      virtual bool close() override {
+        return true;
+      }
+  };
+
+
+  /*
+   * The server's connection. /hello.txt has a fixed length, /echo answers with the request
+   * body and /report is of unknown length. Each new server takes the settings at the time.
+   */
+
+  class KeepAliveConnection : public HttpServerConnection<KeepAliveConnection> {
+
+    public:
+      struct Parameters : HttpServerConnection<KeepAliveConnection>::Parameters {
+        Parameters() {
+          http_version11=Version11;
+          http_maxRequestsPerConnection=MaxRequests;
+          http_keepAliveTimeout=KEEP_ALIVE_TIMEOUT;
+          http_metrics=&Metrics;
+        }
+      };
+
+      static bool Version11;
+      static uint16_t MaxRequests;
+      static HttpServerMetrics Metrics;
+
+    protected:
+      StringOutputStream _body;
+
+    protected:
+      void processRequest();
+
+    public:
+      KeepAliveConnection(const Parameters& params)
+        : HttpServerConnection<KeepAliveConnection>(params) {
+      }
+
+      bool handleClosed() {
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+
+      State handleStateChange(State newState) {
+
+        if(newState==State::READING_REQUEST_BODY) {
+          _body.Data.clear();
+          _requestBody=&_body;
+        }
+        else if(newState==State::READING_REQUEST_LINE)
+          _requestBody=nullptr;
+        else if(newState==State::WRITING_RESPONSE)
+          processRequest();
+
+        return newState;
+      }
+
+      void handleRequestHeader(const std::string&) {
+      }
+  };
+
+  bool KeepAliveConnection::Version11=true;
+  uint16_t KeepAliveConnection::MaxRequests=100;
+  HttpServerMetrics KeepAliveConnection::Metrics;
+
+
+  void KeepAliveConnection::processRequest() {
+
+    std::string *response;
+
+    response=new std::string(_version+" 200 OK\r\n");
+    addContentTypeHeader(*response,"text/plain");
+
+    if(_uri=="/report") {
+
+      addUnknownLengthHeaders(*response);
+      (*response)+="\r\n";
+
+      _output.addStream(new StlStringInputStream(response,true),true);
+      addUnknownLengthStream(new ByteArrayInputStream(Report.c_str(),Report.length()),true);
+    }
+    else {
+
+      addConnectionHeader(*response);
+
+      if(_uri=="/echo") {
+        addContentLengthHeader(*response,_body.Data.length());
+        (*response)+="\r\n";
+        (*response)+=_body.Data;
+      }
+      else {
+        addContentLengthHeader(*response,sizeof(HELLO)-1);
+        (*response)+="\r\n";
+        (*response)+=HELLO;
+      }
+
+      _output.addStream(new StlStringInputStream(response,true),true);
+    }
+  }
+
+
+  /*
+   * A server with the connection settings at the time and the array that runs it
+   */
+
+  class Server {
+
+    protected:
+      TcpServer<KeepAliveConnection> *_server;
+      scoped_ptr<TcpConnectionArray<KeepAliveConnection>> _connections;
+
+    public:
+      Server(MemoryNetwork& network,uint16_t port);
+      ~Server();
+
+      bool isCreated() const;
+      void serve(uint32_t millis);
+  };
+
+
+  Server::Server(MemoryNetwork& network,uint16_t port) {
+
+    _server=nullptr;
+    network.getStack().tcpCreateServer(port,_server);
+
+    if(_server) {
+      _connections.reset(new TcpConnectionArray<KeepAliveConnection>(*_server));
+      _server->start();
+    }
+  }
+
+
+  Server::~Server() {
+    _connections.reset();
+    delete _server;
+  }
+
+
+  bool Server::isCreated() const {
+    return _server!=nullptr;
+  }
+
+
+  void Server::serve(uint32_t millis) {
+    _connections->wait(TcpWaitState::WRITE | TcpWaitState::READ | TcpWaitState::CLOSED,millis);
+  }
+
+
+  /*
+   * A client connected to the server
+   */
+
+  class Client {
+
+    protected:
+      Server& _server;
+      MemoryTcpPeer _peer;
+
+    public:
+      Client(MemoryNetwork& network,Server& server,uint16_t serverPort,uint16_t port);
+
+      void send(const std::string& text);
+      bool readResponses(std::vector<HttpResponse>& responses,uint32_t count,bool closed);
+      bool waitForClose(uint32_t timeout);
+      void close();
+  };
+
+
+  Client::Client(MemoryNetwork& network,Server& server,uint16_t serverPort,uint16_t port)
+    : _server(server),
+      _peer(network,"192.168.0.20",port) {
+
+    _peer.connect(serverPort);
+    _server.serve(10);
+  }
+
+
+  void Client::send(const std::string& text) {
+    _peer.send(text);
+  }
+
+
+  /*
+   * Run the server until this many responses have arrived, and if closed is set then until
+   * the server has closed the connection as well. Anything more is a failure.
+   */
+
+  bool Client::readResponses(std::vector<HttpResponse>& responses,uint32_t count,bool closed) {
+
+    HttpResponse response;
+    uint32_t pos,size,waited;
+
+    for(waited=0;waited<TIMEOUT;waited++) {
+
+      responses.clear();
+
+      for(pos=0;(size=readHttpResponse(_peer.getReceived().substr(pos),false,response,_peer.isRemoteClosed()))!=0;pos+=size)
+        responses.push_back(response);
+
+      if(responses.size()>=count && (!closed || _peer.isRemoteClosed()))
+        break;
+
+      _server.serve(1);
+    }
+
+    _server.serve(10);
+    return responses.size()==count && pos==_peer.getReceived().length() && closed==_peer.isRemoteClosed();
+  }
+
+
+  /*
+   * Run the server until it closes the connection
+   * @return true if it closed within the time
+   */
+
+  bool Client::waitForClose(uint32_t timeout) {
+
+    uint32_t start;
+
+    start=MillisecondTimer::millis();
+
+    while(!_peer.isRemoteClosed() && MillisecondTimer::millis()-start<timeout)
+      _server.serve(1);
+
+    return _peer.isRemoteClosed();
+  }
+
+
+  void Client::close() {
+    _peer.close();
+    _server.serve(10);
+  }
+
+
+  std::string get(const char *uri,const char *headers="",const char *version="HTTP/1.1") {
+    return std::string("GET ")+uri+" "+version+"\r\nHost: 192.168.0.10\r\n"+headers+"\r\n";
+  }
+
+
+  /*
+   * The scripted client: five requests pipelined in one segment
+   */
+
+  void testPipelined(MemoryNetwork& network) {
+
+    std::vector<HttpResponse> responses;
+
+    KeepAliveConnection::Metrics.reset();
+
+    Server server(network,SERVER_PORT);
+    HOSTTEST_CHECK(server.isCreated());
+
+    Client client(network,server,SERVER_PORT,50000);
+
+    client.send(get("/hello.txt")+
+                "POST /echo HTTP/1.1\r\nHost: 192.168.0.10\r\nContent-Length: "+std::to_string(sizeof(POSTED)-1)+"\r\n\r\n"+POSTED+
+                get("/report")+
+                get("/hello.txt","Connection: keep-alive, Close\r\n")+
+                get("/hello.txt"));
+
+    HOSTTEST_CHECK(client.readResponses(responses,4,true));
+
+    if(responses.size()!=4)
+      return;
+
+    HOSTTEST_CHECK(responses[0].StatusLine=="HTTP/1.1 200 OK");
+    HOSTTEST_CHECK(responses[0].getHeader("Connection")=="keep-alive");
+    HOSTTEST_CHECK(responses[0].Body==HELLO);
+
+    HOSTTEST_CHECK(responses[1].getHeader("Connection")=="keep-alive");
+    HOSTTEST_CHECK(responses[1].Body==POSTED);
+
+    HOSTTEST_CHECK(responses[2].getHeader("Transfer-Encoding")=="chunked");
+    HOSTTEST_CHECK(responses[2].getHeader("Connection")=="keep-alive");
+    HOSTTEST_CHECK(!responses[2].hasHeader("Content-Length"));
+    HOSTTEST_CHECK(responses[2].Body==Report);
+
+    HOSTTEST_CHECK(responses[3].getHeader("Connection")=="close");
+    HOSTTEST_CHECK(responses[3].Body==HELLO);
+
+    // three requests had arrived when the response before them finished
+
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.connections==1);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requests==4);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.pipelinedRequests==3);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.reusedConnections==1);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.idleCloses==0);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.maxRequestsPerConnection==4);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requestsPerConnection[3]==1);
+  }
+
+
+  /*
+   * A request body that arrives in pieces, with the next request behind it
+   */
+
+  void testSplitBody(MemoryNetwork& network) {
+
+    std::vector<HttpResponse> responses;
+    std::string request;
+
+    Server server(network,SERVER_PORT);
+    Client client(network,server,SERVER_PORT,50009);
+
+    request="POST /echo HTTP/1.1\r\nHost: 192.168.0.10\r\nContent-Length: "+std::to_string(sizeof(POSTED)-1)+"\r\n\r\n"+POSTED;
+
+    client.send(request.substr(0,request.length()-15));
+    HOSTTEST_CHECK(client.readResponses(responses,0,false));
+
+    client.send(request.substr(request.length()-15,10));
+    HOSTTEST_CHECK(client.readResponses(responses,0,false));
+
+    client.send(request.substr(request.length()-5)+get("/hello.txt"));
+    HOSTTEST_CHECK(client.readResponses(responses,2,false));
+    HOSTTEST_CHECK(responses.size()==2 && responses[0].Body==POSTED && responses[1].Body==HELLO);
+
+    client.close();
+  }
+
+
+  /*
+   * An HTTP/1.0 client, or a server that doesn't do HTTP/1.1, gets one response that isn't
+   * chunked and the connection is closed after it
+   */
+
+  void testVersion10(MemoryNetwork& network) {
+
+    std::vector<HttpResponse> responses;
+
+    Server server(network,SERVER_PORT);
+
+    {
+      Client client(network,server,SERVER_PORT,50001);
+
+      client.send(get("/report","","HTTP/1.0")+get("/hello.txt","","HTTP/1.0"));
+
+      HOSTTEST_CHECK(client.readResponses(responses,1,true));
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].StatusLine=="HTTP/1.0 200 OK");
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].getHeader("Connection")=="close");
+      HOSTTEST_CHECK(responses.size()==1 && !responses[0].hasHeader("Transfer-Encoding"));
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].Body==Report);
+    }
+
+    {
+      Client client(network,server,SERVER_PORT,50002);
+
+      client.send(get("/hello.txt","Connection: keep-alive\r\n","HTTP/1.0")+get("/hello.txt","","HTTP/1.0"));
+
+      HOSTTEST_CHECK(client.readResponses(responses,1,true));
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].getHeader("Connection")=="close");
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].Body==HELLO);
+    }
+
+    KeepAliveConnection::Version11=false;
+
+    {
+      Server server10(network,SERVER_PORT+1);
+      Client client(network,server10,SERVER_PORT+1,50003);
+
+      client.send(get("/report")+get("/hello.txt"));
+
+      HOSTTEST_CHECK(client.readResponses(responses,1,true));
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].StatusLine=="HTTP/1.1 200 OK");
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].getHeader("Connection")=="close");
+      HOSTTEST_CHECK(responses.size()==1 && !responses[0].hasHeader("Transfer-Encoding"));
+      HOSTTEST_CHECK(responses.size()==1 && responses[0].Body==Report);
+    }
+
+    KeepAliveConnection::Version11=true;
+  }
+
+
+  /*
+   * The last request that the limit allows is answered with Connection: close
+   */
+
+  void testMaxRequests(MemoryNetwork& network) {
+
+    std::vector<HttpResponse> responses;
+    std::string requests;
+    uint32_t i;
+
+    KeepAliveConnection::MaxRequests=3;
+    KeepAliveConnection::Metrics.reset();
+
+    Server server(network,SERVER_PORT);
+    Client client(network,server,SERVER_PORT,50004);
+
+    for(i=0;i<5;i++)
+      requests+=get("/hello.txt");
+
+    client.send(requests);
+
+    HOSTTEST_CHECK(client.readResponses(responses,3,true));
+
+    for(i=0;i<responses.size();i++) {
+      HOSTTEST_CHECK(responses[i].getHeader("Connection")==(i==2 ? "close" : "keep-alive"));
+      HOSTTEST_CHECK(responses[i].Body==HELLO);
+    }
+
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requests==3);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.maxRequestsPerConnection==3);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requestsPerConnection[2]==1);
+
+    KeepAliveConnection::MaxRequests=100;
+  }
+
+
+  /*
+   * Before the first request the server's idle timeout applies. Between requests it's the
+   * shorter keep-alive timeout, and once the next request has started it's the server's
+   * again.
+   */
+
+  void testIdleTimeouts(MemoryNetwork& network) {
+
+    std::vector<HttpResponse> responses;
+    uint32_t start,elapsed;
+
+    KeepAliveConnection::Metrics.reset();
+
+    Server server(network,SERVER_PORT);
+
+    {
+      Client client(network,server,SERVER_PORT,50005);
+
+      // a new connection isn't subject to the keep-alive timeout
+
+      HOSTTEST_CHECK(!client.waitForClose(KEEP_ALIVE_TIMEOUT*2));
+
+      client.send(get("/hello.txt"));
+      HOSTTEST_CHECK(client.readResponses(responses,1,false));
+
+      // but an idle one is
+
+      start=MillisecondTimer::millis();
+      HOSTTEST_CHECK(client.waitForClose(IDLE_TIMEOUT));
+      elapsed=MillisecondTimer::millis()-start;
+
+      HOSTTEST_CHECK(elapsed>=KEEP_ALIVE_TIMEOUT-20 && elapsed<=KEEP_ALIVE_TIMEOUT+50);
+      HOSTTEST_CHECK(KeepAliveConnection::Metrics.idleCloses==1);
+      HOSTTEST_CHECK(KeepAliveConnection::Metrics.connections==1);
+      HOSTTEST_CHECK(KeepAliveConnection::Metrics.pipelinedRequests==0);
+    }
+
+    {
+      Client client(network,server,SERVER_PORT,50006);
+
+      client.send(get("/hello.txt"));
+      HOSTTEST_CHECK(client.readResponses(responses,1,false));
+
+      // a slow request isn't closed at the keep-alive timeout
+
+      client.send("GET /hello.txt HTTP/1.1\r\n");
+      HOSTTEST_CHECK(!client.waitForClose(KEEP_ALIVE_TIMEOUT*2));
+
+      client.send("Host: 192.168.0.10\r\n\r\n");
+      HOSTTEST_CHECK(client.readResponses(responses,2,false));
+
+      // the client closes
+
+      client.close();
+      HOSTTEST_CHECK(client.waitForClose(100));
+    }
+
+    // a request line that stops part way keeps the keep-alive timeout but it's not an idle close
+
+    {
+      Client client(network,server,SERVER_PORT,50007);
+
+      client.send(get("/hello.txt"));
+      HOSTTEST_CHECK(client.readResponses(responses,1,false));
+
+      client.send("GET /hel");
+      HOSTTEST_CHECK(client.waitForClose(KEEP_ALIVE_TIMEOUT*2));
+    }
+
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.connections==3);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.idleCloses==1);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requests==4);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requestsPerConnection[1]==2);
+    HOSTTEST_CHECK(KeepAliveConnection::Metrics.requestsPerConnection[2]==1);
+
+    // the server's own timeout still closes a connection that never sends anything
+
+    {
+      Client client(network,server,SERVER_PORT,50008);
+
+      start=MillisecondTimer::millis();
+      HOSTTEST_CHECK(client.waitForClose(IDLE_TIMEOUT*2));
+      elapsed=MillisecondTimer::millis()-start;
+
+      HOSTTEST_CHECK(elapsed>=IDLE_TIMEOUT-20 && elapsed<=IDLE_TIMEOUT+50);
+    }
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  uint32_t i;
+
+  // a report long enough to go out in several chunks
+
+  for(i=0;i<100;i++)
+    Report+="sensor "+std::to_string(i)+": "+std::to_string(i*37%1000)+"\n";
+
+  network.getParameters().tcp_idleConnectionTimeout=IDLE_TIMEOUT;
+  HOSTTEST_CHECK(network.initialise());
+
+  testPipelined(network);
+  testSplitBody(network);
+  testVersion10(network);
+  testMaxRequests(network);
+  testIdleTimeouts(network);
+
+  return hosttest::result("HttpKeepAliveTest");
+}
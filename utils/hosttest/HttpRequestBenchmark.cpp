@@ -0,0 +1,490 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * HTTP request line and header parsing on the captured requests. The old way, which is
+ * copied here, took the request a byte at a time out of the TCP receive buffer with a
+ * receive() call for each one and took the request line apart with std::string substr().
+ * The new way is the HTTP server connection's own, which finds the LF in each contiguous
+ * block of the receive buffer and parses in place.
+ *
+ * The captured GET requests are pipelined into the receive buffer of an accepted connection
+ * in segments of a few sizes, each one read before the next arrives, and parsed both ways.
+ * It prints the requests per second and the heap allocations for each request. The old way
+ * makes a receive() call for every byte. The two must get the same lines and fields out of
+ * every request. The captured POST is left out because the old parser never recognised
+ * its Content-Length.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "MemoryNetwork.h"
+#include "CapturedHttpRequests.h"
+
+#include <chrono>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+/*
+ * Count heap allocations. The library's operator delete frees what malloc() returned.
+ */
+
+namespace {
+  uint32_t Allocations=0;
+}
+
+__attribute__((noinline)) void *operator new(size_t size) {
+
+  void *p;
+
+  Allocations++;
+
+  if((p=malloc(size))==nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+
+namespace {
+
+  enum {
+    RECEIVE_BUFFER_SIZE = 2048,
+    MAX_LINE_LENGTH = 200,
+    REQUESTS = 200000,
+    SERVER_PORT = 80,
+    TIMEOUT = 5000
+  };
+
+  const uint32_t SEGMENT_SIZES[]={ 1,64,536,1460 };
+
+
+  /*
+   * The fields of a parsed request, kept when a connection is recording
+   */
+
+  struct Request {
+    std::string Action;
+    std::string Uri;
+    std::string Version;
+    std::vector<std::string> Headers;
+  };
+
+
+  /*
+   * The old way: a byte at a time through receive(), CR dropped and the line truncated at
+   * the maximum length, then the request line cut up with substr() and decoded into a new
+   * string
+   */
+
+  class ByteRequestParser {
+
+    protected:
+      TcpConnection& _conn;
+      std::string _line;
+      bool _ready;
+      bool _readingHeaders;
+
+      std::string _action;
+      std::string _uri;
+      std::string _version;
+
+      Request _request;
+
+    public:
+      std::vector<Request> Requests;
+      uint32_t RequestCount;
+      bool Record;
+
+    protected:
+      bool add();
+      void parseRequestLine();
+      std::string decodeUri(const std::string& uri);
+
+    public:
+      ByteRequestParser(TcpConnection& conn)
+        : _conn(conn),
+          _ready(false),
+          _readingHeaders(false),
+          RequestCount(0),
+          Record(false) {
+      }
+
+      void handleRead();
+  };
+
+
+  bool ByteRequestParser::add() {
+
+    char c;
+    uint32_t actuallyRead;
+
+    while(_conn.getDataAvailable()) {
+
+      if(!_conn.receive(&c,1,actuallyRead,1) || actuallyRead!=1)
+        return false;
+
+      if(c=='\n') {
+        _ready=true;
+        break;
+      }
+      else if(c!='\r' && _line.length()<MAX_LINE_LENGTH)
+        _line+=c;
+    }
+
+    return true;
+  }
+
+
+  void ByteRequestParser::handleRead() {
+
+    while(_conn.getDataAvailable()) {
+
+      add();
+
+      if(!_ready)
+        continue;
+
+      if(!_readingHeaders) {
+
+        parseRequestLine();
+        _readingHeaders=true;
+
+        if(Record) {
+          _request.Action=_action;
+          _request.Uri=_uri;
+          _request.Version=_version;
+          _request.Headers.clear();
+        }
+      }
+      else if(_line.empty()) {
+
+        // end of the headers
+
+        if(Record)
+          Requests.push_back(_request);
+
+        RequestCount++;
+        _readingHeaders=false;
+      }
+      else if(Record)
+        _request.Headers.push_back(_line);
+
+      _line.clear();
+      _ready=false;
+    }
+  }
+
+
+  void ByteRequestParser::parseRequestLine() {
+
+    std::string::size_type pos,pos2;
+
+    if((pos=_line.find(' '))!=std::string::npos) {
+
+      _action=_line.substr(0,pos);
+
+      if((pos2=_line.find(' ',pos+1))!=std::string::npos) {
+
+        _uri=decodeUri(_line.substr(pos+1,pos2-pos-1));
+        _version=_line.substr(pos2+1);
+
+        if((pos=_uri.find("://"))!=std::string::npos) {
+
+          if((pos=_uri.find('/',pos+3))!=std::string::npos)
+            _uri=_uri.substr(pos);
+          else
+            _uri="/index.html";
+        }
+      }
+    }
+  }
+
+
+  std::string ByteRequestParser::decodeUri(const std::string& uri) {
+
+    std::string ret;
+    std::string::size_type i;
+    uint8_t ch;
+
+    ret.reserve(uri.length());
+
+    for(i=0;i<uri.length();i++) {
+
+      if(uri[i]=='%' && i<=uri.length()-3) {
+
+        ch=((uri[i+1]-'0')*16)+(uri[i+2]-'0');
+        ret+=static_cast<char>(ch);
+        i+=2;
+      }
+      else
+        ret+=uri[i];
+    }
+    return ret;
+  }
+
+
+  /*
+   * The new way: the HTTP server connection, with the response skipped so that it goes
+   * straight on to the next request. Data is put into its receive buffer by inject() as
+   * if it had arrived from the network.
+   */
+
+  class BenchmarkConnection : public HttpServerConnection<BenchmarkConnection> {
+
+    public:
+      struct Parameters : HttpServerConnection<BenchmarkConnection>::Parameters {
+        Parameters() {
+          tcp_receiveBufferSize=RECEIVE_BUFFER_SIZE;
+          http_maxRequestLineLength=MAX_LINE_LENGTH;
+        }
+      };
+
+    protected:
+      Request _request;
+
+    public:
+      std::vector<Request> Requests;
+      uint32_t RequestCount;
+      bool Record;
+      static BenchmarkConnection *Last;
+
+    public:
+      BenchmarkConnection(const Parameters& params)
+        : HttpServerConnection<BenchmarkConnection>(params),
+          RequestCount(0),
+          Record(false) {
+        Last=this;
+      }
+
+      void inject(const char *data,uint32_t size) {
+        _receiveBuffer->write(reinterpret_cast<const uint8_t *>(data),size);
+      }
+
+      bool handleClosed() {
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+
+      State handleStateChange(State newState) {
+
+        if(newState==State::READING_REQUEST_HEADERS) {
+
+          if(Record) {
+            _request.Action=_action;
+            _request.Uri=_uri;
+            _request.Version=_version;
+            _request.Headers.clear();
+          }
+        }
+        else if(newState==State::WRITING_BEGIN) {
+
+          if(Record)
+            Requests.push_back(_request);
+
+          RequestCount++;
+          resetRequest();
+          return State::READING_REQUEST_LINE;
+        }
+
+        return newState;
+      }
+
+      void handleRequestHeader(const std::string& header) {
+        if(Record)
+          _request.Headers.push_back(header);
+      }
+  };
+
+  BenchmarkConnection *BenchmarkConnection::Last=nullptr;
+
+
+  /*
+   * Deliver the requests to the connection in segments, each read as it arrives
+   */
+
+  template<class TReader>
+  void deliver(BenchmarkConnection& conn,TReader& reader,const std::string& data,uint32_t segmentSize) {
+
+    uint32_t pos,size;
+
+    for(pos=0;pos<data.length();pos+=size) {
+      size=std::min<uint32_t>(segmentSize,data.length()-pos);
+      conn.inject(data.c_str()+pos,size);
+      reader.handleRead();
+    }
+  }
+
+
+  bool sameRequests(const std::vector<Request>& a,const std::vector<Request>& b) {
+
+    uint32_t i;
+
+    if(a.size()!=b.size())
+      return false;
+
+    for(i=0;i<a.size();i++)
+      if(a[i].Action!=b[i].Action || a[i].Uri!=b[i].Uri || a[i].Version!=b[i].Version || a[i].Headers!=b[i].Headers)
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * Parse the captured requests both ways and check they agree with each other and the
+   * captures
+   */
+
+  bool verify(BenchmarkConnection& conn,ByteRequestParser& old,const std::string& requests,uint32_t count) {
+
+    uint32_t i,j;
+
+    for(uint32_t segmentSize : SEGMENT_SIZES) {
+
+      conn.Requests.clear();
+      old.Requests.clear();
+      conn.Record=old.Record=true;
+
+      deliver(conn,conn,requests,segmentSize);
+      deliver(conn,old,requests,segmentSize);
+
+      conn.Record=old.Record=false;
+
+      if(conn.Requests.size()!=count || !sameRequests(conn.Requests,old.Requests)) {
+        printf("the two parsers disagree in %u byte segments\n",segmentSize);
+        return false;
+      }
+
+      for(i=j=0;i<CAPTURED_HTTP_REQUEST_COUNT;i++) {
+
+        if(CAPTURED_HTTP_REQUESTS[i].ContentLength)
+          continue;
+
+        if(conn.Requests[j].Uri!=CAPTURED_HTTP_REQUESTS[i].Uri) {
+          printf("%s: got %s\n",CAPTURED_HTTP_REQUESTS[i].Name,conn.Requests[j].Uri.c_str());
+          return false;
+        }
+
+        j++;
+      }
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Time one way of parsing at one segment size. Every request must have been parsed.
+   */
+
+  template<class TReader>
+  bool run(const char *name,BenchmarkConnection& conn,TReader& reader,const std::string& requests,uint32_t count,uint32_t segmentSize) {
+
+    uint32_t i,passes,allocations,parsed;
+
+    passes=REQUESTS/count;
+    allocations=Allocations;
+    parsed=reader.RequestCount;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<passes;i++)
+      deliver(conn,reader,requests,segmentSize);
+
+    std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+
+    printf("%-6s %8u %12.0f %10.0f %12.3f\n",
+           name,
+           segmentSize,
+           passes*count/elapsed.count(),
+           elapsed.count()*1e9/(passes*count),
+           (Allocations-allocations)/(double)(passes*count));
+
+    if(reader.RequestCount-parsed!=passes*count) {
+      printf("%u of %u requests were parsed\n",reader.RequestCount-parsed,passes*count);
+      return false;
+    }
+
+    return true;
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<BenchmarkConnection> *server;
+  std::string requests;
+  uint32_t i,count;
+  bool ok;
+
+  if(!network.initialise()) {
+    printf("The stack did not start\n");
+    return 1;
+  }
+
+  // the server accepts a connection from the peer and the benchmark then drives it directly
+
+  server=nullptr;
+  network.getStack().tcpCreateServer(SERVER_PORT,server);
+
+  if(server==nullptr) {
+    printf("The server was not created\n");
+    return 1;
+  }
+
+  TcpConnectionArray<BenchmarkConnection> connections(*server);
+  server->start();
+
+  MemoryTcpPeer peer(network,"192.168.0.20",50000);
+  peer.connect(SERVER_PORT);
+
+  if(!network.runUntil([&] { return BenchmarkConnection::Last!=nullptr; },TIMEOUT)) {
+    printf("The connection was not accepted\n");
+    return 1;
+  }
+
+  BenchmarkConnection& conn(*BenchmarkConnection::Last);
+  ByteRequestParser old(conn);
+
+  // the GET requests, pipelined
+
+  for(i=count=0;i<CAPTURED_HTTP_REQUEST_COUNT;i++) {
+    if(CAPTURED_HTTP_REQUESTS[i].ContentLength==0) {
+      requests+=CAPTURED_HTTP_REQUESTS[i].Text;
+      count++;
+    }
+  }
+
+  // the timer would service the network on every receive() that the old way makes
+
+  MillisecondTimer::interrupt()=nullptr;
+
+  if(!verify(conn,old,requests,count))
+    return 1;
+
+  printf("%u requests of %.0f bytes on average\n\n",count,requests.length()/(double)count);
+  printf("%-6s %8s %12s %10s %12s\n","parser","segment","requests/s","ns/req","allocs/req");
+
+  ok=true;
+
+  for(uint32_t segmentSize : SEGMENT_SIZES) {
+    ok&=run("byte",conn,old,requests,count,segmentSize);
+    ok&=run("block",conn,conn,requests,count,segmentSize);
+  }
+
+  delete server;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,423 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the bulk line receiver and the in-place HTTP request parser. An HTTP connection
+ * is accepted by a server on the memory network and the requests are then written straight
+ * into its receive buffer, a piece at a time, so that the places where the receive buffer
+ * splits them can be chosen. Every captured request must come out the same however it's
+ * split and whatever runs behind it on the connection. The edge cases are a CR LF split
+ * across two arrivals and across the end of the circular buffer, lines that are longer
+ * than the receiver's limit and escapes in the URI that are cut short.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "MemoryNetwork.h"
+#include "CapturedHttpRequests.h"
+#include "HostTest.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    RECEIVE_BUFFER_SIZE = 512,
+    MAX_LINE_LENGTH = 200,
+    SERVER_PORT = 80,
+    TIMEOUT = 5000
+  };
+
+  const uint32_t SEGMENT_SIZES[]={ 1,2,3,7,64,RECEIVE_BUFFER_SIZE };
+
+
+  /*
+   * What the parser got out of one request
+   */
+
+  struct Request {
+    std::string Action;
+    std::string Uri;
+    std::string Version;
+    std::vector<std::string> Headers;
+    uint32_t ContentLength;
+  };
+
+
+  /*
+   * A connection that keeps the requests it parses instead of answering them. Data is put
+   * into its receive buffer by inject() as if it had arrived from the network.
+   */
+
+  class TestConnection : public HttpServerConnection<TestConnection> {
+
+    public:
+      struct Parameters : HttpServerConnection<TestConnection>::Parameters {
+        Parameters() {
+          tcp_receiveBufferSize=RECEIVE_BUFFER_SIZE;
+          http_maxRequestLineLength=MAX_LINE_LENGTH;
+        }
+      };
+
+    protected:
+      Request _request;
+
+    public:
+      std::vector<Request> Requests;
+      uint32_t Injected;
+      static TestConnection *Last;
+
+    public:
+      TestConnection(const Parameters& params)
+        : HttpServerConnection<TestConnection>(params),
+          Injected(0) {
+        Last=this;
+      }
+
+      void inject(const char *data,uint32_t size) {
+        _receiveBuffer->write(reinterpret_cast<const uint8_t *>(data),size);
+        Injected+=size;
+      }
+
+      bool handleClosed() {
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+
+      State handleStateChange(State newState) {
+
+        if(newState==State::READING_REQUEST_HEADERS) {
+          _request.Action=_action;
+          _request.Uri=_uri;
+          _request.Version=_version;
+          _request.Headers.clear();
+        }
+        else if(newState==State::READING_REQUEST_BODY)
+          _request.ContentLength=_contentLength;
+        else if(newState==State::WRITING_BEGIN) {
+
+          // the request is complete, keep it and go straight on to the next one
+
+          if(_request.ContentLength==0)
+            _request.ContentLength=_contentLength;
+
+          Requests.push_back(_request);
+          _request.ContentLength=0;
+
+          resetRequest();
+          return State::READING_REQUEST_LINE;
+        }
+
+        return newState;
+      }
+
+      void handleRequestHeader(const std::string& header) {
+        _request.Headers.push_back(header);
+      }
+  };
+
+  TestConnection *TestConnection::Last=nullptr;
+
+
+  /*
+   * Deliver data to the connection in pieces, letting it read after each one
+   */
+
+  void deliver(TestConnection& conn,const std::string& data,uint32_t segmentSize) {
+
+    uint32_t pos,size;
+
+    for(pos=0;pos<data.length();pos+=size) {
+      size=std::min<uint32_t>(segmentSize,data.length()-pos);
+      conn.inject(data.c_str()+pos,size);
+      conn.handleRead();
+    }
+  }
+
+
+  /*
+   * The header lines of a captured request
+   */
+
+  std::vector<std::string> getHeaders(const char *text) {
+
+    std::vector<std::string> headers;
+    const char *end;
+
+    text=strstr(text,"\r\n")+2;
+
+    while((end=strstr(text,"\r\n"))!=text) {
+      headers.push_back(std::string(text,end-text));
+      text=end+2;
+    }
+
+    return headers;
+  }
+
+
+  bool matches(const Request& request,const CapturedHttpRequest& captured) {
+
+    return request.Action==captured.Action &&
+           request.Uri==captured.Uri &&
+           request.Version==captured.Version &&
+           request.ContentLength==captured.ContentLength &&
+           request.Headers==getHeaders(captured.Text);
+  }
+
+
+  /*
+   * Every captured request on its own, then all of them pipelined, in every segment size
+   */
+
+  void testCaptured(TestConnection& conn) {
+
+    std::string all;
+    uint32_t i;
+
+    for(uint32_t segmentSize : SEGMENT_SIZES) {
+
+      for(i=0;i<CAPTURED_HTTP_REQUEST_COUNT;i++) {
+
+        conn.Requests.clear();
+        deliver(conn,CAPTURED_HTTP_REQUESTS[i].Text,segmentSize);
+
+        HOSTTEST_CHECK(conn.Requests.size()==1);
+        HOSTTEST_CHECK(conn.Requests.size()==1 && matches(conn.Requests[0],CAPTURED_HTTP_REQUESTS[i]));
+        HOSTTEST_CHECK(conn.getDataAvailable()==0);
+      }
+    }
+
+    for(i=0;i<CAPTURED_HTTP_REQUEST_COUNT;i++)
+      all+=CAPTURED_HTTP_REQUESTS[i].Text;
+
+    for(uint32_t segmentSize : SEGMENT_SIZES) {
+
+      conn.Requests.clear();
+      deliver(conn,all,segmentSize);
+
+      HOSTTEST_CHECK(conn.Requests.size()==CAPTURED_HTTP_REQUEST_COUNT);
+
+      for(i=0;i<conn.Requests.size() && i<CAPTURED_HTTP_REQUEST_COUNT;i++)
+        HOSTTEST_CHECK(matches(conn.Requests[i],CAPTURED_HTTP_REQUESTS[i]));
+    }
+  }
+
+
+  /*
+   * The CR arrives in one segment and the LF in the next
+   */
+
+  void testCrSplitAcrossSegments(TestConnection& conn) {
+
+    conn.Requests.clear();
+
+    deliver(conn,"GET /split HTTP/1.1\r",RECEIVE_BUFFER_SIZE);
+    deliver(conn,"\nHost: 192.168.0.10\r",RECEIVE_BUFFER_SIZE);
+    deliver(conn,"\n\r",RECEIVE_BUFFER_SIZE);
+    deliver(conn,"\n",RECEIVE_BUFFER_SIZE);
+
+    HOSTTEST_CHECK(conn.Requests.size()==1);
+
+    if(conn.Requests.size()==1) {
+      HOSTTEST_CHECK(conn.Requests[0].Uri=="/split");
+      HOSTTEST_CHECK(conn.Requests[0].Version=="HTTP/1.1");
+      HOSTTEST_CHECK(conn.Requests[0].Headers.size()==1 && conn.Requests[0].Headers[0]=="Host: 192.168.0.10");
+    }
+  }
+
+
+  /*
+   * The CR is the last byte before the circular buffer wraps and the LF is the first one
+   * after it, so the receiver finds the end of the line in its second contiguous block
+   */
+
+  void testCrSplitAcrossWrap(TestConnection& conn) {
+
+    const uint8_t *data;
+    uint32_t size,headerSize,fillerSize,bodySize;
+    char header[60];
+    std::string filler,line;
+
+    // a POST with a body sized to move the buffer position to 64 bytes before the end
+
+    headerSize=strlen("POST /filler HTTP/1.1\r\nContent-Length: 000\r\n\r\n");
+    fillerSize=(RECEIVE_BUFFER_SIZE*2-64-conn.Injected % RECEIVE_BUFFER_SIZE) % RECEIVE_BUFFER_SIZE;
+    bodySize=(fillerSize+RECEIVE_BUFFER_SIZE*2-headerSize-100) % RECEIVE_BUFFER_SIZE+100;
+
+    sprintf(header,"POST /filler HTTP/1.1\r\nContent-Length: %03u\r\n\r\n",bodySize);
+
+    filler=header;
+    filler.append(bodySize,'f');
+
+    // a request line whose CR is the 64th byte
+
+    line="GET /";
+    line.append(64-line.length()-strlen(" HTTP/1.1\r"),'w');
+    line+=" HTTP/1.1\r\nHost: 192.168.0.10\r\n\r\n";
+
+    conn.Requests.clear();
+    deliver(conn,filler,RECEIVE_BUFFER_SIZE);
+
+    HOSTTEST_CHECK(conn.Injected % RECEIVE_BUFFER_SIZE==RECEIVE_BUFFER_SIZE-64);
+
+    // the whole request arrives at once, the first block stops after the CR
+
+    conn.inject(line.c_str(),line.length());
+
+    size=conn.peekReceive(data);
+    HOSTTEST_CHECK(size==64 && data[size-1]=='\r' && conn.getDataAvailable()>size);
+
+    conn.handleRead();
+
+    HOSTTEST_CHECK(conn.Requests.size()==2);
+
+    if(conn.Requests.size()==2) {
+      HOSTTEST_CHECK(conn.Requests[0].ContentLength==bodySize);
+      HOSTTEST_CHECK(conn.Requests[1].Uri==line.substr(4,line.find(' ',4)-4));
+      HOSTTEST_CHECK(conn.Requests[1].Version=="HTTP/1.1");
+      HOSTTEST_CHECK(conn.Requests[1].Headers.size()==1 && conn.Requests[1].Headers[0]=="Host: 192.168.0.10");
+    }
+  }
+
+
+  /*
+   * Lines longer than the maximum are cut short but the line after them is not affected
+   */
+
+  void testOverLongLines(TestConnection& conn) {
+
+    std::string request,cookie;
+
+    // a request line that's too long loses its end, with the URI and version
+
+    request="GET /";
+    request.append(MAX_LINE_LENGTH,'u');
+    request+=" HTTP/1.1\r\nHost: 192.168.0.10\r\n\r\n";
+
+    // a header that's too long, then one that must still be seen, then the body
+
+    cookie="Cookie: ";
+    cookie.append(MAX_LINE_LENGTH*2,'c');
+
+    request+="POST /form HTTP/1.1\r\n"+cookie+"\r\nContent-Length: 5\r\n\r\nhello";
+
+    // lines that are exactly the maximum and one more than it
+
+    request+="GET /";
+    request.append(MAX_LINE_LENGTH-5-9,'e');
+    request+=" HTTP/1.1\r\n\r\n";
+
+    request+="GET /";
+    request.append(MAX_LINE_LENGTH-5-9+1,'e');
+    request+=" HTTP/1.1\r\n\r\n";
+
+    request+="GET /after HTTP/1.1\r\n\r\n";
+
+    for(uint32_t segmentSize : SEGMENT_SIZES) {
+
+      conn.Requests.clear();
+      deliver(conn,request,segmentSize);
+
+      HOSTTEST_CHECK(conn.Requests.size()==5);
+
+      if(conn.Requests.size()!=5)
+        continue;
+
+      HOSTTEST_CHECK(conn.Requests[0].Action=="GET");
+      HOSTTEST_CHECK(conn.Requests[0].Uri.empty() && conn.Requests[0].Version.empty());
+      HOSTTEST_CHECK(conn.Requests[0].Headers.size()==1 && conn.Requests[0].Headers[0]=="Host: 192.168.0.10");
+
+      HOSTTEST_CHECK(conn.Requests[1].Headers.size()==2);
+      HOSTTEST_CHECK(conn.Requests[1].Headers.size()==2 && conn.Requests[1].Headers[0]==cookie.substr(0,MAX_LINE_LENGTH));
+      HOSTTEST_CHECK(conn.Requests[1].ContentLength==5);
+
+      HOSTTEST_CHECK(conn.Requests[2].Uri.length()==MAX_LINE_LENGTH-4-9 && conn.Requests[2].Version=="HTTP/1.1");
+      HOSTTEST_CHECK(conn.Requests[3].Uri.length()==MAX_LINE_LENGTH-4-9+1 && conn.Requests[3].Version=="HTTP/1.");
+
+      HOSTTEST_CHECK(conn.Requests[4].Uri=="/after" && conn.Requests[4].Version=="HTTP/1.1");
+    }
+  }
+
+
+  /*
+   * Escapes in the URI, including ones cut short by the end of it
+   */
+
+  void testUriEscapes(TestConnection& conn) {
+
+    static const char *const uris[][2]={
+      { "/a%","/a%" },
+      { "/a%4","/a%4" },
+      { "/%","/%" },
+      { "/%41%62c","/Abc" },
+      { "/x%2f%2Fy","/x//y" },
+      { "/%e2%82%AC","/\xe2\x82\xac" },
+      { "http://192.168.0.10/p%20q%","/p q%" },
+      { "http://192.168.0.10","/index.html" }
+    };
+
+    std::string request;
+
+    for(const auto& uri : uris) {
+
+      request="GET ";
+      request+=uri[0];
+      request+=" HTTP/1.1\r\n\r\n";
+
+      conn.Requests.clear();
+      deliver(conn,request,RECEIVE_BUFFER_SIZE);
+
+      HOSTTEST_CHECK(conn.Requests.size()==1 && conn.Requests[0].Uri==uri[1]);
+    }
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<TestConnection> *server;
+
+  HOSTTEST_CHECK(network.initialise());
+
+  // the server accepts a connection from the peer and the test then drives it directly
+
+  server=nullptr;
+  network.getStack().tcpCreateServer(SERVER_PORT,server);
+
+  if(server==nullptr)
+    return hosttest::result("HttpRequestTest");
+
+  TcpConnectionArray<TestConnection> connections(*server);
+  server->start();
+
+  MemoryTcpPeer peer(network,"192.168.0.20",50000);
+  peer.connect(SERVER_PORT);
+
+  HOSTTEST_CHECK(network.runUntil([&] { return TestConnection::Last!=nullptr; },TIMEOUT));
+
+  if(TestConnection::Last==nullptr)
+    return hosttest::result("HttpRequestTest");
+
+  TestConnection& conn(*TestConnection::Last);
+
+  testCaptured(conn);
+  testCrSplitAcrossSegments(conn);
+  testCrSplitAcrossWrap(conn);
+  testOverLongLines(conn);
+  testUriEscapes(conn);
+
+  delete server;
+  return hosttest::result("HttpRequestTest");
+}
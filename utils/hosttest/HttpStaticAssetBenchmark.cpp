@@ -0,0 +1,365 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Static responses from an HTTP server on the memory network. The old way, as the web server
+ * example does it, builds the header in a new std::string and sends it and the body through
+ * the stream of streams. sendStaticAsset() builds the header in a buffer that the connection
+ * keeps and sends a body in memory straight from where it is. It's measured with the body in
+ * memory, with the body streamed and answering with 304 Not Modified.
+ *
+ * A peer sends the requests one at a time on a persistent connection. It prints the time
+ * spent in the connection's handlers and the heap allocations they make for each request,
+ * with the time spent servicing the simulated wire taken out, and the frames and bytes that
+ * the stack sent for each one. Every response must be the right one.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "MemoryNetwork.h"
+#include "HttpResponseReader.h"
+
+#include <chrono>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+/*
+ * Count heap allocations while the connection is being metered. The library's operator
+ * delete frees what malloc() returned.
+ */
+
+namespace {
+  bool Metering=false;
+  uint32_t Allocations=0;
+}
+
+__attribute__((noinline)) void *operator new(size_t size) {
+
+  void *p;
+
+  if(Metering)
+    Allocations++;
+
+  if((p=malloc(size))==nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+
+namespace {
+
+  enum {
+    PAGE_SIZE = 1000,
+    TEXT_SIZE = 40,
+    REQUESTS = 20000,
+    SERVER_PORT = 80,
+    TIMEOUT = 5000
+  };
+
+  uint8_t Page[PAGE_SIZE];
+  uint8_t Text[TEXT_SIZE];
+
+  const HttpStaticAsset ASSETS[]={
+
+    { "/index.html",
+      "Content-Type: text/html\r\nETag: \"1a2b3c4d\"\r\n",
+      "\"1a2b3c4d\"",
+      Page,sizeof(Page),
+      nullptr,0 },
+
+    { "/status.txt",
+      "Content-Type: text/plain\r\nETag: \"6c7d8e9f\"\r\n",
+      "\"6c7d8e9f\"",
+      Text,sizeof(Text),
+      nullptr,0 }
+  };
+
+  const uint16_t ASSET_COUNT=sizeof(ASSETS)/sizeof(ASSETS[0]);
+
+
+  /*
+   * How the connection answers
+   */
+
+  enum class Mode {
+    STRINGS,        // std::string header and streams, the old way
+    STATIC,         // sendStaticAsset() with the body in memory
+    STREAMED        // sendStaticAsset() with a stream on to the body
+  };
+
+
+  /*
+   * Time and allocations in the connection's handlers. The timer interrupt services the
+   * wire while the connection waits to send and that isn't the connection's time.
+   */
+
+  struct Meter {
+
+    std::chrono::steady_clock::duration Elapsed;
+    void (*Service)();
+
+    static Meter& instance() {
+      static Meter meter;
+      return meter;
+    }
+
+    static void onTimerInterrupt() {
+
+      auto start=std::chrono::steady_clock::now();
+      bool metering;
+
+      metering=Metering;
+      Metering=false;
+
+      instance().Service();
+
+      if((Metering=metering))
+        instance().Elapsed-=std::chrono::steady_clock::now()-start;
+    }
+
+    template<class F>
+    static bool run(F f) {
+
+      auto start=std::chrono::steady_clock::now();
+      bool ok;
+
+      Metering=true;
+      ok=f();
+      Metering=false;
+
+      instance().Elapsed+=std::chrono::steady_clock::now()-start;
+      return ok;
+    }
+  };
+
+
+  class BenchmarkConnection : public HttpServerConnection<BenchmarkConnection> {
+
+    public:
+      struct Parameters : HttpServerConnection<BenchmarkConnection>::Parameters {
+        Parameters() {
+          http_maxRequestsPerConnection=0;
+        }
+      };
+
+      static Mode ResponseMode;
+
+    protected:
+      void processRequest();
+
+    public:
+      BenchmarkConnection(const Parameters& params)
+        : HttpServerConnection<BenchmarkConnection>(params) {
+      }
+
+      bool handleRead() {
+        return Meter::run([this] { return HttpServerConnection<BenchmarkConnection>::handleRead(); });
+      }
+
+      bool handleWrite() {
+        return Meter::run([this] { return HttpServerConnection<BenchmarkConnection>::handleWrite(); });
+      }
+
+      bool handleClosed() {
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+
+      State handleStateChange(State newState) {
+
+        if(newState==State::WRITING_RESPONSE)
+          processRequest();
+
+        return newState;
+      }
+
+      void handleRequestHeader(const std::string&) {
+      }
+  };
+
+  Mode BenchmarkConnection::ResponseMode=Mode::STATIC;
+
+
+  void BenchmarkConnection::processRequest() {
+
+    const HttpStaticAsset *asset;
+    HttpStaticAsset streamed;
+    std::string *response;
+
+    asset=findStaticAsset(ASSETS,ASSET_COUNT);
+
+    if(ResponseMode==Mode::STRINGS) {
+
+      // as the web server example does it, with a byte array standing in for the file
+
+      response=new std::string(_version+" 200 OK\r\n");
+
+      addConnectionHeader(*response);
+      addContentTypeHeader(*response);
+      addContentLengthHeader(*response,asset->bodySize);
+      (*response)+="ETag: ";
+      (*response)+=asset->etag;
+      (*response)+="\r\n\r\n";
+
+      _output.addStream(new StlStringInputStream(response,true),true);
+      _output.addStream(new ByteArrayInputStream(asset->body,asset->bodySize),true);
+    }
+    else if(ResponseMode==Mode::STATIC)
+      sendStaticAsset(*asset);
+    else {
+
+      // the same asset as if the body was in a file
+
+      streamed=*asset;
+      streamed.body=nullptr;
+
+      if(isNotModified(streamed))
+        sendStaticAsset(streamed);
+      else
+        sendStaticAsset(streamed,new ByteArrayInputStream(asset->body,asset->bodySize),true);
+    }
+  }
+
+
+  /*
+   * One row of the table
+   */
+
+  struct Case {
+    const char *Name;
+    Mode ResponseMode;
+    const char *Uri;
+    const char *Headers;
+    uint16_t Status;
+    const uint8_t *Body;
+    uint32_t BodySize;
+  };
+
+  const Case CASES[]={
+    { "strings",Mode::STRINGS,"/index.html","",200,Page,sizeof(Page) },
+    { "static",Mode::STATIC,"/index.html","",200,Page,sizeof(Page) },
+    { "streamed",Mode::STREAMED,"/index.html","",200,Page,sizeof(Page) },
+    { "strings",Mode::STRINGS,"/status.txt","",200,Text,sizeof(Text) },
+    { "static",Mode::STATIC,"/status.txt","",200,Text,sizeof(Text) },
+    { "streamed",Mode::STREAMED,"/status.txt","",200,Text,sizeof(Text) },
+    { "static",Mode::STATIC,"/index.html","If-None-Match: \"1a2b3c4d\"\r\n",304,nullptr,0 },
+    { "streamed",Mode::STREAMED,"/index.html","If-None-Match: \"1a2b3c4d\"\r\n",304,nullptr,0 }
+  };
+
+
+  bool run(MemoryNetwork& network,TcpConnectionArray<BenchmarkConnection>& connections,MemoryTcpPeer& peer,const Case& c) {
+
+    HttpResponse response;
+    std::string request;
+    uint32_t i,waited,allocations;
+
+    request=std::string("GET ")+c.Uri+" HTTP/1.1\r\nHost: 192.168.0.10\r\n"+c.Headers+"\r\n";
+    BenchmarkConnection::ResponseMode=c.ResponseMode;
+
+    network.resetCounters();
+    Meter::instance().Elapsed=std::chrono::steady_clock::duration::zero();
+    allocations=Allocations;
+
+    for(i=0;i<REQUESTS;i++) {
+
+      peer.clearReceived();
+      peer.send(request);
+
+      for(waited=0;readHttpResponse(peer.getReceived(),false,response)==0 && waited<TIMEOUT;waited++)
+        connections.wait(TcpWaitState::WRITE | TcpWaitState::READ | TcpWaitState::CLOSED,1);
+
+      if(waited==TIMEOUT ||
+         response.Status!=c.Status ||
+         response.Body.length()!=c.BodySize ||
+         memcmp(response.Body.c_str(),c.Body,c.BodySize)!=0) {
+
+        printf("%s %s: got %s\n",c.Name,c.Uri,response.StatusLine.c_str());
+        return false;
+      }
+    }
+
+    std::chrono::duration<double,std::nano> elapsed=Meter::instance().Elapsed;
+
+    printf("%-10s %-12s %6u %10.0f %12.2f %10.2f %10.1f\n",
+           c.Name,
+           c.Uri,
+           c.Status,
+           elapsed.count()/REQUESTS,
+           (Allocations-allocations)/static_cast<double>(REQUESTS),
+           network.getCounters().FramesFromStack/static_cast<double>(REQUESTS),
+           network.getCounters().BytesFromStack/static_cast<double>(REQUESTS));
+
+    return true;
+  }
+
+
+  void fill(uint8_t *data,uint32_t size,uint32_t seed) {
+
+    while(size--) {
+      seed=seed*1103515245+12345;
+      *data++=seed >> 16;
+    }
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<BenchmarkConnection> *server;
+  uint32_t waited;
+  bool ok;
+
+  fill(Page,sizeof(Page),1);
+  fill(Text,sizeof(Text),2);
+
+  if(!network.initialise()) {
+    printf("The stack did not start\n");
+    return 1;
+  }
+
+  // meter the connection without the wire
+
+  Meter::instance().Service=MillisecondTimer::interrupt();
+  MillisecondTimer::interrupt()=&Meter::onTimerInterrupt;
+
+  server=nullptr;
+  network.getStack().tcpCreateServer(SERVER_PORT,server);
+
+  if(server==nullptr) {
+    printf("The server was not created\n");
+    return 1;
+  }
+
+  TcpConnectionArray<BenchmarkConnection> connections(*server);
+  server->start();
+
+  MemoryTcpPeer peer(network,"192.168.0.20",50000);
+  peer.connect(SERVER_PORT);
+
+  for(waited=0;peer.getState()!=MemoryTcpPeer::State::ESTABLISHED && waited<TIMEOUT;waited++)
+    connections.wait(TcpWaitState::WRITE | TcpWaitState::READ | TcpWaitState::CLOSED,1);
+
+  printf("%-10s %-12s %6s %10s %12s %10s %10s\n","response","uri","status","ns/req","allocs/req","frames/req","bytes/req");
+
+  ok=true;
+
+  for(const Case& c : CASES)
+    ok&=run(network,connections,peer,c);
+
+  delete server;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,551 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the static asset responses. An HTTP server on the memory network serves three
+ * assets with sendStaticAsset(): a page in memory with a gzip variant, a small text file in
+ * memory that goes out in the same segment as the header and a script that's streamed, also
+ * with a gzip variant. A peer sends requests and every response is checked as it arrives:
+ * the status, the headers, the body and that nothing follows it. The cases are the gzip
+ * choice with its quality values, If-None-Match and 304, byte ranges and 416, and HEAD.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "config/net_http.h"
+#include "MemoryNetwork.h"
+#include "HttpResponseReader.h"
+#include "HostTest.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    PAGE_SIZE = 1000,
+    PAGE_GZIP_SIZE = 300,
+    TEXT_SIZE = 40,
+    SCRIPT_SIZE = 5000,
+    SCRIPT_GZIP_SIZE = 1500,
+    SERVER_PORT = 80,
+    TIMEOUT = 5000
+  };
+
+  uint8_t Page[PAGE_SIZE];
+  uint8_t PageGzip[PAGE_GZIP_SIZE];
+  uint8_t Text[TEXT_SIZE];
+  uint8_t Script[SCRIPT_SIZE];
+  uint8_t ScriptGzip[SCRIPT_GZIP_SIZE];
+
+  const HttpStaticAsset ASSETS[]={
+
+    { "/index.html",
+      "Content-Type: text/html\r\nETag: \"1a2b3c4d\"\r\nCache-Control: no-cache\r\n",
+      "\"1a2b3c4d\"",
+      Page,sizeof(Page),
+      PageGzip,sizeof(PageGzip) },
+
+    { "/status.txt",
+      "Content-Type: text/plain\r\nCache-Control: no-store\r\n",
+      nullptr,
+      Text,sizeof(Text),
+      nullptr,0 },
+
+    { "/js/dashboard.js",
+      "Content-Type: application/javascript\r\nETag: \"5a1c-2f0e\"\r\n",
+      "\"5a1c-2f0e\"",
+      nullptr,sizeof(Script),
+      nullptr,sizeof(ScriptGzip) }
+  };
+
+  const uint16_t ASSET_COUNT=sizeof(ASSETS)/sizeof(ASSETS[0]);
+
+
+  /*
+   * A connection that answers with the assets. The script is streamed from its arrays as
+   * if they were files.
+   */
+
+  class AssetConnection : public HttpServerConnection<AssetConnection> {
+
+    public:
+      static uint32_t StreamsOpened;
+
+    protected:
+      void processRequest();
+
+    public:
+      AssetConnection(const Parameters& params)
+        : HttpServerConnection<AssetConnection>(params) {
+      }
+
+      bool handleClosed() {
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+
+      State handleStateChange(State newState) {
+
+        if(newState==State::WRITING_RESPONSE)
+          processRequest();
+
+        return newState;
+      }
+
+      void handleRequestHeader(const std::string&) {
+      }
+  };
+
+  uint32_t AssetConnection::StreamsOpened=0;
+
+
+  void AssetConnection::processRequest() {
+
+    const HttpStaticAsset *asset;
+    std::string *response;
+    bool gzip;
+
+    if((asset=findStaticAsset(ASSETS,ASSET_COUNT))==nullptr) {
+
+      response=new std::string(_version+" 404 Not Found\r\n");
+      addContentLengthHeader(*response,0);
+      addConnectionHeader(*response);
+      (*response)+="\r\n";
+
+      _output.addStream(new StlStringInputStream(response,true),true);
+    }
+    else if(asset->body!=nullptr || isNotModified(*asset))
+      HOSTTEST_CHECK(sendStaticAsset(*asset));
+    else {
+
+      // the streamed asset: open the variant that will be sent
+
+      gzip=wantsGzipVariant(*asset);
+      StreamsOpened++;
+
+      HOSTTEST_CHECK(sendStaticAsset(*asset,
+                                     gzip ? new ByteArrayInputStream(ScriptGzip,sizeof(ScriptGzip))
+                                          : new ByteArrayInputStream(Script,sizeof(Script)),
+                                     true));
+    }
+  }
+
+
+  /*
+   * A peer that sends a request and runs the server until the response has arrived
+   */
+
+  class Client {
+
+    protected:
+      TcpConnectionArray<AssetConnection>& _connections;
+      MemoryTcpPeer _peer;
+
+    protected:
+      bool serve(uint32_t millis);
+
+    public:
+      Client(MemoryNetwork& network,TcpConnectionArray<AssetConnection>& connections,uint16_t port);
+
+      bool request(const std::string& text,HttpResponse& response,bool head=false);
+      bool isClosed();
+  };
+
+
+  Client::Client(MemoryNetwork& network,TcpConnectionArray<AssetConnection>& connections,uint16_t port)
+    : _connections(connections),
+      _peer(network,"192.168.0.20",port) {
+
+    _peer.connect(SERVER_PORT);
+    serve(10);
+  }
+
+
+  bool Client::serve(uint32_t millis) {
+    return _connections.wait(TcpWaitState::WRITE | TcpWaitState::READ | TcpWaitState::CLOSED,millis);
+  }
+
+
+  /*
+   * Send the request and wait for the whole response. Anything more than one response is
+   * a failure.
+   */
+
+  bool Client::request(const std::string& text,HttpResponse& response,bool head) {
+
+    uint32_t size,waited;
+
+    _peer.clearReceived();
+    _peer.send(text);
+
+    for(waited=0;(size=readHttpResponse(_peer.getReceived(),head,response))==0 && waited<TIMEOUT;waited++)
+      serve(1);
+
+    if(size==0)
+      return false;
+
+    // give the server the chance to send something it shouldn't
+
+    serve(10);
+    return size==_peer.getReceived().length();
+  }
+
+
+  bool Client::isClosed() {
+
+    uint32_t waited;
+
+    for(waited=0;!_peer.isRemoteClosed() && waited<TIMEOUT;waited++)
+      serve(1);
+
+    return _peer.isRemoteClosed();
+  }
+
+
+  std::string get(const char *uri,const char *headers="",const char *action="GET") {
+    return std::string(action)+" "+uri+" HTTP/1.1\r\nHost: 192.168.0.10\r\n"+headers+"\r\n";
+  }
+
+
+  bool bodyIs(const HttpResponse& response,const uint8_t *data,uint32_t size) {
+    return response.Body.length()==size && !memcmp(response.Body.c_str(),data,size);
+  }
+
+
+  /*
+   * The whole of each asset, plain and gzip
+   */
+
+  void testWhole(Client& client) {
+
+    HttpResponse response;
+
+    HOSTTEST_CHECK(client.request(get("/index.html"),response));
+    HOSTTEST_CHECK(response.StatusLine=="HTTP/1.1 200 OK");
+    HOSTTEST_CHECK(response.getHeader("Content-Type")=="text/html");
+    HOSTTEST_CHECK(response.getHeader("ETag")=="\"1a2b3c4d\"");
+    HOSTTEST_CHECK(response.getHeader("Content-Length")=="1000");
+    HOSTTEST_CHECK(response.getHeader("Vary")=="Accept-Encoding");
+    HOSTTEST_CHECK(response.getHeader("Accept-Ranges")=="bytes");
+    HOSTTEST_CHECK(response.getHeader("Connection")=="keep-alive");
+    HOSTTEST_CHECK(!response.hasHeader("Content-Encoding"));
+    HOSTTEST_CHECK(bodyIs(response,Page,sizeof(Page)));
+
+    HOSTTEST_CHECK(client.request(get("/index.html","Accept-Encoding: gzip, deflate\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(response.getHeader("Content-Encoding")=="gzip");
+    HOSTTEST_CHECK(response.getHeader("Content-Length")=="300");
+    HOSTTEST_CHECK(bodyIs(response,PageGzip,sizeof(PageGzip)));
+
+    // the small file goes out with its header and has no gzip variant to vary on
+
+    HOSTTEST_CHECK(client.request(get("/status.txt","Accept-Encoding: gzip\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(!response.hasHeader("Content-Encoding"));
+    HOSTTEST_CHECK(!response.hasHeader("Vary"));
+    HOSTTEST_CHECK(bodyIs(response,Text,sizeof(Text)));
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(bodyIs(response,Script,sizeof(Script)));
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Accept-Encoding: gzip,deflate,sdch\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(response.getHeader("Content-Encoding")=="gzip");
+    HOSTTEST_CHECK(bodyIs(response,ScriptGzip,sizeof(ScriptGzip)));
+
+    HOSTTEST_CHECK(client.request(get("/missing.html"),response));
+    HOSTTEST_CHECK(response.Status==404);
+  }
+
+
+  /*
+   * Quality values on gzip in Accept-Encoding
+   */
+
+  void testQualityValues(Client& client) {
+
+    static const struct {
+      const char *AcceptEncoding;
+      bool Gzip;
+    } cases[]={
+      { "gzip",true },
+      { "deflate, gzip",true },
+      { "gzip;q=1.0, deflate",true },
+      { "gzip;q=0.5",true },
+      { "gzip; q=0.001",true },
+      { "gzip ;q=0",false },
+      { "gzip;q=0, deflate",false },
+      { "gzip;q=0.000",false },
+      { "deflate;q=0.5, gzip;q=0",false },
+      { "deflate",false },
+      { "identity",false }
+    };
+
+    HttpResponse response;
+
+    for(const auto& c : cases) {
+
+      HOSTTEST_CHECK(client.request(get("/index.html",(std::string("Accept-Encoding: ")+c.AcceptEncoding+"\r\n").c_str()),response));
+      HOSTTEST_CHECK(response.Status==200);
+
+      if(c.Gzip!=(response.getHeader("Content-Encoding")=="gzip"))
+        fprintf(stderr,"Accept-Encoding: %s\n",c.AcceptEncoding);
+
+      HOSTTEST_CHECK(c.Gzip==(response.getHeader("Content-Encoding")=="gzip"));
+      HOSTTEST_CHECK(c.Gzip ? bodyIs(response,PageGzip,sizeof(PageGzip)) : bodyIs(response,Page,sizeof(Page)));
+    }
+  }
+
+
+  /*
+   * If-None-Match: the ETag in a list, "*", another ETag, and one too long to be kept
+   */
+
+  void testNotModified(Client& client) {
+
+    HttpResponse response;
+    uint32_t opened;
+
+    HOSTTEST_CHECK(client.request(get("/index.html","If-None-Match: \"1a2b3c4d\"\r\nAccept-Encoding: gzip\r\n"),response));
+    HOSTTEST_CHECK(response.StatusLine=="HTTP/1.1 304 Not Modified");
+    HOSTTEST_CHECK(response.getHeader("ETag")=="\"1a2b3c4d\"");
+    HOSTTEST_CHECK(!response.hasHeader("Content-Length"));
+    HOSTTEST_CHECK(!response.hasHeader("Content-Encoding"));
+    HOSTTEST_CHECK(response.getHeader("Connection")=="keep-alive");
+    HOSTTEST_CHECK(response.Body.empty());
+
+    HOSTTEST_CHECK(client.request(get("/index.html","If-None-Match: \"00000000\", \"1a2b3c4d\"\r\n"),response));
+    HOSTTEST_CHECK(response.Status==304);
+
+    HOSTTEST_CHECK(client.request(get("/index.html","If-None-Match: *\r\n"),response));
+    HOSTTEST_CHECK(response.Status==304);
+
+    HOSTTEST_CHECK(client.request(get("/index.html","If-None-Match: \"00000000\"\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(bodyIs(response,Page,sizeof(Page)));
+
+    HOSTTEST_CHECK(client.request(get("/index.html","If-None-Match: \"00000000\", \"11111111\", \"22222222\", \"33333333\", \"1a2b3c4d\"\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+
+    // an asset without an ETag is never not modified
+
+    HOSTTEST_CHECK(client.request(get("/status.txt","If-None-Match: *\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+
+    // the streamed asset isn't opened for a 304
+
+    opened=AssetConnection::StreamsOpened;
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","If-None-Match: \"5a1c-2f0e\"\r\n"),response));
+    HOSTTEST_CHECK(response.Status==304);
+    HOSTTEST_CHECK(AssetConnection::StreamsOpened==opened);
+
+    // the header is per-request
+
+    HOSTTEST_CHECK(client.request(get("/index.html"),response));
+    HOSTTEST_CHECK(response.Status==200);
+  }
+
+
+  /*
+   * Byte ranges of the page in memory
+   */
+
+  void testRanges(Client& client) {
+
+    static const struct {
+      const char *Range;
+      uint16_t Status;
+      uint32_t First;
+      uint32_t Length;
+    } cases[]={
+      { "bytes=0-99",206,0,100 },
+      { "bytes=100-100",206,100,1 },
+      { "bytes=900-",206,900,100 },
+      { "bytes=-100",206,900,100 },
+      { "bytes=-5000",206,0,1000 },
+      { "bytes=990-5000",206,990,10 },
+      { "bytes= 10-19",206,10,10 },
+      { "BYTES=0-0",206,0,1 },
+      { "bytes=1000-",416,0,0 },
+      { "bytes=1000-2000",416,0,0 },
+      { "bytes=-0",416,0,0 },
+      { "bytes=0-10,20-30",200,0,1000 },
+      { "bytes=50-10",200,0,1000 },
+      { "bytes=",200,0,1000 },
+      { "items=0-5",200,0,1000 }
+    };
+
+    HttpResponse response;
+    char contentRange[40];
+
+    for(const auto& c : cases) {
+
+      // gzip is acceptable but ranges are always of the original
+
+      HOSTTEST_CHECK(client.request(get("/index.html",(std::string("Range: ")+c.Range+"\r\nAccept-Encoding: gzip\r\n").c_str()),response));
+
+      if(response.Status!=c.Status)
+        fprintf(stderr,"Range: %s got %u\n",c.Range,response.Status);
+
+      HOSTTEST_CHECK(response.Status==c.Status);
+
+      if(c.Status==206) {
+        snprintf(contentRange,sizeof(contentRange),"bytes %u-%u/1000",c.First,c.First+c.Length-1);
+        HOSTTEST_CHECK(response.getHeader("Content-Range")==contentRange);
+        HOSTTEST_CHECK(!response.hasHeader("Content-Encoding"));
+        HOSTTEST_CHECK(bodyIs(response,Page+c.First,c.Length));
+      }
+      else if(c.Status==416) {
+        HOSTTEST_CHECK(response.StatusLine=="HTTP/1.1 416 Range Not Satisfiable");
+        HOSTTEST_CHECK(response.getHeader("Content-Range")=="bytes */1000");
+        HOSTTEST_CHECK(response.getHeader("Content-Length")=="0");
+        HOSTTEST_CHECK(response.Body.empty());
+      }
+      else {
+        HOSTTEST_CHECK(!response.hasHeader("Content-Range"));
+        HOSTTEST_CHECK(response.getHeader("Content-Encoding")=="gzip");
+      }
+    }
+
+    // 304 takes precedence over the range
+
+    HOSTTEST_CHECK(client.request(get("/index.html","Range: bytes=0-99\r\nIf-None-Match: \"1a2b3c4d\"\r\n"),response));
+    HOSTTEST_CHECK(response.Status==304);
+  }
+
+
+  /*
+   * A streamed body can only be skipped forwards, so only a range to the end is honoured
+   */
+
+  void testStreamedRanges(Client& client) {
+
+    HttpResponse response;
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Range: bytes=4000-\r\n"),response));
+    HOSTTEST_CHECK(response.Status==206);
+    HOSTTEST_CHECK(response.getHeader("Content-Range")=="bytes 4000-4999/5000");
+    HOSTTEST_CHECK(bodyIs(response,Script+4000,1000));
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Range: bytes=-10\r\n"),response));
+    HOSTTEST_CHECK(response.Status==206);
+    HOSTTEST_CHECK(bodyIs(response,Script+4990,10));
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Range: bytes=0-99\r\n"),response));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(bodyIs(response,Script,sizeof(Script)));
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Range: bytes=5000-\r\n"),response));
+    HOSTTEST_CHECK(response.Status==416);
+    HOSTTEST_CHECK(response.Body.empty());
+  }
+
+
+  /*
+   * HEAD gets the GET headers without the body
+   */
+
+  void testHead(Client& client) {
+
+    HttpResponse response;
+
+    HOSTTEST_CHECK(client.request(get("/index.html","Accept-Encoding: gzip\r\n","HEAD"),response,true));
+    HOSTTEST_CHECK(response.Status==200);
+    HOSTTEST_CHECK(response.getHeader("Content-Length")=="300");
+    HOSTTEST_CHECK(response.getHeader("Content-Encoding")=="gzip");
+    HOSTTEST_CHECK(response.Body.empty());
+
+    HOSTTEST_CHECK(client.request(get("/status.txt","","HEAD"),response,true));
+    HOSTTEST_CHECK(response.getHeader("Content-Length")=="40");
+
+    HOSTTEST_CHECK(client.request(get("/js/dashboard.js","Range: bytes=4000-\r\n","HEAD"),response,true));
+    HOSTTEST_CHECK(response.Status==206);
+    HOSTTEST_CHECK(response.getHeader("Content-Length")=="1000");
+
+    // the connection is still in step
+
+    HOSTTEST_CHECK(client.request(get("/status.txt"),response));
+    HOSTTEST_CHECK(bodyIs(response,Text,sizeof(Text)));
+  }
+
+
+  /*
+   * An HTTP/1.0 client gets its own version back and the connection is closed
+   */
+
+  void testVersion10(Client& client) {
+
+    HttpResponse response;
+
+    HOSTTEST_CHECK(client.request("GET /index.html HTTP/1.0\r\nRange: bytes=-10\r\n\r\n",response));
+    HOSTTEST_CHECK(response.StatusLine=="HTTP/1.0 206 Partial Content");
+    HOSTTEST_CHECK(response.getHeader("Connection")=="close");
+    HOSTTEST_CHECK(bodyIs(response,Page+990,10));
+    HOSTTEST_CHECK(client.isClosed());
+  }
+
+
+  void fill(uint8_t *data,uint32_t size,uint32_t seed) {
+
+    while(size--) {
+      seed=seed*1103515245+12345;
+      *data++=seed >> 16;
+    }
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<AssetConnection> *server;
+
+  fill(Page,sizeof(Page),1);
+  fill(PageGzip,sizeof(PageGzip),2);
+  fill(Text,sizeof(Text),3);
+  fill(Script,sizeof(Script),4);
+  fill(ScriptGzip,sizeof(ScriptGzip),5);
+
+  HOSTTEST_CHECK(network.initialise());
+
+  server=nullptr;
+  network.getStack().tcpCreateServer(SERVER_PORT,server);
+
+  if(server==nullptr)
+    return hosttest::result("HttpStaticAssetTest");
+
+  TcpConnectionArray<AssetConnection> connections(*server);
+  server->start();
+
+  {
+    Client client(network,connections,50000);
+
+    testWhole(client);
+    testQualityValues(client);
+    testNotModified(client);
+    testRanges(client);
+    testStreamedRanges(client);
+    testHead(client);
+  }
+
+  {
+    Client client(network,connections,50001);
+    testVersion10(client);
+  }
+
+  delete server;
+  return hosttest::result("HttpStaticAssetTest");
+}
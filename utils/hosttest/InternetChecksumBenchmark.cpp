@@ -0,0 +1,280 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * InternetChecksum against the loop that it replaced, which summed 16 bits at a time and
+ * tested for a carry into the top bit on every word. The blocks are the sizes of an IP
+ * header, a TCP ACK, the minimum reassembly buffer, a full Ethernet payload and a jumbo
+ * frame, at even, odd and 2 byte alignments. The chain row adds a 1460 byte payload in
+ * three pieces of odd length, which the old loop had to pair up byte by byte across the
+ * boundaries. The last row rewrites an address in an IP header with update32() against
+ * summing the header again.
+ *
+ * Every result is checked against a byte-wise sum and the benchmark fails if any is wrong.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "ChecksumReference.h"
+
+#include <chrono>
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    TOTAL_BYTES = 200*1024*1024,
+    MIN_ITERATIONS = 100000,
+    IP_HEADER_SIZE = 20
+  };
+
+  struct Case {
+    uint32_t Length;
+    uint32_t Alignment;
+  };
+
+  const Case Cases[]={
+    { 20,   0 },
+    { 40,   0 },
+    { 64,   0 },
+    { 576,  0 },
+    { 1460, 0 },
+    { 1460, 1 },
+    { 1460, 2 },
+    { 9000, 0 }
+  };
+
+  const uint32_t ChainSplits[]={ 0,333,1001,1460 };
+
+  volatile uint16_t Sink;
+
+
+  /*
+   * The previous implementation: the sum of a block up to its last even byte, and of one
+   * piece of a scatter-gather sequence with an odd byte carried between pieces
+   */
+
+  void sumit(const void *vptr,uint16_t length,uint32_t& sum) {
+
+    const uint16_t *ptr;
+
+    ptr=reinterpret_cast<const uint16_t *>(vptr);
+    length>>=1;
+
+    while(length--) {
+
+      sum+=*ptr++;
+
+      if(sum & 0x80000000)
+        sum=(sum & 0xFFFF)+(sum >> 16);
+    }
+  }
+
+
+  void sumSegment(const uint8_t *ptr,uint32_t size,uint32_t& sum,uint8_t *carry,bool& odd) {
+
+    if(size==0)
+      return;
+
+    if(odd) {
+      carry[1]=*ptr++;
+      sumit(carry,2,sum);
+      size--;
+    }
+
+    sumit(ptr,size & ~1,sum);
+
+    if((odd=(size & 1)!=0))
+      carry[0]=ptr[size-1];
+  }
+
+
+  uint16_t previousChecksum(const uint8_t *const *pieces,const uint32_t *sizes,uint32_t count) {
+
+    uint32_t sum,i;
+    uint8_t carry[2];
+    bool odd;
+
+    sum=0;
+    odd=false;
+
+    for(i=0;i<count;i++)
+      sumSegment(pieces[i],sizes[i],sum,carry,odd);
+
+    if(odd) {
+      carry[1]=0;
+      sumit(carry,2,sum);
+    }
+
+    while(sum >> 16)
+      sum=(sum & 0xFFFF)+(sum >> 16);
+
+    return ~sum;
+  }
+
+
+  uint16_t newChecksum(const uint8_t *const *pieces,const uint32_t *sizes,uint32_t count) {
+
+    InternetChecksum sum;
+    uint32_t i;
+
+    for(i=0;i<count;i++)
+      sum.add(pieces[i],sizes[i]);
+
+    return sum.getChecksum();
+  }
+
+
+  /*
+   * Time a checksum function over the same pieces. The result must match the reference.
+   */
+
+  template<class F>
+  bool time(F f,const uint8_t *const *pieces,const uint32_t *sizes,uint32_t count,uint32_t length,uint16_t expected,double& ns) {
+
+    uint32_t i,iterations;
+    uint16_t result;
+
+    iterations=std::max<uint32_t>(MIN_ITERATIONS,TOTAL_BYTES/length);
+    result=f(pieces,sizes,count);
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<iterations;i++)
+      Sink=f(pieces,sizes,count);
+
+    std::chrono::duration<double,std::nano> elapsed=std::chrono::steady_clock::now()-start;
+
+    ns=elapsed.count()/iterations;
+    return result==expected;
+  }
+
+
+  bool run(const char *name,const uint8_t *const *pieces,const uint32_t *sizes,uint32_t count,uint32_t length,uint16_t expected) {
+
+    double previousNs,newNs;
+    bool ok;
+
+    ok=time(previousChecksum,pieces,sizes,count,length,expected,previousNs);
+    ok&=time(newChecksum,pieces,sizes,count,length,expected,newNs);
+
+    printf("%-16s %10.1f %10.1f %10.0f %10.0f %8.1fx\n",
+           name,
+           previousNs,
+           newNs,
+           length/previousNs*1000,
+           length/newNs*1000,
+           previousNs/newNs);
+
+    if(!ok)
+      printf("%s: a checksum is wrong\n",name);
+
+    return ok;
+  }
+
+
+  /*
+   * Rewrite the destination address of an IP header incrementally and by summing it again
+   */
+
+  bool runUpdate(uint8_t *header) {
+
+    uint32_t i,oldAddress,newAddress;
+    uint16_t checksum;
+    double updateNs,sumNs;
+    bool ok;
+
+    // the checksum field is zero while summing
+
+    memset(header+10,0,2);
+
+    // the time to sum the header from scratch
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<MIN_ITERATIONS*10;i++) {
+      header[19]=i;
+      Sink=InternetChecksum::checksum(header,IP_HEADER_SIZE);
+    }
+
+    std::chrono::duration<double,std::nano> elapsed=std::chrono::steady_clock::now()-start;
+    sumNs=elapsed.count()/(MIN_ITERATIONS*10);
+
+    // and to update it. The final checksum must match the header.
+
+    header[19]=0;
+    checksum=InternetChecksum::checksum(header,IP_HEADER_SIZE);
+
+    start=std::chrono::steady_clock::now();
+
+    for(i=0;i<MIN_ITERATIONS*10;i++) {
+
+      memcpy(&oldAddress,header+16,4);
+      newAddress=oldAddress+0x01000000;
+      memcpy(header+16,&newAddress,4);
+
+      checksum=InternetChecksum::update32(checksum,oldAddress,newAddress);
+      Sink=checksum;
+    }
+
+    elapsed=std::chrono::steady_clock::now()-start;
+    updateNs=elapsed.count()/(MIN_ITERATIONS*10);
+
+    ok=checksum==static_cast<uint16_t>(~referenceSum(header,IP_HEADER_SIZE));
+
+    printf("%-16s %10.1f %10.1f %10s %10s %8.1fx\n","IP addr update",sumNs,updateNs,"","",sumNs/updateNs);
+
+    if(!ok)
+      printf("IP addr update: the checksum is wrong\n");
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  std::vector<uint8_t> data(9000+8);
+  const uint8_t *pieces[3];
+  uint32_t sizes[3],i;
+  char name[32];
+  bool ok;
+
+  srand(1);
+
+  for(i=0;i<data.size();i++)
+    data[i]=rand();
+
+  printf("%-16s %10s %10s %10s %10s %9s\n","","previous","new","previous","new","");
+  printf("%-16s %10s %10s %10s %10s %9s\n","bytes+align","ns","ns","MB/s","MB/s","speedup");
+
+  ok=true;
+
+  for(const Case& c : Cases) {
+
+    pieces[0]=&data[c.Alignment];
+    sizes[0]=c.Length;
+
+    sprintf(name,"%u +%u",c.Length,c.Alignment);
+    ok&=run(name,pieces,sizes,1,c.Length,~referenceSum(pieces[0],c.Length));
+  }
+
+  for(i=0;i<3;i++) {
+    pieces[i]=&data[ChainSplits[i]];
+    sizes[i]=ChainSplits[i+1]-ChainSplits[i];
+  }
+
+  ok&=run("1460 chain of 3",pieces,sizes,3,1460,~referenceSum(&data[0],1460));
+  ok&=runUpdate(&data[0]);
+
+  return ok ? 0 : 1;
+}
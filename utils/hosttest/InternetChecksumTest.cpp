@@ -0,0 +1,307 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Randomised tests of InternetChecksum against a byte-wise RFC 1071 sum:
+ *
+ *   - checksum() of every length up to a few hundred bytes at every alignment up to 8, and
+ *     of random blocks up to a jumbo frame
+ *   - add() of a block split at random points, so that pieces of odd length and odd
+ *     alignment follow each other
+ *   - update() and update32() after a 16 or 32 bit field is rewritten, against the checksum
+ *     computed from scratch (RFC 1624)
+ *   - calculate() on a UDP datagram in a NetBuffer, which must verify with the pseudo-header,
+ *     and a datagram whose checksum comes out as zero, which must be sent as 0xFFFF
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "ChecksumReference.h"
+#include "HostTest.h"
+
+#include <algorithm>
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+using namespace hosttest;
+
+
+namespace {
+
+  enum {
+    MAX_ALIGNMENT = 8,
+    MAX_EXHAUSTIVE_LENGTH = 300,
+    MAX_LENGTH = 9000,
+    TRIALS = 20000,
+    MAX_PIECES = 8,
+    UDP_HEADER_SIZE = 8,
+    PSEUDO_HEADER_SIZE = 12
+  };
+
+
+  std::vector<uint8_t> randomBytes(uint32_t length) {
+
+    std::vector<uint8_t> data(length);
+    uint32_t i;
+
+    for(i=0;i<length;i++)
+      data[i]=rand();
+
+    return data;
+  }
+
+
+  /*
+   * Every short length at every alignment, and random long blocks. Blocks of all 0xff
+   * bytes make the 64 bit accumulator carry the most.
+   */
+
+  void testBlocks() {
+
+    std::vector<uint8_t> data(randomBytes(MAX_LENGTH+MAX_ALIGNMENT)),ones(MAX_LENGTH+MAX_ALIGNMENT,0xff);
+    uint32_t align,length,trial;
+    bool ok;
+
+    ok=true;
+
+    for(align=0;align<MAX_ALIGNMENT;align++)
+      for(length=0;length<=MAX_EXHAUSTIVE_LENGTH;length++)
+        ok&=InternetChecksum::checksum(&data[align],length)==static_cast<uint16_t>(~referenceSum(&data[align],length));
+
+    for(trial=0;trial<TRIALS;trial++) {
+
+      align=rand() % MAX_ALIGNMENT;
+      length=rand() % (MAX_LENGTH+1);
+
+      ok&=InternetChecksum::checksum(&data[align],length)==static_cast<uint16_t>(~referenceSum(&data[align],length));
+      ok&=InternetChecksum::checksum(&ones[align],length)==static_cast<uint16_t>(~referenceSum(&ones[align],length));
+    }
+
+    HOSTTEST_CHECK(ok);
+  }
+
+
+  /*
+   * A block added in pieces split at random points sums the same as the whole block
+   */
+
+  void testChaining() {
+
+    std::vector<uint8_t> data(randomBytes(MAX_LENGTH+MAX_ALIGNMENT));
+    std::vector<uint32_t> splits;
+    uint32_t trial,align,length,pieces,i,offset;
+    InternetChecksum sum;
+    bool ok;
+
+    ok=true;
+
+    for(trial=0;trial<TRIALS;trial++) {
+
+      align=rand() % MAX_ALIGNMENT;
+      length=rand() % (trial<TRIALS/2 ? 64 : MAX_LENGTH+1);
+      pieces=1+rand() % MAX_PIECES;
+
+      splits.clear();
+      for(i=1;i<pieces;i++)
+        splits.push_back(length ? rand() % length : 0);
+
+      splits.push_back(0);
+      splits.push_back(length);
+      std::sort(splits.begin(),splits.end());
+
+      sum.reset();
+
+      for(i=0;i+1<splits.size();i++) {
+        offset=splits[i];
+        sum.add(&data[align+offset],splits[i+1]-offset);
+      }
+
+      ok&=sum.getSum()==referenceSum(&data[align],length);
+      ok&=sum.getChecksum()==static_cast<uint16_t>(~sum.getSum());
+    }
+
+    HOSTTEST_CHECK(ok);
+  }
+
+
+  /*
+   * Rewrite a random field in a random packet and compare the updated checksum with the one
+   * computed from scratch. The packet always has a non-zero byte outside the field so that
+   * its sum can't be zero, where a recomputed checksum and an updated one legitimately differ.
+   */
+
+  void testUpdate() {
+
+    std::vector<uint8_t> packet;
+    uint32_t trial,length,offset,oldValue32,newValue32;
+    uint16_t checksum,oldValue,newValue;
+    bool ok;
+
+    ok=true;
+
+    for(trial=0;trial<TRIALS;trial++) {
+
+      length=8+2*(rand() % 60);
+      packet=randomBytes(length);
+
+      if(trial % 4==0)
+        std::fill(packet.begin(),packet.end(),trial % 8==0 ? 0 : 0xff);
+
+      packet[0]=1;
+
+      // a 16 bit field
+
+      offset=2+2*(rand() % ((length-2)/2));
+      checksum=InternetChecksum::checksum(&packet[0],length);
+
+      memcpy(&oldValue,&packet[offset],2);
+      newValue=trial % 3==0 ? 0 : trial % 3==1 ? 0xffff : rand();
+      memcpy(&packet[offset],&newValue,2);
+
+      ok&=InternetChecksum::update(checksum,oldValue,newValue)==InternetChecksum::checksum(&packet[0],length);
+
+      // a 32 bit field on a 16 bit boundary
+
+      offset=2+2*(rand() % ((length-4)/2));
+      checksum=InternetChecksum::checksum(&packet[0],length);
+
+      memcpy(&oldValue32,&packet[offset],4);
+      newValue32=trial % 3==0 ? 0 : trial % 3==1 ? 0xffffffff : (rand() << 16) ^ rand();
+      memcpy(&packet[offset],&newValue32,4);
+
+      ok&=InternetChecksum::update32(checksum,oldValue32,newValue32)==InternetChecksum::checksum(&packet[0],length);
+    }
+
+    HOSTTEST_CHECK(ok);
+  }
+
+
+  /*
+   * The bytes of the UDP pseudo-header followed by the datagram
+   */
+
+  std::vector<uint8_t> pseudoPacket(const IpAddress& source,const IpAddress& destination,NetBuffer& nb) {
+
+    std::vector<uint8_t> bytes(PSEUDO_HEADER_SIZE);
+    const NetBufferSegment *seg;
+    const uint8_t *header;
+    uint16_t length;
+
+    length=NetUtil::htons(nb.getSizeFromWritePointerToEnd()+nb.getUserBufferSize());
+
+    memcpy(&bytes[0],&source.ipAddress,4);
+    memcpy(&bytes[4],&destination.ipAddress,4);
+    bytes[8]=0;
+    bytes[9]=static_cast<uint8_t>(IpProtocol::UDP);
+    memcpy(&bytes[10],&length,2);
+
+    header=static_cast<const uint8_t *>(nb.getWritePointer());
+    bytes.insert(bytes.end(),header,header+nb.getSizeFromWritePointerToEnd());
+
+    for(seg=nb.getFirstSegment();seg;seg=seg->getNext())
+      bytes.insert(bytes.end(),seg->getData(),seg->getData()+seg->getSize());
+
+    return bytes;
+  }
+
+
+  /*
+   * Put a UDP header on a payload in a NetBuffer
+   */
+
+  UdpDatagram *makeDatagram(NetBuffer& nb,uint16_t payloadSize) {
+
+    UdpDatagram *udp;
+
+    udp=static_cast<UdpDatagram *>(nb.moveWritePointerBack(UDP_HEADER_SIZE));
+
+    udp->udp_sourcePort=NetUtil::htons(1234);
+    udp->udp_destinationPort=NetUtil::htons(53);
+    udp->udp_length=NetUtil::htons(UDP_HEADER_SIZE+payloadSize);
+    udp->udp_checksum=0x5555;
+
+    return udp;
+  }
+
+
+  void testUdp() {
+
+    IpAddress source("192.168.1.10"),destination("10.0.0.1");
+    std::vector<uint8_t> payload,bytes;
+    uint32_t trial,payloadSize;
+    UdpDatagram *udp;
+    uint16_t word;
+    NetBuffer *nb;
+
+    // random datagrams verify
+
+    for(trial=0;trial<100;trial++) {
+
+      payloadSize=rand() % 600;
+      payload=randomBytes(payloadSize+1);
+
+      nb=new NetBuffer(UDP_HEADER_SIZE,0,&payload[1],payloadSize);
+      makeDatagram(*nb,payloadSize);
+
+      HOSTTEST_CHECK(InternetChecksum::calculate(source,destination,IpProtocol::UDP,*nb));
+
+      bytes=pseudoPacket(source,destination,*nb);
+      HOSTTEST_CHECK(referenceSum(&bytes[0],bytes.size())==0xffff);
+
+      delete nb;
+    }
+
+    // a datagram whose checksum is zero is sent with all ones. The first payload word is
+    // chosen to bring the sum to 0xffff.
+
+    payload.assign(32,0);
+    payload[10]=0x12;
+
+    nb=new NetBuffer(UDP_HEADER_SIZE,0,&payload[0],payload.size());
+    udp=makeDatagram(*nb,payload.size());
+
+    udp->udp_checksum=0;
+    bytes=pseudoPacket(source,destination,*nb);
+    word=~referenceSum(&bytes[0],bytes.size());
+    memcpy(&payload[0],&word,2);
+
+    bytes=pseudoPacket(source,destination,*nb);
+    HOSTTEST_CHECK(referenceSum(&bytes[0],bytes.size())==0xffff);
+
+    HOSTTEST_CHECK(InternetChecksum::calculate(source,destination,IpProtocol::UDP,*nb));
+    HOSTTEST_CHECK(udp->udp_checksum==0xffff);
+
+    // and it still verifies, because 0xffff and 0 are both zero in ones' complement
+
+    bytes=pseudoPacket(source,destination,*nb);
+    HOSTTEST_CHECK(referenceSum(&bytes[0],bytes.size())==0xffff);
+
+    delete nb;
+
+    // protocols that it doesn't know are refused
+
+    nb=new NetBuffer(UDP_HEADER_SIZE,0);
+    makeDatagram(*nb,0);
+
+    HOSTTEST_CHECK(!InternetChecksum::calculate(source,destination,static_cast<IpProtocol>(2),*nb));
+    delete nb;
+  }
+}
+
+
+int main() {
+
+  srand(1);
+
+  testBlocks();
+  testChaining();
+  testUpdate();
+  testUdp();
+
+  return hosttest::result("InternetChecksumTest");
+}
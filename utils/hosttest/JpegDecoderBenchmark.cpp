@@ -0,0 +1,189 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * JpegDecoder drawing a row of MCUs at a time from a band buffer with one rawTransfer()
+ * against drawing an 8x8 block at a time with a window and a writePixel() for each pixel,
+ * which is what it falls back to when it can't allocate a band. The JPEGs are the example
+ * images, which have widths and heights that aren't multiples of the MCU size as well as
+ * ones that are. They're drawn into a FrameBufferDevice so that the time is the decoder's
+ * and the device's with no bus.
+ *
+ * Both ways must draw every image and leave exactly the same pixels in the frame buffer,
+ * and the benchmark fails if they don't.
+ */
+
+#include "config/stm32plus.h"
+#include "config/display/tft.h"
+#include "MemoryPanel.h"
+
+#include <chrono>
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::display;
+
+
+namespace {
+
+  enum {
+    WIDTH = 640,
+    HEIGHT = 360,
+    TOTAL_PIXELS = 4*1000*1000
+  };
+
+  typedef GraphicsLibrary<FrameBufferDevice<MemoryGraphicsLibrary,WIDTH,HEIGHT>,MemoryGraphicsLibrary> FrameBuffer;
+
+  struct Image {
+    const char *Name;
+    const char *Path;
+  };
+
+  const Image Images[]={
+    { "ssd1289",    "../../examples/ssd1289/jpeg/test0.jpg" },
+    { "hx8352a",    "../../examples/hx8352a_gpio/jpeg/test0.jpg" },
+    { "ssd1963",    "../../examples/ssd1963/jpeg/test0.jpg" },
+    { "r61523",     "../../examples/r61523/jpeg/test0.jpg" },
+    { "spiflash 1", "../../examples/flash_spi_program/spiflash/1.jpg" },
+    { "spiflash 2", "../../examples/flash_spi_program/spiflash/2.jpg" },
+    { "spiflash 3", "../../examples/flash_spi_program/spiflash/3.jpg" },
+    { "error",      "../../examples/net_web_pframe/error.jpg" }
+  };
+
+
+  bool load(const char *path,std::vector<uint8_t>& data) {
+
+    FILE *f;
+    long size;
+
+    if((f=fopen(path,"rb"))==nullptr) {
+      printf("%s: cannot open\n",path);
+      return false;
+    }
+
+    fseek(f,0,SEEK_END);
+    size=ftell(f);
+    fseek(f,0,SEEK_SET);
+
+    data.resize(size);
+    size=fread(&data[0],1,size,f);
+    fclose(f);
+
+    return size==static_cast<long>(data.size());
+  }
+
+
+  /*
+   * Decode the JPEG at the top left of the frame buffer in bands or in blocks
+   */
+
+  bool decode(const std::vector<uint8_t>& jpeg,FrameBuffer& fb,bool bands,Size& size) {
+
+    ByteArrayInputStream input(&jpeg[0],jpeg.size());
+    JpegDecoder<FrameBuffer> decoder;
+
+    if(!decoder.beginDecode(input,size))
+      return false;
+
+    return bands ? decoder.endDecode(Point(0,0),fb) : decoder.endDecodeBlocks(Point(0,0),fb);
+  }
+
+
+  /*
+   * Time one way of decoding. The frame buffer is left with the image in it.
+   */
+
+  bool time(const std::vector<uint8_t>& jpeg,FrameBuffer& fb,bool bands,Size& size,double& ms) {
+
+    uint32_t i,iterations;
+    bool ok;
+
+    if(!decode(jpeg,fb,bands,size))
+      return false;
+
+    iterations=std::max<uint32_t>(1,TOTAL_PIXELS/(size.Width*size.Height));
+    ok=true;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<iterations;i++)
+      ok&=decode(jpeg,fb,bands,size);
+
+    std::chrono::duration<double,std::milli> elapsed=std::chrono::steady_clock::now()-start;
+
+    ms=elapsed.count()/iterations;
+    return ok;
+  }
+
+
+  bool run(const Image& image,FrameBuffer& bandFb,FrameBuffer& blockFb) {
+
+    std::vector<uint8_t> jpeg;
+    double bandMs,blockMs;
+    uint32_t i,pixels;
+    Size size;
+    bool ok,drawn;
+
+    if(!load(image.Path,jpeg))
+      return false;
+
+    // both frame buffers start clear so what's left over from the last image can't match
+
+    bandFb.setBackground(0);
+    bandFb.clearScreen();
+    blockFb.setBackground(0);
+    blockFb.clearScreen();
+
+    ok=time(jpeg,bandFb,true,size,bandMs);
+    ok&=time(jpeg,blockFb,false,size,blockMs);
+
+    // the pixels must be the same and the image must be there
+
+    pixels=static_cast<uint32_t>(WIDTH)*HEIGHT;
+
+    ok&=memcmp(bandFb.getPixels(),blockFb.getPixels(),pixels*sizeof(*bandFb.getPixels()))==0;
+
+    for(i=0,drawn=false;i<pixels && !drawn;i++)
+      drawn=bandFb.getPixels()[i].packed565!=0;
+
+    ok&=drawn;
+
+    printf("%-11s %4dx%-4d %9.3f %9.3f %9.1f %9.1f %8.2fx\n",
+           image.Name,
+           size.Width,
+           size.Height,
+           bandMs,
+           blockMs,
+           size.Width*size.Height/bandMs/1000,
+           size.Width*size.Height/blockMs/1000,
+           blockMs/bandMs);
+
+    if(!ok)
+      printf("%s: the decoded image is wrong\n",image.Name);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  MemoryPanelAccessMode accessMode;
+  MemoryGraphicsLibrary panel(accessMode);
+  FrameBuffer bandFb(panel),blockFb(panel);
+  bool ok;
+
+  printf("%-11s %9s %9s %9s %9s %9s %9s\n","","","band","block","band","block","");
+  printf("%-11s %9s %9s %9s %9s %9s %9s\n","image","size","ms","ms","Mpix/s","Mpix/s","speedup");
+
+  ok=true;
+
+  for(const Image& image : Images)
+    ok&=run(image,bandFb,blockFb);
+
+  return ok ? 0 : 1;
+}
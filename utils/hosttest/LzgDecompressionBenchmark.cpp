@@ -0,0 +1,195 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * The LZG decompressor against LZG_Decode() from liblzg 1.0.6, which decodes a whole buffer
+ * in memory. The data is the LZG bitmaps from the examples. Each one is decoded by
+ * liblzg, by the static decompress(), by the stream in 480 byte reads, which is how the
+ * examples send a bitmap to a display, and by the stream a byte at a time with read().
+ *
+ * What the stream and decompress() produce is checked against liblzg, which also checks
+ * the checksum, and the benchmark fails if anything is different.
+ */
+
+#include "config/stm32plus.h"
+#include "config/stream.h"
+#include "lzg.h"
+
+#include <chrono>
+#include <vector>
+
+
+using namespace stm32plus;
+
+
+namespace {
+
+  enum {
+    TOTAL_BYTES = 20*1024*1024,
+    READ_SIZE = 480
+  };
+
+  const char *const Bitmaps[]={ "audio","bulb","doc","flag","globe" };
+
+  volatile uint8_t Sink;
+
+
+  bool load(const char *name,std::vector<uint8_t>& data) {
+
+    char path[100];
+    FILE *f;
+    long size;
+
+    sprintf(path,"../../examples/ssd1289/lzg/ili9325/%s.ili9325.262.lzg",name);
+
+    if((f=fopen(path,"rb"))==nullptr) {
+      printf("%s: cannot open\n",path);
+      return false;
+    }
+
+    fseek(f,0,SEEK_END);
+    size=ftell(f);
+    fseek(f,0,SEEK_SET);
+
+    data.resize(size);
+    size=fread(&data[0],1,size,f);
+    fclose(f);
+
+    return size==static_cast<long>(data.size());
+  }
+
+
+  /*
+   * The ways of decoding. Each decodes the compressed data into the output, which is the
+   * decoded size.
+   */
+
+  bool liblzg(const std::vector<uint8_t>& compressed,std::vector<uint8_t>& output) {
+    return LZG_Decode(&compressed[0],compressed.size(),&output[0],output.size())==output.size();
+  }
+
+
+  bool decompress(const std::vector<uint8_t>& compressed,std::vector<uint8_t>& output) {
+    return LzgDecompressionStream::decompress(&compressed[0],compressed.size(),&output[0],output.size());
+  }
+
+
+  bool streamBlocks(const std::vector<uint8_t>& compressed,std::vector<uint8_t>& output) {
+
+    ByteArrayInputStream input(&compressed[0],compressed.size());
+    LzgDecompressionStream lzg(input,compressed.size());
+    uint32_t pos,actuallyRead;
+
+    for(pos=0;pos<output.size();pos+=actuallyRead)
+      if(!lzg.read(&output[pos],std::min<uint32_t>(READ_SIZE,output.size()-pos),actuallyRead) || actuallyRead==0)
+        return false;
+
+    return true;
+  }
+
+
+  bool streamBytes(const std::vector<uint8_t>& compressed,std::vector<uint8_t>& output) {
+
+    ByteArrayInputStream input(&compressed[0],compressed.size());
+    LzgDecompressionStream lzg(input,compressed.size());
+    int16_t b;
+
+    for(uint8_t& out : output) {
+
+      if((b=lzg.read())<0)
+        return false;
+
+      out=b;
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Time a decoder. What it decodes must be the reference.
+   */
+
+  template<class F>
+  bool time(F f,const std::vector<uint8_t>& compressed,const std::vector<uint8_t>& reference,double& ms) {
+
+    std::vector<uint8_t> output(reference.size());
+    uint32_t i,iterations;
+    bool ok;
+
+    iterations=std::max<uint32_t>(1,TOTAL_BYTES/reference.size());
+    ok=f(compressed,output) && output==reference;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<iterations;i++) {
+      f(compressed,output);
+      Sink=output[i % output.size()];
+    }
+
+    std::chrono::duration<double,std::milli> elapsed=std::chrono::steady_clock::now()-start;
+
+    ms=elapsed.count()/iterations;
+    return ok;
+  }
+
+
+  bool run(const char *name) {
+
+    std::vector<uint8_t> compressed,reference;
+    double liblzgMs,decompressMs,blocksMs,bytesMs;
+    bool ok;
+
+    if(!load(name,compressed))
+      return false;
+
+    reference.resize(LZG_DecodedSize(&compressed[0],compressed.size()));
+
+    if(!liblzg(compressed,reference)) {
+      printf("%s: liblzg cannot decode it\n",name);
+      return false;
+    }
+
+    ok=time(liblzg,compressed,reference,liblzgMs);
+    ok&=time(decompress,compressed,reference,decompressMs);
+    ok&=time(streamBlocks,compressed,reference,blocksMs);
+    ok&=time(streamBytes,compressed,reference,bytesMs);
+
+    printf("%-8s %7u %7u %9.3f %10.3f %9.3f %9.3f %7.0f %7.0f %7.0f %7.0f\n",
+           name,
+           static_cast<unsigned>(compressed.size()),
+           static_cast<unsigned>(reference.size()),
+           liblzgMs,
+           decompressMs,
+           blocksMs,
+           bytesMs,
+           reference.size()/liblzgMs/1000,
+           reference.size()/decompressMs/1000,
+           reference.size()/blocksMs/1000,
+           reference.size()/bytesMs/1000);
+
+    if(!ok)
+      printf("%s: the output is wrong\n",name);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  bool ok;
+
+  printf("%-8s %7s %7s %9s %10s %9s %9s %7s %7s %7s %7s\n","","","","liblzg","decompress","stream","stream","liblzg","decomp","stream","stream");
+  printf("%-8s %7s %7s %9s %10s %9s %9s %7s %7s %7s %7s\n","bitmap","lzg","bytes","ms","ms","480 ms","byte ms","MB/s","MB/s","MB/s","MB/s");
+
+  ok=true;
+
+  for(const char *name : Bitmaps)
+    ok&=run(name);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,485 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Round trips through liblzg and the LZG decompressor. Data is compressed with LZG_Encode()
+ * and must come back exactly from the stream, read in pieces of several sizes and a byte at
+ * a time from an input that gives out a few bytes for each read, and from decompress():
+ *
+ *   - literals mixed with copies from up to 2047 bytes back, long enough that the copies
+ *     are split where the history window wraps
+ *   - runs and short repeating patterns, which are copies that overlap their own output
+ *   - skip() mixed with reads, and a skip past the end
+ *   - incompressible data, which liblzg stores with the copy method
+ *   - a copy from further back than the window, which only decompress() can do
+ *
+ * Then corrupt data: a bad magic number, an unknown method, truncated input, a marker with
+ * nothing after it, a copy from before the start, literals, a copy or a marker past the
+ * decoded size and an output buffer that's too small. None may read or write outside the
+ * buffers and each must fail with the right error.
+ */
+
+#include "config/stm32plus.h"
+#include "config/stream.h"
+#include "HostTest.h"
+#include "lzg.h"
+
+#include <algorithm>
+#include <vector>
+
+
+using namespace stm32plus;
+
+
+namespace {
+
+  enum {
+    DATA_SIZE = 65536,
+    WINDOW_SIZE = 2056,
+    MAX_DISTANCE = 2048,
+    HEADER_SIZE = 16,
+    MAX_TRICKLE = 5,
+    GUARD_SIZE = 16,
+    GUARD = 0xaa
+  };
+
+  const uint32_t ReadSizes[]={ 1,7,32,480,4096,DATA_SIZE };
+
+
+  /*
+   * A stream that gives out no more than a few bytes for each read
+   */
+
+  class TrickleInputStream : public ByteArrayInputStream {
+
+    protected:
+      uint32_t _maxRead;
+
+    public:
+      TrickleInputStream(const void *data,uint32_t size,uint32_t maxRead)
+        : ByteArrayInputStream(data,size),
+          _maxRead(maxRead) {
+      }
+
+      virtual bool read(void *buffer,uint32_t size,uint32_t& actuallyRead) override {
+        return ByteArrayInputStream::read(buffer,std::min(size,_maxRead),actuallyRead);
+      }
+  };
+
+
+  /*
+   * Random literals and copies of earlier data from anywhere in the window
+   */
+
+  std::vector<uint8_t> makeHistoryData() {
+
+    std::vector<uint8_t> data;
+    uint32_t i,length,distance;
+
+    while(data.size()<DATA_SIZE) {
+
+      for(i=rand() % 16;i;i--)
+        data.push_back(rand());
+
+      distance=8+rand() % (MAX_DISTANCE-8);
+      length=3+rand() % 126;
+
+      if(distance<=data.size())
+        for(i=0;i<length;i++)
+          data.push_back(data[data.size()-distance]);
+    }
+
+    data.resize(DATA_SIZE);
+    return data;
+  }
+
+
+  /*
+   * Runs of one byte and patterns of up to 8 bytes repeated, with a few literals between
+   */
+
+  std::vector<uint8_t> makeRunData() {
+
+    std::vector<uint8_t> data;
+    uint32_t i,length,period;
+    uint8_t pattern[8];
+
+    while(data.size()<DATA_SIZE) {
+
+      period=1+rand() % 8;
+      length=period+rand() % 300;
+
+      for(i=0;i<period;i++)
+        pattern[i]=rand();
+
+      for(i=0;i<length;i++)
+        data.push_back(pattern[i % period]);
+
+      data.push_back(rand());
+    }
+
+    data.resize(DATA_SIZE);
+    return data;
+  }
+
+
+  std::vector<uint8_t> makeRandomData(uint32_t size) {
+
+    std::vector<uint8_t> data(size);
+
+    for(uint8_t& b : data)
+      b=rand();
+
+    return data;
+  }
+
+
+  /*
+   * Level 1 has a 2048 byte window so there are no distant copies and the stream can
+   * decompress it. Higher levels search further back.
+   */
+
+  std::vector<uint8_t> compress(const std::vector<uint8_t>& data,int level=LZG_LEVEL_1) {
+
+    std::vector<uint8_t> compressed(LZG_MaxEncodedSize(data.size()));
+    lzg_encoder_config_t config;
+
+    LZG_InitEncoderConfig(&config);
+    config.level=level;
+
+    compressed.resize(LZG_Encode(&data[0],data.size(),&compressed[0],compressed.size(),&config));
+    return compressed;
+  }
+
+
+  bool isLastError(uint16_t error) {
+    return errorProvider.isLastError(ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM,error);
+  }
+
+
+  /*
+   * Read the whole stream in pieces of the given size. The last piece is short and after
+   * that there's nothing.
+   */
+
+  bool readInPieces(InputStream& input,const std::vector<uint8_t>& compressed,const std::vector<uint8_t>& expected,uint32_t readSize) {
+
+    LzgDecompressionStream lzg(input,compressed.size());
+    std::vector<uint8_t> output;
+    uint8_t buffer[DATA_SIZE];
+    uint32_t actuallyRead;
+
+    if(errorProvider.hasError() || !lzg.available())
+      return false;
+
+    while(lzg.available()) {
+
+      if(!lzg.read(buffer,readSize,actuallyRead) || actuallyRead==0)
+        return false;
+
+      if(actuallyRead!=readSize && expected.size()-output.size()!=actuallyRead)
+        return false;
+
+      output.insert(output.end(),buffer,buffer+actuallyRead);
+    }
+
+    return output==expected && lzg.read()==InputStream::E_END_OF_STREAM &&
+           lzg.read(buffer,1,actuallyRead) && actuallyRead==0;
+  }
+
+
+  /*
+   * Read a byte at a time from an input that trickles
+   */
+
+  bool readBytes(const std::vector<uint8_t>& compressed,const std::vector<uint8_t>& expected) {
+
+    TrickleInputStream input(&compressed[0],compressed.size(),MAX_TRICKLE);
+    LzgDecompressionStream lzg(input,compressed.size());
+    int16_t b;
+    uint32_t i;
+
+    for(i=0;i<expected.size();i++)
+      if((b=lzg.read())<0 || b!=expected[i])
+        return false;
+
+    return lzg.read()==InputStream::E_END_OF_STREAM && !lzg.available();
+  }
+
+
+  bool roundTrip(const std::vector<uint8_t>& data,const std::vector<uint8_t>& compressed) {
+
+    std::vector<uint8_t> output(data.size());
+    bool ok;
+
+    ok=LzgDecompressionStream::getDecodedSize(&compressed[0],compressed.size())==data.size();
+
+    for(uint32_t readSize : ReadSizes) {
+      ByteArrayInputStream input(&compressed[0],compressed.size());
+      ok&=readInPieces(input,compressed,data,readSize);
+    }
+
+    ok&=readBytes(compressed,data);
+
+    ok&=LzgDecompressionStream::decompress(&compressed[0],compressed.size(),&output[0],output.size());
+    ok&=output==data;
+
+    return ok;
+  }
+
+
+  /*
+   * Skip random amounts with reads of random size between
+   */
+
+  bool skipAndRead(const std::vector<uint8_t>& data,const std::vector<uint8_t>& compressed) {
+
+    ByteArrayInputStream input(&compressed[0],compressed.size());
+    LzgDecompressionStream lzg(input,compressed.size());
+    uint8_t buffer[1000];
+    uint32_t pos,size,actuallyRead;
+    bool ok;
+
+    ok=true;
+
+    for(pos=0;pos<data.size()/2;) {
+
+      size=rand() % 5000;
+      ok&=lzg.skip(size);
+      pos+=size;
+
+      size=1+rand() % sizeof(buffer);
+      ok&=lzg.read(buffer,size,actuallyRead) && actuallyRead==size;
+      ok&=memcmp(buffer,&data[pos],size)==0;
+      pos+=size;
+    }
+
+    // skipping further than the end skips what's there and fails
+
+    ok&=!lzg.skip(data.size()-pos+1) && errorProvider.getProvider()==ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM;
+    ok&=!lzg.available() && lzg.read()==InputStream::E_END_OF_STREAM;
+
+    return ok;
+  }
+
+
+  /*
+   * Build LZG data by hand: the header, the markers 1 to 4 and the given symbols
+   */
+
+  std::vector<uint8_t> makeLzg(uint32_t decodedSize,std::initializer_list<uint8_t> symbols) {
+
+    std::vector<uint8_t> lzg={ 'L','Z','G' };
+    uint32_t i,encodedSize;
+
+    encodedSize=symbols.size()+4;
+
+    for(i=0;i<4;i++)
+      lzg.push_back(decodedSize >> (24-i*8));
+
+    for(i=0;i<4;i++)
+      lzg.push_back(encodedSize >> (24-i*8));
+
+    lzg.insert(lzg.end(),{ 0,0,0,0,1,1,2,3,4 });
+    lzg.insert(lzg.end(),symbols);
+
+    return lzg;
+  }
+
+
+  /*
+   * decompress() must fail with the error and write nothing past the decoded size. It checks
+   * more than the stream can, which only knows that data is missing when it can't get it.
+   */
+
+  bool decompressFails(const std::vector<uint8_t>& lzg,uint16_t error) {
+
+    std::vector<uint8_t> output(LzgDecompressionStream::getDecodedSize(&lzg[0],lzg.size())+GUARD_SIZE,GUARD);
+    uint32_t outputSize;
+
+    outputSize=output.size()-GUARD_SIZE;
+
+    if(LzgDecompressionStream::decompress(&lzg[0],lzg.size(),&output[0],outputSize) || !isLastError(error))
+      return false;
+
+    return std::count(output.begin()+outputSize,output.end(),GUARD)==GUARD_SIZE;
+  }
+
+
+  bool readFails(const std::vector<uint8_t>& lzg) {
+
+    ByteArrayInputStream input(&lzg[0],lzg.size());
+    LzgDecompressionStream stream(input,lzg.size());
+    uint8_t output[DATA_SIZE];
+    uint32_t actuallyRead;
+
+    return !stream.read(output,sizeof(output),actuallyRead) &&
+           errorProvider.getProvider()==ErrorProvider::ERROR_PROVIDER_LZG_DECOMPRESSION_STREAM;
+  }
+
+
+  /*
+   * A header that can't be used is found by the constructor and the stream has nothing
+   */
+
+  bool isRejected(const std::vector<uint8_t>& lzg) {
+
+    ByteArrayInputStream input(&lzg[0],lzg.size());
+    LzgDecompressionStream stream(input,lzg.size());
+    uint8_t output[DATA_SIZE];
+    uint32_t actuallyRead;
+
+    return !stream.available() && stream.read(output,sizeof(output),actuallyRead) && actuallyRead==0;
+  }
+
+
+  bool testCorrupt(const std::vector<uint8_t>& compressed) {
+
+    std::vector<uint8_t> lzg,output(DATA_SIZE);
+    bool ok;
+
+    // a bad magic number or method
+
+    lzg=compressed;
+    lzg[0]='X';
+
+    ok=isRejected(lzg) && isLastError(LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+    ok&=LzgDecompressionStream::getDecodedSize(&lzg[0],lzg.size())==0;
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+
+    lzg=compressed;
+    lzg[15]=2;
+
+    ok&=isRejected(lzg) && isLastError(LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+
+    // too short for the header, and truncated data
+
+    lzg.assign(compressed.begin(),compressed.begin()+HEADER_SIZE-1);
+    ok&=isRejected(lzg);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+
+    lzg.assign(compressed.begin(),compressed.end()-10);
+    ok&=readFails(lzg);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    // a marker at the end with no parameters
+
+    lzg=makeLzg(2,{ 'a',4 });
+    ok&=readFails(lzg);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    lzg=makeLzg(2,{ 'a',2,0x20 });
+    ok&=readFails(lzg);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    lzg=makeLzg(2,{ 'a',1,0x20 });
+    ok&=readFails(lzg);
+    ok&=decompressFails(lzg,LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    // near copies of 10 from 5 back with only 1 byte output, and from 1 back with only 4 to go
+
+    ok&=decompressFails(makeLzg(11,{ 'a',4,(4 << 5) | 8 }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+    ok&=decompressFails(makeLzg(5,{ 'a',4,8 }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    // literals, a copy, a marker and an escaped marker after the output is complete
+
+    ok&=decompressFails(makeLzg(2,{ 'a','b','c' }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+    ok&=decompressFails(makeLzg(1,{ 'a',4,8 }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+    ok&=decompressFails(makeLzg(1,{ 'a',4 }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+    ok&=decompressFails(makeLzg(1,{ 'a',4,0 }),LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    // an output buffer one byte short isn't touched
+
+    std::fill(output.begin(),output.end(),GUARD);
+
+    ok&=!LzgDecompressionStream::decompress(&compressed[0],compressed.size(),&output[0],LzgDecompressionStream::getDecodedSize(&compressed[0],compressed.size())-1);
+    ok&=isLastError(LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+    ok&=std::count(output.begin(),output.end(),GUARD)==DATA_SIZE;
+
+    return ok;
+  }
+
+
+  /*
+   * Stored data must have the size that the header says
+   */
+
+  bool testStored() {
+
+    std::vector<uint8_t> data,compressed,output(DATA_SIZE);
+    bool ok;
+
+    data=makeRandomData(5000);
+    compressed=compress(data);
+
+    ok=compressed.size()==data.size()+HEADER_SIZE && compressed[15]==0;
+    ok&=roundTrip(data,compressed);
+    ok&=skipAndRead(data,compressed);
+
+    compressed.pop_back();
+    ok&=!LzgDecompressionStream::decompress(&compressed[0],compressed.size(),&output[0],output.size());
+    ok&=isLastError(LzgDecompressionStream::E_CORRUPT_COMPRESSED_DATA);
+
+    return ok;
+  }
+
+
+  /*
+   * A block repeated from more than a window back is a distant copy
+   */
+
+  bool testDistantCopy() {
+
+    std::vector<uint8_t> data,compressed,output;
+    uint8_t buffer[DATA_SIZE];
+    uint32_t actuallyRead;
+    bool ok;
+
+    data=makeRandomData(WINDOW_SIZE*2);
+    data.insert(data.end(),data.begin(),data.begin()+WINDOW_SIZE/2);
+    compressed=compress(data,LZG_LEVEL_9);
+    output.resize(data.size());
+
+    ok=compressed[15]==1 && compressed.size()<data.size();
+
+    ok&=LzgDecompressionStream::decompress(&compressed[0],compressed.size(),&output[0],output.size());
+    ok&=output==data;
+
+    ByteArrayInputStream input(&compressed[0],compressed.size());
+    LzgDecompressionStream stream(input,compressed.size());
+
+    ok&=!stream.read(buffer,sizeof(buffer),actuallyRead) && isLastError(LzgDecompressionStream::E_UNSUPPORTED_COMPRESSED_DATA);
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  std::vector<uint8_t> data,compressed;
+
+  srand(1);
+
+  data=makeHistoryData();
+  compressed=compress(data);
+  HOSTTEST_CHECK(compressed[15]==1);
+  HOSTTEST_CHECK(roundTrip(data,compressed));
+  HOSTTEST_CHECK(skipAndRead(data,compressed));
+  HOSTTEST_CHECK(testCorrupt(compressed));
+
+  data=makeRunData();
+  compressed=compress(data);
+  HOSTTEST_CHECK(compressed.size()<data.size()/4);
+  HOSTTEST_CHECK(roundTrip(data,compressed));
+  HOSTTEST_CHECK(skipAndRead(data,compressed));
+
+  HOSTTEST_CHECK(testStored());
+  HOSTTEST_CHECK(testDistantCopy());
+
+  return hosttest::result("LzgDecompressionTest");
+}
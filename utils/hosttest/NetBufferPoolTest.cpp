@@ -0,0 +1,323 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Stress test for the transmit buffer pool. Buffers of random sizes are allocated and
+ * released in a random order and each one is filled with a pattern that's checked when it's
+ * released, so two live buffers that overlap are found. A model of the slabs predicts where
+ * each request must be served from:
+ *
+ *   - the smallest slab that fits, or the large slab if the small one is empty
+ *   - the heap if neither can serve it
+ *
+ * and the statistics must agree with the model after every operation. NetBuffer objects come
+ * from their own slab in the same way. Every block must be 8 byte aligned and a block given
+ * back must be the next one handed out.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "HostTest.h"
+
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    OPERATIONS = 200000,
+    MAX_LIVE = 40,
+    MAX_SIZE = 1600
+  };
+
+  enum Source {
+    SMALL,
+    LARGE,
+    HEAP
+  };
+
+  struct Block {
+    uint8_t *Ptr;
+    uint32_t Size;
+    uint8_t Pattern;
+    Source From;
+  };
+
+
+  /*
+   * What the statistics of each slab should be
+   */
+
+  struct Model {
+    NetBufferPool::Statistics Small;
+    NetBufferPool::Statistics Large;
+    uint32_t HeapFallbacks;
+
+    Model(const NetBufferPool::Parameters& params) {
+
+      memset(this,0,sizeof(*this));
+
+      Small.blockSize=(params.pool_smallBufferSize+7) & ~7;
+      Small.blockCount=params.pool_smallBufferCount;
+      Large.blockSize=(params.pool_largeBufferSize+7) & ~7;
+      Large.blockCount=params.pool_largeBufferCount;
+    }
+
+    static void take(NetBufferPool::Statistics& stats) {
+      stats.allocations++;
+      if(++stats.inUse>stats.highWaterMark)
+        stats.highWaterMark=stats.inUse;
+    }
+
+    Source allocate(uint32_t size) {
+
+      if(size<=Small.blockSize) {
+        if(Small.inUse<Small.blockCount) {
+          take(Small);
+          return SMALL;
+        }
+        Small.exhausted++;
+      }
+
+      if(size<=Large.blockSize) {
+        if(Large.inUse<Large.blockCount) {
+          take(Large);
+          return LARGE;
+        }
+        Large.exhausted++;
+      }
+
+      HeapFallbacks++;
+      return HEAP;
+    }
+
+    void release(Source from) {
+      if(from==SMALL)
+        Small.inUse--;
+      else if(from==LARGE)
+        Large.inUse--;
+    }
+  };
+
+
+  bool operator==(const NetBufferPool::Statistics& a,const NetBufferPool::Statistics& b) {
+    return a.blockSize==b.blockSize
+        && a.blockCount==b.blockCount
+        && a.inUse==b.inUse
+        && a.highWaterMark==b.highWaterMark
+        && a.allocations==b.allocations
+        && a.exhausted==b.exhausted;
+  }
+
+
+  bool check(const Block& block) {
+
+    uint32_t i;
+
+    for(i=0;i<block.Size;i++)
+      if(block.Ptr[i]!=static_cast<uint8_t>(block.Pattern+i))
+        return false;
+
+    return true;
+  }
+
+
+  /*
+   * Random allocations and releases of the data buffers against the model
+   */
+
+  void testBuffers(const NetBufferPool::Parameters& params) {
+
+    NetBufferPool pool;
+    std::vector<Block> live;
+    void *released[HEAP];
+    Block block;
+    uint32_t op,i,index;
+    bool ok;
+
+    if(!pool.initialise(params)) {
+      HOSTTEST_CHECK(!"initialise");
+      return;
+    }
+
+    Model model(params);
+
+    srand(1);
+    released[SMALL]=released[LARGE]=nullptr;
+    ok=true;
+
+    for(op=0;ok && op<OPERATIONS;op++) {
+
+      if(live.size()<MAX_LIVE && (live.empty() || rand() % 2)) {
+
+        // mostly control packets and full frames, with some of everything else
+
+        switch(rand() % 4) {
+          case 0:  block.Size=1+rand() % params.pool_smallBufferSize; break;
+          case 1:  block.Size=params.pool_largeBufferSize-rand() % 100; break;
+          default: block.Size=1+rand() % MAX_SIZE; break;
+        }
+
+        block.From=model.allocate(block.Size);
+        block.Pattern=rand();
+        block.Ptr=static_cast<uint8_t *>(NetBufferPool::allocateBuffer(block.Size));
+
+        ok=block.Ptr!=nullptr && (reinterpret_cast<uintptr_t>(block.Ptr) & 7)==0;
+
+        // the last block given back to a slab is the first one out of it again
+
+        if(block.From!=HEAP) {
+          if(ok && released[block.From])
+            ok=block.Ptr==released[block.From];
+
+          released[block.From]=nullptr;
+        }
+
+        for(i=0;ok && i<block.Size;i++)
+          block.Ptr[i]=block.Pattern+i;
+
+        live.push_back(block);
+      }
+      else {
+
+        index=rand() % live.size();
+        block=live[index];
+        live.erase(live.begin()+index);
+
+        ok=check(block);
+
+        NetBufferPool::releaseBuffer(block.Ptr);
+        model.release(block.From);
+
+        if(block.From!=HEAP)
+          released[block.From]=block.Ptr;
+      }
+
+      ok=ok
+         && pool.getSmallBufferStatistics()==model.Small
+         && pool.getLargeBufferStatistics()==model.Large
+         && pool.getHeapFallbacks()==model.HeapFallbacks;
+    }
+
+    HOSTTEST_CHECK(ok);
+
+    // both slabs must have run dry and overflowed to the heap at some point
+
+    HOSTTEST_CHECK(model.Small.highWaterMark==model.Small.blockCount && model.Small.exhausted>0);
+    HOSTTEST_CHECK(model.Large.highWaterMark==model.Large.blockCount && model.Large.exhausted>0);
+    HOSTTEST_CHECK(model.HeapFallbacks>0);
+
+    for(const Block& b : live) {
+      HOSTTEST_CHECK(check(b));
+      NetBufferPool::releaseBuffer(b.Ptr);
+    }
+
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==0);
+    HOSTTEST_CHECK(pool.getLargeBufferStatistics().inUse==0);
+  }
+
+
+  /*
+   * NetBuffer objects come from their own slab and go to the heap when it's empty
+   */
+
+  void testNetBuffers(const NetBufferPool::Parameters& params) {
+
+    NetBufferPool pool;
+    std::vector<NetBuffer *> live;
+    uint32_t i,count;
+
+    if(!pool.initialise(params)) {
+      HOSTTEST_CHECK(!"initialise");
+      return;
+    }
+
+    count=params.pool_netBufferCount+5;
+
+    for(i=0;i<count;i++)
+      live.push_back(new NetBuffer(20,20));
+
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().inUse==params.pool_netBufferCount);
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().exhausted==5);
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==params.pool_smallBufferCount);
+    HOSTTEST_CHECK(pool.getLargeBufferStatistics().inUse==params.pool_largeBufferCount);
+
+    for(NetBuffer *nb : live) {
+      HOSTTEST_CHECK(nb->isValid());
+      HOSTTEST_CHECK((reinterpret_cast<uintptr_t>(nb) & 7)==0);
+      delete nb;
+    }
+
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().inUse==0);
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().highWaterMark==params.pool_netBufferCount);
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().allocations==params.pool_netBufferCount);
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==0);
+
+    // 5 NetBuffers and the internal buffers that neither slab could hold
+
+    HOSTTEST_CHECK(pool.getHeapFallbacks()==5+count-params.pool_smallBufferCount-params.pool_largeBufferCount);
+  }
+
+
+  /*
+   * A slab with no blocks is passed over without being counted as exhausted, and the NetBuffer
+   * objects go to the heap when their slab has no blocks
+   */
+
+  void testEmptySlab() {
+
+    NetBufferPool::Parameters params;
+    NetBufferPool pool;
+    void *p;
+
+    params.pool_smallBufferCount=0;
+    params.pool_netBufferCount=0;
+
+    if(!pool.initialise(params)) {
+      HOSTTEST_CHECK(!"initialise");
+      return;
+    }
+
+    p=NetBufferPool::allocateBuffer(10);
+
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().exhausted==0);
+    HOSTTEST_CHECK(pool.getLargeBufferStatistics().inUse==1);
+
+    NetBufferPool::releaseBuffer(p);
+    HOSTTEST_CHECK(pool.getLargeBufferStatistics().inUse==0);
+
+    delete new NetBuffer(10,10);
+
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().exhausted==0);
+    HOSTTEST_CHECK(pool.getHeapFallbacks()==0);
+  }
+}
+
+
+int main() {
+
+  NetBufferPool::Parameters params;
+
+  testBuffers(params);
+
+  // odd sizes are rounded up to keep the blocks aligned
+
+  params.pool_smallBufferSize=61;
+  params.pool_smallBufferCount=3;
+  params.pool_largeBufferSize=1001;
+  params.pool_largeBufferCount=5;
+
+  testBuffers(params);
+
+  testNetBuffers(NetBufferPool::Parameters());
+  testEmptySlab();
+
+  return hosttest::result("NetBufferPoolTest");
+}
@@ -0,0 +1,378 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests for the NetBuffer segment chain:
+ *
+ *   - a segment's storage and descriptor go back to the pools when its last reference goes
+ *   - a slice holds the segment that owns the data in scope, a slice of a slice refers to
+ *     the owner directly and a slice of external data holds nothing
+ *   - the user data size is the sum of the segments in the chain
+ *   - a NetBuffer whose user buffer segment can't be allocated is not valid and has no
+ *     segments, and a failed owned segment gives its storage back
+ *   - the checksum of a NetBuffer covers the headers and every segment, whatever their
+ *     lengths and alignments
+ *
+ * On the device operator new returns nullptr when the heap is exhausted. That's done here
+ * by draining the descriptor free list and making operator new fail.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "ChecksumReference.h"
+#include "HostTest.h"
+
+#include <cstdlib>
+#include <vector>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+/*
+ * operator new fails while FailAllocations is set. The library's operator delete frees
+ * what malloc() returned.
+ */
+
+namespace {
+  bool FailAllocations=false;
+}
+
+__attribute__((noinline)) void *operator new(size_t size) {
+
+  void *p;
+
+  if(FailAllocations)
+    return nullptr;
+
+  if((p=malloc(size))==nullptr)
+    throw std::bad_alloc();
+
+  return p;
+}
+
+
+namespace {
+
+  enum {
+    HEADER_SIZE = 8,
+    CHECKSUM_TRIALS = 500,
+    MAX_SEGMENTS = 6,
+    MAX_SEGMENT_SIZE = 300
+  };
+
+
+  /*
+   * All the descriptors are back in the free list and nothing is left in the slabs
+   */
+
+  bool isIdle(const NetBufferPool& pool) {
+    return NetBufferSegment::getPoolFree()==NetBufferSegment::getPoolSize()
+           && pool.getSmallBufferStatistics().inUse==0
+           && pool.getLargeBufferStatistics().inUse==0
+           && pool.getNetBufferStatistics().inUse==0;
+  }
+
+
+  /*
+   * An owned segment is freed with its last reference
+   */
+
+  void testReferenceCounting(const NetBufferPool& pool) {
+
+    NetBufferSegment *seg;
+
+    if((seg=NetBufferSegment::create(100))==nullptr) {
+      HOSTTEST_CHECK(!"create");
+      return;
+    }
+
+    HOSTTEST_CHECK(seg->getReferenceCount()==1);
+    HOSTTEST_CHECK(seg->getSize()==100);
+    HOSTTEST_CHECK(seg->getWritableData()!=nullptr && seg->getData()==seg->getWritableData());
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==1);
+
+    seg->addReference();
+    HOSTTEST_CHECK(seg->getReferenceCount()==2);
+
+    seg->release();
+    HOSTTEST_CHECK(seg->getReferenceCount()==1);
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==1);
+
+    seg->release();
+    HOSTTEST_CHECK(isIdle(pool));
+
+    // a large segment comes from the large slab
+
+    if((seg=NetBufferSegment::create(1000))==nullptr) {
+      HOSTTEST_CHECK(!"create");
+      return;
+    }
+
+    HOSTTEST_CHECK(pool.getLargeBufferStatistics().inUse==1);
+    seg->release();
+    HOSTTEST_CHECK(isIdle(pool));
+  }
+
+
+  /*
+   * Slices keep the owner in scope and point at the right bytes
+   */
+
+  void testSlices(const NetBufferPool& pool) {
+
+    NetBufferSegment *owner,*slice,*sliceOfSlice,*external,*externalSlice;
+    uint8_t data[50];
+    uint16_t i;
+
+    if((owner=NetBufferSegment::create(100))==nullptr) {
+      HOSTTEST_CHECK(!"create");
+      return;
+    }
+
+    for(i=0;i<100;i++)
+      owner->getWritableData()[i]=i;
+
+    slice=NetBufferSegment::createSlice(*owner,10,20);
+    sliceOfSlice=NetBufferSegment::createSlice(*slice,5,5);
+
+    if(slice==nullptr || sliceOfSlice==nullptr) {
+      HOSTTEST_CHECK(!"createSlice");
+      return;
+    }
+
+    HOSTTEST_CHECK(owner->getReferenceCount()==3);
+    HOSTTEST_CHECK(slice->getReferenceCount()==1);
+    HOSTTEST_CHECK(slice->getData()==owner->getData()+10 && slice->getSize()==20);
+    HOSTTEST_CHECK(sliceOfSlice->getData()==owner->getData()+15 && sliceOfSlice->getSize()==5);
+    HOSTTEST_CHECK(slice->getWritableData()==nullptr);
+
+    // the owner's storage outlives the caller's reference to it
+
+    owner->release();
+    slice->release();
+
+    HOSTTEST_CHECK(owner->getReferenceCount()==1);
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==1);
+    HOSTTEST_CHECK(sliceOfSlice->getData()[0]==15 && sliceOfSlice->getData()[4]==19);
+
+    sliceOfSlice->release();
+    HOSTTEST_CHECK(isIdle(pool));
+
+    // slices of external data don't reference it
+
+    if((external=NetBufferSegment::createExternal(data,sizeof(data)))==nullptr
+        || (externalSlice=NetBufferSegment::createSlice(*external,40,10))==nullptr) {
+      HOSTTEST_CHECK(!"createExternal");
+      return;
+    }
+
+    HOSTTEST_CHECK(external->getReferenceCount()==1);
+    HOSTTEST_CHECK(external->getWritableData()==nullptr);
+    HOSTTEST_CHECK(externalSlice->getData()==data+40);
+
+    external->release();
+    HOSTTEST_CHECK(NetBufferSegment::getPoolFree()==NetBufferSegment::getPoolSize()-1);
+
+    externalSlice->release();
+    HOSTTEST_CHECK(isIdle(pool));
+  }
+
+
+  /*
+   * The user data size and count follow the chain, a nullptr segment is refused and
+   * everything goes back when the NetBuffer is deleted
+   */
+
+  void testChain(const NetBufferPool& pool) {
+
+    NetBufferSegment *owned,*seg;
+    uint8_t data[50];
+    NetBuffer *nb;
+
+    nb=new NetBuffer(HEADER_SIZE,0,data,sizeof(data));
+
+    HOSTTEST_CHECK(nb->isValid());
+    HOSTTEST_CHECK(nb->getUserBuffer()==data);
+    HOSTTEST_CHECK(nb->getUserBufferSize()==sizeof(data));
+    HOSTTEST_CHECK(nb->getSegmentCount()==1);
+    HOSTTEST_CHECK(nb->getSizeFromWritePointerToEnd()==0);
+    HOSTTEST_CHECK(nb->moveWritePointerBack(HEADER_SIZE)==nb->getInternalBuffer());
+    HOSTTEST_CHECK(nb->getSizeFromWritePointerToEnd()==HEADER_SIZE);
+
+    owned=NetBufferSegment::create(30);
+
+    HOSTTEST_CHECK(nb->appendSegment(owned));
+    HOSTTEST_CHECK(nb->appendSegment(NetBufferSegment::createSlice(*owned,3,7)));
+    HOSTTEST_CHECK(!nb->appendSegment(nullptr));
+
+    HOSTTEST_CHECK(nb->getUserBufferSize()==sizeof(data)+30+7);
+    HOSTTEST_CHECK(nb->getSegmentCount()==3);
+    HOSTTEST_CHECK(nb->getUserBuffer()==data);
+
+    seg=nb->getFirstSegment();
+    HOSTTEST_CHECK(seg->getData()==data);
+    seg=seg->getNext();
+    HOSTTEST_CHECK(seg==owned && owned->getReferenceCount()==2);
+    seg=seg->getNext();
+    HOSTTEST_CHECK(seg->getData()==owned->getData()+3 && seg->getNext()==nullptr);
+
+    HOSTTEST_CHECK(pool.getNetBufferStatistics().inUse==1);
+
+    delete nb;
+    HOSTTEST_CHECK(isIdle(pool));
+
+    // a buffer with no user data has no segments
+
+    nb=new NetBuffer(HEADER_SIZE,20);
+
+    HOSTTEST_CHECK(nb->isValid());
+    HOSTTEST_CHECK(nb->getFirstSegment()==nullptr && nb->getUserBuffer()==nullptr);
+    HOSTTEST_CHECK(nb->getUserBufferSize()==0 && nb->getSegmentCount()==0);
+    HOSTTEST_CHECK(nb->getSizeFromWritePointerToEnd()==0);
+
+    delete nb;
+    HOSTTEST_CHECK(isIdle(pool));
+  }
+
+
+  /*
+   * With no descriptors left a NetBuffer can't wrap its user buffer and is not valid. An
+   * owned segment that can't get a descriptor gives its storage back.
+   */
+
+  void testAllocationFailure(const NetBufferPool& pool) {
+
+    std::vector<NetBufferSegment *> drained;
+    uint8_t data[50];
+    NetBuffer *nb;
+
+    while(NetBufferSegment::getPoolFree())
+      drained.push_back(NetBufferSegment::createExternal(data,sizeof(data)));
+
+    FailAllocations=true;
+
+    HOSTTEST_CHECK(NetBufferSegment::createExternal(data,sizeof(data))==nullptr);
+    HOSTTEST_CHECK(NetBufferSegment::create(10)==nullptr);
+    HOSTTEST_CHECK(pool.getSmallBufferStatistics().inUse==0);
+
+    nb=new NetBuffer(HEADER_SIZE,0,data,sizeof(data));
+
+    HOSTTEST_CHECK(!nb->isValid());
+    HOSTTEST_CHECK(nb->getSegmentCount()==0 && nb->getUserBufferSize()==0);
+
+    delete nb;
+
+    FailAllocations=false;
+
+    // the pool grows again once there's memory
+
+    nb=new NetBuffer(HEADER_SIZE,0,data,sizeof(data));
+    HOSTTEST_CHECK(nb->isValid() && nb->getUserBufferSize()==sizeof(data));
+    delete nb;
+
+    for(NetBufferSegment *seg : drained)
+      seg->release();
+
+    HOSTTEST_CHECK(isIdle(pool));
+  }
+
+
+  /*
+   * The sum of a NetBuffer is the sum of its header and segments laid end to end. The
+   * segments have random lengths, odd ones included, and are owned, external or slices at
+   * odd offsets.
+   */
+
+  void testChecksum(const NetBufferPool& pool) {
+
+    std::vector<uint8_t> external(MAX_SEGMENT_SIZE+1),expected;
+    NetBufferSegment *seg,*parent;
+    uint32_t trial,count,i,size,offset;
+    InternetChecksum sum;
+    uint8_t *header;
+    NetBuffer *nb;
+
+    srand(1);
+
+    for(i=0;i<external.size();i++)
+      external[i]=rand();
+
+    for(trial=0;trial<CHECKSUM_TRIALS;trial++) {
+
+      nb=new NetBuffer(HEADER_SIZE,0);
+      header=static_cast<uint8_t *>(nb->moveWritePointerBack(1+rand() % HEADER_SIZE));
+
+      expected.assign(header,header+nb->getSizeFromWritePointerToEnd());
+
+      for(i=0;i<expected.size();i++)
+        header[i]=expected[i]=rand();
+
+      count=rand() % (MAX_SEGMENTS+1);
+
+      for(i=0;i<count;i++) {
+
+        size=1+rand() % MAX_SEGMENT_SIZE;
+
+        switch(rand() % 3) {
+
+          case 0:
+            seg=NetBufferSegment::create(size);
+            for(offset=0;offset<size;offset++)
+              seg->getWritableData()[offset]=rand();
+            break;
+
+          case 1:
+            offset=rand() % (external.size()-size+1);
+            seg=NetBufferSegment::createExternal(&external[offset],size);
+            break;
+
+          default:
+            parent=NetBufferSegment::create(MAX_SEGMENT_SIZE+1);
+            for(offset=0;offset<MAX_SEGMENT_SIZE+1;offset++)
+              parent->getWritableData()[offset]=rand();
+
+            offset=rand() % (MAX_SEGMENT_SIZE+1-size+1);
+            seg=NetBufferSegment::createSlice(*parent,offset,size);
+            parent->release();
+            break;
+        }
+
+        expected.insert(expected.end(),seg->getData(),seg->getData()+size);
+        HOSTTEST_CHECK(nb->appendSegment(seg));
+      }
+
+      HOSTTEST_CHECK(nb->getSizeFromWritePointerToEnd()+nb->getUserBufferSize()==expected.size());
+
+      sum.reset();
+      sum.add(*nb);
+
+      HOSTTEST_CHECK(sum.getSum()==hosttest::referenceSum(&expected[0],expected.size()));
+
+      delete nb;
+    }
+
+    HOSTTEST_CHECK(isIdle(pool));
+  }
+}
+
+
+int main() {
+
+  NetBufferPool pool;
+
+  if(!pool.initialise(NetBufferPool::Parameters()))
+    return 1;
+
+  testReferenceCounting(pool);
+  testSlices(pool);
+  testChain(pool);
+  testAllocationFailure(pool);
+  testChecksum(pool);
+
+  return hosttest::result("NetBufferTest");
+}
@@ -0,0 +1,290 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Network event bus dispatch. There are two parts.
+ *
+ * The first raises a received frame and a frame-sent notification, which is what every
+ * frame costs, to the subscribers that a stack with ARP, IP, ping, UDP, TCP, DNS and a TCP
+ * server has on the receive and notification buses. The old bus called every subscriber
+ * for every event and each one checked the type; the typed bus only calls the subscribers
+ * for the type.
+ *
+ * The second runs the composed stack on the memory network with a host sending it batches
+ * of echo requests. It prints the frames per second that the stack handles on the host and
+ * how many events of each type were raised per frame. Every request must be answered.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+
+#include <chrono>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    EVENTS = 5000000,
+    ECHO_REQUESTS = 200000,
+    BATCH_SIZE = 64,
+    ECHO_DATA_SIZE = 56,
+    TIMEOUT = 5000
+  };
+
+  typedef NetEventDescriptor::NetEventType NetEventType;
+  typedef wink::slot<void (NetEventDescriptor&)> Slot;
+
+
+  /*
+   * Part 1: a layer's handler that switches on the event type like the real ones do
+   */
+
+  struct Layer {
+
+    NetEventType Type;
+    uint32_t Hits;
+
+    __attribute__((noinline)) void onEvent(NetEventDescriptor& ned) {
+      if(ned.eventType==Type)
+        Hits++;
+    }
+  };
+
+  // the subscriptions in the stack that the second part runs, plus a TCP server and its array
+
+  const NetEventType RECEIVE_TYPES[]={
+    NetEventType::DATALINK_FRAME,               // ARP
+    NetEventType::DATALINK_FRAME,               // IP
+    NetEventType::ICMP_PACKET                   // ping
+  };
+
+  const NetEventType NOTIFICATION_TYPES[]={
+    NetEventType::ARP_MAPPING_REQUEST,          // ARP
+    NetEventType::IP_ADDRESS_ANNOUNCEMENT,      // ARP, IP
+    NetEventType::MAC_ADDRESS_ANNOUNCEMENT,     // ARP, IP
+    NetEventType::DATALINK_FRAME_SENT,          // UDP
+    NetEventType::TCP_CONNECTION_RELEASED,      // TCP, server, array
+    NetEventType::TCP_CONNECTION_RELEASED,
+    NetEventType::TCP_CONNECTION_RELEASED,
+    NetEventType::TCP_SERVER_RELEASED,          // TCP, array
+    NetEventType::TCP_SERVER_RELEASED,
+    NetEventType::TCP_FIND_CONNECTION,          // TCP
+    NetEventType::DNS_SERVERS_ANNOUNCEMENT      // DNS
+  };
+
+  const uint32_t RECEIVE_COUNT=sizeof(RECEIVE_TYPES)/sizeof(RECEIVE_TYPES[0]);
+  const uint32_t NOTIFICATION_COUNT=sizeof(NOTIFICATION_TYPES)/sizeof(NOTIFICATION_TYPES[0]);
+
+
+  template<class TReceive,class TNotification>
+  double raise(TReceive& receive,TNotification& notification) {
+
+    NetEventDescriptor frame(NetEventType::DATALINK_FRAME);
+    NetEventDescriptor sent(NetEventType::DATALINK_FRAME_SENT);
+    uint32_t i;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<EVENTS;i++) {
+      receive.raiseEvent(frame);
+      notification.raiseEvent(sent);
+    }
+
+    std::chrono::duration<double,std::nano> elapsed=std::chrono::steady_clock::now()-start;
+    return elapsed.count()/EVENTS;
+  }
+
+
+  uint32_t getHits(const Layer *layers,uint32_t count) {
+
+    uint32_t hits;
+
+    hits=0;
+    while(count--)
+      hits+=layers++->Hits;
+
+    return hits;
+  }
+
+
+  bool dispatch() {
+
+    wink::signal<Slot> signalReceive,signalNotification;
+    NetEventSource<Slot> typedReceive,typedNotification;
+    Layer layers[RECEIVE_COUNT+NOTIFICATION_COUNT];
+    uint32_t i,wanted,signalHits,typedHits;
+    double signalTime,typedTime;
+
+    wanted=0;
+
+    for(i=0;i<RECEIVE_COUNT+NOTIFICATION_COUNT;i++) {
+
+      layers[i].Type=i<RECEIVE_COUNT ? RECEIVE_TYPES[i] : NOTIFICATION_TYPES[i-RECEIVE_COUNT];
+      layers[i].Hits=0;
+
+      if(layers[i].Type==(i<RECEIVE_COUNT ? NetEventType::DATALINK_FRAME : NetEventType::DATALINK_FRAME_SENT))
+        wanted++;
+
+      if(i<RECEIVE_COUNT) {
+        signalReceive.insertSubscriber(Slot::bind(&layers[i],&Layer::onEvent));
+        typedReceive.insertSubscriber(layers[i].Type,Slot::bind(&layers[i],&Layer::onEvent));
+      }
+      else {
+        signalNotification.insertSubscriber(Slot::bind(&layers[i],&Layer::onEvent));
+        typedNotification.insertSubscriber(layers[i].Type,Slot::bind(&layers[i],&Layer::onEvent));
+      }
+    }
+
+    signalTime=raise(signalReceive,signalNotification);
+    signalHits=getHits(layers,RECEIVE_COUNT+NOTIFICATION_COUNT);
+
+    typedTime=raise(typedReceive,typedNotification);
+    typedHits=getHits(layers,RECEIVE_COUNT+NOTIFICATION_COUNT)-signalHits;
+
+    printf("%-12s %6u %6u %12.1f %14.0f\n","signal",RECEIVE_COUNT+NOTIFICATION_COUNT,RECEIVE_COUNT+NOTIFICATION_COUNT,signalTime,1e9/signalTime);
+    printf("%-12s %6u %6u %12.1f %14.0f\n","typed",RECEIVE_COUNT+NOTIFICATION_COUNT,wanted,typedTime,1e9/typedTime);
+
+    // the same layers must have seen each frame both ways
+
+    if(signalHits!=EVENTS*wanted || typedHits!=EVENTS*wanted) {
+      printf("the layers were called %u and %u times for %u frames\n",signalHits,typedHits,EVENTS);
+      return false;
+    }
+
+    if(typedReceive.getDispatchCount(NetEventType::DATALINK_FRAME)!=EVENTS ||
+       typedNotification.getDispatchCount(NetEventType::DATALINK_FRAME_SENT)!=EVENTS) {
+      printf("the dispatch counts are wrong\n");
+      return false;
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Part 2: echo requests through the stack
+   */
+
+  struct EventCount {
+    const char *Name;
+    NetEventType Type;
+  };
+
+  const EventCount RECEIVE_EVENTS[]={
+    { "DATALINK_FRAME",NetEventType::DATALINK_FRAME },
+    { "ICMP_PACKET",NetEventType::ICMP_PACKET }
+  };
+
+  const EventCount SEND_EVENTS[]={
+    { "IP_TRANSMIT_REQUEST",NetEventType::IP_TRANSMIT_REQUEST },
+    { "ETHERNET_TRANSMIT_REQUEST",NetEventType::ETHERNET_TRANSMIT_REQUEST }
+  };
+
+  const EventCount NOTIFICATION_EVENTS[]={
+    { "DATALINK_FRAME_SENT",NetEventType::DATALINK_FRAME_SENT },
+    { "IP_ADDRESS_MAPPING",NetEventType::IP_ADDRESS_MAPPING },
+    { "ARP_MAPPING_REQUEST",NetEventType::ARP_MAPPING_REQUEST }
+  };
+
+
+  template<class TSource,uint32_t N>
+  void printCounts(const TSource& source,const EventCount (&counts)[N],uint32_t frames) {
+
+    for(const EventCount& ec : counts)
+      printf("  %-28s %8.2f\n",ec.Name,source.getDispatchCount(ec.Type)/static_cast<double>(frames));
+  }
+
+
+  bool echo() {
+
+    MemoryNetwork network;
+    uint8_t data[ECHO_DATA_SIZE];
+    uint32_t i,sent,frames;
+    bool ok;
+
+    if(!network.initialise()) {
+      printf("The stack did not start\n");
+      return false;
+    }
+
+    MemoryHost host(network,"192.168.0.20");
+    MemoryNetworkStack& stack(network.getStack());
+
+    for(i=0;i<sizeof(data);i++)
+      data[i]=i;
+
+    // the first request teaches the stack the host's address
+
+    host.sendEchoRequest(1,0,data,sizeof(data));
+
+    if(!network.runUntil([&] { return host.getCounters().EchoReplies==1; },TIMEOUT)) {
+      printf("The first echo request was not answered\n");
+      return false;
+    }
+
+    host.resetCounters();
+    network.resetCounters();
+    stack.NetworkReceiveEventSender.resetDispatchCounts();
+    stack.NetworkSendEventSender.resetDispatchCounts();
+    stack.NetworkNotificationEventSender.resetDispatchCounts();
+
+    ok=true;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(sent=0;sent<ECHO_REQUESTS && ok;) {
+
+      for(i=0;i<BATCH_SIZE;i++)
+        host.sendEchoRequest(1,sent++,data,sizeof(data));
+
+      ok=network.runUntil([&] { return host.getCounters().EchoReplies==sent; },TIMEOUT);
+    }
+
+    std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+
+    frames=network.getCounters().FramesToStack;
+
+    printf("%10u %10u %12.0f %12.2f\n",
+           frames,
+           network.getCounters().FramesFromStack,
+           frames/elapsed.count(),
+           elapsed.count()*1e6/frames);
+
+    printf("\nevents per received frame:\n");
+
+    printCounts(stack.NetworkReceiveEventSender,RECEIVE_EVENTS,frames);
+    printCounts(stack.NetworkSendEventSender,SEND_EVENTS,frames);
+    printCounts(stack.NetworkNotificationEventSender,NOTIFICATION_EVENTS,frames);
+
+    if(!ok || host.getCounters().EchoReplies!=ECHO_REQUESTS) {
+      printf("%u of %u echo requests were answered\n",host.getCounters().EchoReplies,ECHO_REQUESTS);
+      return false;
+    }
+
+    return true;
+  }
+}
+
+
+int main() {
+
+  bool ok;
+
+  printf("%-12s %6s %6s %12s %14s\n","bus","subs","called","ns/frame","frames/s");
+
+  ok=dispatch();
+
+  printf("\n%10s %10s %12s %12s\n","frames in","frames out","frames/s","host us/frm");
+
+  ok&=echo();
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,387 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests that each layer of a composed stack still receives every event type that its
+ * handler switches on now that the layers subscribe to the event bus by type. Each case
+ * drives the stack on the memory network so that a layer has to act on one of its
+ * subscribed types for the result to come out right:
+ *
+ *   - ARP:  answers requests (DATALINK_FRAME), knows its MAC and IP (MAC_ADDRESS_ANNOUNCEMENT,
+ *           IP_ADDRESS_ANNOUNCEMENT), resolves for the upper layers (ARP_MAPPING_REQUEST),
+ *           learns from incoming packets (IP_ADDRESS_MAPPING) and routes off the subnet
+ *           (SUBNET_MASK_ANNOUNCEMENT, DEFAULT_GATEWAY_ANNOUNCEMENT)
+ *   - IP:   receives (DATALINK_FRAME) and sends (IP_TRANSMIT_REQUEST)
+ *   - ICMP: sends errors for UDP (ICMP_TRANSMIT_REQUEST)
+ *   - Ping: sees the reply (ICMP_PACKET)
+ *   - UDP:  synchronous sends complete (DATALINK_FRAME_SENT)
+ *   - DNS:  queries the announced server (DNS_SERVERS_ANNOUNCEMENT)
+ *   - TCP:  finds connections (TCP_FIND_CONNECTION), frees a connection's slot in the server,
+ *           the connection array and the table (TCP_CONNECTION_RELEASED) and frees a server's
+ *           port (TCP_SERVER_RELEASED)
+ *   - DHCP and link local IP: learn the MAC address (MAC_ADDRESS_ANNOUNCEMENT)
+ *
+ * The ST MAC's PHY register requests can't be built on the host and aren't covered.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+#include "HostTest.h"
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    TIMEOUT = 5000,
+    SERVER_PORT = 80,
+    CLOSED_UDP_PORT = 9999,
+    DNS_PORT = 53
+  };
+
+  typedef NetEventDescriptor::NetEventType NetEventType;
+
+
+  /*
+   * Find the first UDP datagram that the host kept and return its destination port
+   */
+
+  bool getUdpDestinationPort(MemoryHost& host,uint16_t& port) {
+
+    std::vector<uint8_t> frame;
+    const IpPacketHeader *iph;
+    const UdpDatagram *udp;
+
+    while(host.getFrame(frame)) {
+
+      iph=reinterpret_cast<const IpPacketHeader *>(&frame[14]);
+
+      if(iph->ip_hdr_protocol==IpProtocol::UDP) {
+        udp=reinterpret_cast<const UdpDatagram *>(&frame[14+(iph->ip_hdr_version & 0xf)*4]);
+        port=NetUtil::ntohs(udp->udp_destinationPort);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  /*
+   * The host asks for the stack's MAC address and gets the announced MAC and IP back
+   */
+
+  void testArp(MemoryNetwork& network,MemoryHost& host) {
+
+    MemoryNetworkStack& stack(network.getStack());
+    uint32_t frames,sent;
+
+    frames=stack.NetworkReceiveEventSender.getDispatchCount(NetEventType::DATALINK_FRAME);
+    sent=stack.NetworkNotificationEventSender.getDispatchCount(NetEventType::DATALINK_FRAME_SENT);
+
+    host.sendArpRequest();
+
+    HOSTTEST_CHECK(network.runUntil([&] { return host.getCounters().ArpReplies==1; },TIMEOUT));
+    HOSTTEST_CHECK(host.getStackMacAddress()==MemoryNetwork::getStackMacAddress());
+
+    // one frame in, one reply out and the MAC has said that it went
+
+    network.run(10);
+
+    HOSTTEST_CHECK(stack.NetworkReceiveEventSender.getDispatchCount(NetEventType::DATALINK_FRAME)==frames+1);
+    HOSTTEST_CHECK(stack.NetworkNotificationEventSender.getDispatchCount(NetEventType::DATALINK_FRAME_SENT)==sent+1);
+  }
+
+
+  /*
+   * The host pings the stack. The reply goes back without an ARP request because the stack
+   * learned the host's address from the request.
+   */
+
+  void testEchoReply(MemoryNetwork& network,MemoryHost& host) {
+
+    host.resetCounters();
+    host.sendEchoRequest(1,1,"hello",5);
+
+    HOSTTEST_CHECK(network.runUntil([&] { return host.getCounters().EchoReplies==1; },TIMEOUT));
+    HOSTTEST_CHECK(host.getCounters().ArpRequests==0);
+  }
+
+
+  /*
+   * The stack pings a host that it hasn't heard from, so it must resolve it first
+   */
+
+  void testPing(MemoryNetwork& network) {
+
+    MemoryHost host(network,"192.168.0.30");
+    uint32_t elapsed;
+
+    HOSTTEST_CHECK(network.getStack().ping(host.getAddress(),elapsed));
+    HOSTTEST_CHECK(host.getCounters().ArpRequests==1);
+    HOSTTEST_CHECK(host.getCounters().EchoRequests==1);
+  }
+
+
+  /*
+   * A ping off the subnet goes to the gateway. Nothing answers it.
+   */
+
+  void testGateway(MemoryNetwork& network,MemoryHost& gateway) {
+
+    uint32_t elapsed;
+
+    gateway.resetCounters();
+
+    HOSTTEST_CHECK(!network.getStack().ping("10.0.0.1",elapsed));
+    HOSTTEST_CHECK(gateway.getCounters().ArpRequests==1);
+  }
+
+
+  /*
+   * A datagram to a closed port gets an ICMP port unreachable and a synchronous send to the
+   * host completes
+   */
+
+  void testUdp(MemoryNetwork& network,MemoryHost& host) {
+
+    std::vector<uint8_t> frame;
+    const IpPacketHeader *iph;
+    const IcmpDestinationUnreachable *icmp;
+    bool found;
+
+    host.sendUdp(1234,CLOSED_UDP_PORT,"x",1);
+    network.run(10);
+
+    found=false;
+
+    while(host.getFrame(frame)) {
+
+      iph=reinterpret_cast<const IpPacketHeader *>(&frame[14]);
+      icmp=reinterpret_cast<const IcmpDestinationUnreachable *>(&frame[14+(iph->ip_hdr_version & 0xf)*4]);
+
+      if(iph->ip_hdr_protocol==IpProtocol::ICMP &&
+         icmp->icmp_type==IcmpType::DESTINATION_UNREACHABLE &&
+         icmp->icmp_code==IcmpCode::DESTINATION_PORT_UNREACHABLE)
+        found=true;
+    }
+
+    HOSTTEST_CHECK(found);
+
+    // the send waits for the MAC to say that the frame has gone
+
+    HOSTTEST_CHECK(network.getStack().udpSend(host.getAddress(),1234,1234,"x",1,false,TIMEOUT));
+  }
+
+
+  /*
+   * A lookup goes to the server from the parameters, which arrived as an announcement. The
+   * server doesn't answer.
+   */
+
+  void testDns(MemoryNetwork& network,MemoryHost& server) {
+
+    std::vector<uint8_t> frame;
+    IpAddress address;
+    uint16_t port;
+
+    while(server.getFrame(frame));
+
+    HOSTTEST_CHECK(!network.getStack().dnsHostnameQuery("www.example.com",address));
+    HOSTTEST_CHECK(getUdpDestinationPort(server,port) && port==DNS_PORT);
+  }
+
+
+  /*
+   * A server connection that keeps what it reads and deletes itself when the peer closes
+   */
+
+  std::string received;
+  uint16_t closedCount;
+
+
+  class TestConnection : public TcpConnection {
+
+    protected:
+      void read() {
+
+        char buffer[64];
+        uint32_t actuallyRead;
+
+        while(getDataAvailable() && receive(buffer,sizeof(buffer),actuallyRead,0) && actuallyRead)
+          received.append(buffer,actuallyRead);
+      }
+
+    public:
+      TestConnection(const Parameters& params)
+        : TcpConnection(params) {
+      }
+
+      bool handleRead() {
+        read();
+        return true;
+      }
+
+      bool handleWrite() {
+        return true;
+      }
+
+      bool handleClosed() {
+        read();
+        closedCount++;
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+  };
+
+
+  /*
+   * The server takes one connection at a time, so the second peer is only accepted if the
+   * first connection's release reached the server, the array and the connection table.
+   * Then the server is deleted and the port must be free for a new one.
+   */
+
+  void testTcp(MemoryNetwork& network) {
+
+    MemoryNetworkStack& stack(network.getStack());
+    TcpServer<TestConnection> *server;
+    uint32_t startTime;
+
+    server=nullptr;
+    HOSTTEST_CHECK(stack.tcpCreateServer(SERVER_PORT,server));
+
+    if(server==nullptr)
+      return;
+
+    TcpConnectionArray<TestConnection> connections(*server);
+    server->start();
+
+    MemoryTcpPeer first(network,"192.168.0.40",50000);
+    first.connect(SERVER_PORT);
+
+    HOSTTEST_CHECK(network.runUntil([&] { return first.getState()==MemoryTcpPeer::State::ESTABLISHED; },TIMEOUT));
+
+    // the connection can be found by its addresses
+
+    TcpFindConnectionNotificationEvent tfcne(first.getAddress(),first.getPort(),SERVER_PORT);
+    stack.NetworkNotificationEventSender.raiseEvent(tfcne);
+    HOSTTEST_CHECK(tfcne.tcpConnection!=nullptr);
+
+    // close the first and connect the second
+
+    received.clear();
+    closedCount=0;
+
+    first.send("first");
+    first.close();
+
+    startTime=MillisecondTimer::millis();
+
+    while(closedCount<1 && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+      connections.wait(TcpWaitState::READ | TcpWaitState::CLOSED,10);
+
+    HOSTTEST_CHECK(received=="first");
+
+    TcpFindConnectionNotificationEvent gone(first.getAddress(),first.getPort(),SERVER_PORT);
+    stack.NetworkNotificationEventSender.raiseEvent(gone);
+    HOSTTEST_CHECK(gone.tcpConnection==nullptr);
+
+    MemoryTcpPeer second(network,"192.168.0.41",50001);
+    second.connect(SERVER_PORT);
+
+    HOSTTEST_CHECK(network.runUntil([&] { return second.getState()==MemoryTcpPeer::State::ESTABLISHED; },TIMEOUT));
+
+    second.send("second");
+    second.close();
+
+    startTime=MillisecondTimer::millis();
+
+    while(closedCount<2 && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+      connections.wait(TcpWaitState::READ | TcpWaitState::CLOSED,10);
+
+    HOSTTEST_CHECK(received=="firstsecond");
+
+    // the released server gives up its port and the array lets go of it
+
+    delete server;
+    server=nullptr;
+
+    HOSTTEST_CHECK(stack.tcpCreateServer(SERVER_PORT,server));
+    HOSTTEST_CHECK(server!=nullptr && connections.autoAdd(*server));
+
+    delete server;
+  }
+
+
+  /*
+   * Stacks with the address clients. Only the MAC announcement is tested because their
+   * startup() waits on the network.
+   */
+
+  template<template<class> class TClient>
+  class ClientStack : public NetworkStack<ApplicationLayer<MemoryTransportLayer,TClient>> {
+
+    public:
+      const MacAddress& getClientMacAddress() const {
+        return TClient<MemoryTransportLayer>::_myMacAddress;
+      }
+  };
+
+
+  template<template<class> class TClient>
+  void testClientMacAddress() {
+
+    RtcSecondInterruptFeature rtc;
+    ClientStack<TClient> stack;
+    typename ClientStack<TClient>::Parameters params;
+
+    params.base_rtc=&rtc;
+    params.mac_address=MemoryNetwork::getStackMacAddress();
+
+    HOSTTEST_CHECK(stack.initialise(params));
+    HOSTTEST_CHECK(!stack.getClientMacAddress().isValid());
+
+    stack.MemoryMac<MemoryPhysicalLayer>::startup();
+    HOSTTEST_CHECK(stack.getClientMacAddress()==MemoryNetwork::getStackMacAddress());
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+
+  network.getParameters().tcp_maxConnectionsPerServer=1;
+  network.getParameters().tcp_maxServers=1;
+  network.getParameters().dns_timeout=100;
+  network.getParameters().dns_retries=1;
+
+  HOSTTEST_CHECK(network.initialise());
+
+  MemoryHost gateway(network,"192.168.0.1");
+  MemoryHost host(network,"192.168.0.20");
+
+  testArp(network,host);
+  testEchoReply(network,host);
+  testPing(network);
+  testGateway(network,gateway);
+  testUdp(network,host);
+  testDns(network,gateway);
+  testTcp(network);
+
+  testClientMacAddress<DhcpClient>();
+  testClientMacAddress<LinkLocalIp>();
+
+  return hosttest::result("NetEventSourceTest");
+}
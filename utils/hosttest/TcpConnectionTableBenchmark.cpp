@@ -0,0 +1,380 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * TCP segment demultiplexing with many open connections. There are two parts.
+ *
+ * The first times the connection table on its own against what it replaced, which was
+ * every connection subscribed to the receive signal and checking its own 4-tuple. The same
+ * segments are looked up with 8 to 128 connections open and the cost per segment is printed.
+ *
+ * The second runs the real stack on the memory network with 8 to 128 peers, each with its
+ * own address, connected to one server. Every peer sends 8KB and closes and the server
+ * checks that each connection got exactly what its peer sent. The host time per segment
+ * received by the stack should stay flat as the number of connections goes up.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+
+#include <chrono>
+#include <map>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    LOOKUPS = 2000000,
+    DATA_SIZE = 8192,
+    SERVER_PORT = 80,
+    FIRST_PEER_PORT = 50000,
+    TIMEOUT = 600000
+  };
+
+  const uint16_t CONNECTION_COUNTS[]={ 8,32,64,128 };
+
+
+  /*
+   * Part 1: a connection that subscribes to the signal as every connection used to and one
+   * that sits in the table
+   */
+
+  struct Subscriber {
+
+    TcpConnectionTable::Entry Entry;
+    IpPacketHeader IpHeader;
+    IpPacket Packet;
+    TcpHeader Header;
+    uint32_t Hits;
+
+    void onBroadcast(TcpSegmentEvent& event) {
+
+      if(event.ipPacket.header->ip_sourceAddress!=Entry.remoteAddress ||
+         event.sourcePort!=Entry.remotePort ||
+         event.destinationPort!=Entry.localPort)
+        return;
+
+      event.handled=true;
+      Hits++;
+    }
+
+    void onReceive(TcpSegmentEvent& event) {
+      event.handled=true;
+      Hits++;
+    }
+  };
+
+
+  IpAddress getPeerAddress(uint16_t index) {
+
+    char address[20];
+
+    sprintf(address,"192.168.0.%d",20+index);
+    return IpAddress(address);
+  }
+
+
+  uint32_t getHits(const std::vector<Subscriber>& subscribers) {
+
+    uint32_t hits;
+
+    hits=0;
+    for(const Subscriber& s : subscribers)
+      hits+=s.Hits;
+
+    return hits;
+  }
+
+
+  bool lookup(uint16_t count) {
+
+    TcpReceiveEventSourceType signal;
+    TcpConnectionTable table;
+    std::vector<Subscriber> subscribers(count);
+    uint32_t i,broadcastHits,tableHits;
+    const TcpConnectionTable::Entry *entry;
+
+    table.initialise(count);
+
+    for(i=0;i<count;i++) {
+
+      Subscriber& s(subscribers[i]);
+
+      s.Entry.remoteAddress=getPeerAddress(i);
+      s.Entry.remotePort=FIRST_PEER_PORT+i;
+      s.Entry.localPort=SERVER_PORT;
+      s.Entry.connection=nullptr;
+      s.Entry.handler=TcpReceiveEventSourceSlot::bind(&s,&Subscriber::onReceive);
+
+      s.IpHeader.ip_sourceAddress=s.Entry.remoteAddress;
+      s.Packet.header=&s.IpHeader;
+      s.Header.initialise(FIRST_PEER_PORT+i,SERVER_PORT,0,0,0,TcpHeaderFlags::ACK);
+      s.Hits=0;
+
+      signal.insertSubscriber(TcpReceiveEventSourceSlot::bind(&s,&Subscriber::onBroadcast));
+      table.addConnection(s.Entry);
+    }
+
+    // the same segments in the same order for both, stepping through the connections
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<LOOKUPS;i++) {
+
+      Subscriber& s(subscribers[(i*13) % count]);
+      TcpSegmentEvent event(s.Packet,s.Header,nullptr,0,FIRST_PEER_PORT+(i*13) % count,SERVER_PORT);
+
+      signal.raiseEvent(event);
+    }
+
+    auto middle=std::chrono::steady_clock::now();
+
+    broadcastHits=getHits(subscribers);
+
+    for(i=0;i<LOOKUPS;i++) {
+
+      Subscriber& s(subscribers[(i*13) % count]);
+      TcpSegmentEvent event(s.Packet,s.Header,nullptr,0,FIRST_PEER_PORT+(i*13) % count,SERVER_PORT);
+
+      if((entry=table.findConnection(event.ipPacket.header->ip_sourceAddress,event.sourcePort,event.destinationPort))!=nullptr)
+        entry->handler(event);
+    }
+
+    auto end=std::chrono::steady_clock::now();
+
+    tableHits=getHits(subscribers)-broadcastHits;
+
+    for(i=0;i<count;i++)
+      table.removeConnection(subscribers[i].Entry);
+
+    std::chrono::duration<double,std::nano> broadcast=middle-start;
+    std::chrono::duration<double,std::nano> hashed=end-middle;
+
+    printf("%6u %14.1f %14.1f %8.1fx\n",
+           count,
+           broadcast.count()/LOOKUPS,
+           hashed.count()/LOOKUPS,
+           broadcast.count()/hashed.count());
+
+    // each segment must have been claimed exactly once both ways
+
+    if(broadcastHits!=LOOKUPS || tableHits!=LOOKUPS) {
+      printf("%u connections: %u and %u of %u segments were delivered\n",count,broadcastHits,tableHits,LOOKUPS);
+      return false;
+    }
+
+    return true;
+  }
+
+
+  /*
+   * Part 2: a server connection that reads everything and checks it against the pattern that
+   * its peer sends
+   */
+
+  uint8_t getPattern(uint16_t index,uint32_t position) {
+    return (position*7+index) & 0xff;
+  }
+
+
+  std::map<uint32_t,uint32_t> receivedBytes;
+  std::map<uint32_t,bool> receivedCorrectly;
+  uint16_t closedCount;
+
+
+  class BenchmarkConnection : public TcpConnection {
+
+    protected:
+      uint16_t _index;
+      uint32_t _received;
+      bool _correct;
+
+    protected:
+      void read() {
+
+        uint8_t buffer[256];
+        uint32_t i,actuallyRead;
+
+        while(getDataAvailable()) {
+
+          if(!receive(buffer,sizeof(buffer),actuallyRead,0) || actuallyRead==0)
+            return;
+
+          for(i=0;i<actuallyRead;i++)
+            if(buffer[i]!=getPattern(_index,_received+i))
+              _correct=false;
+
+          _received+=actuallyRead;
+        }
+      }
+
+    public:
+      BenchmarkConnection(const Parameters& params)
+        : TcpConnection(params),
+          _received(0),
+          _correct(true) {
+      }
+
+      bool handleRead() {
+
+        _index=getRemoteAddress().ipAddressBytes[3]-20;
+        read();
+        return true;
+      }
+
+      bool handleWrite() {
+        return true;
+      }
+
+      bool handleClosed() {
+
+        _index=getRemoteAddress().ipAddressBytes[3]-20;
+        read();
+
+        receivedBytes[_index]=_received;
+        receivedCorrectly[_index]=_correct;
+        closedCount++;
+
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+  };
+
+
+  bool transfer(uint16_t count) {
+
+    MemoryNetwork network;
+    TcpServer<BenchmarkConnection> *server;
+    std::vector<MemoryTcpPeer *> peers;
+    std::string data;
+    uint32_t i,segments,startTime;
+    uint16_t index;
+    char address[20];
+    bool ok;
+
+    network.getParameters().tcp_maxConnectionsPerServer=count;
+    network.getParameters().tcp_connectionTableSize=count;
+    network.getParameters().arp_cacheSize=count;
+
+    if(!network.initialise()) {
+      printf("The stack did not start\n");
+      return false;
+    }
+
+    server=nullptr;
+
+    if(!network.getStack().tcpCreateServer(SERVER_PORT,server)) {
+      printf("The server was not created\n");
+      return false;
+    }
+
+    TcpConnectionArray<BenchmarkConnection> connections(*server);
+    server->start();
+
+    // connect all the peers and let the server accept them
+
+    for(index=0;index<count;index++) {
+      getPeerAddress(index).toString(address);
+      peers.push_back(new MemoryTcpPeer(network,address,FIRST_PEER_PORT+index));
+      peers.back()->connect(SERVER_PORT);
+    }
+
+    ok=network.runUntil([&] {
+      for(MemoryTcpPeer *peer : peers)
+        if(peer->getState()!=MemoryTcpPeer::State::ESTABLISHED)
+          return false;
+      return true;
+    },TIMEOUT);
+
+    if(!ok) {
+      printf("%u connections: not all of the peers connected\n",count);
+      return false;
+    }
+
+    // every peer sends its data and closes, the server reads it all
+
+    receivedBytes.clear();
+    receivedCorrectly.clear();
+    closedCount=0;
+
+    for(index=0;index<count;index++) {
+
+      data.clear();
+
+      for(i=0;i<DATA_SIZE;i++)
+        data.push_back(getPattern(index,i));
+
+      peers[index]->send(data);
+      peers[index]->close();
+    }
+
+    network.resetCounters();
+    startTime=MillisecondTimer::millis();
+    auto start=std::chrono::steady_clock::now();
+
+    while(closedCount<count && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+      connections.wait(TcpWaitState::READ | TcpWaitState::CLOSED,10);
+
+    std::chrono::duration<double,std::micro> elapsed=std::chrono::steady_clock::now()-start;
+
+    segments=network.getCounters().FramesToStack;
+
+    printf("%6u %10u %12u %14.2f %14.0f\n",
+           count,
+           segments,
+           network.getCounters().BytesToStack,
+           elapsed.count()/segments,
+           segments/(elapsed.count()/1e6));
+
+    // check what arrived
+
+    for(index=0;index<count;index++) {
+
+      if(receivedBytes[index]!=DATA_SIZE || !receivedCorrectly[index]) {
+        printf("%u connections: connection %u received %u bytes%s\n",
+               count,
+               index,
+               receivedBytes[index],
+               receivedCorrectly[index] ? "" : " that were not what was sent");
+        ok=false;
+      }
+    }
+
+    for(MemoryTcpPeer *peer : peers)
+      delete peer;
+
+    return ok;
+  }
+}
+
+
+int main() {
+
+  bool ok;
+
+  ok=true;
+
+  printf("%6s %14s %14s %9s\n","conns","signal ns/seg","table ns/seg","speedup");
+
+  for(uint16_t count : CONNECTION_COUNTS)
+    ok&=lookup(count);
+
+  printf("\n%6s %10s %12s %14s %14s\n","conns","segments","bytes","host us/seg","segments/s");
+
+  for(uint16_t count : CONNECTION_COUNTS)
+    ok&=transfer(count);
+
+  return ok ? 0 : 1;
+}
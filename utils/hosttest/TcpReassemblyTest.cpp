@@ -0,0 +1,809 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests of the TCP receiver's out of order reassembly and the SACK blocks in its ACKs. A
+ * peer that has offered SACK sends data to a server connection. A tap on the link to the
+ * stack holds back the data segments that a test chooses and sends them again when the test
+ * says, and a tap on the link from the stack logs the ACKs:
+ *
+ *   - one hole: what follows it is held and reported in one growing SACK block. Filling the
+ *     hole acknowledges everything at once.
+ *   - three holes: the SACK blocks are the held ranges with the most recently changed first
+ *     (RFC 2018) and they merge as the holes fill
+ *   - duplicates of held and of acknowledged data are counted and change nothing
+ *   - a held segment that arrives just before a block joins its front
+ *   - out of order data is only held if it fits in the receive buffer
+ *   - a peer that didn't offer SACK gets no blocks
+ *   - a fifth hole: a segment that needs more intervals than there are is dropped and is
+ *     taken when it's sent again
+ *   - a link that reorders and duplicates at random: the data arrives intact
+ *   - the SYN and SYN-ACK carry exactly the options that they declare, with and without
+ *     SACK. They used to have 4 stray bytes in front of the ethernet header without it.
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+#include "HostTest.h"
+
+#include <set>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    TIMEOUT = 10000,
+    SERVER_PORT = 80,
+    CLIENT_PORT = 49152,
+    RECEIVE_BUFFER_SIZE = 16384,
+    SEGMENT_SIZE = 1460,
+    MAX_INTERVALS = 4,
+    RANDOM_SIZE = 65536,
+    SYN_SIZE = 14+20+20
+  };
+
+
+  /*
+   * A server connection that keeps what it reads and deletes itself when the peer closes
+   */
+
+  std::string received;
+  uint16_t closedCount;
+
+
+  class TestConnection : public TcpConnection {
+
+    public:
+      struct Parameters : TcpConnection::Parameters {
+        Parameters() {
+          tcp_receiveBufferSize=RECEIVE_BUFFER_SIZE;
+          tcp_reassemblyIntervals=MAX_INTERVALS;
+        }
+      };
+
+    protected:
+      void read() {
+
+        char buffer[512];
+        uint32_t actuallyRead;
+
+        while(getDataAvailable() && receive(buffer,sizeof(buffer),actuallyRead,0) && actuallyRead)
+          received.append(buffer,actuallyRead);
+      }
+
+    public:
+      TestConnection(const Parameters& params)
+        : TcpConnection(params) {
+      }
+
+      bool handleRead() {
+        read();
+        return true;
+      }
+
+      bool handleWrite() {
+        return true;
+      }
+
+      bool handleClosed() {
+        read();
+        closedCount++;
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+  };
+
+
+  /*
+   * A client connection that only sends its SYN
+   */
+
+  template<bool TSelectiveAck>
+  class ClientConnection : public TcpClientConnection {
+
+    public:
+      ClientConnection() {
+        _params.tcp_selectiveAck=TSelectiveAck;
+      }
+
+      bool handleRead() {
+        return true;
+      }
+
+      bool handleWrite() {
+        return true;
+      }
+
+      bool handleClosed() {
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+  };
+
+
+  /*
+   * The taps. Data segments to the stack are numbered in the order they were first sent. A
+   * copy of each is kept so that it can be sent again and the first transmission of those
+   * in the hold list is lost. The ACKs from the stack are logged with their SACK blocks,
+   * all relative to the start of the peer's data.
+   */
+
+  struct Ack {
+    uint32_t Offset;
+    uint16_t Window;
+    std::vector<std::pair<uint32_t,uint32_t>> Blocks;
+  };
+
+  std::vector<std::vector<uint8_t>> segments;
+  std::vector<uint32_t> offsets;
+  std::set<uint32_t> toHold;
+  std::vector<Ack> acks;
+  std::vector<uint8_t> lastSyn;
+  uint32_t peerSequenceNumber;
+
+
+  const TcpHeader *getTcpHeader(const std::vector<uint8_t>& frame,uint16_t& payloadSize) {
+
+    const IpPacketHeader *iph;
+    const TcpHeader *tcph;
+    uint16_t ipHeaderLength;
+
+    if(NetUtil::ntohs(reinterpret_cast<const EthernetFrameData *>(&frame[0])->eth_etherType)!=static_cast<uint16_t>(EtherType::IP))
+      return nullptr;
+
+    iph=reinterpret_cast<const IpPacketHeader *>(&frame[14]);
+
+    if(iph->ip_hdr_protocol!=IpProtocol::TCP)
+      return nullptr;
+
+    ipHeaderLength=(iph->ip_hdr_version & 0xf)*4;
+    tcph=reinterpret_cast<const TcpHeader *>(&frame[14+ipHeaderLength]);
+    payloadSize=NetUtil::ntohs(iph->ip_hdr_length)-ipHeaderLength-tcph->getHeaderSize();
+
+    return tcph;
+  }
+
+
+  bool tapToStack(const std::vector<uint8_t>& frame) {
+
+    const TcpHeader *tcph;
+    uint16_t payloadSize;
+    uint32_t offset;
+
+    if((tcph=getTcpHeader(frame,payloadSize))==nullptr)
+      return false;
+
+    if(tcph->hasSyn()) {
+      peerSequenceNumber=NetUtil::ntohl(tcph->tcp_sequenceNumber);
+      return false;
+    }
+
+    if(payloadSize==0)
+      return false;
+
+    offset=NetUtil::ntohl(tcph->tcp_sequenceNumber)-peerSequenceNumber-1;
+
+    if(std::find(offsets.begin(),offsets.end(),offset)!=offsets.end())
+      return false;
+
+    offsets.push_back(offset);
+    segments.push_back(frame);
+
+    return toHold.count(segments.size()-1)!=0;
+  }
+
+
+  bool tapFromStack(const std::vector<uint8_t>& frame) {
+
+    const TcpOptionSack *sack;
+    const TcpHeader *tcph;
+    uint16_t payloadSize;
+    uint32_t base;
+    uint8_t i;
+    Ack ack;
+
+    if((tcph=getTcpHeader(frame,payloadSize))==nullptr)
+      return false;
+
+    if(tcph->hasSyn()) {
+      lastSyn=frame;
+      return false;
+    }
+
+    if(!tcph->hasAck() || tcph->hasFin())
+      return false;
+
+    base=peerSequenceNumber+1;
+    ack.Offset=NetUtil::ntohl(tcph->tcp_ackNumber)-base;
+    ack.Window=NetUtil::ntohs(tcph->tcp_windowSize);
+
+    if((sack=tcph->findOption<TcpOptionSack>())!=nullptr)
+      for(i=0;i<(sack->tcp_optionLength-2)/sizeof(TcpSackBlock);i++)
+        ack.Blocks.push_back(std::make_pair(NetUtil::ntohl(sack->tcp_blocks[i].tcp_leftEdge)-base,
+                                            NetUtil::ntohl(sack->tcp_blocks[i].tcp_rightEdge)-base));
+
+    acks.push_back(ack);
+    return false;
+  }
+
+
+  /*
+   * A connection from a new peer, which offers SACK unless told not to. The link is tapped
+   * both ways.
+   */
+
+  class Transfer {
+
+    protected:
+      MemoryNetwork& _network;
+      TcpConnectionArray<TestConnection>& _connections;
+      MemoryTcpPeer _peer;
+      TcpConnection *_conn;
+      std::string _data;
+
+    public:
+      Transfer(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections,uint16_t port,bool offerSack=true)
+        : _network(network),
+          _connections(connections),
+          _peer(network,"192.168.0.40",port),
+          _conn(nullptr) {
+
+        segments.clear();
+        offsets.clear();
+        acks.clear();
+        received.clear();
+
+        _network.getLinkToStack().Lose=tapToStack;
+        _network.getLinkFromStack().Lose=tapFromStack;
+
+        lastSyn.clear();
+        _peer.connect(SERVER_PORT,offerSack);
+
+        if(_network.runUntil([&] { return _peer.getState()==MemoryTcpPeer::State::ESTABLISHED; },TIMEOUT)) {
+
+          TcpFindConnectionNotificationEvent tfcne(_peer.getAddress(),_peer.getPort(),SERVER_PORT);
+          _network.getStack().NetworkNotificationEventSender.raiseEvent(tfcne);
+          _conn=tfcne.tcpConnection;
+        }
+
+        HOSTTEST_CHECK(_conn!=nullptr);
+      }
+
+
+      /*
+       * Close on a clear link and check what arrived
+       */
+
+      ~Transfer() {
+
+        uint32_t startTime,closed;
+
+        _network.getLinkToStack()=MemoryNetwork::Link();
+        _network.getLinkFromStack()=MemoryNetwork::Link();
+        toHold.clear();
+
+        closed=closedCount;
+        _peer.close();
+
+        startTime=MillisecondTimer::millis();
+
+        while(closedCount==closed && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+          _connections.wait(TcpWaitState::READ | TcpWaitState::CLOSED,10);
+
+        HOSTTEST_CHECK(closedCount==closed+1);
+        HOSTTEST_CHECK(received==_data);
+      }
+
+
+      /*
+       * Send some segments' worth of random data and let the link settle
+       */
+
+      void send(uint32_t size) {
+
+        uint32_t i;
+
+        for(i=0;i<size;i++)
+          _data.push_back(rand());
+
+        _peer.send(_data.c_str()+_data.length()-size,size);
+        _network.run(5);
+      }
+
+
+      /*
+       * Send a segment again and let the link settle
+       */
+
+      void resend(uint32_t index) {
+        _network.transmit(segments[index]);
+        _network.run(5);
+      }
+
+
+      /*
+       * Send a segment of the data at any offset. The headers are copied from the first.
+       */
+
+      void sendAt(uint32_t offset,uint32_t size) {
+
+        std::vector<uint8_t> frame(segments[0].begin(),segments[0].begin()+SYN_SIZE);
+        IpPacketHeader *iph;
+        TcpHeader *tcph;
+
+        frame.insert(frame.end(),_data.begin()+offset,_data.begin()+offset+size);
+
+        iph=reinterpret_cast<IpPacketHeader *>(&frame[14]);
+        iph->ip_hdr_length=NetUtil::htons(20+20+size);
+
+        tcph=reinterpret_cast<TcpHeader *>(&frame[14+20]);
+        tcph->tcp_sequenceNumber=NetUtil::htonl(peerSequenceNumber+1+offset);
+
+        _network.transmit(frame);
+        _network.run(5);
+      }
+
+
+      const TcpReassemblyStatistics& getStatistics() const {
+        return _conn->getReassemblyStatistics();
+      }
+
+
+      uint32_t getEnd(uint32_t index) const {
+        return index<offsets.size()-1 ? offsets[index+1] : _data.length();
+      }
+
+
+      bool isValid() const {
+        return _conn!=nullptr;
+      }
+
+
+      const MacAddress& getPeerMacAddress() const {
+        return _peer.getMacAddress();
+      }
+  };
+
+
+  bool isBlock(const std::pair<uint32_t,uint32_t>& block,uint32_t start,uint32_t end) {
+    return block.first==start && block.second==end;
+  }
+
+
+  /*
+   * The first segment is held back. Every ACK is a duplicate of zero with one block that
+   * grows to cover what's arrived. The hole filling takes everything at once.
+   */
+
+  void testOneHole(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    uint32_t i;
+    bool ok;
+
+    toHold.insert(0);
+
+    Transfer transfer(network,connections,50000);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(6*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(offsets.size()==6 && acks.size()==5);
+
+    if(offsets.size()!=6 || acks.size()!=5)
+      return;
+
+    ok=true;
+
+    for(i=0;i<5;i++)
+      ok&=acks[i].Offset==0 && acks[i].Blocks.size()==1 && isBlock(acks[i].Blocks[0],offsets[1],transfer.getEnd(i+1));
+
+    HOSTTEST_CHECK(ok);
+    HOSTTEST_CHECK(transfer.getStatistics().outOfOrderSegments==5);
+    HOSTTEST_CHECK(transfer.getStatistics().maxDepth==transfer.getEnd(5));
+    HOSTTEST_CHECK(transfer.getStatistics().holesFilled==0);
+    HOSTTEST_CHECK(transfer.getStatistics().maxIntervals==1);
+
+    transfer.resend(0);
+
+    HOSTTEST_CHECK(acks.size()==6 && acks.back().Offset==transfer.getEnd(5) && acks.back().Blocks.empty());
+    HOSTTEST_CHECK(transfer.getStatistics().holesFilled==1);
+  }
+
+
+  /*
+   * Segments 0, 2 and 4 of 7 are held back. The block that changed last is reported first
+   * and the rest follow in sequence order. They merge as the holes fill.
+   */
+
+  void testSackBlocks(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    toHold.insert(0);
+    toHold.insert(2);
+    toHold.insert(4);
+
+    Transfer transfer(network,connections,50001);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(7*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(offsets.size()==7 && !acks.empty());
+
+    if(offsets.size()!=7 || acks.empty())
+      return;
+
+    HOSTTEST_CHECK(acks.back().Offset==0 && acks.back().Blocks.size()==3);
+    HOSTTEST_CHECK(acks.back().Blocks.size()==3 &&
+                   isBlock(acks.back().Blocks[0],offsets[5],transfer.getEnd(6)) &&
+                   isBlock(acks.back().Blocks[1],offsets[1],offsets[2]) &&
+                   isBlock(acks.back().Blocks[2],offsets[3],offsets[4]));
+
+    // the middle hole joins the first two blocks
+
+    transfer.resend(2);
+
+    HOSTTEST_CHECK(acks.back().Offset==0 && acks.back().Blocks.size()==2);
+    HOSTTEST_CHECK(acks.back().Blocks.size()==2 &&
+                   isBlock(acks.back().Blocks[0],offsets[1],offsets[4]) &&
+                   isBlock(acks.back().Blocks[1],offsets[5],transfer.getEnd(6)));
+
+    transfer.resend(4);
+
+    HOSTTEST_CHECK(acks.back().Offset==0 && acks.back().Blocks.size()==1);
+    HOSTTEST_CHECK(acks.back().Blocks.size()==1 && isBlock(acks.back().Blocks[0],offsets[1],transfer.getEnd(6)));
+
+    transfer.resend(0);
+
+    HOSTTEST_CHECK(acks.back().Offset==transfer.getEnd(6) && acks.back().Blocks.empty());
+    HOSTTEST_CHECK(transfer.getStatistics().maxIntervals==3);
+    HOSTTEST_CHECK(transfer.getStatistics().holesFilled==1);
+  }
+
+
+  /*
+   * A held segment and an acknowledged one arrive again
+   */
+
+  void testDuplicates(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    toHold.insert(0);
+
+    Transfer transfer(network,connections,50002);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(4*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(offsets.size()==4);
+
+    if(offsets.size()!=4)
+      return;
+
+    transfer.resend(2);
+
+    HOSTTEST_CHECK(transfer.getStatistics().duplicateSegments==1);
+    HOSTTEST_CHECK(acks.back().Offset==0 && acks.back().Blocks.size()==1 && isBlock(acks.back().Blocks[0],offsets[1],transfer.getEnd(3)));
+
+    transfer.resend(0);
+    transfer.resend(0);
+    transfer.resend(3);
+
+    HOSTTEST_CHECK(acks.back().Offset==transfer.getEnd(3) && acks.back().Blocks.empty());
+    HOSTTEST_CHECK(transfer.getStatistics().duplicateSegments==1);
+    HOSTTEST_CHECK(transfer.getStatistics().holesFilled==1);
+  }
+
+
+  /*
+   * Segments 0 and 1 are held back. When 1 arrives it joins the front of the block.
+   */
+
+  void testJoinFront(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    toHold.insert(0);
+    toHold.insert(1);
+
+    Transfer transfer(network,connections,50005);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(4*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(offsets.size()==4);
+
+    if(offsets.size()!=4)
+      return;
+
+    HOSTTEST_CHECK(acks.back().Blocks.size()==1 && isBlock(acks.back().Blocks[0],offsets[2],transfer.getEnd(3)));
+
+    transfer.resend(1);
+
+    HOSTTEST_CHECK(acks.back().Offset==0 && acks.back().Blocks.size()==1 && isBlock(acks.back().Blocks[0],offsets[1],transfer.getEnd(3)));
+    HOSTTEST_CHECK(transfer.getStatistics().maxIntervals==1);
+
+    transfer.resend(0);
+
+    HOSTTEST_CHECK(acks.back().Offset==transfer.getEnd(3) && acks.back().Blocks.empty());
+  }
+
+
+  /*
+   * Out of order data must fit in the receive buffer. Everything that the peer sends at
+   * first is held back so that the space is the SYN-ACK's window. A segment that ends at the
+   * right edge is held and one that crosses it is not.
+   */
+
+  void testWindowEdge(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    uint32_t i,edge,count;
+
+    for(i=0;i<RECEIVE_BUFFER_SIZE/SEGMENT_SIZE+1;i++)
+      toHold.insert(i);
+
+    Transfer transfer(network,connections,50006);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(RECEIVE_BUFFER_SIZE+2*SEGMENT_SIZE);
+    toHold.clear();
+
+    edge=NetUtil::ntohs(reinterpret_cast<const TcpHeader *>(&lastSyn[14+20])->tcp_windowSize);
+    count=segments.size();
+
+    HOSTTEST_CHECK(acks.empty() && edge==RECEIVE_BUFFER_SIZE && offsets[count-1]+SEGMENT_SIZE>=edge);
+
+    transfer.sendAt(edge-SEGMENT_SIZE+1,SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(transfer.getStatistics().outOfOrderSegments==0);
+    HOSTTEST_CHECK(acks.size()==1 && acks.back().Offset==0 && acks.back().Blocks.empty());
+
+    transfer.sendAt(edge-SEGMENT_SIZE,SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(transfer.getStatistics().outOfOrderSegments==1);
+    HOSTTEST_CHECK(acks.back().Blocks.size()==1 && isBlock(acks.back().Blocks[0],edge-SEGMENT_SIZE,edge));
+
+    // the rest goes when the server reads
+
+    for(i=0;i<count;i++)
+      transfer.resend(i);
+
+    HOSTTEST_CHECK(acks.back().Offset==edge);
+  }
+
+
+  /*
+   * A peer that doesn't offer SACK gets plain duplicate ACKs but its data is still held
+   */
+
+  void testWithoutSack(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    toHold.insert(0);
+
+    Transfer transfer(network,connections,50007,false);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send(3*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(acks.size()==2 && acks.back().Offset==0 && acks.back().Blocks.empty());
+    HOSTTEST_CHECK(transfer.getStatistics().outOfOrderSegments==2);
+
+    transfer.resend(0);
+
+    HOSTTEST_CHECK(acks.back().Offset==transfer.getEnd(2) && acks.back().Blocks.empty());
+  }
+
+
+  /*
+   * Five holes need five intervals. The segment after the last hole is dropped and the SACK
+   * blocks don't include it. It's taken in order when it's sent again.
+   */
+
+  void testTooManyHoles(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    uint32_t i;
+
+    for(i=0;i<=2*MAX_INTERVALS;i+=2)
+      toHold.insert(i);
+
+    Transfer transfer(network,connections,50003);
+
+    if(!transfer.isValid())
+      return;
+
+    transfer.send((2*MAX_INTERVALS+2)*SEGMENT_SIZE);
+
+    HOSTTEST_CHECK(offsets.size()==2*MAX_INTERVALS+2);
+
+    if(offsets.size()!=2*MAX_INTERVALS+2)
+      return;
+
+    HOSTTEST_CHECK(transfer.getStatistics().droppedSegments==1);
+    HOSTTEST_CHECK(transfer.getStatistics().maxIntervals==MAX_INTERVALS);
+    HOSTTEST_CHECK(acks.back().Blocks.size()==MAX_INTERVALS && isBlock(acks.back().Blocks[0],offsets[7],offsets[8]));
+
+    for(i=0;i<=2*MAX_INTERVALS;i+=2)
+      transfer.resend(i);
+
+    HOSTTEST_CHECK(acks.back().Offset==offsets[2*MAX_INTERVALS+1] && acks.back().Blocks.empty());
+
+    transfer.resend(2*MAX_INTERVALS+1);
+
+    HOSTTEST_CHECK(acks.back().Offset==transfer.getEnd(2*MAX_INTERVALS+1));
+  }
+
+
+  /*
+   * Frames are reordered and duplicated at random both ways while the server reads
+   */
+
+  void testRandomLink(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    MemoryNetwork::Link& toStack(network.getLinkToStack());
+    MemoryNetwork::Link& fromStack(network.getLinkFromStack());
+    uint32_t startTime,remaining,size;
+
+    Transfer transfer(network,connections,50004);
+
+    if(!transfer.isValid())
+      return;
+
+    toStack.ReorderOneIn=fromStack.ReorderOneIn=8;
+    toStack.DuplicateOneIn=fromStack.DuplicateOneIn=8;
+    toStack.ReorderDelay=fromStack.ReorderDelay=3;
+    toStack.Delay=fromStack.Delay=1;
+
+    network.resetCounters();
+
+    for(remaining=RANDOM_SIZE;remaining;remaining-=size) {
+
+      size=std::min<uint32_t>(remaining,RECEIVE_BUFFER_SIZE/2);
+      transfer.send(size);
+
+      startTime=MillisecondTimer::millis();
+
+      while(received.length()!=RANDOM_SIZE-remaining+size && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+        connections.wait(TcpWaitState::READ,10);
+    }
+
+    HOSTTEST_CHECK(received.length()==RANDOM_SIZE);
+    HOSTTEST_CHECK(network.getCounters().FramesReordered>0);
+    HOSTTEST_CHECK(network.getCounters().FramesDuplicated>0);
+    HOSTTEST_CHECK(transfer.getStatistics().outOfOrderSegments>0);
+    HOSTTEST_CHECK(transfer.getStatistics().droppedSegments==0);
+  }
+
+
+  /*
+   * A SYN or SYN-ACK frame must be exactly the headers and the options that they declare,
+   * addressed to the peer
+   */
+
+  bool isSynLayoutRight(const std::vector<uint8_t>& frame,const MacAddress& destination,bool sack) {
+
+    const EthernetFrameData *efd;
+    const IpPacketHeader *iph;
+    const TcpHeader *tcph;
+    uint16_t optionsSize;
+
+    optionsSize=TcpOptionMaximumSegmentSize::getSize()+(sack ? 2+TcpOptionSackPermitted::getSize() : 0);
+
+    if(frame.size()!=SYN_SIZE+optionsSize)
+      return false;
+
+    efd=reinterpret_cast<const EthernetFrameData *>(&frame[0]);
+    iph=reinterpret_cast<const IpPacketHeader *>(&frame[14]);
+    tcph=reinterpret_cast<const TcpHeader *>(&frame[14+20]);
+
+    return efd->eth_destinationAddress==destination &&
+           efd->eth_sourceAddress==MemoryNetwork::getStackMacAddress() &&
+           NetUtil::ntohs(efd->eth_etherType)==static_cast<uint16_t>(EtherType::IP) &&
+           iph->ip_hdr_version==0x45 &&
+           NetUtil::ntohs(iph->ip_hdr_length)==20+20+optionsSize &&
+           tcph->getHeaderSize()==20+optionsSize &&
+           tcph->findOption<TcpOptionMaximumSegmentSize>()!=nullptr &&
+           (tcph->findOption<TcpOptionSackPermitted>()!=nullptr)==sack;
+  }
+
+
+  /*
+   * The SYN-ACK to peers that do and don't offer SACK, and the SYN from clients that do
+   * and don't offer it
+   */
+
+  template<bool TSelectiveAck>
+  void testSyn(MemoryNetwork& network,MemoryTcpPeer& peer) {
+
+    ClientConnection<TSelectiveAck> *conn;
+
+    lastSyn.clear();
+
+    HOSTTEST_CHECK(network.getStack().tcpConnectAsync(peer.getAddress(),CLIENT_PORT+TSelectiveAck,SERVER_PORT,conn));
+    network.run(5);
+
+    HOSTTEST_CHECK(isSynLayoutRight(lastSyn,peer.getMacAddress(),TSelectiveAck));
+
+    delete conn;
+  }
+
+
+  void testSynSizes(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    uint16_t i;
+
+    for(i=0;i<2;i++) {
+      Transfer transfer(network,connections,51000+i,i==1);
+      HOSTTEST_CHECK(isSynLayoutRight(lastSyn,transfer.getPeerMacAddress(),i==1));
+    }
+
+    // the peer doesn't answer, it's only there for ARP
+
+    MemoryTcpPeer listener(network,"192.168.0.42",SERVER_PORT);
+
+    network.getLinkFromStack().Lose=tapFromStack;
+
+    testSyn<false>(network,listener);
+    testSyn<true>(network,listener);
+
+    network.getLinkFromStack()=MemoryNetwork::Link();
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<TestConnection> *server;
+
+  srand(1);
+
+  network.getParameters().tcp_maxConnectionsPerServer=1;
+  network.getParameters().tcp_maxServers=1;
+
+  HOSTTEST_CHECK(network.initialise());
+
+  server=nullptr;
+  HOSTTEST_CHECK(network.getStack().tcpCreateServer(SERVER_PORT,server));
+
+  if(server!=nullptr) {
+
+    TcpConnectionArray<TestConnection> connections(*server);
+    server->start();
+
+    testOneHole(network,connections);
+    testSackBlocks(network,connections);
+    testDuplicates(network,connections);
+    testJoinFront(network,connections);
+    testWindowEdge(network,connections);
+    testWithoutSack(network,connections);
+    testTooManyHoles(network,connections);
+    testRandomLink(network,connections);
+    testSynSizes(network,connections);
+
+    delete server;
+  }
+
+  return hosttest::result("TcpReassemblyTest");
+}
@@ -0,0 +1,500 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Tests of the TCP sender's sliding window and its recovery from loss. A server connection
+ * sends a block of data to a peer over a link with a fixed delay each way. Taps on the link
+ * log the data segments from the stack and the ACKs from the peer and lose the segments that
+ * a test chooses:
+ *
+ *   - nothing lost: the data arrives intact, nothing is sent twice, more than the initial
+ *     window is in flight once slow start has run and the round trip time is measured
+ *   - one segment lost: three duplicate ACKs resend it once, well before the resend timer
+ *     would, and the connection leaves recovery with the threshold reduced (RFC 5681).
+ *     Near the end there are only three segments after it to send them.
+ *   - two segments lost from one window: the partial ACK for the first resends the second
+ *     at once without waiting for duplicates, of which there are too few, or for the timer
+ *     (NewReno, RFC 6582)
+ *   - the last segment lost twice: there are no duplicate ACKs, so the resend timer sends it
+ *     again, backs off before the second time and the congestion window restarts
+ *   - random loss in both directions: the data arrives intact
+ */
+
+#include "config/stm32plus.h"
+#include "config/net.h"
+#include "MemoryNetwork.h"
+#include "HostTest.h"
+
+#include <map>
+
+
+using namespace stm32plus;
+using namespace stm32plus::net;
+
+
+namespace {
+
+  enum {
+    TIMEOUT = 60000,
+    SERVER_PORT = 80,
+    MSS = 1460,
+    SEGMENTS = 100,
+    TRANSFER_SIZE = SEGMENTS*MSS,
+    DELAY = 10,
+    MIN_RESEND_DELAY = 200,
+    LOSS_ONE_IN = 20
+  };
+
+
+  /*
+   * A server connection that deletes itself when the peer closes
+   */
+
+  uint16_t closedCount;
+
+
+  class TestConnection : public TcpConnection {
+
+    public:
+      TestConnection(const Parameters& params)
+        : TcpConnection(params) {
+      }
+
+      bool handleRead() {
+        return true;
+      }
+
+      bool handleWrite() {
+        return true;
+      }
+
+      bool handleClosed() {
+        closedCount++;
+        delete this;
+        return true;
+      }
+
+      bool handleCallback() {
+        return true;
+      }
+  };
+
+
+  /*
+   * What a transfer did. The connection's state is read before it's closed.
+   */
+
+  struct Result {
+    bool Sent;
+    std::string Received;
+    uint32_t CongestionWindow;
+    uint32_t SlowStartThreshold;
+    uint32_t SmoothedRoundTripTime;
+    bool InRecovery;
+    uint32_t MaximumFlight;
+  };
+
+
+  /*
+   * The taps. Each data segment from the stack is logged by its offset in the transfer and
+   * the time that it went, and the n'th transmission of an offset is lost if it's in the
+   * list. The flight is the distance from the peer's last ACK to the end of the furthest
+   * segment sent, which can only be less than the stack's view of it.
+   */
+
+  struct Transmission {
+    uint32_t Time;
+    uint32_t Offset;
+    uint32_t Length;
+  };
+
+  std::vector<Transmission> transmissions;
+  std::map<uint32_t,uint32_t> timesSent;
+  std::multimap<uint32_t,uint32_t> toLose;
+  uint32_t initialSequenceNumber;
+  uint32_t acknowledged;
+  uint32_t highest;
+  uint32_t maximumFlight;
+  bool randomAckLoss;
+
+
+  const TcpHeader *getTcpHeader(const std::vector<uint8_t>& frame,uint16_t& payloadSize) {
+
+    const IpPacketHeader *iph;
+    const TcpHeader *tcph;
+    uint16_t ipHeaderLength;
+
+    if(NetUtil::ntohs(reinterpret_cast<const EthernetFrameData *>(&frame[0])->eth_etherType)!=static_cast<uint16_t>(EtherType::IP))
+      return nullptr;
+
+    iph=reinterpret_cast<const IpPacketHeader *>(&frame[14]);
+
+    if(iph->ip_hdr_protocol!=IpProtocol::TCP)
+      return nullptr;
+
+    ipHeaderLength=(iph->ip_hdr_version & 0xf)*4;
+    tcph=reinterpret_cast<const TcpHeader *>(&frame[14+ipHeaderLength]);
+    payloadSize=NetUtil::ntohs(iph->ip_hdr_length)-ipHeaderLength-tcph->getHeaderSize();
+
+    return tcph;
+  }
+
+
+  bool tapFromStack(const std::vector<uint8_t>& frame) {
+
+    const TcpHeader *tcph;
+    uint16_t payloadSize;
+    uint32_t offset,sent;
+
+    if((tcph=getTcpHeader(frame,payloadSize))==nullptr)
+      return false;
+
+    if(tcph->hasSyn()) {
+      initialSequenceNumber=NetUtil::ntohl(tcph->tcp_sequenceNumber);
+      acknowledged=highest=maximumFlight=0;
+      return false;
+    }
+
+    if(payloadSize==0)
+      return false;
+
+    offset=NetUtil::ntohl(tcph->tcp_sequenceNumber)-initialSequenceNumber-1;
+    sent=++timesSent[offset];
+
+    transmissions.push_back(Transmission { MillisecondTimer::counter(),offset,payloadSize });
+
+    highest=std::max(highest,offset+payloadSize);
+    maximumFlight=std::max(maximumFlight,highest-acknowledged);
+
+    for(auto it=toLose.lower_bound(offset);it!=toLose.upper_bound(offset);++it)
+      if(it->second==sent)
+        return true;
+
+    return false;
+  }
+
+
+  /*
+   * Pure ACKs from the peer may be lost at random. The peer doesn't retransmit so its SYN
+   * and FIN must get through.
+   */
+
+  bool tapToStack(const std::vector<uint8_t>& frame) {
+
+    const TcpHeader *tcph;
+    uint16_t payloadSize;
+
+    if((tcph=getTcpHeader(frame,payloadSize))==nullptr || tcph->hasSyn())
+      return false;
+
+    acknowledged=std::max(acknowledged,NetUtil::ntohl(tcph->tcp_ackNumber)-initialSequenceNumber-1);
+
+    return randomAckLoss && !tcph->hasFin() && payloadSize==0 && rand() % LOSS_ONE_IN==0;
+  }
+
+
+  /*
+   * The times at which the data at an offset was sent
+   */
+
+  std::vector<uint32_t> getSendTimes(uint32_t offset) {
+
+    std::vector<uint32_t> times;
+
+    for(const Transmission& t : transmissions)
+      if(t.Offset==offset)
+        times.push_back(t.Time);
+
+    return times;
+  }
+
+
+  /*
+   * The number of offsets that were sent more than once
+   */
+
+  uint32_t getResentCount() {
+
+    uint32_t count;
+
+    count=0;
+
+    for(const auto& ts : timesSent)
+      if(ts.second>1)
+        count++;
+
+    return count;
+  }
+
+
+  std::string createData(uint32_t size) {
+
+    std::string data(size,0);
+    uint32_t i;
+
+    for(i=0;i<size;i++)
+      data[i]=rand();
+
+    return data;
+  }
+
+
+  /*
+   * Connect a new peer, send a block of data to it from the server's end and close it. The
+   * link is delayed both ways and tapped. The close is done on a clear link.
+   */
+
+  Result transfer(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections,const std::string& data,uint32_t lossOneIn) {
+
+    static uint16_t port=50000;
+
+    MemoryTcpPeer peer(network,"192.168.0.40",port++);
+    uint32_t actuallySent,startTime,closed;
+    TcpConnection *conn;
+    Result result;
+
+    transmissions.clear();
+    timesSent.clear();
+
+    network.getLinkFromStack().Delay=DELAY;
+    network.getLinkFromStack().Lose=tapFromStack;
+    network.getLinkToStack().Delay=DELAY;
+    network.getLinkToStack().Lose=tapToStack;
+
+    randomAckLoss=false;
+    result.Sent=false;
+
+    // the handshake isn't lost. the peer's ACK of the SYN-ACK must reach the stack first.
+
+    peer.connect(SERVER_PORT);
+
+    if(!network.runUntil([&] { return peer.getState()==MemoryTcpPeer::State::ESTABLISHED; },TIMEOUT))
+      return result;
+
+    network.run(DELAY*2);
+    network.getLinkFromStack().LossOneIn=lossOneIn;
+    randomAckLoss=lossOneIn!=0;
+
+    TcpFindConnectionNotificationEvent tfcne(peer.getAddress(),peer.getPort(),SERVER_PORT);
+    network.getStack().NetworkNotificationEventSender.raiseEvent(tfcne);
+
+    if((conn=tfcne.tcpConnection)==nullptr)
+      return result;
+
+    result.Sent=conn->send(data.c_str(),data.length(),actuallySent,TIMEOUT) && actuallySent==data.length();
+    result.CongestionWindow=conn->getCongestionControl().getCongestionWindow();
+    result.SlowStartThreshold=conn->getCongestionControl().getSlowStartThreshold();
+    result.InRecovery=conn->getCongestionControl().isInRecovery();
+    result.SmoothedRoundTripTime=conn->getResendDelayCalculator().getSmoothedRoundTripTime();
+    result.MaximumFlight=maximumFlight;
+
+    network.run(DELAY*2);
+    result.Received=peer.getReceived();
+
+    // close on a clear link
+
+    network.getLinkFromStack()=MemoryNetwork::Link();
+    network.getLinkToStack()=MemoryNetwork::Link();
+    toLose.clear();
+
+    closed=closedCount;
+    peer.close();
+
+    startTime=MillisecondTimer::millis();
+
+    while(closedCount==closed && !MillisecondTimer::hasTimedOut(startTime,TIMEOUT))
+      connections.wait(TcpWaitState::CLOSED,10);
+
+    HOSTTEST_CHECK(closedCount==closed+1);
+    return result;
+  }
+
+
+  /*
+   * Nothing lost. Slow start must open the window past its initial 3 segments and the round
+   * trip time is the delay both ways, give or take the millisecond that a frame can wait.
+   */
+
+  void testLossless(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    std::string data(createData(TRANSFER_SIZE));
+    Result result;
+
+    result=transfer(network,connections,data,0);
+
+    HOSTTEST_CHECK(result.Sent);
+    HOSTTEST_CHECK(result.Received==data);
+    HOSTTEST_CHECK(transmissions.size()==SEGMENTS);
+    HOSTTEST_CHECK(getResentCount()==0);
+    HOSTTEST_CHECK(result.MaximumFlight>3*MSS);
+    HOSTTEST_CHECK(result.SlowStartThreshold==UINT16_MAX);
+    HOSTTEST_CHECK(result.SmoothedRoundTripTime>=DELAY*2 && result.SmoothedRoundTripTime<=DELAY*2+4);
+  }
+
+
+  /*
+   * One segment lost is resent on the third duplicate ACK. In the middle of the transfer
+   * new data keeps coming after it. The fourth segment from the end is followed by exactly
+   * three so there will never be a fourth duplicate.
+   */
+
+  void testFastRetransmit(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    const uint32_t offsets[]={ 20*MSS,(SEGMENTS-4)*MSS };
+
+    std::vector<uint32_t> times;
+    Result result;
+
+    for(uint32_t offset : offsets) {
+
+      std::string data(createData(TRANSFER_SIZE));
+
+      toLose.insert(std::make_pair(offset,1));
+      result=transfer(network,connections,data,0);
+
+      HOSTTEST_CHECK(result.Sent);
+      HOSTTEST_CHECK(result.Received==data);
+      HOSTTEST_CHECK(getResentCount()==1);
+
+      times=getSendTimes(offset);
+
+      HOSTTEST_CHECK(times.size()==2);
+      HOSTTEST_CHECK(times.size()==2 && times[1]-times[0]<MIN_RESEND_DELAY);
+
+      HOSTTEST_CHECK(result.SlowStartThreshold<UINT16_MAX);
+      HOSTTEST_CHECK(!result.InRecovery);
+
+      // the full ACK deflates the window to what's in flight plus a segment, which at the
+      // end is just the segment
+
+      HOSTTEST_CHECK(offset==offsets[1] ? result.CongestionWindow==MSS : result.CongestionWindow>MSS);
+    }
+  }
+
+
+  /*
+   * Two segments lost from the same window near the end. The ACK of the first resend only
+   * reaches the second hole, which must be filled as soon as that ACK arrives, a round trip
+   * later give or take the time that the sender takes to notice. Only one segment follows
+   * the second hole so without NewReno it would wait for the resend timer.
+   */
+
+  void testNewReno(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    std::string data(createData(TRANSFER_SIZE));
+    std::vector<uint32_t> first,second;
+    Result result;
+
+    toLose.insert(std::make_pair((SEGMENTS-5)*MSS,1));
+    toLose.insert(std::make_pair((SEGMENTS-2)*MSS,1));
+    result=transfer(network,connections,data,0);
+
+    HOSTTEST_CHECK(result.Sent);
+    HOSTTEST_CHECK(result.Received==data);
+    HOSTTEST_CHECK(getResentCount()==2);
+
+    first=getSendTimes((SEGMENTS-5)*MSS);
+    second=getSendTimes((SEGMENTS-2)*MSS);
+
+    HOSTTEST_CHECK(first.size()==2 && second.size()==2);
+
+    if(first.size()==2 && second.size()==2) {
+      HOSTTEST_CHECK(first[1]-first[0]<MIN_RESEND_DELAY);
+      HOSTTEST_CHECK(second[1]>first[1] && second[1]-first[1]<=DELAY*4);
+    }
+
+    HOSTTEST_CHECK(!result.InRecovery);
+  }
+
+
+  /*
+   * The last segment is lost and so is its first resend. Nothing follows it to cause
+   * duplicate ACKs so the resend timer has to go off twice. The first time is at least the
+   * minimum delay after the last ACK and the second is at least twice that after the first.
+   */
+
+  void testResendTimeout(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    std::string data(createData(TRANSFER_SIZE));
+    std::vector<uint32_t> times;
+    Result result;
+
+    toLose.insert(std::make_pair((SEGMENTS-1)*MSS,1));
+    toLose.insert(std::make_pair((SEGMENTS-1)*MSS,2));
+    result=transfer(network,connections,data,0);
+
+    HOSTTEST_CHECK(result.Sent);
+    HOSTTEST_CHECK(result.Received==data);
+    HOSTTEST_CHECK(getResentCount()==1);
+
+    times=getSendTimes((SEGMENTS-1)*MSS);
+    HOSTTEST_CHECK(times.size()==3);
+
+    if(times.size()==3) {
+      HOSTTEST_CHECK(times[1]-times[0]>=MIN_RESEND_DELAY);
+      HOSTTEST_CHECK(times[2]-times[1]>=2*MIN_RESEND_DELAY);
+      HOSTTEST_CHECK(times[2]-times[1]>times[1]-times[0]);
+    }
+
+    // the window restarted from one segment and has grown by one ACK
+
+    HOSTTEST_CHECK(result.CongestionWindow<=2*MSS);
+    HOSTTEST_CHECK(result.SlowStartThreshold<UINT16_MAX);
+  }
+
+
+  /*
+   * Random loss of data segments and of ACKs over a longer transfer
+   */
+
+  void testRandomLoss(MemoryNetwork& network,TcpConnectionArray<TestConnection>& connections) {
+
+    std::string data(createData(TRANSFER_SIZE*4));
+    Result result;
+
+    network.resetCounters();
+    result=transfer(network,connections,data,LOSS_ONE_IN);
+
+    HOSTTEST_CHECK(result.Sent);
+    HOSTTEST_CHECK(result.Received==data);
+    HOSTTEST_CHECK(network.getCounters().FramesLostFromStack>0);
+    HOSTTEST_CHECK(network.getCounters().FramesLostToStack>0);
+    HOSTTEST_CHECK(getResentCount()>0);
+  }
+}
+
+
+int main() {
+
+  MemoryNetwork network;
+  TcpServer<TestConnection> *server;
+
+  srand(1);
+
+  network.getParameters().tcp_maxConnectionsPerServer=1;
+  network.getParameters().tcp_maxServers=1;
+
+  HOSTTEST_CHECK(network.initialise());
+
+  server=nullptr;
+  HOSTTEST_CHECK(network.getStack().tcpCreateServer(SERVER_PORT,server));
+
+  if(server!=nullptr) {
+
+    TcpConnectionArray<TestConnection> connections(*server);
+    server->start();
+
+    testLossless(network,connections);
+    testFastRetransmit(network,connections);
+    testNewReno(network,connections);
+    testResendTimeout(network,connections);
+    testRandomLoss(network,connections);
+
+    delete server;
+  }
+
+  return hosttest::result("TcpSlidingWindowTest");
+}
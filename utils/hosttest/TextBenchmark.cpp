@@ -0,0 +1,239 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+/*
+ * Text output throughput. A status screen of eight lines is redrawn repeatedly in each of
+ * the sample fonts, as a bitmap font and as the same font converted to run lengths, with and
+ * without a filled background and with and without a glyph cache. For each combination the
+ * panel operations per frame are printed along with the host drawing rate.
+ *
+ * The panel operations are what matter on the MCU: every window axis change and write
+ * command is a register transaction on the bus. The host rate shows the CPU side of the
+ * renderer. Every variant must leave the same pixels in GRAM as the plain bitmap font, and
+ * the benchmark fails if one doesn't.
+ */
+
+#include "config/stm32plus.h"
+#include "config/display/tft.h"
+#include "MemoryPanel.h"
+
+#include <chrono>
+#include <memory>
+
+
+using namespace stm32plus;
+using namespace stm32plus::display;
+
+
+namespace {
+
+  enum {
+    FRAMES = 200
+  };
+
+  const char *Lines[]={
+    "Temp 23.5C  RPM 1234",
+    "Vbus 12.04V Ibus 0.87A",
+    "Uptime 01:23:45",
+    "Link up 100M full duplex",
+    "Rx 123456 Tx 654321 pkts",
+    "Err 0 Drop 0 Retry 3",
+    "Mode: AUTO  State: RUN",
+    "The quick brown fox ~{}|"
+  };
+
+
+  /*
+   * A copy of a bitmap font converted to run lengths in the format that FontConv writes
+   */
+
+  class RleFontCopy {
+
+    protected:
+      std::vector<std::vector<uint8_t>> _runs;
+      std::vector<FontChar> _characters;
+      std::unique_ptr<RleFont> _font;
+
+    public:
+      RleFontCopy(const FontChar *characters,uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing) {
+
+        uint32_t i,bit,run,total;
+        bool current,value;
+
+        _runs.resize(characterCount);
+        _characters.assign(characters,characters+characterCount);
+
+        for(i=0;i<characterCount;i++) {
+
+          std::vector<uint8_t>& runs(_runs[i]);
+
+          total=characters[i].PixelWidth*height;
+          current=false;
+          run=0;
+
+          for(bit=0;bit<=total;bit++) {
+
+            value=bit<total && (characters[i].Data[bit/8] & (1 << (bit % 8)))!=0;
+
+            if(bit==total || value!=current) {
+
+              // long runs are split with a zero length run of the other colour
+
+              while(run>255) {
+                runs.push_back(255);
+                runs.push_back(0);
+                run-=255;
+              }
+
+              runs.push_back(run);
+              current=value;
+              run=0;
+            }
+
+            run++;
+          }
+
+          _characters[i].Data=&runs[0];
+        }
+
+        _font.reset(new RleFont(firstChar,characterCount,height,spacing,&_characters[0]));
+      }
+
+      const RleFont& getFont() const {
+        return *_font;
+      }
+  };
+
+
+  /*
+   * One combination of font and options and what it cost
+   */
+
+  struct Result {
+    std::vector<uint16_t> Gram;
+    MemoryPanel::Counters Counters;
+    double CharactersPerSecond;
+  };
+
+
+  uint32_t drawScreen(MemoryGraphicsLibrary& gl,const FontBase& font) {
+
+    uint32_t i,count;
+
+    count=0;
+
+    for(i=0;i<sizeof(Lines)/sizeof(Lines[0]);i++) {
+      gl.setForeground(i & 1 ? ColourNames::YELLOW : ColourNames::WHITE);
+      gl.setBackground(ColourNames::NAVY);
+      gl.writeString(Point(2,2+i*(font.getHeight()+2)),static_cast<const Font&>(font),Lines[i]);
+      count+=strlen(Lines[i]);
+    }
+
+    return count;
+  }
+
+
+  Result run(const FontBase& font,bool filled,MemoryGraphicsLibrary::tGLYPHCACHE *cache) {
+
+    MemoryPanelAccessMode accessMode;
+    MemoryGraphicsLibrary gl(accessMode);
+    Result result;
+    uint32_t i,characters;
+
+    gl.setFontFilledBackground(filled);
+    gl.setGlyphCache(cache);
+
+    if(cache)
+      cache->clear();
+
+    // the first frame is the one that's checked. it also fills the cache.
+
+    drawScreen(gl,font);
+    result.Gram=gl.getGram();
+
+    gl.resetCounters();
+    characters=0;
+
+    auto start=std::chrono::steady_clock::now();
+
+    for(i=0;i<FRAMES;i++)
+      characters+=drawScreen(gl,font);
+
+    std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+
+    result.Counters=gl.getCounters();
+    result.CharactersPerSecond=characters/elapsed.count();
+
+    return result;
+  }
+
+
+  bool report(const char *name,const char *variant,const Result& result,const Result& reference) {
+
+    bool same;
+
+    same=result.Gram==reference.Gram;
+
+    printf("%-8s %-18s %8u %8u %8u %9u %12.0f  %s\n",
+           name,
+           variant,
+           result.Counters.AxisChanges/FRAMES,
+           result.Counters.Writes/FRAMES,
+           result.Counters.RawTransfers/FRAMES,
+           result.Counters.Pixels/FRAMES,
+           result.CharactersPerSecond,
+           same ? "" : "OUTPUT DIFFERS");
+
+    return same;
+  }
+
+
+  bool benchmark(const char *name,const FontChar *characters,uint8_t firstChar,uint8_t characterCount,uint8_t height,int8_t spacing) {
+
+    Font bitmap(firstChar,characterCount,height,spacing,characters);
+    RleFontCopy rle(characters,firstChar,characterCount,height,spacing);
+    MemoryGraphicsLibrary::tGLYPHCACHE cache(48,16*16);
+    Result filled,unfilled;
+    bool ok;
+
+    filled=run(bitmap,true,nullptr);
+    unfilled=run(bitmap,false,nullptr);
+
+    ok=report(name,"bitmap filled",filled,filled);
+    ok&=report(name,"bitmap unfilled",unfilled,unfilled);
+    ok&=report(name,"rle filled",run(rle.getFont(),true,nullptr),filled);
+    ok&=report(name,"rle unfilled",run(rle.getFont(),false,nullptr),unfilled);
+    ok&=report(name,"bitmap cached",run(bitmap,true,&cache),filled);
+    ok&=report(name,"rle cached",run(rle.getFont(),true,&cache),filled);
+
+    return ok;
+  }
+}
+
+
+namespace stm32plus {
+  namespace display {
+    extern const struct FontChar FDEF_APPLE_CHAR[];
+    extern const struct FontChar FDEF_PERFECT_DOS_VGA_437_WIN_CHAR[];
+    extern const struct FontChar FDEF_ATARIST8X16SYSTEMFONT_CHAR[];
+    extern const struct FontChar FDEF_VOLTER__28GOLDFISH_29_CHAR[];
+  }
+}
+
+
+int main() {
+
+  bool ok;
+
+  printf("%-8s %-18s %8s %8s %8s %9s %12s\n","font","variant","axes/fr","writes/fr","raw/fr","pixels/fr","host chars/s");
+
+  ok=benchmark("apple",FDEF_APPLE_CHAR,32,95,8,0);
+  ok&=benchmark("volter",FDEF_VOLTER__28GOLDFISH_29_CHAR,32,95,10,1);
+  ok&=benchmark("dos",FDEF_PERFECT_DOS_VGA_437_WIN_CHAR,32,143,15,0);
+  ok&=benchmark("atari",FDEF_ATARIST8X16SYSTEMFONT_CHAR,32,96,16,0);
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace hosttest {
+
+  /*
+   * Requests captured from browsers and tools talking to the web server example's dashboard
+   * at 192.168.0.10, with what the request line parser must get out of each one. The body,
+   * if there is one, follows the blank line.
+   */
+
+  struct CapturedHttpRequest {
+    const char *Name;
+    const char *Text;
+    const char *Action;
+    const char *Uri;
+    const char *Version;
+    uint32_t ContentLength;
+  };
+
+
+  const CapturedHttpRequest CAPTURED_HTTP_REQUESTS[]={
+
+    { "chrome page",
+      "GET / HTTP/1.1\r\n"
+      "Host: 192.168.0.10\r\n"
+      "Connection: keep-alive\r\n"
+      "Cache-Control: max-age=0\r\n"
+      "Upgrade-Insecure-Requests: 1\r\n"
+      "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/37.0.2062.120 Safari/537.36\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+      "Accept-Encoding: gzip,deflate,sdch\r\n"
+      "Accept-Language: en-GB,en-US;q=0.8,en;q=0.6\r\n"
+      "\r\n",
+      "GET","/","HTTP/1.1",0 },
+
+    { "firefox script",
+      "GET /js/dashboard.js HTTP/1.1\r\n"
+      "Host: 192.168.0.10\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:32.0) Gecko/20100101 Firefox/32.0\r\n"
+      "Accept: */*\r\n"
+      "Accept-Language: en-gb,en;q=0.5\r\n"
+      "Accept-Encoding: gzip, deflate\r\n"
+      "Referer: http://192.168.0.10/\r\n"
+      "If-None-Match: \"5a1c-2f0e\"\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n",
+      "GET","/js/dashboard.js","HTTP/1.1",0 },
+
+    { "telemetry poll",
+      "GET /api/telemetry?since=1411929381&fields=temp%20rh%20vbat HTTP/1.1\r\n"
+      "Host: 192.168.0.10\r\n"
+      "Connection: keep-alive\r\n"
+      "Accept: application/json, text/javascript, */*; q=0.01\r\n"
+      "X-Requested-With: XMLHttpRequest\r\n"
+      "User-Agent: Mozilla/5.0 (Windows NT 6.1; WOW64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/37.0.2062.120 Safari/537.36\r\n"
+      "Referer: http://192.168.0.10/\r\n"
+      "Accept-Encoding: gzip,deflate,sdch\r\n"
+      "Accept-Language: en-GB,en-US;q=0.8,en;q=0.6\r\n"
+      "Cookie: session=6f1d2c9a8b7e; units=metric\r\n"
+      "\r\n",
+      "GET","/api/telemetry?since=1411929381&fields=temp rh vbat","HTTP/1.1",0 },
+
+    { "curl",
+      "GET /status.txt HTTP/1.1\r\n"
+      "User-Agent: curl/7.35.0\r\n"
+      "Host: 192.168.0.10\r\n"
+      "Accept: */*\r\n"
+      "\r\n",
+      "GET","/status.txt","HTTP/1.1",0 },
+
+    { "proxy, http/1.0",
+      "GET http://192.168.0.10/images/logo%20small.png HTTP/1.0\r\n"
+      "Host: 192.168.0.10\r\n"
+      "User-Agent: Wget/1.15 (linux-gnu)\r\n"
+      "Accept: */*\r\n"
+      "\r\n",
+      "GET","/images/logo small.png","HTTP/1.0",0 },
+
+    { "settings form",
+      "POST /settings HTTP/1.1\r\n"
+      "Host: 192.168.0.10\r\n"
+      "Connection: keep-alive\r\n"
+      "Content-Length: 44\r\n"
+      "Cache-Control: max-age=0\r\n"
+      "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n"
+      "Origin: http://192.168.0.10\r\n"
+      "Content-Type: application/x-www-form-urlencoded\r\n"
+      "Referer: http://192.168.0.10/settings.html\r\n"
+      "\r\n"
+      "interval=30&units=metric&name=Greenhouse+%2A",
+      "POST","/settings","HTTP/1.1",44 }
+  };
+
+  const uint32_t CAPTURED_HTTP_REQUEST_COUNT=sizeof(CAPTURED_HTTP_REQUESTS)/sizeof(CAPTURED_HTTP_REQUESTS[0]);
+}
@@ -0,0 +1,35 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+
+namespace hosttest {
+
+  /*
+   * The RFC 1071 sum of a block of bytes taken one big endian 16 bit word at a time, with an
+   * odd last byte padded with zero. It's returned in memory order so that it compares with
+   * InternetChecksum::getSum().
+   */
+
+  inline uint16_t referenceSum(const uint8_t *data,uint32_t length) {
+
+    uint32_t sum,i;
+
+    for(sum=0,i=0;i<length;i+=2) {
+      sum+=data[i] << 8;
+      if(i+1<length)
+        sum+=data[i+1];
+    }
+
+    while(sum >> 16)
+      sum=(sum & 0xffff)+(sum >> 16);
+
+    return static_cast<uint16_t>((sum >> 8) | (sum << 8));
+  }
+}
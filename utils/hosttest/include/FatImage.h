@@ -0,0 +1,149 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace hosttest {
+
+  /*
+   * Helpers for the programs that put a FAT file system on a block device in memory
+   */
+
+  struct FatImage {
+
+    /*
+     * Mount the file system on a device, with a free cluster bitmap if there's RAM for one
+     * @return The file system, or nullptr if it can't be mounted. The caller deletes it.
+     */
+
+    static stm32plus::fat::FatFileSystem *mount(stm32plus::BlockDevice& device,uint32_t freeClusterBitmapBytes=0) {
+
+      static stm32plus::NullTimeProvider timeProvider;
+      stm32plus::fat::FatFileSystem *fs;
+
+      fs=nullptr;
+      return stm32plus::fat::FatFileSystem::getInstance(device,timeProvider,fs,freeClusterBitmapBytes) ? fs : nullptr;
+    }
+
+
+    /*
+     * Format the whole device as FAT16 or FAT32 and mount it
+     */
+
+    static stm32plus::fat::FatFileSystem *format(stm32plus::BlockDevice& device,bool fat32) {
+
+      if(fat32)
+        stm32plus::fat::Fat32FileSystemFormatter(device,0,device.getTotalBlocksOnDevice(),"HOSTTEST");
+      else
+        stm32plus::fat::Fat16FileSystemFormatter(device,0,device.getTotalBlocksOnDevice(),"HOSTTEST");
+
+      return mount(device);
+    }
+
+
+    /*
+     * Format the device and create the files that the FatFile benchmarks use, each full of
+     * its pattern. The contiguous file and the two that are interleaved cluster by cluster
+     * are written with the free cluster bitmap enabled so that they're allocated from the
+     * next free cluster. The scattered file is written after a remount without the bitmap so
+     * that the default wear resistant allocator puts its clusters all over the device.
+     * @return The file system with the bitmap disabled, or nullptr if it fails.
+     */
+
+    static stm32plus::fat::FatFileSystem *formatWithFiles(stm32plus::BlockDevice& device,bool fat32,uint32_t size) {
+
+      std::unique_ptr<stm32plus::fat::FatFileSystem> fs(format(device,fat32));
+      uint32_t clusterSize;
+
+      if(!fs || !fs->enableFreeClusterBitmap(1))
+        return nullptr;
+
+      clusterSize=fs->getBootSector().BPB_SecPerClus*device.getBlockSizeInBytes();
+
+      if(!createFiles(*fs,{ "/contig.bin" },size,65536) || !createFiles(*fs,{ "/frag0.bin","/frag1.bin" },size,clusterSize))
+        return nullptr;
+
+      fs.reset();
+      fs.reset(mount(device));
+
+      if(!fs || !createFiles(*fs,{ "/scatter.bin" },size,65536))
+        return nullptr;
+
+      return fs.release();
+    }
+
+
+    /*
+     * The byte at an offset in a numbered file. Every byte differs from its neighbours and
+     * from the byte at the same offset in the other files.
+     */
+
+    static uint8_t pattern(uint32_t file,uint32_t offset) {
+      return (offset*7)+(offset >> 9)+(offset >> 17)+file*101;
+    }
+
+
+    static void fill(uint8_t *data,uint32_t file,uint32_t offset,uint32_t size) {
+      while(size--)
+        *data++=pattern(file,offset++);
+    }
+
+
+    static bool check(const uint8_t *data,uint32_t file,uint32_t offset,uint32_t size) {
+
+      while(size--)
+        if(*data++!=pattern(file,offset++))
+          return false;
+
+      return true;
+    }
+
+
+    /*
+     * Create files full of their pattern. They're written a piece of each at a time so that
+     * pieces of the same size as a cluster leave their clusters interleaved on the device
+     * and pieces as big as the file leave each one contiguous.
+     * @return false if it fails
+     */
+
+    static bool createFiles(stm32plus::fat::FatFileSystem& fs,const std::vector<std::string>& names,uint32_t size,uint32_t pieceSize) {
+
+      std::vector<stm32plus::File *> files;
+      std::vector<uint8_t> piece(pieceSize);
+      uint32_t i,offset,length;
+      stm32plus::File *file;
+      bool ok;
+
+      ok=true;
+
+      for(i=0;ok && i<names.size();i++) {
+        if((ok=fs.createFile(names[i].c_str()) && fs.openFile(names[i].c_str(),file)))
+          files.push_back(file);
+      }
+
+      for(offset=0;ok && offset<size;offset+=pieceSize) {
+
+        length=std::min(pieceSize,size-offset);
+
+        for(i=0;ok && i<files.size();i++) {
+          fill(&piece[0],i,offset,length);
+          ok=files[i]->write(&piece[0],length);
+        }
+      }
+
+      for(stm32plus::File *f : files)
+        delete f;
+
+      return ok;
+    }
+  };
+}
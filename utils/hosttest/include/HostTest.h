@@ -0,0 +1,44 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+
+/*
+ * Minimal checking support for the host tests. A failed check prints where it was and the
+ * test carries on so that one run shows every failure.
+ */
+
+namespace hosttest {
+
+  inline uint32_t& failures() {
+    static uint32_t count=0;
+    return count;
+  }
+
+  inline void check(bool ok,const char *expression,const char *file,int line) {
+
+    if(!ok) {
+      fprintf(stderr,"%s:%d: check failed: %s\n",file,line,expression);
+      failures()++;
+    }
+  }
+
+  inline int result(const char *name) {
+
+    if(failures())
+      printf("%s: %u failure(s)\n",name,static_cast<unsigned>(failures()));
+    else
+      printf("%s: passed\n",name);
+
+    return failures()==0 ? 0 : 1;
+  }
+}
+
+#define HOSTTEST_CHECK(x) hosttest::check((x),#x,__FILE__,__LINE__)
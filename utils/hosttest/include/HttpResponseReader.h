@@ -0,0 +1,171 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <strings.h>
+
+
+namespace hosttest {
+
+  /*
+   * An HTTP response taken apart from what a peer received from the stack
+   */
+
+  struct HttpResponse {
+
+    std::string StatusLine;
+    uint16_t Status;
+    std::vector<std::string> Headers;
+    std::string Body;
+
+    bool hasHeader(const char *name) const;
+    std::string getHeader(const char *name) const;
+  };
+
+
+  uint32_t readHttpResponse(const std::string& data,bool head,HttpResponse& response,bool closed=false);
+  uint32_t readChunkedBody(const std::string& data,size_t pos,std::string& body);
+
+
+  /*
+   * Check if there's a header with this name
+   */
+
+  inline bool HttpResponse::hasHeader(const char *name) const {
+
+    size_t length;
+
+    length=strlen(name);
+
+    for(const std::string& header : Headers)
+      if(header.length()>length && header[length]==':' && !strncasecmp(header.c_str(),name,length))
+        return true;
+
+    return false;
+  }
+
+
+  /*
+   * Get the value of a header without the spaces before it, empty if there isn't one
+   */
+
+  inline std::string HttpResponse::getHeader(const char *name) const {
+
+    size_t length,pos;
+
+    length=strlen(name);
+
+    for(const std::string& header : Headers) {
+
+      if(header.length()>length && header[length]==':' && !strncasecmp(header.c_str(),name,length)) {
+        for(pos=length+1;pos<header.length() && header[pos]==' ';pos++);
+        return header.substr(pos);
+      }
+    }
+
+    return std::string();
+  }
+
+
+  /*
+   * Take the first complete response off the front of the data. There's no body in the answer
+   * to a HEAD request or in a 304. Otherwise the body is chunked, or as long as the
+   * Content-Length header says, or if there's neither then it ends when the server closes.
+   * @param data What the peer has received
+   * @param head true if the request was HEAD
+   * @param[out] response The response
+   * @param closed true if the server has closed the connection
+   * @return The size of the response, zero if it hasn't all arrived
+   */
+
+  inline uint32_t readHttpResponse(const std::string& data,bool head,HttpResponse& response,bool closed) {
+
+    size_t pos,end,bodySize;
+
+    if((end=data.find("\r\n\r\n"))==std::string::npos)
+      return 0;
+
+    response.Headers.clear();
+    response.Body.clear();
+
+    pos=data.find("\r\n");
+    response.StatusLine=data.substr(0,pos);
+    response.Status=response.StatusLine.length()>12 ? atoi(response.StatusLine.c_str()+9) : 0;
+
+    while(pos!=end) {
+      pos+=2;
+      response.Headers.push_back(data.substr(pos,data.find("\r\n",pos)-pos));
+      pos=data.find("\r\n",pos);
+    }
+
+    pos=end+4;
+
+    if(head || response.Status==304)
+      return pos;
+
+    if(!strcasecmp(response.getHeader("Transfer-Encoding").c_str(),"chunked"))
+      return readChunkedBody(data,pos,response.Body);
+
+    if(response.hasHeader("Content-Length"))
+      bodySize=strtoul(response.getHeader("Content-Length").c_str(),nullptr,10);
+    else if(closed)
+      bodySize=data.length()-pos;
+    else
+      return 0;
+
+    if(data.length()-pos<bodySize)
+      return 0;
+
+    response.Body=data.substr(pos,bodySize);
+    return pos+bodySize;
+  }
+
+
+  /*
+   * Decode a chunked body. Each chunk is a hex size, CRLF, the data and CRLF, and the last
+   * one has a size of zero.
+   * @param data What the peer has received
+   * @param pos Where the body starts
+   * @param[out] body The decoded body
+   * @return The end of the body, zero if it hasn't all arrived or isn't well formed
+   */
+
+  inline uint32_t readChunkedBody(const std::string& data,size_t pos,std::string& body) {
+
+    size_t end;
+    uint32_t size;
+    char *last;
+
+    body.clear();
+
+    for(;;) {
+
+      if((end=data.find("\r\n",pos))==std::string::npos)
+        return 0;
+
+      size=strtoul(data.c_str()+pos,&last,16);
+
+      if(last!=data.c_str()+end || end==pos)
+        return 0;
+
+      pos=end+2;
+
+      if(size==0)
+        return data.compare(pos,2,"\r\n")==0 ? pos+2 : 0;
+
+      if(data.length()<pos+size+2 || data.compare(pos+size,2,"\r\n")!=0)
+        return 0;
+
+      body.append(data,pos,size);
+      pos+=size+2;
+    }
+  }
+}
@@ -0,0 +1,198 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+
+namespace stm32plus {
+
+  /*
+   * A block device in memory with 512 byte blocks and no MBR, which is how a formatter leaves
+   * a card. It counts the calls and the blocks that go through it, and a block index can be
+   * made to fail so that the error paths can be driven. An index that's off the end of the
+   * device is a bug in the caller and aborts the program.
+   */
+
+  class MemoryBlockDevice : public BlockDevice {
+
+    public:
+
+      enum {
+        BLOCK_SIZE = 512,
+        NO_FAILURE = 0xffffffff
+      };
+
+      struct Counters {
+        uint32_t ReadCalls;             // readBlock() and readBlocks() calls
+        uint32_t WriteCalls;            // writeBlock() and writeBlocks() calls
+        uint32_t BlocksRead;
+        uint32_t BlocksWritten;
+      };
+
+      struct Write {
+        uint32_t BlockIndex;
+        uint32_t NumBlocks;
+      };
+
+    protected:
+      std::vector<uint8_t> _data;
+      std::vector<Write> _writes;
+      Counters _counters;
+      uint32_t _failingBlock;
+
+    protected:
+      void check(uint32_t blockIndex,uint32_t numBlocks) const;
+      bool fails(uint32_t blockIndex,uint32_t numBlocks) const;
+
+    public:
+      MemoryBlockDevice(uint32_t numBlocks);
+
+      uint8_t *getBlock(uint32_t blockIndex);
+      std::vector<uint8_t>& getData();
+
+      const Counters& getCounters() const;
+      const std::vector<Write>& getWrites() const;
+      void resetCounters();
+
+      void setFailingBlock(uint32_t blockIndex);
+
+      // overrides from BlockDevice
+
+      virtual uint32_t getTotalBlocksOnDevice() override;
+      virtual uint32_t getBlockSizeInBytes() override;
+      virtual bool readBlock(void *dest,uint32_t blockIndex) override;
+      virtual bool readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) override;
+      virtual bool writeBlock(const void *src,uint32_t blockIndex) override;
+      virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) override;
+      virtual formatType getFormatType() override;
+  };
+
+
+  /*
+   * Create a device full of zeros
+   */
+
+  inline MemoryBlockDevice::MemoryBlockDevice(uint32_t numBlocks)
+    : _data(numBlocks*BLOCK_SIZE),
+      _failingBlock(NO_FAILURE) {
+
+    resetCounters();
+  }
+
+
+  inline uint8_t *MemoryBlockDevice::getBlock(uint32_t blockIndex) {
+    check(blockIndex,1);
+    return &_data[blockIndex*BLOCK_SIZE];
+  }
+
+
+  inline std::vector<uint8_t>& MemoryBlockDevice::getData() {
+    return _data;
+  }
+
+
+  inline const MemoryBlockDevice::Counters& MemoryBlockDevice::getCounters() const {
+    return _counters;
+  }
+
+
+  /*
+   * Every write call in the order that they were made since the counters were reset
+   */
+
+  inline const std::vector<MemoryBlockDevice::Write>& MemoryBlockDevice::getWrites() const {
+    return _writes;
+  }
+
+
+  inline void MemoryBlockDevice::resetCounters() {
+    memset(&_counters,0,sizeof(_counters));
+    _writes.clear();
+  }
+
+
+  /*
+   * Make reads and writes that include this block fail. NO_FAILURE puts it right.
+   */
+
+  inline void MemoryBlockDevice::setFailingBlock(uint32_t blockIndex) {
+    _failingBlock=blockIndex;
+  }
+
+
+  inline void MemoryBlockDevice::check(uint32_t blockIndex,uint32_t numBlocks) const {
+
+    if(numBlocks==0 || blockIndex>=_data.size()/BLOCK_SIZE || numBlocks>_data.size()/BLOCK_SIZE-blockIndex) {
+      fprintf(stderr,"MemoryBlockDevice: bad block range %u+%u\n",static_cast<unsigned>(blockIndex),static_cast<unsigned>(numBlocks));
+      abort();
+    }
+  }
+
+
+  inline bool MemoryBlockDevice::fails(uint32_t blockIndex,uint32_t numBlocks) const {
+    return _failingBlock>=blockIndex && _failingBlock-blockIndex<numBlocks;
+  }
+
+
+  inline uint32_t MemoryBlockDevice::getTotalBlocksOnDevice() {
+    return _data.size()/BLOCK_SIZE;
+  }
+
+
+  inline uint32_t MemoryBlockDevice::getBlockSizeInBytes() {
+    return BLOCK_SIZE;
+  }
+
+
+  inline bool MemoryBlockDevice::readBlock(void *dest,uint32_t blockIndex) {
+    return readBlocks(dest,blockIndex,1);
+  }
+
+
+  inline bool MemoryBlockDevice::readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) {
+
+    check(blockIndex,numBlocks);
+
+    _counters.ReadCalls++;
+
+    if(fails(blockIndex,numBlocks))
+      return false;
+
+    _counters.BlocksRead+=numBlocks;
+    memcpy(dest,&_data[blockIndex*BLOCK_SIZE],numBlocks*BLOCK_SIZE);
+    return true;
+  }
+
+
+  inline bool MemoryBlockDevice::writeBlock(const void *src,uint32_t blockIndex) {
+    return writeBlocks(src,blockIndex,1);
+  }
+
+
+  inline bool MemoryBlockDevice::writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) {
+
+    check(blockIndex,numBlocks);
+
+    _counters.WriteCalls++;
+
+    if(fails(blockIndex,numBlocks))
+      return false;
+
+    _counters.BlocksWritten+=numBlocks;
+    _writes.push_back({ blockIndex,numBlocks });
+
+    memcpy(&_data[blockIndex*BLOCK_SIZE],src,numBlocks*BLOCK_SIZE);
+    return true;
+  }
+
+
+  inline BlockDevice::formatType MemoryBlockDevice::getFormatType() {
+    return formatNoMbr;
+  }
+}
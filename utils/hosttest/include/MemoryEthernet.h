@@ -0,0 +1,241 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+
+
+namespace stm32plus {
+  namespace net {
+
+    /*
+     * A PHY that has nothing to do. The cable is always connected.
+     */
+
+    class MemoryPhy {
+
+      public:
+        struct Parameters {
+        };
+
+      public:
+        bool initialise(Parameters& /* params */,NetworkUtilityObjects& /* netutils */) {
+          return true;
+        }
+
+        bool startup() {
+          return true;
+        }
+    };
+
+
+    /*
+     * A MAC that stands in for the ST MAC on the host. Frames are put on the "wire" by calling
+     * receive() and the frames that the stack transmits are queued up to be collected with
+     * getTransmittedFrame(). A transmitted buffer is held until completeTransmits() is called,
+     * which does what the transmit interrupt does on the MCU. There is no checksum offload so
+     * the frames it transmits have zero checksums and nothing is checked on receive.
+     */
+
+    template<class TPhysicalLayer>
+    class MemoryMac : public virtual TPhysicalLayer,
+                      public virtual NetworkReceiveEvents,
+                      public virtual NetworkErrorEvents,
+                      public virtual NetworkSendEvents,
+                      public virtual NetworkNotificationEvents {
+
+      public:
+        enum {
+          E_TOO_BIG=1           ///< the frame is bigger than the MTU
+        };
+
+        struct Parameters {
+
+          uint16_t mac_mtu;
+          MacAddress mac_address;
+
+          Parameters() {
+            mac_mtu=1518;
+            mac_address.macAddress[0]=2;
+            mac_address.macAddress[1]=0;
+            mac_address.macAddress[2]=0;
+            mac_address.macAddress[3]=0;
+            mac_address.macAddress[4]=0;
+            mac_address.macAddress[5]=1;
+          }
+        };
+
+      protected:
+        Parameters _params;
+        std::vector<uint8_t> _receiveBuffer;
+        std::deque<std::vector<uint8_t>> _transmitted;
+        std::vector<NetBuffer *> _sending;
+
+      protected:
+        void onSend(NetEventDescriptor& ned);
+
+      public:
+        ~MemoryMac();
+
+        bool initialise(Parameters& params);
+        bool startup();
+
+        uint32_t getDatalinkTransmitHeaderSize() const;
+        uint32_t getDatalinkMtuSize() const;
+
+        void receive(const void *frame,uint32_t size);
+        bool getTransmittedFrame(std::vector<uint8_t>& frame);
+        void completeTransmits();
+    };
+
+
+    template<class TPhysicalLayer>
+    inline MemoryMac<TPhysicalLayer>::~MemoryMac() {
+      for(NetBuffer *nb : _sending)
+        delete nb;
+    }
+
+
+    template<class TPhysicalLayer>
+    inline bool MemoryMac<TPhysicalLayer>::initialise(Parameters& params) {
+
+      _params=params;
+      _receiveBuffer.resize(_params.mac_mtu);
+
+      this->NetworkSendEventSender.insertSubscriber(NetEventDescriptor::NetEventType::ETHERNET_TRANSMIT_REQUEST,NetworkSendEventSourceSlot::bind(this,&MemoryMac<TPhysicalLayer>::onSend));
+      return true;
+    }
+
+
+    template<class TPhysicalLayer>
+    inline bool MemoryMac<TPhysicalLayer>::startup() {
+      this->NetworkNotificationEventSender.raiseEvent(MacAddressAnnouncementEvent(_params.mac_address));
+      return true;
+    }
+
+
+    template<class TPhysicalLayer>
+    inline uint32_t MemoryMac<TPhysicalLayer>::getDatalinkTransmitHeaderSize() const {
+      return 14;
+    }
+
+
+    template<class TPhysicalLayer>
+    inline uint32_t MemoryMac<TPhysicalLayer>::getDatalinkMtuSize() const {
+      return _params.mac_mtu;
+    }
+
+
+    /*
+     * Receive an ethernet v2 frame without a tag. The frame is copied into the receive buffer
+     * like the DMA would do and then goes up the stack in this call.
+     */
+
+    template<class TPhysicalLayer>
+    inline void MemoryMac<TPhysicalLayer>::receive(const void *frame,uint32_t size) {
+
+      EthernetFrameData *efd;
+      EthernetFrame ef;
+
+      if(size<sizeof(EthernetFrameData) || size>_receiveBuffer.size()) {
+        fprintf(stderr,"MemoryMac: bad frame size %u\n",static_cast<unsigned>(size));
+        abort();
+      }
+
+      memcpy(&_receiveBuffer[0],frame,size);
+      efd=reinterpret_cast<EthernetFrameData *>(&_receiveBuffer[0]);
+
+      ef.destinationMac=&efd->eth_destinationAddress;
+      ef.sourceMac=&efd->eth_sourceAddress;
+      ef.frameSource=DatalinkFrame::FrameSource::ETHERNET_FRAME;
+      ef.protocol=NetUtil::ntohs(efd->eth_etherType);
+      ef.payload=efd->eth_data;
+      ef.payloadLength=size-offsetof(EthernetFrameData,eth_data);
+
+      this->NetworkReceiveEventSender.raiseEvent(DatalinkFrameEvent(ef));
+    }
+
+
+    /*
+     * Get the oldest frame that the stack has transmitted
+     */
+
+    template<class TPhysicalLayer>
+    inline bool MemoryMac<TPhysicalLayer>::getTransmittedFrame(std::vector<uint8_t>& frame) {
+
+      if(_transmitted.empty())
+        return false;
+
+      frame.swap(_transmitted.front());
+      _transmitted.pop_front();
+      return true;
+    }
+
+
+    /*
+     * Release the buffers that have been "transmitted" and tell the stack that they've gone
+     */
+
+    template<class TPhysicalLayer>
+    inline void MemoryMac<TPhysicalLayer>::completeTransmits() {
+
+      std::vector<NetBuffer *> sent;
+
+      sent.swap(_sending);
+
+      for(NetBuffer *nb : sent) {
+
+        this->NetworkNotificationEventSender.raiseEvent(DatalinkFrameSentEvent(*nb));
+
+        if(nb->getReference())
+          this->NetworkNotificationEventSender.raiseEvent(DatalinkFrameSentEvent(*(nb->getReference())));
+
+        delete nb;
+      }
+    }
+
+
+    /*
+     * Add the ethernet header and gather the internal buffer and the segments into a frame
+     */
+
+    template<class TPhysicalLayer>
+    inline void MemoryMac<TPhysicalLayer>::onSend(NetEventDescriptor& ned) {
+
+      EthernetTransmitRequestEvent& event=static_cast<EthernetTransmitRequestEvent&>(ned);
+      const NetBufferSegment *seg;
+      EthernetFrameData *efd;
+      const uint8_t *ptr;
+
+      efd=reinterpret_cast<EthernetFrameData *>(event.networkBuffer->moveWritePointerBack(getDatalinkTransmitHeaderSize()));
+
+      efd->eth_destinationAddress=event.macAddress;
+      efd->eth_sourceAddress=_params.mac_address;
+      efd->eth_etherType=NetUtil::htons(static_cast<uint16_t>(event.etherType));
+
+      std::vector<uint8_t> frame;
+
+      ptr=static_cast<const uint8_t *>(event.networkBuffer->getInternalBuffer());
+      frame.assign(ptr,ptr+event.networkBuffer->getInternalBufferSize());
+
+      for(seg=event.networkBuffer->getFirstSegment();seg;seg=seg->getNext())
+        frame.insert(frame.end(),seg->getData(),seg->getData()+seg->getSize());
+
+      if(frame.size()>_params.mac_mtu) {
+        delete event.networkBuffer;
+        this->setError(ErrorProvider::ERROR_PROVIDER_NET_MAC,E_TOO_BIG);
+        return;
+      }
+
+      _transmitted.push_back(frame);
+      _sending.push_back(event.networkBuffer);
+
+      event.succeeded=true;
+    }
+  }
+}
@@ -0,0 +1,1214 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace stm32plus {
+  namespace net {
+
+    /*
+     * The stack that the network tests run: the real layers from ARP and IP upwards on top of
+     * the memory PHY and MAC, with a static address, DNS and ping
+     */
+
+    typedef PhysicalLayer<MemoryPhy> MemoryPhysicalLayer;
+    typedef DatalinkLayer<MemoryPhysicalLayer,MemoryMac> MemoryDatalinkLayer;
+    typedef NetworkLayer<MemoryDatalinkLayer,DefaultIp,Arp> MemoryNetworkLayer;
+    typedef TransportLayer<MemoryNetworkLayer,Icmp,Udp,Tcp> MemoryTransportLayer;
+    typedef ApplicationLayer<MemoryTransportLayer,StaticIpClient,Dns,Ping> MemoryApplicationLayer;
+    typedef NetworkStack<MemoryApplicationLayer> MemoryNetworkStack;
+
+    class MemoryTcpPeer;
+    class MemoryHost;
+
+
+    /*
+     * A network segment with the stack at 192.168.0.10 and any number of TCP peers and hosts on it.
+     * The wire is serviced by the millisecond timer's interrupt function so that the stack's
+     * blocking calls see replies arrive while they wait, as they would on the MCU. Each
+     * service moves every queued frame in both directions. Time only passes when the wire is
+     * quiet, a millisecond per service, and the RTC second interrupt follows the clock.
+     *
+     * Frames the stack sends are decoded here: ARP requests for a peer or a host are answered,
+     * TCP segments are handed to the peer that owns the address and port and anything else
+     * sent to a host's address goes to the host.
+     *
+     * The wire is perfect unless a test says otherwise. Each direction has a Link that can
+     * lose frames at random or by the test's own choice, delay every frame by a fixed time,
+     * hold frames back at random so that later ones overtake them and send frames twice. The
+     * peers and hosts don't retransmit, so a test that loses frames to the stack should only
+     * lose the ones that the stack will recover from.
+     */
+
+    class MemoryNetwork {
+
+      public:
+        struct Counters {
+          uint32_t FramesToStack;
+          uint32_t FramesFromStack;
+          uint32_t BytesToStack;
+          uint32_t BytesFromStack;
+          uint32_t FramesLostToStack;
+          uint32_t FramesLostFromStack;
+          uint32_t FramesReordered;       // in either direction
+          uint32_t FramesDuplicated;      // in either direction
+        };
+
+        typedef bool (*LoseFunction)(const std::vector<uint8_t>& frame);
+
+        struct Link {
+          uint32_t LossOneIn;             // lose one frame in this many at random, zero for none
+          uint32_t ReorderOneIn;          // hold back one frame in this many at random, zero for none
+          uint32_t DuplicateOneIn;        // send one frame in this many twice at random, zero for none
+          uint32_t Delay;                 // milliseconds that each frame spends on the wire
+          uint32_t ReorderDelay;          // extra milliseconds that a frame is held back for
+          LoseFunction Lose;              // sees every frame and returns true to lose it, or nullptr
+
+          Link()
+            : LossOneIn(0),
+              ReorderOneIn(0),
+              DuplicateOneIn(0),
+              Delay(0),
+              ReorderDelay(1),
+              Lose(nullptr) {
+          }
+        };
+
+      protected:
+        struct InFlight {
+          uint32_t DeliveryTime;
+          std::vector<uint8_t> Frame;
+        };
+
+        RtcSecondInterruptFeature _rtc;
+        MemoryNetworkStack::Parameters _params;
+        scoped_ptr<MemoryNetworkStack> _stack;
+        Link _linkToStack;
+        Link _linkFromStack;
+        std::deque<InFlight> _toStack;
+        std::deque<InFlight> _fromStack;
+        std::vector<MemoryTcpPeer *> _peers;
+        std::vector<MemoryHost *> _hosts;
+        Counters _counters;
+        uint32_t _lastSecond;
+
+      protected:
+        static MemoryNetwork *& instance();
+        static void onTimerInterrupt();
+
+        void service();
+        bool send(Link& link,std::deque<InFlight>& wire,const std::vector<uint8_t>& frame);
+        static void putOnWire(std::deque<InFlight>& wire,uint32_t deliveryTime,const std::vector<uint8_t>& frame);
+        static bool arrived(std::deque<InFlight>& wire,std::vector<uint8_t>& frame);
+        void dispatch(const std::vector<uint8_t>& frame);
+        bool dispatchTcp(const IpPacketHeader& iph);
+        void answerArp(const ArpFrameData& request);
+        MemoryHost *findHost(const IpAddress& address) const;
+
+      public:
+        MemoryNetwork();
+        ~MemoryNetwork();
+
+        MemoryNetworkStack::Parameters& getParameters();
+        bool initialise();
+
+        MemoryNetworkStack& getStack();
+        Link& getLinkToStack();
+        Link& getLinkFromStack();
+
+        void run(uint32_t millis);
+
+        template<class TCondition>
+        bool runUntil(TCondition condition,uint32_t timeout);
+
+        void transmit(const std::vector<uint8_t>& frame);
+        void answerArp(const ArpFrameData& request,const MacAddress& macAddress,const IpAddress& ipAddress);
+        void addPeer(MemoryTcpPeer& peer);
+        void removePeer(MemoryTcpPeer& peer);
+        void addHost(MemoryHost& host);
+        void removeHost(MemoryHost& host);
+
+        const Counters& getCounters() const;
+        void resetCounters();
+
+        static IpAddress getStackAddress();
+        static MacAddress getStackMacAddress();
+        static MacAddress getMacAddress(const IpAddress& address);
+
+        static std::vector<uint8_t> createIpFrame(const MacAddress& sourceMac,
+                                                  const IpAddress& sourceAddress,
+                                                  IpProtocol protocol,
+                                                  uint16_t payloadSize,
+                                                  uint16_t identification);
+        static uint8_t *getIpPayload(std::vector<uint8_t>& frame);
+    };
+
+
+    /*
+     * The remote end of a TCP connection to or from the stack. It's a minimal TCP that
+     * doesn't retransmit, so nothing that it sends may be lost. The stack's window is
+     * respected, every segment received is acknowledged at once and the peer's own receive
+     * window is always open. Data that arrives ahead of a gap is held until the gap is filled
+     * and gets a duplicate ACK meanwhile, as it would from a real receiver.
+     */
+
+    class MemoryTcpPeer {
+
+      public:
+        enum class State {
+          CLOSED,
+          SYN_SENT,
+          ESTABLISHED,
+          RESET
+        };
+
+      protected:
+        enum {
+          MAXIMUM_SEGMENT_SIZE = 1460     // what fits in an ethernet frame with the IP and TCP headers
+        };
+
+        MemoryNetwork& _network;
+        IpAddress _address;
+        MacAddress _macAddress;
+        uint16_t _port;
+        uint16_t _remotePort;
+        State _state;
+        uint32_t _sendUnacknowledged;
+        uint32_t _sendNext;
+        uint32_t _receiveNext;
+        uint16_t _sendWindow;
+        uint16_t _remoteMss;
+        std::string _output;
+        std::string _received;
+        std::map<uint32_t,std::string> _outOfOrder;
+        bool _offerSack;
+        bool _closing;
+        bool _finSent;
+        bool _remoteClosed;
+        uint16_t _identification;
+
+      protected:
+        void transmit(TcpHeaderFlags flags,const void *data,uint16_t size,bool sendMss);
+        void sendPending();
+        void joinOutOfOrder();
+
+      public:
+        MemoryTcpPeer(MemoryNetwork& network,const char *address,uint16_t port);
+        ~MemoryTcpPeer();
+
+        void connect(uint16_t remotePort,bool offerSack=false);
+        void send(const void *data,uint32_t size);
+        void send(const std::string& data);
+        void close();
+
+        State getState() const;
+        bool isRemoteClosed() const;
+        const std::string& getReceived() const;
+        void clearReceived();
+
+        const IpAddress& getAddress() const;
+        const MacAddress& getMacAddress() const;
+        uint16_t getPort() const;
+
+        void receiveSegment(const TcpHeader& header,const uint8_t *payload,uint16_t payloadSize);
+    };
+
+
+    /*
+     * A host on the network that isn't a TCP peer. It answers ARP requests and echo requests
+     * and can send ARP requests, echo requests and UDP datagrams to the stack. Every other
+     * frame that the stack sends to it is kept.
+     */
+
+    class MemoryHost {
+
+      public:
+        struct Counters {
+          uint32_t ArpRequests;           // ARP requests for this host that were answered
+          uint32_t ArpReplies;            // ARP replies from the stack
+          uint32_t EchoRequests;          // echo requests from the stack that were answered
+          uint32_t EchoReplies;           // echo replies from the stack
+        };
+
+      protected:
+        MemoryNetwork& _network;
+        IpAddress _address;
+        MacAddress _macAddress;
+        MacAddress _stackMacAddress;
+        std::deque<std::vector<uint8_t>> _frames;
+        Counters _counters;
+        uint16_t _identification;
+
+      protected:
+        void sendEcho(IcmpType type,uint16_t identifier,uint16_t sequenceNumber,const void *data,uint16_t size);
+
+      public:
+        MemoryHost(MemoryNetwork& network,const char *address);
+        ~MemoryHost();
+
+        void sendArpRequest();
+        void sendEchoRequest(uint16_t identifier,uint16_t sequenceNumber,const void *data,uint16_t size);
+        void sendUdp(uint16_t sourcePort,uint16_t destinationPort,const void *data,uint16_t size);
+
+        bool getFrame(std::vector<uint8_t>& frame);
+        const Counters& getCounters() const;
+        void resetCounters();
+
+        const IpAddress& getAddress() const;
+        const MacAddress& getMacAddress() const;
+        const MacAddress& getStackMacAddress() const;
+
+        void answerArp(const ArpFrameData& request);
+        void receive(const std::vector<uint8_t>& frame);
+    };
+
+
+    /*
+     * The network that the timer interrupt services
+     */
+
+    inline MemoryNetwork *& MemoryNetwork::instance() {
+      static MemoryNetwork *network=nullptr;
+      return network;
+    }
+
+
+    inline MemoryNetwork::MemoryNetwork()
+      : _lastSecond(0) {
+
+      resetCounters();
+
+      _params.base_rtc=&_rtc;
+      _params.staticip_address="192.168.0.10";
+      _params.staticip_subnetMask="255.255.255.0";
+      _params.staticip_defaultGateway="192.168.0.1";
+      _params.staticip_dnsServers[0]="192.168.0.1";
+      _params.mac_address=getStackMacAddress();
+      _params.arp_startupBroadcast=false;
+    }
+
+
+    inline MemoryNetwork::~MemoryNetwork() {
+
+      if(instance()==this) {
+        MillisecondTimer::interrupt()=nullptr;
+        instance()=nullptr;
+      }
+    }
+
+
+    /*
+     * The stack's parameters, which can be changed before initialise() is called
+     */
+
+    inline MemoryNetworkStack::Parameters& MemoryNetwork::getParameters() {
+      return _params;
+    }
+
+
+    /*
+     * Create and start the stack and connect it to the timer interrupt
+     */
+
+    inline bool MemoryNetwork::initialise() {
+
+      _stack.reset(new MemoryNetworkStack);
+
+      instance()=this;
+      MillisecondTimer::interrupt()=&MemoryNetwork::onTimerInterrupt;
+
+      _lastSecond=MillisecondTimer::counter()/1000;
+
+      return _stack->initialise(_params) && _stack->startup();
+    }
+
+
+    inline MemoryNetworkStack& MemoryNetwork::getStack() {
+      return *_stack;
+    }
+
+
+    /*
+     * What happens to frames on their way to and from the stack
+     */
+
+    inline MemoryNetwork::Link& MemoryNetwork::getLinkToStack() {
+      return _linkToStack;
+    }
+
+
+    inline MemoryNetwork::Link& MemoryNetwork::getLinkFromStack() {
+      return _linkFromStack;
+    }
+
+
+    inline void MemoryNetwork::onTimerInterrupt() {
+      if(instance())
+        instance()->service();
+    }
+
+
+    /*
+     * Move the frames in both directions and let time pass if none moved
+     */
+
+    inline void MemoryNetwork::service() {
+
+      std::vector<uint8_t> frame;
+      bool idle;
+
+      idle=true;
+
+      // what the transmit interrupt does
+
+      _stack->completeTransmits();
+
+      // frames from the stack onto the wire
+
+      while(_stack->getTransmittedFrame(frame)) {
+
+        idle=false;
+        _counters.FramesFromStack++;
+        _counters.BytesFromStack+=frame.size();
+
+        if(!send(_linkFromStack,_fromStack,frame))
+          _counters.FramesLostFromStack++;
+      }
+
+      // frames that have crossed the wire to the peers
+
+      while(arrived(_fromStack,frame)) {
+        idle=false;
+        dispatch(frame);
+      }
+
+      // frames that have crossed the wire to the stack, which is what the receive interrupt does
+
+      while(arrived(_toStack,frame)) {
+
+        idle=false;
+        _counters.FramesToStack++;
+        _counters.BytesToStack+=frame.size();
+
+        _stack->receive(&frame[0],frame.size());
+      }
+
+      if(idle) {
+
+        MillisecondTimer::advance(1);
+
+        if(MillisecondTimer::counter()/1000!=_lastSecond) {
+          _lastSecond=MillisecondTimer::counter()/1000;
+          _rtc.secondInterrupt();
+        }
+      }
+    }
+
+
+    /*
+     * Let some time pass with the network running
+     */
+
+    inline void MemoryNetwork::run(uint32_t millis) {
+
+      uint32_t start;
+
+      start=MillisecondTimer::millis();
+      while(MillisecondTimer::millis()-start<millis);
+    }
+
+
+    /*
+     * Run the network until a condition is met
+     * @return false if it timed out first
+     */
+
+    template<class TCondition>
+    inline bool MemoryNetwork::runUntil(TCondition condition,uint32_t timeout) {
+
+      uint32_t start;
+
+      start=MillisecondTimer::millis();
+
+      while(!condition())
+        if(MillisecondTimer::millis()-start>timeout)
+          return false;
+
+      return true;
+    }
+
+
+    /*
+     * Put a frame on the wire to the stack. Short frames are padded to the ethernet minimum.
+     */
+
+    inline void MemoryNetwork::transmit(const std::vector<uint8_t>& frame) {
+
+      std::vector<uint8_t> padded(frame);
+
+      if(padded.size()<sizeof(EthernetFrameData))
+        padded.resize(sizeof(EthernetFrameData));
+
+      if(!send(_linkToStack,_toStack,padded))
+        _counters.FramesLostToStack++;
+    }
+
+
+    /*
+     * Put a frame on the wire in one direction unless the link loses it. The test's own choice
+     * is asked first so that it sees every frame.
+     * @return false if the frame was lost
+     */
+
+    inline bool MemoryNetwork::send(Link& link,std::deque<InFlight>& wire,const std::vector<uint8_t>& frame) {
+
+      uint32_t deliveryTime;
+
+      if(link.Lose && link.Lose(frame))
+        return false;
+
+      if(link.LossOneIn && rand() % link.LossOneIn==0)
+        return false;
+
+      deliveryTime=MillisecondTimer::counter()+link.Delay;
+
+      if(link.ReorderOneIn && rand() % link.ReorderOneIn==0) {
+        deliveryTime+=link.ReorderDelay;
+        _counters.FramesReordered++;
+      }
+
+      putOnWire(wire,deliveryTime,frame);
+
+      // the copy goes at the same time as the original and arrives just after it
+
+      if(link.DuplicateOneIn && rand() % link.DuplicateOneIn==0) {
+        putOnWire(wire,deliveryTime,frame);
+        _counters.FramesDuplicated++;
+      }
+
+      return true;
+    }
+
+
+    /*
+     * Frames are kept in the order that they will arrive. A frame goes after those that are
+     * due at the same time so without a reorder they arrive in the order they were sent.
+     */
+
+    inline void MemoryNetwork::putOnWire(std::deque<InFlight>& wire,uint32_t deliveryTime,const std::vector<uint8_t>& frame) {
+
+      std::deque<InFlight>::iterator it;
+
+      for(it=wire.end();it!=wire.begin() && static_cast<int32_t>((it-1)->DeliveryTime-deliveryTime)>0;--it);
+      wire.insert(it,InFlight { deliveryTime,frame });
+    }
+
+
+    /*
+     * Take the next frame off the wire if its time on the wire is up
+     * @return false if there isn't one
+     */
+
+    inline bool MemoryNetwork::arrived(std::deque<InFlight>& wire,std::vector<uint8_t>& frame) {
+
+      if(wire.empty() || static_cast<int32_t>(MillisecondTimer::counter()-wire.front().DeliveryTime)<0)
+        return false;
+
+      frame.swap(wire.front().Frame);
+      wire.pop_front();
+      return true;
+    }
+
+
+    inline void MemoryNetwork::addPeer(MemoryTcpPeer& peer) {
+      _peers.push_back(&peer);
+    }
+
+
+    inline void MemoryNetwork::removePeer(MemoryTcpPeer& peer) {
+      _peers.erase(std::remove(_peers.begin(),_peers.end(),&peer),_peers.end());
+    }
+
+
+    inline const MemoryNetwork::Counters& MemoryNetwork::getCounters() const {
+      return _counters;
+    }
+
+
+    inline void MemoryNetwork::resetCounters() {
+      memset(&_counters,0,sizeof(_counters));
+    }
+
+
+    inline IpAddress MemoryNetwork::getStackAddress() {
+      return IpAddress("192.168.0.10");
+    }
+
+
+    inline MacAddress MemoryNetwork::getStackMacAddress() {
+      return MacAddress(2,0,0xc0,0xa8,0,10);
+    }
+
+
+    /*
+     * Decode a frame from the stack and pass it on
+     */
+
+    inline void MemoryNetwork::dispatch(const std::vector<uint8_t>& frame) {
+
+      const EthernetFrameData *efd;
+      const IpPacketHeader *iph;
+      const ArpFrameData *afd;
+      MemoryHost *host;
+
+      efd=reinterpret_cast<const EthernetFrameData *>(&frame[0]);
+
+      if(NetUtil::ntohs(efd->eth_etherType)==static_cast<uint16_t>(EtherType::ARP)) {
+
+        afd=reinterpret_cast<const ArpFrameData *>(efd->eth_data);
+
+        if(afd->arp_operation==ArpOperation::REQUEST)
+          answerArp(*afd);
+        else if((host=findHost(afd->arp_targetProtocolAddress))!=nullptr)
+          host->receive(frame);
+
+        return;
+      }
+
+      if(NetUtil::ntohs(efd->eth_etherType)!=static_cast<uint16_t>(EtherType::IP))
+        return;
+
+      iph=reinterpret_cast<const IpPacketHeader *>(efd->eth_data);
+
+      if(iph->ip_hdr_protocol==IpProtocol::TCP && dispatchTcp(*iph))
+        return;
+
+      if((host=findHost(iph->ip_destinationAddress))!=nullptr)
+        host->receive(frame);
+    }
+
+
+    /*
+     * Hand a TCP segment to the peer that owns it
+     * @return true if there was one
+     */
+
+    inline bool MemoryNetwork::dispatchTcp(const IpPacketHeader& iph) {
+
+      const TcpHeader *tcph;
+      const uint8_t *payload;
+      uint16_t ipLength,ipHeaderLength,port;
+
+      ipHeaderLength=(iph.ip_hdr_version & 0xf)*4;
+      ipLength=NetUtil::ntohs(iph.ip_hdr_length);
+      tcph=reinterpret_cast<const TcpHeader *>(reinterpret_cast<const uint8_t *>(&iph)+ipHeaderLength);
+      payload=reinterpret_cast<const uint8_t *>(tcph)+tcph->getHeaderSize();
+      port=NetUtil::ntohs(tcph->tcp_destinationPort);
+
+      for(MemoryTcpPeer *peer : _peers) {
+        if(peer->getAddress()==iph.ip_destinationAddress && peer->getPort()==port) {
+          peer->receiveSegment(*tcph,payload,ipLength-ipHeaderLength-tcph->getHeaderSize());
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+
+    /*
+     * Reply to an ARP request for one of the peers or hosts
+     */
+
+    inline void MemoryNetwork::answerArp(const ArpFrameData& request) {
+
+      MemoryHost *host;
+
+      for(MemoryTcpPeer *peer : _peers) {
+        if(peer->getAddress()==request.arp_targetProtocolAddress) {
+          answerArp(request,peer->getMacAddress(),peer->getAddress());
+          return;
+        }
+      }
+
+      if((host=findHost(request.arp_targetProtocolAddress))!=nullptr)
+        host->answerArp(request);
+    }
+
+
+    inline void MemoryNetwork::answerArp(const ArpFrameData& request,const MacAddress& macAddress,const IpAddress& ipAddress) {
+
+      EthernetFrameData *efd;
+      ArpFrameData *reply;
+
+      std::vector<uint8_t> frame(sizeof(EthernetFrameData));
+
+      efd=reinterpret_cast<EthernetFrameData *>(&frame[0]);
+      efd->eth_destinationAddress=request.arp_senderHardwareAddress;
+      efd->eth_sourceAddress=macAddress;
+      efd->eth_etherType=NetUtil::htons(static_cast<uint16_t>(EtherType::ARP));
+
+      reply=reinterpret_cast<ArpFrameData *>(efd->eth_data);
+      reply->initialise();
+      reply->createReply(request,macAddress,ipAddress);
+
+      transmit(frame);
+    }
+
+
+    inline MemoryHost *MemoryNetwork::findHost(const IpAddress& address) const {
+
+      for(MemoryHost *host : _hosts)
+        if(host->getAddress()==address)
+          return host;
+
+      return nullptr;
+    }
+
+
+    inline void MemoryNetwork::addHost(MemoryHost& host) {
+      _hosts.push_back(&host);
+    }
+
+
+    inline void MemoryNetwork::removeHost(MemoryHost& host) {
+      _hosts.erase(std::remove(_hosts.begin(),_hosts.end(),&host),_hosts.end());
+    }
+
+
+    /*
+     * Every station's MAC address is made from its IP address
+     */
+
+    inline MacAddress MemoryNetwork::getMacAddress(const IpAddress& address) {
+      return MacAddress(2,1,address.ipAddressBytes[0],address.ipAddressBytes[1],address.ipAddressBytes[2],address.ipAddressBytes[3]);
+    }
+
+
+    /*
+     * Create an ethernet frame addressed to the stack with an IP header and room for the
+     * payload. The IP checksum is left at zero because the stack relies on the MAC to check it.
+     */
+
+    inline std::vector<uint8_t> MemoryNetwork::createIpFrame(const MacAddress& sourceMac,
+                                                             const IpAddress& sourceAddress,
+                                                             IpProtocol protocol,
+                                                             uint16_t payloadSize,
+                                                             uint16_t identification) {
+
+      EthernetFrameData *efd;
+      IpPacketHeader *iph;
+
+      std::vector<uint8_t> frame(14+IpPacketHeader::getNoOptionsHeaderSize()+payloadSize);
+
+      efd=reinterpret_cast<EthernetFrameData *>(&frame[0]);
+      efd->eth_destinationAddress=getStackMacAddress();
+      efd->eth_sourceAddress=sourceMac;
+      efd->eth_etherType=NetUtil::htons(static_cast<uint16_t>(EtherType::IP));
+
+      iph=reinterpret_cast<IpPacketHeader *>(efd->eth_data);
+      iph->ip_hdr_version=0x45;
+      iph->ip_hdr_typeOfService=0;
+      iph->ip_hdr_length=NetUtil::htons(IpPacketHeader::getNoOptionsHeaderSize()+payloadSize);
+      iph->ip_hdr_identification=NetUtil::htons(identification);
+      iph->ip_hdr_flagsAndOffset=0;
+      iph->ip_hdr_ttl=64;
+      iph->ip_hdr_protocol=protocol;
+      iph->ip_hdr_checksum=0;
+      iph->ip_sourceAddress=sourceAddress;
+      iph->ip_destinationAddress=getStackAddress();
+
+      return frame;
+    }
+
+
+    inline uint8_t *MemoryNetwork::getIpPayload(std::vector<uint8_t>& frame) {
+      return &frame[14+IpPacketHeader::getNoOptionsHeaderSize()];
+    }
+
+
+    /*
+     * Create a peer. Its MAC address is made from its IP address.
+     */
+
+    inline MemoryTcpPeer::MemoryTcpPeer(MemoryNetwork& network,const char *address,uint16_t port)
+      : _network(network),
+        _address(address),
+        _port(port),
+        _remotePort(0),
+        _state(State::CLOSED),
+        _sendUnacknowledged(0),
+        _sendNext(0),
+        _receiveNext(0),
+        _sendWindow(0),
+        _remoteMss(536),
+        _offerSack(false),
+        _closing(false),
+        _finSent(false),
+        _remoteClosed(false),
+        _identification(0) {
+
+      _macAddress=MemoryNetwork::getMacAddress(_address);
+      _network.addPeer(*this);
+    }
+
+
+    inline MemoryTcpPeer::~MemoryTcpPeer() {
+      _network.removePeer(*this);
+    }
+
+
+    /*
+     * Send a SYN. The connection is established when the SYN-ACK comes back. The peer can
+     * offer SACK so that the stack will report what it holds out of order, but it doesn't
+     * use the blocks itself.
+     */
+
+    inline void MemoryTcpPeer::connect(uint16_t remotePort,bool offerSack) {
+
+      _remotePort=remotePort;
+      _offerSack=offerSack;
+      _state=State::SYN_SENT;
+      _sendUnacknowledged=_sendNext=static_cast<uint32_t>(_port) << 16;
+
+      transmit(TcpHeaderFlags::SYN,nullptr,0,true);
+      _sendNext++;
+    }
+
+
+    /*
+     * Send data. What the stack's window won't take now goes when it opens.
+     */
+
+    inline void MemoryTcpPeer::send(const void *data,uint32_t size) {
+      _output.append(static_cast<const char *>(data),size);
+      sendPending();
+    }
+
+
+    inline void MemoryTcpPeer::send(const std::string& data) {
+      send(data.c_str(),data.length());
+    }
+
+
+    /*
+     * Close the sending side after the pending data has gone
+     */
+
+    inline void MemoryTcpPeer::close() {
+      _closing=true;
+      sendPending();
+    }
+
+
+    inline MemoryTcpPeer::State MemoryTcpPeer::getState() const {
+      return _state;
+    }
+
+
+    inline bool MemoryTcpPeer::isRemoteClosed() const {
+      return _remoteClosed;
+    }
+
+
+    inline const std::string& MemoryTcpPeer::getReceived() const {
+      return _received;
+    }
+
+
+    inline void MemoryTcpPeer::clearReceived() {
+      _received.clear();
+    }
+
+
+    inline const IpAddress& MemoryTcpPeer::getAddress() const {
+      return _address;
+    }
+
+
+    inline const MacAddress& MemoryTcpPeer::getMacAddress() const {
+      return _macAddress;
+    }
+
+
+    inline uint16_t MemoryTcpPeer::getPort() const {
+      return _port;
+    }
+
+
+    /*
+     * A segment from the stack
+     */
+
+    inline void MemoryTcpPeer::receiveSegment(const TcpHeader& header,const uint8_t *payload,uint16_t payloadSize) {
+
+      const TcpOptionMaximumSegmentSize *mss;
+      uint32_t seq,ack;
+
+      seq=NetUtil::ntohl(header.tcp_sequenceNumber);
+      ack=NetUtil::ntohl(header.tcp_ackNumber);
+
+      if(header.hasRst()) {
+        _state=State::RESET;
+        return;
+      }
+
+      if(_state==State::SYN_SENT) {
+
+        if(!header.hasSyn() || !header.hasAck() || ack!=_sendNext)
+          return;
+
+        if((mss=header.findOption<TcpOptionMaximumSegmentSize>())!=nullptr)
+          _remoteMss=NetUtil::ntohs(mss->tcp_optionMss);
+
+        _receiveNext=seq+1;
+        _sendUnacknowledged=ack;
+        _sendWindow=NetUtil::ntohs(header.tcp_windowSize);
+        _state=State::ESTABLISHED;
+
+        transmit(TcpHeaderFlags::ACK,nullptr,0,false);
+        sendPending();
+        return;
+      }
+
+      if(_state!=State::ESTABLISHED)
+        return;
+
+      if(header.hasAck() && static_cast<int32_t>(ack-_sendUnacknowledged)>=0) {
+        _sendUnacknowledged=ack;
+        _sendWindow=NetUtil::ntohs(header.tcp_windowSize);
+      }
+
+      if(payloadSize || header.hasFin()) {
+
+        // everything new is held by its sequence number and taken in order from there. what
+        // isn't in order yet, or was received before, gets a duplicate ACK.
+
+        if(payloadSize && static_cast<int32_t>(seq+payloadSize-_receiveNext)>0) {
+
+          std::string& held(_outOfOrder[seq]);
+
+          if(held.length()<payloadSize)
+            held.assign(reinterpret_cast<const char *>(payload),payloadSize);
+
+          joinOutOfOrder();
+        }
+
+        if(header.hasFin() && seq+payloadSize==_receiveNext) {
+          _receiveNext++;
+          _remoteClosed=true;
+        }
+
+        transmit(TcpHeaderFlags::ACK,nullptr,0,false);
+      }
+
+      sendPending();
+    }
+
+
+    /*
+     * Take the held data that starts at or before receiveNext. A retransmission can overlap
+     * what's already been taken.
+     */
+
+    inline void MemoryTcpPeer::joinOutOfOrder() {
+
+      std::map<uint32_t,std::string>::iterator it;
+      uint32_t offset;
+
+      while(!_outOfOrder.empty() && static_cast<int32_t>((it=_outOfOrder.begin())->first-_receiveNext)<=0) {
+
+        offset=_receiveNext-it->first;
+
+        if(offset<it->second.length()) {
+          _received.append(it->second,offset,std::string::npos);
+          _receiveNext+=it->second.length()-offset;
+        }
+
+        _outOfOrder.erase(it);
+      }
+    }
+
+
+    /*
+     * Send as much of the pending data as the window allows, then the FIN if closing. The
+     * stack works its MSS out from a MTU that includes the ethernet header so its offer is
+     * too big for the wire.
+     */
+
+    inline void MemoryTcpPeer::sendPending() {
+
+      uint32_t flight,size;
+
+      if(_state!=State::ESTABLISHED)
+        return;
+
+      while(!_output.empty()) {
+
+        flight=_sendNext-_sendUnacknowledged;
+
+        if(flight>=_sendWindow)
+          return;
+
+        size=std::min<uint32_t>(std::min<uint32_t>(_remoteMss,MAXIMUM_SEGMENT_SIZE),_sendWindow-flight);
+        size=std::min<uint32_t>(size,_output.length());
+
+        transmit(TcpHeaderFlags::ACK | TcpHeaderFlags::PSH,_output.c_str(),size,false);
+
+        _sendNext+=size;
+        _output.erase(0,size);
+      }
+
+      if(_closing && !_finSent) {
+        transmit(TcpHeaderFlags::ACK | TcpHeaderFlags::FIN,nullptr,0,false);
+        _sendNext++;
+        _finSent=true;
+      }
+    }
+
+
+    /*
+     * Build a segment and put it on the wire. The checksum is left at zero like the IP header's.
+     */
+
+    inline void MemoryTcpPeer::transmit(TcpHeaderFlags flags,const void *data,uint16_t size,bool sendMss) {
+
+      TcpHeader *tcph;
+      uint8_t *options;
+      uint16_t tcpHeaderSize;
+
+      tcpHeaderSize=TcpHeader::getNoOptionsHeaderSize();
+
+      if(sendMss)
+        tcpHeaderSize+=TcpOptionMaximumSegmentSize::getSize()+(_offerSack ? 2+TcpOptionSackPermitted::getSize() : 0);
+
+      std::vector<uint8_t> frame(MemoryNetwork::createIpFrame(_macAddress,_address,IpProtocol::TCP,tcpHeaderSize+size,_identification++));
+
+      tcph=reinterpret_cast<TcpHeader *>(MemoryNetwork::getIpPayload(frame));
+      tcph->initialise(_port,_remotePort,_sendNext,_receiveNext,65535,flags);
+
+      if(sendMss) {
+
+        tcph->setSize(tcpHeaderSize);
+        reinterpret_cast<TcpOptionMaximumSegmentSize *>(tcph+1)->initialise(MAXIMUM_SEGMENT_SIZE);
+
+        if(_offerSack) {
+          options=reinterpret_cast<uint8_t *>(tcph+1)+TcpOptionMaximumSegmentSize::getSize();
+          reinterpret_cast<TcpOptionNop *>(options)->initialise();
+          reinterpret_cast<TcpOptionNop *>(options+1)->initialise();
+          reinterpret_cast<TcpOptionSackPermitted *>(options+2)->initialise();
+        }
+      }
+
+      if(size)
+        memcpy(reinterpret_cast<uint8_t *>(tcph)+tcpHeaderSize,data,size);
+
+      _network.transmit(frame);
+    }
+
+
+    /*
+     * Create a host
+     */
+
+    inline MemoryHost::MemoryHost(MemoryNetwork& network,const char *address)
+      : _network(network),
+        _address(address),
+        _identification(0) {
+
+      _macAddress=MemoryNetwork::getMacAddress(_address);
+      resetCounters();
+
+      _network.addHost(*this);
+    }
+
+
+    inline MemoryHost::~MemoryHost() {
+      _network.removeHost(*this);
+    }
+
+
+    /*
+     * Ask the stack for its MAC address
+     */
+
+    inline void MemoryHost::sendArpRequest() {
+
+      EthernetFrameData *efd;
+      ArpFrameData *request;
+
+      std::vector<uint8_t> frame(sizeof(EthernetFrameData));
+
+      efd=reinterpret_cast<EthernetFrameData *>(&frame[0]);
+      efd->eth_destinationAddress=MacAddress::createBroadcastAddress();
+      efd->eth_sourceAddress=_macAddress;
+      efd->eth_etherType=NetUtil::htons(static_cast<uint16_t>(EtherType::ARP));
+
+      request=reinterpret_cast<ArpFrameData *>(efd->eth_data);
+      request->initialise();
+      request->createRequest(MemoryNetwork::getStackAddress(),_macAddress,_address);
+
+      _network.transmit(frame);
+    }
+
+
+    /*
+     * Ping the stack
+     */
+
+    inline void MemoryHost::sendEchoRequest(uint16_t identifier,uint16_t sequenceNumber,const void *data,uint16_t size) {
+      sendEcho(IcmpType::ECHO_REQUEST,identifier,sequenceNumber,data,size);
+    }
+
+
+    inline void MemoryHost::sendEcho(IcmpType type,uint16_t identifier,uint16_t sequenceNumber,const void *data,uint16_t size) {
+
+      IcmpEchoRequest *echo;
+
+      std::vector<uint8_t> frame(MemoryNetwork::createIpFrame(_macAddress,_address,IpProtocol::ICMP,IcmpEchoRequest::getHeaderSize()+size,_identification++));
+
+      echo=reinterpret_cast<IcmpEchoRequest *>(MemoryNetwork::getIpPayload(frame));
+      echo->icmp_type=type;
+      echo->icmp_code=IcmpCode::ECHO_REQUEST;
+      echo->icmp_checksum=0;
+      echo->icmp_identifier=identifier;
+      echo->icmp_sequenceNumber=sequenceNumber;
+
+      if(size)
+        memcpy(echo->icmp_data,data,size);
+
+      _network.transmit(frame);
+    }
+
+
+    /*
+     * Send a datagram to the stack. The UDP checksum is optional and isn't sent.
+     */
+
+    inline void MemoryHost::sendUdp(uint16_t sourcePort,uint16_t destinationPort,const void *data,uint16_t size) {
+
+      UdpDatagram *udp;
+
+      std::vector<uint8_t> frame(MemoryNetwork::createIpFrame(_macAddress,_address,IpProtocol::UDP,UdpDatagram::getHeaderSize()+size,_identification++));
+
+      udp=reinterpret_cast<UdpDatagram *>(MemoryNetwork::getIpPayload(frame));
+      udp->udp_sourcePort=NetUtil::htons(sourcePort);
+      udp->udp_destinationPort=NetUtil::htons(destinationPort);
+      udp->udp_length=NetUtil::htons(UdpDatagram::getHeaderSize()+size);
+      udp->udp_checksum=0;
+
+      if(size)
+        memcpy(udp->udp_data,data,size);
+
+      _network.transmit(frame);
+    }
+
+
+    /*
+     * Get the oldest frame that the host kept
+     */
+
+    inline bool MemoryHost::getFrame(std::vector<uint8_t>& frame) {
+
+      if(_frames.empty())
+        return false;
+
+      frame.swap(_frames.front());
+      _frames.pop_front();
+      return true;
+    }
+
+
+    inline const MemoryHost::Counters& MemoryHost::getCounters() const {
+      return _counters;
+    }
+
+
+    inline void MemoryHost::resetCounters() {
+      memset(&_counters,0,sizeof(_counters));
+    }
+
+
+    inline const IpAddress& MemoryHost::getAddress() const {
+      return _address;
+    }
+
+
+    inline const MacAddress& MemoryHost::getMacAddress() const {
+      return _macAddress;
+    }
+
+
+    /*
+     * The stack's MAC address from its reply to sendArpRequest()
+     */
+
+    inline const MacAddress& MemoryHost::getStackMacAddress() const {
+      return _stackMacAddress;
+    }
+
+
+    inline void MemoryHost::answerArp(const ArpFrameData& request) {
+      _counters.ArpRequests++;
+      _network.answerArp(request,_macAddress,_address);
+    }
+
+
+    /*
+     * A frame from the stack. Echo requests are answered, ARP replies and echo replies are
+     * counted and everything else is kept.
+     */
+
+    inline void MemoryHost::receive(const std::vector<uint8_t>& frame) {
+
+      const EthernetFrameData *efd;
+      const IpPacketHeader *iph;
+      const IcmpEchoRequest *echo;
+      uint16_t ipHeaderLength;
+
+      efd=reinterpret_cast<const EthernetFrameData *>(&frame[0]);
+
+      if(NetUtil::ntohs(efd->eth_etherType)==static_cast<uint16_t>(EtherType::ARP)) {
+        _stackMacAddress=reinterpret_cast<const ArpFrameData *>(efd->eth_data)->arp_senderHardwareAddress;
+        _counters.ArpReplies++;
+        return;
+      }
+
+      iph=reinterpret_cast<const IpPacketHeader *>(efd->eth_data);
+
+      if(iph->ip_hdr_protocol==IpProtocol::ICMP) {
+
+        ipHeaderLength=(iph->ip_hdr_version & 0xf)*4;
+        echo=reinterpret_cast<const IcmpEchoRequest *>(efd->eth_data+ipHeaderLength);
+
+        if(echo->icmp_type==IcmpType::ECHO_REQUEST) {
+
+          _counters.EchoRequests++;
+
+          sendEcho(IcmpType::ECHO_REPLY,
+                   echo->icmp_identifier,
+                   echo->icmp_sequenceNumber,
+                   echo->icmp_data,
+                   NetUtil::ntohs(iph->ip_hdr_length)-ipHeaderLength-IcmpEchoRequest::getHeaderSize());
+          return;
+        }
+
+        if(echo->icmp_type==IcmpType::ECHO_REPLY) {
+          _counters.EchoReplies++;
+          return;
+        }
+      }
+
+      _frames.push_back(frame);
+    }
+  }
+}
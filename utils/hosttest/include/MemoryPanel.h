@@ -0,0 +1,233 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+
+namespace stm32plus {
+  namespace display {
+
+    /*
+     * Stand-in for the access mode that a panel driver is constructed with
+     */
+
+    struct MemoryPanelAccessMode {
+    };
+
+
+    /*
+     * A 320x240 64K colour panel in memory with the interface that GraphicsLibrary expects from
+     * a device driver. It keeps a GRAM address counter inside the current window like the real
+     * controllers do and counts the operations that cost time on a real panel. A window that
+     * is outside the panel or inside out is a bug in the caller and aborts the program.
+     */
+
+    class MemoryPanel {
+
+      public:
+
+        enum {
+          WIDTH = 320,
+          HEIGHT = 240
+        };
+
+        struct Counters {
+          uint32_t AxisChanges;           // each axis of a window counts one
+          uint32_t Writes;                // beginWriting() calls
+          uint32_t Pixels;                // pixels written
+          uint32_t RawTransfers;          // rawTransfer() calls
+          uint32_t Scrolls;               // setScrollPosition() calls
+        };
+
+      protected:
+        typedef uint32_t tCOLOUR;
+
+        struct UnpackedColour {
+          uint16_t packed565;
+        };
+
+        mutable std::vector<uint16_t> _gram;
+        mutable Counters _counters;
+        mutable int16_t _x1,_y1,_x2,_y2,_x,_y;
+        mutable int16_t _scrollPosition;
+
+      protected:
+        void setWindow(int16_t x1,int16_t y1,int16_t x2,int16_t y2) const;
+        void put(uint16_t colour) const;
+
+      public:
+        MemoryPanel(MemoryPanelAccessMode& accessMode);
+
+        void initialise() const {}
+
+        constexpr int16_t getWidth() const { return WIDTH; }
+        constexpr int16_t getHeight() const { return HEIGHT; }
+
+        void unpackColour(tCOLOUR src,UnpackedColour& dest) const;
+        void unpackColour(uint8_t r,uint8_t g,uint8_t b,UnpackedColour& dest) const;
+
+        void moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend) const;
+        void moveTo(const Rectangle& rc) const;
+        void moveX(int16_t xstart,int16_t xend) const;
+        void moveY(int16_t ystart,int16_t yend) const;
+        void setScrollPosition(int16_t scrollPosition) const;
+
+        void beginWriting() const;
+        void writePixel(const UnpackedColour& cr) const;
+        void writePixelAgain(const UnpackedColour& cr) const;
+        void fillPixels(uint32_t numPixels,const UnpackedColour& cr) const;
+        void allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const;
+        void rawTransfer(const void *buffer,uint32_t numPixels) const;
+
+        const std::vector<uint16_t>& getGram() const { return _gram; }
+        std::vector<uint16_t> getVisible() const;
+        const Counters& getCounters() const { return _counters; }
+        void resetCounters() { memset(&_counters,0,sizeof(_counters)); }
+    };
+
+
+    inline MemoryPanel::MemoryPanel(MemoryPanelAccessMode& /* accessMode */)
+      : _gram(WIDTH*HEIGHT),
+        _scrollPosition(0) {
+
+      resetCounters();
+      setWindow(0,0,WIDTH-1,HEIGHT-1);
+    }
+
+
+    inline void MemoryPanel::unpackColour(tCOLOUR src,UnpackedColour& dest) const {
+      dest.packed565=(src & 0xf80000) >> 8 | (src & 0xfc00) >> 5 | (src & 0xf8) >> 3;
+    }
+
+
+    inline void MemoryPanel::unpackColour(uint8_t r,uint8_t g,uint8_t b,UnpackedColour& dest) const {
+      dest.packed565=(r & 0xf8) << 8 | (g & 0xfc) << 3 | (b & 0xf8) >> 3;
+    }
+
+
+    inline void MemoryPanel::setWindow(int16_t x1,int16_t y1,int16_t x2,int16_t y2) const {
+
+      if(x1<0 || y1<0 || x2>=WIDTH || y2>=HEIGHT || x1>x2 || y1>y2) {
+        fprintf(stderr,"MemoryPanel: bad window (%d,%d)-(%d,%d)\n",x1,y1,x2,y2);
+        abort();
+      }
+
+      _x=_x1=x1;
+      _y=_y1=y1;
+      _x2=x2;
+      _y2=y2;
+    }
+
+
+    inline void MemoryPanel::put(uint16_t colour) const {
+
+      _gram[_y*WIDTH+_x]=colour;
+      _counters.Pixels++;
+
+      if(++_x>_x2) {
+        _x=_x1;
+        if(++_y>_y2)
+          _y=_y1;
+      }
+    }
+
+
+    inline void MemoryPanel::moveTo(int16_t xstart,int16_t ystart,int16_t xend,int16_t yend) const {
+      _counters.AxisChanges+=2;
+      setWindow(xstart,ystart,xend,yend);
+    }
+
+
+    inline void MemoryPanel::moveTo(const Rectangle& rc) const {
+      moveTo(rc.X,rc.Y,rc.X+rc.Width-1,rc.Y+rc.Height-1);
+    }
+
+
+    inline void MemoryPanel::moveX(int16_t xstart,int16_t xend) const {
+      _counters.AxisChanges++;
+      setWindow(xstart,_y1,xend,_y2);
+    }
+
+
+    inline void MemoryPanel::moveY(int16_t ystart,int16_t yend) const {
+      _counters.AxisChanges++;
+      setWindow(_x1,ystart,_x2,yend);
+    }
+
+
+    inline void MemoryPanel::setScrollPosition(int16_t scrollPosition) const {
+      _scrollPosition=scrollPosition;
+      _counters.Scrolls++;
+    }
+
+
+    /*
+     * Get what's on the screen, which is the GRAM rotated up by the scroll position
+     */
+
+    inline std::vector<uint16_t> MemoryPanel::getVisible() const {
+
+      std::vector<uint16_t> visible;
+      int16_t y,row;
+
+      for(y=0;y<HEIGHT;y++) {
+        row=(y+_scrollPosition) % HEIGHT;
+        visible.insert(visible.end(),_gram.begin()+row*WIDTH,_gram.begin()+(row+1)*WIDTH);
+      }
+
+      return visible;
+    }
+
+
+    inline void MemoryPanel::beginWriting() const {
+      _x=_x1;
+      _y=_y1;
+      _counters.Writes++;
+    }
+
+
+    inline void MemoryPanel::writePixel(const UnpackedColour& cr) const {
+      put(cr.packed565);
+    }
+
+
+    inline void MemoryPanel::writePixelAgain(const UnpackedColour& cr) const {
+      put(cr.packed565);
+    }
+
+
+    inline void MemoryPanel::fillPixels(uint32_t numPixels,const UnpackedColour& cr) const {
+
+      beginWriting();
+
+      while(numPixels--)
+        put(cr.packed565);
+    }
+
+
+    inline void MemoryPanel::allocatePixelBuffer(uint32_t numPixels,uint8_t*& buffer,uint32_t& bytesPerPixel) const {
+      buffer=new uint8_t[numPixels*2];
+      bytesPerPixel=2;
+    }
+
+
+    inline void MemoryPanel::rawTransfer(const void *buffer,uint32_t numPixels) const {
+
+      const uint16_t *ptr;
+
+      _counters.RawTransfers++;
+
+      for(ptr=static_cast<const uint16_t *>(buffer);numPixels--;ptr++)
+        put(*ptr);
+    }
+
+
+    typedef GraphicsLibrary<MemoryPanel,MemoryPanelAccessMode> MemoryGraphicsLibrary;
+  }
+}
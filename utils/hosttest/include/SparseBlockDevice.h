@@ -0,0 +1,174 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdio>
+#include <unordered_map>
+
+
+namespace stm32plus {
+
+  /*
+   * A block device in memory that only stores the blocks that aren't all zeros, so that the
+   * images of large cards fit in memory as long as most of the card is never written. It has
+   * 512 byte blocks and no MBR and counts the calls and blocks that go through it. It can be
+   * copied to start several runs from the same image.
+   */
+
+  class SparseBlockDevice : public BlockDevice {
+
+    public:
+
+      enum {
+        BLOCK_SIZE = 512
+      };
+
+      struct Counters {
+        uint32_t ReadCalls;             // readBlock() and readBlocks() calls
+        uint32_t WriteCalls;            // writeBlock() and writeBlocks() calls
+        uint32_t BlocksRead;
+        uint32_t BlocksWritten;
+      };
+
+    protected:
+      typedef std::array<uint8_t,BLOCK_SIZE> Block;
+
+      std::unordered_map<uint32_t,Block> _blocks;
+      uint32_t _numBlocks;
+      Counters _counters;
+
+    protected:
+      void check(uint32_t blockIndex,uint32_t numBlocks) const;
+
+    public:
+      SparseBlockDevice(uint32_t numBlocks);
+
+      const Counters& getCounters() const;
+      void resetCounters();
+      uint32_t getStoredBlocks() const;
+
+      // overrides from BlockDevice
+
+      virtual uint32_t getTotalBlocksOnDevice() override;
+      virtual uint32_t getBlockSizeInBytes() override;
+      virtual bool readBlock(void *dest,uint32_t blockIndex) override;
+      virtual bool readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) override;
+      virtual bool writeBlock(const void *src,uint32_t blockIndex) override;
+      virtual bool writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) override;
+      virtual formatType getFormatType() override;
+  };
+
+
+  /*
+   * Create a device full of zeros
+   */
+
+  inline SparseBlockDevice::SparseBlockDevice(uint32_t numBlocks)
+    : _numBlocks(numBlocks) {
+
+    resetCounters();
+  }
+
+
+  inline const SparseBlockDevice::Counters& SparseBlockDevice::getCounters() const {
+    return _counters;
+  }
+
+
+  inline void SparseBlockDevice::resetCounters() {
+    memset(&_counters,0,sizeof(_counters));
+  }
+
+
+  /*
+   * The number of blocks that aren't all zeros
+   */
+
+  inline uint32_t SparseBlockDevice::getStoredBlocks() const {
+    return _blocks.size();
+  }
+
+
+  inline void SparseBlockDevice::check(uint32_t blockIndex,uint32_t numBlocks) const {
+
+    if(numBlocks==0 || blockIndex>=_numBlocks || numBlocks>_numBlocks-blockIndex) {
+      fprintf(stderr,"SparseBlockDevice: bad block range %u+%u\n",static_cast<unsigned>(blockIndex),static_cast<unsigned>(numBlocks));
+      abort();
+    }
+  }
+
+
+  inline uint32_t SparseBlockDevice::getTotalBlocksOnDevice() {
+    return _numBlocks;
+  }
+
+
+  inline uint32_t SparseBlockDevice::getBlockSizeInBytes() {
+    return BLOCK_SIZE;
+  }
+
+
+  inline bool SparseBlockDevice::readBlock(void *dest,uint32_t blockIndex) {
+    return readBlocks(dest,blockIndex,1);
+  }
+
+
+  inline bool SparseBlockDevice::readBlocks(void *dest,uint32_t blockIndex,uint32_t numBlocks) {
+
+    uint8_t *ptr;
+
+    check(blockIndex,numBlocks);
+
+    _counters.ReadCalls++;
+    _counters.BlocksRead+=numBlocks;
+
+    for(ptr=static_cast<uint8_t *>(dest);numBlocks--;ptr+=BLOCK_SIZE) {
+
+      auto it=_blocks.find(blockIndex++);
+
+      if(it==_blocks.end())
+        memset(ptr,0,BLOCK_SIZE);
+      else
+        memcpy(ptr,it->second.data(),BLOCK_SIZE);
+    }
+
+    return true;
+  }
+
+
+  inline bool SparseBlockDevice::writeBlock(const void *src,uint32_t blockIndex) {
+    return writeBlocks(src,blockIndex,1);
+  }
+
+
+  inline bool SparseBlockDevice::writeBlocks(const void *src,uint32_t blockIndex,uint32_t numBlocks) {
+
+    static const Block zeros={};
+    const uint8_t *ptr;
+
+    check(blockIndex,numBlocks);
+
+    _counters.WriteCalls++;
+    _counters.BlocksWritten+=numBlocks;
+
+    for(ptr=static_cast<const uint8_t *>(src);numBlocks--;ptr+=BLOCK_SIZE,blockIndex++) {
+
+      if(memcmp(ptr,zeros.data(),BLOCK_SIZE)==0)
+        _blocks.erase(blockIndex);
+      else
+        memcpy(_blocks[blockIndex].data(),ptr,BLOCK_SIZE);
+    }
+
+    return true;
+  }
+
+
+  inline BlockDevice::formatType SparseBlockDevice::getFormatType() {
+    return formatNoMbr;
+  }
+}
@@ -0,0 +1,40 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+/*
+ * Host stand-in for the TFT configuration. It has the graphics library and the sample fonts
+ * but none of the access modes or panel drivers. MemoryPanel.h provides a panel to draw on.
+ */
+
+#include "config/timing.h"
+#include "config/stream.h"
+#include "config/display/font.h"
+#include "string/StringUtil.h"
+#include "dma/features/DmaLcdWriter.h"
+
+#define DMA_Priority_High 0
+
+#include "display/Point.h"
+#include "display/Size.h"
+#include "display/Rectangle.h"
+
+#include "display/graphic/fonts/Font_apple_8.h"
+#include "display/graphic/fonts/Font_volter_goldfish_9.h"
+#include "display/graphic/fonts/Font_atari_st_16.h"
+#include "display/graphic/fonts/Font_dos_16.h"
+
+#include "display/graphic/ColourNames.h"
+#include "display/graphic/GraphicTerminal.h"
+#include "display/graphic/PanelConfiguration.h"
+#include "display/graphic/PicoJpeg.h"
+#include "display/graphic/JpegDecoder.h"
+#include "display/graphic/GlyphCache.h"
+#include "display/graphic/GraphicsLibrary.h"
+#include "display/graphic/framebuffer/DirtyRectangleList.h"
+#include "display/graphic/framebuffer/FrameBufferDevice.h"
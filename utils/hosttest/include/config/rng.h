@@ -0,0 +1,33 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /*
+   * Host stand-in for the random number generator. The sequence is fixed so that runs are
+   * repeatable.
+   */
+
+  class DefaultRng {
+
+    protected:
+      uint32_t _state;
+
+    public:
+      DefaultRng()
+        : _state(1) {
+      }
+
+      bool nextRandom(uint32_t& value) {
+        _state=_state*1103515245+12345;
+        value=_state;
+        return true;
+      }
+  };
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /*
+   * Host stand-in for the RTC. The tick is the host millisecond counter in seconds.
+   */
+
+  class RtcBase {
+
+    public:
+      uint32_t getTick() const {
+        return MillisecondTimer::millis()/1000;
+      }
+  };
+
+
+  DECLARE_EVENT_SIGNATURE(RtcSecondInterrupt,void());
+
+
+  /*
+   * Host stand-in for the F1 RTC's per-second interrupt. The interrupt is raised by calling
+   * secondInterrupt() when the test has moved the millisecond counter on by a second.
+   */
+
+  class RtcSecondInterruptFeature : public RtcBase {
+
+    protected:
+      bool _enabled;
+
+    public:
+      DECLARE_EVENT_SOURCE(RtcSecondInterrupt);
+
+      RtcSecondInterruptFeature()
+        : _enabled(false) {
+      }
+
+      void enableSecondInterrupt() {
+        _enabled=true;
+      }
+
+      void disableSecondInterrupt() {
+        _enabled=false;
+      }
+
+      void secondInterrupt() {
+        if(_enabled)
+          RtcSecondInterruptEventSender.raiseEvent();
+      }
+  };
+}
@@ -0,0 +1,33 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+/*
+ * Host stand-in for the main configuration header. It provides just enough of the
+ * environment for the hardware independent headers to compile on a PC.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "error/ErrorProvider.h"
+
+
+namespace stm32plus {
+
+  /*
+   * There are no interrupts on the host
+   */
+
+  struct IrqSuspend {
+    IrqSuspend() {}
+    ~IrqSuspend() {}
+  };
+}
@@ -0,0 +1,28 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+/*
+ * Host stand-in for the stream configuration. The streams that depend on the MCU timers
+ * are left out.
+ */
+
+#include <string>
+
+#include "util/DoublePrecision.h"
+#include "memory/scoped_array.h"
+
+#include "stream/StreamBase.h"
+#include "stream/InputStream.h"
+#include "stream/OutputStream.h"
+#include "stream/Reader.h"
+#include "stream/ByteArrayInputStream.h"
+#include "stream/StlStringInputStream.h"
+#include "stream/LzgDecompressionInputStream.h"
+#include "stream/BufferedInputOutputStream.h"
+#include "stream/LinearBufferInputOutputStream.h"
@@ -0,0 +1,69 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+
+  /*
+   * Host stand-in for the SysTick millisecond counter. Time only moves when a test moves it
+   * so that timeouts are repeatable. A delay moves it on by the amount of the delay.
+   *
+   * Code that waits for an interrupt spins on the timer, so a test can install a function
+   * that's called when the timer is read to do what the interrupts would have done. It is not
+   * called again while it's running, just as an IRQ doesn't pre-empt itself.
+   */
+
+  class MillisecondTimer {
+
+    public:
+      typedef void (*InterruptFunction)();
+
+      static uint32_t &counter() {
+        static uint32_t value=0;
+        return value;
+      }
+
+      static InterruptFunction &interrupt() {
+        static InterruptFunction fn=nullptr;
+        return fn;
+      }
+
+      static void runInterrupt() {
+
+        static bool running=false;
+
+        if(interrupt() && !running) {
+          running=true;
+          interrupt()();
+          running=false;
+        }
+      }
+
+      static void initialise() {}
+      static void delay(uint32_t millis) { counter()+=millis; }
+      static uint32_t millis() { runInterrupt(); return counter(); }
+      static void reset() { counter()=0; }
+      static void advance(uint32_t millis) { counter()+=millis; }
+
+      static bool hasTimedOut(uint32_t start,uint32_t timeout) {
+        return difference(start)>timeout;
+      }
+
+      static uint32_t difference(uint32_t start) {
+        return millis()-start;
+      }
+  };
+}
+
+
+// the time providers that don't need the RTC
+
+#include <ctime>
+
+#include "timing/TimeProvider.h"
+#include "timing/NullTimeProvider.h"
@@ -0,0 +1,37 @@
+/*
+ * This file is a part of the open source stm32plus library.
+ * Copyright (c) 2011,2012,2013,2014 Andy Brown <www.andybrown.me.uk>
+ * Please see website for licensing terms.
+ */
+
+#pragma once
+
+
+namespace stm32plus {
+  namespace net {
+
+    /*
+     * Host stand-in for the byte order functions, which use the ARM rev instructions. The
+     * host is little-endian like the MCU.
+     */
+
+    namespace NetUtil {
+
+      inline static uint16_t ntohs(uint16_t data) {
+        return __builtin_bswap16(data);
+      }
+
+      inline static uint32_t ntohl(uint32_t data) {
+        return __builtin_bswap32(data);
+      }
+
+      inline static uint16_t htons(uint16_t data) {
+        return __builtin_bswap16(data);
+      }
+
+      inline static uint32_t htonl(uint32_t data) {
+        return __builtin_bswap32(data);
+      }
+    }
+  }
+}